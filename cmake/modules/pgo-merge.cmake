@@ -0,0 +1,14 @@
+# Merges the raw clang profiles of a pgo-train run, called in script mode
+# by the pgo-train target of pgo.cmake.
+
+file(GLOB _raw "${PGO_PROFILE_DIR}/*.profraw")
+if(NOT _raw)
+    message(FATAL_ERROR "No profile in ${PGO_PROFILE_DIR}, did the client exit cleanly?")
+endif()
+execute_process(
+    COMMAND ${LLVM_PROFDATA_BIN} merge -output=${PGO_PROFILE_DIR}/psi.profdata ${_raw}
+    RESULT_VARIABLE _result
+)
+if(NOT _result EQUAL 0)
+    message(FATAL_ERROR "llvm-profdata failed")
+endif()
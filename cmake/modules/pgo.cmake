@@ -0,0 +1,50 @@
+cmake_minimum_required( VERSION 3.1.0 )
+
+# pgo-train runs the instrumented client through a load session of
+# qa/integration/load, which covers the roster and message rendering paths
+# the optimized build is meant for, and leaves the profile in
+# PGO_PROFILE_DIR for the PGO_MODE=USE build.
+
+find_program(RUBY_BIN ruby DOC "Path to ruby binary")
+if(NOT RUBY_BIN)
+    message(WARNING "Ruby not found, no pgo-train target")
+    return()
+endif()
+
+set(PGO_TRAIN_CONTACTS 1000 CACHE STRING "Roster size of the pgo-train load session")
+set(PGO_TRAIN_SESSION "--rooms 10 --talkers 10 --rate 5 --churn 10 --transfers 2 --duration 300"
+    CACHE STRING "Options of the pgo-train load session")
+
+set(_load_script ${PROJECT_SOURCE_DIR}/qa/integration/load/load.rb)
+separate_arguments(_session UNIX_COMMAND "${PGO_TRAIN_SESSION}")
+
+set(_merge_command)
+if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    get_filename_component(_llvm_dir ${CMAKE_CXX_COMPILER} DIRECTORY)
+    find_program(LLVM_PROFDATA_BIN llvm-profdata HINTS ${_llvm_dir} DOC "Path to llvm-profdata binary")
+    if(NOT LLVM_PROFDATA_BIN)
+        message(WARNING "llvm-profdata not found, no pgo-train target")
+        return()
+    endif()
+    # clang wants the raw profiles of all runs merged into one
+    set(_merge_command
+        COMMAND ${CMAKE_COMMAND}
+        -DLLVM_PROFDATA_BIN=${LLVM_PROFDATA_BIN}
+        -DPGO_PROFILE_DIR=${PGO_PROFILE_DIR}
+        -P ${PROJECT_SOURCE_DIR}/cmake/modules/pgo-merge.cmake
+    )
+endif()
+
+add_custom_target(pgo-train
+    # a stale profile of an older build would only get in the way
+    COMMAND ${CMAKE_COMMAND} -E remove_directory ${PGO_PROFILE_DIR}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${PGO_PROFILE_DIR}
+    COMMAND ${RUBY_BIN} ${_load_script} prepare ${PGO_TRAIN_CONTACTS}
+    COMMAND ${CMAKE_COMMAND} -E env PSI=$<TARGET_FILE:${PROJECT_NAME}>
+    ${RUBY_BIN} ${_load_script} run ${_session} --out ${PGO_PROFILE_DIR}/load
+    ${_merge_command}
+    DEPENDS ${PROJECT_NAME}
+    COMMENT "Train the instrumented ${PROJECT_NAME} with a load session"
+    USES_TERMINAL
+    VERBATIM
+)
@@ -0,0 +1,45 @@
+# Runs one load session of Psi under a profiler, called in script mode by
+# the profile-* targets of profiling.cmake.
+
+string(TIMESTAMP _stamp "%Y%m%d-%H%M%S")
+set(_dir "${OUTPUT_DIR}/${TOOL}-${_stamp}")
+file(MAKE_DIRECTORY "${_dir}")
+
+set(_valgrind_options "--num-callers=40")
+if(EXISTS "${SUPPRESSIONS}")
+    set(_valgrind_options "${_valgrind_options} --suppressions=${SUPPRESSIONS}")
+endif()
+
+if(TOOL STREQUAL "heaptrack")
+    set(_wrapper "${HEAPTRACK_BIN} -o ${_dir}/heaptrack")
+elseif(TOOL STREQUAL "massif")
+    set(_wrapper "${VALGRIND_BIN} --tool=massif ${_valgrind_options} --massif-out-file=${_dir}/massif.out")
+elseif(TOOL STREQUAL "callgrind")
+    set(_wrapper "${VALGRIND_BIN} --tool=callgrind ${_valgrind_options} --dump-instr=yes --callgrind-out-file=${_dir}/callgrind.out")
+else()
+    message(FATAL_ERROR "Unknown profiler: ${TOOL}")
+endif()
+
+# load.rb starts the client as $PSI and waits for it to exit, so the
+# profiler has written its data when the run returns
+separate_arguments(_session UNIX_COMMAND "${SESSION}")
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -E env "PSI=${_wrapper} ${PSI}"
+    ${RUBY_BIN} ${LOAD_SCRIPT} run ${_session} --out ${_dir}
+    RESULT_VARIABLE _result
+)
+if(NOT _result EQUAL 0)
+    message(FATAL_ERROR "The load run failed, did you run 'load.rb prepare'?")
+endif()
+
+if(TOOL STREQUAL "heaptrack")
+    # heaptrack picks the compression suffix itself
+    file(GLOB _data "${_dir}/heaptrack.*")
+    execute_process(COMMAND ${HEAPTRACK_PRINT_BIN} ${_data} OUTPUT_FILE "${_dir}/report.txt")
+elseif(TOOL STREQUAL "massif")
+    execute_process(COMMAND ${MS_PRINT_BIN} "${_dir}/massif.out" OUTPUT_FILE "${_dir}/report.txt")
+else()
+    execute_process(COMMAND ${CALLGRIND_ANNOTATE_BIN} --inclusive=yes "${_dir}/callgrind.out"
+                    OUTPUT_FILE "${_dir}/report.txt")
+endif()
+message(STATUS "Report written to ${_dir}/report.txt")
@@ -0,0 +1,57 @@
+cmake_minimum_required( VERSION 3.1.0 )
+
+# profile-heaptrack, profile-massif and profile-callgrind run the load
+# session of qa/integration/load under the profiler and write the report
+# next to the samples of the run. The session options are fixed by
+# PROFILE_SESSION, so reports of two builds are comparable.
+
+find_program(HEAPTRACK_BIN heaptrack DOC "Path to heaptrack binary")
+find_program(HEAPTRACK_PRINT_BIN heaptrack_print DOC "Path to heaptrack_print binary")
+find_program(VALGRIND_BIN valgrind DOC "Path to valgrind binary")
+find_program(MS_PRINT_BIN ms_print DOC "Path to ms_print binary")
+find_program(CALLGRIND_ANNOTATE_BIN callgrind_annotate DOC "Path to callgrind_annotate binary")
+find_program(RUBY_BIN ruby DOC "Path to ruby binary")
+
+set(PROFILE_SESSION "--rooms 5 --talkers 10 --rate 2 --churn 5 --transfers 1 --duration 120"
+    CACHE STRING "Options of the load run done by the profile-* targets")
+set(PROFILE_OUTPUT_DIR "${CMAKE_BINARY_DIR}/profiling" CACHE PATH "Where the profile-* targets write their reports")
+
+if(NOT RUBY_BIN)
+    message(STATUS "Ruby not found, no profile-* targets")
+    return()
+endif()
+
+set(_profile_tools)
+if(HEAPTRACK_BIN AND HEAPTRACK_PRINT_BIN)
+    list(APPEND _profile_tools heaptrack)
+endif()
+if(VALGRIND_BIN AND MS_PRINT_BIN)
+    list(APPEND _profile_tools massif)
+endif()
+if(VALGRIND_BIN AND CALLGRIND_ANNOTATE_BIN)
+    list(APPEND _profile_tools callgrind)
+endif()
+
+foreach(_tool ${_profile_tools})
+    add_custom_target(profile-${_tool}
+        COMMAND ${CMAKE_COMMAND}
+        -DTOOL=${_tool}
+        -DPSI=$<TARGET_FILE:${PROJECT_NAME}>
+        -DSESSION=${PROFILE_SESSION}
+        -DOUTPUT_DIR=${PROFILE_OUTPUT_DIR}
+        -DLOAD_SCRIPT=${PROJECT_SOURCE_DIR}/qa/integration/load/load.rb
+        -DSUPPRESSIONS=${PROJECT_SOURCE_DIR}/qa/valgrind/valgrind.supp
+        -DRUBY_BIN=${RUBY_BIN}
+        -DHEAPTRACK_BIN=${HEAPTRACK_BIN}
+        -DHEAPTRACK_PRINT_BIN=${HEAPTRACK_PRINT_BIN}
+        -DVALGRIND_BIN=${VALGRIND_BIN}
+        -DMS_PRINT_BIN=${MS_PRINT_BIN}
+        -DCALLGRIND_ANNOTATE_BIN=${CALLGRIND_ANNOTATE_BIN}
+        -P ${PROJECT_SOURCE_DIR}/cmake/modules/profile-session.cmake
+        DEPENDS ${PROJECT_NAME}
+        COMMENT "Run a load session of ${PROJECT_NAME} under ${_tool}"
+        USES_TERMINAL
+        VERBATIM
+    )
+endforeach()
+message(STATUS "Profiling targets: ${_profile_tools}")
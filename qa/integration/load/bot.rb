@@ -0,0 +1,108 @@
+#!/usr/bin/env ruby -wKU
+
+# A tiny XMPP client for the load bots. It talks plain c2s with
+# jabber:iq:auth, which the test server has enabled, so it needs nothing
+# but the standard library.
+
+require "socket"
+require "rexml/document"
+require "rexml/parsers/sax2parser"
+require "rexml/source"
+require "thread"
+
+class Bot
+  attr_reader :jid
+
+  def initialize(user, password, host = "localhost", port = 5222)
+    @user, @password, @host, @port = user, password, host, port
+    @jid = "#{user}@#{host}/load"
+    @mutex = Mutex.new
+    @handlers = {}
+    @waiting = {}
+    @next_id = 0
+  end
+
+  # handler gets each incoming stanza as a REXML::Element
+  def on(name, &block)
+    @handlers[name] = block
+  end
+
+  def connect
+    @socket = TCPSocket.new(@host, @port)
+    send_raw("<?xml version='1.0'?><stream:stream to='#{@host}' xmlns='jabber:client' " +
+             "xmlns:stream='http://etherx.jabber.org/streams'>")
+    @reader = Thread.new { read_loop }
+    result = request("<iq type='set'><query xmlns='jabber:iq:auth'><username>#{@user}</username>" +
+                     "<password>#{@password}</password><resource>load</resource></query></iq>")
+    raise "#{@user}: authentication failed" if result.nil? || result.attributes["type"] != "result"
+    self
+  end
+
+  def close
+    send_raw("</stream:stream>") rescue nil
+    @socket.close rescue nil
+  end
+
+  def send_raw(xml)
+    @mutex.synchronize { @socket.write(xml) }
+  end
+
+  # sends an iq and waits for its answer, nil on timeout
+  def request(xml, timeout = 30)
+    id = nil
+    queue = Queue.new
+    @mutex.synchronize do
+      id = "l#{@next_id += 1}"
+      @waiting[id] = queue
+    end
+    send_raw(xml.sub(/^<iq /, "<iq id='#{id}' "))
+    waiter = Thread.new { queue.pop }
+    waiter.join(timeout) ? waiter.value : nil
+  ensure
+    @mutex.synchronize { @waiting.delete(id) }
+  end
+
+  def presence(show = nil, status = nil, to = nil)
+    xml = "<presence#{to ? " to='#{to}'" : ""}>"
+    xml << "<show>#{show}</show>" if show
+    xml << "<status>#{REXML::Text.normalize(status)}</status>" if status
+    xml << "</presence>"
+    send_raw(xml)
+  end
+
+  def message(to, body, type = "chat")
+    send_raw("<message to='#{to}' type='#{type}'><body>#{REXML::Text.normalize(body)}</body></message>")
+  end
+
+  private
+
+  def read_loop
+    parser = REXML::Parsers::SAX2Parser.new(REXML::IOSource.new(@socket))
+    stack = []
+    parser.listen(:start_element) do |uri, local, qname, attrs|
+      el = REXML::Element.new(qname)
+      attrs.each { |k, v| el.add_attribute(k, v) }
+      stack.last.add_element(el) if stack.size > 1
+      stack.push(el)
+    end
+    parser.listen(:characters) do |text|
+      stack.last.add_text(text) if stack.size > 1
+    end
+    parser.listen(:end_element) do |uri, local, qname|
+      el = stack.pop
+      dispatch(el) if stack.size == 1
+    end
+    parser.parse
+  rescue IOError, SystemCallError, REXML::ParseException
+    # the stream is gone
+  end
+
+  def dispatch(stanza)
+    queue = @mutex.synchronize { @waiting[stanza.attributes["id"]] }
+    if queue && stanza.name == "iq" && stanza.attributes["type"] =~ /result|error/
+      queue.push(stanza)
+    elsif (handler = @handlers[stanza.name])
+      handler.call(stanza)
+    end
+  end
+end
@@ -0,0 +1,248 @@
+#!/usr/bin/env ruby -wKU
+
+# Drives Psi under a production-like load and records how the client copes.
+#
+#   load.rb prepare [contacts]   writes server data: user01 with a roster of bots
+#   load.rb run [options]        starts Prosody, Psi and the bot fleet
+#
+# user01 is the account of the psi-data profile. Of the bots, the first one
+# is the probe: it pings the client once a second, so the round trip shows
+# how long the client's event loop is kept busy, and it notes when the
+# client's presence shows up, which happens once the roster is loaded.
+# CPU and RSS of the Psi process are sampled alongside.
+
+$LOAD_PATH.unshift(File.dirname(__FILE__))
+$LOAD_PATH.unshift(File.dirname(__FILE__) + "/..")
+require "config.rb"
+require "bot.rb"
+require "fileutils"
+require "optparse"
+
+PWD        = File.expand_path(File.dirname(__FILE__))
+DATA       = PWD + "/data"
+PSIDATADIR = PWD + "/psi-data"
+CLIENT     = "user01@localhost"
+MUC_HOST   = "conference.example.com"
+PSI        = ENV["PSI"] || (RUBY_PLATFORM =~ /darwin/ ?
+                            PWD + "/../../../src/psi.app/Contents/MacOS/psi" : PWD + "/../../../src/psi")
+
+def bot_name(i)
+  "bot%05d" % i
+end
+
+def write_lua(path, entries)
+  FileUtils.mkdir_p(File.dirname(path))
+  File.open(path, "w") do |f|
+    f.puts "return {"
+    entries.each { |line| f.puts "\t#{line}" }
+    f.print "}"
+  end
+end
+
+def roster_item(jid, name, group)
+  "[\"#{jid}\"] = { [\"subscription\"] = \"both\", [\"groups\"] = { [\"#{group}\"] = true }, [\"name\"] = \"#{name}\" },"
+end
+
+def prepare(contacts)
+  FileUtils.rm_rf(DATA)
+  host = DATA + "/localhost"
+  items = (1..contacts).map { |i| roster_item("#{bot_name(i)}@localhost", bot_name(i), "group%02d" % (i % 20)) }
+  write_lua(host + "/accounts/user01.dat", ["[\"password\"] = \"user01\","])
+  write_lua(host + "/roster/user01.dat", ["[false] = { [\"version\"] = 1 },", "[\"pending\"] = { },"] + items)
+  (1..contacts).each do |i|
+    write_lua(host + "/accounts/#{bot_name(i)}.dat", ["[\"password\"] = \"#{bot_name(i)}\","])
+    write_lua(host + "/roster/#{bot_name(i)}.dat",
+              ["[false] = { [\"version\"] = 1 },", "[\"pending\"] = { },", roster_item(CLIENT, "user01", "load")])
+  end
+
+  # the integration profile, logging in on startup
+  FileUtils.rm_rf(PSIDATADIR)
+  FileUtils.cp_r(PWD + "/../psi-data", PSIDATADIR)
+  accounts = PSIDATADIR + "/profiles/default/accounts.xml"
+  File.write(accounts, File.read(accounts).sub("<auto type=\"bool\">false</auto>", "<auto type=\"bool\">true</auto>"))
+  puts "#{contacts} contacts written to #{DATA}"
+end
+
+class Metrics
+  def initialize(dir)
+    FileUtils.mkdir_p(dir)
+    @dir = dir
+    @samples = File.open(dir + "/samples.csv", "w")
+    @samples.puts "time,ping_ms,cpu_percent,rss_kb"
+    @pings = []
+    @cpus = []
+    @rss = []
+    @mutex = Mutex.new
+    @start = Time.now
+  end
+
+  attr_accessor :roster_time
+
+  def elapsed
+    Time.now - @start
+  end
+
+  def sample(ping_ms, cpu, rss)
+    @mutex.synchronize do
+      @pings << ping_ms if ping_ms
+      @cpus << cpu if cpu
+      @rss << rss if rss
+      @samples.puts [format("%.1f", elapsed), ping_ms, cpu, rss].join(",")
+      @samples.flush
+    end
+  end
+
+  def percentile(list, p)
+    return nil if list.empty?
+    sorted = list.sort
+    sorted[[(sorted.size * p).ceil - 1, 0].max]
+  end
+
+  def summary(options)
+    lines = options.map { |k, v| "#{k}: #{v}" }
+    lines << "roster_ready_s: #{roster_time ? format("%.2f", roster_time) : "never"}"
+    lines << "ping_median_ms: #{percentile(@pings, 0.5)}"
+    lines << "ping_p95_ms: #{percentile(@pings, 0.95)}"
+    lines << "ping_max_ms: #{@pings.max}"
+    lines << "pings_lost: #{@lost || 0}"
+    lines << "cpu_mean_percent: #{@cpus.empty? ? nil : format("%.1f", @cpus.inject(:+) / @cpus.size)}"
+    lines << "rss_max_kb: #{@rss.max}"
+    File.write(@dir + "/summary.txt", lines.join("\n") + "\n")
+    puts lines
+  end
+
+  def lost
+    @mutex.synchronize { @lost = (@lost || 0) + 1 }
+  end
+end
+
+def process_stats(pid)
+  cpu, rss = `ps -o %cpu= -o rss= -p #{pid}`.split
+  [cpu && cpu.to_f, rss && rss.to_i]
+end
+
+def run(opts)
+  contacts = Dir[DATA + "/localhost/accounts/bot*.dat"].size
+  abort "run 'load.rb prepare' first" if contacts == 0
+  opts[:contacts] = contacts
+
+  ENV["PROSODY_CFGDIR"]  = PWD + "/../prosody"
+  ENV["PROSODY_DATADIR"] = DATA
+  server = Process.spawn("./prosody", :chdir => PROSODY_DIR)
+  sleep 2
+
+  probe = Bot.new(bot_name(1), bot_name(1)).connect
+  probe.presence
+  # the roster is online before the client logs in
+  bots = (2..contacts).map do |i|
+    Bot.new(bot_name(i), bot_name(i)).connect rescue nil
+  end.compact
+  bots.each { |b| b.presence }
+
+  ENV["PSIDATADIR"] = PSIDATADIR
+  metrics = Metrics.new(opts[:out])
+  # its own process group, so a profiler wrapping the client gets the TERM too
+  psi = Process.spawn(PSI, :pgroup => true)
+  client_full = nil
+  probe.on("presence") do |p|
+    from = p.attributes["from"].to_s
+    if from.start_with?(CLIENT + "/") && p.attributes["type"].nil?
+      client_full = from
+      metrics.roster_time ||= metrics.elapsed
+    end
+  end
+
+  threads = []
+
+  # presence churn, spread over the whole fleet
+  threads << Thread.new do
+    shows = [nil, "away", "xa", "dnd", "chat"]
+    loop do
+      b = bots.sample
+      b.presence(shows.sample, "status #{rand(1000)}") if b
+      sleep 1.0 / opts[:churn]
+    end
+  end
+
+  # rooms with a few talkers each, the client is invited to every one
+  opts[:rooms].times do |r|
+    room = "load%03d@#{MUC_HOST}" % r
+    talkers = bots.sample([opts[:talkers], bots.size].min)
+    talkers.each { |b| b.presence(nil, nil, "#{room}/#{b.jid.split("@").first}") }
+    talkers.first.send_raw("<message to='#{room}'><x xmlns='http://jabber.org/protocol/muc#user'>" +
+                           "<invite to='#{CLIENT}'/></x></message>") if talkers.first
+    threads << Thread.new do
+      loop do
+        talkers.sample.message(room, "message #{rand(100000)} in #{room}", "groupchat") unless talkers.empty?
+        sleep 1.0 / opts[:rate]
+      end
+    end
+  end
+
+  # XEP-0096 file transfer offers, left unanswered by the bots
+  if opts[:transfers] > 0
+    threads << Thread.new do
+      loop do
+        sleep 60.0 / opts[:transfers]
+        next unless client_full
+        b = bots.sample
+        next unless b
+        sid = "s#{rand(1_000_000)}"
+        b.send_raw("<iq type='set' id='#{sid}' to='#{client_full}'>" +
+                   "<si xmlns='http://jabber.org/protocol/si' id='#{sid}' profile='http://jabber.org/protocol/si/profile/file-transfer'>" +
+                   "<file xmlns='http://jabber.org/protocol/si/profile/file-transfer' name='load#{sid}.bin' size='1048576'/>" +
+                   "<feature xmlns='http://jabber.org/protocol/feature-neg'><x xmlns='jabber:x:data' type='form'>" +
+                   "<field var='stream-method' type='list-single'><option><value>http://jabber.org/protocol/bytestreams</value></option>" +
+                   "</field></x></feature></si></iq>")
+      end
+    end
+  end
+
+  deadline = Time.now + opts[:duration]
+  while Time.now < deadline
+    ping = nil
+    if client_full
+      sent = Time.now
+      if probe.request("<iq type='get' to='#{client_full}'><ping xmlns='urn:xmpp:ping'/></iq>", 5)
+        ping = ((Time.now - sent) * 1000).round
+      else
+        metrics.lost
+      end
+    end
+    cpu, rss = process_stats(psi)
+    metrics.sample(ping, cpu, rss)
+    sleep [1 - (ping || 0) / 1000.0, 0].max
+  end
+
+  metrics.summary(opts)
+ensure
+  threads.each(&:kill) if threads
+  (bots || []).each(&:close)
+  probe.close if probe
+  if psi
+    Process.kill("TERM", -psi) rescue nil
+    # a profiler writes its data when the client is gone
+    120.times { break if (Process.wait(psi, Process::WNOHANG) rescue true); sleep 1 }
+  end
+  Process.kill("TERM", server) rescue nil if server
+end
+
+opts = { :rooms => 5, :talkers => 10, :rate => 2.0, :churn => 5.0, :transfers => 1,
+         :duration => 300, :out => PWD + "/results/" + Time.now.strftime("%Y%m%d-%H%M%S") }
+case ARGV.shift
+when "prepare"
+  prepare((ARGV.first || 500).to_i)
+when "run"
+  OptionParser.new do |o|
+    o.on("--rooms N", Integer, "group chats to run (5)") { |v| opts[:rooms] = v }
+    o.on("--talkers N", Integer, "bots talking in each room (10)") { |v| opts[:talkers] = v }
+    o.on("--rate N", Float, "messages per second in each room (2)") { |v| opts[:rate] = v }
+    o.on("--churn N", Float, "presence changes per second (5)") { |v| opts[:churn] = v }
+    o.on("--transfers N", Integer, "file transfer offers per minute (1)") { |v| opts[:transfers] = v }
+    o.on("--duration SECS", Integer, "length of the run (300)") { |v| opts[:duration] = v }
+    o.on("--out DIR", "where samples.csv and summary.txt go") { |v| opts[:out] = v }
+  end.parse!
+  run(opts)
+else
+  puts "usage: load.rb prepare [contacts] | load.rb run [--help]"
+end
@@ -9,10 +9,13 @@
 #include "Certificates/CertificateErrorDialog.h"
 #include "xmpp.h"
 
+#include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
 #include <QDomDocument>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileSystemWatcher>
 #include <QMessageBox>
 #include <QStringList>
 #include <QtCrypto>
@@ -25,12 +28,27 @@ using namespace QCA;
  * \brief A class providing utility functions for Certificates.
  */
 
-/**
- * \brief Returns the collection of all available certificates.
- * This collection includes the system-wide certificates, as well as any
- * custom certificate in the Psi-specific cert dirs.
- */
-CertificateCollection CertificateHelpers::allCertificates(const QStringList& storeDirs)
+// the system store can't be watched, so it is reloaded once in a while
+static const int certificateCacheLifetime = 3600; // secs
+
+namespace {
+struct CertificateCache
+{
+    QStringList dirs;
+    CertificateCollection certs;
+    QElapsedTimer age;
+    QFileSystemWatcher *watcher = nullptr;
+    bool valid = false;
+};
+}
+
+static CertificateCache &certificateCache()
+{
+    static CertificateCache cache;
+    return cache;
+}
+
+static CertificateCollection loadCertificates(const QStringList& storeDirs)
 {
     CertificateCollection certs(systemStore());
     for (QStringList::ConstIterator s = storeDirs.begin(); s != storeDirs.end(); ++s) {
@@ -88,6 +106,57 @@ CertificateCollection CertificateHelpers::allCertificates(const QStringList& sto
     return certs;
 }
 
+/**
+ * \brief Returns the collection of all available certificates.
+ * This collection includes the system-wide certificates, as well as any
+ * custom certificate in the Psi-specific cert dirs.
+ *
+ * The collection is loaded once and shared, until something changes in
+ * the cert dirs.
+ */
+CertificateCollection CertificateHelpers::allCertificates(const QStringList& storeDirs)
+{
+    CertificateCache &cache = certificateCache();
+    if (cache.valid && cache.dirs == storeDirs && cache.age.elapsed() < certificateCacheLifetime * 1000) {
+        return cache.certs;
+    }
+
+    if (!cache.watcher) {
+        cache.watcher = new QFileSystemWatcher(QCoreApplication::instance());
+        QObject::connect(cache.watcher, &QFileSystemWatcher::directoryChanged, []() { CertificateHelpers::invalidateCertificates(); });
+        QObject::connect(cache.watcher, &QFileSystemWatcher::fileChanged, []() { CertificateHelpers::invalidateCertificates(); });
+    }
+    if (!cache.watcher->directories().isEmpty())
+        cache.watcher->removePaths(cache.watcher->directories());
+    if (!cache.watcher->files().isEmpty())
+        cache.watcher->removePaths(cache.watcher->files());
+    QStringList paths;
+    for (const QString &dir : storeDirs) {
+        QDir store(dir);
+        if (!store.exists())
+            continue;
+        paths.append(store.absolutePath());
+        for (const QString &file : store.entryList(QStringList() << "*.crt" << "*.pem" << "*.xml", QDir::Files))
+            paths.append(store.filePath(file));
+    }
+    if (!paths.isEmpty())
+        cache.watcher->addPaths(paths);
+
+    cache.certs = loadCertificates(storeDirs);
+    cache.dirs = storeDirs;
+    cache.age.start();
+    cache.valid = true;
+    return cache.certs;
+}
+
+/**
+ * \brief Makes the next allCertificates() call read the certificates again.
+ */
+void CertificateHelpers::invalidateCertificates()
+{
+    certificateCache().valid = false;
+}
+
 QString CertificateHelpers::validityToString(QCA::Validity v)
 {
     QString s;
@@ -23,6 +23,7 @@ class CertificateHelpers
 {
     public:
         static QCA::CertificateCollection allCertificates(const QStringList& dirs);
+        static void invalidateCertificates();
         static QString resultToString(int result, QCA::Validity);
         static bool checkCertificate(QCA::TLS* tls, XMPP::QCATLSHandler *tlsHandler, QString &tlsOverrideDomain,
                                      QByteArray &tlsOverrideCert, QObject * canceler, const QString &title,
@@ -21,6 +21,7 @@
 
 #include "jidutil.h"
 #include "miniclient.h"
+#include "networkaccessmanager.h"
 #include "proxy.h"
 #include "psicon.h"
 #include "psioptions.h"
@@ -32,6 +33,8 @@
 #include <QMessageBox>
 #include <QScrollArea>
 #include <QtCrypto>
+#include <algorithm>
+#include <climits>
 
 using namespace XMPP;
 
@@ -51,9 +54,13 @@ AccountRegDlg::AccountRegDlg(PsiCon *psi, QWidget *parent) :
 
     // Server select button
     connect(ui_.le_server,SIGNAL(popup()),SLOT(selectServer()));
-    serverlist_querier_ = new ServerListQuerier(this);
+    serverlist_querier_ = new ServerListQuerier(psi->networkAccessManager(), this);
+    serverlist_shown_ = false;
     connect(serverlist_querier_,SIGNAL(listReceived(const QStringList&)),SLOT(serverListReceived(const QStringList&)));
+    connect(serverlist_querier_,SIGNAL(serversFound(const QStringList&)),SLOT(serversFound(const QStringList&)));
     connect(serverlist_querier_,SIGNAL(error(const QString&)),SLOT(serverListError(const QString&)));
+    connect(serverlist_querier_,SIGNAL(serverProbed(const QString&, int)),SLOT(serverProbed(const QString&, int)));
+    connect(serverlist_querier_,SIGNAL(probingFinished()),SLOT(sortServers()));
 
     // Manual Host/Port
     ui_.le_host->setEnabled(false);
@@ -157,11 +164,67 @@ void AccountRegDlg::selectServer()
 
 void AccountRegDlg::serverListReceived(const QStringList& list)
 {
-    ui_.busy->stop();
-    unblock();
+    // a cached list may be followed by a fresh one
+    QString text = ui_.le_server->currentText();
     ui_.le_server->clear();
     ui_.le_server->addItems(list);
-    ui_.le_server->showPopup();
+    ui_.le_server->setEditText(text);
+    serversFound(QStringList());
+
+    if (PsiOptions::instance()->getOption("options.ui.account.register.probe-servers").toBool()) {
+        serverlist_querier_->probe(list);
+    }
+}
+
+void AccountRegDlg::serversFound(const QStringList& servers)
+{
+    if (!servers.isEmpty()) {
+        ui_.le_server->addItems(servers);
+    }
+    if (!serverlist_shown_ && ui_.le_server->count() > 0) {
+        serverlist_shown_ = true;
+        ui_.busy->stop();
+        unblock();
+        ui_.le_server->showPopup();
+    }
+}
+
+void AccountRegDlg::serverProbed(const QString& server, int msecs)
+{
+    int i = ui_.le_server->findText(server);
+    if (i == -1) {
+        return;
+    }
+    ui_.le_server->setItemData(i, msecs, Qt::UserRole);
+    ui_.le_server->setItemData(i, msecs < 0 ? tr("Not reachable") : tr("Connects in %1 ms").arg(msecs), Qt::ToolTipRole);
+}
+
+void AccountRegDlg::sortServers()
+{
+    QList<QPair<int, QString>> servers;
+    for (int i = 0; i < ui_.le_server->count(); i++) {
+        QVariant msecs = ui_.le_server->itemData(i, Qt::UserRole);
+        // unprobed and unreachable servers go last
+        int key = msecs.isValid() && msecs.toInt() >= 0 ? msecs.toInt() : INT_MAX;
+        servers += qMakePair(key, ui_.le_server->itemText(i));
+    }
+    std::stable_sort(servers.begin(), servers.end(),
+                     [](const QPair<int, QString> &a, const QPair<int, QString> &b) { return a.first < b.first; });
+
+    QString text = ui_.le_server->currentText();
+    QHash<QString, QPair<QVariant, QVariant>> data;
+    for (int i = 0; i < ui_.le_server->count(); i++) {
+        data[ui_.le_server->itemText(i)] = qMakePair(ui_.le_server->itemData(i, Qt::UserRole),
+                                                      ui_.le_server->itemData(i, Qt::ToolTipRole));
+    }
+    ui_.le_server->clear();
+    for (const auto &s : servers) {
+        ui_.le_server->addItem(s.second);
+        int i = ui_.le_server->count() - 1;
+        ui_.le_server->setItemData(i, data[s.second].first, Qt::UserRole);
+        ui_.le_server->setItemData(i, data[s.second].second, Qt::ToolTipRole);
+    }
+    ui_.le_server->setEditText(text);
 }
 
 void AccountRegDlg::serverListError(const QString& e)
@@ -80,6 +80,9 @@ protected slots:
     void selectServer();
     void serverListReceived(const QStringList&);
     void serverListError(const QString&);
+    void serversFound(const QStringList&);
+    void serverProbed(const QString&, int);
+    void sortServers();
 
     void client_handshaken();
     void client_error();
@@ -94,6 +97,7 @@ private:
     XDataWidget* fields_;
     ProxyChooser *proxy_chooser_;
     ServerListQuerier *serverlist_querier_;
+    bool serverlist_shown_;
     MiniClient *client_;
     bool isOld_;
 
@@ -40,6 +40,8 @@ public:
     bool setStatus(const QString &profile, const QString &status, const QString &message) const;
     bool openUri(const QString &profile, const QString &uri) const;
     bool raise(const QString &profile, bool withUI) const;
+    bool trimCaches(const QString &profile) const;
+    QString memoryReport(const QString &profile) const; // empty if it can't be asked
 
     ~ActiveProfiles();
 
@@ -47,6 +49,7 @@ signals:
     void setStatusRequested(const QString &status, const QString &message);
     void openUriRequested(const QString &uri);
     void raiseRequested();
+    void trimCachesRequested();
 
 protected:
     static ActiveProfiles *instance_;
@@ -26,6 +26,7 @@
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
 #include <QDBusInterface>
+#include <QDBusReply>
 #include <QLabel>
 #include <QString>
 #include <QStringList>
@@ -198,6 +199,18 @@ bool ActiveProfiles::setStatus(const QString &profile, const QString &status, co
     return true;
 }
 
+bool ActiveProfiles::trimCaches(const QString &profile) const
+{
+    QDBusInterface(d->dbusName(profile), "/Main", PSIDBUSMAINIF).call(QDBus::NoBlock, "trimCaches");
+    return true;
+}
+
+QString ActiveProfiles::memoryReport(const QString &profile) const
+{
+    QDBusReply<QString> reply = QDBusInterface(d->dbusName(profile), "/Main", PSIDBUSMAINIF).call("memoryReport");
+    return reply.isValid() ? reply.value() : QString();
+}
+
 bool ActiveProfiles::openUri(const QString &profile, const QString &uri) const
 {
     QDBusInterface(d->dbusName(profile), "/Main", PSIDBUSMAINIF).call(QDBus::NoBlock,
@@ -80,3 +80,15 @@ bool ActiveProfiles::raise(const QString &profile, bool withUI) const
     Q_UNUSED(withUI);
     return true;
 }
+
+bool ActiveProfiles::trimCaches(const QString &profile) const
+{
+    Q_UNUSED(profile);
+    return true;
+}
+
+QString ActiveProfiles::memoryReport(const QString &profile) const
+{
+    Q_UNUSED(profile);
+    return QString();
+}
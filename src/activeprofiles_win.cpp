@@ -200,6 +200,9 @@ bool ActiveProfiles::Private::winEvent(MSG *msg, long *result)
                 } else if (list[0] == "setStatus") {
                     emit ap->setStatusRequested(list.value(1), list.value(2));
                     *result = TRUE;
+                } else if (list[0] == "trimCaches") {
+                    emit ap->trimCachesRequested();
+                    *result = TRUE;
                 }
             }
         }
@@ -349,3 +352,17 @@ bool ActiveProfiles::setStatus(const QString &profile, const QString &status, co
     list << "setStatus" << status << message;
     return d->sendStringList(profile.isEmpty()? d->pickProfile() : profile, list);
 }
+
+bool ActiveProfiles::trimCaches(const QString &profile) const
+{
+    QStringList list;
+    list << "trimCaches" << QString(); // commands need an argument
+    return d->sendStringList(profile.isEmpty()? d->pickProfile() : profile, list);
+}
+
+// window messages can't carry an answer back
+QString ActiveProfiles::memoryReport(const QString &profile) const
+{
+    Q_UNUSED(profile);
+    return QString();
+}
@@ -19,6 +19,7 @@
 
 #include "adhoc_fileserver.h"
 
+#include "ahcservermanager.h"
 #include "psiaccount.h"
 #include "xmpp_xdata.h"
 
@@ -37,16 +38,15 @@ AHCommand AHFileServer::execute(const AHCommand& c, const Jid& requester)
     // Extract the file
     QString file;
     if (c.hasData()) {
-        QString fileName, curDir;
         XData::FieldList fl = c.data().fields();
-        for (unsigned int i=0; i < fl.count(); i++) {
+        for (int i=0; i < fl.count(); i++) {
             if (fl[i].var() == "file" && !(fl[i].value().isEmpty())) {
                 file = fl[i].value().first();
             }
         }
     }
     else {
-        file = QDir::currentDirPath();
+        file = QDir::currentPath();
     }
 
     if (QFileInfo(file).isDir()) {
@@ -71,7 +71,7 @@ AHCommand AHFileServer::execute(const AHCommand& c, const Jid& requester)
             XData::Field::Option file_option;
             QFileInfo fi(QDir(file).filePath(*it));
             file_option.label = *it + (fi.isDir() ? QString(" [DIR]") : QString(" (%1 bytes)").arg(QString::number(fi.size())));
-            file_option.value = QDir(file).absFilePath(*it);
+            file_option.value = QDir(file).absoluteFilePath(*it);
             file_options += file_option;
         }
         files_field.setOptions(file_options);
@@ -83,7 +83,7 @@ AHCommand AHFileServer::execute(const AHCommand& c, const Jid& requester)
     }
     else {
         QStringList l(file);
-        manager()->account()->sendFiles(requester,l,true);
+        manager()->account()->sendFiles(requester,l);
         return AHCommand::completedReply(c);
     }
 }
@@ -21,7 +21,10 @@
 #ifndef AHFILESERVER_H
 #define AHFILESERVER_H
 
-#include "adhoc.h"
+#include "ahcommand.h"
+#include "ahcommandserver.h"
+
+#include <QString>
 
 class AHFileServer : public AHCommandServer
 {
@@ -29,9 +32,9 @@ public:
     AHFileServer(AHCServerManager* m) : AHCommandServer(m) { }
     virtual QString node() const
         { return QString("https://psi-im.org/commands/files"); }
-    virtual bool isAllowed(const Jid&) const;
+    virtual bool isAllowed(const XMPP::Jid&) const;
     virtual QString name() const { return QString("Send file"); }
-    virtual AHCommand execute(const AHCommand& c, const Jid&);
+    virtual AHCommand execute(const AHCommand& c, const XMPP::Jid&);
 };
 
 #endif // AHFILESERVER_H
@@ -0,0 +1,173 @@
+/*
+ * ahcbatch.cpp - runs many ad-hoc commands without user interaction
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ahcbatch.h"
+
+#include "ahcexecutetask.h"
+#include "xmpp_client.h"
+#include "xmpp_xdata.h"
+
+#include <QTimer>
+
+using namespace XMPP;
+
+// --------------------------------------------------------------------------
+// AHCBatchJob
+// --------------------------------------------------------------------------
+
+AHCBatchJob::AHCBatchJob(const Jid &jid, const QString &node, const QVariantMap &fields, QObject *parent) :
+    QObject(parent), jid_(jid), node_(node), fields_(fields)
+{
+}
+
+QString AHCBatchJob::status() const
+{
+    if (!error_.isEmpty())
+        return QLatin1String("error");
+    switch (result_.status()) {
+    case AHCommand::Executing:
+        return QLatin1String("executing");
+    case AHCommand::Canceled:
+        return QLatin1String("canceled");
+    default:
+        return QLatin1String("completed");
+    }
+}
+
+QVariantMap AHCBatchJob::resultFields() const
+{
+    QVariantMap fields;
+    if (!result_.hasData())
+        return fields;
+    for (const XData::Field &f : result_.data().fields()) {
+        if (f.var().isEmpty())
+            continue;
+        if (f.value().count() == 1)
+            fields.insert(f.var(), f.value().first());
+        else
+            fields.insert(f.var(), f.value());
+    }
+    return fields;
+}
+
+// --------------------------------------------------------------------------
+// AHCBatch
+// --------------------------------------------------------------------------
+
+// the form of a command filled with the values of a job
+static XData submitForm(const XData &form, const QVariantMap &values)
+{
+    XData::FieldList fields = form.fields();
+    for (XData::Field &f : fields) {
+        auto it = values.constFind(f.var());
+        if (it != values.constEnd())
+            f.setValue(it.value().toStringList());
+    }
+    XData x;
+    x.setFields(fields);
+    x.setType(XData::Data_Submit);
+    return x;
+}
+
+AHCBatch::AHCBatch(Client *client, QObject *parent) : QObject(parent), client_(client)
+{
+}
+
+void AHCBatch::setMaxRunning(int max)
+{
+    maxRunning_ = qMax(1, max);
+    startJobs();
+}
+
+AHCBatchJob *AHCBatch::add(const Jid &jid, const QString &node, const QVariantMap &fields)
+{
+    AHCBatchJob *job = new AHCBatchJob(jid, node, fields, this);
+    queue_.append(job);
+    if (!startPending_) {
+        // let the caller connect to the job first
+        startPending_ = true;
+        QTimer::singleShot(0, this, [this]() {
+            startPending_ = false;
+            startJobs();
+        });
+    }
+    return job;
+}
+
+void AHCBatch::clear()
+{
+    qDeleteAll(queue_);
+    queue_.clear();
+    if (!running_)
+        emit idle();
+}
+
+void AHCBatch::startJobs()
+{
+    while (running_ < maxRunning_ && !queue_.isEmpty()) {
+        AHCBatchJob *job = queue_.takeFirst();
+        running_++;
+        execute(job, AHCommand(job->node_));
+    }
+}
+
+void AHCBatch::execute(AHCBatchJob *job, const AHCommand &command)
+{
+    AHCExecuteTask *t = new AHCExecuteTask(job->jid_, command, client_->rootTask());
+    connect(t, &Task::finished, this, [this, t, job]() { taskFinished(t, job); });
+    t->go(true);
+}
+
+void AHCBatch::taskFinished(AHCExecuteTask *task, AHCBatchJob *job)
+{
+    if (!task->success()) {
+        job->error_ = task->statusString();
+        if (job->error_.isEmpty())
+            job->error_ = tr("Command failed");
+        finish(job);
+        return;
+    }
+
+    const AHCommand &c = task->resultCommand();
+    job->result_       = c;
+    if (c.status() == AHCommand::Executing) {
+        if (!job->submitted_ && !job->fields_.isEmpty() && c.hasData()) {
+            job->submitted_ = true;
+            execute(job, AHCommand(job->node_, submitForm(c.data(), job->fields_), c.sessionId()));
+            return;
+        }
+        // a stage only a user could answer. don't leave the session open
+        AHCExecuteTask *t = new AHCExecuteTask(job->jid_, AHCommand(job->node_, c.sessionId(), AHCommand::Cancel),
+                                               client_->rootTask());
+        t->go(true);
+    }
+    finish(job);
+}
+
+void AHCBatch::finish(AHCBatchJob *job)
+{
+    running_--;
+    emit job->finished(job->jid_.full(), job->node_, job->status(), job->resultFields(), job->error_);
+    emit jobFinished(job);
+    job->deleteLater();
+
+    startJobs();
+    if (!running_ && queue_.isEmpty())
+        emit idle();
+}
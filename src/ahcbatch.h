@@ -0,0 +1,110 @@
+/*
+ * ahcbatch.h - runs many ad-hoc commands without user interaction
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef AHCBATCH_H
+#define AHCBATCH_H
+
+#include "ahcommand.h"
+#include "xmpp_jid.h"
+
+#include <QList>
+#include <QObject>
+#include <QVariantMap>
+
+class AHCExecuteTask;
+
+namespace XMPP {
+    class Client;
+}
+
+/**
+ * One command of a batch. If the command answers with a form, the form is
+ * submitted once with the given field values, anything the job doesn't
+ * know how to answer cancels the session. The job deletes itself after
+ * it has finished.
+ */
+class AHCBatchJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    const XMPP::Jid &jid() const { return jid_; }
+    const QString &node() const { return node_; }
+    const AHCommand &result() const { return result_; }
+    const QString &error() const { return error_; } // empty if the command was run
+
+    // "completed", "executing" (cancelled at a stage it couldn't answer), "canceled" or "error"
+    QString status() const;
+    // var => value, or a string list for fields with more values
+    QVariantMap resultFields() const;
+
+signals:
+    // plain types, so plugins can connect to it
+    void finished(const QString &jid, const QString &node, const QString &status, const QVariantMap &fields, const QString &error);
+
+private:
+    friend class AHCBatch;
+    AHCBatchJob(const XMPP::Jid &jid, const QString &node, const QVariantMap &fields, QObject *parent);
+
+    XMPP::Jid   jid_;
+    QString     node_;
+    QVariantMap fields_;
+    AHCommand   result_;
+    QString     error_;
+    bool        submitted_ = false;
+};
+
+/**
+ * Queue of ad-hoc commands of an account, run a few at a time. Jobs finish
+ * in the order the entities answer, not in the order they were added.
+ */
+class AHCBatch : public QObject
+{
+    Q_OBJECT
+
+public:
+    AHCBatch(XMPP::Client *client, QObject *parent = nullptr);
+
+    void setMaxRunning(int max);
+    int maxRunning() const { return maxRunning_; }
+
+    AHCBatchJob *add(const XMPP::Jid &jid, const QString &node, const QVariantMap &fields = QVariantMap());
+    void clear(); // drops the jobs which didn't start yet
+
+    int queued() const { return queue_.count(); }
+    int running() const { return running_; }
+
+signals:
+    void jobFinished(AHCBatchJob *job);
+    void idle(); // nothing queued or running anymore
+
+private:
+    void startJobs();
+    void execute(AHCBatchJob *job, const AHCommand &command);
+    void taskFinished(AHCExecuteTask *task, AHCBatchJob *job);
+    void finish(AHCBatchJob *job);
+
+    XMPP::Client *       client_;
+    int                  maxRunning_   = 4;
+    int                  running_      = 0;
+    bool                 startPending_ = false;
+    QList<AHCBatchJob *> queue_;
+};
+
+#endif // AHCBATCH_H
@@ -0,0 +1,177 @@
+/*
+ * ahcbatchdlg.cpp - runs a list of ad-hoc commands and collects the results
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ahcbatchdlg.h"
+
+#include "ahcbatch.h"
+#include "fileutil.h"
+#include "psiaccount.h"
+
+#include <QDialogButtonBox>
+#include <QFile>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QTextStream>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+// the text of the result fields, one "var=value" per field
+static QString fieldsText(const QVariantMap &fields)
+{
+    QStringList parts;
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        parts << QString("%1=%2").arg(it.key(), it.value().toStringList().join(QLatin1Char(',')));
+    }
+    return parts.join(QLatin1String("; "));
+}
+
+AHCBatchDlg::AHCBatchDlg(PsiAccount *pa, const QString &commands) :
+    QDialog(nullptr), pa_(pa)
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(tr("Execute Commands (%1)").arg(pa->jid().bare()));
+
+    batch_ = new AHCBatch(pa->client(), this);
+    connect(batch_, &AHCBatch::jobFinished, this, &AHCBatchDlg::jobFinished);
+    connect(batch_, &AHCBatch::idle, this, &AHCBatchDlg::updateState);
+
+    QVBoxLayout *vbox = new QVBoxLayout(this);
+    vbox->addWidget(new QLabel(tr("One command per line: JID, node and the form values to submit, if any"), this));
+    te_commands = new QPlainTextEdit(this);
+    te_commands->setPlaceholderText(tr("jabber.example.com http://jabber.org/protocol/admin#get-online-users max_items=100"));
+    te_commands->setPlainText(commands);
+    vbox->addWidget(te_commands);
+
+    QHBoxLayout *hbox = new QHBoxLayout;
+    hbox->addWidget(new QLabel(tr("Run at once:"), this));
+    sb_parallel = new QSpinBox(this);
+    sb_parallel->setRange(1, 32);
+    sb_parallel->setValue(batch_->maxRunning());
+    connect(sb_parallel, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), batch_, &AHCBatch::setMaxRunning);
+    hbox->addWidget(sb_parallel);
+    hbox->addStretch();
+    lb_state = new QLabel(this);
+    hbox->addWidget(lb_state);
+    vbox->addLayout(hbox);
+
+    tw_results = new QTreeWidget(this);
+    tw_results->setRootIsDecorated(false);
+    tw_results->setUniformRowHeights(true);
+    tw_results->setHeaderLabels(QStringList() << tr("JID") << tr("Command") << tr("Status") << tr("Result"));
+    tw_results->header()->setStretchLastSection(true);
+    vbox->addWidget(tw_results, 1);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    pb_run    = buttons->addButton(tr("Run"), QDialogButtonBox::ActionRole);
+    pb_stop   = buttons->addButton(tr("Stop"), QDialogButtonBox::ActionRole);
+    pb_export = buttons->addButton(tr("Export..."), QDialogButtonBox::ActionRole);
+    connect(pb_run, SIGNAL(clicked()), SLOT(run()));
+    connect(pb_stop, SIGNAL(clicked()), SLOT(stop()));
+    connect(pb_export, SIGNAL(clicked()), SLOT(exportResults()));
+    connect(buttons, SIGNAL(rejected()), SLOT(close()));
+    vbox->addWidget(buttons);
+
+    updateState();
+    resize(700, 500);
+}
+
+void AHCBatchDlg::run()
+{
+    if (!pa_->isAvailable()) {
+        QMessageBox::information(this, tr("Execute Commands"), tr("You must be online to execute commands."));
+        return;
+    }
+
+    const QStringList lines = te_commands->toPlainText().split(QLatin1Char('\n'), QString::SkipEmptyParts);
+    for (const QString &line : lines) {
+        QStringList words = line.simplified().split(QLatin1Char(' '), QString::SkipEmptyParts);
+        if (words.count() < 2)
+            continue;
+        QVariantMap fields;
+        for (int i = 2; i < words.count(); i++) {
+            QString var   = words[i].section(QLatin1Char('='), 0, 0);
+            QString value = words[i].section(QLatin1Char('='), 1);
+            QStringList values = fields.value(var).toStringList(); // repeated for more values
+            fields.insert(var, values << value);
+        }
+        batch_->add(words[0], words[1], fields);
+        total_++;
+    }
+    updateState();
+}
+
+void AHCBatchDlg::stop()
+{
+    total_ -= batch_->queued();
+    batch_->clear();
+    updateState();
+}
+
+void AHCBatchDlg::jobFinished(AHCBatchJob *job)
+{
+    done_++;
+    QString result = job->error();
+    if (result.isEmpty()) {
+        QStringList parts;
+        if (job->result().hasNote())
+            parts << job->result().note().text;
+        QString fields = fieldsText(job->resultFields());
+        if (!fields.isEmpty())
+            parts << fields;
+        result = parts.join(QLatin1String(" | "));
+    }
+    new QTreeWidgetItem(tw_results, QStringList() << job->jid().full() << job->node() << job->status() << result);
+    updateState();
+}
+
+void AHCBatchDlg::updateState()
+{
+    bool busy = batch_->running() || batch_->queued();
+    pb_stop->setEnabled(batch_->queued() > 0);
+    pb_export->setEnabled(tw_results->topLevelItemCount() > 0);
+    lb_state->setText(busy ? tr("%1 of %2 done").arg(done_).arg(total_) : QString());
+}
+
+void AHCBatchDlg::exportResults()
+{
+    QString fileName = FileUtil::getSaveFileName(this, tr("Export Results"), QLatin1String("commands.txt"),
+                                                 tr("Text files (*.txt);;All files (*)"));
+    if (fileName.isEmpty())
+        return;
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QMessageBox::critical(this, tr("Error"), tr("Unable to write to %1").arg(fileName));
+        return;
+    }
+    QTextStream out(&f);
+    out.setCodec("UTF-8");
+    for (int i = 0; i < tw_results->topLevelItemCount(); i++) {
+        QTreeWidgetItem *item = tw_results->topLevelItem(i);
+        QStringList      columns;
+        for (int c = 0; c < tw_results->columnCount(); c++)
+            columns << item->text(c);
+        out << columns.join(QLatin1Char('\t')) << '\n';
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * ahcbatchdlg.h - runs a list of ad-hoc commands and collects the results
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef AHCBATCHDLG_H
+#define AHCBATCHDLG_H
+
+#include <QDialog>
+
+class AHCBatch;
+class AHCBatchJob;
+class PsiAccount;
+class QLabel;
+class QPlainTextEdit;
+class QPushButton;
+class QSpinBox;
+class QTreeWidget;
+
+/**
+ * Takes one command per line, "jid node [var=value ...]", runs them with
+ * a few in flight at once and lists the results as they come in.
+ */
+class AHCBatchDlg : public QDialog
+{
+    Q_OBJECT
+
+public:
+    AHCBatchDlg(PsiAccount *pa, const QString &commands = QString());
+
+private slots:
+    void run();
+    void stop();
+    void exportResults();
+
+private:
+    void jobFinished(AHCBatchJob *job);
+    void updateState();
+
+    PsiAccount *    pa_;
+    AHCBatch *      batch_;
+    int             total_ = 0;
+    int             done_  = 0;
+    QPlainTextEdit *te_commands;
+    QSpinBox *      sb_parallel;
+    QTreeWidget *   tw_results;
+    QLabel *        lb_state;
+    QPushButton *   pb_run;
+    QPushButton *   pb_stop;
+    QPushButton *   pb_export;
+};
+
+#endif // AHCBATCHDLG_H
@@ -19,6 +19,7 @@
 
 #include "ahcommanddlg.h"
 
+#include "ahcbatchdlg.h"
 #include "ahcexecutetask.h"
 #include "ahcformdlg.h"
 #include "busywidget.h"
@@ -150,6 +151,8 @@ AHCommandDlg::AHCommandDlg(PsiAccount* pa, const Jid& receiver)
     connect(pb_execute, SIGNAL(clicked()), SLOT(executeCommand()));
     connect(pb_close, SIGNAL(clicked()), SLOT(close()));
     pb_execute->setDefault(true);
+    QPushButton *pb_batch = ui_.buttonBox->addButton(tr("Batch..."), QDialogButtonBox::ActionRole);
+    connect(pb_batch, SIGNAL(clicked()), SLOT(openBatch()));
 
     setWindowTitle(QString("Execute Command (%1)").arg(receiver.full()));
 
@@ -198,6 +201,19 @@ void AHCommandDlg::commandExecuted()
     close();
 }
 
+void AHCommandDlg::openBatch()
+{
+    // the chosen command as the first line to start from
+    QString commands;
+    if (ui_.cb_commands->count() > 0) {
+        const AHCommandItem &ci = commands_[ui_.cb_commands->currentIndex()];
+        commands = QString("%1 %2\n").arg(ci.jid, ci.node);
+    }
+    AHCBatchDlg *w = new AHCBatchDlg(pa_, commands);
+    w->show();
+    close();
+}
+
 void AHCommandDlg::executeCommand(PsiCon *psi, XMPP::Client* c, const XMPP::Jid& to, const QString &node)
 {
     AHCExecuteTask* t = new AHCExecuteTask(to,AHCommand(node),c->rootTask());
@@ -52,6 +52,7 @@ protected slots:
     void listReceived();
     void executeCommand();
     void commandExecuted();
+    void openBatch();
 
 private:
     Ui::AHCommandDlg ui_;
@@ -19,6 +19,7 @@
 
 #include "ahcservermanager.h"
 
+#include "ahcbatch.h"
 #include "ahcommand.h"
 #include "ahcommandserver.h"
 #include "psiaccount.h"
@@ -167,11 +168,23 @@ void JT_AHCServer::sendReply(const AHCommand& c, const Jid& to, const QString& i
 
 // --------------------------------------------------------------------------
 
-AHCServerManager::AHCServerManager(PsiAccount *pa) : pa_(pa)
+AHCServerManager::AHCServerManager(PsiAccount *pa) : pa_(pa), batch_(nullptr)
 {
     server_task_ = new JT_AHCServer(pa_->client()->rootTask(), this);
 }
 
+AHCServerManager::~AHCServerManager()
+{
+    delete batch_;
+}
+
+AHCBatch* AHCServerManager::batch()
+{
+    if (!batch_)
+        batch_ = new AHCBatch(pa_->client());
+    return batch_;
+}
+
 void AHCServerManager::addServer(AHCommandServer* server)
 {
     servers_.append(server);
@@ -22,6 +22,7 @@
 
 #include <QList>
 
+class AHCBatch;
 class AHCommand;
 class AHCommandServer;
 class JT_AHCServer;
@@ -36,6 +37,7 @@ class AHCServerManager
 {
 public:
     AHCServerManager(PsiAccount* pa);
+    ~AHCServerManager();
     void addServer(AHCommandServer*);
     void removeServer(AHCommandServer*);
 
@@ -45,6 +47,9 @@ public:
     PsiAccount* account() const { return pa_; }
     bool hasServer(const QString& node, const XMPP::Jid&) const;
 
+    // the account's queue for commands run on other entities, e.g. by plugins
+    AHCBatch* batch();
+
 protected:
     AHCommandServer* findServer(const QString& node) const;
 
@@ -52,6 +57,7 @@ private:
     PsiAccount* pa_;
     JT_AHCServer* server_task_;
     ServerList servers_;
+    AHCBatch* batch_;
 };
 
 #endif // AHCSERVERMANAGER_H
@@ -19,11 +19,12 @@
 
 #include "alerticon.h"
 
+#include "animtimer.h"
 #include "psioptions.h"
 
 #include <QApplication>
+#include <QMetaMethod>
 #include <QPixmap>
-#include <QTimer>
 
 //----------------------------------------------------------------------------
 // MetaAlertIcon
@@ -46,11 +47,15 @@ signals:
 public slots:
     void updateAlertStyle();
 
+protected:
+    void connectNotify(const QMetaMethod &signal);
+    void disconnectNotify(const QMetaMethod &signal);
+
 private slots:
     void animTimeout();
 
 private:
-    QTimer *animTimer;
+    AnimTimer *animTimer;
     int frame;
     Impix _blank16;
 };
@@ -59,11 +64,12 @@ static MetaAlertIcon *metaAlertIcon = nullptr;
 
 MetaAlertIcon::MetaAlertIcon()
     : QObject(qApp)
-    , animTimer(new QTimer(this))
+    , animTimer(new AnimTimer(this))
     , frame(0)
 {
+    // one clock for all blinking icons; it only runs while any of them is blinking
     connect(animTimer, SIGNAL(timeout()), SLOT(animTimeout()));
-    animTimer->start(120 * 5);
+    animTimer->setInterval(120 * 5);
 
     // blank icon
     QImage blankImg(16, 16, QImage::Format_ARGB32);
@@ -80,6 +86,19 @@ Impix MetaAlertIcon::blank16() const
     return _blank16;
 }
 
+void MetaAlertIcon::connectNotify(const QMetaMethod &signal)
+{
+    if ( signal == QMetaMethod::fromSignal(&MetaAlertIcon::updateFrame) && !animTimer->isActive() )
+        animTimer->start();
+}
+
+void MetaAlertIcon::disconnectNotify(const QMetaMethod &signal)
+{
+    if ( (!signal.isValid() || signal == QMetaMethod::fromSignal(&MetaAlertIcon::updateFrame))
+         && !isSignalConnected(QMetaMethod::fromSignal(&MetaAlertIcon::updateFrame)) )
+        animTimer->stop();
+}
+
 void MetaAlertIcon::animTimeout()
 {
     frame = !frame;
@@ -156,6 +175,8 @@ void AlertIcon::Private::init()
     updateAlertStyle();
 
     connect(metaAlertIcon, SIGNAL(update()), SLOT(update()));
+    // the frames made of the old pixmaps are stale
+    connect(real, SIGNAL(iconModified()), ai, SIGNAL(iconModified()));
     connect(real, SIGNAL(iconModified()), SLOT(pixmapChanged()));
 
     if ( alertStyle == "animate" && real->isAnimated() )
@@ -180,7 +201,7 @@ void AlertIcon::Private::activated(bool playSound)
         }
     }
     else if ( alertStyle == "blink" || (alertStyle == "animate" && !real->isAnimated()) ) {
-        connect(metaAlertIcon, SIGNAL(updateFrame(int)), SLOT(updateFrame(int)));
+        connect(metaAlertIcon, SIGNAL(updateFrame(int)), SLOT(updateFrame(int)), Qt::UniqueConnection);
     }
     else {
         impix = real->impix();
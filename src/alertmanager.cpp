@@ -49,11 +49,15 @@ void AlertManager::findDialogs(const QMetaObject& mo, QList<void*>* list) const
 
 void AlertManager::dialogRegister(QWidget* w, int prio)
 {
+    if (items_.contains(w)) {
+        return;
+    }
     qDebug() << "registered dialog";
     connect(w, SIGNAL(destroyed(QObject*)), SLOT(forceDialogUnregister(QObject*)));
     Item* i = new Item();
     i->widget = w;
     i->priority = prio;
+    items_.insert(w, i);
     list_.append(i);
     std::push_heap(list_.begin(), list_.end(), itemCompare);
 
@@ -61,22 +65,23 @@ void AlertManager::dialogRegister(QWidget* w, int prio)
 
 void AlertManager::dialogUnregister(QWidget* w)
 {
-    if (list_.at(0)->widget == w) {
+    Item* i = items_.take(w);
+    if (!i) {
+        return;
+    }
+
+    if (list_.at(0) == i) {
         std::pop_heap(list_.begin(), list_.end(), itemCompare);
         list_.removeLast();
+        delete i;
         if (!list_.isEmpty()) {
             list_.at(0)->widget->show();
         }
         return;
     }
 
-    foreach(Item* i, list_) {
-        if (i->widget == w) {
-            list_.removeAll(i);
-            delete i;
-            break;
-        }
-    }
+    list_.removeOne(i);
+    delete i;
     std::make_heap(list_.begin(), list_.end(), itemCompare);
 
 }
@@ -90,6 +95,7 @@ void AlertManager::deleteDialogList()
 {
     while (!list_.isEmpty()) {
         Item* i = list_.takeLast();
+        items_.remove(i->widget);
         i->widget->disconnect(); // ensure forceDialogUnregister won't be called
         delete i->widget;
         delete i;
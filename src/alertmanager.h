@@ -24,6 +24,7 @@
 
 #include "psicon.h"
 
+#include <QHash>
 #include <QMessageBox>
 
 class AlertManager : public QObject {
@@ -68,7 +69,8 @@ public:
         int priority;
     };
     PsiCon *psi_;
-    QList<Item*> list_;
+    QList<Item*> list_; // heap, highest priority first
+    QHash<const QWidget*, Item*> items_;
 };
 
 #endif // ALERTMANAGER_H
@@ -0,0 +1,137 @@
+/*
+ * archivesync.cpp - copies the server side message archive into local history
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "archivesync.h"
+
+#include "eventdb.h"
+#include "mamquerytask.h"
+#include "psiaccount.h"
+#include "psievent.h"
+#include "psioptions.h"
+#include "seenmessages.h"
+#include "xmpp_client.h"
+
+/**
+ * \class ArchiveSync
+ * \brief Fetches messages the account got or sent elsewhere from the server archive.
+ *
+ * The archive id of the last synced message is kept in the history storage,
+ * so after a reconnect only newer messages are requested. Messages which
+ * the account already got live are recognized by its SeenMessages index
+ * and skipped.
+ */
+
+static const int pageSize = 250;
+static const int maxPages = 40; // per sync. the rest waits for the next connection
+
+ArchiveSync::ArchiveSync(PsiAccount *account) : QObject(account), account_(account), pages_(0), loaded_(false)
+{
+}
+
+QString ArchiveSync::paramKey(const char *name) const
+{
+    return QString(QLatin1String("%1_%2")).arg(QLatin1String(name), account_->id());
+}
+
+/**
+ * \brief Requests messages archived since the last sync.
+ */
+void ArchiveSync::start()
+{
+    if (task_ || !PsiOptions::instance()->getOption("options.history.sync-server-archive").toBool())
+        return;
+    // without a storage for the cursor every sync would start over
+    EDB *edb = account_->edb();
+    if (!edb || !(edb->features() & EDB::SeparateAccounts))
+        return;
+    if (!loaded_) { // history is opened after the accounts
+        loaded_ = true;
+        cursor_ = edb->getStorageParam(paramKey("mam_last"));
+        account_->seenMessages()->fromList(
+            edb->getStorageParam(paramKey("mam_seen")).split('\n', QString::SkipEmptyParts));
+    }
+    pages_ = 0;
+    requestPage();
+}
+
+void ArchiveSync::stop()
+{
+    if (task_)
+        task_->safeDelete();
+    saveState();
+}
+
+void ArchiveSync::requestPage()
+{
+    task_ = new MamQueryTask(account_->client()->rootTask());
+    connect(task_, SIGNAL(finished()), SLOT(pageFinished()));
+    if (cursor_.isEmpty())
+        task_->queryLatest(pageSize); // first sync of this account. don't pull the whole archive
+    else
+        task_->queryAfter(cursor_, pageSize);
+    task_->go(true);
+}
+
+void ArchiveSync::pageFinished()
+{
+    MamQueryTask *task = static_cast<MamQueryTask *>(sender());
+    if (!task->success()) {
+        qDebug("ArchiveSync: archive query failed: %s", qPrintable(task->statusString()));
+        return;
+    }
+
+    EDB *         edb  = account_->edb();
+    SeenMessages *seen = account_->seenMessages();
+    for (const MamQueryTask::Item &item : task->items()) {
+        const XMPP::Message &m   = item.message;
+        SeenMessages::Ids    ids = SeenMessages::idsOf(m, account_->jid());
+        ids.originId             = item.originId;
+        ids.archiveId            = item.archiveId;
+        if (seen->testAndInsert(ids))
+            continue;
+        if (m.type() == "groupchat" || m.type() == "error" || m.body().isEmpty() || !m.xencrypted().isEmpty())
+            continue;
+
+        bool      outgoing = m.from().compare(account_->jid(), false);
+        XMPP::Jid contact  = (outgoing ? m.to() : m.from()).bare();
+        if (contact.isEmpty() || account_->findGCContact(contact))
+            continue;
+
+        MessageEvent::Ptr me(new MessageEvent(m, account_));
+        me->setOriginLocal(outgoing);
+        me->setTimeStamp(m.timeStamp());
+        edb->appendDeferred(account_->id(), contact, me, EDB::Contact);
+    }
+
+    if (!task->lastId().isEmpty())
+        cursor_ = task->lastId();
+    saveState();
+
+    if (!task->complete() && !task->items().isEmpty() && ++pages_ < maxPages && !cursor_.isEmpty())
+        requestPage();
+}
+
+void ArchiveSync::saveState()
+{
+    if (!loaded_)
+        return;
+    EDB *edb = account_->edb();
+    edb->setStorageParam(paramKey("mam_last"), cursor_);
+    edb->setStorageParam(paramKey("mam_seen"), account_->seenMessages()->toList().join('\n'));
+}
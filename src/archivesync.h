@@ -0,0 +1,54 @@
+/*
+ * archivesync.h - copies the server side message archive into local history
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ARCHIVESYNC_H
+#define ARCHIVESYNC_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+class MamQueryTask;
+class PsiAccount;
+
+class ArchiveSync : public QObject
+{
+    Q_OBJECT
+public:
+    ArchiveSync(PsiAccount *account);
+
+    void start();
+    void stop();
+
+private slots:
+    void pageFinished();
+
+private:
+    PsiAccount *          account_;
+    QPointer<MamQueryTask> task_;
+    QString               cursor_; // archive id of the last synced message
+    int                   pages_;
+    bool                  loaded_;
+
+    void    requestPage();
+    void    saveState();
+    QString paramKey(const char *name) const;
+};
+
+#endif // ARCHIVESYNC_H
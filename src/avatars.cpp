@@ -29,10 +29,14 @@
 #include "applicationinfo.h"
 #include "filecache.h"
 #include "iconset.h"
+#include "jidkey.h"
+#include "idlescheduler.h"
 #include "pepmanager.h"
+#include "pixmapcache.h"
 #include "pixmaputil.h"
 #include "profiles.h"
 #include "psiaccount.h"
+#include "stanzapacer.h"
 #include "vcardfactory.h"
 #include "xmpp_client.h"
 #include "xmpp_hash.h"
@@ -48,9 +52,12 @@
 #include <QDomElement>
 #include <QFile>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QImageReader>
 #include <QPainter>
 #include <QPixmap>
+#include <QSet>
+#include <QtConcurrentRun>
 #include <QtCrypto>
 
 // we have retine nowdays and various other huge resolutions.96px is not that big already.
@@ -71,7 +78,7 @@ static QByteArray scaleAvatar(const QByteArray &b)
         qWarning("AvatarFactory::scaleAvatar(): Null image (unrecognized format?)");
         return QByteArray();
     } else if (i.width() > maxSize || i.height() > maxSize) {
-        QImage     image = i.scaled(maxSize, maxSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        QImage     image = PixmapUtil::scaledImage(i, QSize(maxSize, maxSize));
         QByteArray ba;
         QBuffer    buffer(&ba);
         buffer.open(QIODevice::WriteOnly);
@@ -134,7 +141,7 @@ public:
 
     JidIcons icons(const QString &jid)
     {
-        auto it = jidToIcons.constFind(jid);
+        auto it = jidToIcons.constFind(JidKey(jid));
         if (it == jidToIcons.constEnd()) {
             return JidIcons();
         }
@@ -163,7 +170,9 @@ public:
     }
 
     // caches avatars and returns true if it's really something new and valid
-    OpResult setIcon(IconType iconType, const QString &jid, const QByteArray &data, const QByteArray &_hash = QByteArray())
+    // scaled is scaleAvatar(data) when the caller has it already, e.g. from a worker thread
+    OpResult setIcon(IconType iconType, const QString &jid, const QByteArray &data, const QByteArray &_hash = QByteArray(),
+                     const QByteArray &scaled = QByteArray())
     {
         QString metaType = image2type(data);
         if (metaType.isEmpty()) { // a little bit stupid. It's better to use some enum
@@ -175,7 +184,7 @@ public:
             // do not scale. keep as is. we make avatar from it later
             newData = data;
         } else {
-            newData = scaleAvatar(data);
+            newData = scaled.isNull() ? scaleAvatar(data) : scaled;
             if (!newData.isSharedWith(data)) { // some new data. so resized
                 metaType = QLatin1String("image/png");
             }
@@ -184,7 +193,7 @@ public:
         if (newData.isNull())
             return NoData;
 
-        auto &icons = jidToIcons[jid];  // it's fine to make new icons-item here. it's anyway required after all the checks
+        auto &icons = jidToIcons[JidKey(jid)];  // it's fine to make new icons-item here. it's anyway required after all the checks
         if (!canAdd(icons, iconType)) { // for new icons-item we definitely can
             return NotChanged;
         }
@@ -219,7 +228,7 @@ public:
             icons.avatar = nullptr; // we have to regenerate it from new vcard
         }
 
-        FileCacheItem *newActiveItem = ensureHasAvatar(icons, jid);
+        FileCacheItem *newActiveItem = ensureHasAvatar(icons, jid, iconType == VCardType ? scaled : QByteArray());
         return oldActiveItem == newActiveItem ? Changed : UserUpdateRequired;
     }
 
@@ -227,7 +236,7 @@ public:
     // keepEmptyIcons - don't remove from jidToIcons even if all icons associated with jid are empty.
     OpResult removeIcon(IconType iconType, const QString &jid, bool keepEmptyIcons = false)
     {
-        auto it = jidToIcons.find(jid);
+        auto it = jidToIcons.find(JidKey(jid));
         if (it == jidToIcons.end()) {
             return NoData; // wtf?
         }
@@ -275,7 +284,7 @@ public:
         if (itemOut) {
             *itemOut = item;
         }
-        auto &icons = jidToIcons[jid];
+        auto &icons = jidToIcons[JidKey(jid)];
         if (iconsOut) {
             *iconsOut = &icons;
         }
@@ -305,11 +314,12 @@ protected:
     void removeItem(FileCacheItem *item, bool needSync)
     {
         QStringList jids = item->metadata().value(QLatin1String("jids")).toStringList();
+        fromVCard.remove(QByteArray::fromHex(item->metadata().value(QLatin1String("source")).toString().toLatin1()));
         // weh have user of this icon. And this users can use other icons as well. so we have to properly update them
         for (const QString &j : jids) {
             IconType itype = extractIconType(j);
             QString  jid   = extractIconJid(j);
-            auto     it    = jidToIcons.find(jid);
+            auto     it    = jidToIcons.find(JidKey(jid));
             if (it == jidToIcons.end()) { // never happens if we maintain cache properly
                 continue;
             }
@@ -378,11 +388,22 @@ private:
         }
     }
 
-    FileCacheItem *ensureHasAvatar(const JidIcons &icons, const QString &jid)
+    FileCacheItem *ensureHasAvatar(const JidIcons &icons, const QString &jid, const QByteArray &scaled = QByteArray())
     {
         FileCacheItem *item = activeAvatarIcon(icons);
         if (!item && icons.vcard) {
-            setIcon(AvatarFromVCardType, jid, icons.vcard->data()); // it should change our "icons"
+            // the same photo comes with other contacts, accounts and rooms. scale it once
+            const QByteArray source = icons.vcard->id().data();
+            auto             it     = fromVCard.constFind(source);
+            if (it == fromVCard.constEnd() || appendUser(it.value(), AvatarFromVCardType, jid) == NoData) {
+                setIcon(AvatarFromVCardType, jid, icons.vcard->data(), QByteArray(), scaled); // it should change our "icons"
+                if (icons.avatar && icons.avatarFromVCard && icons.avatar != icons.vcard) {
+                    QVariantMap md = icons.avatar->metadata();
+                    md.insert(QLatin1String("source"), QString::fromLatin1(source.toHex()));
+                    icons.avatar->setMetadata(md);
+                    fromVCard.insert(source, icons.avatar->id().data());
+                }
+            }
             item = icons.avatar;
         }
         return item;
@@ -506,6 +527,10 @@ private:
                 FileCache::removeItem(it.value(), true);
                 continue;
             }
+            QString source = md.value(QLatin1String("source")).toString();
+            if (!source.isEmpty()) {
+                fromVCard.insert(QByteArray::fromHex(source.toLatin1()), it.key().data());
+            }
             QMutableStringListIterator jIt(jids);
             bool                       jidsChanged = false;
             while (jIt.hasNext()) {
@@ -519,19 +544,19 @@ private:
                     jIt.remove();
                     break;
                 case AvatarType: // pep
-                    jidToIcons[realJid].avatar = it.value();
+                    jidToIcons[JidKey(realJid)].avatar = it.value();
                     break;
                 case VCardType:
-                    jidToIcons[realJid].vcard = it.value();
+                    jidToIcons[JidKey(realJid)].vcard = it.value();
                     break;
                 case AvatarFromVCardType: {
-                    auto &ref           = jidToIcons[realJid];
+                    auto &ref           = jidToIcons[JidKey(realJid)];
                     ref.avatar          = it.value();
                     ref.avatarFromVCard = true;
                     break;
                 }
                 case CustomType:
-                    jidToIcons[realJid].customAvatar = it.value();
+                    jidToIcons[JidKey(realJid)].customAvatar = it.value();
                     break;
                 }
             }
@@ -543,7 +568,8 @@ private:
         }
     }
 
-    QHash<QString, JidIcons> jidToIcons;
+    QHash<JidKey, JidIcons>       jidToIcons; // by bare jid, by room jid/nick for group chats
+    QHash<QByteArray, QByteArray> fromVCard;  // vcard photo hash => hash of the avatar scaled from it
 
     static AvatarCache *_instance;
 };
@@ -562,8 +588,58 @@ public:
     PsiAccount *pa_;
     Iconset     iconset_;
 
-    QQueue<std::tuple<Jid, QByteArray, bool>> vcardReqQueue_;
-    QTimer                                    vcardReqTimer_;
+    struct VCardRequest {
+        Jid        jid;
+        QByteArray hash;
+        bool       isMuc;
+    };
+    struct ServerState {
+        int    running = 0;
+        int    backoff = 0; // msecs
+        qint64 retryAt = 0;
+    };
+
+    QList<VCardRequest>          vcardReqQueue_;  // the front is fetched first
+    QHash<QString, ServerState>  vcardServers_;   // domain => requests state
+    QSet<QByteArray>             vcardReqHashes_; // photos being fetched. others with the same one wait for it
+    QSet<QByteArray>             preparing_;      // photos being scaled. others with the same one wait for it too
+    QHash<QString, quint64>      prepareSeq_;     // typed jid => latest scaling job, older results are dropped
+    quint64                      lastPrepare_ = 0;
+
+    // Decodes and scales the image in a worker thread and caches it when done,
+    // so big vcard photos don't stall the event loop
+    void setIconLater(AvatarFactory *q, AvatarCache::IconType iconType, const Jid &jid, const QString &fullJid,
+                      const QByteArray &data, const QByteArray &hash)
+    {
+        if (image2type(data).isEmpty())
+            return;
+
+        const QString key = QString::number(iconType) + fullJid;
+        const quint64 seq = ++lastPrepare_;
+        prepareSeq_.insert(key, seq);
+        if (!hash.isEmpty())
+            preparing_.insert(hash);
+
+        // parented to the factory, so the result is dropped if the account is gone
+        auto watcher = new QFutureWatcher<QByteArray>(q);
+        QObject::connect(watcher, &QFutureWatcherBase::finished, q, [this, q, watcher, iconType, jid, fullJid, data, hash, key, seq]() {
+            watcher->deleteLater();
+            if (!hash.isEmpty())
+                preparing_.remove(hash);
+            if (prepareSeq_.value(key) == seq) {
+                prepareSeq_.remove(key);
+                QByteArray scaled = watcher->result();
+                if (!scaled.isNull()
+                    && AvatarCache::instance()->setIcon(iconType, fullJid, data, hash, scaled) == AvatarCache::UserUpdateRequired) {
+                    iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(fullJid));
+                    emit q->avatarChanged(jid);
+                }
+            }
+            if (!hash.isEmpty() && !vcardReqQueue_.isEmpty())
+                q->processVCardQueue(); // those waiting for the same photo
+        });
+        watcher->setFuture(QtConcurrent::run(scaleAvatar, data));
+    }
 };
 
 AvatarFactory::AvatarFactory(PsiAccount *pa) :
@@ -573,40 +649,12 @@ AvatarFactory::AvatarFactory(PsiAccount *pa) :
     // Register iconset
     d->iconset_.addToFactory();
 
-    d->vcardReqTimer_.setSingleShot(false);
-    d->vcardReqTimer_.setInterval(VcardReqInterval);
-    QObject::connect(&d->vcardReqTimer_, &QTimer::timeout, this, [this]() {
-        Jid        j;
-        QByteArray hash;
-        bool       isMuc;
-        std::tie(j, hash, isMuc) = d->vcardReqQueue_.dequeue();
-        if (d->vcardReqQueue_.isEmpty()) {
-            d->vcardReqTimer_.stop();
-        }
-        VCardFactory::instance()->getVCard(
-            j,
-            d->pa_->client()->rootTask(), this, [this, hash]() {
-                auto task = dynamic_cast<JT_VCard *>(sender());
-                if (task->success() && !task->vcard().isNull()) {
-                    QByteArray ba = task->vcard().photo();
-                    if (!ba.isNull()) {
-                        QString fullJid = task->jid().full(); // jids for regular contacts are already without resource
-                        if (AvatarCache::instance()->setIcon(AvatarCache::VCardType, fullJid, ba, hash) == AvatarCache::UserUpdateRequired) {
-                            d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(task->jid().full()));
-                            emit avatarChanged(task->jid());
-                        }
-                    }
-                }
-            },
-            !isMuc, isMuc, false);
-    });
-
     // Connect signals
     connect(VCardFactory::instance(), SIGNAL(vcardPhotoAvailable(Jid, bool)), this, SLOT(vcardUpdated(Jid, bool)));
     connect(d->pa_->client(), SIGNAL(resourceAvailable(const Jid &, const Resource &)), SLOT(resourceAvailable(const Jid &, const Resource &)));
 
     // PEP
-    connect(d->pa_->pepManager(), SIGNAL(itemPublished(const Jid &, const QString &, const PubSubItem &)), SLOT(itemPublished(const Jid &, const QString &, const PubSubItem &)));
+    connect(d->pa_->pepManager(), SIGNAL(itemsPublished(const Jid &, const PEPItems &)), SLOT(itemsPublished(const Jid &, const PEPItems &)));
     connect(d->pa_->pepManager(), SIGNAL(publish_success(const QString &, const PubSubItem &)), SLOT(publish_success(const QString &, const PubSubItem &)));
 }
 
@@ -634,6 +682,23 @@ inline static QPixmap ensureSquareAvatar(const QPixmap &original)
     return square;
 }
 
+// Decoded avatars are shared by the cache hash, so an image used by several
+// contacts, accounts or rooms is decoded once and its pixmap data is shared
+static QPixmap cachedAvatarPixmap(FileCacheItem *item)
+{
+    const QString key = QString::fromLatin1(item->id().data().toHex());
+    QPixmap       pm;
+    if (PixmapCache::find(QLatin1String("avatar-images"), key, &pm))
+        return pm;
+
+    QImage img = QImage::fromData(item->data());
+    if (img.isNull())
+        return pm;
+    pm = ensureSquareAvatar(QPixmap::fromImage(std::move(img)));
+    PixmapCache::insert(QLatin1String("avatar-images"), key, pm);
+    return pm;
+}
+
 QPixmap AvatarFactory::getAvatar(const Jid &_jid)
 {
     QString bareJid  = _jid.bare();
@@ -643,24 +708,25 @@ QPixmap AvatarFactory::getAvatar(const Jid &_jid)
         return iconp->pixmap();
     }
 
-    auto   icons = AvatarCache::instance()->icons(bareJid);
-    QImage img;
+    auto    icons = AvatarCache::instance()->icons(bareJid);
+    QPixmap pm;
     if (icons.customAvatar) {
-        img = QImage::fromData(icons.customAvatar->data());
-        if (img.isNull()) {
+        pm = cachedAvatarPixmap(icons.customAvatar);
+        if (pm.isNull()) {
             AvatarCache::instance()->removeIcon(AvatarCache::CustomType, bareJid);
         }
     }
-    if (img.isNull() && icons.avatar) {
-        img = QImage::fromData(icons.avatar->data());
-        if (img.isNull()) {
+    if (pm.isNull() && icons.avatar) {
+        pm = cachedAvatarPixmap(icons.avatar);
+        if (pm.isNull()) {
             AvatarCache::instance()->removeIcon(AvatarCache::AvatarType, bareJid);
         }
     }
 
-    if (img.isNull()) {
+    if (pm.isNull()) {
         auto vcard = VCardFactory::instance()->vcard(_jid);
         if (vcard.isNull() || vcard.photo().isNull()) {
+            prioritizeVCard(_jid.withResource(QString()));
             return QPixmap();
         }
         QByteArray data = vcard.photo();
@@ -669,17 +735,14 @@ QPixmap AvatarFactory::getAvatar(const Jid &_jid)
             if (!item)
                 qWarning("Avatars cache is damaged");
             else
-                img = QImage::fromData(item->data()); // from scaled avatar
+                pm = cachedAvatarPixmap(item); // from scaled avatar
         }
     }
 
-    if (img.isNull()) {
+    if (pm.isNull()) {
         return QPixmap();
     }
 
-    QPixmap pm = QPixmap::fromImage(std::move(img));
-    pm         = ensureSquareAvatar(pm);
-
     // Update iconset
     PsiIcon icon;
     icon.setImpix(pm);
@@ -752,32 +815,27 @@ QPixmap AvatarFactory::getMucAvatar(const Jid &_jid)
         return iconp->pixmap();
     }
 
-    auto       icons = AvatarCache::instance()->icons(fullJid);
-    QByteArray data;
+    auto icons = AvatarCache::instance()->icons(fullJid);
     if (!icons.avatar) {
         auto vcard = VCardFactory::instance()->mucVcard(_jid);
         if (vcard.isNull() || vcard.photo().isNull()) {
+            prioritizeVCard(_jid);
             return QPixmap();
         }
-        data = vcard.photo();
-        AvatarCache::instance()->setIcon(AvatarCache::VCardType, _jid.full(), data);
+        AvatarCache::instance()->setIcon(AvatarCache::VCardType, _jid.full(), vcard.photo());
         icons = AvatarCache::instance()->icons(fullJid); // should return scaled copy
     }
 
+    // for mucs icons.avatar is always made of vcard and anything else is not supported. at least for now.
+    QPixmap pm;
     if (icons.avatar) {
-        data = icons.avatar->data();
+        pm = cachedAvatarPixmap(icons.avatar);
     }
 
-    // for mucs icons.avatar is always made of vcard and anything else is not supported. at least for now.
-    QImage img(QImage::fromData(data));
-
-    if (img.isNull()) {
+    if (pm.isNull()) {
         return QPixmap();
     }
 
-    QPixmap pm = QPixmap::fromImage(std::move(img));
-    pm         = ensureSquareAvatar(pm);
-
     // Update iconset
     PsiIcon icon;
     icon.setImpix(pm);
@@ -863,15 +921,121 @@ void AvatarFactory::statusUpdate(const Jid &jid, const XMPP::Status &status)
                 d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(fullJid));
                 emit avatarChanged(jid);
             } else if (result == AvatarCache::NoData) {
-                d->vcardReqQueue_.enqueue(std::tuple<Jid, QByteArray, bool> { jid, hash, isMuc });
-                if (!d->vcardReqTimer_.isActive()) {
-                    d->vcardReqTimer_.start();
+                bool queued = false;
+                for (auto &r : d->vcardReqQueue_) {
+                    if (r.jid == jid) {
+                        r.hash = hash;
+                        queued = true;
+                        break;
+                    }
+                }
+                if (!queued) {
+                    d->vcardReqQueue_.append({ jid, hash, isMuc });
                 }
+                processVCardQueue();
             }
         }
     }
 }
 
+/**
+ * Starts vcard avatar requests while servers have free slots. A photo already
+ * being fetched for somebody else is not requested again, the waiting users
+ * get it from the cache when the first request finishes.
+ */
+void AvatarFactory::processVCardQueue()
+{
+    const qint64 now       = QDateTime::currentMSecsSinceEpoch();
+    qint64       nextRetry = 0;
+    QList<Jid>   changed;
+    for (auto it = d->vcardReqQueue_.begin(); it != d->vcardReqQueue_.end();) {
+        if (d->vcardReqHashes_.contains(it->hash) || d->preparing_.contains(it->hash)) {
+            ++it;
+            continue;
+        }
+        QString fullJid = it->jid.full();
+        auto    result  = AvatarCache::instance()->appendUser(it->hash, AvatarCache::VCardType, fullJid);
+        if (result != AvatarCache::NoData) { // came with somebody else's vcard
+            if (result == AvatarCache::UserUpdateRequired) {
+                d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(fullJid));
+                changed.append(it->jid);
+            }
+            it = d->vcardReqQueue_.erase(it);
+            continue;
+        }
+
+        QString server = it->jid.domain();
+        auto &  state  = d->vcardServers_[server];
+        if (state.retryAt > now) {
+            nextRetry = nextRetry ? qMin(nextRetry, state.retryAt) : state.retryAt;
+            ++it;
+            continue;
+        }
+        if (state.running >= VcardReqPerServer) {
+            ++it;
+            continue;
+        }
+        if (!d->pa_->stanzaPacer()->admit(StanzaPacer::Background, this, [this]() { processVCardQueue(); }))
+            break;
+
+        Private::VCardRequest req = *it;
+        it = d->vcardReqQueue_.erase(it);
+        state.running++;
+        d->vcardReqHashes_.insert(req.hash);
+
+        auto task = VCardFactory::instance()->getVCard(
+            req.jid, d->pa_->client()->rootTask(), this,
+            [this, req, server]() {
+                auto  task  = dynamic_cast<JT_VCard *>(sender());
+                auto &state = d->vcardServers_[server];
+                if (task->success()) {
+                    state.backoff = 0;
+                    QByteArray ba = task->vcard().photo();
+                    if (!task->vcard().isNull() && !ba.isNull()) {
+                        QString fullJid = task->jid().full(); // jids for regular contacts are already without resource
+                        d->setIconLater(this, AvatarCache::VCardType, task->jid(), fullJid, ba, req.hash);
+                    }
+                } else if (task->statusCode() != 403 && task->statusCode() != 404 && task->statusCode() != 501 && task->statusCode() != 503) {
+                    // not just a contact without vcard. the server is unhappy, slow down
+                    state.backoff = state.backoff ? qMin(state.backoff * 2, int(VcardReqMaxBackoff)) : 1000;
+                    state.retryAt = QDateTime::currentMSecsSinceEpoch() + state.backoff;
+                }
+            },
+            !req.isMuc, req.isMuc, false);
+
+        // tasks are deleted when finished or when the connection is gone
+        connect(task, &QObject::destroyed, this, [this, req, server]() {
+            d->vcardServers_[server].running--;
+            d->vcardReqHashes_.remove(req.hash);
+            processVCardQueue();
+        });
+    }
+
+    if (nextRetry) {
+        // wake up servers after backoff, preferably while the user is not busy
+        int wait = int(qMax(qint64(0), nextRetry - now));
+        IdleScheduler::instance()->schedule(this, "vcards", [this]() { processVCardQueue(); },
+                                            IdleScheduler::Low, wait + 5000, wait);
+    }
+    for (const Jid &j : changed) {
+        emit avatarChanged(j);
+    }
+}
+
+/**
+ * Moves a queued vcard avatar request to the front. Called when the avatar
+ * is actually wanted, e.g. for a visible roster row or muc participant.
+ */
+void AvatarFactory::prioritizeVCard(const Jid &jid)
+{
+    for (int i = 1; i < d->vcardReqQueue_.size(); ++i) {
+        if (d->vcardReqQueue_.at(i).jid == jid) {
+            d->vcardReqQueue_.move(i, 0);
+            break;
+        }
+    }
+}
+
 QString AvatarFactory::getCacheDir()
 {
     QDir avatars(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/avatars");
@@ -898,28 +1062,33 @@ QPixmap AvatarFactory::roundedAvatar(const QPixmap &pix, int rad, int avSize)
 {
     QPixmap avatar_icon;
     QPixmap av = pix;
-    if (!pix.isNull()) {
-        if (avSize != 0) {
-            if (rad != 0) {
-                avSize         = qMax(avSize, rad * 2);
-                av             = av.scaled(avSize, avSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-                int          w = av.width(), h = av.height();
-                QPainterPath pp;
-                pp.addRoundedRect(0, 0, w, h, rad, rad);
-                avatar_icon = QPixmap(w, h);
-                avatar_icon.fill(QColor(0, 0, 0, 0));
-                QPainter mp(&avatar_icon);
-                mp.setBackgroundMode(Qt::TransparentMode);
-                mp.setRenderHints(QPainter::Antialiasing, true);
-                mp.fillPath(pp, QBrush(av));
-            } else {
-                avatar_icon = av.scaled(avSize, avSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-            }
-        } else {
-            avatar_icon = QPixmap();
-        }
+    if (pix.isNull() || avSize == 0)
+        return avatar_icon;
+
+    // delegates ask for the same avatar on every repaint. cacheKey() changes
+    // whenever the source pixmap does, so entries of replaced avatars just
+    // age out of the LRU.
+    QString cachedName = QString("%1/%2/%3").arg(pix.cacheKey()).arg(rad).arg(avSize);
+    if (PixmapCache::find("avatars", cachedName, &avatar_icon))
+        return avatar_icon;
+
+    if (rad != 0) {
+        avSize         = qMax(avSize, rad * 2);
+        av             = QPixmap::fromImage(PixmapUtil::scaledImage(av.toImage(), QSize(avSize, avSize)));
+        int          w = av.width(), h = av.height();
+        QPainterPath pp;
+        pp.addRoundedRect(0, 0, w, h, rad, rad);
+        avatar_icon = QPixmap(w, h);
+        avatar_icon.fill(QColor(0, 0, 0, 0));
+        QPainter mp(&avatar_icon);
+        mp.setBackgroundMode(Qt::TransparentMode);
+        mp.setRenderHints(QPainter::Antialiasing, true);
+        mp.fillPath(pp, QBrush(av));
+    } else {
+        avatar_icon = QPixmap::fromImage(PixmapUtil::scaledImage(av.toImage(), QSize(avSize, avSize)));
     }
 
+    PixmapCache::insert("avatars", cachedName, avatar_icon);
     return avatar_icon;
 }
 
@@ -940,13 +1109,21 @@ void AvatarFactory::vcardUpdated(const Jid &j, bool isMuc)
     }
     ba = vcard.photo();
     if (!ba.isEmpty()) {
-        if (AvatarCache::instance()->setIcon(AvatarCache::VCardType, fullJid, ba) == AvatarCache::UserUpdateRequired) {
-            d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(fullJid));
-            emit avatarChanged(j);
-        }
+        d->setIconLater(this, AvatarCache::VCardType, j, fullJid, ba, QByteArray());
     }
 }
 
+void AvatarFactory::itemsPublished(const Jid &jid, const PEPItems &items)
+{
+    // metadata first: the data node is only useful once we know it's wanted
+    auto it = items.constFind(PEP_AVATAR_METADATA_NS);
+    if (it != items.constEnd())
+        itemPublished(jid, it.key(), it.value());
+    it = items.constFind(PEP_AVATAR_DATA_NS);
+    if (it != items.constEnd())
+        itemPublished(jid, it.key(), it.value());
+}
+
 void AvatarFactory::itemPublished(const Jid &jid, const QString &n, const PubSubItem &item)
 {
     AvatarCache *         cache   = AvatarCache::instance();
@@ -963,8 +1140,9 @@ void AvatarFactory::itemPublished(const Jid &jid, const QString &n, const PubSub
             if (result == AvatarCache::NoData) {
                 QByteArray ba = QByteArray::fromBase64(item.payload().text().toLatin1());
                 if (!ba.isEmpty()) {
-                    result = cache->setIcon(AvatarCache::AvatarType, jidFull, ba, hash);
+                    d->setIconLater(this, AvatarCache::AvatarType, jid, jidFull, ba, hash);
                 }
+                return;
             }
         } else {
             qWarning("avatars.cpp: Unexpected item payload");
@@ -994,7 +1172,8 @@ void AvatarFactory::itemPublished(const Jid &jid, const QString &n, const PubSub
                 // found in-band png (by xep84 hash is for png) avatar. So we can make request
                 result = cache->appendUser(hash, AvatarCache::AvatarType, jidFull);
                 if (result == AvatarCache::NoData) {
-                    d->pa_->pepManager()->get(jid, PEP_AVATAR_DATA_NS, hash);
+                    if (!d->preparing_.contains(hash)) // else the data is already here
+                        d->pa_->pepManager()->get(jid, PEP_AVATAR_DATA_NS, hash);
                     return;
                 }
                 break;
@@ -20,6 +20,8 @@
 #ifndef AVATARS_H
 #define AVATARS_H
 
+#include "pepmanager.h"
+
 #include <QByteArray>
 #include <QMap>
 #include <QPixmap>
@@ -53,7 +55,8 @@ using namespace XMPP;
 class AvatarFactory : public QObject {
     Q_OBJECT
 
-    static const int VcardReqInterval = 500; // query vcard avatars once per half second
+    static const int VcardReqPerServer  = 3;     // vcard avatar requests running at once to one server
+    static const int VcardReqMaxBackoff = 60000; // msecs
 
 public:
     struct UserHashes {
@@ -92,7 +95,7 @@ signals:
     void avatarChanged(const Jid &);
 
 protected slots:
-    void itemPublished(const Jid &, const QString &, const PubSubItem &);
+    void itemsPublished(const Jid &, const PEPItems &);
     void publish_success(const QString &, const PubSubItem &);
     void resourceAvailable(const Jid &, const Resource &);
 
@@ -102,6 +105,10 @@ private slots:
 private:
     class Private;
     Private *d;
+
+    void itemPublished(const Jid &, const QString &, const PubSubItem &);
+    void processVCardQueue();
+    void prioritizeVCard(const Jid &jid);
 };
 
 #endif // AVATARS_H
@@ -27,14 +27,22 @@
 #include "xmpp_jid.h"
 
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QLibrary>
+#include <QMutex>
+#include <QThread>
 #include <QtCrypto>
 #include <stdio.h>
 #include <stdlib.h>
 
 #define USE_THREAD
 
+// kbps, the cap for the bitrate controller when none was negotiated
+static const int defaultMaximumVideoBitrate = 2048;
+
 // get default settings
 static MediaConfiguration getDefaultConfiguration()
 {
@@ -157,6 +165,68 @@ static PsiMedia::PayloadInfo payloadTypeToPayloadInfo(const JingleRtpPayloadType
     return out;
 }
 
+// 32 bits from the middle of an NTP timestamp, in 1/65536 seconds, as
+//   used for the round trip time of RTCP reports (RFC 3550, 6.4.1)
+static quint32 ntpMiddle32()
+{
+    const qint64 msecs = QDateTime::currentMSecsSinceEpoch() + qint64(2208988800LL) * 1000;
+    return quint32(((msecs / 1000) << 16) | ((msecs % 1000) * 65536 / 1000));
+}
+
+static quint32 readUInt32(const char *p)
+{
+    const uchar *u = reinterpret_cast<const uchar*>(p);
+    return (quint32(u[0]) << 24) | (quint32(u[1]) << 16) | (quint32(u[2]) << 8) | u[3];
+}
+
+// loss based rate control as in Google Congestion Control, also backing
+//   off on growing round trip times, since on Wi-Fi queues fill before
+//   loss shows
+class AvBitrateController
+{
+public:
+    static const int minimumKbps = 64;
+
+    AvBitrateController(int maximumKbps) :
+        maximum(qMax(int(minimumKbps), maximumKbps)),
+        current(maximum),
+        minRtt(-1)
+    {
+    }
+
+    int bitrate() const
+    {
+        return current;
+    }
+
+    // returns true if the bitrate changed enough to be worth applying
+    bool update(int fractionLost, int rtt)
+    {
+        const double loss = fractionLost / 256.0;
+        if(rtt >= 0)
+            minRtt = (minRtt < 0) ? rtt : qMin(minRtt, rtt);
+
+        double next = current;
+        if(loss > 0.1)
+            next = current * (1.0 - 0.5 * loss);
+        else if(rtt >= 0 && rtt > minRtt * 2 + 50)
+            next = current * 0.85;
+        else if(loss < 0.02)
+            next = current * 1.08 + 1;
+
+        const int kbps = qBound(int(minimumKbps), int(next), maximum);
+        if(qAbs(kbps - current) * 20 < current)
+            return false;
+        current = kbps;
+        return true;
+    }
+
+private:
+    int maximum;
+    int current;
+    int minRtt;
+};
+
 class AvTransmit : public QObject
 {
     Q_OBJECT
@@ -165,12 +235,20 @@ public:
     PsiMedia::RtpChannel *audio, *video;
     JingleRtpChannel *transport;
 
+    // reused between wakeups, so forwarding doesn't allocate once warmed up
+    QVector<PsiMedia::RtpRawPacket> mediaPackets, audioPackets, videoPackets;
+    JingleRtp::RtpPackets transportPackets;
+
     AvTransmit(PsiMedia::RtpChannel *_audio, PsiMedia::RtpChannel *_video, JingleRtpChannel *_transport, QObject *parent = nullptr) :
         QObject(parent),
         audio(_audio),
         video(_video),
-        transport(_transport)
+        transport(_transport),
+        lastArrival(-1),
+        lastSpacing(-1)
     {
+        clock.start();
+
         if(audio)
         {
             audio->setParent(this);
@@ -197,48 +275,149 @@ public:
         transport->setParent(nullptr);
     }
 
-private slots:
-    void audio_readyRead()
+    // may be called from any thread
+    AvCall::Statistics statistics() const
     {
-        while(audio->packetsAvailable() > 0)
-        {
-            PsiMedia::RtpPacket packet = audio->read();
+        QMutexLocker locker(&statsMutex);
+        return stats;
+    }
 
-            JingleRtp::RtpPacket jpacket;
-            jpacket.type = JingleRtp::Audio;
-            jpacket.portOffset = packet.portOffset();
-            jpacket.value = packet.rawValue();
+signals:
+    // from RTCP receiver reports about our video. rtt is in msecs, or -1
+    void videoReport(int fractionLost, int rtt);
+
+private:
+    QElapsedTimer clock;
+    mutable QMutex statsMutex;
+    AvCall::Statistics stats;
+    qint64 lastArrival, lastSpacing; // usecs
+
+    void addForwardTime(qint64 start)
+    {
+        const qint64 usecs = clock.nsecsElapsed() / 1000 - start;
+        stats.forwardTimeMax = qMax(stats.forwardTimeMax, int(usecs));
+        // exponential average, as for the jitter below
+        stats.forwardTimeAverage += (int(usecs) - stats.forwardTimeAverage) / 16;
+    }
+
+    // RFC 3550 style jitter estimate, taken on the spacing between batch
+    //   arrivals, since the clock rates of the payloads aren't known here
+    void parseRtcp(const QByteArray &packet)
+    {
+        const quint32 now = ntpMiddle32();
+        const char *p = packet.constData();
+        int left = packet.size();
+        // a compound packet, SR = 200 and RR = 201 carry report blocks
+        while(left >= 8)
+        {
+            const int count = uchar(p[0]) & 0x1f;
+            const int type = uchar(p[1]);
+            const int len = (((uchar(p[2]) << 8) | uchar(p[3])) + 1) * 4;
+            if(len > left)
+                break;
+
+            const int offset = (type == 200) ? 28 : (type == 201 ? 8 : -1);
+            if(offset != -1 && count > 0 && offset + 24 <= len)
+            {
+                const char *block = p + offset;
+                const quint32 lsr = readUInt32(block + 16);
+                const quint32 dlsr = readUInt32(block + 20);
+                int rtt = -1;
+                if(lsr != 0 && now - lsr >= dlsr)
+                    rtt = int(qint64(now - lsr - dlsr) * 1000 / 65536);
+                if(rtt > 60000) // clocks out of sync
+                    rtt = -1;
+                emit videoReport(uchar(block[4]), rtt);
+            }
 
-            transport->write(jpacket);
+            p += len;
+            left -= len;
         }
     }
 
-    void video_readyRead()
+    void addArrival(qint64 now)
     {
-        while(video->packetsAvailable() > 0)
+        if(lastArrival >= 0)
         {
-            PsiMedia::RtpPacket packet = video->read();
+            const qint64 spacing = now - lastArrival;
+            if(lastSpacing >= 0)
+            {
+                const qint64 d = qAbs(spacing - lastSpacing);
+                stats.jitter += (int(d) - stats.jitter) / 16;
+            }
+            lastSpacing = spacing;
+        }
+        lastArrival = now;
+    }
 
-            JingleRtp::RtpPacket jpacket;
-            jpacket.type = JingleRtp::Video;
-            jpacket.portOffset = packet.portOffset();
-            jpacket.value = packet.rawValue();
+private slots:
+    // payloads are implicitly shared, so only the packet headers are copied
+    void forwardToTransport(PsiMedia::RtpChannel *channel, JingleRtp::Type type)
+    {
+        const qint64 start = clock.nsecsElapsed() / 1000;
+        mediaPackets.resize(0);
+        if(!channel->readAll(mediaPackets))
+            return;
 
-            transport->write(jpacket);
+        transportPackets.resize(0);
+        transportPackets.reserve(mediaPackets.size());
+        foreach(const PsiMedia::RtpRawPacket &packet, mediaPackets)
+        {
+            JingleRtp::RtpPacket jpacket;
+            jpacket.type = type;
+            jpacket.portOffset = packet.portOffset;
+            jpacket.value = packet.rawValue;
+            transportPackets += jpacket;
         }
+        transport->write(transportPackets);
+
+        QMutexLocker locker(&statsMutex);
+        stats.packetsSent += transportPackets.size();
+        addForwardTime(start);
+    }
+
+    void audio_readyRead()
+    {
+        forwardToTransport(audio, JingleRtp::Audio);
+    }
+
+    void video_readyRead()
+    {
+        forwardToTransport(video, JingleRtp::Video);
     }
 
     void transport_readyRead()
     {
-        while(transport->packetsAvailable())
-        {
-            JingleRtp::RtpPacket jpacket = transport->read();
+        const qint64 start = clock.nsecsElapsed() / 1000;
+        transportPackets.resize(0);
+        if(!transport->readAll(transportPackets))
+            return;
 
-            if(jpacket.type == JingleRtp::Audio && audio) // FIXME why audio could null but we still receive packets? (the check was added to fix a crash)
-                audio->write(PsiMedia::RtpPacket(jpacket.value, jpacket.portOffset));
-            else if(jpacket.type == JingleRtp::Video && video) //  FIXME see above
-                video->write(PsiMedia::RtpPacket(jpacket.value, jpacket.portOffset));
+        audioPackets.resize(0);
+        videoPackets.resize(0);
+        foreach(const JingleRtp::RtpPacket &jpacket, transportPackets)
+        {
+            PsiMedia::RtpRawPacket packet;
+            packet.rawValue = jpacket.value;
+            packet.portOffset = jpacket.portOffset;
+            if(jpacket.type == JingleRtp::Audio)
+                audioPackets += packet;
+            else if(jpacket.type == JingleRtp::Video)
+            {
+                videoPackets += packet;
+                if(jpacket.portOffset == 1)
+                    parseRtcp(jpacket.value);
+            }
         }
+        if(audio) // FIXME why audio could null but we still receive packets? (the check was added to fix a crash)
+            audio->write(audioPackets);
+        if(video) //  FIXME see above
+            video->write(videoPackets);
+
+        QMutexLocker locker(&statsMutex);
+        stats.packetsReceived += transportPackets.size();
+        addArrival(start);
+        addForwardTime(start);
     }
 
     void transport_packetsWritten(int count)
@@ -254,38 +433,38 @@ class AvTransmitHandler : public QObject
     Q_OBJECT
 
 public:
-    AvTransmit *avTransmit;
-    QThread *previousThread;
-
     AvTransmitHandler(QObject *parent = nullptr) :
-        QObject(parent),
-        avTransmit(nullptr),
-        previousThread(nullptr)
+        QObject(parent)
     {
     }
 
     ~AvTransmitHandler()
     {
-        if(avTransmit)
-            releaseAvTransmit();
+        foreach(QObject *avTransmit, previousThreads.keys())
+            releaseAvTransmit(avTransmit);
     }
 
-    // NOTE: the handler never touches these variables except here
-    //   and on destruction, so it's safe to call this function from
-    //   another thread if you know what you're doing.
-    void setAvTransmit(AvTransmit *_avTransmit)
+    // must be called from the thread the transmit currently lives in
+    void setAvTransmit(AvTransmit *avTransmit)
     {
-        avTransmit = _avTransmit;
-        previousThread = avTransmit->thread();
+        QMutexLocker locker(&mutex);
+        previousThreads.insert(avTransmit, avTransmit->thread());
         avTransmit->moveToThread(thread());
     }
 
-    void releaseAvTransmit()
+public slots:
+    // moving an object away only works from its own thread, so this is
+    //   invoked in the handler's thread
+    void releaseAvTransmit(QObject *avTransmit)
     {
-        Q_ASSERT(avTransmit);
-        avTransmit->moveToThread(previousThread);
-        avTransmit = nullptr;
+        QMutexLocker locker(&mutex);
+        Q_ASSERT(previousThreads.contains(avTransmit));
+        avTransmit->moveToThread(previousThreads.take(avTransmit));
     }
+
+private:
+    QMutex mutex;
+    QHash<QObject*, QThread*> previousThreads;
 };
 
 class AvTransmitThread : public QCA::SyncThread
@@ -295,9 +474,12 @@ class AvTransmitThread : public QCA::SyncThread
 public:
     AvTransmitHandler *handler;
 
+    int calls;
+
     AvTransmitThread(QObject *parent = nullptr) :
         QCA::SyncThread(parent),
-        handler(nullptr)
+        handler(nullptr),
+        calls(0)
     {
     }
 
@@ -306,9 +488,45 @@ public:
         stop();
     }
 
+    // calls are spread over at most one thread per core. threads are
+    //   shared by all accounts and only touched from the main thread.
+    static AvTransmitThread *acquire(AvTransmit *avTransmit)
+    {
+        AvTransmitThread *best = nullptr;
+        foreach(AvTransmitThread *t, pool)
+        {
+            if(!best || t->calls < best->calls)
+                best = t;
+        }
+
+        if(!best || (best->calls > 0 && pool.count() < qMax(1, QThread::idealThreadCount())))
+        {
+            best = new AvTransmitThread;
+            best->start();
+            pool += best;
+        }
+
+        ++best->calls;
+        best->handler->setAvTransmit(avTransmit);
+        return best;
+    }
+
+    static void release(AvTransmitThread *t, AvTransmit *avTransmit)
+    {
+        QMetaObject::invokeMethod(t->handler, "releaseAvTransmit", Qt::BlockingQueuedConnection, Q_ARG(QObject*, avTransmit));
+        if(--t->calls == 0)
+        {
+            pool.removeAll(t);
+            delete t;
+        }
+    }
+
 protected:
     virtual void atStart()
     {
+        // there is no portable way to pin a thread to a core, but media
+        //   forwarding should at least not wait behind bulk work
+        QThread::currentThread()->setPriority(QThread::TimeCriticalPriority);
         handler = new AvTransmitHandler;
     }
 
@@ -316,8 +534,13 @@ protected:
     {
         delete handler;
     }
+
+private:
+    static QList<AvTransmitThread*> pool;
 };
 
+QList<AvTransmitThread*> AvTransmitThread::pool;
+
 //----------------------------------------------------------------------------
 // AvCall
 //----------------------------------------------------------------------------
@@ -361,6 +584,7 @@ public:
     bool transmitting;
     AvTransmit *avTransmit;
     AvTransmitThread *avTransmitThread;
+    AvBitrateController *bitrateController;
 
     AvCallPrivate(AvCall *_q) :
         QObject(_q),
@@ -371,7 +595,8 @@ public:
         transmitVideo(false),
         transmitting(false),
         avTransmit(nullptr),
-        avTransmitThread(nullptr)
+        avTransmitThread(nullptr),
+        bitrateController(nullptr)
     {
         allowVideo = AvCallManager::isVideoSupported();
 
@@ -488,12 +713,16 @@ private:
     void cleanup()
     {
         // if we had a thread, this will move the object back
-        delete avTransmitThread;
+        if(avTransmitThread)
+            AvTransmitThread::release(avTransmitThread, avTransmit);
         avTransmitThread = nullptr;
 
         delete avTransmit;
         avTransmit = nullptr;
 
+        delete bitrateController;
+        bitrateController = nullptr;
+
         rtp.reset();
 
         delete sess;
@@ -708,6 +937,12 @@ private slots:
         emit q->error();
     }
 
+    void avTransmit_videoReport(int fractionLost, int rtt)
+    {
+        if(bitrateController && bitrateController->update(fractionLost, rtt))
+            rtp.setMaximumSendingBitrate(bitrateController->bitrate());
+    }
+
     void sess_activated()
     {
         PsiMedia::RtpChannel *audio = nullptr;
@@ -719,10 +954,16 @@ private slots:
             video = rtp.videoRtpChannel();
 
         avTransmit = new AvTransmit(audio, video, sess->rtpChannel());
+        if(transmitVideo)
+        {
+            int maximum = bitrate;
+            if(maximum == -1)
+                maximum = sess->remoteMaximumBitrate();
+            bitrateController = new AvBitrateController(maximum != -1 ? maximum : defaultMaximumVideoBitrate);
+            connect(avTransmit, SIGNAL(videoReport(int,int)), SLOT(avTransmit_videoReport(int,int)));
+        }
 #ifdef USE_THREAD
-        avTransmitThread = new AvTransmitThread(this);
-        avTransmitThread->start();
-        avTransmitThread->handler->setAvTransmit(avTransmit);
+        avTransmitThread = AvTransmitThread::acquire(avTransmit);
 #endif
 
         if(transmitAudio)
@@ -802,6 +1043,19 @@ QString AvCall::errorString() const
     return d->errorString;
 }
 
+AvCall::Statistics AvCall::statistics() const
+{
+    Statistics stats;
+    if(d->avTransmit)
+        stats = d->avTransmit->statistics();
+    if(d->sess)
+    {
+        stats.audio = d->sess->statistics(JingleRtp::Audio);
+        stats.video = d->sess->statistics(JingleRtp::Video);
+    }
+    return stats;
+}
+
 void AvCall::unlink()
 {
     d->unlink();
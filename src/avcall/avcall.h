@@ -19,6 +19,7 @@
 #ifndef AVCALL_H
 #define AVCALL_H
 
+#include "jinglertp.h"
 #include "xmpp.h"
 
 #include <QObject>
@@ -48,6 +49,20 @@ public:
         Both
     };
 
+    // counters of the media forwarding, times are in microseconds
+    struct Statistics
+    {
+        qint64 packetsSent = 0;
+        qint64 packetsReceived = 0;
+        int forwardTimeAverage = 0;
+        int forwardTimeMax = 0;
+        int jitter = 0; // of incoming packet arrivals
+
+        // transport level, per media type
+        JingleRtp::Statistics audio;
+        JingleRtp::Statistics video;
+    };
+
     AvCall(const AvCall &from);
     ~AvCall();
 
@@ -61,6 +76,7 @@ public:
     void setIncomingVideo(PsiMedia::VideoWidget *widget);
 
     QString errorString() const;
+    Statistics statistics() const;
 
     // if we use deleteLater() on a call, then it won't detach from the
     //   manager until the deletion resolves.  use unlink() to immediately
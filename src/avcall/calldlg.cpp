@@ -29,6 +29,7 @@
 #include "xmpp_client.h"
 
 #include <QMessageBox>
+#include <QStringList>
 #include <QTime>
 #include <QTimer>
 
@@ -247,6 +248,26 @@ private slots:
     {
         call_duration = call_duration.addSecs(1);
         ui.lb_status->setText(tr("Call duration: %1").arg(call_duration.toString("mm:ss")));
+        ui.lb_status->setToolTip(statisticsText());
+    }
+
+    QString statisticsText() const
+    {
+        const AvCall::Statistics stats = sess->statistics();
+        QStringList lines;
+        const bool video = sess->mode() != AvCall::Audio;
+        for(int n = 0; n < (video ? 2 : 1); ++n)
+        {
+            const JingleRtp::Statistics &s = (n == 0) ? stats.audio : stats.video;
+            lines += (n == 0) ? tr("Audio") : tr("Video");
+            lines += tr("Received: %1 packets, %2 KiB").arg(s.packetsReceived).arg(s.bytesReceived / 1024);
+            lines += tr("Sent: %1 packets, %2 KiB").arg(s.packetsSent).arg(s.bytesSent / 1024);
+            lines += tr("Dropped: %1, jitter: %2 ms").arg(s.packetsDropped).arg(s.jitter / 1000.0, 0, 'f', 1);
+            lines += tr("Candidates: %1 / %2%3").arg(s.localCandidateTypes.join(","), s.remoteCandidateTypes.join(","),
+                                                   s.relayed() ? tr(" (relayed)") : QString());
+        }
+        lines += tr("Forwarding time: %1 us average, %2 us max").arg(stats.forwardTimeAverage).arg(stats.forwardTimeMax);
+        return lines.join("\n");
     }
 };
 
@@ -24,6 +24,8 @@
 #include "jingle.h"
 #include "xmpp_client.h"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QtCrypto>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,6 +34,10 @@
 // TODO: support candidate negotiations over the JingleRtpChannel thread
 //   boundary, so we can change candidates after the stream is active
 
+// a couple of seconds of video at most, the reader is expected to drain
+//   the queue on every notification
+static const int maxQueuedPackets = 1024;
+
 // scope values: 0 = local, 1 = link-local, 2 = private, 3 = public
 static int getAddressScope(const QHostAddress &a)
 {
@@ -124,6 +130,48 @@ static QString randomCredential(int len)
     return out;
 }
 
+// addresses of the external host and stun servers, shared by the calls of a
+//   manager so that they don't each wait for DNS
+class AddressCache
+{
+public:
+    AddressCache()
+    {
+        clock.start();
+    }
+
+    bool lookup(const QString &host, QHostAddress *addr) const
+    {
+        QHash<QString, Entry>::const_iterator it = entries.constFind(host);
+        if(it == entries.constEnd() || it->expires < clock.elapsed())
+            return false;
+        *addr = it->addr;
+        return true;
+    }
+
+    void insert(const QString &host, const QHostAddress &addr, int ttl)
+    {
+        Entry e;
+        e.addr = addr;
+        e.expires = clock.elapsed() + qBound(int(minTtl), ttl, int(maxTtl)) * 1000LL;
+        entries.insert(host, e);
+    }
+
+private:
+    // secs. servers are looked up again after a while in case they move
+    static const int minTtl = 60;
+    static const int maxTtl = 1800;
+
+    struct Entry
+    {
+        QHostAddress addr;
+        qint64 expires;
+    };
+
+    QElapsedTimer clock;
+    QHash<QString, Entry> entries;
+};
+
 // resolve external address and stun server
 // TODO: resolve hosts and start ice engine simultaneously
 // FIXME: when/if our ICE engine supports adding these dynamically, we should
@@ -147,9 +195,11 @@ private:
 public:
     QHostAddress extAddr;
     QHostAddress stunBindAddr, stunRelayUdpAddr, stunRelayTcpAddr;
+    AddressCache *cache;
 
     Resolver(QObject *parent = nullptr) :
         QObject(parent),
+        cache(nullptr),
         dnsA(parent),
         dnsB(parent),
         dnsC(parent),
@@ -175,37 +225,21 @@ public:
         stunRelayUdpHost = _stunRelayUdpHost;
         stunRelayTcpHost = _stunRelayTcpHost;
 
-        if(!extHost.isEmpty())
-        {
-            extDone = false;
+        extDone = extHost.isEmpty() || (cache && cache->lookup(extHost, &extAddr));
+        if(!extDone)
             dnsA.start(extHost.toLatin1());
-        }
-        else
-            extDone = true;
 
-        if(!stunBindHost.isEmpty())
-        {
-            stunBindDone = false;
+        stunBindDone = stunBindHost.isEmpty() || (cache && cache->lookup(stunBindHost, &stunBindAddr));
+        if(!stunBindDone)
             dnsB.start(stunBindHost.toLatin1());
-        }
-        else
-            stunBindDone = true;
 
-        if(!stunRelayUdpHost.isEmpty())
-        {
-            stunRelayUdpDone = false;
+        stunRelayUdpDone = stunRelayUdpHost.isEmpty() || (cache && cache->lookup(stunRelayUdpHost, &stunRelayUdpAddr));
+        if(!stunRelayUdpDone)
             dnsC.start(stunRelayUdpHost.toLatin1());
-        }
-        else
-            stunRelayUdpDone = true;
 
-        if(!stunRelayTcpHost.isEmpty())
-        {
-            stunRelayTcpDone = false;
+        stunRelayTcpDone = stunRelayTcpHost.isEmpty() || (cache && cache->lookup(stunRelayTcpHost, &stunRelayTcpAddr));
+        if(!stunRelayTcpDone)
             dnsD.start(stunRelayTcpHost.toLatin1());
-        }
-        else
-            stunRelayTcpDone = true;
 
         if(extDone && stunBindDone && stunRelayUdpDone && stunRelayTcpDone)
             QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
@@ -221,6 +255,11 @@ private slots:
 
         // FIXME: support more than one address?
         QHostAddress addr = results.first().address();
+        if(cache)
+        {
+            const QString host = (dns == &dnsA) ? extHost : (dns == &dnsB) ? stunBindHost : (dns == &dnsC) ? stunRelayUdpHost : stunRelayTcpHost;
+            cache->insert(host, addr, results.first().ttl());
+        }
 
         if(dns == &dnsA)
         {
@@ -371,13 +410,20 @@ public:
     XMPP::Ice176 *iceA;
     XMPP::Ice176 *iceV;
     QTimer *rtpActivityTimer;
-    QList<JingleRtp::RtpPacket> in;
+    JingleRtp::RtpPackets in;
+
+    // guards the counters, they are read from JingleRtp's thread
+    mutable QMutex statsMutex;
+    JingleRtp::Statistics audioStats, videoStats;
+    QElapsedTimer clock;
+    qint64 lastArrival[2], lastSpacing[2];
 
     JingleRtpChannelPrivate(JingleRtpChannel *_q);
     ~JingleRtpChannelPrivate();
 
     void setIceObjects(XMPP::UdpPortReserver *_portReserver, XMPP::Ice176 *_iceA, XMPP::Ice176 *_iceV);
     void restartRtpActivityTimer();
+    void writePacket(const JingleRtp::RtpPacket &packet);
 
 private slots:
     void start();
@@ -408,6 +454,9 @@ public:
     QString stunRelayTcpPass;
     XMPP::TurnClient::Proxy stunProxy;
     int basePort;
+    AddressCache addressCache;
+    Resolver prefetchResolver;
+    QTimer *prefetchTimer;
     QList<JingleRtp*> sessions;
     QList<JingleRtp*> pending;
     JT_PushJingleRtp *push_task;
@@ -419,6 +468,10 @@ public:
 
     void unlink(JingleRtp *sess);
 
+public slots:
+    // look up the servers ahead of the first call
+    void prefetch();
+
 private slots:
     void push_task_incomingRequest(const XMPP::Jid &from, const QString &iq_id, const JingleRtpEnvelope &envelope);
 };
@@ -469,6 +522,9 @@ public:
         QList<XMPP::Ice176::Candidate> remoteCandidates;
 
         QVector<bool> channelsReady;
+
+        QStringList localTypes;
+        QStringList remoteTypes;
     };
     IceStatus iceA_status;
     IceStatus iceV_status;
@@ -537,6 +593,7 @@ public:
         }
 
         printf("types=%d\n", types);
+        resolver.cache = &manager->addressCache;
         resolver.start(manager->extHost, manager->stunBindHost, manager->stunRelayUdpHost, manager->stunRelayTcpHost);
     }
 
@@ -546,6 +603,7 @@ public:
 
         // TODO: cancel away whatever media type is not used
 
+        resolver.cache = &manager->addressCache;
         resolver.start(manager->extHost, manager->stunBindHost, manager->stunRelayUdpHost, manager->stunRelayTcpHost);
     }
 
@@ -1121,6 +1179,7 @@ private:
             content.trans.user = iceA->localUfrag();
             content.trans.pass = iceA->localPassword();
             content.trans.candidates = iceA_status.localCandidates;
+            addCandidateTypes(&iceA_status.localTypes, iceA_status.localCandidates);
             iceA_status.localCandidates.clear();
 
             contentList += content;
@@ -1138,6 +1197,7 @@ private:
             content.trans.user = iceV->localUfrag();
             content.trans.pass = iceV->localPassword();
             content.trans.candidates = iceV_status.localCandidates;
+            addCandidateTypes(&iceV_status.localTypes, iceV_status.localCandidates);
             iceV_status.localCandidates.clear();
 
             contentList += content;
@@ -1156,6 +1216,15 @@ private:
         }
     }
 
+    static void addCandidateTypes(QStringList *types, const QList<XMPP::Ice176::Candidate> &list)
+    {
+        foreach(const XMPP::Ice176::Candidate &c, list)
+        {
+            if(!types->contains(c.type))
+                *types += c.type;
+        }
+    }
+
     void flushRemoteCandidates()
     {
         // FIXME: currently, new candidates are ignored after the
@@ -1171,6 +1240,7 @@ private:
             if(!iceA_status.remoteCandidates.isEmpty())
             {
                 iceA->addRemoteCandidates(iceA_status.remoteCandidates);
+                addCandidateTypes(&iceA_status.remoteTypes, iceA_status.remoteCandidates);
                 iceA_status.remoteCandidates.clear();
             }
         }
@@ -1182,6 +1252,7 @@ private:
             if(!iceV_status.remoteCandidates.isEmpty())
             {
                 iceV->addRemoteCandidates(iceV_status.remoteCandidates);
+                addCandidateTypes(&iceV_status.remoteTypes, iceV_status.remoteCandidates);
                 iceV_status.remoteCandidates.clear();
             }
         }
@@ -1501,6 +1572,21 @@ JingleRtp::Error JingleRtp::errorCode() const
     return d->errorCode;
 }
 
+JingleRtp::Statistics JingleRtp::statistics(Type type) const
+{
+    Statistics stats;
+    {
+        JingleRtpChannelPrivate *c = d->rtpChannel->d;
+        QMutexLocker locker(&c->statsMutex);
+        stats = (type == Audio) ? c->audioStats : c->videoStats;
+    }
+
+    const JingleRtpPrivate::IceStatus &status = (type == Audio) ? d->iceA_status : d->iceV_status;
+    stats.localCandidateTypes = status.localTypes;
+    stats.remoteCandidateTypes = status.remoteTypes;
+    return stats;
+}
+
 JingleRtpChannel *JingleRtp::rtpChannel()
 {
     return d->rtpChannel;
@@ -1516,6 +1602,13 @@ JingleRtpChannelPrivate::JingleRtpChannelPrivate(JingleRtpChannel *_q) :
     iceA(nullptr),
     iceV(nullptr)
 {
+    clock.start();
+    for(int n = 0; n < 2; ++n)
+    {
+        lastArrival[n] = -1;
+        lastSpacing[n] = -1;
+    }
+
     rtpActivityTimer = new QTimer(this);
     connect(rtpActivityTimer, SIGNAL(timeout()), SLOT(rtpActivity_timeout()));
 }
@@ -1606,6 +1699,21 @@ void JingleRtpChannelPrivate::setIceObjects(XMPP::UdpPortReserver *_portReserver
     }
 }
 
+// call with m locked
+void JingleRtpChannelPrivate::writePacket(const JingleRtp::RtpPacket &packet)
+{
+    XMPP::Ice176 *ice = (packet.type == JingleRtp::Audio) ? iceA : iceV;
+    if(!ice)
+        return;
+
+    ice->writeDatagram(packet.portOffset, packet.value);
+
+    QMutexLocker locker(&statsMutex);
+    JingleRtp::Statistics &stats = (packet.type == JingleRtp::Audio) ? audioStats : videoStats;
+    ++stats.packetsSent;
+    stats.bytesSent += packet.value.size();
+}
+
 void JingleRtpChannelPrivate::restartRtpActivityTimer()
 {
     // if we go 5 seconds without an RTP packet, then that's
@@ -1631,30 +1739,53 @@ void JingleRtpChannelPrivate::ice_readyRead(int componentIndex)
     if(ice == iceA && componentIndex == 0)
         restartRtpActivityTimer();
 
-    if(ice == iceA)
+    bool wasEmpty = in.isEmpty();
+    JingleRtp::Type type = (ice == iceA) ? JingleRtp::Audio : JingleRtp::Video;
+    int packets = 0, dropped = 0;
+    qint64 bytes = 0;
+    while(ice->hasPendingDatagrams(componentIndex))
     {
-        while(iceA->hasPendingDatagrams(componentIndex))
+        // if the reader stalls, drop rather than letting the delay grow
+        if(in.size() >= maxQueuedPackets)
         {
-            JingleRtp::RtpPacket packet;
-            packet.type = JingleRtp::Audio;
-            packet.portOffset = componentIndex;
-            packet.value = iceA->readDatagram(componentIndex);
-            in += packet;
+            ice->readDatagram(componentIndex);
+            ++dropped;
+            continue;
         }
+
+        in.resize(in.size() + 1);
+        JingleRtp::RtpPacket &packet = in.last();
+        packet.type = type;
+        packet.portOffset = componentIndex;
+        packet.value = ice->readDatagram(componentIndex);
+        ++packets;
+        bytes += packet.value.size();
     }
-    else // iceV
+
     {
-        while(iceV->hasPendingDatagrams(componentIndex))
-        {
-            JingleRtp::RtpPacket packet;
-            packet.type = JingleRtp::Video;
-            packet.portOffset = componentIndex;
-            packet.value = iceV->readDatagram(componentIndex);
-            in += packet;
-        }
+        QMutexLocker locker(&statsMutex);
+        JingleRtp::Statistics &stats = (type == JingleRtp::Audio) ? audioStats : videoStats;
+        stats.packetsReceived += packets;
+        stats.bytesReceived += bytes;
+        stats.packetsDropped += dropped;
+
+        // RFC 3550 style estimate on the arrival spacing of RTP
+        const int n = (type == JingleRtp::Audio) ? 0 : 1;
+        const qint64 now = clock.nsecsElapsed() / 1000;
+        if(componentIndex == 0 && lastArrival[n] >= 0)
+        {
+            const qint64 spacing = now - lastArrival[n];
+            if(lastSpacing[n] >= 0)
+                stats.jitter += (int(qAbs(spacing - lastSpacing[n])) - stats.jitter) / 16;
+            lastSpacing[n] = spacing;
+        }
+        if(componentIndex == 0)
+            lastArrival[n] = now;
     }
 
-    emit q->readyRead();
+    // the reader drains the whole queue, so one notification per batch is enough
+    if(wasEmpty && !in.isEmpty())
+        emit q->readyRead();
 }
 
 void JingleRtpChannelPrivate::ice_datagramsWritten(int componentIndex, int count)
@@ -1689,14 +1820,34 @@ JingleRtp::RtpPacket JingleRtpChannel::read()
     return d->in.takeFirst();
 }
 
+int JingleRtpChannel::readAll(JingleRtp::RtpPackets &packets)
+{
+    int count = d->in.size();
+    if(packets.isEmpty())
+    {
+        packets.swap(d->in); // our queue gets the spare capacity
+    }
+    else
+    {
+        packets += d->in;
+        d->in.resize(0);
+    }
+    return count;
+}
+
+void JingleRtpChannel::write(const JingleRtp::RtpPackets &packets)
+{
+    QMutexLocker locker(&d->m);
+
+    foreach(const JingleRtp::RtpPacket &packet, packets)
+        d->writePacket(packet);
+}
+
 void JingleRtpChannel::write(const JingleRtp::RtpPacket &packet)
 {
     QMutexLocker locker(&d->m);
 
-    if(packet.type == JingleRtp::Audio && d->iceA)
-        d->iceA->writeDatagram(packet.portOffset, packet.value);
-    else if(packet.type == JingleRtp::Video && d->iceV)
-        d->iceV->writeDatagram(packet.portOffset, packet.value);
+    d->writePacket(packet);
 }
 
 //----------------------------------------------------------------------------
@@ -1709,8 +1860,16 @@ JingleRtpManagerPrivate::JingleRtpManagerPrivate(XMPP::Client *_client, JingleRt
     stunBindPort(-1),
     stunRelayUdpPort(-1),
     stunRelayTcpPort(-1),
-    basePort(-1)
+    basePort(-1),
+    prefetchResolver(this)
 {
+    prefetchResolver.cache = &addressCache;
+
+    // settings usually change several at a time
+    prefetchTimer = new QTimer(this);
+    prefetchTimer->setSingleShot(true);
+    connect(prefetchTimer, SIGNAL(timeout()), SLOT(prefetch()));
+
     push_task = new JT_PushJingleRtp(client->rootTask());
     connect(push_task, SIGNAL(incomingRequest(const XMPP::Jid &, const QString &, const JingleRtpEnvelope &)), SLOT(push_task_incomingRequest(const XMPP::Jid &, const QString &, const JingleRtpEnvelope &)));
 }
@@ -1720,6 +1879,11 @@ JingleRtpManagerPrivate::~JingleRtpManagerPrivate()
     delete push_task;
 }
 
+void JingleRtpManagerPrivate::prefetch()
+{
+    prefetchResolver.start(extHost, stunBindHost, stunRelayUdpHost, stunRelayTcpHost);
+}
+
 QString JingleRtpManagerPrivate::createSid(const XMPP::Jid &peer) const
 {
     while(1)
@@ -1844,17 +2008,22 @@ JingleRtp *JingleRtpManager::takeIncoming()
 void JingleRtpManager::setSelfAddress(const QHostAddress &addr)
 {
     d->selfAddr = addr;
+
+    // set once we are connected, so the network is likely up
+    d->prefetchTimer->start(0);
 }
 
 void JingleRtpManager::setExternalAddress(const QString &host)
 {
     d->extHost = host;
+    d->prefetchTimer->start(0);
 }
 
 void JingleRtpManager::setStunBindService(const QString &host, int port)
 {
     d->stunBindHost = host;
     d->stunBindPort = port;
+    d->prefetchTimer->start(0);
 }
 
 void JingleRtpManager::setStunRelayUdpService(const QString &host, int port, const QString &user, const QString &pass)
@@ -1863,6 +2032,7 @@ void JingleRtpManager::setStunRelayUdpService(const QString &host, int port, con
     d->stunRelayUdpPort = port;
     d->stunRelayUdpUser = user;
     d->stunRelayUdpPass = pass;
+    d->prefetchTimer->start(0);
 }
 
 void JingleRtpManager::setStunRelayTcpService(const QString &host, int port, const XMPP::AdvancedConnector::Proxy &proxy, const QString &user, const QString &pass)
@@ -1886,6 +2056,7 @@ void JingleRtpManager::setStunRelayTcpService(const QString &host, int port, con
     }
 
     d->stunProxy = tproxy;
+    d->prefetchTimer->start(0);
 }
 
 void JingleRtpManager::setBasePort(int port)
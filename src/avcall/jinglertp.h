@@ -22,6 +22,9 @@
 #include "jinglertptasks.h"
 #include "xmpp.h"
 
+#include <QStringList>
+#include <QVector>
+
 class JingleRtpChannel;
 class JingleRtpChannelPrivate;
 class JingleRtpManagerPrivate;
@@ -52,6 +55,27 @@ public:
         int portOffset;
         QByteArray value;
     };
+    typedef QVector<RtpPacket> RtpPackets;
+
+    // per media type. the Ice176 engine doesn't tell which candidate pair
+    //   it nominated, so only the candidate types offered are known
+    class Statistics
+    {
+    public:
+        qint64 packetsReceived = 0;
+        qint64 bytesReceived = 0;
+        qint64 packetsSent = 0;
+        qint64 bytesSent = 0;
+        qint64 packetsDropped = 0; // the incoming queue is bounded
+        int jitter = 0; // usecs, of packet arrivals
+        QStringList localCandidateTypes;
+        QStringList remoteCandidateTypes;
+
+        bool relayed() const
+        {
+            return localCandidateTypes == QStringList() << "relay" || remoteCandidateTypes == QStringList() << "relay";
+        }
+    };
 
     ~JingleRtp();
 
@@ -77,6 +101,9 @@ public:
 
     Error errorCode() const;
 
+    // may be called while the channel is in another thread
+    Statistics statistics(Type type) const;
+
     // this object is valid at construction time and initially lives in
     //   JingleRtp's thread.  it can be moved to another thread as long
     //   it is moved back to JingleRtp's thread before destructing
@@ -113,7 +140,14 @@ public:
     JingleRtp::RtpPacket read();
     void write(const JingleRtp::RtpPacket &packet);
 
+    // bulk versions of read() and write(). readAll() appends all the
+    //   queued packets and returns their count. reuse the vector between
+    //   calls to avoid reallocations
+    int readAll(JingleRtp::RtpPackets &packets);
+    void write(const JingleRtp::RtpPackets &packets);
+
 signals:
+    // emitted when packets arrive to the empty queue
     void readyRead();
 
     // note: this says nothing about the order packets were written
@@ -122,6 +156,7 @@ signals:
 private:
     Q_DISABLE_COPY(JingleRtpChannel);
 
+    friend class JingleRtp;
     friend class JingleRtpChannelPrivate;
     friend class JingleRtpPrivate;
     JingleRtpChannel();
@@ -161,4 +196,6 @@ private:
     JingleRtpManagerPrivate *d;
 };
 
+Q_DECLARE_TYPEINFO(JingleRtp::RtpPacket, Q_MOVABLE_TYPE);
+
 #endif // JINGLERTP_H
@@ -17,13 +17,27 @@
 #include "mediadevicewatcher.h"
 
 #include "../psimedia/psimedia.h"
+#include "avcall.h"
 #include "psioptions.h"
 
 #include <QApplication>
 
+static bool sameDevices(const QList<PsiMedia::Device> &a, const QList<PsiMedia::Device> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (int n = 0; n < a.size(); ++n) {
+        if (a[n].id() != b[n].id() || a[n].name() != b[n].name() || a[n].isDefault() != b[n].isDefault())
+            return false;
+    }
+    return true;
+}
+
 MediaDeviceWatcher::MediaDeviceWatcher(QObject *parent) : QObject(parent)
 {
     connect(&_features, SIGNAL(updated()), SLOT(featuresUpdated()));
+    // the provider may have its lists already
+    takeFeatures();
     updateDefaults();
 }
 
@@ -54,19 +68,48 @@ void MediaDeviceWatcher::updateDefaults()
     //QString videoParams = s.value("videoParams").toString();
 
     _configuration.audioOutDeviceId = (hasAudioIn && userPrefAudioIn.isEmpty())?
-                QString() : defaultDeviceId(_features.audioOutputDevices(), userPrefAudioOut);
+                QString() : defaultDeviceId(_audioOutputDevices, userPrefAudioOut);
     _configuration.audioInDeviceId = (hasAudioOut && userPrefAudioOut.isEmpty())?
-                QString() : defaultDeviceId(_features.audioInputDevices(), userPrefAudioIn);
+                QString() : defaultDeviceId(_audioInputDevices, userPrefAudioIn);
     _configuration.videoInDeviceId = (hasVideoIn && userPrefVideoIn.isEmpty())?
-                QString() : defaultDeviceId(_features.videoInputDevices(), userPrefVideoIn);
+                QString() : defaultDeviceId(_videoInputDevices, userPrefVideoIn);
+
+    // a call starting now gets them without looking at the devices again,
+    // until the devices are known the options are as good as it gets
+    if (!_ready)
+        return;
+    AvCallManager::setAudioOutDevice(_configuration.audioOutDeviceId);
+    AvCallManager::setAudioInDevice(_configuration.audioInDeviceId);
+    AvCallManager::setVideoInDevice(_configuration.videoInDeviceId);
 }
 
 void MediaDeviceWatcher::featuresUpdated()
 {
+    if (!takeFeatures())
+        return;
     updateDefaults();
     emit updated();
 }
 
+bool MediaDeviceWatcher::takeFeatures()
+{
+    QList<PsiMedia::Device> audioIn = _features.audioInputDevices();
+    QList<PsiMedia::Device> audioOut = _features.audioOutputDevices();
+    QList<PsiMedia::Device> videoIn = _features.videoInputDevices();
+    if (audioIn.isEmpty() && audioOut.isEmpty() && videoIn.isEmpty() && !_ready)
+        return false; // nothing listed yet
+
+    const bool changed = !_ready || !sameDevices(audioIn, _audioInputDevices)
+            || !sameDevices(audioOut, _audioOutputDevices) || !sameDevices(videoIn, _videoInputDevices);
+    _ready = true;
+    _audioInputDevices = audioIn;
+    _audioOutputDevices = audioOut;
+    _videoInputDevices = videoIn;
+    _audioModes = _features.supportedAudioModes();
+    _videoModes = _features.supportedVideoModes();
+    return changed;
+}
+
 QString MediaDeviceWatcher::defaultDeviceId(const QList<PsiMedia::Device> &devs, const QString &userPref)
 {
     QString def;
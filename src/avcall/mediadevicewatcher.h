@@ -35,6 +35,12 @@ public:
     QString extHost;
 };
 
+/**
+ * Keeps the devices reported by the media provider, which lists them off
+ * the GUI thread and tells about hotplugged ones. Everything here reads the
+ * kept lists, so neither the options nor a call wait for devices to be
+ * listed, and updated() is only emitted when a list really changed.
+ */
 class MediaDeviceWatcher : public QObject
 {
     Q_OBJECT
@@ -47,23 +53,31 @@ public:
     void updateDefaults();
     inline const MediaConfiguration &configuration() const { return _configuration; }
 
-    inline QList<PsiMedia::Device> audioInputDevices() { return _features.audioInputDevices(); }
-    inline QList<PsiMedia::Device> audioOutputDevices() { return _features.audioOutputDevices(); }
-    inline QList<PsiMedia::Device> videoInputDevices() { return _features.videoInputDevices(); }
-    inline QList<PsiMedia::AudioParams> supportedAudioModes() { return _features.supportedAudioModes(); }
-    inline QList<PsiMedia::VideoParams> supportedVideoModes() { return _features.supportedVideoModes(); }
+    // false until the provider listed the devices for the first time
+    inline bool isReady() const { return _ready; }
+    inline QList<PsiMedia::Device> audioInputDevices() const { return _audioInputDevices; }
+    inline QList<PsiMedia::Device> audioOutputDevices() const { return _audioOutputDevices; }
+    inline QList<PsiMedia::Device> videoInputDevices() const { return _videoInputDevices; }
+    inline QList<PsiMedia::AudioParams> supportedAudioModes() const { return _audioModes; }
+    inline QList<PsiMedia::VideoParams> supportedVideoModes() const { return _videoModes; }
 
 signals:
     void updated();
 
-public slots:
-
 private slots:
     void featuresUpdated();
 
 private:
+    bool takeFeatures();
+
     MediaConfiguration _configuration;
     PsiMedia::Features _features;
+    bool _ready = false;
+    QList<PsiMedia::Device> _audioInputDevices;
+    QList<PsiMedia::Device> _audioOutputDevices;
+    QList<PsiMedia::Device> _videoInputDevices;
+    QList<PsiMedia::AudioParams> _audioModes;
+    QList<PsiMedia::VideoParams> _videoModes;
     static MediaDeviceWatcher *_instance;
 
 };
@@ -26,11 +26,22 @@
 
 using namespace XMPP;
 
+// Busy conferences send lots of one-off images. Small items (smileys,
+// captchas) are always kept in memory, larger ones only once they were
+// requested again, so a burst of new stickers can't push out the hot set.
+static const int     bobSmallItemSize = 16 * 1024;
+static const int     bobMaxItemSize   = 1024 * 1024; // larger data is not cached at all
+static const int     bobSourceQuota   = 8 * 1024 * 1024;
+static const int     bobSketchWidth   = 4096;
+static const int     bobSketchDepth   = 4;
+static const quint8  bobSketchMax     = 15;
+
 BoBFileCache::BoBFileCache() :
-    BoBCache(nullptr)
+    BoBCache(nullptr), _sketch(bobSketchWidth * bobSketchDepth, 0)
 {
     setParent(QApplication::instance());
     _fileCache = new FileCache(ApplicationInfo::bobDir(), this);
+    _fileCache->setMemoryCacheSize(2 * 1024 * 1024);
 }
 
 BoBFileCache *BoBFileCache::instance()
@@ -41,20 +52,83 @@ BoBFileCache *BoBFileCache::instance()
     return _instance;
 }
 
+/**
+ * Count-min sketch of recent accesses (TinyLFU style). Counters are halved
+ * periodically, so old popularity fades away.
+ */
+void BoBFileCache::recordAccess(const Hash &h)
+{
+    const QByteArray &key = h.data();
+    for (int i = 0; i < bobSketchDepth; i++) {
+        quint8 &c = _sketch[i * bobSketchWidth + int(qHash(key, uint(i) * 0x9e3779b9u) % bobSketchWidth)];
+        if (c < bobSketchMax)
+            c++;
+    }
+    if (++_sketchAdditions >= bobSketchWidth * 8) {
+        _sketchAdditions = 0;
+        for (quint8 &c : _sketch)
+            c >>= 1;
+    }
+}
+
+int BoBFileCache::accessFrequency(const Hash &h) const
+{
+    const QByteArray &key = h.data();
+    int               ret = bobSketchMax;
+    for (int i = 0; i < bobSketchDepth; i++) {
+        ret = qMin(ret, int(_sketch[i * bobSketchWidth + int(qHash(key, uint(i) * 0x9e3779b9u) % bobSketchWidth)]));
+    }
+    return ret;
+}
+
+void BoBFileCache::admit(FileCacheItem *item)
+{
+    if (item->size() > bobSmallItemSize && accessFrequency(item->id()) < 2) {
+        _fileCache->releaseMemory(item); // disk only until it's requested again
+    }
+}
+
 void BoBFileCache::put(const BoBData &data)
 {
+    if (data.data().size() > bobMaxItemSize) {
+        return;
+    }
+    recordAccess(data.hash());
     QVariantMap md;
     md.insert(QLatin1String("type"), data.type());
-    _fileCache->append(data.hash(), data.data(), md, data.maxAge());
+    admit(_fileCache->append(data.hash(), data.data(), md, data.maxAge()));
+}
+
+void BoBFileCache::setSource(const Hash &h, const QString &source)
+{
+    FileCacheItem *item = _fileCache->get(h);
+    if (!item || _itemSource.contains(item->id())) {
+        return;
+    }
+    _itemSource.insert(item->id(), source);
+
+    SourceUsage &u = _sources[source];
+    u.items.append(qMakePair(item->id(), item->size()));
+    u.bytes += item->size();
+
+    // drop the oldest items of the source which is over its quota
+    while (u.bytes > bobSourceQuota && u.items.size() > 1) {
+        auto oldest = u.items.takeFirst();
+        u.bytes -= oldest.second;
+        _itemSource.remove(oldest.first);
+        _fileCache->remove(oldest.first);
+    }
 }
 
 BoBData BoBFileCache::get(const Hash &h)
 {
     FileCacheItem *item = _fileCache->get(h);
     BoBData        bd;
+    recordAccess(h);
     if (item) {
         bd.setHash(h);
         bd.setData(item->data());
+        admit(item);
         bd.setMaxAge(item->maxAge());
         QVariantMap md = item->metadata();
         bd.setType(md[QLatin1String("type")].toString());
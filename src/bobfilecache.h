@@ -22,7 +22,13 @@
 
 #include "iris/xmpp_bitsofbinary.h"
 
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QVector>
+
 class FileCache;
+class FileCacheItem;
 
 using namespace XMPP;
 
@@ -34,11 +40,27 @@ public:
     virtual void    put(const BoBData &) override;
     virtual BoBData get(const Hash &) override;
 
+    // accounts the item to the given source (e.g. a conference) for quota purposes
+    void setSource(const Hash &, const QString &source);
+
 private:
     BoBFileCache();
 
-    FileCache *          _fileCache;
-    static BoBFileCache *_instance;
+    void recordAccess(const Hash &);
+    int  accessFrequency(const Hash &) const;
+    void admit(FileCacheItem *item);
+
+    struct SourceUsage {
+        qint64                      bytes = 0;
+        QList<QPair<Hash, qint64>> items; // oldest first
+    };
+
+    FileCache *                 _fileCache;
+    QVector<quint8>             _sketch;
+    int                         _sketchAdditions = 0;
+    QHash<QString, SourceUsage> _sources;
+    QHash<Hash, QString>        _itemSource;
+    static BoBFileCache *       _instance;
 };
 
 #endif // BOBFILECACHE_H
@@ -21,6 +21,7 @@
 
 #include "accountlabel.h"
 #include "avatars.h"
+#include "chatstatemanager.h"
 #include "chatview.h"
 #include "eventdb.h"
 #include "fancylabel.h"
@@ -93,6 +94,13 @@ ChatDlg *ChatDlg::create(const Jid &jid, PsiAccount *account, TabManager *tabMan
     return chat;
 }
 
+ChatDlg *ChatDlg::createUnbound(PsiAccount *account, TabManager *tabManager)
+{
+    ChatDlg *chat = new PsiChatDlg(Jid(), account, tabManager);
+    chat->build();
+    return chat;
+}
+
 ChatDlg::ChatDlg(const Jid &jid, PsiAccount *pa, TabManager *tabManager) :
     TabbableWidget(jid, pa, tabManager), highlightersInstalled_(false), delayedMessages(nullptr)
 {
@@ -106,33 +114,30 @@ ChatDlg::ChatDlg(const Jid &jid, PsiAccount *pa, TabManager *tabManager) :
 
     status_ = -1;
 
-    if (!pa->findGCContact(jid) || ((pa->edb()->features() & EDB::PrivateContacts) != 0)) {
-        historyState = false;
-        preloadHistory();
-    } else
-        historyState = true;
-
+    historyState       = false;
     autoSelectContact_ = false;
-    if (PsiOptions::instance()->getOption("options.ui.chat.default-jid-mode").toString() == "auto") {
-        UserListItem *uli = account()->findFirstRelevant(jid);
-        if (!uli || (!uli->isPrivate() && (jid.resource().isEmpty() || uli->userResourceList().count() <= 1))) {
-            autoSelectContact_ = true;
-        }
-    }
 
     // Message events
-    contactChatState_ = XMPP::StateNone;
-    if ((PsiOptions::instance()->getOption("options.messages.send-composing-events-at-start").toBool()) && (account()->client()->capsManager()->features(jid).hasChatState())) {
-        contactChatState_ = XMPP::StateActive;
-    }
+    contactChatState_    = XMPP::StateNone;
     lastChatState_       = XMPP::StateNone;
     sendComposingEvents_ = false;
     isComposing_         = false;
-    composingTimer_      = nullptr;
-    updateRealJid();
 }
 
 void ChatDlg::init()
+{
+    build();
+    bind();
+}
+
+void ChatDlg::bindTo(const Jid &jid)
+{
+    TabbableWidget::setJid(jid);
+    bind();
+}
+
+// the widgets of the dialog, none of them depends on the contact
+void ChatDlg::build()
 {
     initUi();
     initActions();
@@ -140,14 +145,6 @@ void ChatDlg::init()
 
     chatEdit()->installEventFilter(this);
     chatView()->setDialog(this);
-    bool isPrivate = account()->groupchats().contains(jid().bare());
-    chatView()->setSessionData(false, isPrivate, jid(), jid().full()); //FIXME fix nick updating
-#ifdef WEBKIT
-    chatView()->setAccount(account());
-#else
-    chatView()->setMediaOpener(account()->fileSharingDeviceOpener());
-#endif
-    chatView()->init();
 
     // seems its useless hack
     //connect(chatView(), SIGNAL(selectionChanged()), SLOT(logSelectionChanged())); //
@@ -158,18 +155,54 @@ void ChatDlg::init()
     connect(this, SIGNAL(composing(bool)), SLOT(updateIsComposing(bool)));
 
     setAcceptDrops(true);
-    updateContact(jid(), true);
 
     X11WM_CLASS("chat");
     setLooks();
 
-    updatePGP();
-
     connect(account(), SIGNAL(pgpKeyChanged()), SLOT(updatePGP()));
     connect(account(), SIGNAL(encryptedMessageSent(int, bool, int, const QString &)), SLOT(encryptedMessageSent(int, bool, int, const QString &)));
-    account()->dialogRegister(this, jid());
 
     chatView()->setFocusPolicy(Qt::NoFocus);
+}
+
+// everything about the contact, done once the dialog has its jid
+void ChatDlg::bind()
+{
+    const Jid &jid = this->jid();
+    if (!account()->findGCContact(jid) || ((account()->edb()->features() & EDB::PrivateContacts) != 0)) {
+        historyState = false;
+        preloadHistory();
+    } else
+        historyState = true;
+
+    if (PsiOptions::instance()->getOption("options.ui.chat.default-jid-mode").toString() == "auto") {
+        UserListItem *uli = account()->findFirstRelevant(jid);
+        if (!uli || (!uli->isPrivate() && (jid.resource().isEmpty() || uli->userResourceList().count() <= 1))) {
+            autoSelectContact_ = true;
+        }
+    }
+
+    if ((PsiOptions::instance()->getOption("options.messages.send-composing-events-at-start").toBool()) && (account()->client()->capsManager()->features(jid).hasChatState())) {
+        contactChatState_ = XMPP::StateActive;
+    }
+    updateRealJid();
+
+    bindUi();
+
+    bool isPrivate = account()->groupchats().contains(jid.bare());
+    chatView()->setSessionData(false, isPrivate, jid, jid.full()); //FIXME fix nick updating
+#ifdef WEBKIT
+    chatView()->setAccount(account());
+#else
+    chatView()->setMediaOpener(account()->fileSharingDeviceOpener());
+#endif
+    chatView()->init();
+    connect(chatView(), SIGNAL(olderMessagesRequested(QDateTime)), SLOT(loadOlderHistory(QDateTime)));
+
+    updateContact(jid, true);
+    updatePGP();
+    account()->dialogRegister(this, jid);
+
     chatEdit()->setFocus();
 }
 
@@ -305,7 +338,7 @@ void ChatDlg::hideEvent(QHideEvent *e)
 
 void ChatDlg::showEvent(QShowEvent *)
 {
-    //
+    wake();
 }
 
 void ChatDlg::logSelectionChanged()
@@ -424,21 +457,94 @@ UserStatus ChatDlg::userStatusFor(const Jid &jid, QList<UserListItem *> ul, bool
 
 void ChatDlg::preloadHistory()
 {
-    int cnt = PsiOptions::instance()->getOption("options.ui.chat.history.preload-history-size").toInt();
+    loadHistory(PsiOptions::instance()->getOption("options.ui.chat.history.preload-history-size").toInt());
+}
+
+void ChatDlg::loadHistory(int cnt)
+{
     if (cnt > 0) {
         holdMessages(true);
         if (cnt > 100) // This is limit, just in case.
             cnt = 100;
         EDBHandle *h = new EDBHandle(account()->edb());
         connect(h, SIGNAL(finished()), this, SLOT(getHistory()));
-        Jid j = jid();
-        if (!account()->findGCContact(j))
-            j = jid().bare();
         int start = account()->eventQueue()->count(jid(), false);
-        h->get(account()->id(), j, QDateTime(), EDB::Backward, start, cnt);
+        h->get(account()->id(), historyJid(), QDateTime(), EDB::Backward, start, cnt);
     }
 }
 
+/**
+ * Drops the rendered log of a tab nobody looked at for a while. Messages
+ * arriving meanwhile are still shown, wake() rebuilds the log from history.
+ */
+void ChatDlg::hibernate()
+{
+    // without history in EDB the log couldn't be restored
+    if (hibernated_ || (account()->findGCContact(jid()) && !(account()->edb()->features() & EDB::PrivateContacts)))
+        return;
+
+    hibernated_ = true;
+    chatView()->clear();
+}
+
+void ChatDlg::wake()
+{
+    if (!hibernated_)
+        return;
+
+    hibernated_ = false;
+    chatView()->clear();
+    loadHistory(qMax(50, PsiOptions::instance()->getOption("options.ui.chat.history.preload-history-size").toInt()));
+}
+
+Jid ChatDlg::historyJid() const
+{
+    Jid j = jid();
+    if (!account()->findGCContact(j))
+        j = jid().bare();
+    return j;
+}
+
+/**
+ * The chat view dropped its oldest messages and the user scrolled up to them.
+ * Loads the page of history right before \a before.
+ */
+void ChatDlg::loadOlderHistory(const QDateTime &before)
+{
+    EDBHandle *h = new EDBHandle(account()->edb());
+    connect(h, SIGNAL(finished()), this, SLOT(getOlderHistory()));
+    h->get(account()->id(), historyJid(), before, EDB::Backward, 0, 50);
+}
+
+void ChatDlg::getOlderHistory()
+{
+    EDBHandle *h = qobject_cast<EDBHandle *>(sender());
+    if (!h)
+        return;
+
+    // render through the usual path but collect the views instead of showing them
+    QList<MessageView> page;
+    const bool         state    = historyState;
+    const bool         trackBar = trackBar_;
+    olderMessages_              = &page;
+    historyState                = true;
+    trackBar_                   = false;
+    const EDBResult &r          = h->result();
+    for (int i = r.count() - 1; i >= 0; --i) {
+        PsiEvent::Ptr e = r.at(i)->event();
+        if (e->type() == PsiEvent::Message) {
+            MessageEvent::Ptr me = e.staticCast<MessageEvent>();
+            appendMessage(me->message(), me->originLocal());
+        }
+    }
+    olderMessages_ = nullptr;
+    historyState   = state;
+    trackBar_      = trackBar;
+    delete h;
+
+    chatView()->prependMessages(page);
+}
+
 void ChatDlg::getHistory()
 {
     EDBHandle *h = qobject_cast<EDBHandle *>(sender());
@@ -576,7 +682,8 @@ void ChatDlg::setLooks()
 
     // update contact info
     status_ = -2; // sick way of making it redraw the status
-    updateContact(jid(), false);
+    if (!jid().isEmpty())
+        updateContact(jid(), false);
 
     // update the widget icon
 #ifndef Q_OS_MAC
@@ -761,6 +868,10 @@ void ChatDlg::doSend()
 
     // Update current state
     setChatState(XMPP::StateActive);
+    if (m.chatState() == XMPP::StateActive) {
+        // the message tells it, no notification of its own
+        account()->chatStateManager()->stateSent(jid(), XMPP::StateActive);
+    }
 
     if (isEncryptionEnabled()) {
         chatEdit()->setEnabled(false);
@@ -966,7 +1077,9 @@ void ChatDlg::holdMessages(bool hold)
 
 void ChatDlg::dispatchMessage(const MessageView &mv)
 {
-    if (delayedMessages)
+    if (olderMessages_)
+        olderMessages_->append(mv);
+    else if (delayedMessages)
         delayedMessages->append(mv);
     else
         displayMessage(mv);
@@ -1061,24 +1174,13 @@ void ChatDlg::setChatState(ChatState state)
                 }
             }
             if (contactChatState_ != XMPP::StateNone) {
-                if ((state == XMPP::StateInactive && lastChatState_ == XMPP::StateComposing) || (state == XMPP::StateComposing && lastChatState_ == XMPP::StateInactive)) {
-                    // First go to the paused state
-                    Message tm(jid());
-                    m.setType("chat");
-                    m.setChatState(XMPP::StatePaused);
-                    if (account()->isAvailable()) {
-                        account()->dj_sendMessage(m, false);
-                    }
-                }
                 m.setChatState(state);
             }
 
-            // Send event message
+            // Send event message, the manager passes composing to inactive through paused
             if (m.containsEvents() || m.chatState() != XMPP::StateNone) {
                 m.setType("chat");
-                if (account()->isAvailable()) {
-                    account()->dj_sendMessage(m, false);
-                }
+                account()->chatStateManager()->send(m);
             }
         }
 
@@ -1125,37 +1227,27 @@ void ChatDlg::addEmoticon(QString text)
  */
 void ChatDlg::setComposing()
 {
-    if (!composingTimer_) {
+    if (!isComposing_) {
         /* User (re)starts composing */
-        composingTimer_ = new QTimer(this);
-        connect(composingTimer_, SIGNAL(timeout()), SLOT(checkComposing()));
-        composingTimer_->start(2000); // FIXME: magic number
+        isComposing_ = true;
         emit composing(true);
     }
-    isComposing_ = true;
+    account()->chatStateManager()->touchComposing(this, [this]() { checkComposing(); });
 }
 
 /**
- * Checks if the user is still composing
+ * Called once the user stopped composing
  */
 void ChatDlg::checkComposing()
 {
-    if (!isComposing_) {
-        // User stopped composing
-        composingTimer_->deleteLater();
-        composingTimer_ = nullptr;
-        emit composing(false);
-    }
-    isComposing_ = false; // Reset composing
+    isComposing_ = false;
+    emit composing(false);
 }
 
 void ChatDlg::resetComposing()
 {
-    if (composingTimer_) {
-        delete composingTimer_;
-        composingTimer_ = nullptr;
-        isComposing_    = false;
-    }
+    account()->chatStateManager()->cancelComposing(this);
+    isComposing_ = false;
 }
 
 PsiAccount *ChatDlg::account() const
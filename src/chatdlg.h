@@ -64,9 +64,14 @@ class ChatDlg : public TabbableWidget
 protected:
     ChatDlg(const Jid& jid, PsiAccount* account, TabManager* tabManager);
     virtual void init();
+    void build();
+    void bind();
 
 public:
     static ChatDlg* create(const Jid& jid, PsiAccount* account, TabManager* tabManager);
+    // a dialog with its widgets built, waiting for bindTo() to get a contact
+    static ChatDlg* createUnbound(PsiAccount* account, TabManager* tabManager);
+    void bindTo(const Jid &jid);
     ~ChatDlg();
 
     // reimplemented
@@ -87,6 +92,7 @@ public:
     bool autoSelectContact() const {return autoSelectContact_;}
     static UserStatus userStatusFor(const Jid& jid, QList<UserListItem*> ul, bool forceEmptyResource);
     void preloadHistory();
+    void loadHistory(int count);
     void dispatchMessage(const MessageView &mv);
     virtual void appendSysMsg(const QString& txt) = 0;
     void appendMessage(const Message &, bool local = false);
@@ -121,6 +127,8 @@ public slots:
     // reimplemented
     virtual void deactivated() override;
     virtual void activated() override;
+    void hibernate() override;
+    void wake() override;
 
     virtual void optionsUpdate();
     void updateContact(const Jid &, bool);
@@ -150,6 +158,8 @@ private slots:
     void initComposing();
     void setComposing();
     void getHistory();
+    void loadOlderHistory(const QDateTime &before);
+    void getOlderHistory();
 
 protected slots:
     void checkComposing();
@@ -163,11 +173,13 @@ protected:
     void doneSend();
     void holdMessages(bool hold);
     void displayMessage(const MessageView &mv);
+    Jid historyJid() const;
     virtual void setLooks();
     virtual void chatEditCreated();
     void initHighlighters();
 
     virtual void initUi() = 0;
+    virtual void bindUi() = 0;
     virtual void capsChanged();
     virtual void updateJidWidget(const QList<UserListItem*> &ul, int status, bool fromPresence);
     virtual void contactUpdated(UserListItem* u, int status, const QString& statusString);
@@ -209,14 +221,15 @@ private:
     Jid realJid_;
 
     // Message Events & Chat States
-    QTimer* composingTimer_;
     bool isComposing_;
     bool sendComposingEvents_;
     bool historyState;
+    bool hibernated_ = false;
     QString eventId_;
     ChatState contactChatState_;
     ChatState lastChatState_;
     QList<MessageView> *delayedMessages;
+    QList<MessageView> *olderMessages_ = nullptr; // collects a history page shown above the log
 
     QList<Reference> fileShareReferences_;
     QString fileShareDesc_;
@@ -0,0 +1,306 @@
+/*
+ * chatspellchecker.cpp - asynchronous, cached spell checking for chat input
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "chatspellchecker.h"
+
+#include "spellchecker/spellchecker.h"
+
+#include <QCoreApplication>
+#include <QRegularExpression>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTimer>
+#include <QtConcurrentRun>
+
+static const int cacheSize = 20000; // words
+static const int batchSize = 200;   // words per worker run
+
+QMutex ChatSpellChecker::backendMutex_;
+
+static bool isNumber(const QString &word)
+{
+    for (const QChar &c : word) {
+        if (!c.isDigit()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ChatSpellChecker *ChatSpellChecker::instance()
+{
+    static ChatSpellChecker *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new ChatSpellChecker();
+    }
+    return instance_;
+}
+
+ChatSpellChecker::ChatSpellChecker() :
+    QObject(QCoreApplication::instance()),
+    cache_(cacheSize)
+{
+    pool_.setMaxThreadCount(1);
+    connect(&watcher_, SIGNAL(finished()), SLOT(lookupFinished()));
+    connect(&loadWatcher_, SIGNAL(finished()), SLOT(loadFinished()));
+    // created here so the worker never races the GUI thread to it
+    SpellChecker::instance();
+}
+
+ChatSpellChecker::State ChatSpellChecker::check(const QString &word)
+{
+    if (bool *correct = cache_.object(word)) {
+        return *correct ? Correct : Misspelled;
+    }
+    if (!queued_.contains(word)) {
+        queued_.insert(word);
+        queue_.append(word);
+        if (queue_.size() == 1) {
+            // let the highlighter finish the block first, then look up everything it asked for
+            QTimer::singleShot(0, this, SLOT(startLookup()));
+        }
+    }
+    return Unknown;
+}
+
+bool ChatSpellChecker::isCorrect(const QString &word)
+{
+    if (bool *correct = cache_.object(word)) {
+        return *correct;
+    }
+    if (loading_) {
+        return true; // asked again once the dictionaries are there
+    }
+    bool correct;
+    {
+        QMutexLocker locker(&backendMutex_);
+        correct = SpellChecker::instance()->isCorrect(word);
+    }
+    cache_.insert(word, new bool(correct));
+    return correct;
+}
+
+QList<QString> ChatSpellChecker::suggestions(const QString &word)
+{
+    if (loading_) {
+        return QList<QString>();
+    }
+    QMutexLocker locker(&backendMutex_);
+    return SpellChecker::instance()->suggestions(word);
+}
+
+bool ChatSpellChecker::writable()
+{
+    QMutexLocker locker(&backendMutex_);
+    return SpellChecker::instance()->writable();
+}
+
+bool ChatSpellChecker::add(const QString &word)
+{
+    {
+        QMutexLocker locker(&backendMutex_);
+        if (!SpellChecker::instance()->add(word)) {
+            return false;
+        }
+    }
+    cache_.insert(word, new bool(true));
+    emit wordAdded(word);
+    return true;
+}
+
+void ChatSpellChecker::setActiveLanguages(const QSet<LanguageManager::LangId> &langs, bool uiDefault)
+{
+    ++generation_; // drop whatever the worker is checking now
+    cache_.clear();
+    queue_.clear();
+    queued_.clear();
+    loading_ = true;
+    if (loadWatcher_.isRunning()) {
+        // the latest one wins
+        hasPending_ = true;
+        pendingLangs_ = langs;
+        pendingUiDefault_ = uiDefault;
+        return;
+    }
+    startLoad(langs, uiDefault, true);
+}
+
+void ChatSpellChecker::listLanguages()
+{
+    if (!loadWatcher_.isRunning()) {
+        startLoad(Languages(), false, false);
+    }
+}
+
+void ChatSpellChecker::startLoad(const Languages &langs, bool uiDefault, bool activate)
+{
+    activating_ = activate;
+    loadWatcher_.setFuture(QtConcurrent::run(&pool_, &ChatSpellChecker::load, langs, uiDefault, activate));
+}
+
+void ChatSpellChecker::loadFinished()
+{
+    available_ = loadWatcher_.result();
+    listed_ = true;
+    emit languagesListed();
+
+    if (hasPending_) {
+        hasPending_ = false;
+        startLoad(pendingLangs_, pendingUiDefault_, true);
+        return;
+    }
+    if (!activating_) {
+        return;
+    }
+    loading_ = false;
+    // what was checked meanwhile is against the old dictionaries
+    ++generation_;
+    cache_.clear();
+    queue_.clear();
+    queued_.clear();
+    emit reset();
+}
+
+ChatSpellChecker::Languages ChatSpellChecker::load(Languages langs, bool uiDefault, bool activate)
+{
+    QMutexLocker locker(&backendMutex_);
+    const Languages available = SpellChecker::instance()->getAllLanguages();
+    if (activate) {
+        if (langs.isEmpty() && uiDefault) {
+            langs = LanguageManager::bestUiMatch(available).toSet();
+        }
+        SpellChecker::instance()->setActiveLanguages(langs);
+    }
+    return available;
+}
+
+void ChatSpellChecker::startLookup()
+{
+    if (watcher_.isRunning() || queue_.isEmpty() || loading_) {
+        return;
+    }
+    QStringList batch = queue_.mid(0, batchSize);
+    queue_.erase(queue_.begin(), queue_.begin() + batch.size());
+    lookupGeneration_ = generation_;
+    watcher_.setFuture(QtConcurrent::run(&pool_, &ChatSpellChecker::lookup, batch));
+}
+
+void ChatSpellChecker::lookupFinished()
+{
+    if (lookupGeneration_ == generation_) {
+        QStringList words;
+        for (const auto &r : watcher_.result()) {
+            cache_.insert(r.first, new bool(r.second));
+            queued_.remove(r.first);
+            words.append(r.first);
+        }
+        emit checked(words);
+    }
+    startLookup();
+}
+
+ChatSpellChecker::Results ChatSpellChecker::lookup(const QStringList &words)
+{
+    Results results;
+    results.reserve(words.size());
+    QMutexLocker locker(&backendMutex_);
+    for (const QString &word : words) {
+        results.append(qMakePair(word, SpellChecker::instance()->isCorrect(word)));
+    }
+    return results;
+}
+
+//----------------------------------------------------------------------------
+// ChatSpellHighlighter
+//----------------------------------------------------------------------------
+
+ChatSpellHighlighter::ChatSpellHighlighter(QTextDocument *document) :
+    QSyntaxHighlighter(document)
+{
+    format_.setUnderlineColor(QColor(255, 0, 0));
+    format_.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+
+    ChatSpellChecker *checker = ChatSpellChecker::instance();
+    connect(checker, SIGNAL(checked(QStringList)), SLOT(wordsChecked(QStringList)));
+    connect(checker, SIGNAL(wordAdded(QString)), SLOT(wordAdded(QString)));
+    connect(checker, SIGNAL(reset()), SLOT(rehighlight()));
+}
+
+/**
+ * QSyntaxHighlighter only calls this for blocks that changed. Known words
+ * are answered from the cache; the rest is formatted once the worker is done.
+ */
+void ChatSpellHighlighter::highlightBlock(const QString &text)
+{
+    static const QRegularExpression wordRe("\\b\\w+\\b", QRegularExpression::UseUnicodePropertiesOption);
+
+    ChatSpellChecker *checker = ChatSpellChecker::instance();
+    auto it = wordRe.globalMatch(text);
+    while (it.hasNext()) {
+        auto match = it.next();
+        QString word = match.captured();
+        if (isNumber(word)) {
+            continue;
+        }
+        switch (checker->check(word)) {
+        case ChatSpellChecker::Misspelled:
+            setFormat(match.capturedStart(), match.capturedLength(), format_);
+            break;
+        case ChatSpellChecker::Unknown:
+            waiting_.insert(word);
+            break;
+        case ChatSpellChecker::Correct:
+            break;
+        }
+    }
+}
+
+void ChatSpellHighlighter::wordsChecked(const QStringList &words)
+{
+    ChatSpellChecker *checker = ChatSpellChecker::instance();
+    QStringList misspelled;
+    for (const QString &word : words) {
+        // correct words are already shown as such
+        if (waiting_.remove(word) && checker->check(word) == ChatSpellChecker::Misspelled) {
+            misspelled.append(word);
+        }
+    }
+    rehighlightWords(misspelled);
+}
+
+void ChatSpellHighlighter::wordAdded(const QString &word)
+{
+    rehighlightWords(QStringList() << word);
+}
+
+void ChatSpellHighlighter::rehighlightWords(const QStringList &words)
+{
+    if (words.isEmpty()) {
+        return;
+    }
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        const QString text = block.text();
+        for (const QString &word : words) {
+            if (text.contains(word)) {
+                rehighlightBlock(block);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * chatspellchecker.h - asynchronous, cached spell checking for chat input
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CHATSPELLCHECKER_H
+#define CHATSPELLCHECKER_H
+
+#include "languagemanager.h"
+
+#include <QCache>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+#include <QSyntaxHighlighter>
+#include <QThreadPool>
+
+/**
+ * Front end to SpellChecker. Results are kept in a LRU cache and unknown
+ * words are looked up in batches on a single worker thread. All calls into
+ * the backend go through this class so they are serialized.
+ *
+ * Dictionaries are loaded on the same worker, and words are only checked
+ * once they are ready, so neither a chat input nor the options wait for
+ * Hunspell to parse them.
+ */
+class ChatSpellChecker : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State { Unknown, Correct, Misspelled };
+
+    static ChatSpellChecker *instance();
+
+    // cached state of the word; unknown words are queued for lookup
+    State check(const QString &word);
+
+    bool isCorrect(const QString &word);
+    QList<QString> suggestions(const QString &word);
+    bool writable();
+    bool add(const QString &word);
+
+    // loads the dictionaries on the worker. With uiDefault and no langs,
+    // those best matching the UI language
+    void setActiveLanguages(const QSet<LanguageManager::LangId> &langs, bool uiDefault = false);
+
+    // the installed dictionaries, listed on the worker with every load
+    void listLanguages();
+    bool hasLanguageList() const { return listed_; }
+    QSet<LanguageManager::LangId> availableLanguages() const { return available_; }
+
+signals:
+    void checked(const QStringList &words);
+    void wordAdded(const QString &word);
+    void reset();
+    void languagesListed();
+
+private slots:
+    void startLookup();
+    void lookupFinished();
+    void loadFinished();
+
+private:
+    typedef QList<QPair<QString, bool>> Results;
+    typedef QSet<LanguageManager::LangId> Languages;
+
+    ChatSpellChecker();
+    static Results lookup(const QStringList &words);
+    static Languages load(Languages langs, bool uiDefault, bool activate);
+    void startLoad(const Languages &langs, bool uiDefault, bool activate);
+
+    QCache<QString, bool> cache_;
+    QStringList queue_;
+    QSet<QString> queued_;
+    QThreadPool pool_;
+    QFutureWatcher<Results> watcher_;
+    int generation_ = 0;
+    int lookupGeneration_ = 0;
+
+    QFutureWatcher<Languages> loadWatcher_;
+    bool loading_ = false;   // dictionaries being activated
+    bool activating_ = false; // by the load running now
+    bool hasPending_ = false; // another activation waits for it
+    Languages pendingLangs_;
+    bool pendingUiDefault_ = false;
+    bool listed_ = false;
+    Languages available_;
+
+    static QMutex backendMutex_;
+};
+
+class ChatSpellHighlighter : public QSyntaxHighlighter
+{
+    Q_OBJECT
+
+public:
+    ChatSpellHighlighter(QTextDocument *document);
+
+protected:
+    void highlightBlock(const QString &text);
+
+private slots:
+    void wordsChecked(const QStringList &words);
+    void wordAdded(const QString &word);
+
+private:
+    void rehighlightWords(const QStringList &words);
+
+    QTextCharFormat format_;
+    QSet<QString> waiting_;
+};
+
+#endif // CHATSPELLCHECKER_H
@@ -0,0 +1,154 @@
+/*
+ * chatstatemanager.cpp - chat state notifications of an account
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "chatstatemanager.h"
+
+#include "psiaccount.h"
+
+static const int tickInterval    = 250; // msecs
+static const int sendInterval    = 4;   // ticks between two notifications to a contact
+static const int composingTicks  = 8;   // no typing for that long ends composing
+static const int wheelSize       = 16;  // more than any timeout
+
+ChatStateManager::ChatStateManager(PsiAccount *account) :
+    QObject(account),
+    account_(account),
+    wheel_(wheelSize)
+{
+    timer_.setInterval(tickInterval);
+    connect(&timer_, SIGNAL(timeout()), SLOT(tick()));
+}
+
+ChatStateManager::~ChatStateManager()
+{
+}
+
+void ChatStateManager::send(const XMPP::Message &m)
+{
+    Contact &c = contacts_[m.to().full()];
+    if (m.chatState() == c.lastSent && !m.containsEvents()) {
+        // back where the contact was left, a waiting one is void
+        c.hasPending = false;
+        return;
+    }
+    c.pending    = m;
+    c.hasPending = true;
+    schedule();
+}
+
+void ChatStateManager::stateSent(const XMPP::Jid &jid, XMPP::ChatState state)
+{
+    Contact &c = contacts_[jid.full()];
+    c.hasPending = false;
+    c.lastSent   = state;
+    c.nextSend   = tick_ + sendInterval;
+    schedule();
+}
+
+void ChatStateManager::touchComposing(QObject *owner, std::function<void()> stopped)
+{
+    auto it = timeouts_.find(owner);
+    if (it == timeouts_.end()) {
+        connect(owner, SIGNAL(destroyed(QObject *)), SLOT(ownerDestroyed(QObject *)));
+        it = timeouts_.insert(owner, Timeout());
+    } else {
+        wheel_[it->deadline % wheelSize].removeOne(owner);
+    }
+    it->deadline = tick_ + composingTicks;
+    it->stopped  = stopped;
+    wheel_[it->deadline % wheelSize].append(owner);
+    schedule();
+}
+
+void ChatStateManager::cancelComposing(QObject *owner)
+{
+    auto it = timeouts_.find(owner);
+    if (it == timeouts_.end())
+        return;
+    wheel_[it->deadline % wheelSize].removeOne(owner);
+    timeouts_.erase(it);
+    disconnect(owner, SIGNAL(destroyed(QObject *)), this, SLOT(ownerDestroyed(QObject *)));
+}
+
+void ChatStateManager::ownerDestroyed(QObject *owner)
+{
+    auto it = timeouts_.find(owner);
+    if (it == timeouts_.end())
+        return;
+    wheel_[it->deadline % wheelSize].removeOne(owner);
+    timeouts_.erase(it);
+}
+
+void ChatStateManager::schedule()
+{
+    if (!timer_.isActive())
+        timer_.start();
+}
+
+void ChatStateManager::tick()
+{
+    ++tick_;
+
+    // the timeouts of this slot, all of them due as no timeout spans the wheel
+    const QList<QObject *> due = wheel_[tick_ % wheelSize];
+    wheel_[tick_ % wheelSize].clear();
+    for (QObject *owner : due) {
+        const Timeout t = timeouts_.take(owner);
+        disconnect(owner, SIGNAL(destroyed(QObject *)), this, SLOT(ownerDestroyed(QObject *)));
+        t.stopped();
+    }
+
+    // idle until something is scheduled again, no contact is held back then
+    if (!flush() && timeouts_.isEmpty())
+        timer_.stop();
+}
+
+bool ChatStateManager::flush()
+{
+    const bool online = account_->isAvailable();
+    bool       limited = false;
+    for (auto it = contacts_.begin(); it != contacts_.end();) {
+        Contact &c = it.value();
+        if (c.hasPending && c.nextSend <= tick_) {
+            XMPP::Message &m = c.pending;
+            if (online) {
+                // composing and inactive are only left through paused
+                if ((c.lastSent == XMPP::StateComposing && m.chatState() == XMPP::StateInactive)
+                    || (c.lastSent == XMPP::StateInactive && m.chatState() == XMPP::StateComposing)) {
+                    XMPP::Message pm(m.to());
+                    pm.setType("chat");
+                    pm.setChatState(XMPP::StatePaused);
+                    account_->dj_sendMessage(pm, false);
+                }
+                account_->dj_sendMessage(m, false);
+            }
+            c.hasPending = false;
+            c.lastSent = online ? m.chatState() : XMPP::StateNone;
+            c.nextSend = tick_ + sendInterval;
+        }
+        if (c.hasPending || c.nextSend > tick_)
+            limited = true;
+        // the conversation is over, nothing to remember
+        if (!c.hasPending && c.lastSent == XMPP::StateGone && c.nextSend <= tick_)
+            it = contacts_.erase(it);
+        else
+            ++it;
+    }
+    return limited;
+}
@@ -0,0 +1,87 @@
+/*
+ * chatstatemanager.h - chat state notifications of an account
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CHATSTATEMANAGER_H
+#define CHATSTATEMANAGER_H
+
+#include "xmpp_message.h"
+
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include <functional>
+
+class PsiAccount;
+
+/**
+ * Sends the standalone chat state notifications of the chat dialogs of an
+ * account. A notification waits until the previous one to the same
+ * contact is a second old, and is replaced by a newer one while it waits,
+ * so flipping between states sends only where the contact ends up, and a
+ * state the contact already has isn't sent again. Due notifications go out
+ * together on the tick of a shared timer.
+ *
+ * The same timer runs a wheel of timeouts, which tells the dialogs when
+ * their user stopped typing without each of them ticking its own timer.
+ */
+class ChatStateManager : public QObject {
+    Q_OBJECT
+public:
+    ChatStateManager(PsiAccount *account);
+    ~ChatStateManager();
+
+    // m is a chat message with a chat state or message events only
+    void send(const XMPP::Message &m);
+    // a message to jid carried this state, nothing else needs to tell it
+    void stateSent(const XMPP::Jid &jid, XMPP::ChatState state);
+
+    // calls stopped() once owner didn't call this for the composing timeout
+    void touchComposing(QObject *owner, std::function<void()> stopped);
+    void cancelComposing(QObject *owner);
+
+private slots:
+    void tick();
+    void ownerDestroyed(QObject *owner);
+
+private:
+    struct Contact {
+        XMPP::Message   pending;
+        bool            hasPending = false;
+        XMPP::ChatState lastSent   = XMPP::StateNone;
+        qint64          nextSend   = 0; // tick
+    };
+    struct Timeout {
+        qint64                deadline; // tick
+        std::function<void()> stopped;
+    };
+
+    void schedule();
+    bool flush();
+
+    PsiAccount *              account_;
+    QTimer                    timer_;
+    qint64                    tick_ = 0;
+    QHash<QString, Contact>   contacts_; // by full jid
+    QVector<QList<QObject *>> wheel_;    // owners by deadline modulo the wheel size
+    QHash<QObject *, Timeout> timeouts_;
+};
+
+#endif // CHATSTATEMANAGER_H
@@ -21,7 +21,9 @@
 
 #include "coloropt.h"
 #include "common.h"
+#include "debug.h"
 #include "iconset.h"
+#include "memoryaccounting.h"
 #include "messageview.h"
 #include "msgmle.h"
 #include "psioptions.h"
@@ -30,6 +32,7 @@
 #include "textutil.h"
 #include "xmpp/jid/jid.h"
 
+#include <QAbstractTextDocumentLayout>
 #include <QKeyEvent>
 #include <QMenu>
 #include <QScrollBar>
@@ -49,6 +52,15 @@ static const char *informationalColorOpt = "options.ui.look.colors.messages.info
 static const QRegExp underlineFixRE("(<a href=\"addnick://psi/[^\"]*\"><span style=\")");
 static const QRegExp removeTagsRE("<[^>]*>");
 
+// marks the first block of each message so the log can be trimmed message-wise
+class ChatLogBlockData : public QTextBlockUserData
+{
+public:
+    explicit ChatLogBlockData(const QDateTime &time) : time(time) { }
+
+    QDateTime time;
+};
+
 //----------------------------------------------------------------------------
 // ChatView
 //----------------------------------------------------------------------------
@@ -57,6 +69,11 @@ ChatView::ChatView(QWidget *parent)
     , isMuc_(false)
     , isEncryptionEnabled_(false)
     , oldTrackBarPosition(0)
+    , maxMessages_(0)
+    , shownMessages_(0)
+    , trimmed_(false)
+    , olderRequested_(false)
+    , prepending_(false)
     , dialog_(nullptr)
 {
     setWordWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
@@ -79,6 +96,17 @@ ChatView::ChatView(QWidget *parent)
         actQuote_->setEnabled(textCursor().hasSelection());
     });
 
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), SLOT(checkOlderMessages(int)));
+    maxMessages_ = PsiOptions::instance()->getOption("options.ui.chat.history.max-shown-messages").toInt();
+
+    // just the text, layout and images come on top
+    MemoryAccounting::add(this, "chat view documents", [this]() {
+        MemoryAccounting::Usage u;
+        u.bytes   = qint64(document()->characterCount()) * qint64(sizeof(QChar));
+        u.entries = shownMessages_;
+        return u;
+    });
+
     useMessageIcons_ = PsiOptions::instance()->getOption("options.ui.chat.use-message-icons").toBool();
     if (useMessageIcons_) {
         int logIconsSize = int(fontInfo().pixelSize()*0.93);
@@ -147,6 +175,10 @@ void ChatView::clear()
 {
     PsiTextView::clear();
     addLogIconsResources();
+    shownMessages_  = 0;
+    trimmed_        = false;
+    olderRequested_ = false;
+    markers_.clear();
 }
 
 void ChatView::contextMenuEvent(QContextMenuEvent *e)
@@ -190,10 +222,20 @@ void ChatView::markReceived(QString id)
 {
     if (useMessageIcons_) {
         document()->addResource(QTextDocument::ImageResource, QUrl(QString("icon:delivery") + id), isEncryptionEnabled_? logIconDeliveredPgp : logIconDelivered);
-        setLineWrapColumnOrWidth(lineWrapColumnOrWidth());
+        // the receipts of a backlog come together, one relayout shows them all
+        if (!relayoutPending_) {
+            relayoutPending_ = true;
+            QTimer::singleShot(16, this, SLOT(relayoutReceipts()));
+        }
     }
 }
 
+void ChatView::relayoutReceipts()
+{
+    relayoutPending_ = false;
+    setLineWrapColumnOrWidth(lineWrapColumnOrWidth());
+}
+
 bool ChatView::focusNextPrevChild(bool next)
 {
     return QWidget::focusNextPrevChild(next);
@@ -307,6 +349,9 @@ void ChatView::appendText(const QString &text)
 
 void ChatView::dispatchMessage(const MessageView &mv)
 {
+    TRACE_FUNCTION();
+    const int  blocksBefore = document()->blockCount();
+    const bool wasEmpty     = document()->isEmpty();
     const QString& replaceId = mv.replaceId();
     if ((mv.type() == MessageView::Message || mv.type() == MessageView::Subject)
             && ChatViewCommon::updateLastMsgTime(mv.dateTime()) && replaceId.isEmpty())
@@ -327,8 +372,7 @@ void ChatView::dispatchMessage(const MessageView &mv)
             cursor.clearSelection();
             setTextCursor(cursor);
             if (isReplace) {
-                cursor.setPosition(0);
-                replaceCursor = PsiRichText::findMarker(cursor, replaceId + "_" + mv.userId());
+                replaceCursor = findMessageMarker(replaceId + "_" + mv.userId());
                 isReplace = !replaceCursor.isNull(); // marker not found
             }
             if (isReplace) {
@@ -344,7 +388,15 @@ void ChatView::dispatchMessage(const MessageView &mv)
             } else {
                 cursor.movePosition(QTextCursor::End); // no luck with replace, then insert into the end of doc
             }
-            PsiRichText::insertMarker(cursor, mv.messageId() + "_" + mv.userId());
+            if (isReplace) {
+                markers_.remove(replaceId + "_" + mv.userId());
+            }
+            const QString markerId = mv.messageId() + "_" + mv.userId();
+            PsiRichText::insertMarker(cursor, markerId);
+            markers_.insert(markerId, cursor.block());
+            if (prepending_) {
+                prependedMarkers_.append(qMakePair(markerId, cursor.blockNumber()));
+            }
             setTextCursor(cursor); // make sure the message is rendered here and nowhere else
             if (isMuc_) {
                 renderMucMessage(mv, cursor);
@@ -389,6 +441,190 @@ void ChatView::dispatchMessage(const MessageView &mv)
         default: // System/Status
             renderSysMessage(mv);
     }
+
+    QTextBlock first = document()->findBlockByNumber(wasEmpty ? 0 : blocksBefore);
+    if (first.isValid() && !first.userData()) {
+        first.setUserData(new ChatLogBlockData(mv.dateTime()));
+        ++shownMessages_;
+        if (!prepending_) {
+            trimMessages();
+        }
+    }
+}
+
+/**
+ * Drops the oldest messages once more than the configured number is shown.
+ * While scrolled to the bottom the log is kept at the limit. Scrolled up, it
+ * may grow to twice that, and then only what's above the viewport goes, with
+ * the scroll position moved along so the text the user is reading stays put.
+ */
+void ChatView::trimMessages()
+{
+    if (maxMessages_ <= 0 || shownMessages_ <= maxMessages_) {
+        return;
+    }
+    const bool bottom = atBottom();
+    if (!bottom && shownMessages_ <= maxMessages_ * 2) {
+        return;
+    }
+
+    QScrollBar *                 sb      = verticalScrollBar();
+    QAbstractTextDocumentLayout *layout  = document()->documentLayout();
+    int                          excess  = shownMessages_ - maxMessages_;
+    int                          dropped = 0;
+    QTextBlock                   block   = document()->begin();
+    for (; block.isValid(); block = block.next()) {
+        if (block.userData()) {
+            if (excess == 0 || (!bottom && layout->blockBoundingRect(block).top() > sb->value())) {
+                break;
+            }
+            --excess;
+            ++dropped;
+        }
+    }
+    if (!block.isValid() || dropped == 0) {
+        return;
+    }
+
+    for (QTextBlock b = document()->begin(); b != block; b = b.next()) {
+        for (const QString &id : PsiRichText::markers(b)) {
+            markers_.remove(id);
+        }
+    }
+
+    const int   height = int(layout->blockBoundingRect(block).top());
+    const int   value  = sb->value();
+    QTextCursor cursor(document());
+    cursor.setPosition(block.position(), QTextCursor::KeepAnchor);
+    const int removed = cursor.selectionEnd();
+    cursor.removeSelectedText();
+    shownMessages_     -= dropped;
+    trimmed_            = true;
+    oldTrackBarPosition = qMax(0, oldTrackBarPosition - removed);
+    if (bottom) {
+        scrollToBottom();
+    } else {
+        sb->setValue(qMax(0, value - height));
+    }
+}
+
+/**
+ * Renders a page of older messages from history above the current log.
+ * An empty list means there is nothing more to load.
+ */
+void ChatView::prependMessages(const QList<MessageView> &list)
+{
+    olderRequested_ = false;
+    if (list.isEmpty()) {
+        trimmed_ = false;
+        return;
+    }
+
+    // render the page at the end as usual and then move it to the top
+    QScrollBar *     sb           = verticalScrollBar();
+    const int        fromBottom   = sb->maximum() - sb->value();
+    const int        blocksBefore = document()->blockCount();
+    const QDateTime  lastMsgTime  = _lastMsgTime;
+    QList<QDateTime> times;
+    QList<int>       offsets;
+
+    prepending_  = true;
+    _lastMsgTime = QDateTime();
+    prependedMarkers_.clear();
+    for (const MessageView &mv : list) {
+        const int count = shownMessages_;
+        dispatchMessage(mv);
+        if (shownMessages_ != count) {
+            QTextBlock b = document()->findBlockByNumber(document()->blockCount() - 1);
+            while (b.isValid() && !b.userData()) {
+                b = b.previous();
+            }
+            offsets.append(b.blockNumber() - blocksBefore);
+            times.append(mv.dateTime());
+        }
+    }
+    _lastMsgTime = lastMsgTime;
+    prepending_  = false;
+
+    QTextCursor cursor(document());
+    cursor.setPosition(document()->findBlockByNumber(blocksBefore).position());
+    cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+    const QTextDocumentFragment page = cursor.selection();
+    cursor.setPosition(document()->findBlockByNumber(blocksBefore - 1).position());
+    cursor.movePosition(QTextCursor::EndOfBlock);
+    cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+
+    cursor.setPosition(0);
+    cursor.beginEditBlock();
+    cursor.insertBlock();
+    cursor.setPosition(0);
+    QTextBlockFormat blockFormat = cursor.blockFormat();
+    blockFormat.clearProperty(QTextFormat::BlockTrailingHorizontalRulerWidth);
+    cursor.setBlockFormat(blockFormat);
+    cursor.insertFragment(page);
+    cursor.endEditBlock();
+    if (oldTrackBarPosition) {
+        oldTrackBarPosition += cursor.position() + 1;
+    }
+
+    // the fragment doesn't carry block data, so mark the messages again
+    for (int i = 0; i < offsets.size(); ++i) {
+        QTextBlock b = document()->findBlockByNumber(offsets.at(i));
+        if (b.isValid()) {
+            b.setUserData(new ChatLogBlockData(times.at(i)));
+        }
+    }
+    for (const auto &marker : prependedMarkers_) {
+        QTextBlock b = document()->findBlockByNumber(marker.second - blocksBefore);
+        if (b.isValid()) {
+            markers_.insert(marker.first, b);
+        } else {
+            markers_.remove(marker.first);
+        }
+    }
+    prependedMarkers_.clear();
+    sb->setValue(sb->maximum() - fromBottom);
+}
+
+void ChatView::checkOlderMessages(int value)
+{
+    if (!trimmed_ || olderRequested_ || value != verticalScrollBar()->minimum()) {
+        return;
+    }
+
+    for (QTextBlock b = document()->begin(); b.isValid(); b = b.next()) {
+        ChatLogBlockData *data = static_cast<ChatLogBlockData *>(b.userData());
+        if (data && data->time.isValid()) {
+            olderRequested_ = true;
+            emit olderMessagesRequested(data->time);
+            return;
+        }
+    }
+}
+
+/**
+ * Finds the marker of a shown message, so it can be corrected. The block is
+ * remembered when the marker is inserted and only verified here; if the
+ * document changed under it, the whole log is searched once more.
+ */
+QTextCursor ChatView::findMessageMarker(const QString &id)
+{
+    auto it = markers_.find(id);
+    if (it == markers_.end()) {
+        return QTextCursor(); // trimmed away, or never shown here
+    }
+    QTextCursor found = PsiRichText::findMarker(*it, id);
+    if (found.isNull()) {
+        QTextCursor cursor(document());
+        found = PsiRichText::findMarker(cursor, id);
+        if (found.isNull()) {
+            markers_.erase(it);
+        } else {
+            *it = found.block();
+        }
+    }
+    return found;
 }
 
 QString ChatView::replaceMarker(const MessageView &mv) const
@@ -485,7 +721,7 @@ void ChatView::renderMessage(const MessageView &mv, QTextCursor &insertCursor)
     }
     insertText(str, insertCursor);
 
-    if (mv.isLocal() && PsiOptions::instance()->getOption("options.ui.chat.auto-scroll-to-bottom").toBool() ) {
+    if (mv.isLocal() && !prepending_ && PsiOptions::instance()->getOption("options.ui.chat.auto-scroll-to-bottom").toBool() ) {
         deferredScroll();
     }
 }
@@ -22,7 +22,9 @@
 
 #include <QContextMenuEvent>
 #include <QDateTime>
+#include <QHash>
 #include <QPointer>
+#include <QTextBlock>
 #include <QWidget>
 
 #include "chatviewcommon.h"
@@ -62,6 +64,7 @@ public:
     void insertText(const QString &text, QTextCursor &insertCursor);
     void appendText(const QString &text);
     void dispatchMessage(const MessageView &);
+    void prependMessages(const QList<MessageView> &);
     bool handleCopyEvent(QObject *object, QEvent *event, ChatEdit *chatEdit);
 
     void deferredScroll();
@@ -86,30 +89,43 @@ protected:
     QString colorString(bool local, bool spooled) const;
 
     QString replaceMarker(const MessageView &mv) const;
+    QTextCursor findMessageMarker(const QString &id);
     void renderMucMessage(const MessageView &, QTextCursor &insertCursor);
     void renderMessage(const MessageView &, QTextCursor &insertCursor);
     void renderSysMessage(const MessageView &);
     void renderSubject(const MessageView &);
     void renderMucSubject(const MessageView &);
     void renderUrls(const MessageView &);
+    void trimMessages();
 
 protected slots:
     void autoCopy();
 
 private slots:
     void slotScroll();
+    void checkOlderMessages(int value);
+    void relayoutReceipts();
 
 signals:
     void showNM(const QString&);
     void quote(const QString &text);
     void nickInsertClick(const QString &nick);
+    void olderMessagesRequested(const QDateTime &before);
 
 private:
     bool isMuc_;
     bool isMucPrivate_;
     bool isEncryptionEnabled_;
     bool useMessageIcons_;
+    bool relayoutPending_ = false;
     int  oldTrackBarPosition;
+    int  maxMessages_;
+    int  shownMessages_;
+    bool trimmed_;
+    bool olderRequested_;
+    bool prepending_;
+    QHash<QString, QTextBlock> markers_; // message markers by id, for corrections
+    QList<QPair<QString, int>> prependedMarkers_; // id and block offset within the page
     XMPP::Jid jid_;
     QString name_;
     QPointer<QWidget> dialog_;
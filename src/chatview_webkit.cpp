@@ -23,6 +23,7 @@
 #include "avatars.h"
 #include "chatviewtheme.h"
 #include "chatviewthemeprovider.h"
+#include "debug.h"
 #include "desktoputil.h"
 #include "filesharingmanager.h"
 #include "jsutil.h"
@@ -53,7 +54,10 @@
 #include <QMetaProperty>
 #include <QNetworkReply>
 #include <QPalette>
+#include <QRegularExpression>
+#include <QTimer>
 #include <QWidget>
+#include <memory>
 #ifdef WEBENGINE
 #if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
 #include <QWebEngineContextMenuData>
@@ -68,6 +72,82 @@
 class ChatViewJSObject;
 class ChatViewThemeSessionBridge;
 
+// Writes one JSON object straight into a string, so the message objects of
+// the themes skip QVariantMap. Keys are plain ASCII and written as is.
+class JsonObjectWriter {
+public:
+    explicit JsonObjectWriter(QString &out) : out_(out) { out_ += QLatin1Char('{'); }
+
+    void addString(const char *key, const QString &value)
+    {
+        addKey(key);
+        appendString(out_, value);
+    }
+
+    void addBool(const char *key, bool value)
+    {
+        addKey(key);
+        out_ += value ? QLatin1String("true") : QLatin1String("false");
+    }
+
+    void addNumber(const char *key, qint64 value)
+    {
+        addKey(key);
+        out_ += QString::number(value);
+    }
+
+    void addJson(const char *key, const QString &json)
+    {
+        addKey(key);
+        out_ += json;
+    }
+
+    void finish() { out_ += QLatin1Char('}'); }
+
+    static void appendString(QString &out, const QString &value)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out += QLatin1Char('"');
+        for (const QChar c : value) {
+            const ushort u = c.unicode();
+            if (u == '"' || u == '\\') {
+                out += QLatin1Char('\\');
+                out += c;
+            } else if (u == '\n') {
+                out += QLatin1String("\\n");
+            } else if (u == '\r') {
+                out += QLatin1String("\\r");
+            } else if (u == '\t') {
+                out += QLatin1String("\\t");
+            } else if (u < 0x20) {
+                out += QLatin1String("\\u00");
+                out += QLatin1Char(hex[u >> 4]);
+                out += QLatin1Char(hex[u & 0xf]);
+            } else {
+                out += c;
+            }
+        }
+        out += QLatin1Char('"');
+    }
+
+private:
+    void addKey(const char *key)
+    {
+        if (!first_) {
+            out_ += QLatin1Char(',');
+        }
+        first_ = false;
+        out_ += QLatin1Char('"');
+        out_ += QLatin1String(key);
+        out_ += QLatin1String("\":");
+    }
+
+    QString &out_;
+    bool     first_ = true;
+};
+
+static const int receiptsDelay = 16; // msecs, a frame
+
 class ChatViewPrivate {
 public:
     ChatViewPrivate() = default;
@@ -76,8 +156,10 @@ public:
 
     WebView *                 webView  = nullptr;
     ChatViewJSObject *        jsObject = nullptr;
-    QList<QVariantMap>        jsBuffer_;
-    bool                      sessionReady_ = false;
+    QVariantList              jsBuffer_; // objects and messages already written as JSON text
+    bool                      sessionReady_     = false;
+    bool                      jsFlushScheduled_ = false;
+    QVariantMap               receipts_; // message id => encrypted, waiting for the next frame
     QPointer<QWidget>         dialog_;
     bool                      isMuc_               = false;
     bool                      isMucPrivate_        = false;
@@ -87,6 +169,7 @@ public:
     PsiAccount *              account_ = nullptr;
     AvatarFactory::UserHashes remoteIcons;
     AvatarFactory::UserHashes localIcons;
+    QHash<QString, QString>   mucAvatars; // participant nick => avatar url, kept up by updateAvatar()
     ChatViewThemeProvider *   themeProvider = nullptr;
 
     static QString closeIconTags(const QString &richText)
@@ -97,35 +180,74 @@ public:
         return s;
     }
 
-    QString prepareShares(const QString &msg)
+    // the share tag of the file sharing item idStr with the attributes the
+    // themes show it with, nothing for an unknown item
+    void appendShare(QString &out, const QString &idStr)
     {
-        static QRegularExpression re("<share id=\"([^\"]+)\"/>");
-        int                       post = 0;
-        QString                   ret;
-        auto                      it = re.globalMatch(msg);
+        auto id   = XMPP::Hash::from(QStringRef(&idStr));
+        auto item = account_->psi()->fileSharingManager()->item(id);
+        if (!item) {
+            return;
+        }
+
+        QString attrs;
+        attrs += QString(" id=\"%1\"").arg(idStr);
+        auto metaType = item->mimeType();
+        attrs += QString(" type=\"%1\"").arg(metaType);
+        if (metaType.startsWith(QLatin1String("audio/"))) {
+            // a waveform at hand goes with the tag, one computed later fills the bars in
+            QByteArray hg;
+            auto       inTag = std::make_shared<bool>(true);
+            item->manager()->amplitudes(item, jsObject, [this, idStr, inTag, &hg](const QByteArray &ampl) {
+                if (*inTag) {
+                    hg = ampl;
+                } else if (ampl.size()) {
+                    QVariantMap m;
+                    m["type"]       = "amplitudes";
+                    m["id"]         = idStr;
+                    m["amplitudes"] = amplitudePercents(ampl);
+                    static_cast<ChatView *>(jsObject->parent())->sendJsObject(m);
+                }
+            });
+            *inTag = false;
+            if (hg.size())
+                attrs += QString(" amplitudes=\"%1\"").arg(amplitudePercents(hg).join(','));
+        }
+        out.append(QString("<share%1/>").arg(attrs));
+    }
+
+    static QStringList amplitudePercents(const QByteArray &hg)
+    {
+        QStringList l;
+        std::transform(hg.constBegin(), hg.constEnd(), std::back_inserter(l),
+                       [](char f) { return QString::number(int(quint8(f) / 2.55)); });
+        return l;
+    }
+
+    // prepares the html of a message in one pass: shares get their
+    // attributes, icon tags are closed and referenced bits of binary are
+    // fetched while the message is queued for display
+    QString prepareMessage(const QString &msg)
+    {
+        static QRegularExpression re(
+            QStringLiteral("<share id=\"([^\"]+)\"/>|(<icon [^>]+>)|src=[\"']cid:([^\"']+)[\"']"));
+        int     post = 0;
+        QString ret;
+        ret.reserve(msg.size());
+        auto it = re.globalMatch(msg);
         while (it.hasNext()) {
             auto match = it.next();
-            auto idStr = match.captured(1);
-            auto id    = XMPP::Hash::from(QStringRef(&idStr));
-            auto item  = account_->psi()->fileSharingManager()->item(id);
-
             ret.append(msg.midRef(post, match.capturedStart(0) - post));
-            if (item) {
-                auto    vm = item->metaData();
-                QString attrs;
-                attrs += QString(" id=\"%1\"").arg(idStr);
-                auto metaType = item->mimeType();
-                attrs += QString(" type=\"%1\"").arg(metaType);
-                if (metaType.startsWith(QLatin1String("audio/"))) {
-                    auto hg = vm.value(QLatin1String("amplitudes")).toByteArray();
-                    if (hg.size()) {
-                        QStringList l;
-                        std::transform(hg.constBegin(), hg.constEnd(), std::back_inserter(l),
-                                       [](char f) { return QString::number(int(quint8(f) / 2.55)); });
-                        attrs += QString(" amplitudes=\"%1\"").arg(l.join(','));
-                    }
+            if (match.capturedStart(1) != -1) {
+                appendShare(ret, match.captured(1));
+            } else if (match.capturedStart(2) != -1) {
+                ret.append(match.capturedRef(2));
+                ret.append(QLatin1String("</icon>"));
+            } else {
+                ret.append(match.capturedRef(0));
+                if (account_) {
+                    account_->prefetchBob(jid_, match.captured(3));
                 }
-                ret.append(QString("<share%1/>").arg(attrs));
             }
             post = match.capturedEnd(0);
         }
@@ -297,6 +419,12 @@ public slots:
         emit _view->nickInsertClick(nick);
     }
 
+    // the theme dropped old messages and the user scrolled up to them
+    void requestOlderMessages(double before)
+    {
+        emit _view->olderMessagesRequested(QDateTime::fromMSecsSinceEpoch(qint64(before)));
+    }
+
     void getUrlHeaders(const QString &tId, const QString url)
     {
         QNetworkRequest req(QUrl::fromEncoded(url.toLatin1()));
@@ -344,6 +472,7 @@ signals:
     void localUserImageChanged(const QString &);
     void localUserAvatarChanged(const QString &);
     void newMessage(const QVariant &);
+    void newMessages(const QVariantList &); // several messages in one bridge call
 };
 
 //----------------------------------------------------------------------------
@@ -502,12 +631,23 @@ void ChatView::setEncryptionEnabled(bool enabled)
     d->isEncryptionEnabled_ = enabled;
 }
 
+// a backlog acknowledged at once brings hundreds of receipts, the theme
+// gets the ones of a frame in one object
 void ChatView::markReceived(QString id)
 {
+    if (d->receipts_.isEmpty())
+        QTimer::singleShot(receiptsDelay, this, SLOT(flushReceipts()));
+    d->receipts_.insert(id, d->isEncryptionEnabled_);
+}
+
+void ChatView::flushReceipts()
+{
+    if (d->receipts_.isEmpty())
+        return;
     QVariantMap m;
-    m["type"]      = "receipt";
-    m["id"]        = id;
-    m["encrypted"] = d->isEncryptionEnabled_;
+    m["type"]     = "receipts";
+    m["receipts"] = d->receipts_;
+    d->receipts_.clear();
     sendJsObject(m);
 }
 
@@ -590,16 +730,39 @@ void ChatView::psiOptionChanged(const QString &option)
 void ChatView::sendJsObject(const QVariantMap &map)
 {
     d->jsBuffer_.append(map);
-    checkJsBuffer();
+    scheduleJsFlush();
+}
+
+// the themes take a message given as JSON text like an object
+void ChatView::sendJsMessage(const QString &json)
+{
+    d->jsBuffer_.append(json);
+    scheduleJsFlush();
+}
+
+void ChatView::scheduleJsFlush()
+{
+    // messages dispatched in a row (e.g. history preload) go in one bridge call
+    if (d->sessionReady_ && !d->jsFlushScheduled_) {
+        d->jsFlushScheduled_ = true;
+        QTimer::singleShot(0, this, SLOT(checkJsBuffer()));
+    }
 }
 
 void ChatView::checkJsBuffer()
 {
-    if (d->sessionReady_) {
-        while (!d->jsBuffer_.isEmpty()) {
-            d->jsObject->newMessage(d->jsBuffer_.takeFirst());
-        }
+    d->jsFlushScheduled_ = false;
+    if (!d->sessionReady_ || d->jsBuffer_.isEmpty()) {
+        return;
+    }
+    if (d->jsBuffer_.size() == 1) {
+        d->jsObject->newMessage(d->jsBuffer_.takeFirst());
+        return;
     }
+
+    QVariantList batch;
+    batch.swap(d->jsBuffer_);
+    emit d->jsObject->newMessages(batch);
 }
 
 void ChatView::sessionInited()
@@ -625,6 +788,7 @@ bool ChatView::handleCopyEvent(QObject *object, QEvent *event, ChatEdit *chatEdi
 // input point of all messages
 void ChatView::dispatchMessage(const MessageView &mv)
 {
+    TRACE_FUNCTION();
     QString replaceId = mv.replaceId();
     if (replaceId.isEmpty() && (mv.type() == MessageView::Message || mv.type() == MessageView::Subject)
         && updateLastMsgTime(mv.dateTime())) {
@@ -634,31 +798,131 @@ void ChatView::dispatchMessage(const MessageView &mv)
         m["mtype"] = "lastDate";
         sendJsObject(m);
     }
-    QVariantMap vm = mv.toVariantMap(d->isMuc_, true);
-    if (mv.type() == MessageView::MUCJoin) {
-        Jid j           = d->jid_.withResource(mv.nick());
-        vm["avatar"]    = ChatViewJSObject::avatarUrl(d->account_->avatarFactory()->userHashes(j).avatar);
-        vm["nickcolor"] = getMucNickColor(mv.nick(), mv.isLocal());
-    }
-    auto it = vm.find(QLatin1String("usertext"));
-    if (it != vm.end()) {
-        *it = ChatViewPrivate::closeIconTags(it.value().toString());
-    }
-    it = vm.find(QLatin1String("message"));
-    if (it != vm.end()) {
-        *it = d->prepareShares(it.value().toString());
-        *it = ChatViewPrivate::closeIconTags(it.value().toString());
+    sendJsMessage(jsMessage(mv, replaceId));
+}
+
+// a page of older messages from history shown above the current ones
+void ChatView::prependMessages(const QList<MessageView> &list)
+{
+    QVariantList items;
+    QDate        lastDate;
+    for (const MessageView &mv : list) {
+        if (mv.type() == MessageView::Message && mv.dateTime().date() != lastDate) {
+            lastDate = mv.dateTime().date();
+            QVariantMap m;
+            m["date"]  = mv.dateTime();
+            m["type"]  = "message";
+            m["mtype"] = "lastDate";
+            items.append(m);
+        }
+        items.append(jsMessage(mv));
     }
+    QVariantMap m;
+    m["type"]  = "prepend";
+    m["items"] = items;
+    sendJsObject(m);
+}
 
-    vm["encrypted"] = d->isEncryptionEnabled_;
-    if (!replaceId.isEmpty()) {
-        vm["type"]      = "replace";
-        vm["replaceId"] = replaceId;
+// The message object of the themes as JSON text, what MessageView::toVariantMap()
+// has with the html prepared for the view. The time goes as msecs since epoch.
+QString ChatView::jsMessage(const MessageView &mv, const QString &replaceId)
+{
+    // in the order of MessageView::Type
+    static const char *types[] = { "message", "system", "status", "subject", "urls",
+                                   "join",    "part",   "newnick", "ftreq",  "ftfin" };
+
+    QString json;
+    json.reserve(256 + mv.text().size() * 2);
+    JsonObjectWriter w(json);
+    if (replaceId.isEmpty()) {
+        w.addString("type", QStringLiteral("message"));
     } else {
-        vm["mtype"] = vm["type"];
-        vm["type"]  = "message";
+        w.addString("type", QStringLiteral("replace"));
+        w.addString("replaceId", replaceId);
+    }
+    w.addString("mtype", QLatin1String(types[mv.type()]));
+    w.addNumber("time", mv.dateTime().toMSecsSinceEpoch());
+    w.addBool("encrypted", d->isEncryptionEnabled_);
+
+    switch (mv.type()) {
+    case MessageView::Message:
+        w.addString("message", d->prepareMessage(mv.formattedText()));
+        w.addBool("emote", mv.isEmote());
+        w.addBool("local", mv.isLocal());
+        w.addString("sender", mv.nick());
+        w.addString("userid", mv.userId());
+        w.addBool("spooled", mv.isSpooled());
+        w.addString("id", mv.messageId());
+        if (d->isMuc_) {
+            w.addBool("alert", mv.isAlert());
+        } else {
+            w.addBool("awaitingReceipt", mv.isAwaitingReceipt());
+        }
+        if (mv.references().count()) {
+            // rare and of free form, left to QJsonDocument
+            QJsonObject refs;
+            for (auto const &r : mv.references()) {
+                auto md = r->metaData();
+                md.insert("type", r->mimeType());
+                refs.insert(r->sums()[0].toString(), QJsonObject::fromVariantMap(md));
+            }
+            w.addJson("references", QString::fromUtf8(QJsonDocument(refs).toJson(QJsonDocument::Compact)));
+        }
+        break;
+    case MessageView::NickChange:
+        w.addString("sender", mv.nick());
+        w.addString("newnick", mv.userText());
+        w.addString("message", d->prepareMessage(mv.text()));
+        break;
+    case MessageView::MUCJoin: {
+        auto avatar = d->mucAvatars.constFind(mv.nick());
+        if (avatar == d->mucAvatars.constEnd()) {
+            Jid j  = d->jid_.withResource(mv.nick());
+            avatar = d->mucAvatars.insert(
+                mv.nick(), ChatViewJSObject::avatarUrl(d->account_->avatarFactory()->userHashes(j).avatar));
+        }
+        w.addString("avatar", avatar.value());
+        w.addString("nickcolor", getMucNickColor(mv.nick(), mv.isLocal()));
+    }
+        PSI_FALLSTHROUGH; // falls through
+    case MessageView::MUCPart:
+        w.addBool("nopartjoin", mv.isJoinLeaveHidden());
+        PSI_FALLSTHROUGH; // falls through
+    case MessageView::Status:
+        w.addString("sender", mv.nick());
+        w.addNumber("status", mv.status());
+        w.addNumber("priority", mv.statusPriority());
+        w.addString("message", d->prepareMessage(mv.text()));
+        w.addString("usertext", ChatViewPrivate::closeIconTags(mv.formattedUserText()));
+        w.addBool("nostatus", mv.isStatusChangeHidden());
+        break;
+    case MessageView::System:
+    case MessageView::Subject:
+        w.addString("message", d->prepareMessage(mv.formattedText()));
+        w.addString("usertext", ChatViewPrivate::closeIconTags(mv.formattedUserText()));
+        break;
+    case MessageView::Urls: {
+        // urls are the keys here, so written by hand
+        QString    urls(QLatin1Char('{'));
+        const auto list = mv.urls();
+        for (auto it = list.constBegin(); it != list.constEnd(); ++it) {
+            if (it != list.constBegin()) {
+                urls += QLatin1Char(',');
+            }
+            JsonObjectWriter::appendString(urls, it.key());
+            urls += QLatin1Char(':');
+            JsonObjectWriter::appendString(urls, it.value());
+        }
+        urls += QLatin1Char('}');
+        w.addJson("urls", urls);
+        break;
+    }
+    case MessageView::FileTransferRequest:
+    case MessageView::FileTransferFinished:
+        break;
     }
-    sendJsObject(vm);
+    w.finish();
+    return json;
 }
 
 void ChatView::sendJsCode(const QString &js)
@@ -707,10 +971,12 @@ void ChatView::updateAvatar(const Jid &jid, ChatViewCommon::UserType utype)
             d->jsObject->setLocalUserImageHash(h.avatar);
         }
     } else { // muc participant
+        QString url = ChatViewJSObject::avatarUrl(d->account_->avatarFactory()->userHashes(jid).avatar);
+        d->mucAvatars.insert(jid.resource(), url);
         QVariantMap m;
         m["type"]   = "avatar";
         m["sender"] = jid.resource();
-        m["avatar"] = ChatViewJSObject::avatarUrl(d->account_->avatarFactory()->userHashes(jid).avatar);
+        m["avatar"] = url;
         sendJsObject(m);
     }
 }
@@ -59,7 +59,9 @@ public:
     bool handleCopyEvent(QObject *object, QEvent *event, ChatEdit *chatEdit);
 
     void sendJsObject(const QVariantMap &);
+    void sendJsMessage(const QString &json);
     void dispatchMessage(const MessageView &m);
+    void prependMessages(const QList<MessageView> &list);
     void sendJsCode(const QString &js);
 
     void clear();
@@ -92,12 +94,17 @@ public slots:
 private slots:
     void checkJsBuffer();
     void sessionInited();
+    void flushReceipts();
 
 signals:
     void showNM(const QString&);
     void nickInsertClick(const QString &nick);
+    void olderMessagesRequested(const QDateTime &before);
 
 private:
+    QString jsMessage(const MessageView &mv, const QString &replaceId = QString());
+    void    scheduleJsFlush();
+
     friend class ChatViewPrivate;
     friend class ChatViewJSObject;
     QScopedPointer<ChatViewPrivate> d;
@@ -21,7 +21,6 @@
 
 #include <QApplication>
 #include <QColor>
-#include <QRegExp>
 #include <QWidget>
 #include <math.h>
 
@@ -44,15 +43,53 @@ bool ChatViewCommon::updateLastMsgTime(QDateTime t)
     return doInsert;
 }
 
+// bumped when any of the nick coloring options changes
+static int nickColorsGeneration()
+{
+    static int generation = 0;
+    static bool connected = false;
+    if (!connected) {
+        connected = true;
+        QObject::connect(PsiOptions::instance(), &PsiOptions::optionChanged, PsiOptions::instance(), [](const QString &option) {
+            if (option.startsWith(QLatin1String("options.ui.muc.use-")) || option == QLatin1String("options.ui.look.colors.muc.nick-colors"))
+                ++generation;
+        });
+    }
+    return generation;
+}
+
 QString ChatViewCommon::getMucNickColor(const QString &nick, bool isSelf)
+{
+    QColor base = qApp->palette().color(QPalette::Base);
+    if (_nickColorsGeneration != nickColorsGeneration() || _nickColorsBase != base) {
+        _nickColorsGeneration = nickColorsGeneration();
+        _nickColorsBase = base;
+        _nickColors.clear();
+        _selfNickColors.clear();
+    }
+
+    QHash<QString, QString> &cache = isSelf ? _selfNickColors : _nickColors;
+    auto it = cache.constFind(nick);
+    if (it == cache.constEnd()) {
+        it = cache.insert(nick, nickColor(nick, isSelf));
+    }
+    return it.value();
+}
+
+QString ChatViewCommon::nickColor(const QString &nick, bool isSelf)
 {
     do {
         if(!PsiOptions::instance()->getOption("options.ui.muc.use-nick-coloring").toBool()) {
             break;
         }
 
-        QString nickwoun = nick; // nick without underscores
-        nickwoun.remove(QRegExp("(^_*|_*$)"));
+        // nick without leading and trailing underscores
+        int first = 0, last = nick.size();
+        while (first < last && nick.at(first) == '_')
+            ++first;
+        while (last > first && nick.at(last - 1) == '_')
+            --last;
+        QString nickwoun = nick.mid(first, last - first);
 
         if (PsiOptions::instance()->getOption("options.ui.muc.use-hash-nick-coloring").toBool()) {
             /* Hash-driven colors */
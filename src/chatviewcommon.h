@@ -20,7 +20,9 @@
 #ifndef CHATVIEWBASE_H
 #define CHATVIEWBASE_H
 
+#include <QColor>
 #include <QDateTime>
+#include <QHash>
 #include <QMap>
 #include <QStringList>
 
@@ -35,7 +37,7 @@ public:
         Participant
     };
 
-    ChatViewCommon() : _nickNumber(0) { }
+    ChatViewCommon() : _nickNumber(0), _nickColorsGeneration(-1) { }
     void setLooks(QWidget *);
     inline const QDateTime& lastMsgTime() const { return _lastMsgTime; }
     bool updateLastMsgTime(QDateTime t);
@@ -48,8 +50,14 @@ protected:
 private:
     QList<QColor> &generatePalette();
     bool compatibleColors(const QColor &, const QColor &);
+    QString nickColor(const QString &, bool);
     int _nickNumber;
     QMap<QString,int> _nicks;
+
+    // nick => color, dropped when options or the palette change
+    QHash<QString, QString> _nickColors, _selfNickColors;
+    int _nickColorsGeneration;
+    QColor _nickColorsBase;
 };
 
 #endif // CHATVIEWBASE_H
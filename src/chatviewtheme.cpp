@@ -32,7 +32,9 @@
 #include "webview.h"
 
 #include <QApplication>
+#include <QBuffer>
 #include <QFileInfo>
+#include <QImage>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QMetaProperty>
@@ -65,7 +67,8 @@ public:
     bool data(const QNetworkRequest &req, QByteArray &data, QByteArray &mime) const
     {
         Q_UNUSED(mime)
-        data = session->theme.loadData(session->theme.priv<ChatViewThemePrivate>()->httpRelPath + req.url().path());
+        auto priv = session->theme.priv<ChatViewThemePrivate>();
+        data = priv->resourceData(priv->httpRelPath + req.url().path());
         if (!data.isNull()) {
             return true;
         }
@@ -75,16 +78,22 @@ public:
 
 QVariant ChatViewThemePrivate::evaluateFromFile(const QString fileName, QWebFrame *frame)
 {
-    QFile f(fileName);
-    if (f.open(QIODevice::ReadOnly)) {
-        return frame->evaluateJavaScript(f.readAll());
+    // the same scripts are embedded into every session
+    auto it = scriptSources.constFind(fileName);
+    if (it == scriptSources.constEnd()) {
+        QFile f(fileName);
+        if (!f.open(QIODevice::ReadOnly)) {
+            return QVariant();
+        }
+        it = scriptSources.insert(fileName, QString::fromUtf8(f.readAll()));
     }
-    return QVariant();
+    return frame->evaluateJavaScript(it.value());
 }
 #endif
 
 ChatViewThemePrivate::ChatViewThemePrivate(ChatViewThemeProvider *provider) :
-    ThemePrivate(provider)
+    ThemePrivate(provider),
+    resourceCache(4096)
 {
     nam = provider->psi()->networkAccessManager();
 }
@@ -224,6 +233,47 @@ QVariantMap ChatViewThemePrivate::loadFromCacheMulti(const QVariantList &list)
     return ret;
 }
 
+/**
+ * Theme files requested by chat sessions. Every new chat asks for the same
+ * html, css and images, and zipped themes would be unpacked each time,
+ * so the data is kept for subsequent sessions.
+ */
+QByteArray ChatViewThemePrivate::resourceData(const QString &path, bool *loaded)
+{
+    QByteArray *cached = resourceCache.object(path);
+    if (cached) {
+        if (loaded) {
+            *loaded = true;
+        }
+        return *cached;
+    }
+
+    bool ok;
+    QByteArray data = loadData(path, &ok);
+    if (loaded) {
+        *loaded = ok;
+    }
+    if (!ok) {
+        return data;
+    }
+#ifdef WEBENGINE
+    if (!data.isNull() && path.endsWith(QLatin1String(".tiff"))) {
+        // seems like we are loading tiff image which is supported by safari only.
+        // let's convert it
+        QImage image(QImage::fromData(data));
+        QByteArray ba;
+        QBuffer buffer(&ba);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+        if (!ba.isNull()) {
+            data = ba;
+        }
+    }
+#endif
+    resourceCache.insert(path, new QByteArray(data), qMax(1, data.size() / 1024));
+    return data;
+}
+
 bool ChatViewThemePrivate::isTransparentBackground() const
 {
     return transparentBackground;
@@ -331,20 +381,8 @@ bool ChatViewThemePrivate::applyToSession(ChatViewThemeSession *session)
             return true;
         } else {
             bool loaded;
-            QByteArray data = loadData(httpRelPath + path, &loaded);
+            QByteArray data = resourceData(httpRelPath + path, &loaded);
             if (loaded) {
-                if (!data.isNull() && path.endsWith(QLatin1String(".tiff"))) {
-                    // seems like we are loading tiff image which is supported by safari only.
-                    // let's convert it
-                    QImage image(QImage::fromData(data));
-                    QByteArray ba;
-                    QBuffer buffer(&ba);
-                    buffer.open(QIODevice::WriteOnly);
-                    image.save(&buffer, "PNG");
-                    if (!ba.isNull()) {
-                        data = ba;
-                    }
-                }
                 if (path.endsWith(QLatin1String(".css"))) {
                     res->headers().insert("Content-Type", "text/css;charset=utf-8");
                 }
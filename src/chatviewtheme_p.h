@@ -23,6 +23,7 @@
 #include "chatviewtheme.h"
 #include "theme_p.h"
 
+#include <QCache>
 #include <QPointer>
 #include <QScopedPointer>
 #include <QTimer>
@@ -144,6 +145,7 @@ public:
     bool prepareSessionHtml = false; // if html should be generated by JS for each session.
     bool transparentBackground = false;
     QPointer<NetworkAccessManager> nam;
+    QCache<QString, QByteArray> resourceCache; // theme files served to sessions, cost in KiB
 
 #ifdef WEBENGINE
     QList<QWebEngineScript> scripts;
@@ -153,6 +155,7 @@ public:
     QList<std::function<void(bool)>> loadCallbacks;
 
 #ifndef WEBENGINE
+    QHash<QString, QString> scriptSources;
     QVariant evaluateFromFile(const QString fileName, QWebFrame *frame);
 #endif
 
@@ -178,6 +181,7 @@ public:
     bool applyToSession(ChatViewThemeSession *session);
 
     QVariantMap loadFromCacheMulti(const QVariantList &list);
+    QByteArray resourceData(const QString &path, bool *loaded = nullptr);
 };
 
 #endif // CHATVIEWTHEME_P_H
@@ -34,6 +34,9 @@
 #include <QPointer>
 #include <QUrlQuery>
 #ifdef WEBENGINE
+#include <QCache>
+#include <QDateTime>
+#include <QFileInfo>
 #include <QWebEngineProfile>
 #else
 #include <QNetworkRequest>
@@ -155,57 +158,95 @@ ChatViewCon::ChatViewCon(PsiCon *pc) :
         QString fn = req->url().path().mid(sizeof("/psi/themes"));
         fn.replace("..", ""); // a little security
         fn = PsiThemeProvider::themePath(fn);
+        if (fn.isEmpty())
+            return false;
+
+        // the same assets are requested by every chat view. keep them ready but notice edits
+        struct Asset {
+            QDateTime                 modified;
+            WebServer::StaticResponse response;
+        };
+        static QCache<QString, Asset> assets(8 * 1024 * 1024);
 
-        if (!fn.isEmpty()) {
+        QFileInfo fi(fn);
+        Asset *   asset = assets.object(fn);
+        if (!asset || asset->modified != fi.lastModified()) {
             QFile f(fn);
-            if (f.open(QIODevice::ReadOnly)) {
-                res->setStatusCode(qhttp::ESTATUS_OK);
-                if (fn.endsWith(QLatin1String(".js"))) {
-                    res->headers().insert("Content-Type", "application/javascript;charset=utf-8");
-                }
-                if (fn.endsWith(QLatin1String(".css"))) {
-                    res->headers().insert("Content-Type", "text/css;charset=utf-8");
-                }
-                res->end(f.readAll());
-                f.close();
+            if (!f.open(QIODevice::ReadOnly))
+                return false;
+            QByteArray contentType;
+            if (fn.endsWith(QLatin1String(".js"))) {
+                contentType = "application/javascript;charset=utf-8";
+            }
+            if (fn.endsWith(QLatin1String(".css"))) {
+                contentType = "text/css;charset=utf-8";
+            }
+            asset = new Asset { fi.lastModified(), WebServer::StaticResponse(contentType, f.readAll()) };
+            WebServer::StaticResponse response = asset->response;
+            if (!assets.insert(fn, asset, qMax(1, response.data.size()))) { // too big to be cached. already deleted
+                WebServer::sendStatic(req, res, response);
                 return true;
             }
         }
-        return false;
+        WebServer::sendStatic(req, res, asset->response);
+        return true;
     };
 
+    // Icons are requested for every line showing them. The response of an
+    // icon is kept with its etag, so the view revalidates and gets a 304
+    // while the iconset still has the same data.
     WebServer::Handler iconsHandler = [&](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
         QString    name = req->url().path().mid(sizeof("/psi/icon"));
         QByteArray ba   = IconsetFactory::raw(name);
+        if (ba.isEmpty())
+            return false;
 
-        if (!ba.isEmpty()) {
-            res->setStatusCode(qhttp::ESTATUS_OK);
-            res->end(ba);
-            return true;
+        static QCache<QString, WebServer::StaticResponse> icons(2 * 1024 * 1024);
+
+        WebServer::StaticResponse *response = icons.object(name);
+        if (!response || response->data.constData() != ba.constData()) { // shared data unless the icon changed
+            response               = new WebServer::StaticResponse(image2type(ba).toLatin1(), ba);
+            response->cacheControl = "no-cache";
+            WebServer::StaticResponse copy = *response;
+            if (!icons.insert(name, response, qMax(1, ba.size()))) {
+                WebServer::sendStatic(req, res, copy);
+                return true;
+            }
         }
-        return false;
+        WebServer::sendStatic(req, res, *response);
+        return true;
     };
 
+    // avatars are addressed by the hash of their data, so they never change
     WebServer::Handler avatarsHandler = [&](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
-        QString    hash = req->url().path().mid(sizeof("/psi/avatar")); // no / because of null pointer
-        QByteArray ba;
+        QString hash = req->url().path().mid(sizeof("/psi/avatar")); // no / because of null pointer
         if (hash == QLatin1String("default.png")) {
-            QPixmap p;
-            QBuffer buffer(&ba);
-            buffer.open(QIODevice::WriteOnly);
-            p = IconsetFactory::icon("psi/default_avatar").pixmap();
-            if (p.save(&buffer, "PNG")) {
-                res->setStatusCode(qhttp::ESTATUS_OK);
-                res->headers().insert("Content-Type", "image/png");
-                res->end(ba);
-                return true;
+            // shown for everybody without an avatar, encoded again only when the iconset changes
+            static qint64                    defaultKey = 0;
+            static WebServer::StaticResponse defaultAvatar;
+
+            QPixmap p = IconsetFactory::icon("psi/default_avatar").pixmap();
+            if (p.cacheKey() != defaultKey) {
+                QByteArray ba;
+                QBuffer    buffer(&ba);
+                buffer.open(QIODevice::WriteOnly);
+                if (!p.save(&buffer, "PNG"))
+                    return false;
+                defaultKey                 = p.cacheKey();
+                defaultAvatar              = WebServer::StaticResponse("image/png", ba);
+                defaultAvatar.cacheControl = "no-cache";
             }
+            WebServer::sendStatic(req, res, defaultAvatar);
+            return true;
         } else {
             AvatarFactory::AvatarData ad = AvatarFactory::avatarDataByHash(QByteArray::fromHex(hash.toLatin1()));
             if (!ad.data.isEmpty()) {
-                res->setStatusCode(qhttp::ESTATUS_OK);
-                res->headers().insert("Content-Type", ad.metaType.toLatin1());
-                res->end(ad.data);
+                WebServer::StaticResponse response;
+                response.contentType  = ad.metaType.toLatin1();
+                response.data         = ad.data;
+                response.etag         = '"' + hash.toLatin1() + '"';
+                response.cacheControl = "max-age=31536000, immutable";
+                WebServer::sendStatic(req, res, response);
                 return true;
             }
         }
@@ -213,25 +254,9 @@ ChatViewCon::ChatViewCon(PsiCon *pc) :
         return false;
     };
 
-    WebServer::Handler qwebchannelHandler = [&](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
-        if (req->method() != qhttp::EHTTP_GET)
-            return false;
-        QFile qwcjs(":/qtwebchannel/qwebchannel.js");
-        if (qwcjs.open(QIODevice::ReadOnly)) {
-            res->setStatusCode(qhttp::ESTATUS_OK);
-            res->headers().insert("Content-Type", "application/javascript;charset=utf-8");
-            res->end(qwcjs.readAll());
-        } else {
-            res->setStatusCode(qhttp::ESTATUS_NOT_FOUND);
-        }
-        return true;
-    };
-
     WebServer::Handler faviconHandler = [&](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
-        if (req->method() != qhttp::EHTTP_GET)
-            return false;
-        res->setStatusCode(qhttp::ESTATUS_OK);
-        res->end(IconsetFactory::icon(QLatin1String("psi/logo_16")).raw());
+        static WebServer::StaticResponse favicon(QByteArray(), IconsetFactory::icon(QLatin1String("psi/logo_16")).raw());
+        WebServer::sendStatic(req, res, favicon);
         return true;
     };
 
@@ -289,8 +314,11 @@ ChatViewCon::ChatViewCon(PsiCon *pc) :
     ws->route("/psi/themes/", themesDirHandler);
     ws->route("/psi/icon/", iconsHandler);
     ws->route("/psi/avatar/", avatarsHandler);
-    ws->route("/psi/static/qwebchannel.js", qwebchannelHandler);
-    ws->route("/favicon.ico", faviconHandler);
+    QFile qwcjs(":/qtwebchannel/qwebchannel.js");
+    if (qwcjs.open(QIODevice::ReadOnly))
+        ws->routeStatic("/psi/static/qwebchannel.js",
+                        WebServer::StaticResponse("application/javascript;charset=utf-8", qwcjs.readAll()));
+    ws->route("/favicon.ico", faviconHandler, WebServer::Methods() << qhttp::EHTTP_GET << qhttp::EHTTP_HEAD);
 
     requestInterceptor = new ChatViewUrlRequestInterceptor(this);
     QWebEngineProfile::defaultProfile()->setRequestInterceptor(requestInterceptor);
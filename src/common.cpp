@@ -29,6 +29,7 @@
 #include "psiiconset.h"
 #include "psioptions.h"
 #include "rtparse.h"
+#include "soundengine.h"
 #include "tabdlg.h"
 #ifdef HAVE_X11
 #    include "x11windowsystem.h"
@@ -299,9 +300,15 @@ void soundPlay(const QString &s)
     }
 
 #if defined(Q_OS_WIN) || defined(Q_OS_MAC)
-    QSound::play(str);
+    if (!SoundEngine::instance()->play(str)) {
+        QSound::play(str);
+    }
 #else
     QString player = PsiOptions::instance()->getOption("options.ui.notifications.sounds.unix-sound-player").toString();
+    // an explicitly configured player always wins
+    if (player.isEmpty() && SoundEngine::instance()->play(str)) {
+        return;
+    }
     if (player == "") player = soundDetectPlayer();
     QStringList args = player.split(' ');
     args += str;
@@ -158,6 +158,7 @@ Qt::ItemFlags ContactListDragModel::flags(const QModelIndex& index) const
 QStringList ContactListDragModel::mimeTypes() const
 {
     return QStringList()
+           << ContactListModelSelection::binaryMimeType()
            << ContactListModelSelection::mimeType()
            << "text/plain";
 }
@@ -27,9 +27,12 @@
 #include "psicontact.h"
 #include "userlist.h"
 
+#include <QCollator>
 #include <QCoreApplication>
 #include <QTextDocument>
 
+static quint64 lastVersion = 0;
+
 ContactListItem::ContactListItem(ContactListModel *model, Type type, SpecialGroupType specialGropType)
     : AbstractTreeItem()
     , _model(model)
@@ -44,7 +47,12 @@ ContactListItem::ContactListItem(ContactListModel *model, Type type, SpecialGrou
     , _displayName()
     , _totalContacts(0)
     , _onlineContacts(0)
-    , _shouldBeVisible(type != Type::GroupType)
+    , _visibleContacts(0)
+    , _counted(false)
+    , _countedOnline(false)
+    , _countedVisible(false)
+    , _statusRank(-1)
+    , _version(++lastVersion)
     , _hidden(false)
 {
     switch (_specialGroupType) {
@@ -80,6 +88,11 @@ ContactListItem::ContactListItem(ContactListModel *model, Type type, SpecialGrou
 
 ContactListItem::~ContactListItem()
 {
+    // children update the counters of this item, so delete them while it's still alive
+    qDeleteAll(AbstractTreeItem::children());
+    if (_counted)
+        addToGroupsCount(-1, -int(_countedOnline), -int(_countedVisible));
+
     _selfValid = false; // just for a check for already freed but still mapped memory. though does not give any guarantee
 }
 
@@ -210,17 +223,17 @@ bool ContactListItem::lessThan(const ContactListItem* other) const
             return _specialGroupType < other->_specialGroupType;
         }
         else {
-            return QString::localeAwareCompare(_displayName.toLower(), other->_displayName.toLower()) < 0;
+            return nameLessThan(other);
         }
     }
     else if (_type == Type::ContactType && other->_type == Type::ContactType) {
-        int rank = rankStatus(_contact->status().type()) - rankStatus(other->_contact->status().type());
+        int rank = statusRank() - other->statusRank();
         if (rank == 0)
-            rank = QString::localeAwareCompare(_contact->name().toLower(), other->_contact->name().toLower());
+            rank = sortKey().compare(other->sortKey());
         return rank < 0;
     }
     else if (_type == Type::AccountType && other->_type == Type::AccountType) {
-        return QString::localeAwareCompare(_account->name().toLower(), other->_account->name().toLower()) < 0;
+        return nameLessThan(other);
     }
     else if (_type == Type::ContactType && other->_type == Type::GroupType) {
         if (_contact->isSelf()) {
@@ -242,6 +255,43 @@ bool ContactListItem::lessThan(const ContactListItem* other) const
     return false;
 }
 
+bool ContactListItem::nameLessThan(const ContactListItem *other) const
+{
+    return sortKey().compare(other->sortKey()) < 0;
+}
+
+void ContactListItem::invalidateCache()
+{
+    _sortKey.reset();
+    _statusRank = -1;
+    _version = ++lastVersion;
+}
+
+quint64 ContactListItem::version() const
+{
+    return _version;
+}
+
+const QCollatorSortKey &ContactListItem::sortKey() const
+{
+    if (!_sortKey) {
+        static QCollator collator = [] {
+            QCollator c;
+            c.setCaseSensitivity(Qt::CaseInsensitive);
+            return c;
+        }();
+        _sortKey.reset(new QCollatorSortKey(collator.sortKey(name())));
+    }
+    return *_sortKey;
+}
+
+int ContactListItem::statusRank() const
+{
+    if (_statusRank < 0)
+        _statusRank = _contact ? rankStatus(_contact->status().type()) : 0;
+    return _statusRank;
+}
+
 QString ContactListItem::name() const
 {
     QString name;
@@ -267,6 +317,7 @@ void ContactListItem::setName(const QString &name)
 
     case Type::GroupType:
         _displayName = name;
+        invalidateCache();
         break;
 
     default:
@@ -326,7 +377,7 @@ PsiAccount *ContactListItem::account() const
 
 bool ContactListItem::shouldBeVisible() const
 {
-    return _shouldBeVisible;
+    return _type != Type::GroupType || _visibleContacts > 0;
 }
 
 void ContactListItem::setHidden(bool hidden)
@@ -529,17 +580,14 @@ QVariant ContactListItem::value(int role) const
             } break;
 
             case ContactListModel::DisplayGroupRole:
-                updateContactsCount();
                 res = name() + QString(" (%1/%2)").arg(_onlineContacts).arg(_totalContacts);
                 break;
 
             case ContactListModel::OnlineContactsRole:
-                updateContactsCount();
                 res = _onlineContacts;
                 break;
 
             case ContactListModel::TotalContactsRole:
-                updateContactsCount();
                 res = _totalContacts;
                 break;
 
@@ -558,38 +606,29 @@ QVariant ContactListItem::value(int role) const
     return res;
 }
 
-void ContactListItem::updateContactsCount() const
+bool ContactListItem::updateContactsCount()
 {
-    if (_type != Type::GroupType)
-        return;
-
-    _totalContacts = 0;
-    _onlineContacts = 0;
-    _shouldBeVisible = false;
+    if (_type != Type::ContactType)
+        return false;
 
-    AbstractTreeItemList children = AbstractTreeItem::children();
-    for (const auto &child: children) {
-        ContactListItem *item = static_cast<ContactListItem*>(child);
-        if (item->_type == Type::ContactType) {
-            _totalContacts++;
-            if (item->_contact->alerting()
-                || item->_contact->isAlwaysVisible()) {
+    const bool online = _contact && _contact->isOnline();
+    const bool visible = _contact && (_contact->alerting() || _contact->isAlwaysVisible());
+    if (_counted && online == _countedOnline && visible == _countedVisible)
+        return false;
 
-                _shouldBeVisible = true;
-            }
+    addToGroupsCount(_counted ? 0 : 1, int(online) - int(_countedOnline), int(visible) - int(_countedVisible));
+    _counted = true;
+    _countedOnline = online;
+    _countedVisible = visible;
+    return true;
+}
 
-            if (item->_contact->isOnline()) {
-                _onlineContacts++;
-            }
-        }
-        else if (item->_type == Type::GroupType) {
-            item->updateContactsCount();
-            if (item->shouldBeVisible()) {
-                _shouldBeVisible = true;
-            }
-            _totalContacts += item->_totalContacts;
-            _onlineContacts += item->_onlineContacts;
-        }
+void ContactListItem::addToGroupsCount(int total, int online, int visible)
+{
+    for (ContactListItem *group = parent(); group && group->isGroup(); group = group->parent()) {
+        group->_totalContacts += total;
+        group->_onlineContacts += online;
+        group->_visibleContacts += visible;
     }
 }
 
@@ -21,8 +21,10 @@
 
 #include "abstracttreeitem.h"
 
+#include <QCollatorSortKey>
 #include <QObject>
 #include <QPointer>
+#include <QScopedPointer>
 #include <QString>
 #include <QVariant>
 
@@ -84,6 +86,11 @@ public:
     bool isFixedSize() const;
 
     bool lessThan(const ContactListItem* other) const;
+    bool nameLessThan(const ContactListItem* other) const;
+    // drops the cached name and status used for sorting and bumps version()
+    void invalidateCache();
+    // changes whenever the item should be repainted. unique among all items
+    quint64 version() const;
 
     bool editing() const;
     void setEditing(bool editing);
@@ -109,7 +116,9 @@ public:
     void setValue(int role, const QVariant &value);
     QVariant value(int role) const;
 
-    void updateContactsCount() const;
+    // re-reads the state of the contact and updates the counters of parent groups.
+    // returns true if the counters changed
+    bool updateContactsCount();
 
     QList<ContactListItem*> allChildren() const;
 
@@ -128,10 +137,21 @@ private:
     bool _expanded;
     QString _internalName;
     QString _displayName;
-    mutable int _totalContacts;
-    mutable int _onlineContacts;
-    mutable bool _shouldBeVisible;
+    int _totalContacts;
+    int _onlineContacts;
+    int _visibleContacts; // alerting or always visible
+    bool _counted;
+    bool _countedOnline;
+    bool _countedVisible;
     bool _hidden;
+
+    mutable QScopedPointer<QCollatorSortKey> _sortKey;
+    mutable int _statusRank;
+    quint64 _version;
+
+    void addToGroupsCount(int total, int online, int visible);
+    const QCollatorSortKey &sortKey() const;
+    int statusRank() const;
 };
 
 Q_DECLARE_METATYPE(ContactListItem*)
@@ -30,11 +30,15 @@
 #include <QIcon>
 #include <QMessageBox>
 #include <QModelIndex>
+#include <QSet>
 #include <QTextDocument>
 #include <QVariant>
 
+#include <algorithm>
+
 #define MAX_COMMIT_DELAY 30 /* seconds */
 #define COMMIT_INTERVAL 100 /* msecs */
+#define MAX_INCREMENTAL_ADD 100 /* contacts. larger batches relayout the whole model */
 #define COLLAPSED_OPTIONS "options.contactlist.group-state.collapsed"
 #define HIDDEN_OPTIONS "options.contactlist.group-state.hidden"
 
@@ -50,6 +54,7 @@ ContactListModel::Private::Private(ContactListModel *parent)
     , contactList(nullptr)
     , commitTimer(new QTimer(this))
     , commitTimerStartTime()
+    , bulkUpdates(0)
     , monitoredContacts()
     , operationQueue()
     , collapsed()
@@ -67,7 +72,20 @@ ContactListModel::Private::~Private()
 {
 }
 
-void ContactListModel::Private::realAddContact(PsiContact *contact)
+void ContactListModel::Private::appendItem(ContactListItem *parent, ContactListItem *item, bool notify)
+{
+    if (notify) {
+        const int row = parent->childCount();
+        q->beginInsertRows(q->toModelIndex(parent), row, row);
+        parent->appendChild(item);
+        q->endInsertRows();
+    }
+    else {
+        parent->appendChild(item);
+    }
+}
+
+void ContactListModel::Private::realAddContact(PsiContact *contact, bool notify)
 {
     ContactListItem *root = static_cast<ContactListItem*>(q->root());;
     if (accountsEnabled) {
@@ -82,7 +100,7 @@ void ContactListModel::Private::realAddContact(PsiContact *contact)
             connect(account, SIGNAL(accountDestroyed()), SLOT(onAccountDestroyed()));
             connect(account, SIGNAL(updatedAccount()), SLOT(updateAccount()));
 
-            root->appendChild(accountItem);
+            appendItem(root, accountItem, notify);
         }
         root = accountItem;
     }
@@ -112,11 +130,13 @@ void ContactListModel::Private::realAddContact(PsiContact *contact)
                 if (specialGroupType == ContactListItem::SpecialGroupType::NoneSpecialGroupType)
                     groupItem->setName(groupName);
 
-                root->appendChild(groupItem);
+                appendItem(root, groupItem, notify);
                 groupItem->setExpanded(!collapsed.contains(groupItem->internalName()));
                 groupItem->setHidden(hidden.contains(groupItem->internalName()));
             }
-            groupItem->appendChild(item);
+            appendItem(groupItem, item, notify);
+            if (item->updateContactsCount() && notify)
+                q->updateItem(groupItem);
 
             monitoredContacts.insertMulti(contact, q->toModelIndex(item));
         }
@@ -124,7 +144,7 @@ void ContactListModel::Private::realAddContact(PsiContact *contact)
     else {
         ContactListItem *item = new ContactListItem(q, ContactListItem::Type::ContactType);
         item->setContact(contact);
-        root->appendChild(item);
+        appendItem(root, item, notify);
         monitoredContacts.insertMulti(contact, q->toModelIndex(item));
     }
 
@@ -142,9 +162,17 @@ void ContactListModel::Private::addContacts(const QList<PsiContact*> &contacts)
     if (contacts.isEmpty())
         return;
 
+    // a few contacts are inserted row by row, so the views keep their state
+    if (contacts.size() <= MAX_INCREMENTAL_ADD) {
+        for (auto *contact: contacts) {
+            realAddContact(contact, true);
+        }
+        return;
+    }
+
     emit q->layoutAboutToBeChanged();
     for (auto *contact: contacts) {
-        realAddContact(contact);
+        realAddContact(contact, false);
     }
     emit q->layoutChanged();
 }
@@ -156,40 +184,46 @@ void ContactListModel::Private::updateContacts(const QList<PsiContact*> &contact
     if (contacts.isEmpty())
         return;
 
-    // prepare ranges for updating to reduce 'emit dataChanged' invoking
-    QHash<QModelIndex, QPair<int, int>> ranges;
-    QModelIndexList indexes;
+    // collect the changed rows. only runs of adjacent rows are merged
+    // into one 'emit dataChanged', so the proxy doesn't resort unchanged rows
+    QHash<QModelIndex, QList<int>> rows;
+    QSet<ContactListItem*> groups;
     for (const PsiContact *contact: contacts) {
-        QModelIndexList indexes2 = q->indexesFor(contact);
-        indexes += indexes2;
-
-        for (const QModelIndex &index: indexes2) {
-            QModelIndex parent = index.parent();
-            int row = index.row();
-            if (ranges.contains(parent)) {
-                if (index.row() < ranges.value(parent).first)
-                    ranges[parent].first = row;
-                else if (index.row() > ranges.value(parent).second)
-                    ranges[parent].second = row;
-            }
-            else {
-                ranges.insert(parent, QPair<int, int>(row, row));
-            }
+        for (const QModelIndex &index: q->indexesFor(contact)) {
+            if (!index.isValid())
+                continue;
+
+            // keep the counters of the groups and the sort keys current before they are repainted
+            ContactListItem *item = q->toItem(index);
+            if (item->updateContactsCount() && item->parent()->isGroup())
+                groups << item->parent();
+            item->invalidateCache();
+
+            rows[index.parent()] << index.row();
         }
     }
 
-    QHashIterator<QModelIndex, QPair<int, int>> it(ranges);
+    QHashIterator<QModelIndex, QList<int>> it(rows);
     while (it.hasNext()) {
         it.next();
-        int row1 = it.value().first;
-        int row2 = it.value().second;
-        QModelIndex index = it.key();
-
-        // update contact
-        emit q->dataChanged(q->index(row1, 0, index), q->index(row2, 0, index));
+        const QModelIndex parent = it.key();
+        QList<int> parentRows = it.value();
+        std::sort(parentRows.begin(), parentRows.end());
+
+        // update contacts
+        int first = parentRows.first();
+        for (int i = 1; i <= parentRows.size(); ++i) {
+            if (i < parentRows.size() && parentRows[i] <= parentRows[i - 1] + 1)
+                continue;
+            emit q->dataChanged(q->index(first, 0, parent), q->index(parentRows[i - 1], 0, parent));
+            if (i < parentRows.size())
+                first = parentRows[i];
+        }
+    }
 
-        // Update group
-        emit q->dataChanged(index, index);
+    // update groups whose counters changed
+    for (ContactListItem *group: groups) {
+        q->updateItem(group);
     }
 }
 
@@ -211,10 +245,22 @@ void ContactListModel::Private::addOperation(PsiContact *contact, ContactListMod
 
     if (commitTimerStartTime.secsTo(QDateTime::currentDateTime()) > MAX_COMMIT_DELAY)
         commit();
-    else
+    else if (!bulkUpdates)
         commitTimer->start();
 }
 
+void ContactListModel::Private::beginBulkUpdate()
+{
+    ++bulkUpdates;
+    commitTimer->stop();
+}
+
+void ContactListModel::Private::endBulkUpdate()
+{
+    if (bulkUpdates > 0 && --bulkUpdates == 0)
+        commit();
+}
+
 int ContactListModel::Private::simplifiedOperationList(int operations) const
 {
     return (operations & AddContact)
@@ -256,6 +302,8 @@ void ContactListModel::Private::commit()
     if (operationQueue.isEmpty())
         return;
 
+    TRACE_COUNTER("roster operations", operationQueue.size());
+
     QHashIterator<PsiContact*, int> it(operationQueue);
 
     QList<PsiContact*> contactsForAdding;
@@ -429,6 +477,7 @@ void ContactListModel::Private::updateAccount()
         ContactListItem *root = static_cast<ContactListItem*>(q->root());;
         ContactListItem *accountItem = root->findAccount(account);
         Q_ASSERT(accountItem);
+        accountItem->invalidateCache();
         q->updateItem(accountItem);
     } else {
         cleanUpAccount(account);
@@ -462,6 +511,8 @@ ContactListModel::ContactListModel(PsiContactList* contactList)
 
     connect(contactList, SIGNAL(addedContact(PsiContact*)), d, SLOT(addContact(PsiContact*)));
     connect(contactList, SIGNAL(removedContact(PsiContact*)), d, SLOT(removeContact(PsiContact*)));
+    connect(contactList, SIGNAL(beginBulkContactUpdate()), d, SLOT(beginBulkUpdate()));
+    connect(contactList, SIGNAL(endBulkContactUpdate()), d, SLOT(endBulkUpdate()));
 
     connect(d->contactList, SIGNAL(destroying()), SLOT(destroyingContactList()));
     connect(d->contactList, SIGNAL(showOfflineChanged(bool)), SIGNAL(showOfflineChanged()));
@@ -23,7 +23,8 @@ public:
     Private(ContactListModel *parent);
     ~Private();
 
-    void realAddContact(PsiContact *contact);
+    void realAddContact(PsiContact *contact, bool notify);
+    void appendItem(ContactListItem *parent, ContactListItem *item, bool notify);
     void addContacts(const QList<PsiContact*> &contacts);
     void updateContacts(const QList<PsiContact*> &contacts);
 
@@ -40,6 +41,8 @@ public slots:
     void contactUpdated();
     void contactGroupsChanged();
     void updateAccount();
+    void beginBulkUpdate();
+    void endBulkUpdate();
 
 private slots:
     void onAccountDestroyed();
@@ -54,6 +57,7 @@ public:
     PsiContactList *contactList;
     QTimer *commitTimer;
     QDateTime commitTimerStartTime;
+    int bulkUpdates; // commits wait until the bulk update is over
     QHash<PsiContact*, QPersistentModelIndex> monitoredContacts; // always keeps all the contacts
     QHash<PsiContact*, int> operationQueue;
     QStringList collapsed;
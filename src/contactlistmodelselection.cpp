@@ -25,20 +25,19 @@
 #include "textutil.h"
 #include "xmpp_xmlcommon.h"
 
+#include <QDataStream>
 #include <QDomElement>
 #include <QStringList>
 
 static const QString psiRosterSelectionMimeType = "application/psi-roster-selection";
+// the same selection without the XML, for drags within the running client
+static const QString psiRosterSelectionBinaryMimeType = "application/x-psi-roster-selection-binary";
+static const quint8 binaryVersion = 1;
 
 ContactListModelSelection::ContactListModelSelection(QList<ContactListItem*> items)
     : QMimeData()
     , mimeData_(nullptr)
 {
-    QDomDocument doc;
-    QDomElement root = doc.createElement("items");
-    root.setAttribute("version", "2.0");
-    doc.appendChild(root);
-
     QStringList jids;
 
     for (auto *item: items) {
@@ -47,31 +46,21 @@ ContactListModelSelection::ContactListModelSelection(QList<ContactListItem*> ite
         switch (item->type()) {
         case ContactListItem::Type::ContactType: {
             PsiContact* contact = item->contact();
-            QDomElement tag = textTag(&doc, "contact", contact->jid().full());
-            tag.setAttribute("account", contact->account()->id());
-            tag.setAttribute("group", item->parent()->isGroup() ? item->parent()->internalName() : "");
-            root.appendChild(tag);
+            selection_.contacts << Contact(contact->jid().full(),
+                                           contact->account()->id(),
+                                           item->parent()->isGroup() ? item->parent()->internalName() : "");
 
             jids << contact->jid().full();
             break; }
 
         case ContactListItem::Type::GroupType: {
-            // if group->fullName() consists only of whitespace when we'll try
-            // to read it back we'll get an empty string, so we're using CDATA
-            // QDomElement tag = textTag(&doc, "group", group->fullName());
-            QDomElement tag = doc.createElement("group");
-            QDomText text = doc.createCDATASection(TextUtil::escape(item->internalName()));
-            tag.appendChild(text);
-
-            root.appendChild(tag);
+            selection_.groups << Group(item->internalName());
 
             jids << item->name();
             break; }
 
         case ContactListItem::Type::AccountType: {
-            QDomElement tag = doc.createElement("account");
-            tag.setAttribute("id", item->account()->id());
-            root.appendChild(tag);
+            selection_.accounts << Account(item->account()->id());
 
             jids << item->name();
             break; }
@@ -80,9 +69,10 @@ ContactListModelSelection::ContactListModelSelection(QList<ContactListItem*> ite
             break;
         }
     }
+    selection_.valid = true;
 
+    // the binary and XML forms are only built when someone asks for them
     setText(jids.join(", "));
-    setData(psiRosterSelectionMimeType, doc.toByteArray());
 }
 
 ContactListModelSelection::ContactListModelSelection(const QMimeData *mimeData)
@@ -92,6 +82,10 @@ ContactListModelSelection::ContactListModelSelection(const QMimeData *mimeData)
     const ContactListModelSelection* other = qobject_cast<const ContactListModelSelection*>(mimeData_);
     if (other) {
         mimeData_ = other->mimeData();
+        selection_ = other->selection_;
+    }
+    else {
+        selection_ = decode(mimeData_);
     }
 }
 
@@ -100,73 +94,135 @@ const QString &ContactListModelSelection::mimeType()
     return psiRosterSelectionMimeType;
 }
 
-QDomElement ContactListModelSelection::rootElementFor(const QMimeData* mimeData) const
+const QString &ContactListModelSelection::binaryMimeType()
 {
-    QDomDocument doc;
-    if (!doc.setContent(mimeData->data(psiRosterSelectionMimeType)))
-        return QDomElement();
+    return psiRosterSelectionBinaryMimeType;
+}
 
-    QDomElement root = doc.documentElement();
-    if (root.tagName() != "items" || root.attribute("version") != "2.0")
-        return QDomElement();
+QStringList ContactListModelSelection::formats() const
+{
+    QStringList result = QMimeData::formats();
+    if (!mimeData_ && selection_.valid)
+        result << psiRosterSelectionBinaryMimeType << psiRosterSelectionMimeType;
+    return result;
+}
 
-    return root;
+QVariant ContactListModelSelection::retrieveData(const QString& mimeType, QVariant::Type type) const
+{
+    if (!mimeData_ && selection_.valid) {
+        if (mimeType == psiRosterSelectionBinaryMimeType) {
+            if (binary_.isNull())
+                binary_ = toBinary(selection_);
+            return binary_;
+        }
+        if (mimeType == psiRosterSelectionMimeType) {
+            if (xml_.isNull())
+                xml_ = toXml(selection_);
+            return xml_;
+        }
+    }
+    return QMimeData::retrieveData(mimeType, type);
 }
 
-bool ContactListModelSelection::haveRosterSelectionIn(const QMimeData* mimeData) const
+QByteArray ContactListModelSelection::toBinary(const Selection& selection)
 {
-    return !rootElementFor(mimeData).isNull();
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << binaryVersion << quint32(selection.contacts.count());
+    for (const Contact &c: selection.contacts)
+        out << c.jid << c.account << c.group;
+    out << quint32(selection.groups.count());
+    for (const Group &g: selection.groups)
+        out << g.fullName;
+    out << quint32(selection.accounts.count());
+    for (const Account &a: selection.accounts)
+        out << a.id;
+
+    return data;
 }
 
-QList<ContactListModelSelection::Contact> ContactListModelSelection::contactsFor(const QMimeData* mimeData) const
+QByteArray ContactListModelSelection::toXml(const Selection& selection)
 {
-    QList<Contact> result;
-    QDomElement root = rootElementFor(mimeData);
-    if (root.isNull())
-        return result;
+    QDomDocument doc;
+    QDomElement root = doc.createElement("items");
+    root.setAttribute("version", "2.0");
+    doc.appendChild(root);
 
-    for (QDomNode n = root.firstChild(); !n.isNull(); n = n.nextSibling()) {
-        QDomElement e = n.toElement();
-        if (e.isNull())
-            continue;
+    for (const Contact &c: selection.contacts) {
+        QDomElement tag = textTag(&doc, "contact", c.jid);
+        tag.setAttribute("account", c.account);
+        tag.setAttribute("group", c.group);
+        root.appendChild(tag);
+    }
 
-        if (e.tagName() == "contact") {
-            Jid jid = tagContent(e);
-            result << Contact(jid.full(),
-                              e.attribute("account"),
-                              e.attribute("group"));
-        }
+    for (const Group &g: selection.groups) {
+        // if group->fullName() consists only of whitespace when we'll try
+        // to read it back we'll get an empty string, so we're using CDATA
+        // QDomElement tag = textTag(&doc, "group", group->fullName());
+        QDomElement tag = doc.createElement("group");
+        QDomText text = doc.createCDATASection(TextUtil::escape(g.fullName));
+        tag.appendChild(text);
+
+        root.appendChild(tag);
     }
 
-    return result;
+    for (const Account &a: selection.accounts) {
+        QDomElement tag = doc.createElement("account");
+        tag.setAttribute("id", a.id);
+        root.appendChild(tag);
+    }
+
+    return doc.toByteArray();
 }
 
-QList<ContactListModelSelection::Group> ContactListModelSelection::groupsFor(const QMimeData* mimeData) const
+ContactListModelSelection::Selection ContactListModelSelection::fromBinary(const QByteArray& data)
 {
-    QList<Group> result;
-    QDomElement root = rootElementFor(mimeData);
-    if (root.isNull())
-        return result;
-
-    for (QDomNode n = root.firstChild(); !n.isNull(); n = n.nextSibling()) {
-        QDomElement e = n.toElement();
-        if (e.isNull())
-            continue;
-
-        if (e.tagName() == "group") {
-            QString groupName = TextUtil::unescape(tagContent(e));
-            result << Group(groupName);
-        }
+    Selection result;
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint8 version = 0;
+    quint32 count = 0;
+    in >> version;
+    if (version != binaryVersion)
+        return Selection();
+
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString jid, account, group;
+        in >> jid >> account >> group;
+        result.contacts << Contact(jid, account, group);
+    }
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString fullName;
+        in >> fullName;
+        result.groups << Group(fullName);
+    }
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString id;
+        in >> id;
+        result.accounts << Account(id);
     }
 
+    if (in.status() != QDataStream::Ok)
+        return Selection();
+    result.valid = true;
     return result;
 }
 
-QList<ContactListModelSelection::Account> ContactListModelSelection::accountsFor(const QMimeData* mimeData) const
+ContactListModelSelection::Selection ContactListModelSelection::fromXml(const QByteArray& data)
 {
-    QList<Account> result;
-    QDomElement root = rootElementFor(mimeData);
-    if (root.isNull())
+    Selection result;
+    QDomDocument doc;
+    if (!doc.setContent(data))
+        return result;
+
+    QDomElement root = doc.documentElement();
+    if (root.tagName() != "items" || root.attribute("version") != "2.0")
         return result;
 
     for (QDomNode n = root.firstChild(); !n.isNull(); n = n.nextSibling()) {
@@ -174,14 +230,50 @@ QList<ContactListModelSelection::Account> ContactListModelSelection::accountsFor
         if (e.isNull())
             continue;
 
-        if (e.tagName() == "account") {
-            result << Account(e.attribute("id"));
+        if (e.tagName() == "contact") {
+            Jid jid = tagContent(e);
+            result.contacts << Contact(jid.full(),
+                                       e.attribute("account"),
+                                       e.attribute("group"));
+        }
+        else if (e.tagName() == "group") {
+            QString groupName = TextUtil::unescape(tagContent(e));
+            result.groups << Group(groupName);
+        }
+        else if (e.tagName() == "account") {
+            result.accounts << Account(e.attribute("id"));
         }
     }
 
+    result.valid = true;
     return result;
 }
 
+ContactListModelSelection::Selection ContactListModelSelection::decode(const QMimeData* mimeData)
+{
+    // a drag asks for the selection on every move over the view, the
+    // payload stays the same meanwhile
+    static QString lastFormat;
+    static QByteArray lastData;
+    static Selection lastSelection;
+
+    QString format;
+    if (mimeData->hasFormat(psiRosterSelectionBinaryMimeType))
+        format = psiRosterSelectionBinaryMimeType;
+    else if (mimeData->hasFormat(psiRosterSelectionMimeType))
+        format = psiRosterSelectionMimeType;
+    else
+        return Selection();
+
+    QByteArray data = mimeData->data(format);
+    if (format != lastFormat || data != lastData) {
+        lastSelection = format == psiRosterSelectionBinaryMimeType ? fromBinary(data) : fromXml(data);
+        lastFormat = format;
+        lastData = data;
+    }
+    return lastSelection;
+}
+
 const QMimeData* ContactListModelSelection::mimeData() const
 {
     return mimeData_ ? mimeData_ : this;
@@ -189,22 +281,22 @@ const QMimeData* ContactListModelSelection::mimeData() const
 
 bool ContactListModelSelection::haveRosterSelection() const
 {
-    return haveRosterSelectionIn(mimeData());
+    return selection_.valid;
 }
 
 QList<ContactListModelSelection::Contact> ContactListModelSelection::contacts() const
 {
-    return contactsFor(mimeData());
+    return selection_.contacts;
 }
 
 QList<ContactListModelSelection::Group> ContactListModelSelection::groups() const
 {
-    return groupsFor(mimeData());
+    return selection_.groups;
 }
 
 QList<ContactListModelSelection::Account> ContactListModelSelection::accounts() const
 {
-    return accountsFor(mimeData());
+    return selection_.accounts;
 }
 
 bool ContactListModelSelection::isMultiSelection() const
@@ -22,7 +22,6 @@
 #include <QMimeData>
 
 class ContactListItem;
-class QDomElement;
 
 class ContactListModelSelection : public QMimeData
 {
@@ -32,6 +31,7 @@ public:
     ContactListModelSelection(const QMimeData *mimeData);
 
     static const QString& mimeType();
+    static const QString& binaryMimeType();
 
     struct Contact {
         Contact(QString _jid, QString _account, QString _group)
@@ -68,14 +68,31 @@ public:
 
     static void debugSelection(const QMimeData* data, const QString& name);
 
+    // reimplemented
+    QStringList formats() const;
+
+protected:
+    // reimplemented
+    QVariant retrieveData(const QString& mimeType, QVariant::Type type) const;
+
 private:
+    struct Selection {
+        bool valid = false;
+        QList<Contact> contacts;
+        QList<Group> groups;
+        QList<Account> accounts;
+    };
+
     const QMimeData* mimeData_;
+    Selection selection_;
+    mutable QByteArray binary_;
+    mutable QByteArray xml_;
 
     const QMimeData* mimeData() const;
 
-    QDomElement rootElementFor(const QMimeData* mimeData) const;
-    bool haveRosterSelectionIn(const QMimeData* mimeData) const;
-    QList<Contact> contactsFor(const QMimeData* mimeData) const;
-    QList<Group> groupsFor(const QMimeData* mimeData) const;
-    QList<Account> accountsFor(const QMimeData* mimeData) const;
+    static QByteArray toBinary(const Selection& selection);
+    static QByteArray toXml(const Selection& selection);
+    static Selection fromBinary(const QByteArray& data);
+    static Selection fromXml(const QByteArray& data);
+    static Selection decode(const QMimeData* mimeData);
 };
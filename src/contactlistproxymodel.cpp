@@ -129,12 +129,7 @@ bool ContactListProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex& s
         }
 
         if (!showOffline()) {
-            return show && ((item->value(ContactListModel::OnlineContactsRole).toInt() > 0) ||
-                            item->shouldBeVisible());
-            // shouldBeVisible is updated during OnlineContactsRole.
-            // So it may have different value here (see above for dup).
-            // OnlineContactsRole counts visible contacts ans also finds always-visible ones.
-            // Kind of bug? maybe..
+            return show && item->value(ContactListModel::OnlineContactsRole).toInt() > 0;
         }
         else {
             return show;
@@ -160,17 +155,17 @@ bool ContactListProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex& s
 
 bool ContactListProxyModel::lessThan(const QModelIndex& left, const QModelIndex& right) const
 {
-    ContactListItem* item1 = qvariant_cast<ContactListItem*>(left.data(ContactListModel::ContactListItemRole));
-    ContactListItem* item2 = qvariant_cast<ContactListItem*>(right.data(ContactListModel::ContactListItemRole));
+    ContactListModel *model = qobject_cast<ContactListModel*>(sourceModel());
+    ContactListItem* item1 = model->toItem(left);
+    ContactListItem* item2 = model->toItem(right);
     if (!item1 || !item2)
         return false;
 
-    ContactListModel *model = qobject_cast<ContactListModel*>(sourceModel());
-    if (model->contactSortStyle() == "status" || !item1->isContact() || !item2->isContact()) {
+    if (!item1->isContact() || !item2->isContact() || model->contactSortStyle() == "status") {
         return item1->lessThan(item2);
     }
     else {
-        return item1->name().toLower() < item2->name().toLower();
+        return item1->nameLessThan(item2);
     }
 }
 
@@ -27,6 +27,7 @@
 #include "contactlistviewdelegate_p.h"
 #include "debug.h"
 #include "mood.h"
+#include "pixmaputil.h"
 #include "psiiconset.h"
 #include "psioptions.h"
 
@@ -36,11 +37,13 @@
 #include <QLineEdit>
 #include <QMutableSetIterator>
 #include <QPainter>
+#include <QRegion>
 #include <QSetIterator>
 #include <QSortFilterProxyModel>
 
 #define ALERT_INTERVAL 100 /* msecs */
 #define ANIM_INTERVAL 300 /* msecs */
+#define ROW_CACHE_SIZE 16384 /* KiB */
 
 #define PSI_HIDPI computeScaleFactor(contactList)
 //#define PSI_HIDPI (2) // for testing purposes
@@ -67,6 +70,16 @@ static const QString allClientsOptionPath(QStringLiteral("options.ui.contactlist
 static const QString enableGroupsOptionPath(QStringLiteral("options.ui.contactlist.enable-groups"));
 static const QString statusIconsetOptionPath(QStringLiteral("options.iconsets.status"));
 
+// icons painted on every row, resolved once
+static const IconsetFactory::Handle defaultAvatarIcon("psi/default_avatar");
+static const IconsetFactory::Handle tuneIcon("pep/tune");
+static const IconsetFactory::Handle geolocationIcon("pep/geolocation");
+static const IconsetFactory::Handle pgpIcon("psi/pgp");
+static const IconsetFactory::Handle groupOpenIcon("psi/groupOpen");
+static const IconsetFactory::Handle groupClosedIcon("psi/groupClosed");
+static const IconsetFactory::Handle cryptoYesIcon("psi/cryptoYes");
+static const IconsetFactory::Handle cryptoNoIcon("psi/cryptoNo");
+
 static const QString awayColorPath(QStringLiteral("options.ui.look.colors.contactlist.status.away"));
 static const QString dndColorPath(QStringLiteral("options.ui.look.colors.contactlist.status.do-not-disturb"));
 static const QString offlineColorPath(QStringLiteral("options.ui.look.colors.contactlist.status.offline"));
@@ -132,8 +145,8 @@ ContactListViewDelegate::Private::Private(ContactListViewDelegate *parent, Conta
     , verticalMargin_(3)
     , statusIconSize_(0)
     , avatarRadius_(0)
-    , alertTimer_(new QTimer(this))
-    , animTimer(new QTimer(this))
+    , alertTimer_(new AnimTimer(this))
+    , animTimer(new AnimTimer(this))
     , fontMetrics_(QFont())
     , statusFontMetrics_(QFont())
     , statusSingle_(false)
@@ -162,6 +175,7 @@ ContactListViewDelegate::Private::Private(ContactListViewDelegate *parent, Conta
     , _statusMessageColor(QColor())
     , _headerBackgroundColor(QColor())
     , _headerForegroundColor(QColor())
+    , rowCache(ROW_CACHE_SIZE)
 {
     alertTimer_->setInterval(ALERT_INTERVAL);
     alertTimer_->setSingleShot(false);
@@ -308,6 +322,7 @@ void ContactListViewDelegate::Private::optionChanged(const QString &option)
             updateViewport = true;
         }
         if (updateViewport) {
+            rowCache.clear();
             contactList->viewport()->update();
         }
     }
@@ -363,71 +378,41 @@ void ContactListViewDelegate::Private::colorOptionChanged(const QString &option)
         //updated = true;
         updateViewPort = true;
     }
-    if (!bulkUpdate && updateViewPort)
+    if (!bulkUpdate && updateViewPort) {
+        rowCache.clear();
         contactList->viewport()->update();
+    }
 }
 
 void ContactListViewDelegate::Private::updateAlerts()
 {
-    // Q_ASSERT(!alertingIndexes_.isEmpty());
-
     if (!contactList->isVisible())
         return; // needed?
 
-    // prepare ranges for updating to reduce 'dataChanged' invoking
-    QHash<QModelIndex, QPair<int, int>> ranges;
-
-    // Remove invalid indexes
-    QMutableSetIterator<QPersistentModelIndex> it(alertingIndexes);
-    while (it.hasNext()) {
-        QModelIndex index = it.next();
-
-        // Clean invalid indexes
-        if (!index.isValid()) {
-            it.remove();
-            continue;
-        }
-
-        QModelIndex parent = index.parent();
-        int row = index.row();
-        if (ranges.contains(parent)) {
-            if (index.row() < ranges.value(parent).first)
-                ranges[parent].first = row;
-            else if (index.row() > ranges.value(parent).second)
-                ranges[parent].second = row;
-        }
-        else {
-            ranges.insert(parent, QPair<int, int>(row, row));
-        }
-
-    }
-
-    QHashIterator<QModelIndex, QPair<int, int>> it2(ranges);
-    while (it2.hasNext()) {
-        it2.next();
-        int row1 = it2.value().first;
-        int row2 = it2.value().second;
-        QModelIndex index = it2.key();
-
-        // update contacts
-        contactList->dataChanged(contactList->model()->index(row1, 0, index), contactList->model()->index(row2, 0, index));
-    }
+    repaintRows(alertingIndexes);
 }
 
 void ContactListViewDelegate::Private::updateAnim()
 {
     animPhase = !animPhase;
 
-    // Q_ASSERT(!alertingIndexes_.isEmpty());
-
     if (!contactList->isVisible())
         return; // needed?
 
-    // prepare ranges for updating to reduce 'dataChanged' invoking
-    QHash<QModelIndex, QPair<int, int>> ranges;
+    repaintRows(animIndexes);
+}
+
+/**
+ * Drops stale indexes and repaints the rows of the others that are on screen
+ * with a single viewport update. dataChanged() would repaint the whole
+ * viewport and recheck size hints of every row in between.
+ */
+void ContactListViewDelegate::Private::repaintRows(QSet<QPersistentModelIndex> &indexes)
+{
+    const QRect visible = contactList->viewport()->rect();
+    QRegion dirty;
 
-    // Remove invalid indexes
-    QMutableSetIterator<QPersistentModelIndex> it(animIndexes);
+    QMutableSetIterator<QPersistentModelIndex> it(indexes);
     while (it.hasNext()) {
         QModelIndex index = it.next();
 
@@ -437,31 +422,17 @@ void ContactListViewDelegate::Private::updateAnim()
             continue;
         }
 
-        QModelIndex parent = index.parent();
-        int row = index.row();
-        if (ranges.contains(parent)) {
-            if (index.row() < ranges.value(parent).first)
-                ranges[parent].first = row;
-            else if (index.row() > ranges.value(parent).second)
-                ranges[parent].second = row;
+        // the row is painted together with the left margin, see drawBackground()
+        QRect rect = contactList->visualRect(index);
+        if (rect.intersects(visible)) {
+            rect.setLeft(visible.left());
+            rect.setRight(visible.right());
+            dirty += rect;
         }
-        else {
-            ranges.insert(parent, QPair<int, int>(row, row));
-        }
-
     }
 
-    QHashIterator<QModelIndex, QPair<int, int>> it2(ranges);
-    while (it2.hasNext()) {
-        it2.next();
-        int row1 = it2.value().first;
-        int row2 = it2.value().second;
-        QModelIndex index = it2.key();
-
-        // update contacts
-        contactList->dataChanged(contactList->model()->index(row1, 0, index), contactList->model()->index(row2, 0, index));
-
-    }
+    if (!dirty.isEmpty())
+        contactList->viewport()->update(dirty);
 }
 
 void ContactListViewDelegate::Private::rosterIconsSizeChanged(int size)
@@ -542,13 +513,53 @@ QPixmap ContactListViewDelegate::Private::avatarIcon(const QModelIndex &index)
                  : index.data(ContactListModel::AvatarRole).value<QPixmap>();
 
     if(av.isNull() && useDefaultAvatar_)
-        av = IconsetFactory::iconPixmap("psi/default_avatar");
+        av = defaultAvatarIcon.pixmap();
 
     return AvatarFactory::roundedAvatar(av, avatarRadius_, avSize);
 
 }
 
 void ContactListViewDelegate::Private::drawContact(QPainter* painter, const QModelIndex& index)
+{
+    // alerting and animated rows change with every frame
+    ContactListItem *item = qvariant_cast<ContactListItem*>(index.data(ContactListModel::ContactListItemRole));
+    if (index.data(ContactListModel::IsAlertingRole).toBool() || index.data(ContactListModel::IsAnimRole).toBool()) {
+        drawContactRow(painter, index);
+        return;
+    }
+
+    // the row is painted together with the left margin, see drawBackground()
+    QRect rowRect = opt.rect;
+    rowRect.setLeft(0);
+    const int dpr = contactList->devicePixelRatio();
+    const int state = opt.state & (QStyle::State_Enabled | QStyle::State_Active | QStyle::State_Selected);
+    const QRgb background = backgroundColor(opt, index).rgba();
+
+    const CachedRow *row = rowCache.object(item);
+    if (row && row->version == item->version() && row->left == opt.rect.left() && row->size == rowRect.size()
+        && row->dpr == dpr && row->state == state && row->background == background && row->direction == opt.direction)
+    {
+        painter->drawPixmap(rowRect.topLeft(), row->pixmap);
+        return;
+    }
+
+    QPixmap pixmap(rowRect.size() * dpr);
+    pixmap.setDevicePixelRatio(dpr);
+    pixmap.fill(Qt::transparent);
+    QPainter p(&pixmap);
+    p.setRenderHints(painter->renderHints());
+    p.setFont(painter->font());
+    p.setPen(painter->pen());
+    p.translate(-rowRect.topLeft());
+    drawContactRow(&p, index);
+    p.end();
+
+    painter->drawPixmap(rowRect.topLeft(), pixmap);
+    rowCache.insert(item, new CachedRow { item->version(), opt.rect.left(), rowRect.size(), dpr, state, background, opt.direction, pixmap },
+                    qMax(1, pixmap.width() * pixmap.height() * pixmap.depth() / 8 / 1024));
+}
+
+void ContactListViewDelegate::Private::drawContactRow(QPainter* painter, const QModelIndex& index)
 {
     /* We have a few possible ways to draw contact
      * 1) Avatar is hidden or on the left or on the right
@@ -632,7 +643,7 @@ void ContactListViewDelegate::Private::drawContact(QPainter* painter, const QMod
     QPixmap statusPixmap = this->statusPixmap(index);
     if(!statusPixmap.isNull()) {
         if(statusIconsOverAvatars_ && showAvatars_) {
-            statusPixmap = statusPixmap.scaled(statusIconRect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            statusPixmap = PixmapUtil::scaled(statusPixmap, statusIconRect.size());
         } else {
             if (opt.direction == Qt::RightToLeft) {
                 statusIconRect.moveRight(firstLineRect.right());
@@ -741,19 +752,19 @@ void ContactListViewDelegate::Private::drawContact(QPainter* painter, const QMod
         }
 
         if (showTuneIcons_ && index.data(ContactListModel::TuneRole).toBool()) {
-            const QPixmap &pix = IconsetFactory::iconPixmap("pep/tune");
+            const QPixmap &pix = tuneIcon.pixmap();
             rightPixs.push_back(pix);
             rightWidths.push_back(pix.width());
         }
 
         if (showGeolocIcons_ && index.data(ContactListModel::GeolocationRole).toBool()) {
-            const QPixmap &pix = IconsetFactory::iconPixmap("pep/geolocation");
+            const QPixmap &pix = geolocationIcon.pixmap();
             rightPixs.push_back(pix);
             rightWidths.push_back(pix.width());
         }
 
         if (index.data(ContactListModel::IsSecureRole).toBool()) {
-            const QPixmap &pix = IconsetFactory::iconPixmap("psi/pgp");
+            const QPixmap &pix = pgpIcon.pixmap();
             rightPixs.push_back(pix);
             rightWidths.push_back(pix.width());
         }
@@ -822,6 +833,8 @@ void ContactListViewDelegate::Private::drawContact(QPainter* painter, const QMod
 
 void ContactListViewDelegate::Private::recomputeGeometry()
 {
+    rowCache.clear();
+
     // this function recompute just some parameters. others will be computed during rendering
     // when bounding rect is known. For now main unknown parameter is available width,
     // so compute for something small like 16px.
@@ -949,7 +962,7 @@ QSize ContactListViewDelegate::Private::sizeHint(const QModelIndex &index) const
     }
     int contentHeight;
     if (role == ContactListItem::Type::GroupType) {
-        contentHeight = qMax(IconsetFactory::iconPtr("psi/groupOpen")->pixmap().height() * PSI_HIDPI,
+        contentHeight = qMax(groupOpenIcon.iconPtr()->pixmap().height() * PSI_HIDPI,
                              nickRect_.height());
     } else {
         contentHeight = qMax(showStatusIcons_? statusIconSize_ * PSI_HIDPI : 0, nickRect_.height());
@@ -987,8 +1000,8 @@ void ContactListViewDelegate::Private::drawGroup(QPainter *painter, const QModel
     }
 
     const QPixmap &pixmap = index.data(ContactListModel::ExpandedRole).toBool()
-                            ? IconsetFactory::iconPtr("psi/groupOpen")->pixmap()
-                            : IconsetFactory::iconPtr("psi/groupClosed")->pixmap();
+                            ? groupOpenIcon.iconPtr()->pixmap()
+                            : groupClosedIcon.iconPtr()->pixmap();
 
     QSize pixmapSize = pixmap.size()*PSI_HIDPI;
     QRect pixmapRect = relativeRect(opt, pixmapSize, QRect());
@@ -1046,8 +1059,8 @@ void ContactListViewDelegate::Private::drawAccount(QPainter *painter, const QMod
     drawText(painter, o, r, text);
 
     QPixmap sslPixmap = index.data(ContactListModel::UsingSSLRole).toBool()
-                        ? IconsetFactory::iconPixmap("psi/cryptoYes")
-                        : IconsetFactory::iconPixmap("psi/cryptoNo");
+                        ? cryptoYesIcon.pixmap()
+                        : cryptoNoIcon.pixmap();
 
     QSize sslPixmapSize = statusPixmap.size() * PSI_HIDPI;
     QRect sslRect = relativeRect(o, sslPixmapSize, r, 3);
@@ -1234,7 +1247,7 @@ void ContactListViewDelegate::Private::setAnimEnabled(const QModelIndex &index,
     }
     else if (!enable && animIndexes.contains(index)) {
         animIndexes.remove(index);
-        if (alertingIndexes.isEmpty()) {
+        if (animIndexes.isEmpty()) {
             animTimer->stop();
         }
     }
@@ -1,8 +1,10 @@
 #pragma once
 
+#include "animtimer.h"
 #include "contactlistview.h"
 #include "contactlistviewdelegate.h"
 
+#include <QCache>
 #include <QColor>
 #include <QFont>
 #include <QFontMetrics>
@@ -12,7 +14,8 @@
 #include <QPersistentModelIndex>
 #include <QPixmap>
 #include <QSet>
-#include <QTimer>
+
+class ContactListItem;
 
 class ContactListViewDelegate::Private : public QObject
 {
@@ -42,6 +45,7 @@ public:
     virtual QPixmap avatarIcon(const QModelIndex &index);
 
     void drawContact(QPainter *painter, const QModelIndex &index);
+    void drawContactRow(QPainter *painter, const QModelIndex &index);
     void drawGroup(QPainter *painter, const QModelIndex &index);
     void drawAccount(QPainter *painter, const QModelIndex &index);
 
@@ -56,6 +60,7 @@ public:
 
     void setAlertEnabled(const QModelIndex &index, bool enable);
     void setAnimEnabled(const QModelIndex &index, bool enable);
+    void repaintRows(QSet<QPersistentModelIndex> &indexes);
 
 public:
     static const int ContactVMargin = 2;
@@ -77,8 +82,8 @@ public:
     int statusIconSize_;
     int avatarRadius_;
 
-    QTimer *alertTimer_;
-    QTimer *animTimer;
+    AnimTimer *alertTimer_;
+    AnimTimer *animTimer;
     QFont font_, statusFont_;
     QFontMetrics fontMetrics_, statusFontMetrics_;
     bool statusSingle_;
@@ -89,6 +94,19 @@ public:
     mutable QSet<QPersistentModelIndex> alertingIndexes;
     mutable QSet<QPersistentModelIndex> animIndexes;
 
+    // rendered contact rows
+    struct CachedRow {
+        quint64 version;
+        int left;
+        QSize size;
+        int dpr;
+        int state;
+        QRgb background;
+        Qt::LayoutDirection direction;
+        QPixmap pixmap;
+    };
+    QCache<const ContactListItem*, CachedRow> rowCache;
+
     // Colors
     QColor _awayColor;
     QColor _dndColor;
@@ -1,7 +1,9 @@
-HEADERS += $$PWD/contactmanagerdlg.h \
+HEADERS += $$PWD/contactmanagerbatch.h \
+    $$PWD/contactmanagerdlg.h \
     $$PWD/contactmanagermodel.h \
     $$PWD/contactmanagerview.h
-SOURCES += $$PWD/contactmanagerdlg.cpp \
+SOURCES += $$PWD/contactmanagerbatch.cpp \
+    $$PWD/contactmanagerdlg.cpp \
     $$PWD/contactmanagermodel.cpp \
     $$PWD/contactmanagerview.cpp
 FORMS += $$PWD/contactmanagerdlg.ui
@@ -0,0 +1,211 @@
+/*
+ * contactmanagerbatch.cpp - roster changes for many contacts at once
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "contactmanagerbatch.h"
+
+#include "psiaccount.h"
+#include "stanzapacer.h"
+#include "xmpp_client.h"
+#include "xmpp_tasks.h"
+
+#include <QTimer>
+
+using namespace XMPP;
+
+// enough to hide the round trip, few enough not to get throttled
+static const int maxInFlight = 8;
+
+ContactManagerBatch::ContactManagerBatch(PsiAccount *pa, QObject *parent) :
+    QObject(parent),
+    pa_(pa)
+{
+}
+
+ContactManagerBatch::~ContactManagerBatch()
+{
+    if (running_ && pa_)
+        emit pa_->endBulkContactUpdate();
+}
+
+void ContactManagerBatch::set(const Jid &jid, const QString &name, const QStringList &groups, bool subscribe)
+{
+    Operation op;
+    op.kind      = Set;
+    op.jid       = jid;
+    op.name      = name;
+    op.groups    = groups;
+    op.subscribe = subscribe;
+    queue_ += op;
+    ++total_;
+}
+
+void ContactManagerBatch::remove(const Jid &jid, bool unregister)
+{
+    Operation op;
+    op.kind       = Remove;
+    op.jid        = jid;
+    op.unregister = unregister;
+    queue_ += op;
+    ++total_;
+}
+
+void ContactManagerBatch::move(const Jid &from, const Jid &to, const QString &name, const QStringList &groups)
+{
+    Operation op;
+    op.kind   = MoveAdd;
+    op.jid    = to;
+    op.from   = from;
+    op.name   = name;
+    op.groups = groups;
+    queue_ += op;
+    ++total_;
+}
+
+void ContactManagerBatch::start()
+{
+    if (running_ || !pa_)
+        return;
+    running_ = true;
+    // the roster pushes of the whole batch make one contact list update
+    emit pa_->beginBulkContactUpdate();
+    emit progress(done_, total_);
+    clock_.start();
+    sendNext();
+}
+
+void ContactManagerBatch::sendNext()
+{
+    if (!pa_ || !pa_->isAvailable()) {
+        // nothing of what's left is going to be sent
+        for (const Operation &op : queue_) {
+            const bool moved = op.kind == MoveRemove || op.kind == Undo;
+            failures_ += Failure { op.kind == Set || op.kind == Remove ? op.jid : op.from, tr("Not connected"),
+                                   moved ? Duplicated : Unchanged };
+        }
+        queue_.clear();
+    }
+
+    while (!queue_.isEmpty() && inFlight_.size() < maxInFlight) {
+        if (rateLimit_ > 0) {
+            const qint64 due = qint64(sent_) * 1000 / rateLimit_; // msecs after the start
+            const qint64 now = clock_.elapsed();
+            if (due > now) {
+                if (!paced_) {
+                    paced_ = true;
+                    QTimer::singleShot(int(due - now), this, [this]() {
+                        paced_ = false;
+                        sendNext();
+                    });
+                }
+                return;
+            }
+        }
+        if (!pa_->stanzaPacer()->admit(StanzaPacer::Bulk, this, [this]() { sendNext(); }))
+            return;
+        send(queue_.takeFirst());
+        ++sent_;
+    }
+
+    if (queue_.isEmpty() && inFlight_.isEmpty())
+        finish();
+}
+
+void ContactManagerBatch::send(const Operation &op)
+{
+    Task *parent = pa_->client()->rootTask();
+
+    if (op.kind == Remove && op.unregister) {
+        JT_UnRegister *ju = new JT_UnRegister(parent);
+        ju->unreg(op.jid);
+        ju->go(true);
+    }
+
+    JT_Roster *r = new JT_Roster(parent);
+    switch (op.kind) {
+    case Set:
+    case MoveAdd:
+        r->set(op.jid, op.name, op.groups);
+        break;
+    case Remove:
+    case Undo:
+        r->remove(op.jid);
+        break;
+    case MoveRemove:
+        r->remove(op.from);
+        break;
+    }
+    inFlight_.insert(r, op);
+    connect(r, &Task::finished, this, [this, r]() { taskFinished(r); });
+    r->go(true);
+}
+
+void ContactManagerBatch::taskFinished(Task *task)
+{
+    const Operation op = inFlight_.take(task);
+    const bool      ok = task->success();
+
+    switch (op.kind) {
+    case MoveAdd:
+        if (ok) {
+            // the new contact is there, the old one goes next
+            Operation next = op;
+            next.kind      = MoveRemove;
+            queue_.prepend(next);
+        } else {
+            failures_ += Failure { op.from, task->statusString(), Unchanged };
+            ++done_;
+        }
+        break;
+    case MoveRemove:
+        if (ok) {
+            ++done_;
+        } else {
+            Operation undo = op;
+            undo.kind      = Undo;
+            undo.error     = task->statusString();
+            queue_.prepend(undo);
+        }
+        break;
+    case Undo:
+        failures_ += Failure { op.from, op.error, ok ? RolledBack : Duplicated };
+        ++done_;
+        break;
+    case Set:
+    case Remove:
+        if (!ok)
+            failures_ += Failure { op.jid, task->statusString(), Unchanged };
+        else if (op.subscribe && pa_)
+            pa_->dj_authReq(op.jid);
+        ++done_;
+        break;
+    }
+
+    emit progress(done_, total_);
+    sendNext();
+}
+
+void ContactManagerBatch::finish()
+{
+    if (!running_)
+        return;
+    running_ = false;
+    if (pa_)
+        emit pa_->endBulkContactUpdate();
+    emit finished();
+}
@@ -0,0 +1,114 @@
+/*
+ * contactmanagerbatch.h - roster changes for many contacts at once
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONTACTMANAGERBATCH_H
+#define CONTACTMANAGERBATCH_H
+
+#include "xmpp_jid.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+
+class PsiAccount;
+
+namespace XMPP {
+    class Task;
+}
+
+/**
+ * Sends queued roster changes with a few requests in flight at a time, and
+ * no more than the rate limit per second when one is set or the outgoing
+ * budget of the account allows, and keeps the contact list from redrawing
+ * on every roster push meanwhile.
+ * Moving a contact to another jid is undone when the old one can't be
+ * removed, failures are collected for reporting at the end.
+ */
+class ContactManagerBatch : public QObject
+{
+    Q_OBJECT
+public:
+    enum Outcome {
+        Unchanged,  // the contact is as it was
+        RolledBack, // the new contact of a move was removed again
+        Duplicated  // both the old and the new contact of a move are in the roster
+    };
+
+    struct Failure {
+        XMPP::Jid jid;
+        QString   error;
+        Outcome   outcome;
+    };
+
+    ContactManagerBatch(PsiAccount *pa, QObject *parent = nullptr);
+    ~ContactManagerBatch();
+
+    // subscribe asks for the presence of the contact once it is in the roster
+    void set(const XMPP::Jid &jid, const QString &name, const QStringList &groups, bool subscribe = false);
+    void remove(const XMPP::Jid &jid, bool unregister = false);
+    void move(const XMPP::Jid &from, const XMPP::Jid &to, const QString &name, const QStringList &groups);
+
+    void setRateLimit(int perSecond) { rateLimit_ = perSecond; }
+    void start();
+    bool isRunning() const { return running_; }
+
+    int                   done() const { return done_; }
+    int                   total() const { return total_; }
+    const QList<Failure> &failures() const { return failures_; }
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private:
+    enum Kind { Set, Remove, MoveAdd, MoveRemove, Undo };
+
+    struct Operation {
+        Kind        kind;
+        XMPP::Jid   jid;
+        XMPP::Jid   from; // for moves
+        QString     name;
+        QStringList groups;
+        bool        unregister = false;
+        bool        subscribe  = false;
+        QString     error; // of the step being undone
+    };
+
+    void sendNext();
+    void send(const Operation &op);
+    void taskFinished(XMPP::Task *task);
+    void finish();
+
+    QPointer<PsiAccount>            pa_;
+    QList<Operation>                queue_;
+    QHash<XMPP::Task *, Operation>  inFlight_;
+    QList<Failure>                  failures_;
+    int                             done_    = 0;
+    int                             total_   = 0;
+    bool                            running_ = false;
+    int                             rateLimit_ = 0; // requests per second, 0 for none
+    int                             sent_      = 0;
+    bool                            paced_     = false; // waiting for the rate limit
+    QElapsedTimer                   clock_;
+};
+
+#endif // CONTACTMANAGERBATCH_H
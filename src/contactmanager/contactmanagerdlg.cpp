@@ -19,6 +19,7 @@
 
 #include "contactmanagerdlg.h"
 
+#include "contactmanagerbatch.h"
 //#include "contactview.h"
 #include "xmpp_tasks.h"
 
@@ -37,7 +38,8 @@
 ContactManagerDlg::ContactManagerDlg(PsiAccount *pa) :
     QDialog(nullptr, Qt::Window),
     pa_(pa),
-    um(nullptr)
+    um(nullptr),
+    batch_(nullptr)
 {
     setAttribute(Qt::WA_DeleteOnClose, true);
     ui_.setupUi(this);
@@ -49,6 +51,7 @@ ContactManagerDlg::ContactManagerDlg(PsiAccount *pa) :
     um->reloadUsers();
     ui_.usersView->setModel(um);
     ui_.usersView->init();
+    ui_.progressBar->hide();
 
     ui_.cbAction->addItem(IconsetFactory::icon("psi/sendMessage").icon(), tr("Message"), 1);
     ui_.cbAction->addItem(IconsetFactory::icon("psi/remove").icon(), tr("Remove"), 2);
@@ -96,6 +99,9 @@ void ContactManagerDlg::doSelect()
 
 void ContactManagerDlg::executeCurrent()
 {
+    if (batch_) {
+        return;
+    }
     int                   action = ui_.cbAction->itemData(ui_.cbAction->currentIndex()).toInt();
     QList<UserListItem *> users  = um->checkedUsers();
     if (!users.count() && action != 9) {
@@ -118,19 +124,11 @@ void ContactManagerDlg::executeCurrent()
             != QMessageBox::Yes) {
             return;
         }
-        um->startBatch();
+        ContactManagerBatch *batch = new ContactManagerBatch(pa_, this);
         foreach (UserListItem *u, users) {
-            if (u->isTransport() && !Jid(pa_->client()->host()).compare(u->jid())) {
-                JT_UnRegister *ju = new JT_UnRegister(pa_->client()->rootTask());
-                ju->unreg(u->jid());
-                ju->go(true);
-            }
-            JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
-            r->remove(u->jid());
-            r->go(true);
+            batch->remove(u->jid(), u->isTransport() && !Jid(pa_->client()->host()).compare(u->jid()));
         }
-        um->clear();
-        pa_->client()->rosterRequest();
+        runBatch(batch);
     } break;
     case 3: //Auth request
         foreach (UserListItem *u, users) {
@@ -185,17 +183,13 @@ void ContactManagerDlg::changeDomain(QList<UserListItem *> &users)
 {
     QString domain = ui_.edtActionParam->text();
     if (domain.size()) {
-        um->startBatch();
-        um->clear();
+        ContactManagerBatch *batch = new ContactManagerBatch(pa_, this);
         foreach (UserListItem *u, users) {
-            JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
             if (!u->jid().node().isEmpty()) {
-                r->set(u->jid().withDomain(domain), u->name(), u->groups());
-                r->remove(u->jid());
+                batch->move(u->jid(), u->jid().withDomain(domain), u->name(), u->groups());
             }
-            r->go(true);
         }
-        pa_->client()->rosterRequest();
+        runBatch(batch);
     } else {
         QMessageBox::warning(this, tr("Invalid"), tr("Please fill parameter field with new domain name"));
     }
@@ -205,10 +199,68 @@ void ContactManagerDlg::changeGroup(QList<UserListItem *> &users)
 {
     QStringList groups(ui_.cmbActionParam->currentText());
 
+    ContactManagerBatch *batch = new ContactManagerBatch(pa_, this);
     foreach (UserListItem *u, users) {
-        JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
-        r->set(u->jid(), u->name(), groups);
-        r->go(true);
+        batch->set(u->jid(), u->name(), groups);
+    }
+    runBatch(batch);
+}
+
+void ContactManagerDlg::runBatch(ContactManagerBatch *batch)
+{
+    batch_ = batch;
+    connect(batch_, SIGNAL(progress(int, int)), SLOT(batchProgress(int, int)));
+    connect(batch_, SIGNAL(finished()), SLOT(batchFinished()));
+    ui_.btnExecute->setEnabled(false);
+    ui_.progressBar->show();
+    um->startBatch();
+    batch_->start();
+}
+
+void ContactManagerDlg::batchProgress(int done, int total)
+{
+    ui_.progressBar->setMaximum(total);
+    ui_.progressBar->setValue(done);
+}
+
+void ContactManagerDlg::batchFinished()
+{
+    QStringList failed;
+    QStringList details;
+    foreach (const ContactManagerBatch::Failure &f, batch_->failures()) {
+        failed += f.jid.full();
+        QString outcome;
+        switch (f.outcome) {
+        case ContactManagerBatch::Unchanged:
+            outcome = tr("left unchanged");
+            break;
+        case ContactManagerBatch::RolledBack:
+            outcome = tr("the new contact was removed again");
+            break;
+        case ContactManagerBatch::Duplicated:
+            outcome = tr("both the old and the new contact are in the roster");
+            break;
+        }
+        details += QString("%1: %2 (%3)").arg(f.jid.full(), f.error, outcome);
+    }
+    const int total = batch_->total();
+    batch_->deleteLater();
+    batch_ = nullptr;
+
+    ui_.progressBar->hide();
+    ui_.btnExecute->setEnabled(true);
+    um->stopBatch();
+
+    if (!failed.isEmpty()) {
+        // left checked, so the action can be retried on them
+        um->setChecked(failed);
+        QMessageBox *msg = new QMessageBox(QMessageBox::Warning, tr("Contacts Manager"),
+                                           tr("%1 of %2 contacts could not be changed.").arg(failed.count()).arg(total),
+                                           QMessageBox::Ok, this);
+        msg->setDetailedText(details.join("\n"));
+        msg->setAttribute(Qt::WA_DeleteOnClose, true);
+        msg->setModal(false);
+        msg->show();
     }
 }
 
@@ -220,7 +272,6 @@ void ContactManagerDlg::client_rosterUpdated(bool success, int statusCode, QStri
     ui_.usersView->viewport()->update();
     Q_UNUSED(statusCode);
     Q_UNUSED(statusString);
-    um->stopBatch();
 }
 
 void ContactManagerDlg::exportRoster(QList<UserListItem *> &users)
@@ -300,15 +351,12 @@ void ContactManagerDlg::importRoster()
             QMessageBox::Question, tr("Confirm contacts importing"),
             tr("Do you really want to import these contacts?"), QMessageBox::Cancel | QMessageBox::Yes);
         confirmDlg.setDetailedText(labelContent.join("\n"));
-        if (confirmDlg.exec() == QMessageBox::Yes) {
-            um->startBatch();
-            um->clear();
+        if (confirmDlg.exec() == QMessageBox::Yes && !batch_) {
+            ContactManagerBatch *batch = new ContactManagerBatch(pa_, this);
             foreach (QString jid, jids) {
-                JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
-                r->set(Jid(jid), nicks[jid], groups[jid]);
-                r->go(true);
+                batch->set(Jid(jid), nicks[jid], groups[jid]);
             }
-            pa_->client()->rosterRequest(); // через ж.., но пускай пока так.
+            runBatch(batch);
         }
         file.close();
     }
@@ -25,6 +25,7 @@
 
 #include <QDialog>
 
+class ContactManagerBatch;
 class PsiAccount;
 
 namespace Ui {
@@ -46,16 +47,20 @@ private:
     void changeGroup(QList<UserListItem *>& users);
     void exportRoster(QList<UserListItem *>& users);
     void importRoster();
+    void runBatch(ContactManagerBatch *batch);
 
     Ui::ContactManagerDlg ui_;
     PsiAccount *pa_;
     ContactManagerModel *um;
+    ContactManagerBatch *batch_;
 
 private slots:
     void doSelect();
     void executeCurrent();
     void showParamField(int index);
     void client_rosterUpdated(bool,int,QString);
+    void batchProgress(int done, int total);
+    void batchFinished();
 };
 
 #endif // CONTACTMANAGERDLG_H
@@ -47,6 +47,8 @@ ContactManagerModel::ContactManagerModel(QObject * parent, PsiAccount *pa) :
 
 void ContactManagerModel::reloadUsers()
 {
+    if (batch_)
+        return;
     beginResetModel();
     clear();
     UserList *ul = pa_->userList();
@@ -64,6 +66,24 @@ void ContactManagerModel::clear()
     checks.clear();
 }
 
+void ContactManagerModel::startBatch()
+{
+    if (batch_)
+        return;
+    batch_ = true;
+    beginResetModel();
+    clear();
+}
+
+void ContactManagerModel::stopBatch()
+{
+    if (!batch_)
+        return;
+    batch_ = false;
+    endResetModel();
+    reloadUsers();
+}
+
 int ContactManagerModel::rowCount(const QModelIndex &parent) const
 {
     if (parent.isValid()) return 0;
@@ -253,6 +273,14 @@ QList<UserListItem *> ContactManagerModel::checkedUsers()
     return users;
 }
 
+void ContactManagerModel::setChecked(const QStringList &jids)
+{
+    for (const QString &jid : jids)
+        checks.insert(jid);
+    if (!_userList.isEmpty())
+        emit dataChanged(index(0, 0), index(_userList.count() - 1, 0));
+}
+
 void ContactManagerModel::invertByMatch(int columnIndex, int matchType, const QString &str)
 {
     emit layoutAboutToBeChanged();
@@ -289,6 +317,8 @@ void ContactManagerModel::client_rosterItemUpdated(const RosterItem &item)
 
 void  ContactManagerModel::contactUpdated(const Jid &jid)
 {
+    if (batch_)
+        return;
     int i = 0;
     foreach (UserListItem *lu, _userList) {
         if (lu->jid() == jid) {
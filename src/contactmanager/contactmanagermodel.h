@@ -67,10 +67,13 @@ public:
     void clear();
     void addContact(UserListItem *u);
     QList<UserListItem *> checkedUsers();
+    void setChecked(const QStringList &jids);
     void invertByMatch(int columnIndex, int matchType, const QString &str);
 
-    void startBatch() { layoutAboutToBeChanged(); }
-    void stopBatch() { layoutChanged(); }
+    // the contacts are let go of while the roster is being changed under them
+    void startBatch();
+    void stopBatch();
+    bool inBatch() const { return batch_; }
 
 private:
     PsiAccount *pa_;
@@ -78,6 +81,7 @@ private:
     QStringList columnNames;
     QList<Role> roles;
     QSet<QString> checks;
+    bool batch_ = false;
 
     QString userFieldString(UserListItem *u, ContactManagerModel::Role columnRole) const;
     void contactUpdated(const Jid &);
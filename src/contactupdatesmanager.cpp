@@ -19,23 +19,22 @@
 
 #include "contactupdatesmanager.h"
 
+#include "idlescheduler.h"
 #include "psiaccount.h"
 #include "psicon.h"
 #include "psicontact.h"
 #include "psievent.h"
 #include "userlist.h"
 
-#include <QTimer>
+#include <QElapsedTimer>
+
+static const int updateSlice = 5; // msecs
 
 ContactUpdatesManager::ContactUpdatesManager(PsiCon* parent)
     : QObject(parent)
     , controller_(parent)
 {
     Q_ASSERT(controller_);
-    updateTimer_ = new QTimer(this);
-    updateTimer_->setSingleShot(false);
-    updateTimer_->setInterval(0);
-    connect(updateTimer_, SIGNAL(timeout()), SLOT(update()));
 }
 
 ContactUpdatesManager::~ContactUpdatesManager()
@@ -46,21 +45,21 @@ void ContactUpdatesManager::contactBlocked(PsiAccount* account, const XMPP::Jid&
 {
     Q_ASSERT(account);
     updates_ << ContactUpdateAction(ContactBlocked, account, jid);
-    updateTimer_->start();
+    scheduleUpdate();
 }
 
 void ContactUpdatesManager::contactDeauthorized(PsiAccount* account, const XMPP::Jid& jid)
 {
     Q_ASSERT(account);
     updates_ << ContactUpdateAction(ContactDeauthorized, account, jid);
-    updateTimer_->start();
+    scheduleUpdate();
 }
 
 void ContactUpdatesManager::contactAuthorized(PsiAccount* account, const XMPP::Jid& jid)
 {
     Q_ASSERT(account);
     updates_ << ContactUpdateAction(ContactAuthorized, account, jid);
-    updateTimer_->start();
+    scheduleUpdate();
 }
 
 void ContactUpdatesManager::contactRemoved(PsiAccount* account, const XMPP::Jid& jid)
@@ -119,9 +118,16 @@ void ContactUpdatesManager::removeNotInListContacts(PsiAccount* account, const X
     }
 }
 
+void ContactUpdatesManager::scheduleUpdate()
+{
+    IdleScheduler::instance()->schedule(this, "update", [this]() { update(); }, IdleScheduler::High, 500);
+}
+
 void ContactUpdatesManager::update()
 {
-    while (!updates_.isEmpty()) {
+    QElapsedTimer slice;
+    slice.start();
+    while (!updates_.isEmpty() && slice.elapsed() < updateSlice) {
         ContactUpdateAction action = updates_.takeFirst();
         if (!action.account)
             continue;
@@ -142,8 +148,6 @@ void ContactUpdatesManager::update()
         }
     }
 
-    if (updates_.isEmpty())
-        updateTimer_->stop();
-    else
-        updateTimer_->start();
+    if (!updates_.isEmpty())
+        scheduleUpdate();
 }
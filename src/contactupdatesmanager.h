@@ -27,7 +27,6 @@
 #include <QPointer>
 
 class PsiCon;
-class QTimer;
 
 class ContactUpdatesManager : public QObject
 {
@@ -44,6 +43,9 @@ public:
 private slots:
     void update();
 
+private:
+    void scheduleUpdate();
+
 private:
     PsiCon* controller_;
     enum ContactUpdateActionType {
@@ -63,7 +65,6 @@ private:
         XMPP::Jid jid;
     };
     QList<ContactUpdateAction> updates_;
-    QTimer* updateTimer_;
 
     void removeAuthRequestEventsFor(PsiAccount* account, const XMPP::Jid& jid, bool denyAuthRequests);
     void removeToastersFor(PsiAccount* account, const XMPP::Jid& jid);
@@ -2,6 +2,7 @@
 
 #include "activeprofiles.h"
 #include "common.h"
+#include "memoryaccounting.h"
 #include "psiaccount.h"
 #include "psicontactlist.h"
 
@@ -28,6 +29,8 @@ public Q_SLOTS:
     void raise();
     void sleep();
     void wake();
+    void trimCaches();
+    QString memoryReport();
 /*Q_SIGNALS:
     void psi_pong();
 */
@@ -69,6 +72,16 @@ void PsiConAdapter::wake()
     psicon->doWakeup();
 }
 
+void PsiConAdapter::trimCaches()
+{
+    emit ActiveProfiles::instance()->trimCachesRequested();
+}
+
+QString PsiConAdapter::memoryReport()
+{
+    return MemoryAccounting::report();
+}
+
 void addPsiConAdapter(PsiCon *psicon)
 {
     new PsiConAdapter(psicon);
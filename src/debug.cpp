@@ -19,27 +19,567 @@
 
 #include "debug.h"
 
+#include <QCoreApplication>
+#include <QDateTime>
 #include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
 #include <config.h>
+#include <zlib.h>
+
+#define TRACE_BUFFER_SIZE 16384 /* events per thread. power of two */
+#define LOG_FILE_SIZE     (8 * 1024 * 1024) /* bytes before a log file is rotated */
+#define LOG_FILES         5                 /* rotated files kept */
+#define LOG_QUEUE_SIZE    100000            /* lines waiting at most, later ones are dropped */
+#define LOG_WAKE_LINES    1024              /* lines that wake the writer before its interval */
+
+static QString relativePath(const QString &path)
+{
+    const int stripSz = int(sizeof(__FILE__) - sizeof("src/debug.cpp"));
+    return path.size() > stripSz ? path.mid(stripSz) : path;
+}
 
 SlowTimer::SlowTimer(const QString &path, int line, int maxTime, const QString &message)
     : _path(QDir::fromNativeSeparators(path))
     , _line(line)
     , _message(message)
     , _maxTime(maxTime)
+    , _watched(StallMonitor::isRunning() && QThread::currentThread() == qApp->thread())
 {
+    if (_watched)
+        StallMonitor::enterScope(QString("%1:%2 %3").arg(relativePath(_path)).arg(_line).arg(_message).trimmed());
     _timer.start();
 }
 
 SlowTimer::~SlowTimer ()
 {
+    if (_watched)
+        StallMonitor::leaveScope();
     int t = int(_timer.elapsed());
     if (t >= _maxTime) {
-        const int stripSz = int(sizeof(__FILE__) - sizeof("src/debug.cpp"));
-        QString relPath = _path.size() > stripSz ? _path.mid(stripSz) : _path;
+        QString relPath = relativePath(_path);
         if (_message.isEmpty())
             WARNING() << "[slow]" << QString("%1:%2 %3 milliseconds").arg(relPath).arg(_line).arg(t);
         else
             WARNING() << "[slow]" << QString("%1:%2 %3 %4 milliseconds").arg(relPath).arg(_line).arg(_message).arg(t);
     }
 }
+
+//----------------------------------------------------------------------------
+// Trace
+//----------------------------------------------------------------------------
+
+namespace {
+
+struct TraceEvent
+{
+    const char *name;
+    qint64 timestamp; // microseconds
+    qint64 value;
+    char phase;
+};
+
+// written only by its thread. save() reads the recorded part
+struct TraceBuffer
+{
+    int tid;
+    QString threadName;
+    QAtomicInteger<quint32> head;
+    TraceEvent events[TRACE_BUFFER_SIZE];
+};
+
+QMutex traceMutex;
+QList<TraceBuffer*> traceBuffers; // never freed, thread ids may be reused
+QElapsedTimer traceClock;
+thread_local TraceBuffer *traceBuffer = nullptr;
+
+TraceBuffer *currentTraceBuffer()
+{
+    if (!traceBuffer) {
+        QMutexLocker locker(&traceMutex);
+        traceBuffer = new TraceBuffer;
+        traceBuffer->tid = traceBuffers.size() + 1;
+        QThread *thread = QThread::currentThread();
+        traceBuffer->threadName = thread->objectName().isEmpty()
+                                  ? QString("thread %1").arg(traceBuffer->tid)
+                                  : thread->objectName();
+        traceBuffer->head.storeRelease(0);
+        traceBuffers << traceBuffer;
+    }
+    return traceBuffer;
+}
+
+void addTraceEvent(char phase, const char *name, qint64 value)
+{
+    TraceBuffer *buffer = currentTraceBuffer();
+    const quint32 head = buffer->head.loadAcquire();
+    TraceEvent &e = buffer->events[head & (TRACE_BUFFER_SIZE - 1)];
+    e.name = name;
+    e.timestamp = traceClock.nsecsElapsed() / 1000;
+    e.value = value;
+    e.phase = phase;
+    buffer->head.storeRelease(head + 1);
+}
+
+}
+
+QAtomicInt Trace::_enabled;
+
+void Trace::setEnabled(bool enabled)
+{
+    QMutexLocker locker(&traceMutex);
+    if (enabled && !traceClock.isValid())
+        traceClock.start();
+    _enabled.storeRelease(enabled ? 1 : 0);
+}
+
+void Trace::begin(const char *name)
+{
+    addTraceEvent('B', name, 0);
+}
+
+void Trace::end(const char *name)
+{
+    addTraceEvent('E', name, 0);
+}
+
+void Trace::counter(const char *name, qint64 value)
+{
+    addTraceEvent('C', name, value);
+}
+
+/**
+ * Saves the recorded events to \a fileName. Events recorded by other threads
+ * while saving may be partially written, so better save when idle.
+ */
+bool Trace::save(const QString &fileName)
+{
+    QJsonArray events;
+    {
+        QMutexLocker locker(&traceMutex);
+        for (const TraceBuffer *buffer: traceBuffers) {
+            QJsonObject meta;
+            meta.insert("name", "thread_name");
+            meta.insert("ph", "M");
+            meta.insert("pid", 1);
+            meta.insert("tid", buffer->tid);
+            meta.insert("args", QJsonObject { { "name", buffer->threadName } });
+            events.append(meta);
+
+            const quint32 head = buffer->head.loadAcquire();
+            const quint32 count = qMin(head, quint32(TRACE_BUFFER_SIZE));
+            for (quint32 i = head - count; i != head; ++i) {
+                const TraceEvent &e = buffer->events[i & (TRACE_BUFFER_SIZE - 1)];
+                QJsonObject event;
+                event.insert("name", QString::fromUtf8(e.name));
+                event.insert("ph", QString(QLatin1Char(e.phase)));
+                event.insert("ts", double(e.timestamp));
+                event.insert("pid", 1);
+                event.insert("tid", buffer->tid);
+                if (e.phase == 'C')
+                    event.insert("args", QJsonObject { { "value", double(e.value) } });
+                events.append(event);
+            }
+        }
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        WARNING() << "[trace]" << "can't write" << fileName << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(QJsonObject { { "traceEvents", events } }).toJson(QJsonDocument::Compact));
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// StallMonitor
+//----------------------------------------------------------------------------
+
+namespace {
+
+const int heartbeatInterval = 20; // msecs
+const int maxStalls = 100;
+const int latencyBuckets[] = { 5, 16, 33, 50, 100, 250, 500, 1000, 2000 }; // upper bounds, msecs
+const int bucketCount = int(sizeof(latencyBuckets) / sizeof(latencyBuckets[0])) + 1;
+
+struct Stall
+{
+    QDateTime when;
+    qint64 duration;
+    QStringList scopes;
+};
+
+class StallWatchdog : public QThread
+{
+protected:
+    void run() override;
+};
+
+struct StallState
+{
+    QMutex mutex; // for all but the atomics
+    QElapsedTimer clock;
+    QAtomicInteger<qint64> lastBeat;
+    QAtomicInt captured; // the watchdog has seen the current stall
+    QAtomicInt threshold;
+    QStringList scopes; // SLOW_TIMER scopes the GUI thread is in
+    QStringList stallScopes; // as the watchdog found them
+    qint64 histogram[bucketCount] = {};
+    qint64 beats = 0;
+    QList<Stall> stalls;
+    QTimer *heartbeat = nullptr;
+    StallWatchdog *watchdog = nullptr;
+};
+
+QAtomicInt stallRunning;
+StallState stall;
+
+void StallWatchdog::run()
+{
+    while (!isInterruptionRequested()) {
+        msleep(heartbeatInterval);
+        const qint64 quiet = stall.clock.elapsed() - stall.lastBeat.loadAcquire();
+        if (quiet >= stall.threshold.loadAcquire() && stall.captured.testAndSetOrdered(0, 1)) {
+            QMutexLocker locker(&stall.mutex);
+            stall.stallScopes = stall.scopes;
+        }
+    }
+}
+
+void heartbeat()
+{
+    const qint64 now = stall.clock.elapsed();
+    const qint64 late = qMax(qint64(0), now - stall.lastBeat.loadAcquire() - heartbeatInterval);
+    stall.lastBeat.storeRelease(now);
+
+    int bucket = 0;
+    while (bucket < bucketCount - 1 && late >= latencyBuckets[bucket])
+        ++bucket;
+
+    QStringList scopes;
+    {
+        QMutexLocker locker(&stall.mutex);
+        ++stall.histogram[bucket];
+        ++stall.beats;
+        if (late < stall.threshold.loadAcquire())
+            return;
+        scopes = stall.stallScopes;
+        stall.stallScopes.clear();
+        stall.captured.storeRelease(0);
+        if (stall.stalls.size() >= maxStalls)
+            stall.stalls.removeFirst();
+        stall.stalls += Stall { QDateTime::currentDateTime(), late, scopes };
+    }
+    if (scopes.isEmpty())
+        WARNING() << "[stall]" << QString("event loop blocked for %1 milliseconds").arg(late);
+    else
+        WARNING() << "[stall]" << QString("event loop blocked for %1 milliseconds in %2").arg(late).arg(scopes.join(" > "));
+}
+
+}
+
+/**
+ * Starts watching the event loop of the GUI thread, or changes the
+ * threshold if it's watched already. Stalls of at least \a threshold
+ * milliseconds are logged and kept for report(). Call from the GUI thread.
+ */
+void StallMonitor::start(int threshold)
+{
+    stall.threshold.storeRelease(qMax(threshold, heartbeatInterval));
+    if (isRunning())
+        return;
+
+    if (!stall.clock.isValid())
+        stall.clock.start();
+    stall.lastBeat.storeRelease(stall.clock.elapsed());
+    stall.captured.storeRelease(0);
+
+    stall.heartbeat = new QTimer;
+    stall.heartbeat->setTimerType(Qt::PreciseTimer);
+    stall.heartbeat->setInterval(heartbeatInterval);
+    QObject::connect(stall.heartbeat, &QTimer::timeout, heartbeat);
+    stall.heartbeat->start();
+
+    stall.watchdog = new StallWatchdog;
+    stall.watchdog->setObjectName("StallWatchdog");
+    stall.watchdog->start(QThread::LowPriority);
+    stallRunning.storeRelease(1);
+}
+
+void StallMonitor::stop()
+{
+    if (!isRunning())
+        return;
+    stallRunning.storeRelease(0);
+    stall.watchdog->requestInterruption();
+    stall.watchdog->wait();
+    delete stall.watchdog;
+    stall.watchdog = nullptr;
+    delete stall.heartbeat;
+    stall.heartbeat = nullptr;
+
+    QMutexLocker locker(&stall.mutex);
+    stall.scopes.clear();
+    stall.stallScopes.clear();
+}
+
+bool StallMonitor::isRunning()
+{
+    return stallRunning.loadAcquire() != 0;
+}
+
+/**
+ * The latency histogram and the recent stalls as plain text, for the
+ * diagnostics dialog and for attaching to bug reports.
+ */
+QString StallMonitor::report()
+{
+    QMutexLocker locker(&stall.mutex);
+    if (!stall.beats)
+        return QCoreApplication::translate("StallMonitor", "The event loop isn't monitored.");
+
+    QString text = QString("Event loop latency, %1 beats of %2 milliseconds:\n").arg(stall.beats).arg(heartbeatInterval);
+    for (int i = 0; i < bucketCount; ++i) {
+        const QString range = i < bucketCount - 1 ? QString("< %1 ms").arg(latencyBuckets[i])
+                                                  : QString(">= %1 ms").arg(latencyBuckets[i - 1]);
+        text += QString("  %1 %2 (%3%)\n")
+                    .arg(range, -10)
+                    .arg(stall.histogram[i], 10)
+                    .arg(100.0 * stall.histogram[i] / stall.beats, 0, 'f', 2);
+    }
+
+    text += QString("\nStalls of %1 milliseconds or more, the last %2 kept:\n").arg(stall.threshold.loadAcquire()).arg(maxStalls);
+    if (stall.stalls.isEmpty())
+        text += "  none\n";
+    for (const Stall &s : stall.stalls) {
+        text += QString("  %1 %2 ms").arg(s.when.toString(Qt::ISODate)).arg(s.duration, 6);
+        if (!s.scopes.isEmpty())
+            text += "  " + s.scopes.join(" > ");
+        text += "\n";
+    }
+    return text;
+}
+
+void StallMonitor::enterScope(const QString &scope)
+{
+    QMutexLocker locker(&stall.mutex);
+    stall.scopes += scope;
+}
+
+void StallMonitor::leaveScope()
+{
+    QMutexLocker locker(&stall.mutex);
+    if (!stall.scopes.isEmpty())
+        stall.scopes.removeLast();
+}
+
+//----------------------------------------------------------------------------
+// DebugLog
+//----------------------------------------------------------------------------
+
+namespace {
+
+struct LogNode
+{
+    QAtomicPointer<LogNode> next;
+    QByteArray line;
+};
+
+// any thread pushes, only the writer pops (Vyukov's intrusive MPSC queue)
+class LogQueue
+{
+public:
+    LogQueue() : tail_(new LogNode) { head_.store(tail_); }
+
+    ~LogQueue()
+    {
+        QByteArray line;
+        while (pop(&line)) { }
+        delete tail_;
+    }
+
+    void push(LogNode *node)
+    {
+        node->next.store(nullptr);
+        LogNode *prev = head_.fetchAndStoreOrdered(node);
+        prev->next.storeRelease(node);
+    }
+
+    // false when empty, or when a push is half way through
+    bool pop(QByteArray *line)
+    {
+        LogNode *next = tail_->next.loadAcquire();
+        if (!next)
+            return false;
+        delete tail_;
+        tail_ = next; // stays as the stub of the queue
+        line->swap(next->line);
+        return true;
+    }
+
+private:
+    QAtomicPointer<LogNode> head_;
+    LogNode *tail_;
+};
+
+class LogWriter : public QThread
+{
+public:
+    QString dir;
+    QAtomicInt stopping;
+    QSemaphore wake;
+
+protected:
+    void run() override;
+};
+
+// never freed, a thread may be in the message handler while it is replaced
+LogQueue *logQueue = nullptr;
+LogWriter *logWriter = nullptr;
+QtMessageHandler previousHandler = nullptr;
+QAtomicInt logPending;
+QAtomicInt logDropped;
+
+QString logFileName(const QString &dir, int n)
+{
+    return n ? QString("%1/psi-debug.%2.log.gz").arg(dir).arg(n) : dir + "/psi-debug.log";
+}
+
+bool gzipFile(const QString &from, const QString &to)
+{
+    QFile in(from);
+    if (!in.open(QIODevice::ReadOnly))
+        return false;
+    gzFile out = gzopen(QFile::encodeName(to).constData(), "wb6");
+    if (!out)
+        return false;
+    bool ok = true;
+    while (ok && !in.atEnd()) {
+        const QByteArray chunk = in.read(65536);
+        ok = gzwrite(out, chunk.constData(), unsigned(chunk.size())) == chunk.size();
+    }
+    return gzclose(out) == Z_OK && ok;
+}
+
+void LogWriter::run()
+{
+    QFile file(logFileName(dir, 0));
+    file.open(QIODevice::WriteOnly | QIODevice::Append);
+    QByteArray line;
+    QByteArray buffer;
+    for (;;) {
+        const bool last = stopping.loadAcquire() != 0;
+        while (logQueue->pop(&line)) {
+            logPending.fetchAndAddRelaxed(-1);
+            buffer += line;
+        }
+        const int dropped = logDropped.fetchAndStoreRelaxed(0);
+        if (dropped)
+            buffer += QString("[log] %1 lines dropped\n").arg(dropped).toUtf8();
+        if (!buffer.isEmpty()) {
+            file.write(buffer);
+            file.flush();
+            buffer.clear();
+        }
+
+        if (file.size() >= LOG_FILE_SIZE) {
+            file.close();
+            QFile::remove(logFileName(dir, LOG_FILES));
+            for (int i = LOG_FILES - 1; i > 0; --i)
+                QFile::rename(logFileName(dir, i), logFileName(dir, i + 1));
+            if (gzipFile(file.fileName(), logFileName(dir, 1)))
+                QFile::remove(file.fileName());
+            file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        }
+
+        if (last)
+            break;
+        wake.tryAcquire(1, 200);
+    }
+}
+
+void queueMessage(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    static const char *const levels[] = { "debug", "warning", "critical", "fatal", "info" };
+
+    if (type == QtFatalMsg) {
+        // nothing is left to write the queue after this one
+        DebugLog::stop();
+        if (previousHandler)
+            previousHandler(type, context, msg);
+        return;
+    }
+
+    if (logPending.fetchAndAddRelaxed(1) >= LOG_QUEUE_SIZE) {
+        logPending.fetchAndAddRelaxed(-1);
+        logDropped.fetchAndAddRelaxed(1);
+        return;
+    }
+    LogNode *node = new LogNode;
+    node->line = QString("%1 %2 %3\n")
+                     .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz"),
+                          QLatin1String(levels[type < 5 ? type : 0]), msg)
+                     .toUtf8();
+    logQueue->push(node);
+    if (logPending.load() == LOG_WAKE_LINES)
+        logWriter->wake.release();
+}
+
+}
+
+QAtomicInt DebugLog::_categories(DebugLog::All);
+QAtomicInt DebugLog::_running;
+
+void DebugLog::start(const QString &dir, const QString &categories)
+{
+    if (isRunning())
+        return;
+
+    static const struct { const char *name; Category category; } names[] = {
+        { "general", General }, { "edb", Edb }, { "cl", ContactList }, { "xml", Xml },
+        { "client", Client }, { "all", All }
+    };
+    int mask = 0;
+    for (const QString &c: categories.split(',', QString::SkipEmptyParts)) {
+        for (const auto &n: names) {
+            if (c.trimmed() == QLatin1String(n.name))
+                mask |= n.category;
+        }
+    }
+    _categories.store(mask ? mask : int(All));
+
+    QDir().mkpath(dir);
+    if (!logQueue)
+        logQueue = new LogQueue;
+    logWriter = new LogWriter;
+    logWriter->dir = dir;
+    logWriter->setObjectName("DebugLog");
+    logWriter->start(QThread::LowPriority);
+    previousHandler = qInstallMessageHandler(queueMessage);
+    _running.storeRelease(1);
+}
+
+/**
+ * Writes what is queued, ends the writer and gives the messages back to
+ * the previous handler.
+ */
+void DebugLog::stop()
+{
+    if (!_running.testAndSetOrdered(1, 0))
+        return;
+
+    qInstallMessageHandler(previousHandler);
+    logWriter->stopping.storeRelease(1);
+    logWriter->wake.release();
+    logWriter->wait();
+}
@@ -19,23 +19,55 @@
 
 #pragma once
 
+#include <QAtomicInt>
 #include <QDebug>
 #include <QElapsedTimer>
 
+/**
+ * Takes over qDebug() and friends once started: the message handler only
+ * puts the line on a lock-free queue, and a writer thread appends the
+ * queue to a log file, which is gzipped and rotated every few megabytes.
+ * Debug messages are kept to the started categories, warnings and worse
+ * always go through.
+ */
+class DebugLog
+{
+public:
+    enum Category { General = 0x01, Edb = 0x02, ContactList = 0x04, Xml = 0x08, Client = 0x10, All = 0xff };
+
+    // categories: comma separated names as in the macros below, or "all"
+    static void start(const QString &dir, const QString &categories);
+    static void stop();
+    static bool isRunning() { return _running.loadAcquire() != 0; }
+    static bool isEnabled(Category c) { return (_categories.load() & c) != 0; }
+
+private:
+    static QAtomicInt _categories; // everything until started
+    static QAtomicInt _running;
+};
+
+#define DEBUG_LOG_IF(c) for (bool debugLogOn = DebugLog::isEnabled(c); debugLogOn; debugLogOn = false)
+#define DEBUG_LOG_ONLY_IF(c) \
+    for (bool debugLogOn = DebugLog::isRunning() && DebugLog::isEnabled(c); debugLogOn; debugLogOn = false)
+
 // history
-#define EDB_DEBUG() qDebug().noquote() << "[edb]"
+#define EDB_DEBUG() DEBUG_LOG_IF(DebugLog::Edb) qDebug().noquote() << "[edb]"
 #define EDB_CRITICAL() qCritical().noquote() << "[edb]"
 #define EDB_WARNING() qWarning().noquote() << "[edb]"
 #define EDB_FATAL() QDebug(QtMsgType::QtFatalMsg).noquote() << "[edb]"
 
 // contact list
-#define CL_DEBUG() qDebug().noquote() << "[cl]"
+#define CL_DEBUG() DEBUG_LOG_IF(DebugLog::ContactList) qDebug().noquote() << "[cl]"
 #define CL_CRITICAL() qCritical().noquote() << "[cl]"
 #define CL_WARNING() qWarning().noquote() << "[cl]"
 #define CL_FATAL() QDebug(QtMsgType::QtFatalMsg).noquote() << "[cl]"
 
+// stanzas, only to a started log
+#define XML_DEBUG() DEBUG_LOG_ONLY_IF(DebugLog::Xml) qDebug().noquote() << "[xml]"
+#define CLIENT_DEBUG() DEBUG_LOG_ONLY_IF(DebugLog::Client) qDebug().noquote() << "[client]"
+
 // Common
-#define DEBUG() qDebug().noquote()
+#define DEBUG() DEBUG_LOG_IF(DebugLog::General) qDebug().noquote()
 #define CRITICAL() qCritical().noquote()
 #define WARNING() qWarning().noquote()
 #define FATAL() QDebug(QtMsgType::QtFatalMsg).noquote()
@@ -52,6 +84,78 @@ private:
     int _line;
     QString _message;
     int _maxTime;
+    bool _watched;
+};
+
+/*
+ * Watches the GUI thread's event loop. A timer there beats every few
+ * milliseconds and its lateness goes to a histogram. A watchdog thread
+ * notices beats that don't come and notes which SLOW_TIMER scopes the GUI
+ * thread is in at that moment; the stall is logged once the loop is back.
+ */
+class StallMonitor
+{
+public:
+    static void start(int threshold); // msecs
+    static void stop();
+    static bool isRunning();
+
+    static QString report();
+
+private:
+    friend class SlowTimer;
+    static void enterScope(const QString &scope);
+    static void leaveScope();
 };
 
-#define SLOW_TIMER(...) SlowTimer slowTimer(__FILE__, __LINE__, __VA_ARGS__)
+/*
+ * Tracing of named scopes and counters, saved in Chrome trace event format
+ * (chrome://tracing, Perfetto). Events go to a fixed size ring buffer of the
+ * current thread, so only the most recent ones are kept. Names must stay
+ * valid forever, e.g. string literals or Q_FUNC_INFO.
+ */
+class Trace
+{
+public:
+    static bool isEnabled() { return _enabled.loadAcquire() != 0; }
+    static void setEnabled(bool enabled);
+
+    static void begin(const char *name);
+    static void end(const char *name);
+    static void counter(const char *name, qint64 value);
+
+    static bool save(const QString &fileName);
+
+private:
+    static QAtomicInt _enabled;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : _name(Trace::isEnabled() ? name : nullptr)
+    {
+        if (_name)
+            Trace::begin(_name);
+    }
+
+    ~TraceScope()
+    {
+        if (_name)
+            Trace::end(_name);
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *_name;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(Q_FUNC_INFO)
+#define TRACE_COUNTER(name, value) do { if (Trace::isEnabled()) Trace::counter(name, value); } while (0)
+
+#define SLOW_TIMER(...) TRACE_FUNCTION(); SlowTimer slowTimer(__FILE__, __LINE__, __VA_ARGS__)
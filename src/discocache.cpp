@@ -0,0 +1,198 @@
+/*
+ * discocache.cpp - shared cache of service discovery results
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "discocache.h"
+
+#include "xmpp_caps.h"
+#include "xmpp_client.h"
+#include "xmpp_tasks.h"
+
+#include <QTimer>
+
+using namespace XMPP;
+
+static const int infoTtl    = 10 * 60 * 1000; // msecs
+static const int itemsTtl   = 5 * 60 * 1000;
+static const int errorTtl   = 60 * 1000; // so a missing service isn't asked for on every click
+static const int maxEntries = 2000;
+
+//----------------------------------------------------------------------------
+// DiscoCache
+//----------------------------------------------------------------------------
+
+DiscoCache::DiscoCache(Client *client, QObject *parent) : QObject(parent), client_(client)
+{
+    clock_.start();
+    connect(client->capsManager(), SIGNAL(capsChanged(const Jid &)), SLOT(capsChanged(const Jid &)));
+}
+
+Client *DiscoCache::client() const
+{
+    return client_;
+}
+
+void DiscoCache::invalidate(const Jid &jid, const QString &node)
+{
+    entries_.remove(QLatin1Char('i') + jid.full() + QLatin1Char('\n') + node);
+    entries_.remove(QLatin1Char('t') + jid.full() + QLatin1Char('\n') + node);
+}
+
+void DiscoCache::clear()
+{
+    entries_.clear();
+}
+
+void DiscoCache::capsChanged(const Jid &jid)
+{
+    const QString prefix = QLatin1Char('i') + jid.full() + QLatin1Char('\n');
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it.key().startsWith(prefix))
+            it = entries_.erase(it);
+        else
+            ++it;
+    }
+}
+
+void DiscoCache::start(DiscoQuery *query)
+{
+    const QString key = query->key();
+
+    auto entry = entries_.constFind(key);
+    if (entry != entries_.constEnd() && entry->expires > clock_.elapsed()) {
+        // tasks never finish from within go(), and neither do we
+        const Entry e = *entry;
+        QTimer::singleShot(0, query, [query, e]() { query->finish(e); });
+        return;
+    }
+
+    auto waiting = waiting_.find(key);
+    if (waiting != waiting_.end()) {
+        waiting->append(query);
+        return;
+    }
+    waiting_[key].append(query);
+
+    Task *task;
+    if (query->type() == DiscoQuery::Info) {
+        JT_DiscoInfo *jt = new JT_DiscoInfo(client_->rootTask());
+        // we're the cache here; caps derived info is wrong for some transports
+        jt->setAllowCache(false);
+        jt->get(query->jid(), query->node());
+        task = jt;
+    } else {
+        JT_DiscoItems *jt = new JT_DiscoItems(client_->rootTask());
+        jt->get(query->jid(), query->node());
+        task = jt;
+    }
+    connect(task, &Task::finished, this, [this, task, key]() { taskFinished(task, key); });
+    task->go(true);
+}
+
+void DiscoCache::taskFinished(Task *task, const QString &key)
+{
+    Entry e;
+    e.success      = task->success();
+    e.statusCode   = task->statusCode();
+    e.statusString = task->statusString();
+    if (key.startsWith(QLatin1Char('i'))) {
+        if (e.success)
+            e.item = static_cast<JT_DiscoInfo *>(task)->item();
+        e.expires = clock_.elapsed() + (e.success ? infoTtl : errorTtl);
+    } else {
+        if (e.success)
+            e.items = static_cast<JT_DiscoItems *>(task)->items();
+        e.expires = clock_.elapsed() + (e.success ? itemsTtl : errorTtl);
+    }
+
+    // losing the connection says nothing about the entity
+    if (e.success || e.statusCode != Task::ErrDisc) {
+        if (entries_.size() >= maxEntries)
+            purgeExpired();
+        entries_.insert(key, e);
+    }
+
+    const QList<QPointer<DiscoQuery>> queries = waiting_.take(key);
+    for (const QPointer<DiscoQuery> &q : queries) {
+        if (q)
+            q->finish(e);
+    }
+}
+
+void DiscoCache::purgeExpired()
+{
+    const qint64 now = clock_.elapsed();
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->expires <= now)
+            it = entries_.erase(it);
+        else
+            ++it;
+    }
+    // still full of fresh entries: start over rather than grow without bound
+    if (entries_.size() >= maxEntries)
+        entries_.clear();
+}
+
+//----------------------------------------------------------------------------
+// DiscoQuery
+//----------------------------------------------------------------------------
+
+DiscoQuery::DiscoQuery(DiscoCache *cache, Type type) : Task(cache->client()->rootTask()), cache_(cache), type_(type)
+{
+}
+
+void DiscoQuery::get(const Jid &jid, const QString &node)
+{
+    jid_  = jid;
+    node_ = node;
+}
+
+QString DiscoQuery::key() const
+{
+    return (type_ == Info ? QLatin1Char('i') : QLatin1Char('t')) + jid_.full() + QLatin1Char('\n') + node_;
+}
+
+void DiscoQuery::onGo()
+{
+    if (cache_)
+        cache_->start(this);
+    else
+        setError(ErrDisc);
+}
+
+bool DiscoQuery::take(const QDomElement &)
+{
+    // the shared request gets the answer, not us
+    return false;
+}
+
+void DiscoQuery::onDisconnect()
+{
+    // the shared request fails with ErrDisc then, and tells us
+}
+
+void DiscoQuery::finish(const DiscoCache::Entry &entry)
+{
+    if (entry.success) {
+        item_  = entry.item;
+        items_ = entry.items;
+        setSuccess();
+    } else {
+        setError(entry.statusCode, entry.statusString);
+    }
+}
@@ -0,0 +1,120 @@
+/*
+ * discocache.h - shared cache of service discovery results
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DISCOCACHE_H
+#define DISCOCACHE_H
+
+#include "xmpp_discoitem.h"
+#include "xmpp_jid.h"
+#include "xmpp_task.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+
+namespace XMPP {
+class Client;
+}
+
+class DiscoQuery;
+
+/**
+ * Per-account cache of disco#info and disco#items results. Answers are kept
+ * for a few minutes, and identical queries that are in flight at the same
+ * time share a single request to the entity. Cached info of an entity is
+ * dropped when its caps change.
+ */
+class DiscoCache : public QObject {
+    Q_OBJECT
+public:
+    DiscoCache(XMPP::Client *client, QObject *parent = nullptr);
+
+    XMPP::Client *client() const;
+
+    // makes the next query for jid/node ask the entity again
+    void invalidate(const XMPP::Jid &jid, const QString &node = QString());
+    void clear();
+
+private slots:
+    void capsChanged(const XMPP::Jid &jid);
+
+private:
+    friend class DiscoQuery;
+
+    struct Entry {
+        bool            success = false;
+        int             statusCode = 0;
+        QString         statusString;
+        XMPP::DiscoItem item;
+        XMPP::DiscoList items;
+        qint64          expires = 0;
+    };
+
+    void start(DiscoQuery *query);
+    void taskFinished(XMPP::Task *task, const QString &key);
+    void purgeExpired();
+
+    QPointer<XMPP::Client>                     client_;
+    QElapsedTimer                              clock_;
+    QHash<QString, Entry>                      entries_;
+    QHash<QString, QList<QPointer<DiscoQuery>>> waiting_; // by key of the request in flight
+};
+
+/**
+ * Used like JT_DiscoInfo and JT_DiscoItems, but answered through the
+ * DiscoCache of the account.
+ */
+class DiscoQuery : public XMPP::Task {
+    Q_OBJECT
+public:
+    enum Type { Info, Items };
+
+    DiscoQuery(DiscoCache *cache, Type type);
+
+    void get(const XMPP::Jid &jid, const QString &node = QString());
+
+    Type                   type() const { return type_; }
+    const XMPP::Jid &      jid() const { return jid_; }
+    const QString &        node() const { return node_; }
+    const XMPP::DiscoItem &item() const { return item_; }   // for Info
+    const XMPP::DiscoList &items() const { return items_; } // for Items
+
+    void onGo();
+    bool take(const QDomElement &);
+
+protected:
+    void onDisconnect();
+
+private:
+    friend class DiscoCache;
+
+    QString key() const;
+    void    finish(const DiscoCache::Entry &entry);
+
+    QPointer<DiscoCache> cache_;
+    Type                 type_;
+    XMPP::Jid            jid_;
+    QString              node_;
+    XMPP::DiscoItem      item_;
+    XMPP::DiscoList      items_;
+};
+
+#endif // DISCOCACHE_H
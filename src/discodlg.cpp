@@ -22,6 +22,7 @@
 #include "accountlabel.h"
 #include "bookmarkmanager.h"
 #include "busywidget.h"
+#include "discocache.h"
 #include "iconaction.h"
 #include "psiaccount.h"
 #include "psicon.h"
@@ -39,6 +40,7 @@
 #include <QContextMenuEvent>
 #include <QEvent>
 #include <QHeaderView>
+#include <QIcon>
 #include <QList>
 #include <QMenu>
 #include <QMessageBox>
@@ -46,9 +48,12 @@
 #include <QPushButton>
 #include <QScrollBar>
 #include <QSignalMapper>
+#include <QSortFilterProxyModel>
 #include <QToolBar>
 #include <QToolButton>
-#include <QTreeWidget>
+#include <QTreeView>
+
+#include <algorithm>
 
 //----------------------------------------------------------------------------
 
@@ -149,120 +154,44 @@ PsiIcon category2icon(PsiAccount *acc, const Jid &jid, const QString &category,
 // DiscoData -- a shared data struct
 //----------------------------------------------------------------------------
 
-class DiscoListItem;
-
-class DiscoConnector : public QObject
-{
-    Q_OBJECT
-public:
-    DiscoConnector(QObject *parent)
-    : QObject(parent) {}
-
-signals:
-    void itemUpdated(QTreeWidgetItem *);
-
-private:
-    friend class DiscoListItem;
-};
-
 struct DiscoData {
     PsiAccount *pa;
     TaskList *tasks;
-    DiscoConnector *d;
 };
 
 //----------------------------------------------------------------------------
-// DiscoListItem
+// DiscoNode -- one row of the tree. Plain data, so that services with tens
+// of thousands of items don't cost as many QObjects
 //----------------------------------------------------------------------------
 
-class DiscoListItem : public QObject, public QTreeWidgetItem
+struct DiscoNode
 {
-    Q_OBJECT
-public:
-    DiscoListItem(DiscoItem it, DiscoData *d, QTreeWidget *parent);
-    DiscoListItem(DiscoItem it, DiscoData *d, QTreeWidgetItem *parent);
-    ~DiscoListItem();
-
-    void setExpanded(bool expand);
-    const DiscoItem &item() const;
-
-    void itemSelected();
-
-public slots: // the two are used internally by class, and also called by DiscoDlg::Private::refresh()
-    void updateInfo();
-    void updateItems(bool parentAutoItems = false);
-    QString getErrorInfo() const;
-
-private slots:
-    void discoItemsFinished();
-    void discoInfoFinished();
-
-private:
-    DiscoItem di;
-    DiscoData *d;
-    bool isRoot;
-    bool alreadyItems, alreadyInfo;
-    bool autoItems; // used in updateItemsFinished
-    bool autoInfo;
+    DiscoItem item;
+    DiscoNode *parent = nullptr;
+    int row = 0; // in parent->children
+    QList<DiscoNode *> children;
+    DiscoList pending; // received items, not yet added as rows
     QString errorInfo;
+    QIcon icon; // computed when first shown
 
-    void copyItem(const DiscoItem &);
-    void updateInfo(const DiscoItem &);
-    void updateItemsFinished(const DiscoList &);
-    void autoItemsChildren() const; // automatically call disco#items for children :-)
-    QString hash() { return computeHash( item().jid().full(), item().node() ); }
-    QString computeHash( QString jid, QString node );
-
-    // helper functions
-    void init(DiscoItem it, DiscoData *dd);
+    bool alreadyItems = false, alreadyInfo = false;
+    bool autoItems = false; // used when the items arrive
+    bool autoInfo = false;
+    bool noChildren = false; // hides the child indicator
+    bool expanded = false;
 
-    void hideChildIndicator();
-
-    bool autoItemsEnabled() const;
-    bool autoInfoEnabled() const;
-    DiscoDlg *dlg() const;
+    ~DiscoNode() { qDeleteAll(children); }
 };
 
-DiscoListItem::DiscoListItem(DiscoItem it, DiscoData *_d, QTreeWidget *parent)
-: QTreeWidgetItem (parent)
+static QString computeHash( QString jid, QString node )
 {
-    isRoot = true;
-
-    init(it, _d);
-}
-
-DiscoListItem::DiscoListItem(DiscoItem it, DiscoData *_d, QTreeWidgetItem *parent)
-: QTreeWidgetItem (parent)
-{
-    isRoot = false;
-
-    init(it, _d);
-}
-
-DiscoListItem::~DiscoListItem()
-{
-}
-
-void DiscoListItem::init(DiscoItem _item, DiscoData *_d)
-{
-    d = _d;
-    di = _item;
-    copyItem(_item);
-
-    alreadyItems = alreadyInfo = false;
-
-    if ( !autoItemsEnabled() )
-        setChildIndicatorPolicy(ShowIndicator);
-
-    autoInfo = false;
-    if ( autoInfoEnabled() || isRoot ) {
-        updateInfo();
-        if ( !isRoot )
-            autoInfo = true;
-    }
+    QString ret = jid.replace( '@', "\\@" );
+    ret += "@";
+    ret += node.replace( '@', "\\@" );
+    return ret;
 }
 
-void DiscoListItem::copyItem(const DiscoItem &it)
+static void copyItem(DiscoItem &di, const DiscoItem &it)
 {
     if ( !(!di.jid().full().isEmpty() && it.jid().full().isEmpty()) )
         di.setJid ( it.jid() );
@@ -306,214 +235,368 @@ void DiscoListItem::copyItem(const DiscoItem &it)
             di.setIdentities( ids );
         }
     }
+}
 
-    setText(0, di.name().simplified());
-    setText(1, di.jid().full());
-    setText(2, di.node().simplified());
+//----------------------------------------------------------------------------
+// DiscoModel
+//----------------------------------------------------------------------------
 
-    bool iconOk = false;
-    if ( !di.identities().isEmpty() ) {
-        DiscoItem::Identity id = di.identities().first();
+/**
+ * The tree of the dialog. Items of an entity are asked for when it is
+ * expanded, and the answer is added as rows one page at a time through
+ * canFetchMore()/fetchMore(), so a huge list doesn't stall the dialog.
+ */
+class DiscoModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    DiscoModel(DiscoDlg *dlg, DiscoData *data);
+    ~DiscoModel();
 
-        if ( !id.category.isEmpty() ) {
-            QIcon icon = category2icon(d->pa, di.jid(), id.category, id.type).icon();
+    void setRoot(const Jid &jid, const QString &node);
+    DiscoNode *node(const QModelIndex &index) const;
+    QModelIndex indexOf(DiscoNode *node) const;
 
-            if ( !icon.isNull() ) {
-                setIcon(0, icon);
-                iconOk = true;
-            }
-        }
-    }
+    void updateItems(DiscoNode *node, bool parentAutoItems = false);
+    void updateInfo(DiscoNode *node);
+    void setExpanded(DiscoNode *node, bool expanded);
 
-    if ( !iconOk )
-        setIcon(0, PsiIconset::instance()->status(di.jid(), STATUS_ONLINE).icon());
+    // reimplemented
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &index) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
 
-    if ( isSelected() ) // update actions
-        emit d->d->itemUpdated( this );
-}
+signals:
+    void nodeUpdated(DiscoNode *);
+
+private slots:
+    void discoItemsFinished();
+    void discoInfoFinished();
+
+private:
+    DiscoDlg *dlg;
+    DiscoData *d;
+    DiscoNode *root = nullptr;
+    QHash<DiscoQuery *, DiscoNode *> queries;
 
-QString DiscoListItem::getErrorInfo() const
+    bool autoItemsEnabled() const;
+    bool autoInfoEnabled() const;
+    void autoItemsChildren(DiscoNode *node);
+    void nodeChanged(DiscoNode *node);
+    void removeChild(DiscoNode *node, int row);
+    void forget(DiscoNode *node);
+};
+
+static const int pageSize = 200; // rows added per fetchMore()
+
+DiscoModel::DiscoModel(DiscoDlg *_dlg, DiscoData *_d)
+: QAbstractItemModel(_dlg), dlg(_dlg), d(_d)
 {
-    return errorInfo;
 }
 
-const DiscoItem &DiscoListItem::item() const
+DiscoModel::~DiscoModel()
 {
-    return di;
+    delete root;
 }
 
-DiscoDlg *DiscoListItem::dlg() const
+void DiscoModel::setRoot(const Jid &jid, const QString &node)
 {
-    return static_cast<DiscoDlg *>(treeWidget()->parent());
+    beginResetModel();
+    queries.clear();
+    delete root;
+    root = new DiscoNode;
+    root->item.setJid( jid );
+    root->item.setNode( node );
+    copyItem(root->item, root->item);
+    endResetModel();
+
+    updateInfo(root);
 }
 
-bool DiscoListItem::autoItemsEnabled() const
+DiscoNode *DiscoModel::node(const QModelIndex &index) const
 {
-    return dlg()->ck_autoItems->isChecked();
+    return index.isValid() ? static_cast<DiscoNode *>(index.internalPointer()) : nullptr;
 }
 
-bool DiscoListItem::autoInfoEnabled() const
+QModelIndex DiscoModel::indexOf(DiscoNode *node) const
 {
-    return dlg()->ck_autoInfo->isChecked();
+    if ( !node )
+        return QModelIndex();
+    return createIndex(node->row, 0, node);
 }
 
-void DiscoListItem::setExpanded (bool expand)
+QModelIndex DiscoModel::index(int row, int column, const QModelIndex &parent) const
 {
-    if ( expand ) {
-        if ( !alreadyItems )
-            updateItems();
-        else
-            autoItemsChildren();
-    }
+    if ( row < 0 || column < 0 || column >= 3 )
+        return QModelIndex();
 
-    QTreeWidgetItem::setExpanded(expand);
+    if ( !parent.isValid() )
+        return (root && row == 0) ? createIndex(row, column, root) : QModelIndex();
+
+    DiscoNode *p = node(parent);
+    if ( parent.column() > 0 || row >= p->children.count() )
+        return QModelIndex();
+    return createIndex(row, column, p->children.at(row));
 }
 
-void DiscoListItem::itemSelected()
+QModelIndex DiscoModel::parent(const QModelIndex &index) const
 {
-    if ( !alreadyInfo )
-        updateInfo();
+    DiscoNode *n = node(index);
+    if ( !n || !n->parent )
+        return QModelIndex();
+    return indexOf(n->parent);
 }
 
-void DiscoListItem::updateItems(bool parentAutoItems)
+int DiscoModel::rowCount(const QModelIndex &parent) const
 {
-    if ( parentAutoItems ) {
-        // save traffic
-        if ( alreadyItems )
-            return;
+    if ( !parent.isValid() )
+        return root ? 1 : 0;
+    if ( parent.column() > 0 )
+        return 0;
+    return node(parent)->children.count();
+}
 
-        // FIXME: currently, JUD doesn't seem to answer to browsing requests
-        if ( item().identities().size() ) {
-            DiscoItem::Identity id = item().identities().first();
-            if ( id.category == "service" && id.type == "jud" )
-                return;
+int DiscoModel::columnCount(const QModelIndex &) const
+{
+    return 3;
+}
+
+QVariant DiscoModel::data(const QModelIndex &index, int role) const
+{
+    DiscoNode *n = node(index);
+    if ( !n )
+        return QVariant();
+
+    if ( role == Qt::DisplayRole ) {
+        switch ( index.column() ) {
+        case 0: return n->item.name().simplified();
+        case 1: return n->item.jid().full();
+        case 2: return n->item.node().simplified();
         }
-        QString j = item().jid().domain(); // just another method to discover if we're gonna to browse JUD
-        if ( item().jid().node().isEmpty() && (j.left(4) == "jud." || j.left(6) == "users.") )
-            return;
     }
+    else if ( role == Qt::DecorationRole && index.column() == 0 ) {
+        if ( n->icon.isNull() ) {
+            if ( !n->item.identities().isEmpty() ) {
+                DiscoItem::Identity id = n->item.identities().first();
+                if ( !id.category.isEmpty() )
+                    n->icon = category2icon(d->pa, n->item.jid(), id.category, id.type).icon();
+            }
+            if ( n->icon.isNull() )
+                n->icon = PsiIconset::instance()->status(n->item.jid(), STATUS_ONLINE).icon();
+        }
+        return n->icon;
+    }
+    return QVariant();
+}
 
-    autoItems = !parentAutoItems;
+QVariant DiscoModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if ( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+        return QVariant();
 
-    if ( !autoItemsEnabled() )
-        autoItems = false;
+    switch ( section ) {
+    case 0: return tr( "Name" );
+    case 1: return tr( "JID" );
+    case 2: return tr( "Node" );
+    }
+    return QVariant();
+}
 
-    JT_DiscoItems *jt = new JT_DiscoItems(d->pa->client()->rootTask());
-    connect(jt, SIGNAL(finished()), SLOT(discoItemsFinished()));
-    jt->get(di.jid(), di.node());
-    jt->go(true);
-    d->tasks->append(jt);
+bool DiscoModel::hasChildren(const QModelIndex &parent) const
+{
+    DiscoNode *n = node(parent);
+    if ( !n )
+        return root != nullptr;
+    if ( parent.column() > 0 )
+        return false;
+    if ( !n->children.isEmpty() || !n->pending.isEmpty() )
+        return true;
+    // without automatic items nobody knows until the entity is asked
+    return !n->alreadyItems && !n->noChildren && !autoItemsEnabled();
 }
 
-void DiscoListItem::discoItemsFinished()
+bool DiscoModel::canFetchMore(const QModelIndex &parent) const
 {
-    JT_DiscoItems *jt = static_cast<JT_DiscoItems *>(sender());
+    DiscoNode *n = node(parent);
+    return n && !n->pending.isEmpty();
+}
 
-    if ( jt->success() ) {
-        updateItemsFinished(jt->items());
+void DiscoModel::fetchMore(const QModelIndex &parent)
+{
+    DiscoNode *n = node(parent);
+    if ( !n || n->pending.isEmpty() )
+        return;
+
+    int count = qMin(pageSize, n->pending.count());
+    int first = n->children.count();
+    beginInsertRows(indexOf(n), first, first + count - 1);
+    for ( int i = 0; i < count; i++ ) {
+        DiscoNode *child = new DiscoNode;
+        child->parent = n;
+        child->row = n->children.count();
+        copyItem(child->item, n->pending.at(i));
+        n->children.append(child);
     }
-    else if ( !autoItems ) {
-        QString error = jt->statusString();
-        QMessageBox::critical(dlg(), tr("Error"), tr("There was an error getting items for <b>%1</b>.<br>Reason: %2").arg(di.jid().full()).arg(QString(error).replace('\n', "<br>")));
+    n->pending.erase(n->pending.begin(), n->pending.begin() + count);
+    endInsertRows();
+
+    for ( int i = first; i < first + count; i++ ) {
+        DiscoNode *child = n->children.at(i);
+        if ( autoInfoEnabled() ) {
+            child->autoInfo = true;
+            updateInfo(child);
+        }
+        if ( n->autoItems && n->expanded )
+            updateItems(child, true);
     }
-
-    alreadyItems = true;
 }
 
-QString DiscoListItem::computeHash( QString jid, QString node )
+bool DiscoModel::autoItemsEnabled() const
 {
-    QString ret = jid.replace( '@', "\\@" );
-    ret += "@";
-    ret += node.replace( '@', "\\@" );
-    return ret;
+    return dlg->ck_autoItems->isChecked();
 }
 
-void DiscoListItem::hideChildIndicator()
+bool DiscoModel::autoInfoEnabled() const
 {
-    setChildIndicatorPolicy(DontShowIndicator);
-    emitDataChanged();
+    return dlg->ck_autoInfo->isChecked();
 }
 
-void DiscoListItem::updateItemsFinished(const DiscoList &list)
+void DiscoModel::setExpanded(DiscoNode *node, bool expanded)
 {
-    treeWidget()->setUpdatesEnabled(false);
+    node->expanded = expanded;
+    if ( !expanded )
+        return;
+
+    if ( !node->alreadyItems )
+        updateItems(node);
+    else
+        autoItemsChildren(node);
+}
 
-    QHash<QString, DiscoListItem*> children;
-    DiscoListItem *child = static_cast<DiscoListItem *>(QTreeWidgetItem::child(0));
-    for ( int i = 1; child; ++i ) {
-        children.insert( child->hash(), child );
+void DiscoModel::updateItems(DiscoNode *node, bool parentAutoItems)
+{
+    if ( parentAutoItems ) {
+        // save traffic
+        if ( node->alreadyItems )
+            return;
 
-        child = static_cast<DiscoListItem *>(QTreeWidgetItem::child(i));
+        // FIXME: currently, JUD doesn't seem to answer to browsing requests
+        if ( node->item.identities().size() ) {
+            DiscoItem::Identity id = node->item.identities().first();
+            if ( id.category == "service" && id.type == "jud" )
+                return;
+        }
+        QString j = node->item.jid().domain(); // just another method to discover if we're gonna to browse JUD
+        if ( node->item.jid().node().isEmpty() && (j.left(4) == "jud." || j.left(6) == "users.") )
+            return;
     }
 
-    // add/update items
-    for(DiscoList::ConstIterator it = list.begin(); it != list.end(); ++it) {
-        const DiscoItem a = *it;
+    node->autoItems = !parentAutoItems;
+
+    if ( !autoItemsEnabled() )
+        node->autoItems = false;
+
+    DiscoQuery *jt = new DiscoQuery(d->pa->discoCache(), DiscoQuery::Items);
+    connect(jt, SIGNAL(finished()), SLOT(discoItemsFinished()));
+    jt->get(node->item.jid(), node->item.node());
+    jt->go(true);
+    queries.insert(jt, node);
+    d->tasks->append(jt);
+}
 
-        QString key = computeHash(a.jid().full(), a.node());
-        child = children[ key ];
+void DiscoModel::discoItemsFinished()
+{
+    DiscoQuery *jt = static_cast<DiscoQuery *>(sender());
+    DiscoNode *n = queries.take(jt);
+    if ( !n )
+        return; // the node is gone
 
-        if ( child ) {
-            child->copyItem ( a );
-            children.remove( key );
+    if ( jt->success() ) {
+        QHash<QString, DiscoNode *> children;
+        foreach ( DiscoNode *child, n->children )
+            children.insert(computeHash(child->item.jid().full(), child->item.node()), child);
+
+        // update the rows we have, the rest is added page by page
+        n->pending.clear();
+        foreach ( const DiscoItem &a, jt->items() ) {
+            DiscoNode *child = children.take(computeHash(a.jid().full(), a.node()));
+            if ( child ) {
+                copyItem(child->item, a);
+                nodeChanged(child);
+            }
+            else {
+                n->pending.append(a);
+            }
         }
-        else {
-            new DiscoListItem (a, d, this);
+        std::sort(n->pending.begin(), n->pending.end(), [](const DiscoItem &a, const DiscoItem &b) {
+            return a.jid().full() < b.jid().full();
+        });
+
+        // remove all items that are not on new DiscoList
+        for ( int row = n->children.count() - 1; row >= 0; row-- ) {
+            if ( children.contains(computeHash(n->children.at(row)->item.jid().full(), n->children.at(row)->item.node())) )
+                removeChild(n, row);
         }
-    }
-
-    // remove all items that are not on new DiscoList
-    qDeleteAll(children);
-    children.clear();
 
-    if ( autoItems && isExpanded() )
-        autoItemsChildren();
+        n->alreadyItems = true;
+        if ( jt->items().isEmpty() )
+            n->noChildren = true;
+        nodeChanged(n);
 
-    if (list.isEmpty()) {
-        hideChildIndicator();
+        if ( n->autoItems && n->expanded )
+            autoItemsChildren(n);
+        fetchMore(indexOf(n));
+    }
+    else {
+        n->alreadyItems = true;
+        if ( !n->autoItems ) {
+            QString error = jt->statusString();
+            QMessageBox::critical(dlg, tr("Error"), tr("There was an error getting items for <b>%1</b>.<br>Reason: %2").arg(n->item.jid().full()).arg(QString(error).replace('\n', "<br>")));
+        }
     }
-
-    // root item is initially hidden
-    if ( isRoot && isHidden() )
-        setHidden(false);
-
-    treeWidget()->setUpdatesEnabled(true);
 }
 
-void DiscoListItem::autoItemsChildren() const
+void DiscoModel::autoItemsChildren(DiscoNode *node)
 {
     if ( !autoItemsEnabled() )
         return;
 
-    DiscoListItem *child = static_cast<DiscoListItem *>(QTreeWidgetItem::child(0));
-    for ( int i = 1; child; ++i ) {
-        child->updateItems(true);
-
-        child = static_cast<DiscoListItem *>(QTreeWidgetItem::child(i));
-    }
+    foreach ( DiscoNode *child, node->children )
+        updateItems(child, true);
 }
 
-void DiscoListItem::updateInfo()
+void DiscoModel::updateInfo(DiscoNode *node)
 {
-    JT_DiscoInfo *jt = new JT_DiscoInfo(d->pa->client()->rootTask());
-    jt->setAllowCache(false); // Workaround for a bug https://github.com/hanzz/spectrum2/issues/205 (invalid caps from transport)
+    // DiscoCache doesn't take info from caps, see https://github.com/hanzz/spectrum2/issues/205 (invalid caps from transport)
+    DiscoQuery *jt = new DiscoQuery(d->pa->discoCache(), DiscoQuery::Info);
     connect(jt, SIGNAL(finished()), SLOT(discoInfoFinished()));
-    jt->get(di.jid(), di.node());
+    jt->get(node->item.jid(), node->item.node());
     jt->go(true);
+    queries.insert(jt, node);
     d->tasks->append(jt);
 }
 
-void DiscoListItem::discoInfoFinished()
+void DiscoModel::discoInfoFinished()
 {
-    JT_DiscoInfo *jt = static_cast<JT_DiscoInfo *>(sender());
+    DiscoQuery *jt = static_cast<DiscoQuery *>(sender());
+    DiscoNode *n = queries.take(jt);
+    if ( !n )
+        return;
 
     if ( jt->success() ) {
-        updateInfo( jt->item() );
+        copyItem(n->item, jt->item());
+        n->icon = QIcon();
     }
     else {
         QString error_str = jt->statusString();
         int error_code = jt->statusCode();
-        hideChildIndicator();
+        n->noChildren = true;
 
         // we change the icon for the items with disco#info returning type=="cancel" || type=="wait" error codes
         // based on XEP-0086
@@ -521,55 +604,124 @@ void DiscoListItem::discoInfoFinished()
         // FIXME: use another method for checking XMPP error-types when Iris will provide one
         if ( error_code==400 || error_code==404 || error_code==405 || error_code==409 ||
              error_code==500 || error_code==501 || error_code==503 || error_code==504 ) {
-            bool iconOk = false;
-            if ( !di.identities().isEmpty() ) {
-                DiscoItem::Identity id = di.identities().first();
-                if ( !id.category.isEmpty() ) {
-                    QIcon icon = category2icon(d->pa, di.jid(), id.category, id.type, STATUS_ERROR).icon();
-
-                    if ( !icon.isNull() ) {
-                        setIcon (0, icon);
-                        iconOk = true;
-                    }
-                }
+            n->icon = QIcon();
+            if ( !n->item.identities().isEmpty() ) {
+                DiscoItem::Identity id = n->item.identities().first();
+                if ( !id.category.isEmpty() )
+                    n->icon = category2icon(d->pa, n->item.jid(), id.category, id.type, STATUS_ERROR).icon();
             }
-            if ( !iconOk )
-                setIcon(0, PsiIconset::instance()->status(di.jid(), STATUS_ERROR).icon());
+            if ( n->icon.isNull() )
+                n->icon = PsiIconset::instance()->status(n->item.jid(), STATUS_ERROR).icon();
         }
 
-        errorInfo=QString("%1").arg(QString(error_str).replace('\n', "<br>"));
+        n->errorInfo = QString("%1").arg(QString(error_str).replace('\n', "<br>"));
 
-        if ( !autoInfo ) {
-            QMessageBox::critical(dlg(), tr("Error"), tr("There was an error getting item's info for <b>%1</b>.<br>Reason: %2").arg(di.jid().full()).arg(QString(error_str).replace('\n', "<br>")));
+        if ( !n->autoInfo ) {
+            QMessageBox::critical(dlg, tr("Error"), tr("There was an error getting item's info for <b>%1</b>.<br>Reason: %2").arg(n->item.jid().full()).arg(QString(error_str).replace('\n', "<br>")));
         }
     }
 
-    alreadyInfo = true;
-    autoInfo = false;
+    n->alreadyInfo = true;
+    n->autoInfo = false;
+    nodeChanged(n);
 }
 
-void DiscoListItem::updateInfo(const DiscoItem &item)
+void DiscoModel::nodeChanged(DiscoNode *node)
 {
-    copyItem( item );
+    QModelIndex i = indexOf(node);
+    emit dataChanged(i, i.sibling(i.row(), 2));
+    emit nodeUpdated(node);
+}
 
-    if ( isRoot && isHidden() )
-        setHidden(false);
+void DiscoModel::removeChild(DiscoNode *node, int row)
+{
+    beginRemoveRows(indexOf(node), row, row);
+    DiscoNode *child = node->children.takeAt(row);
+    forget(child);
+    delete child;
+    for ( int i = row; i < node->children.count(); i++ )
+        node->children.at(i)->row = i;
+    endRemoveRows();
 }
 
+// drops the requests whose answer would go to node or its children
+void DiscoModel::forget(DiscoNode *node)
+{
+    for ( auto it = queries.begin(); it != queries.end(); ) {
+        if ( it.value() == node )
+            it = queries.erase(it);
+        else
+            ++it;
+    }
+    foreach ( DiscoNode *child, node->children )
+        forget(child);
+}
+
+//----------------------------------------------------------------------------
+// DiscoFilterModel -- sorting, and the "Filter by JID" line
+//----------------------------------------------------------------------------
+
+class DiscoFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+public:
+    DiscoFilterModel(DiscoModel *model, QObject *parent)
+    : QSortFilterProxyModel(parent), source(model)
+    {
+        setSourceModel(model);
+    }
+
+public slots:
+    void setFilter(const QString &text)
+    {
+        filter = text;
+        invalidateFilter();
+    }
+
+protected:
+    bool filterAcceptsRow(int row, const QModelIndex &parent) const
+    {
+        // the entity being browsed stays
+        if ( filter.isEmpty() || !parent.isValid() )
+            return true;
+        return accepts(source->node(source->index(row, 0, parent)));
+    }
+
+private:
+    // an expanded item also stays if some of its children match
+    bool accepts(DiscoNode *node) const
+    {
+        if ( node->item.name().contains(filter, Qt::CaseInsensitive) || node->item.jid().full().contains(filter, Qt::CaseInsensitive) )
+            return true;
+        if ( node->expanded ) {
+            foreach ( DiscoNode *child, node->children ) {
+                if ( accepts(child) )
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    DiscoModel *source;
+    QString filter;
+};
+
 //----------------------------------------------------------------------------
 // DiscoList
 //----------------------------------------------------------------------------
 
-class DiscoListView : public QTreeWidget
+class DiscoListView : public QTreeView
 {
     Q_OBJECT
 
     DiscoDlg *dlg;
 public:
-    DiscoListView(DiscoDlg *parent);
+    DiscoListView(DiscoDlg *parent, DiscoData *data);
 
-public slots:
-    void updateItemsVisibility(const QString& filter);
+    DiscoModel *discoModel() const { return source; }
+    DiscoFilterModel *filterModel() const { return proxy; }
+    DiscoNode *node(const QModelIndex &index) const;
+    DiscoNode *currentNode() const { return node(currentIndex()); }
 
 protected:
     bool maybeTip(const QPoint &);
@@ -577,33 +729,46 @@ protected:
     // reimplemented
     bool eventFilter(QObject* o, QEvent* e);
     void resizeEvent(QResizeEvent*);
+    void verticalScrollbarValueChanged(int value);
+
+private:
+    DiscoModel *source;
+    DiscoFilterModel *proxy;
 };
 
-DiscoListView::DiscoListView(DiscoDlg *parent)
-: QTreeWidget(parent)
+DiscoListView::DiscoListView(DiscoDlg *parent, DiscoData *data)
+: QTreeView(parent)
 {
     dlg = parent;
+    source = new DiscoModel(parent, data);
+    proxy = new DiscoFilterModel(source, this);
+    setModel(proxy);
     installEventFilter(this);
-    setHeaderLabels( QStringList() << tr( "Name" ) << tr( "JID" ) << tr( "Node" ) );
 //    header()->setResizeMode(0, QHeaderView::Stretch);
 //    header()->setResizeMode(1, QHeaderView::ResizeToContents);
 //    header()->setResizeMode(2, QHeaderView::ResizeToContents);
     header()->setStretchLastSection(false);
     setRootIsDecorated(false);
+    setUniformRowHeights(true);
     setSortingEnabled(true);
     sortByColumn(1, Qt::AscendingOrder);
+}
 
+DiscoNode *DiscoListView::node(const QModelIndex &index) const
+{
+    return source->node(proxy->mapToSource(index));
 }
 
 void DiscoListView::resizeEvent(QResizeEvent* e)
 {
-    QTreeWidget::resizeEvent(e);
+    QTreeView::resizeEvent(e);
 
     QHeaderView* h = header();
+    QString nodeText = model() ? model()->headerData(2, Qt::Horizontal).toString() : QString();
 #if QT_VERSION >= QT_VERSION_CHECK(5,11,0)
-    h->resizeSection(2, h->fontMetrics().horizontalAdvance(headerItem()->text(2)) * 2);
+    h->resizeSection(2, h->fontMetrics().horizontalAdvance(nodeText) * 2);
 #else
-    h->resizeSection(2, h->fontMetrics().width(headerItem()->text(2)) * 2);
+    h->resizeSection(2, h->fontMetrics().width(nodeText) * 2);
 #endif
     float remainingWidth = viewport()->width() - h->sectionSize(2);
     h->resizeSection(1, int(remainingWidth * 0.3f));
@@ -612,12 +777,31 @@ void DiscoListView::resizeEvent(QResizeEvent* e)
     //h->adjustHeaderSize();
 }
 
+/**
+ * QTreeView only fetches more for its root on its own, so the next page of
+ * an expanded item is added when the list is scrolled close to its end.
+ */
+void DiscoListView::verticalScrollbarValueChanged(int value)
+{
+    QTreeView::verticalScrollbarValueChanged(value);
+
+    if ( value < verticalScrollBar()->maximum() - verticalScrollBar()->pageStep() )
+        return;
+
+    for ( QModelIndex i = indexAt(viewport()->rect().bottomLeft()); i.isValid(); i = i.parent() ) {
+        if ( model()->canFetchMore(i) ) {
+            model()->fetchMore(i);
+            break;
+        }
+    }
+}
+
 /**
  * \param pos should be in global coordinate system.
  */
 bool DiscoListView::maybeTip(const QPoint &pos)
 {
-    DiscoListItem* i = static_cast<DiscoListItem *>(itemAt(viewport()->mapFromGlobal(pos)));
+    DiscoNode *i = node(indexAt(viewport()->mapFromGlobal(pos)));
     if(!i)
         return false;
 
@@ -633,7 +817,7 @@ bool DiscoListView::maybeTip(const QPoint &pos)
 
     // top row
     QString text = "<qt><nobr>";
-    DiscoItem item = i->item();
+    DiscoItem item = i->item;
 
     if ( item.name()!=item.jid().full() )
         text += item.name() + " ";
@@ -683,14 +867,13 @@ bool DiscoListView::maybeTip(const QPoint &pos)
         }
     }
 
-    QString errorInfo=i->getErrorInfo();
+    QString errorInfo=i->errorInfo;
     if ( !errorInfo.isEmpty() ) {
         text += "<br>\n<br>\n<b>" + tr("Error:") + "</b>\n";
         text += errorInfo;
     }
 
     text += "</qt>";
-//    QRect r( visualItemRect(i) );
     PsiToolTip::showText(pos, text, this);
     return true;
 }
@@ -703,38 +886,7 @@ bool DiscoListView::eventFilter(QObject* o, QEvent* e)
         maybeTip(w->mapToGlobal(he->pos()));
         return true;
     }
-    return QTreeWidget::eventFilter(o, e);
-}
-
-// returns false if parent item should not be hidden (it has visible children)
-static bool updateItemsRecursively(QTreeWidgetItem* parent, const QString& filter)
-{
-    bool hidden = true;
-    for(int j = 0; j < parent->childCount(); j++) {
-        QTreeWidgetItem *i = parent->child(j);
-        if(filter.isEmpty()) {
-            i->setHidden(false);
-            updateItemsRecursively(i, filter);
-        }
-        else {
-            bool v = true;
-            if(i->isExpanded()) {
-                v = updateItemsRecursively(i, filter);
-            }
-            v &= !(i->text(0).contains(filter, Qt::CaseInsensitive) || i->text(1).contains(filter, Qt::CaseInsensitive));
-            i->setHidden(v);
-            hidden &= v;
-        }
-    }
-    return hidden;
-}
-
-void DiscoListView::updateItemsVisibility(const QString& filter)
-{
-    for(int n = 0; n < topLevelItemCount(); n++) {
-        QTreeWidgetItem *it = topLevelItem(n);
-        updateItemsRecursively(it, filter);
-    }
+    return QTreeView::eventFilter(o, e);
 }
 
 //----------------------------------------------------------------------------
@@ -765,6 +917,7 @@ public: // data
     QString node;
 
     DiscoData data;
+    DiscoListView *view;
 
     QToolBar *toolBar;
     IconAction *actBrowse, *actBack, *actForward, *actRefresh, *actStop;
@@ -800,18 +953,17 @@ public slots:
     void disableButtons();
     void enableButtons(const DiscoItem &);
 
-    void itemSelected (QTreeWidgetItem *);
-    void itemExpanded (QTreeWidgetItem *);
-    void itemDoubleclicked (QTreeWidgetItem *);
+    void itemSelected (const QModelIndex &);
+    void itemExpanded (const QModelIndex &);
+    void itemCollapsed (const QModelIndex &);
+    void itemDoubleclicked (const QModelIndex &);
+    void nodeUpdated (DiscoNode *);
     bool eventFilter (QObject *, QEvent *);
 
     // features...
     void actionActivated(int);
 
     void objectDestroyed(QObject *);
-
-private:
-    friend class DiscoListItem;
 };
 
 DiscoDlg::Private::Private(DiscoDlg *parent, PsiAccount *pa)
@@ -821,23 +973,24 @@ DiscoDlg::Private::Private(DiscoDlg *parent, PsiAccount *pa)
     data.tasks = new TaskList;
     connect(data.tasks, SIGNAL(started()),  SLOT(itemUpdateStarted()));
     connect(data.tasks, SIGNAL(finished()), SLOT(itemUpdateFinished()));
-    data.d = new DiscoConnector(this);
-    connect(data.d, SIGNAL(itemUpdated(QTreeWidgetItem *)), SLOT(itemSelected (QTreeWidgetItem *)));
 
     // mess with widgets
     busy = parent->busy;
     connect(busy, SIGNAL(destroyed(QObject *)), SLOT(objectDestroyed(QObject *)));
 
-    QTreeWidget *lv_discoOld = dlg->lv_disco;
-    dlg->lv_disco = new DiscoListView(dlg);
+    QTreeView *lv_discoOld = dlg->lv_disco;
+    view = new DiscoListView(dlg, &data);
+    dlg->lv_disco = view;
     replaceWidget(lv_discoOld, dlg->lv_disco);
 
     dlg->lv_disco->installEventFilter (this);
     dlg->le_filter->installEventFilter(this);
-    connect(dlg->lv_disco, SIGNAL(currentItemChanged (QTreeWidgetItem *, QTreeWidgetItem *)), SLOT(itemSelected (QTreeWidgetItem *)));
-    connect(dlg->lv_disco, SIGNAL(itemExpanded (QTreeWidgetItem *)), SLOT(itemExpanded (QTreeWidgetItem *)));
-    connect(dlg->lv_disco, SIGNAL(itemDoubleClicked (QTreeWidgetItem *, int)), SLOT(itemDoubleclicked (QTreeWidgetItem *)));
-    connect(dlg->le_filter, SIGNAL(textChanged(QString)), dlg->lv_disco, SLOT(updateItemsVisibility(QString)));
+    connect(view->selectionModel(), SIGNAL(currentChanged (const QModelIndex &, const QModelIndex &)), SLOT(itemSelected (const QModelIndex &)));
+    connect(view, SIGNAL(expanded (const QModelIndex &)), SLOT(itemExpanded (const QModelIndex &)));
+    connect(view, SIGNAL(collapsed (const QModelIndex &)), SLOT(itemCollapsed (const QModelIndex &)));
+    connect(view, SIGNAL(doubleClicked (const QModelIndex &)), SLOT(itemDoubleclicked (const QModelIndex &)));
+    connect(view->discoModel(), SIGNAL(nodeUpdated (DiscoNode *)), SLOT(nodeUpdated (DiscoNode *)));
+    connect(dlg->le_filter, SIGNAL(textChanged(QString)), view->filterModel(), SLOT(setFilter(QString)));
 
     // create actions
     actBrowse = new IconAction (tr("Browse"), "psi/jabber", tr("&Browse"), 0, dlg);
@@ -960,20 +1113,12 @@ void DiscoDlg::Private::doDisco(QString _host, QString _node, bool doHistory)
     disableButtons();
     updateBackForward();
 
-    dlg->lv_disco->clear();
-
     // create new root item
-    DiscoItem di;
-    di.setJid( jid );
-    di.setNode( node );
-
-    DiscoListItem *root = new DiscoListItem (di, &data, dlg->lv_disco);
-    root->setHidden (false); // don't confuse users with empty root
+    view->discoModel()->setRoot( jid, node );
 
-//    DiscoListItem::setExpanded(true); will be called from
-//    DiscoDlg::Private::itemExpanded(QTreeWidgetItem *item)
-//    So we preventing disco#items request sends twice
-    static_cast<QTreeWidgetItem*>(root)->setExpanded(true); // begin browsing;
+//    DiscoModel::setExpanded(true); will be called from
+//    DiscoDlg::Private::itemExpanded(const QModelIndex &)
+    view->expand( view->model()->index(0, 0) ); // begin browsing;
 }
 
 void DiscoDlg::Private::updateComboBoxes(Jid j, QString n)
@@ -994,21 +1139,22 @@ void DiscoDlg::Private::actionStop()
 
 void DiscoDlg::Private::actionRefresh()
 {
-    DiscoListItem *it = static_cast<DiscoListItem *>(dlg->lv_disco->currentItem());
+    DiscoNode *it = view->currentNode();
     if ( !it )
         return;
 
-    it->updateItems();
-    it->updateInfo();
+    data.pa->discoCache()->invalidate(it->item.jid(), it->item.node());
+    view->discoModel()->updateItems(it);
+    view->discoModel()->updateInfo(it);
 }
 
 void DiscoDlg::Private::actionBrowse()
 {
-    DiscoListItem *it = static_cast<DiscoListItem *>(dlg->lv_disco->currentItem());
+    DiscoNode *it = view->currentNode();
     if ( !it )
         return;
 
-    doDisco(it->item().jid().full(), it->item().node());
+    doDisco(it->item.jid().full(), it->item.node());
 }
 
 void DiscoDlg::Private::actionBack()
@@ -1071,34 +1217,48 @@ void DiscoDlg::Private::enableButtons(const DiscoItem &it)
     actQueryVersion->setEnabled( f.hasVersion() );
 }
 
-void DiscoDlg::Private::itemSelected (QTreeWidgetItem *item)
+void DiscoDlg::Private::itemSelected (const QModelIndex &index)
 {
-    DiscoListItem *it = static_cast<DiscoListItem *>(item);
+    DiscoNode *it = view->node(index);
     if ( !it ) {
         disableButtons();
         return;
     }
 
-    it->itemSelected();
+    if ( !it->alreadyInfo )
+        view->discoModel()->updateInfo(it);
 
-    const DiscoItem di = it->item();
+    const DiscoItem di = it->item;
     enableButtons ( di );
 }
 
-void DiscoDlg::Private::itemExpanded (QTreeWidgetItem *item)
+void DiscoDlg::Private::nodeUpdated (DiscoNode *node)
+{
+    if ( node == view->currentNode() ) // update actions
+        enableButtons ( node->item );
+}
+
+void DiscoDlg::Private::itemExpanded (const QModelIndex &index)
+{
+    DiscoNode *it = view->node(index);
+    if (it)
+        view->discoModel()->setExpanded(it, true);
+}
+
+void DiscoDlg::Private::itemCollapsed (const QModelIndex &index)
 {
-    DiscoListItem *it = static_cast<DiscoListItem *>(item);
+    DiscoNode *it = view->node(index);
     if (it)
-        it->setExpanded(true);
+        view->discoModel()->setExpanded(it, false);
 }
 
-void DiscoDlg::Private::itemDoubleclicked (QTreeWidgetItem *item)
+void DiscoDlg::Private::itemDoubleclicked (const QModelIndex &index)
 {
-    DiscoListItem *it = static_cast<DiscoListItem *>(item);
+    DiscoNode *it = view->node(index);
     if ( !it )
         return;
 
-    const DiscoItem d = it->item();
+    const DiscoItem d = it->item;
     const Features &f = d.features();
 
     // set the prior state of item
@@ -1126,12 +1286,12 @@ void DiscoDlg::Private::itemDoubleclicked (QTreeWidgetItem *item)
     }
 
     if ( id > 0 ) {
-        if ( !it->isExpanded() ) {
-            if ( it->childCount() )
-                it->setExpanded( true );
+        if ( !view->isExpanded(index) ) {
+            if ( view->model()->rowCount(index) )
+                view->expand( index );
         }
         else {
-            it->setExpanded( false );
+            view->collapse( index );
         }
         emit dlg->featureActivated( Features::feature(id), d.jid(), d.node() );
     }
@@ -1143,13 +1303,13 @@ bool DiscoDlg::Private::eventFilter (QObject *object, QEvent *event)
         if ( event->type() == QEvent::ContextMenu ) {
             QContextMenuEvent *e = static_cast<QContextMenuEvent *>(event);
 
-            DiscoListItem *it = static_cast<DiscoListItem *>(dlg->lv_disco->currentItem());
+            DiscoNode *it = view->currentNode();
             if ( !it )
                 return true;
 
             // prepare features list
             QList<long> idFeatures;
-            QStringList features = it->item().features().list();
+            QStringList features = it->item.features().list();
             {    // convert all features to their IDs
                 QStringList::Iterator it = features.begin();
                 for ( ; it != features.end(); ++it) {
@@ -1236,11 +1396,11 @@ bool DiscoDlg::Private::eventFilter (QObject *object, QEvent *event)
 
 void DiscoDlg::Private::actionActivated(int id)
 {
-    DiscoListItem *it = static_cast<DiscoListItem *>(dlg->lv_disco->currentItem());
+    DiscoNode *it = view->currentNode();
     if ( !it )
         return;
 
-    emit dlg->featureActivated(Features::feature(id), it->item().jid(), it->item().node());
+    emit dlg->featureActivated(Features::feature(id), it->item.jid(), it->item.node());
 }
 
 void DiscoDlg::Private::objectDestroyed(QObject *obj)
@@ -27,14 +27,22 @@
 #include "psicontactlist.h"
 #include "xmpp_jid.h"
 
+#include <QCoreApplication>
+#include <QDataStream>
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
 #include <QTextStream>
+#include <QThread>
 #include <QTimer>
 #include <QVector>
 
+#include <cstring>
+
 #define FAKEDELAY 0
+#define INDEX_READ_BLOCK  (1024 * 1024)
+#define INDEX_FILE_MAGIC  0x50484958 // "PHIX"
+#define INDEX_FILE_VER    1
 
 using namespace XMPP;
 
@@ -51,7 +59,7 @@ struct item_file_req
     int id;
     QDateTime date;
     QString findStr;
-    PsiEvent::Ptr event;
+    QList<PsiEvent::Ptr> events;
 
     enum Type {
         Type_get,
@@ -122,19 +130,23 @@ int EDBFlatFile::find(const QString &/*accId*/, const QString &str, const Jid &j
     return r->id;
 }
 
-int EDBFlatFile::append(const QString &/*accId*/, const Jid &j, const PsiEvent::Ptr &e, int type)
+int EDBFlatFile::append(const QString &accId, const Jid &j, const PsiEvent::Ptr &e, int type)
+{
+    if ( !e ) {
+        qWarning("EDBFlatFile::append(): Attempted to append incompatible type.");
+        return 0;
+    }
+    return appendBatch(accId, j, QList<PsiEvent::Ptr>() << e, type);
+}
+
+int EDBFlatFile::appendBatch(const QString &/*accId*/, const Jid &j, const QList<PsiEvent::Ptr> &events, int type)
 {
     if (type != EDB::Contact)
         return 0;
     item_file_req *r = new item_file_req;
     r->j = j;
     r->type = item_file_req::Type_append;
-    r->event = e;
-    if ( !r->event ) {
-        qWarning("EDBFlatFile::append(): Attempted to append incompatible type.");
-        delete r;
-        return 0;
-    }
+    r->events = events;
     r->id = genUniqueId();
     d->rlist.append(r);
 
@@ -215,6 +227,7 @@ bool EDBFlatFile::deleteFile(const Jid &j)
     QFileInfo fi(fname);
     if(fi.exists()) {
         QDir dir = fi.dir();
+        dir.remove(File::indexFileName(fi.fileName()));
         return dir.remove(fi.fileName());
     }
     else
@@ -269,7 +282,14 @@ void EDBFlatFile::performRequests()
         resultReady(r->id, result, startId);
     }
     else if(type == item_file_req::Type_append) {
-        writeFinished(r->id, f->append(r->event));
+        bool b = true;
+        foreach (const PsiEvent::Ptr &e, r->events) {
+            if (!e || !f->append(e)) {
+                b = false;
+                break;
+            }
+        }
+        writeFinished(r->id, b);
     }
     else if(type == item_file_req::Type_find) {
         int id = f->getId(r->date, r->dir, 0);
@@ -323,8 +343,26 @@ public:
 
     QVector<quint64> index;
     bool indexed = false;
+    bool indexDirty = false;
+
+    void scan(const char *data, qint64 len, qint64 base, qint64 &lineStart);
 };
 
+// Appends offsets of all lines terminated within data[0..len)
+void EDBFlatFile::File::Private::scan(const char *data, qint64 len, qint64 base, qint64 &lineStart)
+{
+    const char *p   = data;
+    const char *end = data + len;
+    while (p < end) {
+        const char *nl = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+        if (!nl)
+            break;
+        index.append(quint64(lineStart));
+        lineStart = base + (nl - data) + 1;
+        p = nl + 1;
+    }
+}
+
 EDBFlatFile::File::File(const Jid &_j)
 {
     d = new Private;
@@ -345,13 +383,65 @@ EDBFlatFile::File::File(const Jid &_j)
 
 EDBFlatFile::File::~File()
 {
-    if(valid)
+    if(valid) {
         f.close();
+        if (d->indexed && d->indexDirty)
+            saveIndex();
+    }
     //printf("[EDB closing -- %s]\n", j.full().latin1());
 
     delete d;
 }
 
+QString EDBFlatFile::File::indexFileName(const QString &fileName)
+{
+    return fileName + ".idx";
+}
+
+/*
+ * The index is stored next to the log together with the size
+ * and modification time of the log it was built for.
+ */
+bool EDBFlatFile::File::loadIndex()
+{
+    QFile idx(indexFileName(fname));
+    if (!idx.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&idx);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, ver;
+    qint64  size, mtime;
+    in >> magic >> ver >> size >> mtime;
+    if (magic != INDEX_FILE_MAGIC || ver != INDEX_FILE_VER)
+        return false;
+
+    const QFileInfo fi(fname);
+    if (size != fi.size() || mtime != fi.lastModified().toMSecsSinceEpoch())
+        return false;
+
+    in >> d->index;
+    if (in.status() != QDataStream::Ok) {
+        d->index.clear();
+        return false;
+    }
+    return true;
+}
+
+void EDBFlatFile::File::saveIndex()
+{
+    const QFileInfo fi(fname);
+    QFile idx(indexFileName(fname));
+    if (!idx.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+
+    QDataStream out(&idx);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(INDEX_FILE_MAGIC) << quint32(INDEX_FILE_VER)
+        << qint64(fi.size()) << qint64(fi.lastModified().toMSecsSinceEpoch())
+        << d->index;
+}
+
 QString EDBFlatFile::File::jidToFileName(const XMPP::Jid &j)
 {
     return ApplicationInfo::historyDir() + "/" + strToFileName(JIDUtil::encode(j.bare()).toLower());
@@ -386,33 +476,37 @@ void EDBFlatFile::File::ensureIndex()
             return;
         }
 
-        f.reset(); // go to beginning
         d->index.clear();
+        if (loadIndex()) {
+            d->indexed = true;
+            return;
+        }
 
         //printf(" file: %s\n", fname.latin1());
         // build index
-        while(1) {
-            quint64 at = quint64(f.pos());
-
-            // locate a newline
-            bool found = false;
-            char c;
-            while (f.getChar(&c)) {
-                if (c == '\n') {
-                    found = true;
-                    break;
-                }
+        const qint64 size = f.size();
+        // a rough guess of an average line length saves most of reallocations
+        d->index.reserve(int(qMin<qint64>(size / 128, 1 << 24)));
+        qint64 lineStart = 0;
+        uchar *mem = size > 0 ? f.map(0, size) : nullptr;
+        if (mem) {
+            d->scan(reinterpret_cast<const char *>(mem), size, 0, lineStart);
+            f.unmap(mem);
+        }
+        else {
+            f.reset(); // go to beginning
+            QByteArray buf(INDEX_READ_BLOCK, Qt::Uninitialized);
+            qint64 base = 0;
+            qint64 len;
+            while ((len = f.read(buf.data(), buf.size())) > 0) {
+                d->scan(buf.constData(), len, base, lineStart);
+                base += len;
             }
-
-            if(!found)
-                break;
-
-            int oldsize = d->index.size();
-            d->index.resize(oldsize+1);
-            d->index[oldsize] = at;
         }
+        d->index.squeeze();
 
         d->indexed = true;
+        d->indexDirty = true;
     }
     else {
         //printf(" file: can't open\n");
@@ -555,15 +649,51 @@ bool EDBFlatFile::File::append(const PsiEvent::Ptr &e)
     f.flush();
 
     if ( d->indexed ) {
-        int oldsize = d->index.size();
-        d->index.resize(oldsize+1);
-        d->index[oldsize] = at;
+        d->index.append(at);
+        d->indexDirty = true;
     }
 
     return true;
 }
 
+/*
+ * Parses the whole log of the contact without touching an open File,
+ * so it is safe to call from any thread. The returned events belong
+ * to the main thread.
+ */
+QList<PsiEvent::Ptr> EDBFlatFile::File::readEvents(const XMPP::Jid &j)
+{
+    QList<PsiEvent::Ptr> res;
+    QFile file(jidToFileName(j));
+    if (!file.open(QIODevice::ReadOnly))
+        return res;
+
+    QThread *mainThread = QCoreApplication::instance()->thread();
+    int lineNum = 0;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        ++lineNum;
+        if (!line.endsWith('\n'))
+            break; // not finished line is not indexed by ensureIndex() too
+        line.chop(line.endsWith("\r\n") ? 2 : 1);
+        PsiEvent::Ptr e = lineToEvent(j, QString::fromUtf8(line));
+        if (!e) {
+            qWarning("EDBFlatFile::File::readEvents() Failed to parse file %s, line %d",
+                     qUtf8Printable(file.fileName()), lineNum);
+            continue;
+        }
+        e->moveToThread(mainThread);
+        res.append(e);
+    }
+    return res;
+}
+
 PsiEvent::Ptr EDBFlatFile::File::lineToEvent(const QString &line)
+{
+    return lineToEvent(j, line);
+}
+
+PsiEvent::Ptr EDBFlatFile::File::lineToEvent(const XMPP::Jid &j, const QString &line)
 {
     // -- parse the line --
     enum { Time = 0, Type = 1, Origin = 2, Flags = 3, Subj = 4, UrlAddr = 5, UrlDesc = 6 };
@@ -40,6 +40,7 @@ public:
     int get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int start, int len);
     int find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction);
     int append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
+    int appendBatch(const QString &accId, const XMPP::Jid &, const QList<PsiEvent::Ptr> &, int);
     int erase(const QString &accId, const XMPP::Jid &);
     QList<EDB::ContactItem> contacts(const QString &accId, int type);
     quint64 eventsCount(const QString &accId, const XMPP::Jid &jid);
@@ -77,7 +78,9 @@ public:
 
     static QString jidToFileName(const XMPP::Jid &);
     static QString strToFileName(const QString &s);
+    static QString indexFileName(const QString &fileName);
     static QList<EDB::ContactItem> contacts(const QString &accId, int type);
+    static QList<PsiEvent::Ptr> readEvents(const XMPP::Jid &j);
 
 signals:
     void timeout();
@@ -97,8 +100,11 @@ public:
 
 private:
     PsiEvent::Ptr lineToEvent(const QString &);
+    static PsiEvent::Ptr lineToEvent(const XMPP::Jid &j, const QString &);
     QString eventToLine(const PsiEvent::Ptr&);
     void ensureIndex();
+    bool loadIndex();
+    void saveIndex();
     QString getLine(int id);
     QDateTime getDate(int id);
 };
@@ -19,115 +19,145 @@
 
 #include "applicationinfo.h"
 //#include "common.h"
+#include "debug.h"
 #include "edbsqlite.h"
 #include "historyimp.h"
 #include "jidutil.h"
 #include "psicontactlist.h"
+#include "psioptions.h"
 
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QRegExp>
 #include <QSqlDriver>
 #include <QSqlError>
 
-#define FAKEDELAY 0
+#define MAX_PAGE_CURSORS 32
+#define FTS_BACKFILL_CHUNK 5000
+#define FTS_BACKFILL_DELAY 50
+#define MAINT_CHECK_INTERVAL   300000 // msecs
+#define MAINT_STEP_DELAY       200    // msecs between chunks of one job
+#define MAINT_IDLE_SECS        120    // no requests for that long counts as idle
+#define MAINT_DELETE_CHUNK     2000   // events deleted per step
+#define MAINT_VACUUM_PAGES     1000   // pages released per step
+#define MAINT_VACUUM_MIN_PAGES 2560
+#define STORAGE_CACHE_KIB      8192              // page cache of the connection
+#define STORAGE_MMAP_BYTES     (256 * 1024 * 1024) // reads through mmap, 64-bit builds only
+#define STORAGE_WAL_LIMIT      (4 * 1024 * 1024) // the WAL file is truncated to this after checkpoints
+#define MATCH_BATCH_SIZE       50     // hits per batch of a streamed search
+
+static const QString retentionOption = "options.history.retention-days";
 
 using namespace XMPP;
 
+// `oob_urls` holds "url US desc RS url US desc ...". Both separators are
+// control characters that cannot occur in XML text, so no escaping is needed.
+static const QChar urlSeparator(0x1e);
+static const QChar descSeparator(0x1f);
+
+static QVariant encodeUrls(const UrlList &urls)
+{
+    QString res;
+    for (const Url &url : urls) {
+        if (url.url().isEmpty())
+            continue;
+        if (!res.isEmpty())
+            res += urlSeparator;
+        res += url.url();
+        if (!url.desc().isEmpty())
+            res += descSeparator + url.desc();
+    }
+    return res.isEmpty() ? QVariant(QVariant::String) : QVariant(res);
+}
+
+static void decodeUrls(const QString &str, Message *m)
+{
+    if (str.isEmpty())
+        return;
+    for (const QStringRef &item : str.splitRef(urlSeparator, QString::SkipEmptyParts)) {
+        const int pos = item.indexOf(descSeparator);
+        if (pos < 0)
+            m->urlAdd(Url(item.toString(), QString()));
+        else
+            m->urlAdd(Url(item.left(pos).toString(), item.mid(pos + 1).toString()));
+    }
+}
+
+// links stored by version 0.2 as {"jabber:x:oob": [[url, desc], ...]}
+static QString urlsFromExtraData(const QString &extra)
+{
+    const QJsonDocument doc = QJsonDocument::fromJson(extra.toUtf8());
+    if (doc.isNull())
+        return QString();
+    UrlList urls;
+    for (const QJsonValue &item : doc.object().value("jabber:x:oob").toArray()) {
+        const QJsonArray itemList = item.toArray();
+        if (!itemList.isEmpty())
+            urls.append(Url(itemList.at(0).toString(), itemList.at(1).toString()));
+    }
+    return encodeUrls(urls).toString();
+}
+
 //----------------------------------------------------------------------------
 // EDBSqLite
 //----------------------------------------------------------------------------
 
 EDBSqLite::EDBSqLite(PsiCon *psi) : EDB(psi),
-    transactionsCounter(0),
-    lastCommitTime(QDateTime::currentDateTime()),
-    commitTimer(nullptr),
+    active(false),
+    workerThread(new QThread(this)),
+    worker(new EDBSqLiteWorker()),
     mirror_(nullptr)
 {
-    status = NotActive;
-    QString path = ApplicationInfo::historyDir() + "/history.db";
-    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "history");
-    db.setDatabaseName(path);
-    if (!db.open()) {
-        qWarning("%s\n%s", "EDBSqLite::EDBSqLite(): Can't open base.", qUtf8Printable(db.lastError().text()));
-        return;
-    }
-    QSqlQuery query(db);
-    query.exec("PRAGMA foreign_keys = ON;");
-    setInsertingMode(Normal);
-    if (db.tables(QSql::Tables).size() == 0) {
-        // no tables found.
-        if (db.transaction()) {
-            query.exec("CREATE TABLE `system` ("
-                "`key` TEXT, "
-                "`value` TEXT"
-                ");");
-            query.exec("CREATE TABLE `accounts` ("
-                "`id` TEXT, "
-                "`lifetime` INTEGER"
-                ");");
-            query.exec("CREATE TABLE `contacts` ("
-                "`id` INTEGER NOT NULL PRIMARY KEY ASC, "
-                "`acc_id` TEXT, "
-                "`type` INTEGER, "
-                "`jid` TEXT, "
-                "`lifetime` INTEGER"
-                ");");
-            query.exec("CREATE TABLE `events` ("
-                "`id` INTEGER NOT NULL PRIMARY KEY ASC, "
-                "`contact_id` INTEGER NOT NULL REFERENCES `contacts`(`id`) ON DELETE CASCADE, "
-                "`resource` TEXT, "
-                "`date` TEXT, "
-                "`type` INTEGER, "
-                "`direction` INTEGER, "
-                "`subject` TEXT, "
-                "`m_text` TEXT, "
-                "`lang` TEXT, "
-                "`extra_data` TEXT"
-                ");");
-            query.exec("CREATE INDEX `key` ON `system` (`key`);");
-            query.exec("CREATE INDEX `jid` ON `contacts` (`jid`);");
-            query.exec("CREATE INDEX `contact_id` ON `events` (`contact_id`);");
-            query.exec("CREATE INDEX `date` ON `events` (`date`);");
-            if (db.commit()) {
-                status = Commited;
-                setStorageParam("version", "0.1");
-                setStorageParam("import_start", "yes");
-            }
-        }
-    }
-    else
-        status = Commited;
+    qRegisterMetaType<EDBSqLiteRecords>("EDBSqLiteRecords");
+    worker->moveToThread(workerThread);
+    connect(worker, SIGNAL(resultReady(int,EDBSqLiteRecords,int)), SLOT(workerResultReady(int,EDBSqLiteRecords,int)));
+    connect(worker, SIGNAL(matchesReady(int,EDBSqLiteRecords)), SLOT(workerMatchesReady(int,EDBSqLiteRecords)));
+    connect(worker, SIGNAL(writeFinished(int,bool)), SLOT(workerWriteFinished(int,bool)));
+    connect(worker, SIGNAL(eventsExpired()), SLOT(workerEventsExpired()));
+    workerThread->setObjectName("EDBSqLite");
+    workerThread->start();
+    QMetaObject::invokeMethod(worker, "open", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, active));
 }
 
 EDBSqLite::~EDBSqLite()
 {
-    commit();
-    {
-        QSqlDatabase db = QSqlDatabase::database("history", false);
-        if (db.isOpen())
-            db.close();
-    }
-    QSqlDatabase::removeDatabase("history");
+    flushDeferred();
+    QMetaObject::invokeMethod(worker, "close", Qt::BlockingQueuedConnection);
+    workerThread->quit();
+    workerThread->wait();
+    delete worker;
     delete mirror_;
 }
 
 bool EDBSqLite::init()
 {
-    if (status == NotActive)
+    if (!active)
         return false;
 
     if (!getStorageParam("import_start").isEmpty()) {
         if (!importExecute()) {
-            status = NotActive;
+            active = false;
             return false;
         }
     }
 
     setMirror(new EDBFlatFile(psi()));
+
+    optionChanged(retentionOption);
+    connect(PsiOptions::instance(), SIGNAL(optionChanged(QString)), SLOT(optionChanged(QString)));
+    QMetaObject::invokeMethod(worker, "startBackgroundJobs", Qt::QueuedConnection);
     return true;
 }
 
+void EDBSqLite::optionChanged(const QString &option)
+{
+    if (option == retentionOption) {
+        QMetaObject::invokeMethod(worker, "setDefaultLifetime", Qt::QueuedConnection,
+                                  Q_ARG(int, PsiOptions::instance()->getOption(retentionOption).toInt()));
+    }
+}
+
 int EDBSqLite::features() const
 {
     return SeparateAccounts | PrivateContacts | AllContacts | AllAccounts;
@@ -144,13 +174,23 @@ int EDBSqLite::get(const QString &accId, const XMPP::Jid &jid, QDateTime date, i
     r->dir   = direction;
     r->date  = date;
     r->id    = genUniqueId();
-    rlist.append(r);
-
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
-    return r->id;
+    const int id = r->id;
+    worker->enqueue(r);
+    return id;
 }
 
 int EDBSqLite::find(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date, int direction)
+{
+    return enqueueFind(accId, str, jid, date, direction, 0);
+}
+
+int EDBSqLite::findMatches(const QString &accId, const QString &str, const XMPP::Jid &jid)
+{
+    return enqueueFind(accId, str, jid, QDateTime(), EDB::Forward, MATCH_BATCH_SIZE);
+}
+
+int EDBSqLite::enqueueFind(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date,
+                           int direction, int batch)
 {
     item_query_req *r = new item_query_req;
     r->accId   = accId;
@@ -160,35 +200,108 @@ int EDBSqLite::find(const QString &accId, const QString &str, const XMPP::Jid &j
     r->dir     = direction;
     r->findStr = str;
     r->date    = date;
+    r->batch   = batch;
     r->id      = genUniqueId();
-    rlist.append(r);
-
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
-    return r->id;
+    const int id = r->id;
+    worker->enqueue(r);
+    return id;
 }
 
 int EDBSqLite::append(const QString &accId, const XMPP::Jid &jid, const PsiEvent::Ptr &e, int type)
+{
+    if (!e) {
+        qWarning("EDBSqLite::append(): Attempted to append incompatible type.");
+        return 0;
+    }
+    return appendBatch(accId, jid, QList<PsiEvent::Ptr>() << e, type);
+}
+
+int EDBSqLite::appendBatch(const QString &accId, const XMPP::Jid &jid, const QList<PsiEvent::Ptr> &events, int type)
 {
     item_query_req *r = new item_query_req;
+    r->rows.reserve(events.size());
+    foreach (const PsiEvent::Ptr &e, events) {
+        EDBSqLiteWorker::EventRow row;
+        if (!e || !makeEventRow(e, &row)) {
+            // unsupported event types are not stored
+            delete r;
+            return failedWrite();
+        }
+        r->rows.append(row);
+    }
     r->accId   = accId;
     r->j       = jid;
     r->jidType = type;
     r->type    = item_query_req::Type_append;
-    r->event   = e;
-    if ( !r->event ) {
-        qWarning("EDBSqLite::append(): Attempted to append incompatible type.");
-        delete r;
-        return 0;
-    }
     r->id      = genUniqueId();
-    rlist.append(r);
-
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
+    const int id = r->id;
+    worker->enqueue(r);
+    contactAppended(accId, jid, type);
 
     if (mirror_)
-        mirror_->append(accId, jid, e, type);
+        mirror_->appendBatch(accId, jid, events, type);
+
+    return id;
+}
 
-    return r->id;
+// Reports the failure asynchronously, like any other write
+int EDBSqLite::failedWrite()
+{
+    const int id = genUniqueId();
+    QMetaObject::invokeMethod(this, "workerWriteFinished", Qt::QueuedConnection, Q_ARG(int, id), Q_ARG(bool, false));
+    return id;
+}
+
+bool EDBSqLite::makeEventRow(const PsiEvent::Ptr &e, EDBSqLiteWorker::EventRow *row)
+{
+    int nType = 0;
+
+    if (e->type() == PsiEvent::Message) {
+        MessageEvent::Ptr me = e.staticCast<MessageEvent>();
+        const Message &m = me->message();
+        row->date = m.timeStamp();
+        if (m.type() == "chat")
+            nType = 1;
+        else if(m.type() == "error")
+            nType = 4;
+        else if(m.type() == "headline")
+            nType = 5;
+
+    } else if (e->type() == PsiEvent::Auth) {
+        AuthEvent::Ptr ae = e.staticCast<AuthEvent>();
+        row->date = ae->timeStamp();
+        QString subType = ae->authType();
+        if(subType == "subscribe")
+            nType = 3;
+        else if(subType == "subscribed")
+            nType = 6;
+        else if(subType == "unsubscribe")
+            nType = 7;
+        else if(subType == "unsubscribed")
+            nType = 8;
+    } else
+        return false;
+
+    row->type      = nType;
+    row->direction = e->originLocal() ? 1 : 2;
+    if (nType == 0 || nType == 1 || nType == 4 || nType == 5) {
+        MessageEvent::Ptr me = e.staticCast<MessageEvent>();
+        const Message &m = me->message();
+        QString lang = m.lang();
+        row->subject = m.subject(lang);
+        row->text    = m.body(lang);
+        row->lang    = lang;
+        row->oobUrls   = encodeUrls(m.urlList());
+        row->extraData = QVariant(QVariant::String);
+    }
+    else {
+        row->subject   = QVariant(QVariant::String);
+        row->text      = QVariant(QVariant::String);
+        row->lang      = QVariant(QVariant::String);
+        row->oobUrls   = QVariant(QVariant::String);
+        row->extraData = QVariant(QVariant::String);
+    }
+    return true;
 }
 
 int EDBSqLite::erase(const QString &accId, const XMPP::Jid &jid)
@@ -198,43 +311,430 @@ int EDBSqLite::erase(const QString &accId, const XMPP::Jid &jid)
     r->j     = jid;
     r->type  = item_query_req::Type_erase;
     r->id    = genUniqueId();
-    rlist.append(r);
-
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
+    const int id = r->id;
+    worker->enqueue(r);
+    // a contact keeps its row if it has its own lifetime, let the next query tell
+    dropContactsCache();
 
     if (mirror_)
         mirror_->erase(accId, jid);
 
-    return r->id;
+    return id;
 }
 
 QList<EDB::ContactItem> EDBSqLite::contacts(const QString &accId, int type)
+{
+    const QString key = contactsKey(accId, type);
+    if (!contactsCache.contains(key)) {
+        EDBSqLiteRecords records;
+        QMetaObject::invokeMethod(worker, "contacts", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(EDBSqLiteRecords, records), Q_ARG(QString, accId), Q_ARG(int, type));
+        cacheContacts(key, contactItems(records));
+    }
+    return contactsCache.value(key).items;
+}
+
+/**
+ * Served from the cache when possible, otherwise queued behind the pending
+ * writes, so the list includes everything logged before the request.
+ */
+int EDBSqLite::requestContacts(const QString &accId, int type)
+{
+    const QString key = contactsKey(accId, type);
+    const int id = genUniqueId();
+    if (contactsCache.contains(key)) {
+        const QList<ContactItem> list = contactsCache.value(key).items;
+        QTimer::singleShot(0, this, [this, id, list]() { contactsReady(id, list); });
+        return id;
+    }
+
+    item_query_req *r = new item_query_req;
+    r->accId   = accId;
+    r->jidType = type;
+    r->type    = item_query_req::Type_contacts;
+    r->id      = id;
+    pendingContacts.insert(id, key);
+    worker->enqueue(r);
+    return id;
+}
+
+QString EDBSqLite::contactsKey(const QString &accId, int type)
+{
+    return accId + "|" + QString::number(type);
+}
+
+QList<EDB::ContactItem> EDBSqLite::contactItems(const EDBSqLiteRecords &records)
 {
     QList<ContactItem> res;
-    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryContactsList, accId.isEmpty(), true);
+    res.reserve(records.size());
+    foreach (const QSqlRecord &rec, records)
+        res.append(ContactItem(rec.value("acc_id").toString(), XMPP::Jid(rec.value("jid").toString())));
+    return res;
+}
+
+void EDBSqLite::cacheContacts(const QString &key, const QList<ContactItem> &items)
+{
+    ContactList &list = contactsCache[key];
+    list.items = items;
+    list.ids.clear();
+    foreach (const ContactItem &ci, items)
+        list.ids.insert(ci.accId + "|" + ci.jid.full());
+}
+
+void EDBSqLite::dropContactsCache()
+{
+    contactsCache.clear();
+    for (auto it = pendingContacts.begin(); it != pendingContacts.end(); ++it)
+        it->clear();
+}
+
+// the worker stores the full jid of group chat contacts and the bare one otherwise
+void EDBSqLite::contactAppended(const QString &accId, const XMPP::Jid &jid, int type)
+{
+    const QString jidStr = (type == EDB::GroupChatContact) ? jid.full() : jid.bare();
+    const QString id     = accId + "|" + jidStr;
+    foreach (const QString &key, QStringList() << contactsKey(accId, type) << contactsKey(QString(), type)) {
+        auto it = contactsCache.find(key);
+        if (it != contactsCache.end() && !it->ids.contains(id)) {
+            it->items.append(ContactItem(accId, XMPP::Jid(jidStr)));
+            it->ids.insert(id);
+        }
+    }
+    for (auto it = pendingContacts.begin(); it != pendingContacts.end(); ++it) {
+        if (*it == contactsKey(accId, type) || *it == contactsKey(QString(), type))
+            it->clear();
+    }
+}
+
+quint64 EDBSqLite::eventsCount(const QString &accId, const XMPP::Jid &jid)
+{
+    qulonglong res = 0;
+    QMetaObject::invokeMethod(worker, "eventsCount", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(qulonglong, res), Q_ARG(QString, accId), Q_ARG(QString, jid.full()));
+    return res;
+}
+
+QString EDBSqLite::getStorageParam(const QString &key)
+{
+    QString res;
+    QMetaObject::invokeMethod(worker, "getStorageParam", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(QString, res), Q_ARG(QString, key));
+    return res;
+}
+
+void EDBSqLite::setStorageParam(const QString &key, const QString &val)
+{
+    QMetaObject::invokeMethod(worker, "setStorageParam", Qt::BlockingQueuedConnection,
+                              Q_ARG(QString, key), Q_ARG(QString, val));
+}
+
+void EDBSqLite::setInsertingMode(InsertMode mode)
+{
+    QMetaObject::invokeMethod(worker, "setInsertingMode", Qt::BlockingQueuedConnection, Q_ARG(int, int(mode)));
+}
+
+void EDBSqLite::setLifetime(const QString &accId, const XMPP::Jid &jid, int days, int type)
+{
+    bool res = false;
+    QMetaObject::invokeMethod(worker, "setLifetime", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, res),
+                              Q_ARG(QString, accId), Q_ARG(QString, jid.full()), Q_ARG(int, type), Q_ARG(int, days));
+    if (!jid.isEmpty())
+        dropContactsCache();
+    if (!res)
+        qWarning("EDBSqLite: can't store the history lifetime for %s", qUtf8Printable(jid.isEmpty() ? accId : jid.full()));
+}
+
+int EDBSqLite::lifetime(const QString &accId, const XMPP::Jid &jid, int type)
+{
+    int res = -1;
+    QMetaObject::invokeMethod(worker, "lifetime", Qt::BlockingQueuedConnection, Q_RETURN_ARG(int, res),
+                              Q_ARG(QString, accId), Q_ARG(QString, jid.full()), Q_ARG(int, type));
+    return res;
+}
+
+void EDBSqLite::setMirror(EDBFlatFile *mirr)
+{
+    if (mirr != mirror_) {
+        if (mirror_)
+            delete mirror_;
+        mirror_ = mirr;
+    }
+}
+
+EDBFlatFile *EDBSqLite::mirror() const
+{
+    return mirror_;
+}
+
+EDBResult EDBSqLite::eventItems(const EDBSqLiteRecords &records)
+{
+    EDBResult result;
+    foreach (const QSqlRecord &rec, records) {
+        PsiEvent::Ptr e(getEvent(rec));
+        if (e)
+            result.append(EDBItemPtr(new EDBItem(e, rec.value("id").toString())));
+    }
+    return result;
+}
+
+void EDBSqLite::workerResultReady(int id, const EDBSqLiteRecords &records, int beginRow)
+{
+    if (pendingContacts.contains(id)) {
+        // an empty key means the list changed while the query was queued
+        const QString key = pendingContacts.take(id);
+        const QList<ContactItem> items = contactItems(records);
+        if (!key.isEmpty())
+            cacheContacts(key, items);
+        contactsReady(id, items);
+        return;
+    }
+
+    resultReady(id, eventItems(records), beginRow);
+}
+
+void EDBSqLite::workerMatchesReady(int id, const EDBSqLiteRecords &records)
+{
+    matchesReady(id, eventItems(records));
+}
+
+void EDBSqLite::workerWriteFinished(int id, bool success)
+{
+    writeFinished(id, success);
+}
+
+void EDBSqLite::workerEventsExpired()
+{
+    clearCache();
+    dropContactsCache();
+}
+
+PsiEvent::Ptr EDBSqLite::getEvent(const QSqlRecord &record)
+{
+    PsiAccount *pa = psi()->contactList()->getAccount(record.value("acc_id").toString());
+
+    int type = record.value("type").toInt();
+
+    if(type == 0 || type == 1 || type == 4 || type == 5) {
+        Message m;
+        m.setTimeStamp(record.value("date").toDateTime());
+        if(type == 1)
+            m.setType("chat");
+        else if(type == 4)
+            m.setType("error");
+        else if(type == 5)
+            m.setType("headline");
+        else
+            m.setType("");
+        m.setFrom(Jid(record.value("jid").toString()));
+        QVariant text = record.value("m_text");
+        if (!text.isNull()) {
+            m.setBody(text.toString());
+            m.setLang(record.value("lang").toString());
+            m.setSubject(record.value("subject").toString());
+        }
+        m.setSpooled(true);
+        decodeUrls(record.value("oob_urls").toString(), &m);
+        // only rows the 0.3 upgrade could not convert still carry JSON
+        const QString extraStr = record.value("extra_data").toString();
+        if (!extraStr.isEmpty())
+            decodeUrls(urlsFromExtraData(extraStr), &m);
+        MessageEvent::Ptr me(new MessageEvent(m, pa));
+        me->setOriginLocal((record.value("direction").toInt() == 1));
+        return me.staticCast<PsiEvent>();
+    }
+
+    if(type == 2 || type == 3 || type == 6 || type == 7 || type == 8) {
+        QString subType = "subscribe";
+        // if(type == 2) { // Not used (stupid "system message" from Psi <= 0.8.6)
+        if(type == 3)
+            subType = "subscribe";
+        else if(type == 6)
+            subType = "subscribed";
+        else if(type == 7)
+            subType = "unsubscribe";
+        else if(type == 8)
+            subType = "unsubscribed";
+
+        AuthEvent::Ptr ae(new AuthEvent(Jid(record.value("jid").toString()), subType, pa));
+        ae->setTimeStamp(record.value("date").toDateTime());
+        return ae.staticCast<PsiEvent>();
+    }
+    return PsiEvent::Ptr();
+}
+
+bool EDBSqLite::importExecute()
+{
+    bool res = true;
+    HistoryImport *imp = new HistoryImport(psi());
+    if (imp->isNeeded()) {
+        if (imp->exec() != HistoryImport::ResultNormal) {
+            res = false;
+        }
+    }
+    delete imp;
+    return res;
+}
+
+//----------------------------------------------------------------------------
+// EDBSqLiteWorker
+//----------------------------------------------------------------------------
+
+EDBSqLiteWorker::EDBSqLiteWorker() : QObject(),
+    status(NotActive),
+    transactionsCounter(0),
+    lastCommitTime(QDateTime::currentDateTime()),
+    commitTimer(nullptr),
+    queryes(nullptr),
+    ftsState(FtsNone),
+    ftsTrigram(false),
+    insertMode(EDBSqLite::Normal),
+    defaultLifetime(0),
+    lastActivity(QDateTime::currentDateTime()),
+    maintenanceTimer(nullptr),
+    analyzePending(false),
+    walMode(false),
+    walDirty(false)
+{
+}
+
+EDBSqLiteWorker::~EDBSqLiteWorker()
+{
+    qDeleteAll(rlist);
+}
+
+void EDBSqLiteWorker::enqueue(item_query_req *r)
+{
+    {
+        QMutexLocker locker(&rlistMutex);
+        rlist.append(r);
+        TRACE_COUNTER("edb queue", rlist.size());
+    }
+    QMetaObject::invokeMethod(this, "performRequests", Qt::QueuedConnection);
+}
+
+bool EDBSqLiteWorker::open()
+{
+    status = NotActive;
+    queryes = new QueryStorage();
+    QString path = ApplicationInfo::historyDir() + "/history.db";
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "history");
+    db.setDatabaseName(path);
+    if (!db.open()) {
+        qWarning("%s\n%s", "EDBSqLiteWorker::open(): Can't open base.", qUtf8Printable(db.lastError().text()));
+        return false;
+    }
+    QSqlQuery query(db);
+    query.exec("PRAGMA foreign_keys = ON;");
+    applyStorageProfile();
+    setInsertingMode(EDBSqLite::Normal);
+    if (db.tables(QSql::Tables).size() == 0) {
+        // no tables found.
+        // lets the maintenance job give space back in small steps; must precede the first table
+        query.exec("PRAGMA auto_vacuum = INCREMENTAL;");
+        if (db.transaction()) {
+            query.exec("CREATE TABLE `system` ("
+                "`key` TEXT, "
+                "`value` TEXT"
+                ");");
+            query.exec("CREATE TABLE `accounts` ("
+                "`id` TEXT, "
+                "`lifetime` INTEGER"
+                ");");
+            query.exec("CREATE TABLE `contacts` ("
+                "`id` INTEGER NOT NULL PRIMARY KEY ASC, "
+                "`acc_id` TEXT, "
+                "`type` INTEGER, "
+                "`jid` TEXT, "
+                "`lifetime` INTEGER"
+                ");");
+            query.exec("CREATE TABLE `events` ("
+                "`id` INTEGER NOT NULL PRIMARY KEY ASC, "
+                "`contact_id` INTEGER NOT NULL REFERENCES `contacts`(`id`) ON DELETE CASCADE, "
+                "`resource` TEXT, "
+                "`date` TEXT, "
+                "`ts` INTEGER, "
+                "`type` INTEGER, "
+                "`direction` INTEGER, "
+                "`subject` TEXT, "
+                "`m_text` TEXT, "
+                "`lang` TEXT, "
+                "`oob_urls` TEXT, "
+                "`extra_data` TEXT"
+                ");");
+            query.exec("CREATE INDEX `key` ON `system` (`key`);");
+            query.exec("CREATE INDEX `jid` ON `contacts` (`jid`);");
+            query.exec("CREATE INDEX `contact_ts` ON `events` (`contact_id`, `ts`);");
+            query.exec("CREATE INDEX `ts` ON `events` (`ts`);");
+            if (db.commit()) {
+                status = Commited;
+                setStorageParam("version", "0.3");
+                setStorageParam("import_start", "yes");
+            }
+        }
+    }
+    else {
+        status = Commited;
+        if (getStorageParam("version") == "0.1" && !migrateTimestamps())
+            status = NotActive;
+        if (status != NotActive && getStorageParam("version") == "0.2" && !migrateExtraData())
+            status = NotActive;
+    }
+
+    if (status == Commited)
+        ensureFullTextIndex();
+    return status != NotActive;
+}
+
+void EDBSqLiteWorker::close()
+{
+    commit();
+    if (walMode && status != NotActive) {
+        QSqlQuery query(QSqlDatabase::database("history"));
+        query.exec("PRAGMA wal_checkpoint(TRUNCATE);");
+    }
+    status = NotActive;
+    delete commitTimer;
+    commitTimer = nullptr;
+    delete maintenanceTimer;
+    maintenanceTimer = nullptr;
+    delete queryes;
+    queryes = nullptr;
+    {
+        QSqlDatabase db = QSqlDatabase::database("history", false);
+        if (db.isOpen())
+            db.close();
+    }
+    QSqlDatabase::removeDatabase("history");
+}
+
+EDBSqLiteRecords EDBSqLiteWorker::contacts(const QString &accId, int type)
+{
+    lastActivity = QDateTime::currentDateTime();
+    EDBSqLiteRecords res;
+    EDBSqLiteWorker::PreparedQuery *query = queryes->getPreparedQuery(QueryContactsList, accId.isEmpty(), true);
     query->bindValue(":type", type);
     if (!accId.isEmpty())
         query->bindValue(":acc_id", accId);
     if (query->exec()) {
         while (query->next()) {
-            const QSqlRecord &rec = query->record();
-            res.append(ContactItem(rec.value("acc_id").toString(), XMPP::Jid(rec.value("jid").toString())));
+            res.append(query->record());
         }
         query->freeResult();
     }
     return res;
 }
 
-quint64 EDBSqLite::eventsCount(const QString &accId, const XMPP::Jid &jid)
+qulonglong EDBSqLiteWorker::eventsCount(const QString &accId, const QString &jid)
 {
-    quint64 res = 0;
+    lastActivity = QDateTime::currentDateTime();
+    qulonglong res = 0;
     bool fAccAll  = accId.isEmpty();
     bool fContAll = jid.isEmpty();
-    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryRowCount, fAccAll, fContAll);
+    EDBSqLiteWorker::PreparedQuery *query = queryes->getPreparedQuery(QueryRowCount, fAccAll, fContAll);
     if (!fAccAll)
         query->bindValue(":acc_id", accId);
     if (!fContAll)
-        query->bindValue(":jid", jid.full());
+        query->bindValue(":jid", jid);
     if (query->exec()) {
         if (query->next())
             res = query->record().value("count").toULongLong();
@@ -243,8 +743,10 @@ quint64 EDBSqLite::eventsCount(const QString &accId, const XMPP::Jid &jid)
     return res;
 }
 
-QString EDBSqLite::getStorageParam(const QString &key)
+QString EDBSqLiteWorker::getStorageParam(const QString &key)
 {
+    if (key == QLatin1String("storage_profile"))
+        return storageProfile;
     QSqlQuery query(QSqlDatabase::database("history"));
     query.prepare("SELECT `value` FROM `system` WHERE `key` = :key;");
     query.bindValue(":key", key);
@@ -253,121 +755,418 @@ QString EDBSqLite::getStorageParam(const QString &key)
     return QString();
 }
 
-void EDBSqLite::setStorageParam(const QString &key, const QString &val)
+void EDBSqLiteWorker::setStorageParam(const QString &key, const QString &val)
+{
+    transaction(true);
+    QSqlQuery query(QSqlDatabase::database("history"));
+    if (val.isEmpty()) {
+        query.prepare("DELETE FROM `system` WHERE `key` = :key;");
+        query.bindValue(":key", key);
+        query.exec();
+    }
+    else {
+        query.prepare("SELECT COUNT(*) AS `count` FROM `system` WHERE `key` = :key;");
+        query.bindValue(":key", key);
+        if (query.exec() && query.next() && query.record().value("count").toULongLong() != 0) {
+            query.prepare("UPDATE `system` SET `value` = :val WHERE `key` = :key;");
+            query.bindValue(":key", key);
+            query.bindValue(":val", val);
+            query.exec();
+        }
+        else {
+            query.prepare("INSERT INTO `system` (`key`, `value`) VALUES (:key, :val);");
+            query.bindValue(":key", key);
+            query.bindValue(":val", val);
+            query.exec();
+        }
+    }
+    commit();
+}
+
+void EDBSqLiteWorker::setInsertingMode(int mode)
+{
+    // in the case of a flow of new records
+    if (mode == EDBSqLite::Import) {
+        // Commit after 10000 inserts and every 5 seconds
+        maxUncommitedRecs = 10000;
+        maxUncommitedSecs = 5;
+    } else {
+        // Commit after 3 inserts and every 1 second
+        maxUncommitedRecs = 3;
+        maxUncommitedSecs = 1;
+    }
+    // Commit if there were no new additions for 1 second
+    commitByTimeoutSecs = 1;
+    //--
+    commit();
+    if (insertMode == EDBSqLite::Import && mode == EDBSqLite::Normal)
+        analyzePending = true; // statistics are stale after a bulk import
+    insertMode = mode;
+}
+
+void EDBSqLiteWorker::startBackgroundJobs()
+{
+    if (ftsState == FtsBackfill)
+        QTimer::singleShot(FTS_BACKFILL_DELAY, this, SLOT(backfillFullTextIndex()));
+
+    if (!maintenanceTimer) {
+        maintenanceTimer = new QTimer(this);
+        maintenanceTimer->setSingleShot(true);
+        connect(maintenanceTimer, SIGNAL(timeout()), SLOT(runMaintenance()));
+    }
+    maintenanceTimer->start(MAINT_CHECK_INTERVAL);
+}
+
+void EDBSqLiteWorker::setDefaultLifetime(int days)
+{
+    if (days != defaultLifetime) {
+        defaultLifetime = days;
+        retentionQueue.clear();
+        setStorageParam("maint_retention", QString()); // apply at the next idle time
+    }
+}
+
+bool EDBSqLiteWorker::setLifetime(const QString &accId, const QString &jid, int jidType, int days)
+{
+    if (!transaction(true))
+        return false;
+    bool res;
+    QSqlQuery query(QSqlDatabase::database("history"));
+    if (jid.isEmpty()) {
+        query.prepare("DELETE FROM `accounts` WHERE `id` = :acc_id;");
+        query.bindValue(":acc_id", accId);
+        res = query.exec();
+        if (res && days >= 0) {
+            query.prepare("INSERT INTO `accounts` (`id`, `lifetime`) VALUES (:acc_id, :lifetime);");
+            query.bindValue(":acc_id", accId);
+            query.bindValue(":lifetime", days);
+            res = query.exec();
+        }
+    } else {
+        // a contact row with its own lifetime survives erasing its history
+        const qint64 id = ensureJidRowId(accId, XMPP::Jid(jid), jidType);
+        query.prepare("UPDATE `contacts` SET `lifetime` = :lifetime WHERE `id` = :id;");
+        query.bindValue(":lifetime", days < 0 ? -1 : days);
+        query.bindValue(":id", id);
+        res = id != 0 && query.exec();
+    }
+    if (!res || !commit()) {
+        rollback();
+        return false;
+    }
+    retentionQueue.clear();
+    setStorageParam("maint_retention", QString());
+    return true;
+}
+
+int EDBSqLiteWorker::lifetime(const QString &accId, const QString &jid, int jidType)
+{
+    QSqlQuery query(QSqlDatabase::database("history"));
+    if (jid.isEmpty()) {
+        query.prepare("SELECT `lifetime` FROM `accounts` WHERE `id` = :acc_id;");
+        query.bindValue(":acc_id", accId);
+    } else {
+        const XMPP::Jid j(jid);
+        query.prepare("SELECT `lifetime` FROM `contacts` WHERE `acc_id` = :acc_id AND `jid` = :jid;");
+        query.bindValue(":acc_id", accId);
+        query.bindValue(":jid", jidType == EDB::GroupChatContact ? j.full() : j.bare());
+    }
+    if (query.exec() && query.next() && !query.value(0).isNull())
+        return query.value(0).toInt();
+    return -1;
+}
+
+/**
+ * Picks the journal and cache settings of the connection. WAL lets a
+ * commit append to the log instead of rewriting pages twice, which makes
+ * synchronous = NORMAL safe; it is refused where the file system can't
+ * share memory, and then the rollback journal stays with full syncs.
+ * The result is reported as the "storage_profile" storage param.
+ */
+void EDBSqLiteWorker::applyStorageProfile()
+{
+    QSqlQuery query(QSqlDatabase::database("history"));
+    QString journal;
+    if (query.exec("PRAGMA journal_mode = WAL;") && query.next())
+        journal = query.value(0).toString().toLower();
+    query.finish();
+    walMode = journal == QLatin1String("wal");
+
+    QStringList profile;
+    profile << "journal=" + journal;
+    if (walMode) {
+        query.exec("PRAGMA synchronous = NORMAL;");
+        query.exec(QString("PRAGMA journal_size_limit = %1;").arg(STORAGE_WAL_LIMIT));
+        profile << "synchronous=normal";
+    } else {
+        profile << "synchronous=full";
+    }
+    query.exec(QString("PRAGMA cache_size = -%1;").arg(STORAGE_CACHE_KIB));
+    profile << QString("cache=%1KiB").arg(STORAGE_CACHE_KIB);
+    if (sizeof(void*) >= 8) {
+        // a smaller value is all the library allows, report that one
+        query.exec(QString("PRAGMA mmap_size = %1;").arg(STORAGE_MMAP_BYTES));
+        profile << QString("mmap=%1").arg(pragmaValue("mmap_size"));
+    }
+    storageProfile = profile.join(' ');
+}
+
+/**
+ * Moves what the WAL holds back into the database while the history is
+ * idle, so the automatic checkpoints of a busy moment stay small and the
+ * log file doesn't keep growing between runs.
+ */
+void EDBSqLiteWorker::checkpoint()
+{
+    commit();
+    QSqlQuery query(QSqlDatabase::database("history"));
+    if (!query.exec("PRAGMA wal_checkpoint(TRUNCATE);") || !query.next()) {
+        qWarning("EDBSqLite: checkpoint failed: %s", qUtf8Printable(query.lastError().text()));
+        return;
+    }
+    // busy means a reader was in the way, try again at the next idle time
+    walDirty = query.value(0).toInt() != 0;
+}
+
+/**
+ * Runs retention, ANALYZE, incremental vacuum and integrity checks, one
+ * short step at a time and only while nothing else uses the history.
+ * Requests queued in between are served before the next step.
+ */
+void EDBSqLiteWorker::runMaintenance()
+{
+    if (status == NotActive)
+        return;
+
+    if (insertMode == EDBSqLite::Import || lastActivity.secsTo(QDateTime::currentDateTime()) < MAINT_IDLE_SECS) {
+        maintenanceTimer->start(MAINT_CHECK_INTERVAL);
+        return;
+    }
+
+    if (walDirty)
+        checkpoint();
+    else if (!retentionQueue.isEmpty() || maintenanceDue("maint_retention", 1))
+        retentionStep();
+    else if (analyzePending || maintenanceDue("maint_analyze", 30))
+        analyze();
+    else if (vacuumNeeded() && maintenanceDue("maint_vacuum_failed", 1)) {
+        if (!vacuumStep())
+            setStorageParam("maint_vacuum_failed", QDateTime::currentDateTime().toString(Qt::ISODate));
+    }
+    else if (maintenanceDue("maint_check", 7))
+        checkIntegrity();
+    else {
+        maintenanceTimer->start(MAINT_CHECK_INTERVAL);
+        return;
+    }
+    maintenanceTimer->start(MAINT_STEP_DELAY);
+}
+
+bool EDBSqLiteWorker::maintenanceDue(const QString &key, int days)
+{
+    const QDateTime last = QDateTime::fromString(getStorageParam(key), Qt::ISODate);
+    return !last.isValid() || last.daysTo(QDateTime::currentDateTime()) >= days;
+}
+
+qint64 EDBSqLiteWorker::pragmaValue(const char *name)
 {
-    transaction(true);
     QSqlQuery query(QSqlDatabase::database("history"));
-    if (val.isEmpty()) {
-        query.prepare("DELETE FROM `system` WHERE `key` = :key;");
-        query.bindValue(":key", key);
-        query.exec();
-    }
-    else {
-        query.prepare("SELECT COUNT(*) AS `count` FROM `system` WHERE `key` = :key;");
-        query.bindValue(":key", key);
-        if (query.exec() && query.next() && query.record().value("count").toULongLong() != 0) {
-            query.prepare("UPDATE `system` SET `value` = :val WHERE `key` = :key;");
-            query.bindValue(":key", key);
-            query.bindValue(":val", val);
-            query.exec();
+    if (query.exec(QString("PRAGMA %1;").arg(QLatin1String(name))) && query.next())
+        return query.value(0).toLongLong();
+    return 0;
+}
+
+void EDBSqLiteWorker::retentionStep()
+{
+    if (retentionQueue.isEmpty()) {
+        // effective lifetime: contact, then account, then the global option
+        QSqlQuery query(QSqlDatabase::database("history"));
+        if (query.exec("SELECT `c`.`id`, `c`.`lifetime`, `a`.`lifetime` FROM `contacts` AS `c`"
+                       " LEFT JOIN `accounts` AS `a` ON `a`.`id` = `c`.`acc_id`;")) {
+            const QDateTime now = QDateTime::currentDateTime();
+            while (query.next()) {
+                int days = query.value(1).toInt();
+                if (query.value(1).isNull() || days < 0)
+                    days = (query.value(2).isNull() || query.value(2).toInt() < 0) ? defaultLifetime
+                                                                                    : query.value(2).toInt();
+                if (days > 0)
+                    retentionQueue.append(qMakePair(query.value(0).toLongLong(), sortTimestamp(now.addDays(-days))));
+            }
         }
-        else {
-            query.prepare("INSERT INTO `system` (`key`, `value`) VALUES (:key, :val);");
-            query.bindValue(":key", key);
-            query.bindValue(":val", val);
-            query.exec();
+        if (retentionQueue.isEmpty()) {
+            setStorageParam("maint_retention", QDateTime::currentDateTime().toString(Qt::ISODate));
+            return;
         }
     }
-    commit();
+
+    if (!transaction(true))
+        return;
+    const QPair<qint64, qint64> item = retentionQueue.first();
+    QSqlQuery query(QSqlDatabase::database("history"));
+    query.prepare("DELETE FROM `events` WHERE `id` IN (SELECT `id` FROM `events`"
+                  " WHERE `contact_id` = :id AND `ts` < :ts LIMIT :cnt);");
+    query.bindValue(":id", item.first);
+    query.bindValue(":ts", item.second);
+    query.bindValue(":cnt", MAINT_DELETE_CHUNK);
+    if (!query.exec() || !commit()) {
+        qWarning("EDBSqLite: retention cleanup failed: %s", qUtf8Printable(query.lastError().text()));
+        rollback();
+        retentionQueue.clear();
+        setStorageParam("maint_retention", QDateTime::currentDateTime().toString(Qt::ISODate));
+        return;
+    }
+    const int deleted = query.numRowsAffected();
+    if (deleted > 0) {
+        pageCursors.clear(); // row offsets have moved
+        emit eventsExpired();
+    }
+    if (deleted < MAINT_DELETE_CHUNK) {
+        retentionQueue.removeFirst();
+        if (retentionQueue.isEmpty())
+            setStorageParam("maint_retention", QDateTime::currentDateTime().toString(Qt::ISODate));
+    }
 }
 
-void EDBSqLite::setInsertingMode(InsertMode mode)
+void EDBSqLiteWorker::analyze()
 {
-    // in the case of a flow of new records
-    if (mode == Import) {
-        // Commit after 10000 inserts and every 5 seconds
-        maxUncommitedRecs = 10000;
-        maxUncommitedSecs = 5;
-    } else {
-        // Commit after 3 inserts and every 1 second
-        maxUncommitedRecs = 3;
-        maxUncommitedSecs = 1;
-    }
-    // Commit if there were no new additions for 1 second
-    commitByTimeoutSecs = 1;
-    //--
     commit();
+    QSqlQuery query(QSqlDatabase::database("history"));
+    if (!query.exec("ANALYZE;"))
+        qWarning("EDBSqLite: ANALYZE failed: %s", qUtf8Printable(query.lastError().text()));
+    analyzePending = false;
+    setStorageParam("maint_analyze", QDateTime::currentDateTime().toString(Qt::ISODate));
 }
 
-void EDBSqLite::setMirror(EDBFlatFile *mirr)
+bool EDBSqLiteWorker::vacuumNeeded()
 {
-    if (mirr != mirror_) {
-        if (mirror_)
-            delete mirror_;
-        mirror_ = mirr;
-    }
+    const qint64 freePages = pragmaValue("freelist_count");
+    return freePages > MAINT_VACUUM_MIN_PAGES && freePages * 10 > pragmaValue("page_count");
 }
 
-EDBFlatFile *EDBSqLite::mirror() const
+bool EDBSqLiteWorker::vacuumStep()
 {
-    return mirror_;
+    if (!commit())
+        return false;
+    QSqlQuery query(QSqlDatabase::database("history"));
+    if (pragmaValue("auto_vacuum") != 2) {
+        // databases created before incremental mode need one full VACUUM to switch
+        queryes->clear();
+        if (!query.exec("PRAGMA auto_vacuum = INCREMENTAL;") || !query.exec("VACUUM;")) {
+            qWarning("EDBSqLite: VACUUM failed: %s", qUtf8Printable(query.lastError().text()));
+            return false;
+        }
+        return true;
+    }
+    if (!query.exec(QString("PRAGMA incremental_vacuum(%1);").arg(MAINT_VACUUM_PAGES)))
+        return false;
+    while (query.next()) {
+        // the pragma frees pages while it is being stepped
+    }
+    return true;
 }
 
-void EDBSqLite::performRequests()
+void EDBSqLiteWorker::checkIntegrity()
 {
-    if (rlist.isEmpty())
-        return;
+    commit();
+    QSqlQuery query(QSqlDatabase::database("history"));
+    if (query.exec("PRAGMA quick_check;")) {
+        int reported = 0;
+        while (query.next() && query.value(0).toString() != "ok" && reported++ < 10)
+            qWarning("EDBSqLite: integrity check: %s", qUtf8Printable(query.value(0).toString()));
+    }
+    setStorageParam("maint_check", QDateTime::currentDateTime().toString(Qt::ISODate));
+}
 
-    item_query_req *r = rlist.takeFirst();
+void EDBSqLiteWorker::performRequests()
+{
+    TRACE_FUNCTION();
+    lastActivity = QDateTime::currentDateTime();
+    item_query_req *r;
+    {
+        QMutexLocker locker(&rlistMutex);
+        if (rlist.isEmpty())
+            return;
+        r = rlist.takeFirst();
+    }
     const int type = r->type;
 
     if (type == item_query_req::Type_append) {
-        bool b = appendEvent(r->accId, r->j, r->event, r->jidType);
-        writeFinished(r->id, b);
+        bool b = true;
+        foreach (const EventRow &row, r->rows) {
+            if (!appendEvent(r, row)) {
+                b = false;
+                break;
+            }
+        }
+        for (auto it = pageCursors.begin(); it != pageCursors.end(); ++it)
+            it->rowCount = -1;
+        emit writeFinished(r->id, b);
     }
 
     else if (type == item_query_req::Type_get) {
         commit();
         bool fContAll = r->j.isEmpty();
         bool fAccAll  = r->accId.isEmpty();
+        // Continuing a page sequence seeks past the last returned row
+        // instead of skipping `start` rows, so deep pages cost the same.
+        const QString cursorKey = QString("%1|%2|%3|%4").arg(r->accId, r->j.full(), r->date.toString(Qt::ISODate))
+                                  .arg(r->dir);
+        PageCursor &cursor = pageCursor(cursorKey);
+        const bool fSeek = (r->start != 0 && cursor.positions.contains(r->start));
         QueryType queryType;
-        if (r->date.isNull()) {
-            if (r->dir == Forward)
+        if (fSeek) {
+            if (r->dir == EDB::Backward)
+                queryType = QuerySeekBackward;
+            else
+                queryType = QuerySeekForward;
+        } else if (r->date.isNull()) {
+            if (r->dir == EDB::Forward)
                 queryType = QueryOldest;
             else
                 queryType = QueryLatest;
         } else {
-            if (r->dir == Backward)
+            if (r->dir == EDB::Backward)
                 queryType = QueryDateBackward;
             else
                 queryType = QueryDateForward;
         }
-        EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(queryType, fAccAll, fContAll);
+        EDBSqLiteWorker::PreparedQuery *query = queryes->getPreparedQuery(queryType, fAccAll, fContAll);
         if (!fContAll)
             query->bindValue(":jid", r->j.full());
         if (!fAccAll)
             query->bindValue(":acc_id", r->accId);
-        if (!r->date.isNull())
-            query->bindValue(":date", r->date);
-        query->bindValue(":start", r->start);
+        if (fSeek) {
+            const SeekPosition &pos = cursor.positions.value(r->start);
+            query->bindValue(":seek_ts", pos.ts);
+            query->bindValue(":seek_ts_eq", pos.ts);
+            query->bindValue(":seek_id", pos.id);
+        } else {
+            if (!r->date.isNull())
+                query->bindValue(":ts", sortTimestamp(r->date));
+            query->bindValue(":start", r->start);
+        }
         query->bindValue(":cnt", r->len);
-        EDBResult result;
+        EDBSqLiteRecords result;
+        SeekPosition last = { 0, 0 };
         if (query->exec()) {
             while (query->next()) {
-                PsiEvent::Ptr e(getEvent(query->record()));
-                if (e) {
-                    QString id = query->record().value("id").toString();
-                    result.append(EDBItemPtr(new EDBItem(e, id)));
-                }
+                const QSqlRecord rec = query->record();
+                result.append(rec);
+                last.ts = rec.value("ts").toLongLong();
+                last.id = rec.value("id").toLongLong();
             }
             query->freeResult();
         }
+        if (last.id != 0)
+            cursor.positions.insert(r->start + result.size(), last);
         int beginRow;
-        if (r->dir == Forward && r->date.isNull()) {
+        if (r->dir == EDB::Forward && r->date.isNull()) {
             beginRow = r->start;
         } else {
-            int cnt = rowCount(r->accId, r->j, r->date);
-            if (r->dir == Backward) {
+            if (cursor.rowCount < 0)
+                cursor.rowCount = rowCount(r->accId, r->j, r->date);
+            int cnt = cursor.rowCount;
+            if (r->dir == EDB::Backward) {
                 beginRow = cnt - r->len + 1;
                 if (beginRow < 0)
                     beginRow = 0;
@@ -375,204 +1174,87 @@ void EDBSqLite::performRequests()
                 beginRow = cnt + 1;
             }
         }
-        resultReady(r->id, result, beginRow);
+        emit resultReady(r->id, result, beginRow);
 
     } else if(type == item_query_req::Type_find) {
         commit();
         bool fContAll = r->j.isEmpty();
         bool fAccAll  = r->accId.isEmpty();
-        EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryFindText, fAccAll, fContAll);
+        QString matchStr;
+        if (ftsState == FtsReady)
+            matchStr = fullTextMatchString(r->findStr);
+        EDBSqLiteWorker::PreparedQuery *query = queryes->getPreparedQuery(matchStr.isEmpty() ? QueryFindText : QueryFindTextIndexed,
+                                                                   fAccAll, fContAll);
+        if (!matchStr.isEmpty())
+            query->bindValue(":match", matchStr);
         if (!fContAll)
             query->bindValue(":jid", r->j.full());
         if (!fAccAll)
             query->bindValue(":acc_id", r->accId);
-        EDBResult result;
+        EDBSqLiteRecords result;
         if (query->exec()) {
             QString str = r->findStr.toLower();
             while (query->next()) {
                 const QSqlRecord rec = query->record();
                 if (!rec.value("m_text").toString().toLower().contains(str, Qt::CaseSensitive))
                     continue;
-                PsiEvent::Ptr e(getEvent(rec));
-                if (e) {
-                    QString id = rec.value("id").toString();
-                    EDBItemPtr eip = EDBItemPtr(new EDBItem(e, id));
-                    result.append(eip);
+                result.append(rec);
+                if (r->batch > 0 && result.size() == r->batch) {
+                    emit matchesReady(r->id, result);
+                    result.clear();
                 }
             }
             query->freeResult();
         }
-        resultReady(r->id, result, 0);
+        emit resultReady(r->id, result, 0);
 
     } else if(type == item_query_req::Type_erase) {
-        writeFinished(r->id, eraseHistory(r->accId, r->j));
+        pageCursors.clear();
+        emit writeFinished(r->id, eraseHistory(r->accId, r->j));
+
+    } else if(type == item_query_req::Type_contacts) {
+        emit resultReady(r->id, contacts(r->accId, r->jidType), 0);
     }
 
     delete r;
 }
 
-bool EDBSqLite::appendEvent(const QString &accId, const XMPP::Jid &jid, const PsiEvent::Ptr &e, int jidType)
+bool EDBSqLiteWorker::appendEvent(const item_query_req *r, const EventRow &row)
 {
-    QSqlDatabase db = QSqlDatabase::database("history");
-    const qint64 contactId = ensureJidRowId(accId, jid, jidType);
+    const qint64 contactId = ensureJidRowId(r->accId, r->j, r->jidType);
     if (contactId == 0)
         return false;
 
-    QDateTime dTime;
-    int nType = 0;
-
-    if (e->type() == PsiEvent::Message) {
-        MessageEvent::Ptr me = e.staticCast<MessageEvent>();
-        const Message &m = me->message();
-        dTime = m.timeStamp();
-        if (m.type() == "chat")
-            nType = 1;
-        else if(m.type() == "error")
-            nType = 4;
-        else if(m.type() == "headline")
-            nType = 5;
-
-    } else if (e->type() == PsiEvent::Auth) {
-        AuthEvent::Ptr ae = e.staticCast<AuthEvent>();
-        dTime = ae->timeStamp();
-        QString subType = ae->authType();
-        if(subType == "subscribe")
-            nType = 3;
-        else if(subType == "subscribed")
-            nType = 6;
-        else if(subType == "unsubscribe")
-            nType = 7;
-        else if(subType == "unsubscribed")
-            nType = 8;
-    } else
-        return false;
-
-    int nDirection = e->originLocal() ? 1 : 2;
     if (!transaction(false))
         return false;
 
-    PreparedQuery *query = queryes.getPreparedQuery(QueryInsertEvent, false, false);
+    PreparedQuery *query = queryes->getPreparedQuery(QueryInsertEvent, false, false);
     query->bindValue(":contact_id", contactId);
-    query->bindValue(":resource", (jidType != GroupChatContact) ? jid.resource() : "");
-    query->bindValue(":date", dTime);
-    query->bindValue(":type", nType);
-    query->bindValue(":direction", nDirection);
-    if (nType == 0 || nType == 1 || nType == 4 || nType == 5) {
-        MessageEvent::Ptr me = e.staticCast<MessageEvent>();
-        const Message &m = me->message();
-        QString lang = m.lang();
-        query->bindValue(":subject", m.subject(lang));
-        query->bindValue(":m_text", m.body(lang));
-        query->bindValue(":lang", lang);
-        QString extraData;
-        const UrlList &urls = m.urlList();
-        if (!urls.isEmpty()) {
-            QVariantMap xepList;
-            QVariantList urlList;
-            foreach (const Url &url, urls)
-                if (!url.url().isEmpty()) {
-                    QVariantList urlItem;
-                    urlItem.append(QVariant(url.url()));
-                    if (!url.desc().isEmpty())
-                        urlItem.append(QVariant(url.desc()));
-                    urlList.append(QVariant(urlItem));
-                }
-            xepList["jabber:x:oob"] = QVariant(urlList);
-            QJsonDocument doc(QJsonObject::fromVariantMap(xepList));
-            extraData = QString::fromUtf8(doc.toBinaryData());
-        }
-        query->bindValue(":extra_data", extraData);
-    }
-    else {
-        query->bindValue(":subject", QVariant(QVariant::String));
-        query->bindValue(":m_text", QVariant(QVariant::String));
-        query->bindValue(":lang", QVariant(QVariant::String));
-        query->bindValue(":extra_data", QVariant(QVariant::String));
-    }
+    query->bindValue(":resource", (r->jidType != EDB::GroupChatContact) ? r->j.resource() : "");
+    query->bindValue(":date", row.date);
+    query->bindValue(":ts", sortTimestamp(row.date));
+    query->bindValue(":type", row.type);
+    query->bindValue(":direction", row.direction);
+    query->bindValue(":subject", row.subject);
+    query->bindValue(":m_text", row.text);
+    query->bindValue(":lang", row.lang);
+    query->bindValue(":oob_urls", row.oobUrls);
+    query->bindValue(":extra_data", row.extraData);
     bool res = query->exec();
     return res;
 }
 
-PsiEvent::Ptr EDBSqLite::getEvent(const QSqlRecord &record)
-{
-    PsiAccount *pa = psi()->contactList()->getAccount(record.value("acc_id").toString());
-
-    int type = record.value("type").toInt();
-
-    if(type == 0 || type == 1 || type == 4 || type == 5) {
-        Message m;
-        m.setTimeStamp(record.value("date").toDateTime());
-        if(type == 1)
-            m.setType("chat");
-        else if(type == 4)
-            m.setType("error");
-        else if(type == 5)
-            m.setType("headline");
-        else
-            m.setType("");
-        m.setFrom(Jid(record.value("jid").toString()));
-        QVariant text = record.value("m_text");
-        if (!text.isNull()) {
-            m.setBody(text.toString());
-            m.setLang(record.value("lang").toString());
-            m.setSubject(record.value("subject").toString());
-        }
-        m.setSpooled(true);
-        QString extraStr = record.value("extra_data").toString();
-        if (!extraStr.isEmpty()) {
-            bool fOk;
-            QJsonDocument doc = QJsonDocument::fromJson(extraStr.toUtf8());
-            fOk = !doc.isNull();
-            QVariantMap extraData = doc.object().toVariantMap();
-
-            if (fOk) {
-                foreach (const QVariant &urlItem, extraData["jabber:x:oob"].toList()) {
-                    QVariantList itemList = urlItem.toList();
-                    if (!itemList.isEmpty()) {
-                        QString url = itemList.at(0).toString();
-                        QString desc;
-                        if (itemList.size() > 1)
-                            desc = itemList.at(1).toString();
-                        m.urlAdd(Url(url, desc));
-                    }
-                }
-            }
-        }
-        MessageEvent::Ptr me(new MessageEvent(m, pa));
-        me->setOriginLocal((record.value("direction").toInt() == 1));
-        return me.staticCast<PsiEvent>();
-    }
-
-    if(type == 2 || type == 3 || type == 6 || type == 7 || type == 8) {
-        QString subType = "subscribe";
-        // if(type == 2) { // Not used (stupid "system message" from Psi <= 0.8.6)
-        if(type == 3)
-            subType = "subscribe";
-        else if(type == 6)
-            subType = "subscribed";
-        else if(type == 7)
-            subType = "unsubscribe";
-        else if(type == 8)
-            subType = "unsubscribed";
-
-        AuthEvent::Ptr ae(new AuthEvent(Jid(record.value("jid").toString()), subType, pa));
-        ae->setTimeStamp(record.value("date").toDateTime());
-        return ae.staticCast<PsiEvent>();
-    }
-    return PsiEvent::Ptr();
-}
-
-qint64 EDBSqLite::ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int type)
+qint64 EDBSqLiteWorker::ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int type)
 {
     if (jid.isEmpty())
         return 0;
-    QString sJid = (type == GroupChatContact) ? jid.full() : jid.bare();
+    QString sJid = (type == EDB::GroupChatContact) ? jid.full() : jid.bare();
     QString sKey = accId + "|" + sJid;
     qint64 id = jidsCache.value(sKey, 0);
     if (id != 0)
         return id;
 
-    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryJidRowId, false, false);
+    EDBSqLiteWorker::PreparedQuery *query = queryes->getPreparedQuery(QueryJidRowId, false, false);
     query->bindValue(":jid", sJid);
     query->bindValue(":acc_id", accId);
     if (query->exec()) {
@@ -597,7 +1279,7 @@ qint64 EDBSqLite::ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int
     return id;
 }
 
-int EDBSqLite::rowCount(const QString &accId, const XMPP::Jid &jid, QDateTime before)
+int EDBSqLiteWorker::rowCount(const QString &accId, const XMPP::Jid &jid, QDateTime before)
 {
     bool fAccAll  = accId.isEmpty();
     bool fContAll = jid.isEmpty();
@@ -606,13 +1288,13 @@ int EDBSqLite::rowCount(const QString &accId, const XMPP::Jid &jid, QDateTime be
         type = QueryRowCount;
     else
         type = QueryRowCountBefore;
-    PreparedQuery *query = queryes.getPreparedQuery(type, fAccAll, fContAll);
+    PreparedQuery *query = queryes->getPreparedQuery(type, fAccAll, fContAll);
     if (!fContAll)
         query->bindValue(":jid", jid.full());
     if (!fAccAll)
         query->bindValue(":acc_id", accId);
     if (!before.isNull())
-        query->bindValue(":date", before);
+        query->bindValue(":ts", sortTimestamp(before));
     int res = 0;
     if (query->exec()) {
         if (query->next()) {
@@ -623,7 +1305,7 @@ int EDBSqLite::rowCount(const QString &accId, const XMPP::Jid &jid, QDateTime be
     return res;
 }
 
-bool EDBSqLite::eraseHistory(const QString &accId, const XMPP::Jid &jid)
+bool EDBSqLiteWorker::eraseHistory(const QString &accId, const XMPP::Jid &jid)
 {
     bool res = false;
     if (!transaction(true))
@@ -638,7 +1320,7 @@ bool EDBSqLite::eraseHistory(const QString &accId, const XMPP::Jid &jid)
             }
     }
     else {
-        PreparedQuery *query = queryes.getPreparedQuery(QueryJidRowId, false, false);
+        PreparedQuery *query = queryes->getPreparedQuery(QueryJidRowId, false, false);
         query->bindValue(":jid", jid.full());
         query->bindValue(":acc_id", accId);
         if (query->exec()) {
@@ -668,7 +1350,7 @@ bool EDBSqLite::eraseHistory(const QString &accId, const XMPP::Jid &jid)
     return res;
 }
 
-bool EDBSqLite::transaction(bool now)
+bool EDBSqLiteWorker::transaction(bool now)
 {
     if (status == NotActive)
         return false;
@@ -689,10 +1371,12 @@ bool EDBSqLite::transaction(bool now)
     return true;
 }
 
-bool EDBSqLite::commit()
+bool EDBSqLiteWorker::commit()
 {
     if (status != NotActive) {
         if (status == Commited || QSqlDatabase::database("history").commit()) {
+            if (status == NotCommited)
+                walDirty = walMode;
             transactionsCounter = 0;
             lastCommitTime = QDateTime::currentDateTime();
             status = Commited;
@@ -703,7 +1387,7 @@ bool EDBSqLite::commit()
     return false;
 }
 
-bool EDBSqLite::rollback()
+bool EDBSqLiteWorker::rollback()
 {
     if (status == NotCommited && QSqlDatabase::database("history").rollback()) {
         transactionsCounter = 0;
@@ -715,7 +1399,7 @@ bool EDBSqLite::rollback()
     return false;
 }
 
-void EDBSqLite::startAutocommitTimer()
+void EDBSqLiteWorker::startAutocommitTimer()
 {
     if (!commitTimer) {
         commitTimer = new QTimer(this);
@@ -726,58 +1410,235 @@ void EDBSqLite::startAutocommitTimer()
     commitTimer->start();
 }
 
-void EDBSqLite::stopAutocommitTimer()
+void EDBSqLiteWorker::stopAutocommitTimer()
 {
     if (commitTimer && commitTimer->isActive())
         commitTimer->stop();
 }
 
-bool EDBSqLite::importExecute()
+EDBSqLiteWorker::PageCursor &EDBSqLiteWorker::pageCursor(const QString &key)
 {
-    bool res = true;
-    HistoryImport *imp = new HistoryImport(psi());
-    if (imp->isNeeded()) {
-        if (imp->exec() != HistoryImport::ResultNormal) {
-            res = false;
-        }
+    if (!pageCursors.contains(key) && pageCursors.size() >= MAX_PAGE_CURSORS)
+        pageCursors.clear();
+    return pageCursors[key];
+}
+
+qint64 EDBSqLiteWorker::sortTimestamp(const QDateTime &dt)
+{
+    // Must give the same value as strftime('%s', `date`) in migrateTimestamps():
+    // local times are stored without an offset and SQLite reads them as UTC.
+    if (dt.timeSpec() == Qt::LocalTime)
+        return QDateTime(dt.date(), dt.time(), Qt::UTC).toMSecsSinceEpoch() / 1000;
+    return dt.toMSecsSinceEpoch() / 1000;
+}
+
+bool EDBSqLiteWorker::migrateTimestamps()
+{
+    qWarning("EDBSqLite: upgrading history database, this may take a while");
+    if (!transaction(true))
+        return false;
+    QSqlQuery query(QSqlDatabase::database("history"));
+    bool res = query.exec("ALTER TABLE `events` ADD COLUMN `ts` INTEGER;")
+        && query.exec("UPDATE `events` SET `ts` = CAST(strftime('%s', `date`) AS INTEGER);")
+        && query.exec("DROP INDEX IF EXISTS `contact_id`;")
+        && query.exec("DROP INDEX IF EXISTS `date`;")
+        && query.exec("CREATE INDEX `contact_ts` ON `events` (`contact_id`, `ts`);")
+        && query.exec("CREATE INDEX `ts` ON `events` (`ts`);");
+    if (!res) {
+        qWarning("EDBSqLite: database upgrade failed: %s", qUtf8Printable(query.lastError().text()));
+        rollback();
+        return false;
     }
-    delete imp;
-    return res;
+    if (!commit())
+        return false;
+    setStorageParam("version", "0.2");
+    return true;
+}
+
+/**
+ * Moves jabber:x:oob links out of the JSON `extra_data` column into
+ * `oob_urls`, so reading a row no longer needs a JSON parser.
+ */
+bool EDBSqLiteWorker::migrateExtraData()
+{
+    qWarning("EDBSqLite: upgrading history database, this may take a while");
+    if (!transaction(true))
+        return false;
+    QSqlDatabase db = QSqlDatabase::database("history");
+    QSqlQuery query(db);
+    QSqlQuery update(db);
+    bool res = query.exec("ALTER TABLE `events` ADD COLUMN `oob_urls` TEXT;")
+        && update.prepare("UPDATE `events` SET `oob_urls` = :oob_urls, `extra_data` = :extra_data WHERE `id` = :id;")
+        && query.exec("SELECT `id`, `extra_data` FROM `events` WHERE `extra_data` IS NOT NULL AND `extra_data` != '';");
+    while (res && query.next()) {
+        const QString extra = query.value(1).toString();
+        const QString urls = urlsFromExtraData(extra);
+        update.bindValue(":id", query.value(0));
+        update.bindValue(":oob_urls", urls.isEmpty() ? QVariant(QVariant::String) : QVariant(urls));
+        // keep what we can not interpret rather than lose it
+        update.bindValue(":extra_data", urls.isEmpty() ? QVariant(extra) : QVariant(QVariant::String));
+        res = update.exec();
+    }
+    if (!res) {
+        qWarning("EDBSqLite: database upgrade failed: %s",
+                 qUtf8Printable((update.lastError().isValid() ? update : query).lastError().text()));
+        rollback();
+        return false;
+    }
+    if (!commit())
+        return false;
+    setStorageParam("version", "0.3");
+    return true;
+}
+
+void EDBSqLiteWorker::ensureFullTextIndex()
+{
+    QSqlDatabase db = QSqlDatabase::database("history");
+    if (db.tables(QSql::Tables).contains("events_fts")) {
+        ftsTrigram = (getStorageParam("fts_tokenizer") == "trigram");
+        ftsState = getStorageParam("fts_backfill_end").isEmpty() ? FtsReady : FtsBackfill;
+        return;
+    }
+
+    if (!transaction(true))
+        return;
+    QSqlQuery query(db);
+    // The trigram tokenizer matches arbitrary substrings just like the old scan did.
+    // Older SQLite builds only have word tokenizers, so fall back to prefix matching there.
+    ftsTrigram = query.exec("CREATE VIRTUAL TABLE `events_fts` USING fts5("
+        "`m_text`, content='events', content_rowid='id', tokenize='trigram');");
+    if (!ftsTrigram && !query.exec("CREATE VIRTUAL TABLE `events_fts` USING fts5("
+            "`m_text`, content='events', content_rowid='id', tokenize='unicode61');")) {
+        qWarning("EDBSqLite: full-text search is not available: %s", qUtf8Printable(query.lastError().text()));
+        rollback();
+        return;
+    }
+    // Rows between fts_backfill_pos and fts_backfill_end are not indexed yet,
+    // so the delete trigger must not try to remove them from the index.
+    bool res = query.exec("CREATE TRIGGER `events_fts_insert` AFTER INSERT ON `events`"
+            " WHEN new.`m_text` IS NOT NULL BEGIN"
+            " INSERT INTO `events_fts` (rowid, `m_text`) VALUES (new.`id`, new.`m_text`);"
+            " END;")
+        && query.exec("CREATE TRIGGER `events_fts_delete` AFTER DELETE ON `events`"
+            " WHEN old.`m_text` IS NOT NULL AND ("
+            "old.`id` > COALESCE((SELECT CAST(`value` AS INTEGER) FROM `system` WHERE `key` = 'fts_backfill_end'), 0)"
+            " OR old.`id` <= COALESCE((SELECT CAST(`value` AS INTEGER) FROM `system` WHERE `key` = 'fts_backfill_pos'), old.`id`)"
+            ") BEGIN"
+            " INSERT INTO `events_fts` (`events_fts`, rowid, `m_text`) VALUES ('delete', old.`id`, old.`m_text`);"
+            " END;");
+    qint64 lastId = 0;
+    if (res && query.exec("SELECT MAX(`id`) AS `max_id` FROM `events`;") && query.next())
+        lastId = query.record().value("max_id").toLongLong();
+    if (!res || !commit()) {
+        qWarning("EDBSqLite: can't create full-text index: %s", qUtf8Printable(query.lastError().text()));
+        rollback();
+        return;
+    }
+
+    setStorageParam("fts_tokenizer", ftsTrigram ? "trigram" : "unicode61");
+    if (lastId > 0) {
+        setStorageParam("fts_backfill_pos", "0");
+        setStorageParam("fts_backfill_end", QString::number(lastId));
+        ftsState = FtsBackfill;
+    }
+    else
+        ftsState = FtsReady;
+}
+
+void EDBSqLiteWorker::backfillFullTextIndex()
+{
+    if (ftsState != FtsBackfill)
+        return;
+
+    const qint64 pos  = getStorageParam("fts_backfill_pos").toLongLong();
+    const qint64 end  = getStorageParam("fts_backfill_end").toLongLong();
+    const qint64 next = qMin<qint64>(pos + FTS_BACKFILL_CHUNK, end);
+    if (!transaction(true))
+        return;
+
+    QSqlQuery query(QSqlDatabase::database("history"));
+    query.prepare("INSERT INTO `events_fts` (rowid, `m_text`)"
+        " SELECT `id`, `m_text` FROM `events`"
+        " WHERE `id` > :pos AND `id` <= :next AND `m_text` IS NOT NULL;");
+    query.bindValue(":pos", pos);
+    query.bindValue(":next", next);
+    bool res = query.exec();
+    if (res) {
+        query.prepare("UPDATE `system` SET `value` = :val WHERE `key` = 'fts_backfill_pos';");
+        query.bindValue(":val", QString::number(next));
+        res = query.exec();
+    }
+    if (!res || !commit()) {
+        qWarning("EDBSqLite: full-text index backfill failed: %s", qUtf8Printable(query.lastError().text()));
+        rollback();
+        ftsState = FtsNone;
+        return;
+    }
+
+    if (next >= end) {
+        setStorageParam("fts_backfill_end", QString());
+        setStorageParam("fts_backfill_pos", QString());
+        ftsState = FtsReady;
+        return;
+    }
+    QTimer::singleShot(FTS_BACKFILL_DELAY, this, SLOT(backfillFullTextIndex()));
+}
+
+QString EDBSqLiteWorker::fullTextMatchString(const QString &str) const
+{
+    // Returns an empty string if the index can't answer this query.
+    // The result is always filtered by the exact substring afterwards.
+    if (ftsTrigram) {
+        if (str.length() < 3)
+            return QString();
+        return QString("\"%1\"").arg(QString(str).replace('"', "\"\""));
+    }
+
+    QStringList terms;
+    foreach (const QString &word, str.split(QRegExp("\\s+"), QString::SkipEmptyParts))
+        terms.append(QString("\"%1\"*").arg(QString(word).replace('"', "\"\"")));
+    return terms.join(' ');
 }
 
 // ****************** class PreparedQueryes ********************
 
-EDBSqLite::QueryStorage::QueryStorage()
+EDBSqLiteWorker::QueryStorage::QueryStorage()
+{
+}
+
+EDBSqLiteWorker::QueryStorage::~QueryStorage()
 {
+    clear();
 }
 
-EDBSqLite::QueryStorage::~QueryStorage()
+void EDBSqLiteWorker::QueryStorage::clear()
 {
-    foreach (EDBSqLite::PreparedQuery *q, queryList.values()) {
+    foreach (EDBSqLiteWorker::PreparedQuery *q, queryList.values()) {
         if (q)
             delete q;
     }
+    queryList.clear();
 }
 
-EDBSqLite::PreparedQuery *EDBSqLite::QueryStorage::getPreparedQuery(QueryType type, bool allAccounts, bool allContacts)
+EDBSqLiteWorker::PreparedQuery *EDBSqLiteWorker::QueryStorage::getPreparedQuery(QueryType type, bool allAccounts, bool allContacts)
 {
     QueryProperty queryProp(type, allAccounts, allContacts);
-    EDBSqLite::PreparedQuery *q = queryList.value(queryProp, nullptr);
+    EDBSqLiteWorker::PreparedQuery *q = queryList.value(queryProp, nullptr);
     if (q != nullptr)
         return q;
 
-    q = new EDBSqLite::PreparedQuery(QSqlDatabase::database("history"));
+    q = new EDBSqLiteWorker::PreparedQuery(QSqlDatabase::database("history"));
     q->setForwardOnly(true);
     q->prepare(getQueryString(type, allAccounts, allContacts));
     queryList[queryProp] = q;
     return q;
 }
 
-EDBSqLite::PreparedQuery::PreparedQuery(QSqlDatabase db) : QSqlQuery(db)
+EDBSqLiteWorker::PreparedQuery::PreparedQuery(QSqlDatabase db) : QSqlQuery(db)
 {
 }
 
-QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts, bool allContacts)
+QString EDBSqLiteWorker::QueryStorage::getQueryString(QueryType type, bool allAccounts, bool allContacts)
 {
     QString queryStr;
     switch (type)
@@ -792,7 +1653,9 @@ QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts
         case QueryOldest:
         case QueryDateBackward:
         case QueryDateForward:
-            queryStr = "SELECT `acc_id`, `events`.`id`, `jid`, `date`, `events`.`type`, `direction`, `subject`, `m_text`, `lang`, `extra_data`"
+        case QuerySeekBackward:
+        case QuerySeekForward:
+            queryStr = "SELECT `acc_id`, `events`.`id`, `jid`, `date`, `ts`, `events`.`type`, `direction`, `subject`, `m_text`, `lang`, `oob_urls`, `extra_data`"
                 " FROM `events`, `contacts`"
                 " WHERE `contacts`.`id` = `contact_id`";
             if (!allContacts)
@@ -800,14 +1663,21 @@ QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts
             if (!allAccounts)
                 queryStr.append(" AND `acc_id` = :acc_id");
             if (type == QueryDateBackward)
-                queryStr.append(" AND `date` < :date");
+                queryStr.append(" AND `ts` < :ts");
             else if (type == QueryDateForward)
-                queryStr.append(" AND `date` >= :date");
-            if (type == QueryLatest || type == QueryDateBackward)
-                queryStr.append(" ORDER BY `date` DESC");
+                queryStr.append(" AND `ts` >= :ts");
+            else if (type == QuerySeekBackward)
+                queryStr.append(" AND (`ts` < :seek_ts OR (`ts` = :seek_ts_eq AND `events`.`id` < :seek_id))");
+            else if (type == QuerySeekForward)
+                queryStr.append(" AND (`ts` > :seek_ts OR (`ts` = :seek_ts_eq AND `events`.`id` > :seek_id))");
+            if (type == QueryLatest || type == QueryDateBackward || type == QuerySeekBackward)
+                queryStr.append(" ORDER BY `ts` DESC, `events`.`id` DESC");
             else
-                queryStr.append(" ORDER BY `date` ASC");
-            queryStr.append(" LIMIT :start, :cnt;");
+                queryStr.append(" ORDER BY `ts` ASC, `events`.`id` ASC");
+            if (type == QuerySeekBackward || type == QuerySeekForward)
+                queryStr.append(" LIMIT :cnt;");
+            else
+                queryStr.append(" LIMIT :start, :cnt;");
             break;
         case QueryRowCount:
         case QueryRowCountBefore:
@@ -819,14 +1689,14 @@ QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts
             if (!allAccounts)
                 queryStr.append(" AND `acc_id` = :acc_id");
             if (type == QueryRowCountBefore)
-                queryStr.append(" AND `date` < :date");
+                queryStr.append(" AND `ts` < :ts");
             queryStr.append(";");
             break;
         case QueryJidRowId:
             queryStr = "SELECT `id` FROM `contacts` WHERE `jid` = :jid AND acc_id = :acc_id;";
             break;
         case QueryFindText:
-            queryStr = "SELECT `acc_id`, `events`.`id`, `jid`, `date`, `events`.`type`, `direction`, `subject`, `m_text`, `lang`, `extra_data`"
+            queryStr = "SELECT `acc_id`, `events`.`id`, `jid`, `date`, `events`.`type`, `direction`, `subject`, `m_text`, `lang`, `oob_urls`, `extra_data`"
                 " FROM `events`, `contacts`"
                 " WHERE `contacts`.`id` = `contact_id`";
             if (!allContacts)
@@ -834,13 +1704,25 @@ QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts
             if (!allAccounts)
                 queryStr.append(" AND `acc_id` = :acc_id");
             queryStr.append(" AND `m_text` IS NOT NULL");
-            queryStr.append(" ORDER BY `date`;");
+            queryStr.append(" ORDER BY `ts`, `events`.`id`;");
+            break;
+        case QueryFindTextIndexed:
+            queryStr = "SELECT `acc_id`, `events`.`id`, `jid`, `date`, `events`.`type`, `direction`, `subject`, `events`.`m_text`, `lang`, `oob_urls`, `extra_data`"
+                " FROM `events_fts`"
+                " JOIN `events` ON `events`.`id` = `events_fts`.rowid"
+                " JOIN `contacts` ON `contacts`.`id` = `contact_id`"
+                " WHERE `events_fts` MATCH :match";
+            if (!allContacts)
+                queryStr.append(" AND `jid` = :jid");
+            if (!allAccounts)
+                queryStr.append(" AND `acc_id` = :acc_id");
+            queryStr.append(" ORDER BY `ts`, `events`.`id`;");
             break;
         case QueryInsertEvent:
             queryStr = "INSERT INTO `events` ("
-                "`contact_id`, `resource`, `date`, `type`, `direction`, `subject`, `m_text`, `lang`, `extra_data`"
+                "`contact_id`, `resource`, `date`, `ts`, `type`, `direction`, `subject`, `m_text`, `lang`, `oob_urls`, `extra_data`"
                 ") VALUES ("
-                ":contact_id, :resource, :date, :type, :direction, :subject, :m_text, :lang, :extra_data"
+                ":contact_id, :resource, :date, :ts, :type, :direction, :subject, :m_text, :lang, :oob_urls, :extra_data"
                 ");";
             break;
     }
@@ -27,10 +27,14 @@
 
 #include <QDateTime>
 #include <QHash>
+#include <QMetaType>
+#include <QMutex>
 #include <QObject>
+#include <QSet>
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlRecord>
+#include <QThread>
 #include <QTimer>
 #include <QVariant>
 
@@ -38,7 +42,8 @@ enum QueryType {
     QueryContactsList,
     QueryLatest, QueryOldest,
     QueryDateForward, QueryDateBackward,
-    QueryFindText,
+    QuerySeekForward, QuerySeekBackward,
+    QueryFindText, QueryFindTextIndexed,
     QueryRowCount, QueryRowCountBefore,
     QueryJidRowId,
     QueryInsertEvent
@@ -60,7 +65,15 @@ struct QueryProperty
 };
 uint qHash(const QueryProperty &struc);
 
-class EDBSqLite : public EDB
+typedef QList<QSqlRecord> EDBSqLiteRecords;
+Q_DECLARE_METATYPE(EDBSqLiteRecords)
+
+/**
+ * Owns the "history" database connection and executes all SQL.
+ * Lives in its own thread; EDBSqLite talks to it only through
+ * queued requests and blocking invocations of its Q_INVOKABLE methods.
+ */
+class EDBSqLiteWorker : public QObject
 {
     Q_OBJECT
 
@@ -86,6 +99,7 @@ class EDBSqLite : public EDB
         QueryStorage();
         ~QueryStorage();
         PreparedQuery *getPreparedQuery(QueryType type, bool allAccounts, bool allContacts);
+        void clear();
     private:
         QString getQueryString(QueryType type, bool allAccounts, bool allContacts);
     private:
@@ -94,43 +108,72 @@ class EDBSqLite : public EDB
     //--------
 
 public:
-    enum InsertMode { Normal, Import };
-
-    EDBSqLite(PsiCon *psi);
-    ~EDBSqLite();
-    bool init();
-
-    int features() const;
-    int get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int start, int len);
-    int find(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date, int direction);
-    int append(const QString &accId, const XMPP::Jid &jid, const PsiEvent::Ptr &e, int type);
-    int erase(const QString &accId, const XMPP::Jid &jid);
-    QList<ContactItem> contacts(const QString &accId, int type);
-    quint64 eventsCount(const QString &accId, const XMPP::Jid &jid);
-    QString getStorageParam(const QString &key);
-    void setStorageParam(const QString &key, const QString &val);
-
-    void setInsertingMode(InsertMode mode);
-    void setMirror(EDBFlatFile *mirr);
-    EDBFlatFile *mirror() const;
+    // event fields for Type_append, extracted in the GUI thread
+    struct EventRow
+    {
+        QDateTime date;
+        int type;
+        int direction;
+        QVariant subject;
+        QVariant text;
+        QVariant lang;
+        QVariant oobUrls;
+        QVariant extraData;
+    };
 
-private:
-    enum { NotActive, NotCommited, Commited };
     struct item_query_req
     {
         QString accId;
         XMPP::Jid j;
         int jidType;
-        int type; // 0 = latest, 1 = oldest, 2 = random, 3 = write
+        int type;
         int start;
         int len;
         int dir;
         int id;
         QDateTime date;
         QString findStr;
-        PsiEvent::Ptr event;
+        int batch; // Type_find: hits per matchesReady(), 0 for the result only
+        QList<EventRow> rows;
+
+        enum Type { Type_get, Type_append, Type_find, Type_erase, Type_contacts };
+    };
+
+    EDBSqLiteWorker();
+    ~EDBSqLiteWorker();
+
+    void enqueue(item_query_req *r);
 
-        enum Type { Type_get, Type_append, Type_find, Type_erase };
+    Q_INVOKABLE bool open();
+    Q_INVOKABLE void close();
+    Q_INVOKABLE EDBSqLiteRecords contacts(const QString &accId, int type);
+    Q_INVOKABLE qulonglong eventsCount(const QString &accId, const QString &jid);
+    Q_INVOKABLE QString getStorageParam(const QString &key);
+    Q_INVOKABLE void setStorageParam(const QString &key, const QString &val);
+    Q_INVOKABLE void setInsertingMode(int mode);
+    Q_INVOKABLE void startBackgroundJobs();
+    Q_INVOKABLE void setDefaultLifetime(int days);
+    Q_INVOKABLE bool setLifetime(const QString &accId, const QString &jid, int jidType, int days);
+    Q_INVOKABLE int lifetime(const QString &accId, const QString &jid, int jidType);
+
+signals:
+    void resultReady(int id, const EDBSqLiteRecords &records, int beginRow);
+    void matchesReady(int id, const EDBSqLiteRecords &records);
+    void writeFinished(int id, bool success);
+    void eventsExpired();
+
+private:
+    enum { NotActive, NotCommited, Commited };
+    enum FtsState { FtsNone, FtsBackfill, FtsReady };
+    struct SeekPosition
+    {
+        qint64 ts;
+        qint64 id;
+    };
+    struct PageCursor
+    {
+        QHash<int, SeekPosition> positions; // row offset -> last row of the previous page
+        int rowCount = -1;
     };
     int  status;
     unsigned int transactionsCounter;
@@ -139,14 +182,25 @@ private:
     int maxUncommitedSecs;
     unsigned int commitByTimeoutSecs;
     QTimer *commitTimer;
-    EDBFlatFile *mirror_;
+    QMutex rlistMutex;
     QList<item_query_req*> rlist;
     QHash<QString, qint64>jidsCache;
-    QueryStorage queryes;
+    QHash<QString, PageCursor> pageCursors;
+    QueryStorage *queryes;
+    FtsState ftsState;
+    bool ftsTrigram;
+    int insertMode;
+    int defaultLifetime;
+    QDateTime lastActivity;
+    QTimer *maintenanceTimer;
+    QList<QPair<qint64, qint64> > retentionQueue; // contact row id -> oldest ts to keep
+    bool analyzePending;
+    QString storageProfile; // what applyStorageProfile() ended up with
+    bool walMode;
+    bool walDirty;          // commits since the last checkpoint
 
 private:
-    bool appendEvent(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
-    PsiEvent::Ptr getEvent(const QSqlRecord &record);
+    bool appendEvent(const item_query_req *r, const EventRow &row);
     qint64 ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int type);
     int  rowCount(const QString &accId, const XMPP::Jid &jid, const QDateTime before);
     bool eraseHistory(const QString &accId, const XMPP::Jid &);
@@ -154,11 +208,100 @@ private:
     bool rollback();
     void startAutocommitTimer();
     void stopAutocommitTimer();
-    bool importExecute();
+    bool migrateTimestamps();
+    bool migrateExtraData();
+    PageCursor &pageCursor(const QString &key);
+    static qint64 sortTimestamp(const QDateTime &dt);
+    void ensureFullTextIndex();
+    QString fullTextMatchString(const QString &str) const;
+    bool maintenanceDue(const QString &key, int days);
+    qint64 pragmaValue(const char *name);
+    bool vacuumNeeded();
+    void retentionStep();
+    bool vacuumStep();
+    void analyze();
+    void checkIntegrity();
+    void applyStorageProfile();
+    void checkpoint();
 
 private slots:
     void performRequests();
     bool commit();
+    void backfillFullTextIndex();
+    void runMaintenance();
+};
+
+class EDBSqLite : public EDB
+{
+    Q_OBJECT
+
+public:
+    enum InsertMode { Normal, Import };
+
+    EDBSqLite(PsiCon *psi);
+    ~EDBSqLite();
+    bool init();
+
+    int features() const;
+    int get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int start, int len);
+    int find(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date, int direction);
+    int findMatches(const QString &accId, const QString &str, const XMPP::Jid &jid);
+    int append(const QString &accId, const XMPP::Jid &jid, const PsiEvent::Ptr &e, int type);
+    int appendBatch(const QString &accId, const XMPP::Jid &jid, const QList<PsiEvent::Ptr> &events, int type);
+    int erase(const QString &accId, const XMPP::Jid &jid);
+    QList<ContactItem> contacts(const QString &accId, int type);
+    quint64 eventsCount(const QString &accId, const XMPP::Jid &jid);
+    QString getStorageParam(const QString &key);
+    void setStorageParam(const QString &key, const QString &val);
+
+    void setInsertingMode(InsertMode mode);
+    // days to keep history for an account (empty jid) or contact;
+    // -1 inherits the account / global setting, 0 keeps everything
+    void setLifetime(const QString &accId, const XMPP::Jid &jid, int days, int type = EDB::Contact);
+    int lifetime(const QString &accId, const XMPP::Jid &jid, int type = EDB::Contact);
+    void setMirror(EDBFlatFile *mirr);
+    EDBFlatFile *mirror() const;
+
+protected:
+    int requestContacts(const QString &accId, int type);
+
+private:
+    typedef EDBSqLiteWorker::item_query_req item_query_req;
+
+    // contacts with history, kept up to date by our own writes
+    struct ContactList
+    {
+        QList<ContactItem> items;
+        QSet<QString> ids;
+    };
+
+    bool active;
+    QThread *workerThread;
+    EDBSqLiteWorker *worker;
+    EDBFlatFile *mirror_;
+    QHash<QString, ContactList> contactsCache; // "acc_id|type", all accounts with an empty acc_id
+    QHash<int, QString> pendingContacts; // request id -> cache key
+
+private:
+    static QString contactsKey(const QString &accId, int type);
+    static QList<ContactItem> contactItems(const EDBSqLiteRecords &records);
+    void cacheContacts(const QString &key, const QList<ContactItem> &items);
+    void contactAppended(const QString &accId, const XMPP::Jid &jid, int type);
+    void dropContactsCache();
+    PsiEvent::Ptr getEvent(const QSqlRecord &record);
+    static bool makeEventRow(const PsiEvent::Ptr &e, EDBSqLiteWorker::EventRow *row);
+    EDBResult eventItems(const EDBSqLiteRecords &records);
+    int enqueueFind(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date,
+                    int direction, int batch);
+    int failedWrite();
+    bool importExecute();
+
+private slots:
+    void workerResultReady(int id, const EDBSqLiteRecords &records, int beginRow);
+    void workerMatchesReady(int id, const EDBSqLiteRecords &records);
+    void workerWriteFinished(int id, bool success);
+    void workerEventsExpired();
+    void optionChanged(const QString &option);
 };
 
 #endif // EDBSQLITE_H
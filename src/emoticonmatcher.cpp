@@ -0,0 +1,125 @@
+/*
+ * emoticonmatcher.cpp - multi-pattern emoticon text matcher
+ * Copyright (C) 2020  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "emoticonmatcher.h"
+
+#include "iconset.h"
+
+#include <QQueue>
+
+#include <algorithm>
+
+EmoticonMatcher::EmoticonMatcher() { clear(); }
+
+void EmoticonMatcher::clear()
+{
+    nodes_.clear();
+    nodes_.append(Node()); // root
+    patternLength_.clear();
+    patternIcon_.clear();
+}
+
+bool EmoticonMatcher::isEmpty() const { return patternIcon_.isEmpty(); }
+
+int EmoticonMatcher::addPattern(const QString &text, PsiIcon *icon)
+{
+    int state = 0;
+    for (const QChar &c : text) {
+        int next = nodes_[state].next.value(c, -1);
+        if (next == -1) {
+            next = nodes_.size();
+            nodes_.append(Node());
+            nodes_[state].next.insert(c, next);
+        }
+        state = next;
+    }
+
+    // the first iconset providing a text wins, as it did with the regexps
+    if (nodes_[state].pattern == -1) {
+        nodes_[state].pattern = patternIcon_.size();
+        patternLength_.append(text.length());
+        patternIcon_.append(icon);
+    }
+    return state;
+}
+
+void EmoticonMatcher::build(const QList<Iconset *> &iconsets)
+{
+    clear();
+
+    foreach (const Iconset *iconset, iconsets) {
+        QListIterator<PsiIcon *> it = iconset->iterator();
+        while (it.hasNext()) {
+            PsiIcon *icon = it.next();
+            foreach (const PsiIcon::IconText &t, icon->text()) {
+                if (!t.text.isEmpty())
+                    addPattern(t.text, icon);
+            }
+        }
+    }
+
+    // breadth-first construction of failure and dictionary links
+    QQueue<int> queue;
+    foreach (int child, nodes_[0].next)
+        queue.enqueue(child);
+
+    while (!queue.isEmpty()) {
+        int  state = queue.dequeue();
+        auto it    = nodes_[state].next.constBegin();
+        for (; it != nodes_[state].next.constEnd(); ++it) {
+            const QChar c     = it.key();
+            const int   child = it.value();
+
+            int f = nodes_[state].fail;
+            while (f != 0 && !nodes_[f].next.contains(c))
+                f = nodes_[f].fail;
+            f = nodes_[f].next.value(c, 0);
+
+            nodes_[child].fail = f;
+            nodes_[child].dict = nodes_[f].pattern != -1 ? f : nodes_[f].dict;
+            queue.enqueue(child);
+        }
+    }
+}
+
+QList<EmoticonMatcher::Match> EmoticonMatcher::findAll(const QString &text) const
+{
+    QList<Match> matches;
+    if (isEmpty())
+        return matches;
+
+    int state = 0;
+    for (int i = 0; i < text.length(); ++i) {
+        const QChar c = text.at(i);
+        while (state != 0 && !nodes_[state].next.contains(c))
+            state = nodes_[state].fail;
+        state = nodes_[state].next.value(c, 0);
+
+        for (int s = nodes_[state].pattern != -1 ? state : nodes_[state].dict; s != -1; s = nodes_[s].dict) {
+            const int p   = nodes_[s].pattern;
+            const int len = patternLength_[p];
+            matches.append({ i - len + 1, len, patternIcon_[p] });
+        }
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const Match &a, const Match &b) {
+        return a.pos < b.pos || (a.pos == b.pos && a.length > b.length);
+    });
+    return matches;
+}
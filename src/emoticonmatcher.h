@@ -0,0 +1,67 @@
+/*
+ * emoticonmatcher.h - multi-pattern emoticon text matcher
+ * Copyright (C) 2020  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EMOTICONMATCHER_H
+#define EMOTICONMATCHER_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+class Iconset;
+class PsiIcon;
+
+/**
+ * Aho-Corasick automaton over the texts of all emoticons, so a message
+ * can be searched for every emoticon in a single pass.
+ */
+class EmoticonMatcher {
+public:
+    struct Match {
+        int      pos;
+        int      length;
+        PsiIcon *icon;
+    };
+
+    EmoticonMatcher();
+
+    void build(const QList<Iconset *> &iconsets);
+    void clear();
+    bool isEmpty() const;
+
+    // all occurrences ordered by position, longest first on equal position
+    QList<Match> findAll(const QString &text) const;
+
+private:
+    struct Node {
+        QHash<QChar, int> next;
+        int               fail    = 0;
+        int               dict    = -1; // nearest suffix node which ends a pattern
+        int               pattern = -1;
+    };
+
+    int addPattern(const QString &text, PsiIcon *icon);
+
+    QVector<Node>      nodes_;
+    QVector<int>       patternLength_;
+    QVector<PsiIcon *> patternIcon_;
+};
+
+#endif // EMOTICONMATCHER_H
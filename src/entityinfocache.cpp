@@ -0,0 +1,176 @@
+/*
+ * entityinfocache.cpp - client version, time and last activity of entities
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "entityinfocache.h"
+
+#include "lastactivitytask.h"
+#include "xmpp_caps.h"
+#include "xmpp_client.h"
+#include "xmpp_resource.h"
+#include "xmpp_tasks.h"
+
+using namespace XMPP;
+
+static const int versionTtl  = 30 * 60 * 1000; // msecs
+static const int timeTtl     = 30 * 60 * 1000;
+static const int activityTtl = 60 * 1000;
+static const int errorTtl    = 60 * 1000; // so a client without support isn't asked on every hover
+static const int maxEntries  = 2000;
+
+static const char kindPrefix[] = { 'v', 't', 'l' };
+
+static QString keyOf(EntityInfoCache::Kind kind, const Jid &jid)
+{
+    return QLatin1Char(kindPrefix[kind]) + jid.full();
+}
+
+EntityInfoCache::EntityInfoCache(Client *client, QObject *parent) : QObject(parent), client_(client)
+{
+    clock_.start();
+    connect(client->capsManager(), SIGNAL(capsChanged(const Jid &)), SLOT(capsChanged(const Jid &)));
+    connect(client, SIGNAL(resourceAvailable(const Jid &, const Resource &)),
+            SLOT(resourceAvailable(const Jid &, const Resource &)));
+    connect(client, SIGNAL(resourceUnavailable(const Jid &, const Resource &)),
+            SLOT(resourceUnavailable(const Jid &, const Resource &)));
+}
+
+bool EntityInfoCache::cached(Kind kind, const Jid &jid, Info *info) const
+{
+    auto entry = entries_.constFind(keyOf(kind, jid));
+    if (entry == entries_.constEnd() || entry->expires <= clock_.elapsed())
+        return false;
+    *info = entry->info;
+    return true;
+}
+
+void EntityInfoCache::query(Kind kind, const Jid &jid, QObject *context, Callback done)
+{
+    Info info;
+    if (cached(kind, jid, &info)) {
+        done(info);
+        return;
+    }
+
+    const QString key     = keyOf(kind, jid);
+    auto          waiting = waiting_.find(key);
+    if (waiting != waiting_.end()) {
+        waiting->append(Waiter { context, done });
+        return;
+    }
+    waiting_[key].append(Waiter { context, done });
+
+    Task *task;
+    if (kind == Version) {
+        JT_ClientVersion *jt = new JT_ClientVersion(client_->rootTask());
+        jt->get(jid);
+        task = jt;
+    } else if (kind == Time) {
+        JT_EntityTime *jt = new JT_EntityTime(client_->rootTask());
+        jt->get(jid);
+        task = jt;
+    } else {
+        task = new LastActivityTask(jid, client_->rootTask());
+    }
+    connect(task, &Task::finished, this, [this, task, kind, key]() { taskFinished(task, kind, key); });
+    task->go(true);
+}
+
+void EntityInfoCache::invalidate(const Jid &jid)
+{
+    for (Kind kind : { Version, Time, LastActivity })
+        entries_.remove(keyOf(kind, jid));
+}
+
+void EntityInfoCache::clear()
+{
+    entries_.clear();
+}
+
+void EntityInfoCache::capsChanged(const Jid &jid)
+{
+    // another client or another version of it
+    entries_.remove(keyOf(Version, jid));
+}
+
+void EntityInfoCache::resourceAvailable(const Jid &jid, const Resource &r)
+{
+    // the contact was active just now
+    entries_.remove(keyOf(LastActivity, jid.withResource(r.name())));
+    entries_.remove(keyOf(LastActivity, jid.bare()));
+}
+
+void EntityInfoCache::resourceUnavailable(const Jid &jid, const Resource &r)
+{
+    invalidate(jid.withResource(r.name()));
+    entries_.remove(keyOf(LastActivity, jid.bare()));
+}
+
+void EntityInfoCache::taskFinished(Task *task, Kind kind, const QString &key)
+{
+    Entry e;
+    e.info.success      = task->success();
+    e.info.statusCode   = task->statusCode();
+    e.info.statusString = task->statusString();
+    if (e.info.success) {
+        if (kind == Version) {
+            JT_ClientVersion *jt = static_cast<JT_ClientVersion *>(task);
+            e.info.name          = jt->name();
+            e.info.version       = jt->version();
+            e.info.os            = jt->os();
+            e.expires            = clock_.elapsed() + versionTtl;
+        } else if (kind == Time) {
+            e.info.timezoneOffset = static_cast<JT_EntityTime *>(task)->timezoneOffset();
+            e.expires             = clock_.elapsed() + timeTtl;
+        } else {
+            LastActivityTask *jt = static_cast<LastActivityTask *>(task);
+            e.info.lastActivity  = jt->time();
+            e.info.lastStatus    = jt->status();
+            e.expires            = clock_.elapsed() + activityTtl;
+        }
+    } else {
+        e.expires = clock_.elapsed() + errorTtl;
+    }
+
+    // losing the connection says nothing about the entity
+    if (e.info.success || e.info.statusCode != Task::ErrDisc) {
+        if (entries_.size() >= maxEntries)
+            purgeExpired();
+        entries_.insert(key, e);
+    }
+
+    const QList<Waiter> waiters = waiting_.take(key);
+    for (const Waiter &w : waiters) {
+        if (w.context)
+            w.done(e.info);
+    }
+}
+
+void EntityInfoCache::purgeExpired()
+{
+    const qint64 now = clock_.elapsed();
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->expires <= now)
+            it = entries_.erase(it);
+        else
+            ++it;
+    }
+    // still full of fresh entries: start over rather than grow without bound
+    if (entries_.size() >= maxEntries)
+        entries_.clear();
+}
@@ -0,0 +1,106 @@
+/*
+ * entityinfocache.h - client version, time and last activity of entities
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ENTITYINFOCACHE_H
+#define ENTITYINFOCACHE_H
+
+#include "xmpp_jid.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+
+#include <functional>
+
+namespace XMPP {
+class Client;
+class Resource;
+class Task;
+}
+
+/**
+ * Per-account cache of the software version (XEP-0092), entity time
+ * (XEP-0202) and last activity (XEP-0012) of entities, by full jid.
+ * Identical queries in flight at the same time share a single request.
+ *
+ * Versions and times are kept until the caps of the entity change or it
+ * goes offline, last activity until its presence changes, and all of
+ * them for some minutes at most.
+ */
+class EntityInfoCache : public QObject {
+    Q_OBJECT
+public:
+    enum Kind { Version, Time, LastActivity };
+
+    struct Info {
+        bool    success    = false;
+        int     statusCode = 0;
+        QString statusString;
+
+        // Version
+        QString name;
+        QString version;
+        QString os;
+        // Time, in minutes from UTC
+        int timezoneOffset = 0;
+        // LastActivity
+        QDateTime lastActivity;
+        QString   lastStatus;
+    };
+    using Callback = std::function<void(const Info &)>;
+
+    EntityInfoCache(XMPP::Client *client, QObject *parent = nullptr);
+
+    // true with the info when a fresh answer is cached
+    bool cached(Kind kind, const XMPP::Jid &jid, Info *info) const;
+    // calls done() right away from the cache, or once the entity answered.
+    // Nothing is called when context is gone by then
+    void query(Kind kind, const XMPP::Jid &jid, QObject *context, Callback done);
+
+    void invalidate(const XMPP::Jid &jid);
+    void clear();
+
+private slots:
+    void capsChanged(const XMPP::Jid &jid);
+    void resourceAvailable(const XMPP::Jid &jid, const XMPP::Resource &r);
+    void resourceUnavailable(const XMPP::Jid &jid, const XMPP::Resource &r);
+
+private:
+    struct Entry {
+        Info   info;
+        qint64 expires = 0;
+    };
+    struct Waiter {
+        QPointer<QObject> context;
+        Callback          done;
+    };
+
+    void taskFinished(XMPP::Task *task, Kind kind, const QString &key);
+    void purgeExpired();
+
+    QPointer<XMPP::Client>        client_;
+    QElapsedTimer                 clock_;
+    QHash<QString, Entry>         entries_;
+    QHash<QString, QList<Waiter>> waiting_; // by key of the request in flight
+};
+
+#endif // ENTITYINFOCACHE_H
@@ -20,17 +20,23 @@
 #include "eventdb.h"
 
 #include "jidutil.h"
+#include "memoryaccounting.h"
 #include "psievent.h"
 
+#include <QCache>
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QHash>
 #include <QTextStream>
 #include <QTimer>
 #include <QVector>
 
 using namespace XMPP;
 
+static const int recentEventsPerContact = 100; // like ChatDlg's preload limit
+static const int recentEventsTotal      = 5000;
+
 //----------------------------------------------------------------------------
 // EDBItem
 //----------------------------------------------------------------------------
@@ -65,6 +71,7 @@ public:
     EDB *edb = nullptr;
     int beginRow_ = 0;
     EDBResult r;
+    QList<EDBContactItem> contacts;
     bool busy = false;
     bool writeSuccess = false;
     int listeningFor = 0;
@@ -105,6 +112,13 @@ void EDBHandle::find(const QString &accId, const QString &str, const XMPP::Jid &
     d->listeningFor = d->edb->op_find(accId, str, jid, date, direction);
 }
 
+void EDBHandle::findMatches(const QString &accId, const QString &str, const XMPP::Jid &jid)
+{
+    d->busy = true;
+    d->lastRequestType = Read;
+    d->listeningFor = d->edb->op_findMatches(accId, str, jid);
+}
+
 void EDBHandle::append(const QString &accId, const Jid &j, const PsiEvent::Ptr &e, int type)
 {
     d->busy = true;
@@ -112,6 +126,13 @@ void EDBHandle::append(const QString &accId, const Jid &j, const PsiEvent::Ptr &
     d->listeningFor = d->edb->op_append(accId, j, e, type);
 }
 
+void EDBHandle::appendBatch(const QString &accId, const Jid &j, const QList<PsiEvent::Ptr> &events, int type)
+{
+    d->busy = true;
+    d->lastRequestType = Write;
+    d->listeningFor = d->edb->op_appendBatch(accId, j, events, type);
+}
+
 void EDBHandle::erase(const QString &accId, const Jid &j)
 {
     d->busy = true;
@@ -119,6 +140,13 @@ void EDBHandle::erase(const QString &accId, const Jid &j)
     d->listeningFor = d->edb->op_erase(accId, j);
 }
 
+void EDBHandle::contacts(const QString &accId, int type)
+{
+    d->busy = true;
+    d->lastRequestType = Contacts;
+    d->listeningFor = d->edb->op_contacts(accId, type);
+}
+
 bool EDBHandle::busy() const
 {
     return d->busy;
@@ -129,6 +157,11 @@ const EDBResult EDBHandle::result() const
     return d->r;
 }
 
+const QList<EDBContactItem> EDBHandle::contactsResult() const
+{
+    return d->contacts;
+}
+
 bool EDBHandle::writeSuccess() const
 {
     return d->writeSuccess;
@@ -142,6 +175,12 @@ void EDBHandle::edb_resultReady(EDBResult r)
     finished();
 }
 
+void EDBHandle::edb_matchesReady(EDBResult r)
+{
+    d->r = r;
+    emit matchesReady();
+}
+
 void EDBHandle::edb_writeFinished(bool b)
 {
     d->busy = false;
@@ -150,6 +189,14 @@ void EDBHandle::edb_writeFinished(bool b)
     finished();
 }
 
+void EDBHandle::edb_contactsReady(const QList<EDBContactItem> &list)
+{
+    d->busy = false;
+    d->contacts = list;
+    d->listeningFor = -1;
+    finished();
+}
+
 int EDBHandle::listeningFor() const
 {
     return d->listeningFor;
@@ -173,9 +220,35 @@ class EDB::Private
 public:
     Private() = default;
 
+    struct Batch
+    {
+        QString              accId;
+        XMPP::Jid            jid;
+        int                  type;
+        QList<PsiEvent::Ptr> events;
+    };
+
+    // latest events of a contact, newest first
+    struct Recent
+    {
+        EDBResult items;
+        bool      complete = false; // the contact has no older events
+    };
+
+    struct PendingRead
+    {
+        QString key;
+        int     start;
+        int     len;
+    };
+
     QList<EDBHandle*> list;
     int reqid_base = 0;
     PsiCon *psi = nullptr;
+    QList<Batch> deferred;
+    bool flushScheduled = false;
+    QCache<QString, Recent> recent;
+    QHash<int, PendingRead> pendingReads;
 };
 
 EDB::EDB(PsiCon *psi)
@@ -183,6 +256,16 @@ EDB::EDB(PsiCon *psi)
     d = new Private;
     d->reqid_base = 0;
     d->psi = psi;
+    d->recent.setMaxCost(recentEventsTotal);
+
+    MemoryAccounting::add(
+        this, "history cache",
+        [this]() {
+            MemoryAccounting::Usage u;
+            u.entries = d->recent.totalCost() - d->recent.count(); // events
+            return u;
+        },
+        [this]() { clearCache(); });
 }
 
 EDB::~EDB()
@@ -207,28 +290,213 @@ void EDB::unreg(EDBHandle *h)
     d->list.removeAll(h);
 }
 
+/**
+ * Queues an event for writing without a handle to wait on. All events
+ * logged during one event loop iteration go to the backend together, one
+ * batch per contact, instead of one request each.
+ */
+void EDB::appendDeferred(const QString &accId, const Jid &j, const PsiEvent::Ptr &e, int type)
+{
+    if (!d->deferred.isEmpty()) {
+        Private::Batch &last = d->deferred.last();
+        if (last.type == type && last.accId == accId && last.jid == j) {
+            last.events.append(e);
+            return;
+        }
+    }
+    d->deferred.append({ accId, j, type, QList<PsiEvent::Ptr>() << e });
+    if (!d->flushScheduled) {
+        d->flushScheduled = true;
+        QTimer::singleShot(0, this, [this]() { flushDeferred(); });
+    }
+}
+
+void EDB::flushDeferred()
+{
+    d->flushScheduled = false;
+    QList<Private::Batch> batches;
+    batches.swap(d->deferred);
+    for (const Private::Batch &b : batches) {
+        cacheAppended(b.accId, b.jid, b.events);
+        appendBatch(b.accId, b.jid, b.events, b.type);
+    }
+}
+
+QString EDB::recentKey(const QString &accId, const Jid &jid)
+{
+    return accId + '|' + jid.full();
+}
+
+/**
+ * Keeps the cached latest events in line with what is being written.
+ * New messages go on top; anything older (imports, archive sync) makes
+ * the cached page unreliable, so it is dropped.
+ */
+void EDB::cacheAppended(const QString &accId, const Jid &jid, const QList<PsiEvent::Ptr> &events)
+{
+    QStringList keys;
+    keys << recentKey(accId, jid);
+    if (jid.full() != jid.bare())
+        keys << recentKey(accId, jid.bare());
+    for (const QString &key : keys) {
+        dropPendingReads(key);
+        Private::Recent *rc = d->recent.object(key);
+        if (!rc)
+            continue;
+        QDateTime newest = rc->items.isEmpty() ? QDateTime() : rc->items.first()->event()->timeStamp();
+        bool inOrder = true;
+        for (const PsiEvent::Ptr &e : events) {
+            if (!newest.isNull() && e->timeStamp() < newest) {
+                inOrder = false;
+                break;
+            }
+            newest = e->timeStamp();
+        }
+        if (!inOrder) {
+            d->recent.remove(key);
+            continue;
+        }
+        EDBResult items;
+        for (int i = events.size() - 1; i >= 0; --i)
+            items.append(EDBItemPtr(new EDBItem(events.at(i), QString())));
+        items += rc->items;
+        if (items.size() > recentEventsPerContact) {
+            items.erase(items.begin() + recentEventsPerContact, items.end());
+            rc->complete = false;
+        }
+        d->recent.insert(key, new Private::Recent { items, rc->complete }, items.size() + 1);
+    }
+}
+
+void EDB::cacheErased(const QString &accId, const Jid &jid)
+{
+    if (accId.isEmpty() || jid.isEmpty()) {
+        clearCache();
+        return;
+    }
+    d->recent.remove(recentKey(accId, jid));
+    d->recent.remove(recentKey(accId, jid.bare()));
+    dropPendingReads(recentKey(accId, jid));
+    dropPendingReads(recentKey(accId, jid.bare()));
+}
+
+void EDB::clearCache()
+{
+    d->recent.clear();
+    d->pendingReads.clear();
+}
+
+// a read that raced with a write must not fill the cache
+void EDB::dropPendingReads(const QString &key)
+{
+    for (auto it = d->pendingReads.begin(); it != d->pendingReads.end();) {
+        if (it->key == key)
+            it = d->pendingReads.erase(it);
+        else
+            ++it;
+    }
+}
+
+// requests below see everything logged before them
+
+/**
+ * The latest events of a contact (what a chat window preloads) are served
+ * from memory when they are cached, without touching the backend.
+ */
 int EDB::op_get(const QString &accId, const Jid &jid, const QDateTime date, int direction, int start, int len)
 {
-    return get(accId, jid, date, direction, start, len);
+    flushDeferred();
+    if (accId.isEmpty() || jid.isEmpty() || !date.isNull() || direction != Backward)
+        return get(accId, jid, date, direction, start, len);
+
+    const QString key = recentKey(accId, jid);
+    Private::Recent *rc = d->recent.object(key);
+    if (rc && (start + len <= rc->items.size() || rc->complete)) {
+        const int id = genUniqueId();
+        const EDBResult r = rc->items.mid(start, len);
+        // handles expect the answer after get() returns
+        QTimer::singleShot(0, this, [this, id, r]() { resultReady(id, r, 0); });
+        return id;
+    }
+    const int id = get(accId, jid, date, direction, start, len);
+    if (start == 0 || (rc && rc->items.size() == start))
+        d->pendingReads.insert(id, { key, start, len });
+    return id;
 }
 
 int EDB::op_find(const QString &accId, const QString &str, const Jid &j, const QDateTime date, int direction)
 {
+    flushDeferred();
     return find(accId, str, j, date, direction);
 }
 
+int EDB::op_findMatches(const QString &accId, const QString &str, const Jid &j)
+{
+    flushDeferred();
+    return findMatches(accId, str, j);
+}
+
 int EDB::op_append(const QString &accId, const Jid &j, const PsiEvent::Ptr &e, int type)
 {
+    flushDeferred();
+    cacheAppended(accId, j, QList<PsiEvent::Ptr>() << e);
     return append(accId, j, e, type);
 }
 
+int EDB::op_appendBatch(const QString &accId, const Jid &j, const QList<PsiEvent::Ptr> &events, int type)
+{
+    flushDeferred();
+    cacheAppended(accId, j, events);
+    return appendBatch(accId, j, events, type);
+}
+
 int EDB::op_erase(const QString &accId, const Jid &j)
 {
+    flushDeferred();
+    cacheErased(accId, j);
     return erase(accId, j);
 }
 
+int EDB::op_contacts(const QString &accId, int type)
+{
+    flushDeferred();
+    return requestContacts(accId, type);
+}
+
+/**
+ * Backends without an asynchronous contact query answer from contacts()
+ * on the next event loop pass.
+ */
+int EDB::requestContacts(const QString &accId, int type)
+{
+    const int id = genUniqueId();
+    const QList<ContactItem> list = contacts(accId, type);
+    QTimer::singleShot(0, this, [this, id, list]() { contactsReady(id, list); });
+    return id;
+}
+
+int EDB::findMatches(const QString &accId, const QString &str, const Jid &j)
+{
+    return find(accId, str, j, QDateTime(), Forward);
+}
+
 void EDB::resultReady(int req, EDBResult r, int begin_row)
 {
+    if (d->pendingReads.contains(req)) {
+        const Private::PendingRead pr = d->pendingReads.take(req);
+        Private::Recent *rc = d->recent.object(pr.key);
+        if (pr.start == 0 || (rc && rc->items.size() == pr.start)) {
+            EDBResult items = pr.start == 0 ? EDBResult() : rc->items;
+            items += r;
+            bool complete = r.size() < pr.len;
+            if (items.size() > recentEventsPerContact) {
+                items.erase(items.begin() + recentEventsPerContact, items.end());
+                complete = false;
+            }
+            d->recent.insert(pr.key, new Private::Recent { items, complete }, items.size() + 1);
+        }
+    }
+
     // deliver
     foreach(EDBHandle* h, d->list) {
         if(h->listeningFor() == req) {
@@ -239,6 +507,17 @@ void EDB::resultReady(int req, EDBResult r, int begin_row)
     }
 }
 
+void EDB::matchesReady(int req, EDBResult r)
+{
+    // deliver
+    foreach(EDBHandle* h, d->list) {
+        if(h->listeningFor() == req) {
+            h->edb_matchesReady(r);
+            return;
+        }
+    }
+}
+
 void EDB::writeFinished(int req, bool b)
 {
     // deliver
@@ -250,6 +529,17 @@ void EDB::writeFinished(int req, bool b)
     }
 }
 
+void EDB::contactsReady(int req, const QList<ContactItem> &list)
+{
+    // deliver
+    foreach(EDBHandle* h, d->list) {
+        if(h->listeningFor() == req) {
+            h->edb_contactsReady(list);
+            return;
+        }
+    }
+}
+
 PsiCon *EDB::psi()
 {
     return d->psi;
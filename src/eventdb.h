@@ -47,29 +47,44 @@ private:
 typedef QSharedPointer<EDBItem> EDBItemPtr;
 typedef QList<EDBItemPtr> EDBResult;
 
+struct EDBContactItem
+{
+    QString   accId;
+    XMPP::Jid jid;
+    EDBContactItem(const QString &aId, XMPP::Jid j) { accId = aId; jid = j; }
+};
+
 class EDB;
 class EDBHandle : public QObject
 {
     Q_OBJECT
 public:
-    enum { Read, Write, Erase };
+    enum { Read, Write, Erase, Contacts };
     EDBHandle(EDB *);
     ~EDBHandle();
 
     // operations
     void get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int begin, int len);
     void find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction);
+    // like find() from the oldest event, but the hits also come in batches
+    // through matchesReady() while the search runs
+    void findMatches(const QString &accId, const QString &, const XMPP::Jid &);
     void append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
+    void appendBatch(const QString &accId, const XMPP::Jid &, const QList<PsiEvent::Ptr> &, int);
     void erase(const QString &accId, const XMPP::Jid &);
+    void contacts(const QString &accId, int type);
 
     bool busy() const;
     const EDBResult result() const;
+    const QList<EDBContactItem> contactsResult() const;
     bool writeSuccess() const;
     int lastRequestType() const;
     int beginRow() const;
 
 signals:
     void finished();
+    // result() holds the hits found since the previous batch
+    void matchesReady();
 
 private:
     class Private;
@@ -77,7 +92,9 @@ private:
 
     friend class EDB;
     void edb_resultReady(EDBResult);
+    void edb_matchesReady(EDBResult);
     void edb_writeFinished(bool);
+    void edb_contactsReady(const QList<EDBContactItem> &);
     int listeningFor() const;
 };
 
@@ -88,12 +105,7 @@ public:
     enum { Forward, Backward };
     enum { Contact = 1, GroupChatContact = 2 };
     enum { SeparateAccounts = 1, PrivateContacts = 2, AllContacts = 4, AllAccounts = 8 };
-    struct ContactItem
-    {
-        QString   accId;
-        XMPP::Jid jid;
-        ContactItem(const QString &aId, XMPP::Jid j) { accId = aId; jid = j; }
-    };
+    typedef EDBContactItem ContactItem;
 
     EDB(PsiCon *psi);
     virtual ~EDB()=0;
@@ -103,14 +115,27 @@ public:
     virtual QString getStorageParam(const QString &key) = 0;
     virtual void setStorageParam(const QString &key, const QString &val) = 0;
 
+    // fire-and-forget logging. events are collected and written in batches
+    void appendDeferred(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
+    void flushDeferred();
+
 protected:
     int genUniqueId() const;
     virtual int get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int start, int len)=0;
     virtual int append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int)=0;
+    virtual int appendBatch(const QString &accId, const XMPP::Jid &, const QList<PsiEvent::Ptr> &, int)=0;
     virtual int find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction)=0;
     virtual int erase(const QString &accId, const XMPP::Jid &)=0;
+    // the contact list for an EDBHandle, answered with contactsReady()
+    virtual int requestContacts(const QString &accId, int type);
+    // a find() which may report hits with matchesReady() before its result
+    virtual int findMatches(const QString &accId, const QString &, const XMPP::Jid &);
     void resultReady(int, EDBResult, int);
+    void matchesReady(int, EDBResult);
     void writeFinished(int, bool);
+    void contactsReady(int, const QList<ContactItem> &);
+    // call when events were removed behind the EDB's back
+    void clearCache();
     PsiCon *psi();
 
 private:
@@ -121,10 +146,18 @@ private:
     void reg(EDBHandle *);
     void unreg(EDBHandle *);
 
+    static QString recentKey(const QString &accId, const XMPP::Jid &jid);
+    void cacheAppended(const QString &accId, const XMPP::Jid &jid, const QList<PsiEvent::Ptr> &events);
+    void cacheErased(const QString &accId, const XMPP::Jid &jid);
+    void dropPendingReads(const QString &key);
+
     int op_get(const QString &accId, const XMPP::Jid &, const QDateTime date, int direction, int start, int len);
     int op_find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction);
     int op_append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
+    int op_appendBatch(const QString &accId, const XMPP::Jid &, const QList<PsiEvent::Ptr> &, int);
     int op_erase(const QString &accId, const XMPP::Jid &);
+    int op_contacts(const QString &accId, int type);
+    int op_findMatches(const QString &accId, const QString &, const XMPP::Jid &);
 };
 
 #endif // EVENTDB_H
@@ -21,14 +21,338 @@
 
 #include "applicationinfo.h"
 #include "fileutil.h"
+#include "idlescheduler.h"
+#include "memoryaccounting.h"
 #include "optionstree.h"
 #include "xmpp_hash.h"
 
+#include <QCoreApplication>
+#include <QDataStream>
 #include <QDebug>
 #include <QDir>
-#include <QTimer>
+#include <QFutureWatcher>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QSet>
+#include <QtConcurrentRun>
 
 #define FC_META_PERSISTENT QStringLiteral("fc_persistent")
+#define FC_GC_INTERVAL 3600 /* secs */
+
+static bool writeCacheFile(const QString &fileName, const QByteArray &data)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning("Can't open file %s for writing", qPrintable(fileName));
+        return false;
+    }
+    return f.write(data) == data.size();
+}
+
+static QByteArray readCacheFile(const QString &fileName)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning("Can't open file %s for reading", qPrintable(fileName));
+        return QByteArray();
+    }
+    return f.readAll();
+}
+
+//------------------------------------------------------------------------------
+// FileCacheRegistry
+//------------------------------------------------------------------------------
+/*
+ * Append-only journal of registry changes. Every sync appends only the records
+ * changed since the previous one. When obsolete records start to dominate, the
+ * journal is compacted by rewriting the live entries into a new file.
+ * Registries from older versions (cache.xml) are migrated on the first load.
+ *
+ * A shared registry is written by several processes, each of them holding the
+ * lock file while it touches the journal. Before appending, a process reads
+ * the records the others appended since it last looked. A compaction starts
+ * a journal with a new epoch, which tells the others to read it anew.
+ */
+class FileCacheRegistry {
+public:
+    struct Entry {
+        QString      ha;
+        QVariantMap  metadata;
+        QDateTime    ctime;
+        unsigned int maxAge = 0;
+        qulonglong   size   = 0;
+        QStringList  aliases;
+    };
+
+    FileCacheRegistry(const QString &cacheDir, bool shared) :
+        _journalFile(cacheDir + "/cache.journal"), _xmlFile(cacheDir + "/cache.xml"), _records(0),
+        _needCompact(false), _shared(shared)
+    {
+    }
+
+    const QHash<QString, Entry> &load()
+    {
+        if (QFile::exists(_journalFile)) {
+            // read anyway without the lock, just a torn tail is left alone then
+            QLockFile lock(_journalFile + ".lock");
+            readJournal(nullptr, !_shared || lock.tryLock(LockTimeout));
+        } else if (QFile::exists(_xmlFile)) {
+            loadXml();
+        }
+        return _entries;
+    }
+
+    inline const QHash<QString, Entry> &entries() const { return _entries; }
+
+    // the entries other processes added or removed since we last looked, if
+    // the journal changed meanwhile. key => hash type of the entry
+    QHash<QString, QString> merge()
+    {
+        QHash<QString, QString> merged;
+        if (!_shared || QFileInfo(_journalFile).size() == _offset)
+            return merged;
+        QLockFile lock(_journalFile + ".lock");
+        if (lock.tryLock(LockTimeout))
+            readJournal(&merged);
+        return merged;
+    }
+
+    void put(const QString &key, const Entry &e)
+    {
+        _entries.insert(key, e);
+        _changed.insert(key);
+    }
+
+    void remove(const QString &key)
+    {
+        if (_entries.remove(key))
+            _changed.insert(key);
+    }
+
+    bool isDirty() const { return !_changed.isEmpty() || _needCompact; }
+
+    // returns what merge() does, the records of the others are read first
+    QHash<QString, QString> save()
+    {
+        QHash<QString, QString> merged;
+        QLockFile               lock(_journalFile + ".lock");
+        if (_shared) {
+            if (!lock.tryLock(LockTimeout))
+                return merged; // still dirty, the next sync tries again
+            readJournal(&merged);
+        }
+
+        if (_needCompact || _records > 2 * _entries.size() + CompactThreshold) {
+            compact();
+            return merged;
+        }
+        if (_changed.isEmpty()) {
+            return merged;
+        }
+
+        QFile f(_journalFile);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qWarning("Can't open file %s for writing", qPrintable(_journalFile));
+            return merged;
+        }
+        QDataStream out(&f);
+        out.setVersion(QDataStream::Qt_5_6);
+        if (f.size() == 0) {
+            _epoch = newEpoch();
+            out << Magic << Version << _epoch;
+        }
+        for (const QString &key : _changed) {
+            auto it = _entries.constFind(key);
+            if (it == _entries.constEnd()) {
+                out << quint8(RemoveRecord) << key;
+            } else {
+                out << quint8(PutRecord) << key;
+                writeEntry(out, it.value());
+            }
+            _records++;
+        }
+        _changed.clear();
+        f.flush();
+        _offset = f.size();
+        return merged;
+    }
+
+private:
+    enum { PutRecord = 1, RemoveRecord = 2 };
+    static constexpr quint32 Magic            = 0x50534643; // "PSFC"
+    static constexpr quint32 Version          = 2;          // 2 - epoch in the header
+    static constexpr int     CompactThreshold = 256;
+    static constexpr int     LockTimeout      = 1000; // msecs
+
+    // tells the journals of two processes apart, never 0 which is the one of old journals
+    static quint32 newEpoch()
+    {
+        return (quint32(QDateTime::currentMSecsSinceEpoch()) ^ quint32(QCoreApplication::applicationPid() << 16)) | 1;
+    }
+
+    static void writeEntry(QDataStream &out, const Entry &e)
+    {
+        out << e.ha << e.metadata << e.ctime << quint32(e.maxAge) << e.size << e.aliases;
+    }
+
+    static void readEntry(QDataStream &in, Entry &e)
+    {
+        quint32 maxAge;
+        in >> e.ha >> e.metadata >> e.ctime >> maxAge >> e.size >> e.aliases;
+        e.maxAge = maxAge;
+    }
+
+    // reads the records appended since the last read, or all of them if the
+    // journal was compacted meanwhile. With merged given, the keys of the
+    // entries which came or went go there, and the entries this process has
+    // yet to save stay as they are. Without the lock a torn record may be
+    // still being written by another process
+    void readJournal(QHash<QString, QString> *merged = nullptr, bool locked = true)
+    {
+        QFile f(_journalFile);
+        if (!f.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        QDataStream in(&f);
+        in.setVersion(QDataStream::Qt_5_6);
+
+        quint32 magic, version, epoch = 0;
+        in >> magic >> version;
+        if (version > 1) {
+            in >> epoch;
+        }
+        if (in.status() != QDataStream::Ok || magic != Magic || version < 1 || version > Version) {
+            qWarning("Unsupported file cache journal %s", qPrintable(_journalFile));
+            _needCompact = true;
+            return;
+        }
+        if (version < Version) {
+            _needCompact = true; // just to write the new header
+        }
+
+        const bool            anew = _offset == 0 || epoch != _epoch || f.size() < _offset;
+        QHash<QString, Entry> fresh;
+        if (anew) {
+            _epoch   = epoch;
+            _records = 0;
+        } else {
+            f.seek(_offset);
+        }
+
+        while (!in.atEnd()) {
+            quint8  op;
+            QString key;
+            Entry   e;
+            in >> op >> key;
+            if (op == PutRecord) {
+                readEntry(in, e);
+            }
+            if (in.status() != QDataStream::Ok || (op != PutRecord && op != RemoveRecord)) {
+                if (!locked) {
+                    break;
+                }
+                // most likely interrupted write. drop the tail
+                qWarning("File cache journal %s is truncated", qPrintable(_journalFile));
+                _needCompact = true;
+                break;
+            }
+            _offset = f.pos();
+            _records++;
+
+            if (anew) {
+                if (op == PutRecord) {
+                    fresh.insert(key, e);
+                } else {
+                    fresh.remove(key);
+                }
+            } else if (merged && !_changed.contains(key)) {
+                if (op == PutRecord) {
+                    if (!_entries.contains(key))
+                        merged->insert(key, e.ha);
+                    _entries.insert(key, e);
+                } else if (_entries.contains(key)) {
+                    merged->insert(key, _entries.take(key).ha);
+                }
+            }
+        }
+
+        if (anew && merged) {
+            for (auto it = _entries.begin(); it != _entries.end();) {
+                if (!fresh.contains(it.key()) && !_changed.contains(it.key())) {
+                    merged->insert(it.key(), it.value().ha);
+                    it = _entries.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            for (auto it = fresh.constBegin(); it != fresh.constEnd(); ++it) {
+                if (_changed.contains(it.key()))
+                    continue;
+                if (!_entries.contains(it.key()))
+                    merged->insert(it.key(), it.value().ha);
+                _entries.insert(it.key(), it.value());
+            }
+        } else if (anew) {
+            _entries = fresh;
+        }
+    }
+
+    void loadXml()
+    {
+        OptionsTree registry;
+        registry.loadOptions(_xmlFile, "items", ApplicationInfo::fileCacheNS());
+        for (const QString &prefix : registry.getChildOptionNames("", true, true)) {
+            Entry e;
+            e.ha       = registry.getOption(prefix + ".ha").toString();
+            e.metadata = registry.getOption(prefix + ".metadata", QVariantMap()).toMap();
+            e.ctime    = QDateTime::fromString(registry.getOption(prefix + ".ctime").toString(), Qt::ISODate);
+            e.maxAge   = registry.getOption(prefix + ".max-age").toUInt();
+            e.size     = registry.getOption(prefix + ".size").toULongLong();
+            e.aliases  = registry.getOption(prefix + ".aliases").toStringList();
+            _entries.insert(prefix.section('.', -1), e);
+        }
+        _needCompact = true;
+    }
+
+    void compact()
+    {
+        QSaveFile f(_journalFile);
+        if (!f.open(QIODevice::WriteOnly)) {
+            qWarning("Can't open file %s for writing", qPrintable(_journalFile));
+            return;
+        }
+        QDataStream   out(&f);
+        const quint32 epoch = newEpoch();
+        out.setVersion(QDataStream::Qt_5_6);
+        out << Magic << Version << epoch;
+        for (auto it = _entries.constBegin(); it != _entries.constEnd(); ++it) {
+            out << quint8(PutRecord) << it.key();
+            writeEntry(out, it.value());
+        }
+        if (!f.commit()) {
+            return;
+        }
+
+        _epoch       = epoch;
+        _offset      = QFileInfo(_journalFile).size();
+        _records     = _entries.size();
+        _needCompact = false;
+        _changed.clear();
+        if (QFile::exists(_xmlFile)) {
+            QFile::remove(_xmlFile); // migrated
+        }
+    }
+
+    QString               _journalFile;
+    QString               _xmlFile;
+    QHash<QString, Entry> _entries;
+    QSet<QString>         _changed;
+    int                   _records; // records in the journal file, including obsolete ones
+    bool                  _needCompact;
+    bool                  _shared;
+    quint32               _epoch  = 0;
+    qint64                _offset = 0; // end of the last record read or written
+};
 
 FileCacheItem::FileCacheItem(FileCache *parent, const QList<XMPP::Hash> &sums, const QVariantMap &metadata,
                              const QDateTime &dt, unsigned int maxAge, qint64 size, const QByteArray &data) :
@@ -47,18 +371,14 @@ bool FileCacheItem::inMemory() const { return _data.size() > 0; }
 
 void FileCacheItem::flushToDisk()
 {
-    if (_flags & OnDisk) {
+    if (_flags & (OnDisk | Writing)) {
         return;
     }
 
     if (_data.size()) {
-        QFile f(parentCache()->cacheDir() + "/" + _fileName);
-        if (f.open(QIODevice::WriteOnly)) {
-            f.write(_data);
-            f.close();
+        if (writeCacheFile(parentCache()->cacheDir() + "/" + _fileName, _data)) {
             _flags |= OnDisk;
-        } else {
-            qWarning("Can't open file %s for writing", qPrintable(_fileName));
+            parentCache()->addToDisk(this);
         }
     } else {
         _flags |= OnDisk;
@@ -79,7 +399,10 @@ bool FileCacheItem::remove() const
 void FileCacheItem::unload()
 {
     flushToDisk();
-    _data = QByteArray();
+    if (_flags & OnDisk) {
+        _data = QByteArray();
+        parentCache()->removeFromMemory(this);
+    }
 }
 
 bool FileCacheItem::isExpired(bool finishSession) const
@@ -95,29 +418,48 @@ QByteArray FileCacheItem::data()
         return QByteArray();
     }
     if (!_data.size()) {
-        QFile f(parentCache()->cacheDir() + "/" + _fileName);
-        if (f.open(QIODevice::ReadOnly)) {
-            _data = f.readAll();
-            // TODO check if filesize differs
-            // TODO notify FileCache to check memory restrictions
-            f.close();
-        } else {
-            qWarning("Can't open file %s for reading", qPrintable(_fileName));
+        _data = readCacheFile(parentCache()->cacheDir() + "/" + _fileName);
+        // TODO check if filesize differs
+        if (_data.size()) {
+            parentCache()->addToMemory(this);
+            parentCache()->scheduleSync(); // check memory limits
         }
     }
     return _data;
 }
 
+void FileCacheItem::addHashSum(const XMPP::Hash &id)
+{
+    _sums += id;
+    unregister();
+}
+
+void FileCacheItem::setMetadata(const QVariantMap &md)
+{
+    _metadata = md;
+    unregister();
+}
+
+void FileCacheItem::unregister()
+{
+    _flags &= ~Registered;
+    // items which aren't in cache yet are still being constructed
+    if (parentCache()->_items.value(id()) == this) {
+        parentCache()->_pendingRegisterItems.insert(id(), this);
+        parentCache()->scheduleSync();
+    }
+}
+
 void FileCacheItem::setUndeletable(bool state)
 {
     if (state) {
         if (_metadata.contains(FC_META_PERSISTENT)) {
             _metadata.insert(FC_META_PERSISTENT, true);
-            _flags &= ~Registered; // we have to update registry eventually
+            unregister(); // we have to update registry eventually
         }
     } else {
         if (_metadata.remove(FC_META_PERSISTENT) > 0) {
-            _flags &= ~Registered; // we have to update registry eventually
+            unregister(); // we have to update registry eventually
         }
     }
 }
@@ -133,65 +475,141 @@ bool FileCacheItem::isDeletable() const
 FileCache::FileCache(const QString &cacheDir, QObject *parent) :
     QObject(parent), _cacheDir(cacheDir), _memoryCacheSize(FileCache::DefaultMemoryCacheSize),
     _fileCacheSize(FileCache::DefaultFileCacheSize), _defaultMaxAge(Forever), _syncPolicy(InstantFLush),
-    _registryChanged(false)
+    _memoryUsage(0), _diskUsage(0), _lastGc(QDateTime::currentDateTime())
+{
+    _shared   = _sharedDefault;
+    _registry = new FileCacheRegistry(_cacheDir, _shared);
+
+    QList<FileCacheItem *> loaded;
+    const auto &entries = _registry->load();
+    for (auto eit = entries.constBegin(); eit != entries.constEnd(); ++eit) {
+        auto item = fromRegistry(eit.key());
+        if (!item)
+            continue;
+        if (item->isExpired()) {
+            remove(item->id());
+        } else {
+            loaded.append(item);
+        }
+    }
+
+    // the registry has no access times, so start with the oldest ones
+    std::sort(loaded.begin(), loaded.end(),
+              [](FileCacheItem *a, FileCacheItem *b) { return a->created() < b->created(); });
+    for (auto item : loaded)
+        addToDisk(item);
+
+    MemoryAccounting::add(
+        this, QString("file cache %1").arg(QDir(_cacheDir).dirName()),
+        [this]() {
+            MemoryAccounting::Usage u;
+            u.bytes   = _memoryUsage;
+            u.entries = qint64(_memoryLru.size());
+            return u;
+        },
+        [this]() {
+            while (!_memoryLru.empty())
+                releaseMemory(_memoryLru.front());
+        });
+}
+
+// an item of a registry entry, known under all its hash sums. Session items
+// of a shared cache belong to the process which made them, they're skipped
+FileCacheItem *FileCache::fromRegistry(const QString &key)
 {
-    _registry  = new OptionsTree(this);
-    _syncTimer = new QTimer(this);
-    _syncTimer->setSingleShot(true);
-    _syncTimer->setInterval(1000);
-    connect(_syncTimer, SIGNAL(timeout()), SLOT(sync()));
+    QByteArray id = QByteArray::fromHex(key.midRef(1).toLatin1());
+    if (id.isEmpty())
+        return nullptr;
+    const FileCacheRegistry::Entry e = _registry->entries().value(key);
+    if (_shared && e.maxAge == Session)
+        return nullptr;
+    auto hash = XMPP::Hash(QStringRef(&e.ha));
+    if (!hash.isValid())
+        return nullptr;
+    hash.setData(id);
 
-    _registry->loadOptions(_cacheDir + "/cache.xml", "items", ApplicationInfo::fileCacheNS());
+    auto item = new FileCacheItem(this, hash, e.metadata, e.ctime, e.maxAge, e.size);
 
-    foreach (const QString &prefix, _registry->getChildOptionNames("", true, true)) {
-        QByteArray id = QByteArray::fromHex(prefix.section('.', -1).midRef(1).toLatin1());
-        if (id.isEmpty())
-            continue;
-        auto hAlgo = _registry->getOption(prefix + ".ha").toString();
-        auto hash  = XMPP::Hash(QStringRef(&hAlgo));
-        if (!hash.isValid())
+    for (const auto &s : e.aliases) {
+        auto ind = s.indexOf('+');
+        if (ind == -1)
             continue;
-        hash.setData(id);
-
-        auto item = new FileCacheItem(
-            this, hash, _registry->getOption(prefix + ".metadata", QVariantMap()).toMap(),
-            QDateTime::fromString(_registry->getOption(prefix + ".ctime").toString(), Qt::ISODate),
-            _registry->getOption(prefix + ".max-age").toUInt(), _registry->getOption(prefix + ".size").toULongLong());
-
-        for (const auto &s : _registry->getOption(prefix + ".aliases").toStringList()) {
-            auto ind = s.indexOf('+');
-            if (ind == -1)
-                continue;
-            auto       type = XMPP::Hash::parseType(s.leftRef(ind));
-            auto       ba   = QByteArray::fromHex(s.midRef(ind + 1).toLatin1());
-            XMPP::Hash hash(type, ba);
-            if (hash.isValid() && ba.size()) {
-                item->addHashSum(hash);
-            }
+        auto       type = XMPP::Hash::parseType(s.leftRef(ind));
+        auto       ba   = QByteArray::fromHex(s.midRef(ind + 1).toLatin1());
+        XMPP::Hash hash(type, ba);
+        if (hash.isValid() && ba.size()) {
+            item->addHashSum(hash);
         }
+    }
 
-        item->_flags |= (FileCacheItem::OnDisk | FileCacheItem::Registered);
-        _items.insert(hash, item);
-        if (item->isExpired()) {
-            remove(item->id());
+    item->_flags |= (FileCacheItem::OnDisk | FileCacheItem::Registered);
+    for (auto const &s : item->sums())
+        _items.insert(s, item);
+    return item;
+}
+
+// takes over what other processes sharing the cache stored or removed
+void FileCache::applyMerged(const QHash<QString, QString> &entries)
+{
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        const QString &key = it.key();
+        auto           id  = XMPP::Hash(QStringRef(&it.value()));
+        id.setData(QByteArray::fromHex(key.midRef(1).toLatin1()));
+        FileCacheItem *known = id.isValid() ? _items.value(id) : nullptr;
+        if (!_registry->entries().contains(key)) {
+            if (known && known->isRegistered())
+                removeItem(known, false); // its file is gone already
+        } else if (!known) {
+            auto item = fromRegistry(key);
+            if (item && item->isExpired())
+                removeItem(item, false);
+            else if (item)
+                addToDisk(item);
         }
     }
 }
 
+void FileCache::merge()
+{
+    if (_shared)
+        applyMerged(_registry->merge());
+}
+
+bool FileCache::_sharedDefault = false;
+
+void FileCache::setShared(bool state) { _sharedDefault = state; }
+
 FileCache::~FileCache()
 {
+    finishIo();
     gc();
     sync(true);
+    delete _registry;
+}
+
+QList<FileCacheItem *> FileCache::uniqueItems() const
+{
+    // items are registered under all their hash sums
+    QList<FileCacheItem *> ret;
+    QSet<FileCacheItem *>  seen;
+    for (auto it = _items.constBegin(); it != _items.constEnd(); ++it) {
+        if (!seen.contains(it.value())) {
+            seen.insert(it.value());
+            ret.append(it.value());
+        }
+    }
+    return ret;
 }
 
 void FileCache::gc()
 {
     QDir dir(_cacheDir);
-    foreach (const XMPP::Hash &id, _items.keys()) {
-        FileCacheItem *item = _items.value(id);
-        // remove broken cache items
-        if (item->isOnDisk() && item->size() && !dir.exists(item->fileName())) {
-            remove(id, false);
+    _lastGc = QDateTime::currentDateTime();
+    for (auto item : uniqueItems()) {
+        // remove broken cache items. in a shared cache another process may be writing the file still
+        if (item->isOnDisk() && item->size() && !dir.exists(item->fileName())
+            && (!_shared || item->created().secsTo(_lastGc) > FC_GC_INTERVAL)) {
+            removeItem(item, false);
             continue;
         }
         // remove expired items
@@ -210,8 +628,10 @@ FileCacheItem *FileCache::append(const QList<XMPP::Hash> &sums, const QByteArray
         = new FileCacheItem(this, sums, metadata, QDateTime::currentDateTime(), maxAge, size_t(data.size()), data);
     for (auto const &s : sums)
         _items.insert(s, item);
+    if (item->inMemory())
+        addToMemory(item);
     _pendingRegisterItems.insert(sums[0], item);
-    _syncTimer->start();
+    scheduleSync();
     return item;
 }
 
@@ -226,8 +646,9 @@ FileCacheItem *FileCache::moveToCache(const QList<XMPP::Hash> &sums, const QFile
     item->_flags |= FileCacheItem::OnDisk;
     for (auto const &s : sums)
         _items.insert(s, item);
+    addToDisk(item);
     _pendingRegisterItems.insert(sums[0], item);
-    _syncTimer->start();
+    scheduleSync();
 
     return item;
 }
@@ -242,18 +663,19 @@ void FileCache::remove(const XMPP::Hash &id, bool needSync)
 
 void FileCache::removeItem(FileCacheItem *item, bool needSync)
 {
-    if (item->isOnDisk()) {
-        _registry->removeOption("h" + item->id().toHex(), true);
-        _registryChanged = true;
+    _registry->remove("h" + item->id().toHex());
+    if (!(item->_flags & FileCacheItem::Writing)) {
+        item->remove(); // otherwise writeFinished() will remove the file
     }
-    item->remove();
+    removeFromMemory(item);
+    removeFromDisk(item);
     for (auto const &a : item->sums()) {
         _items.remove(a);
     }
     _pendingRegisterItems.remove(item->id());
     delete item;
     if (needSync) {
-        _syncTimer->start();
+        scheduleSync();
     }
 }
 
@@ -270,9 +692,15 @@ FileCacheItem *FileCache::get(const XMPP::Hash &id, bool reborn)
                 item->reborn();
                 toRegistry(item);
             }
+            touch(item);
             return item;
         }
         remove(id);
+    } else if (_shared) {
+        // maybe another process has it already
+        merge();
+        if (_items.contains(id))
+            return get(id, reborn);
     }
     return nullptr;
 }
@@ -283,111 +711,245 @@ QByteArray FileCache::getData(const XMPP::Hash &id, bool reborn)
     return item ? item->data() : QByteArray();
 }
 
-bool ctimeLessThan(FileCacheItem *a, FileCacheItem *b) { return a->created() < b->created(); }
+void FileCache::getDataAsync(const XMPP::Hash &id, QObject *context,
+                             std::function<void(const QByteArray &)> callback, bool reborn)
+{
+    FileCacheItem *item = get(id, reborn);
+    if (!item || !item->size() || item->inMemory()) {
+        callback(item ? item->_data : QByteArray());
+        return;
+    }
 
-void FileCache::sync() { sync(false); }
+    auto watcher = new QFutureWatcher<QByteArray>(this);
+    _reads.insert(watcher, ReadRequest { item->id(), context, callback });
+    connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher]() { readFinished(watcher); });
+    watcher->setFuture(QtConcurrent::run(readCacheFile, _cacheDir + "/" + item->fileName()));
+}
 
-void FileCache::sync(bool finishSession)
+void FileCache::readFinished(QFutureWatcher<QByteArray> *watcher)
 {
-    QList<FileCacheItem *> loadedItems;
-    QList<FileCacheItem *> onDiskItems;
-    qint64                 sumMemorySize = 0;
-    qint64                 sumFileSize   = 0;
-    FileCacheItem *        item;
-
-    QHashIterator<XMPP::Hash, FileCacheItem *> it(_items);
-    while (it.hasNext()) {
-        it.next();
-        item = it.value();
-        item->flushToDisk(); /* even if we are going to remove it. it's quite rare to worry about */
-        if (item->isExpired(finishSession)) {
-            removeItem(item, false); // even if virtual method stopped removing, we don't touch this item below.
-            continue;
+    auto it = _reads.find(watcher);
+    if (it == _reads.end()) {
+        return;
+    }
+    ReadRequest req = it.value();
+    _reads.erase(it);
+    watcher->deleteLater();
+
+    QByteArray     data = watcher->result();
+    FileCacheItem *item = _items.value(req.id);
+    if (!item) {
+        data.clear();
+    } else if (!item->inMemory() && data.size()) {
+        item->_data = data;
+        addToMemory(item);
+        scheduleSync(); // check memory limits
+    }
+
+    if (req.context) {
+        req.callback(data);
+    }
+}
+
+void FileCache::flushAsync(FileCacheItem *item)
+{
+    if (item->_flags & (FileCacheItem::OnDisk | FileCacheItem::Writing)) {
+        return;
+    }
+    if (!item->inMemory()) {
+        item->flushToDisk();
+        return;
+    }
+
+    item->_flags |= FileCacheItem::Writing;
+    auto watcher = new QFutureWatcher<bool>(this);
+    _writes.insert(watcher, qMakePair(item->id(), item->fileName()));
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher]() { writeFinished(watcher); });
+    watcher->setFuture(QtConcurrent::run(writeCacheFile, _cacheDir + "/" + item->fileName(), item->_data));
+}
+
+void FileCache::writeFinished(QFutureWatcher<bool> *watcher)
+{
+    auto it = _writes.find(watcher);
+    if (it == _writes.end()) {
+        return;
+    }
+    XMPP::Hash id       = it.value().first;
+    QString    fileName = it.value().second;
+    _writes.erase(it);
+    watcher->deleteLater();
+
+    FileCacheItem *item = _items.value(id);
+    if (!item || !(item->_flags & FileCacheItem::Writing)) {
+        // removed while being written
+        if (watcher->result() && !item) {
+            QFile::remove(_cacheDir + "/" + fileName);
         }
-        if (item->size()) {
-            if (item->inMemory()) {
-                loadedItems.append(item);
-                sumMemorySize += item->size();
-            }
-            if (item->isOnDisk()) {
-                sumFileSize += item->size();
-                onDiskItems.append(item);
-            }
-        } else if (!item->isRegistered()) { // just put to registry item without data and stop reviewing it
-            toRegistry(item);               // save item to registry if not yet
+        return;
+    }
+
+    bool unload = item->_flags & FileCacheItem::UnloadAfterWrite;
+    item->_flags &= ~(FileCacheItem::Writing | FileCacheItem::UnloadAfterWrite);
+    if (!watcher->result()) {
+        if (unload) {
+            addToMemory(item); // keep it in memory, we have nothing else
         }
+        return;
     }
 
-    // if (sumDataSize > _fileCacheSize || sumMemorySize > _memoryCacheSize) {
+    item->_flags |= FileCacheItem::OnDisk;
+    addToDisk(item);
+    if (unload) {
+        item->_data = QByteArray();
+    }
+    scheduleSync(); // check disk limits
+}
 
-    // flush overflowed in-memory data to disk
-    if (sumMemorySize > _memoryCacheSize) {
-        std::sort(loadedItems.begin(), loadedItems.end(), ctimeLessThan); // by create time from oldest to newest
-        while (sumMemorySize > _memoryCacheSize && loadedItems.size()) {
-            item = loadedItems.takeFirst();
-            if (!item->isOnDisk()) { // was kept in memory only. unload() will flush to disk
-                sumFileSize += item->size();
-                onDiskItems.append(item);
-            }
-            item->unload(); // will flush data to disk if necesary
-            sumMemorySize -= item->size();
-            if (!item->isRegistered()) {
-                toRegistry(item); // save item to registry if not yet
+void FileCache::finishIo()
+{
+    for (auto watcher : _writes.keys()) {
+        watcher->waitForFinished();
+        writeFinished(watcher);
+    }
+    for (auto watcher : _reads.keys()) {
+        watcher->waitForFinished();
+        _reads.remove(watcher);
+        watcher->deleteLater();
+    }
+}
+
+void FileCache::touch(FileCacheItem *item)
+{
+    if (item->_inMemoryLru)
+        _memoryLru.splice(_memoryLru.end(), _memoryLru, item->_memoryPos);
+    if (item->_inDiskLru)
+        _diskLru.splice(_diskLru.end(), _diskLru, item->_diskPos);
+}
+
+void FileCache::addToMemory(FileCacheItem *item)
+{
+    if (item->_inMemoryLru || !item->size())
+        return;
+    item->_memoryPos   = _memoryLru.insert(_memoryLru.end(), item);
+    item->_inMemoryLru = true;
+    _memoryUsage += item->size();
+}
+
+void FileCache::removeFromMemory(FileCacheItem *item)
+{
+    if (!item->_inMemoryLru)
+        return;
+    _memoryLru.erase(item->_memoryPos);
+    item->_inMemoryLru = false;
+    _memoryUsage -= item->size();
+}
+
+void FileCache::addToDisk(FileCacheItem *item)
+{
+    if (item->_inDiskLru || !item->size())
+        return;
+    item->_diskPos   = _diskLru.insert(_diskLru.end(), item);
+    item->_inDiskLru = true;
+    _diskUsage += item->size();
+}
+
+void FileCache::removeFromDisk(FileCacheItem *item)
+{
+    if (!item->_inDiskLru)
+        return;
+    _diskLru.erase(item->_diskPos);
+    item->_inDiskLru = false;
+    _diskUsage -= item->size();
+}
+
+void FileCache::releaseMemory(FileCacheItem *item)
+{
+    removeFromMemory(item);
+    if (!item->inMemory())
+        return;
+    if (item->isOnDisk()) {
+        item->_data = QByteArray();
+    } else {
+        item->_flags |= FileCacheItem::UnloadAfterWrite;
+        flushAsync(item);
+    }
+}
+
+void FileCache::enforceLimits()
+{
+    // flush least recently used in-memory data to disk
+    while (_memoryUsage > _memoryCacheSize && !_memoryLru.empty()) {
+        releaseMemory(_memoryLru.front());
+    }
+
+    // remove least recently used disk data
+    auto it = _diskLru.begin();
+    while (_diskUsage > _fileCacheSize && it != _diskLru.end()) {
+        FileCacheItem *item = *it++;
+        if (item->isDeletable()) {
+            removeItem(item, false);
+        }
+    }
+}
+
+void FileCache::sync() { sync(false); }
+
+// nothing is lost if this waits for the user to pause, the limits are just enforced a bit later
+void FileCache::scheduleSync()
+{
+    IdleScheduler::instance()->schedule(this, "sync", [this]() { sync(); }, IdleScheduler::Low, 30000, 1000);
+}
+
+void FileCache::sync(bool finishSession)
+{
+    if (finishSession) {
+        finishIo();
+        for (auto item : uniqueItems()) {
+            item->flushToDisk(); /* even if we are going to remove it. it's quite rare to worry about */
+            if (item->isExpired(true)) {
+                removeItem(item, false); // even if virtual method stopped removing, we don't touch this item below.
             }
         }
+    } else if (_lastGc.secsTo(QDateTime::currentDateTime()) > FC_GC_INTERVAL) {
+        gc();
     }
 
     // register pending items and flush them if necessary
     foreach (FileCacheItem *item, _pendingRegisterItems) {
         toRegistry(item); // FIXME do this only after we have a file on disk (or data size = 0)
         if (_syncPolicy == InstantFLush) {
-            item->flushToDisk();
+            flushAsync(item);
         }
     }
 
-    // remove overflowed disk data
-    if (sumFileSize > _fileCacheSize) {
-        std::sort(onDiskItems.begin(), onDiskItems.end(), ctimeLessThan);
-        while (sumFileSize > _fileCacheSize && onDiskItems.size()) {
-            item = onDiskItems.takeFirst();
-            if (!item->isDeletable()) {
-                continue;
-            }
-            auto id = item->id();
-            auto sz = item->size();
-            removeItem(item, false);
-            if (!_items.value(id)) { // really removed
-                sumFileSize -= sz;
-            }
-        }
+    enforceLimits();
+    if (finishSession) {
+        finishIo();
     }
 
-    if (_registryChanged) {
-        _registry->saveOptions(_cacheDir + "/cache.xml", "items", ApplicationInfo::fileCacheNS(),
-                               ApplicationInfo::version());
-        _registryChanged = false;
+    if (_registry->isDirty()) {
+        applyMerged(_registry->save());
+    } else {
+        merge();
     }
 }
 
 void FileCache::toRegistry(FileCacheItem *item)
 {
-    // TODO build Map/Hash instead and insert it to options
-    QString prefix = QString("h") + QString::fromLatin1(item->id().toHex());
-    _registry->setOption(prefix + ".ha", item->id().stringType());
-    _registry->setOption(prefix + ".metadata", item->metadata());
-    _registry->setOption(prefix + ".ctime", item->created().toString(Qt::ISODate));
-    _registry->setOption(prefix + ".max-age", int(item->maxAge()));
-    _registry->setOption(prefix + ".size", qulonglong(item->size()));
-
-    QStringList aliases;
-    auto        it = item->sums().cbegin() + 1;
+    FileCacheRegistry::Entry e;
+    e.ha       = item->id().stringType();
+    e.metadata = item->metadata();
+    e.ctime    = item->created();
+    e.maxAge   = item->maxAge();
+    e.size     = qulonglong(item->size());
+
+    auto it = item->sums().cbegin() + 1;
     while (it != item->sums().cend()) {
-        aliases.append(QString("%1+%2").arg(it->stringType(), QString::fromLatin1(it->toHex())));
+        e.aliases.append(QString("%1+%2").arg(it->stringType(), QString::fromLatin1(it->toHex())));
         ++it;
     }
-    _registry->setOption(prefix + ".aliases", aliases);
+    _registry->put(QString("h") + QString::fromLatin1(item->id().toHex()), e);
 
     item->_flags |= FileCacheItem::Registered;
     _pendingRegisterItems.remove(item->id());
-    _registryChanged = true;
 }
@@ -27,12 +27,16 @@
 #include <QFileInfo>
 #include <QHash>
 #include <QObject>
+#include <QPointer>
 #include <QVariantMap>
+#include <functional>
+#include <list>
 #include <memory>
 
 class FileCache;
-class OptionsTree;
-class QTimer;
+class FileCacheRegistry;
+
+template <typename T> class QFutureWatcher;
 
 class FileCacheItem : public QObject {
     Q_OBJECT
@@ -42,8 +46,10 @@ public:
     enum Flags {
         OnDisk             = 0x1,
         Registered         = 0x2,
-        SessionUndeletable = 0x4 // The item is undeletable by expiration or cache size limits during this session
+        SessionUndeletable = 0x4, // The item is undeletable by expiration or cache size limits during this session
         // Unloadable  = 0x8 // another good idea
+        Writing            = 0x10, // data is being written to disk by a worker thread
+        UnloadAfterWrite   = 0x20  // evicted from memory, drop data once it's written
     };
 
     FileCacheItem(FileCache *parent, const QList<XMPP::Hash> &sums, const QVariantMap &metadata, const QDateTime &dt,
@@ -64,18 +70,10 @@ public:
     bool              isExpired(bool finishSession = false) const;
     inline FileCache *parentCache() const { return (FileCache *)parent(); }
     inline XMPP::Hash id() const { return _sums.value(0); }
-    inline void       addHashSum(const XMPP::Hash &id)
-    {
-        _sums += id;
-        _flags &= ~Registered;
-    }
+    void              addHashSum(const XMPP::Hash &id);
     inline const QList<XMPP::Hash> &sums() const { return _sums; }
     inline QVariantMap              metadata() const { return _metadata; }
-    inline void                     setMetadata(const QVariantMap &md)
-    {
-        _metadata = md;
-        _flags &= ~Registered;
-    } // we have to update registry eventually
+    void                            setMetadata(const QVariantMap &md); // we have to update registry eventually
     inline QDateTime    created() const { return _ctime; }
     inline void         reborn() { _ctime = QDateTime::currentDateTime(); }
     inline unsigned int maxAge() const { return _maxAge; }
@@ -96,6 +94,8 @@ public:
 private:
     friend class FileCache;
 
+    void unregister(); // registry has to be updated
+
     QList<XMPP::Hash> _sums;
     QVariantMap       _metadata;
     QDateTime         _ctime;
@@ -105,6 +105,12 @@ private:
 
     quint16 _flags;
     QString _fileName;
+
+    // positions in FileCache LRU lists
+    std::list<FileCacheItem *>::iterator _memoryPos;
+    std::list<FileCacheItem *>::iterator _diskPos;
+    bool                                 _inMemoryLru = false;
+    bool                                 _inDiskLru   = false;
 };
 
 class FileCache : public QObject {
@@ -124,6 +130,14 @@ public:
     FileCache(const QString &cacheDir, QObject *parent = nullptr);
     ~FileCache();
 
+    /**
+     * @brief Caches made from now on share their directory with the other
+     *   processes which set this, e.g. profiles running at the same time. A
+     *   process picks up what the others stored on a miss and on sync, and
+     *   its session items stay its own.
+     */
+    static void setShared(bool state);
+
     void gc();
 
     inline QString cacheDir() const { return _cacheDir; }
@@ -174,7 +188,19 @@ public:
      */
     FileCacheItem *get(const XMPP::Hash &id, bool reborn = false);
     QByteArray     getData(const XMPP::Hash &id, bool reborn = false);
-    void           sync(bool finishSession);
+
+    /**
+     * @brief same as getData() but reads the file on a worker thread
+     * @param context - callback won't be called if context is destroyed
+     * @param callback - called from the event loop with the data (empty if not found),
+     *   or immediately if the data is already in memory
+     */
+    void getDataAsync(const XMPP::Hash &id, QObject *context, std::function<void(const QByteArray &)> callback,
+                      bool reborn = false);
+    void sync(bool finishSession);
+
+    // drop in-memory copy of the item. it's written to disk first if necessary
+    void releaseMemory(FileCacheItem *item);
 
 protected:
     /**
@@ -189,7 +215,32 @@ public slots:
     void sync();
 
 private:
-    void toRegistry(FileCacheItem *);
+    friend class FileCacheItem;
+
+    struct ReadRequest {
+        XMPP::Hash                              id;
+        QPointer<QObject>                       context;
+        std::function<void(const QByteArray &)> callback;
+    };
+
+    void                   toRegistry(FileCacheItem *);
+    FileCacheItem *        fromRegistry(const QString &key);
+    void                   applyMerged(const QHash<QString, QString> &entries);
+    void                   merge();
+    QList<FileCacheItem *> uniqueItems() const;
+
+    void touch(FileCacheItem *item);
+    void addToMemory(FileCacheItem *item);
+    void removeFromMemory(FileCacheItem *item);
+    void addToDisk(FileCacheItem *item);
+    void removeFromDisk(FileCacheItem *item);
+    void enforceLimits();
+    void scheduleSync();
+
+    void flushAsync(FileCacheItem *item);
+    void writeFinished(QFutureWatcher<bool> *watcher);
+    void readFinished(QFutureWatcher<QByteArray> *watcher);
+    void finishIo();
 
 protected:
     QHash<XMPP::Hash, FileCacheItem *> _items;
@@ -200,11 +251,21 @@ private:
     unsigned int                       _fileCacheSize;
     unsigned int                       _defaultMaxAge;
     SyncPolicy                         _syncPolicy;
-    QTimer *                           _syncTimer;
-    OptionsTree *                      _registry;
+    FileCacheRegistry *                _registry;
+    bool                               _shared;
     QHash<XMPP::Hash, FileCacheItem *> _pendingRegisterItems;
 
-    bool _registryChanged;
+    // least recently used first
+    std::list<FileCacheItem *> _memoryLru;
+    std::list<FileCacheItem *> _diskLru;
+    qint64                     _memoryUsage;
+    qint64                     _diskUsage;
+    QDateTime                  _lastGc;
+
+    QHash<QFutureWatcher<bool> *, QPair<XMPP::Hash, QString>> _writes; // id and file name
+    QHash<QFutureWatcher<QByteArray> *, ReadRequest>          _reads;
+
+    static bool _sharedDefault;
 };
 
 #endif // FILECACHE_H
@@ -62,12 +62,18 @@ FileShareDlg::FileShareDlg(const QList<FileSharingItem*> &items, QWidget *parent
     for (auto const &pi: items) {
         QFileInfo fi(pi->fileName());
         auto tr = filesModel->addTransfer(MultiFileTransferModel::Outgoing, fi.fileName(), quint64(fi.size()));
-        tr->setThumbnail(pi->thumbnail(QSize(64,64)));
+        pi->thumbnail(QSize(64, 64), tr, [tr](const QIcon &icon) { tr->setThumbnail(icon); });
         if (pi->isPublished()) {
             tr->setCurrentSize(quint64(fi.size()));
             tr->setState(MultiFileTransferModel::Done);
         }
         tr->setProperty("publisher", QVariant::fromValue<FileSharingItem*>(pi));
+        if (pi->isHashing()) {
+            connect(pi, &FileSharingItem::hashingProgress, tr, [tr](qint64 processed, qint64 total) {
+                tr->setInfo(FileShareDlg::tr("Computing hash sums: %1%").arg(total ? processed * 100 / total : 100));
+            });
+            connect(pi, &FileSharingItem::hashingFinished, tr, [tr]() { tr->setInfo(QString()); });
+        }
     }
 
     QImage preview;
@@ -32,10 +32,12 @@
 #include <QByteArray>
 #include <QDir>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QNetworkReply>
 #include <QTimer>
 #include <QUrlQuery>
 #include <QVariant>
+#include <QtConcurrentRun>
 
 static std::tuple<bool, qint64, qint64> parseHttpRangeResponse(const QByteArray &value)
 {
@@ -54,6 +56,37 @@ static std::tuple<bool, qint64, qint64> parseHttpRangeResponse(const QByteArray
     return std::tuple<bool, qint64, qint64>(true, start, size);
 }
 
+static const int    maxSegments       = 4;
+static const qint64 minSegmentSize    = 2 * 1024 * 1024;
+static const int    maxSourceFailures = 2;
+
+static QList<Jid> onlineJids(PsiAccount *acc, const QList<Jid> &jids)
+{
+    QList<Jid> ret;
+    for (auto const &j : jids) {
+        if (j == acc->client()->jid() || ret.contains(j))
+            continue;
+        for (UserListItem *u : acc->findRelevant(j)) {
+            UserResourceList::Iterator rit = u->userResourceList().find(j.resource());
+            if (rit != u->userResourceList().end()) {
+                ret.append(j);
+                break;
+            }
+        }
+    }
+    return ret;
+}
+
+static Jid jingleUriEntity(const QString &uri)
+{
+    QString path = QUrl(uri).path();
+    if (path.startsWith('/')) { // this happens when authority part is present
+        path = path.mid(1);
+    }
+    Jid entity = JIDUtil::fromString(path);
+    return entity.isValid() && !entity.node().isEmpty() ? entity : Jid();
+}
+
 class AbstractFileShareDownloader : public QObject {
     Q_OBJECT
 protected:
@@ -70,19 +103,7 @@ protected:
         QTimer::singleShot(0, this, &AbstractFileShareDownloader::failed);
     }
 
-    Jid selectOnlineJid(const QList<Jid> &jids) const
-    {
-        for (auto const &j : jids) {
-            if (j == acc->client()->jid())
-                continue;
-            for (UserListItem *u : acc->findRelevant(j)) {
-                UserResourceList::Iterator rit = u->userResourceList().find(j.resource());
-                if (rit != u->userResourceList().end())
-                    return j;
-            }
-        }
-        return Jid();
-    }
+    Jid selectOnlineJid(const QList<Jid> &jids) const { return onlineJids(acc, jids).value(0); }
 
 public:
     AbstractFileShareDownloader(PsiAccount *acc, const QString &uri, QObject *parent) :
@@ -120,6 +141,7 @@ class JingleFileShareDownloader : public AbstractFileShareDownloader {
     Jingle::FileTransfer::Application *app = nullptr;
     XMPP::Jingle::FileTransfer::File   file;
     QList<Jid>                         jids;
+    bool                               pinned = false;
 
 public:
     JingleFileShareDownloader(PsiAccount *acc, const QString &uri, const XMPP::Jingle::FileTransfer::File &file,
@@ -129,16 +151,19 @@ public:
     {
     }
 
+    // download only from the given peer
+    void pinSource(const Jid &j)
+    {
+        jids   = QList<Jid>() << j;
+        pinned = true;
+    }
+
     void start()
     {
-        QUrl    uriToOpen(sourceUri);
-        QString path = uriToOpen.path();
-        if (path.startsWith('/')) { // this happens when authority part is present
-            path = path.mid(1);
-        }
-        Jid  entity = JIDUtil::fromString(path);
+        QUrl uriToOpen(sourceUri);
+        Jid  entity = jingleUriEntity(sourceUri);
         auto myJids = jids;
-        if (entity.isValid() && !entity.node().isEmpty())
+        if (!pinned && entity.isValid())
             myJids.prepend(entity);
         Jid dataSource = selectOnlineJid(myJids);
         if (!dataSource.isValid()) {
@@ -250,6 +275,8 @@ public:
 #elif QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
         req.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
 #endif
+        // the file ends up in FileCache, no need to keep a second copy
+        req.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
         reply = acc->psi()->networkAccessManager()->get(req);
         connect(reply, &QNetworkReply::metaDataChanged, this, [this]() {
             int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
@@ -261,7 +288,10 @@ public:
                     namFailed(QLatin1String("Invalid HTTP response range"));
                     return;
                 }
-            } else if (status != 200 && status != 203) {
+            } else if (status == 200 || status == 203) {
+                rangeStart = 0;
+                rangeSize  = 0; // server ignored our range request
+            } else {
                 rangeStart = 0;
                 rangeSize  = 0; // make it not-ranged
                 namFailed(tr("Unexpected HTTP status") + QString(": %1").arg(status));
@@ -389,6 +419,355 @@ public:
     bool                         metaReady  = false;
     bool                         success    = false;
 
+    struct Source {
+        QString uri;
+        Jid     jid; // the peer for Jingle sources
+        int     failures = 0;
+        bool    busy     = false;
+    };
+
+    struct Segment {
+        qint64                       start      = 0;
+        qint64                       end        = 0; // exclusive
+        qint64                       pos        = 0; // next byte to be written
+        int                          source     = -1;
+        AbstractFileShareDownloader *downloader = nullptr;
+        bool                         confirmed  = false; // the source accepted our range
+    };
+
+    // segmented download state
+    bool                  segmented  = false;
+    bool                  verified   = false;
+    bool                  done       = false;
+    QList<Source>         sources;
+    QList<Segment>        segments;
+    qint64                readPos    = 0;
+    qint64                contiguous = 0; // completely downloaded head of the file
+    QByteArray            buffer;
+    QFutureWatcher<bool> *verifier = nullptr;
+
+    QString tmpFileName() const
+    {
+        QFileInfo fi(dstFileName);
+        return QString("%1/dl-%2").arg(fi.path(), fi.fileName());
+    }
+
+    bool finishFile()
+    {
+        tmpFile->close();
+        bool ret = QFile::rename(tmpFile->fileName(), dstFileName);
+        if (!ret)
+            lastError = tr("Failed to rename downloaded file");
+        tmpFile.reset();
+        return ret;
+    }
+
+    void addSource(const QString &uri, const Jid &jid = Jid())
+    {
+        Source src;
+        src.uri = uri;
+        src.jid = jid;
+        sources.append(src);
+    }
+
+    // HTTP/FTP uris and every online peer serving the file with Jingle. BOB can't do ranges
+    void collectSources()
+    {
+        QList<Jid> peers;
+        sources.clear();
+        for (auto it = uris.crbegin(); it != uris.crend(); ++it) {
+            switch (FileSharingItem::sourceType(*it)) {
+            case FileSharingItem::SourceType::HTTP:
+            case FileSharingItem::SourceType::FTP:
+                addSource(*it);
+                break;
+            case FileSharingItem::SourceType::Jingle: {
+                auto candidates = jids;
+                Jid  entity     = jingleUriEntity(*it);
+                if (entity.isValid())
+                    candidates.prepend(entity);
+                for (const Jid &j : onlineJids(acc, candidates)) {
+                    if (peers.contains(j))
+                        continue;
+                    peers.append(j);
+                    addSource(*it, j);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    bool canSegment()
+    {
+        if (rangeStart || rangeSize || !file.hasSize() || qint64(file.size()) < 2 * minSegmentSize)
+            return false;
+        collectSources();
+        return sources.size() > 1;
+    }
+
+    bool startSegmented()
+    {
+        qint64 size = qint64(file.size());
+        tmpFile.reset(new QFile(tmpFileName()));
+        if (!tmpFile->open(QIODevice::ReadWrite | QIODevice::Truncate) || !tmpFile->resize(size)) {
+            lastError = tmpFile->errorString();
+            tmpFile.reset();
+            return false;
+        }
+
+        segmented  = true;
+        int    cnt = int(qMin(qint64(qMin(sources.size(), maxSegments)), size / minSegmentSize));
+        qint64 len = size / cnt;
+        for (int i = 0; i < cnt; i++) {
+            Segment seg;
+            seg.start = seg.pos = len * i;
+            seg.end             = (i == cnt - 1) ? size : seg.start + len;
+            segments.append(seg);
+        }
+        for (int i = 0; i < cnt; i++)
+            startSegment(i, i);
+
+        metaReady = true;
+        QTimer::singleShot(0, q, &FileShareDownloader::metaDataChanged);
+        return true;
+    }
+
+    void startSegment(int idx, int srcIdx)
+    {
+        Source &                     src = sources[srcIdx];
+        AbstractFileShareDownloader *dl;
+        if (src.jid.isValid()) {
+            auto jdl = new JingleFileShareDownloader(acc, src.uri, file, jids, this);
+            jdl->pinSource(src.jid);
+            dl = jdl;
+        } else {
+            dl = new NAMFileShareDownloader(acc, src.uri, this);
+        }
+        src.busy = true;
+
+        Segment &seg   = segments[idx];
+        seg.source     = srcIdx;
+        seg.downloader = dl;
+        seg.confirmed  = false;
+        dl->setRange(seg.pos, seg.end - seg.pos);
+
+        connect(dl, &AbstractFileShareDownloader::metaDataChanged, this, [this, idx]() {
+            Segment &seg = segments[idx];
+            if (std::get<0>(seg.downloader->range()) != seg.pos) {
+                // useless for segmented download
+                sources[seg.source].failures = maxSourceFailures;
+                segmentFailed(idx);
+                return;
+            }
+            seg.confirmed = true;
+            pumpSegment(idx);
+        });
+        connect(dl, &AbstractFileShareDownloader::readyRead, this, [this, idx]() { pumpSegment(idx); });
+        connect(dl, &AbstractFileShareDownloader::disconnected, this, [this, idx]() {
+            pumpSegment(idx);
+            if (segments[idx].downloader)
+                segmentFailed(idx); // disconnected before the end of the segment. resume it later
+        });
+        connect(dl, &AbstractFileShareDownloader::failed, this, [this, idx]() { segmentFailed(idx); });
+        dl->start();
+    }
+
+    int releaseSegment(int idx)
+    {
+        Segment &seg = segments[idx];
+        if (seg.downloader) {
+            seg.downloader->disconnect(this);
+            seg.downloader->abort();
+            seg.downloader->deleteLater();
+            seg.downloader = nullptr;
+        }
+        int src = seg.source;
+        if (src != -1)
+            sources[src].busy = false;
+        seg.source = -1;
+        return src;
+    }
+
+    int activeSegments() const
+    {
+        int ret = 0;
+        for (const auto &seg : segments)
+            if (seg.downloader)
+                ret++;
+        return ret;
+    }
+
+    // halves the biggest remaining part of an active segment. returns index of the new segment or -1
+    int splitLargestSegment()
+    {
+        int    best      = -1;
+        qint64 remaining = 0;
+        for (int i = 0; i < segments.size(); i++) {
+            const Segment &seg = segments[i];
+            if (seg.downloader && seg.end - seg.pos > remaining) {
+                best      = i;
+                remaining = seg.end - seg.pos;
+            }
+        }
+        if (best == -1 || remaining < 2 * minSegmentSize)
+            return -1;
+
+        Segment seg;
+        seg.start = seg.pos = segments[best].pos + remaining / 2;
+        seg.end             = segments[best].end;
+        segments[best].end  = seg.start;
+        segments.append(seg);
+        return segments.size() - 1;
+    }
+
+    void scheduleIdleSources()
+    {
+        for (int i = 0; i < sources.size() && activeSegments() < maxSegments; i++) {
+            if (sources[i].busy || sources[i].failures >= maxSourceFailures)
+                continue;
+            int idx = -1;
+            for (int j = 0; j < segments.size() && idx == -1; j++)
+                if (!segments[j].downloader && segments[j].pos < segments[j].end)
+                    idx = j;
+            if (idx == -1)
+                idx = splitLargestSegment();
+            if (idx == -1)
+                return;
+            startSegment(idx, i);
+        }
+    }
+
+    void pumpSegment(int idx)
+    {
+        Segment &seg = segments[idx];
+        if (!seg.downloader || !seg.confirmed)
+            return;
+
+        if (buffer.isEmpty())
+            buffer.resize(64 * 1024);
+        qint64 avail;
+        while (seg.pos < seg.end && (avail = seg.downloader->bytesAvailable()) > 0) {
+            avail          = qMin(qMin(avail, seg.end - seg.pos), qint64(buffer.size()));
+            qint64 bytesRd = seg.downloader->read(buffer.data(), avail);
+            if (bytesRd <= 0)
+                break;
+            if (!tmpFile->seek(seg.pos) || tmpFile->write(buffer.constData(), bytesRd) != bytesRd) {
+                lastError = tmpFile->errorString();
+                failSegmented();
+                return;
+            }
+            seg.pos += bytesRd;
+        }
+
+        bool completed = seg.pos >= seg.end;
+        updateProgress();
+        if (completed) {
+            releaseSegment(idx);
+            scheduleIdleSources();
+            if (!activeSegments())
+                verify();
+        }
+    }
+
+    void segmentFailed(int idx)
+    {
+        Segment &seg = segments[idx];
+        if (seg.downloader && !seg.downloader->lastError().isEmpty())
+            lastError = seg.downloader->lastError();
+        int src = releaseSegment(idx);
+        if (src != -1)
+            sources[src].failures++;
+        scheduleIdleSources();
+        if (!activeSegments()) {
+            if (lastError.isEmpty())
+                lastError = tr("All download sources failed");
+            failSegmented();
+        }
+    }
+
+    void updateProgress()
+    {
+        qint64 size       = qint64(file.size());
+        qint64 head       = size;
+        qint64 downloaded = 0;
+        for (const auto &seg : segments) {
+            if (seg.pos < seg.end)
+                head = qMin(head, seg.pos);
+            downloaded += seg.pos - seg.start;
+        }
+        emit q->progress(size_t(downloaded), size_t(size));
+        if (head > contiguous) {
+            contiguous = head;
+            emit q->readyRead();
+        }
+    }
+
+    void verify()
+    {
+        if (verifier)
+            return;
+        tmpFile->flush();
+        QString fn     = tmpFile->fileName();
+        auto    hashes = sums;
+        verifier       = new QFutureWatcher<bool>(this);
+        connect(verifier, &QFutureWatcher<bool>::finished, this, [this]() {
+            bool ok = verifier->result();
+            verifier->deleteLater();
+            verifier = nullptr;
+            if (!ok) {
+                lastError = tr("Checksum mismatch for the downloaded file");
+                failSegmented();
+                return;
+            }
+            verified = true;
+            if (readPos >= contiguous)
+                finishSegmented();
+        });
+        verifier->setFuture(QtConcurrent::run([fn, hashes]() {
+            QFile f(fn);
+            for (const auto &h : hashes) {
+                if (!f.open(QIODevice::ReadOnly))
+                    return false;
+                auto computed = XMPP::Hash::from(h.type(), &f);
+                f.close();
+                if (!computed.data().isEmpty() && computed.data() != h.data())
+                    return false;
+            }
+            return true;
+        }));
+    }
+
+    void abortSegments()
+    {
+        for (int i = 0; i < segments.size(); i++)
+            releaseSegment(i);
+    }
+
+    void failSegmented()
+    {
+        if (done)
+            return;
+        done = true;
+        abortSegments();
+        success = false;
+        emit q->disconnected();
+        emit q->finished();
+    }
+
+    // the file is verified and the reader got all the data
+    void finishSegmented()
+    {
+        if (done)
+            return;
+        done    = true;
+        success = finishFile();
+        emit q->disconnected();
+        emit q->finished();
+    }
+
     void startNextDownloader()
     {
         if (downloader) {
@@ -438,10 +817,7 @@ public:
 
         connect(downloader, &AbstractFileShareDownloader::metaDataChanged, q, [this]() {
             metaReady = true;
-            QFileInfo fi(dstFileName);
-            QString   tmpFN = QString::fromLatin1("dl-") + fi.fileName();
-            tmpFN           = QString("%1/%2").arg(fi.path(), tmpFN);
-            tmpFile.reset(new QFile(tmpFN));
+            tmpFile.reset(new QFile(tmpFileName()));
             if (!tmpFile->open(QIODevice::ReadWrite | QIODevice::Truncate)) { // TODO complete unfinished downloads
                 lastError = tmpFile->errorString();
                 tmpFile.reset();
@@ -487,7 +863,12 @@ FileShareDownloader::~FileShareDownloader()
 
 bool FileShareDownloader::isSuccess() const { return d->success; }
 
-bool FileShareDownloader::isConnected() const { return d->downloader ? d->downloader->isConnected() : false; }
+bool FileShareDownloader::isConnected() const
+{
+    if (d->segmented)
+        return !d->done;
+    return d->downloader ? d->downloader->isConnected() : false;
+}
 
 bool FileShareDownloader::open(QIODevice::OpenMode mode)
 {
@@ -516,17 +897,24 @@ bool FileShareDownloader::open(QIODevice::OpenMode mode)
         } else {
             fn = QString("%1-%2").arg(baseName, QString::number(index));
         }
+        index++;
     }
 
     d->dstFileName = docDir.absoluteFilePath(fn);
     QIODevice::open(mode);
-    d->startNextDownloader();
+    if (!d->canSegment()) {
+        d->startNextDownloader();
+    } else if (!d->startSegmented()) {
+        d->success = false;
+        QTimer::singleShot(0, this, &FileShareDownloader::finished);
+    }
 
     return true;
 }
 
 void FileShareDownloader::abort()
 {
+    d->abortSegments();
     if (d->downloader) {
         d->downloader->abort();
     }
@@ -557,6 +945,18 @@ const Jingle::FileTransfer::File &FileShareDownloader::jingleFile() const { retu
 
 qint64 FileShareDownloader::readData(char *data, qint64 maxSize)
 {
+    if (d->segmented) {
+        qint64 bytesRead = qMin(maxSize, d->contiguous - d->readPos);
+        if (!d->tmpFile || bytesRead <= 0 || !d->tmpFile->seek(d->readPos))
+            return 0;
+        bytesRead = d->tmpFile->read(data, bytesRead);
+        if (bytesRead > 0)
+            d->readPos += bytesRead;
+        if (d->verified && d->readPos >= d->contiguous)
+            QTimer::singleShot(0, d.data(), [this]() { d->finishSegmented(); });
+        return qMax(bytesRead, qint64(0));
+    }
+
     if (!d->tmpFile || !d->downloader)
         return 0; // wtf?
 
@@ -570,7 +970,7 @@ qint64 FileShareDownloader::readData(char *data, qint64 maxSize)
 
     if (!d->downloader->isConnected() && !d->downloader->bytesAvailable()) {
         // seems like last piece of data was written. we are ready to finish
-        d->success = true;
+        d->success = d->finishFile();
         emit finished();
     }
 
@@ -584,6 +984,11 @@ qint64 FileShareDownloader::writeData(const char *, qint64)
 
 bool FileShareDownloader::isSequential() const { return true; }
 
-qint64 FileShareDownloader::bytesAvailable() const { return d->downloader ? d->downloader->bytesAvailable() : 0; }
+qint64 FileShareDownloader::bytesAvailable() const
+{
+    if (d->segmented)
+        return d->contiguous - d->readPos;
+    return d->downloader ? d->downloader->bytesAvailable() : 0;
+}
 
 #include "filesharingdownloader.moc"
@@ -22,6 +22,7 @@
 #include "filesharingmanager.h"
 #include "fileutil.h"
 #include "httpfileupload.h"
+#include "pixmaputil.h"
 #include "psiaccount.h"
 #include "userlist.h"
 #include "xmpp_client.h"
@@ -33,14 +34,53 @@
 #include <QFileIconProvider>
 #include <QImageReader>
 #include <QMimeDatabase>
-#include <QPainter>
 #include <QTemporaryFile>
+#include <QTimer>
+#include <QtConcurrentRun>
+
+#include <atomic>
 
 #define TEMP_TTL (7 * 24 * 3600)
 #define FILE_TTL (365 * 24 * 3600)
 
 using namespace XMPP;
 
+struct FileHashState {
+    std::atomic<qint64> processed { 0 };
+    std::atomic<bool>   canceled { false };
+};
+
+// SHA-1 is the share id. SHA-256 is what other clients prefer.
+// Both are computed in one pass, the second one in parallel with the next read.
+static FileSharingItem::HashSums hashFile(const QString &path, std::shared_ptr<FileHashState> state)
+{
+    FileSharingItem::HashSums ret;
+    QFile                     f(path);
+    if (!f.open(QIODevice::ReadOnly))
+        return ret;
+
+    const qint64       blockSize = 1024 * 1024;
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    QCryptographicHash sha256(QCryptographicHash::Sha256);
+    QByteArray         block = f.read(blockSize);
+    while (!block.isEmpty()) {
+        if (state->canceled)
+            return ret;
+        auto sha256Done = QtConcurrent::run([&sha256, block]() { sha256.addData(block); });
+        sha1.addData(block);
+        QByteArray next = f.read(blockSize);
+        sha256Done.waitForFinished();
+        state->processed += block.size();
+        block = next;
+    }
+    if (f.error() != QFileDevice::NoError)
+        return ret;
+
+    ret.append(Hash(Hash::Sha1, sha1.result()));
+    ret.append(Hash(Hash::Sha256, sha256.result()));
+    return ret;
+}
+
 // ======================================================================
 // FileSharingItem
 // ======================================================================
@@ -100,14 +140,17 @@ FileSharingItem::FileSharingItem(const QString &fileName, PsiAccount *acc, FileS
     QObject(manager), _acc(acc), _manager(manager), _fileType(FileType::LocalLink), _flags(SizeKnown),
     _fileName(fileName)
 {
-    QFile file(fileName);
-    _sums.insert(Hash::Sha1, Hash::from(Hash::Sha1, &file));
+    QFileInfo fi(fileName);
+    _sums = manager->knownFileHashes(fi);
+    if (_sums.size() && initFromCache())
+        return;
 
-    if (!initFromCache()) {
-        file.seek(0);
-        _fileSize = size_t(file.size());
-        _mimeType = QMimeDatabase().mimeTypeForFileNameAndData(fileName, &file).name();
-    }
+    QFile file(fileName);
+    file.open(QIODevice::ReadOnly);
+    _fileSize = size_t(file.size());
+    _mimeType = QMimeDatabase().mimeTypeForFileNameAndData(fileName, &file).name();
+    if (_sums.isEmpty())
+        startHashing(fi); // the item may be shown and even uploaded meanwhile
 }
 
 FileSharingItem::FileSharingItem(const QString &mime, const QByteArray &data, const QVariantMap &metaData,
@@ -136,6 +179,8 @@ FileSharingItem::FileSharingItem(const QString &mime, const QByteArray &data, co
 
 FileSharingItem::~FileSharingItem()
 {
+    if (_hashState)
+        _hashState->canceled = true;
     if (_fileType == FileType::TempFile && !_fileName.isEmpty()) {
         QFile f(_fileName);
         if (f.exists())
@@ -184,6 +229,41 @@ bool FileSharingItem::initFromCache(FileCacheItem *cache)
     return true;
 }
 
+void FileSharingItem::startHashing(const QFileInfo &fi)
+{
+    _flags |= Hashing;
+    _hashState   = std::make_shared<FileHashState>();
+    _hashWatcher = new QFutureWatcher<HashSums>(this);
+
+    auto progressTimer = new QTimer(this);
+    progressTimer->setInterval(250);
+    connect(progressTimer, &QTimer::timeout, this,
+            [this]() { emit hashingProgress(_hashState->processed, qint64(_fileSize)); });
+
+    connect(_hashWatcher, &QFutureWatcher<HashSums>::finished, this, [this, fi, progressTimer]() {
+        progressTimer->deleteLater();
+        _sums = _hashWatcher->result();
+        _hashWatcher->deleteLater();
+        _hashWatcher = nullptr;
+        _hashState.reset();
+        _flags &= ~Hashing;
+
+        if (_sums.isEmpty()) {
+            _log.append(tr("Failed to compute hash sums of the file"));
+            emit logChanged();
+        } else {
+            _manager->rememberFileHashes(fi, _sums);
+            if (!(_flags & PublishStarted))
+                initFromCache();
+        }
+        emit hashingFinished();
+        checkPublishFinished();
+    });
+
+    progressTimer->start();
+    _hashWatcher->setFuture(QtConcurrent::run(hashFile, fi.filePath(), _hashState));
+}
+
 Reference FileSharingItem::toReference() const
 {
     QStringList uris(_uris);
@@ -237,23 +317,21 @@ Reference FileSharingItem::toReference() const
     return r;
 }
 
-QIcon FileSharingItem::thumbnail(const QSize &size) const
+void FileSharingItem::thumbnail(const QSize &size, QObject *context,
+                                const std::function<void(const QIcon &)> &callback) const
 {
-    if (_fileType == FileType::RemoteFile)
-        return QIcon();
+    if (_fileType == FileType::RemoteFile) {
+        callback(QIcon());
+        return;
+    }
 
-    QImage image;
-    if (_mimeType.startsWith(QLatin1String("image")) && image.load(_fileName)) {
-        auto   img = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-        QImage back(64, 64, QImage::Format_ARGB32_Premultiplied);
-        back.fill(Qt::transparent);
-        QPainter painter(&back);
-        auto     imgRect = img.rect();
-        imgRect.moveCenter(back.rect().center());
-        painter.drawImage(imgRect, img);
-        return QIcon(QPixmap::fromImage(std::move(back)));
+    callback(QFileIconProvider().icon(_fileName));
+    if (_mimeType.startsWith(QLatin1String("image"))) {
+        PixmapUtil::loadScaled(_fileName, size, context, [size, callback](const QImage &image) {
+            if (!image.isNull())
+                callback(QIcon(QPixmap::fromImage(PixmapUtil::centered(image, size))));
+        });
     }
-    return QFileIconProvider().icon(_fileName);
 }
 
 QImage FileSharingItem::preview(const QSize &maxSize) const
@@ -261,7 +339,7 @@ QImage FileSharingItem::preview(const QSize &maxSize) const
     QImage image;
     if (image.load(_fileName)) {
         auto s = image.size().boundedTo(maxSize);
-        return image.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        return PixmapUtil::scaledImage(image, s);
     }
     return image;
 }
@@ -287,37 +365,44 @@ FileCacheItem *FileSharingItem::cache(bool reborn) const
     return nullptr;
 }
 
+void FileSharingItem::checkPublishFinished()
+{
+    // if we didn't emit yet finished signal and everything is finished (hash sums included)
+    auto ff = HttpFinished | JingleFinished;
+    if ((_flags & PublishNotified) || (_flags & ff) != ff || (_flags & Hashing))
+        return;
+
+    // TODO also check if any of them succeed
+    QVariantMap meta = _metaData;
+    meta["type"]     = _mimeType;
+    if (_uris.count()) // if ever published something on external service
+        // like http
+        meta["uris"] = _uris;
+    if (_sums.isEmpty()) {
+        // nothing to cache it by
+    } else if (_fileType == FileType::TempFile) {
+        auto cache = _manager->moveToCache(_sums, _fileName, meta, TEMP_TTL);
+        _fileType  = FileType::LocalFile;
+        _fileName  = _manager->cacheDir() + "/" + cache->fileName();
+    } else {
+        meta["link"] = _fileName;
+        _manager->saveToCache(_sums, QByteArray(), meta, FILE_TTL);
+    }
+    _flags |= PublishNotified;
+    emit publishFinished();
+}
+
 void FileSharingItem::publish()
 {
     Q_ASSERT(_fileType != FileType::RemoteFile);
 
-    auto checkFinished = [this]() {
-        // if we didn't emit yet finished signal and everything is finished
-        auto ff = HttpFinished | JingleFinished;
-        if (!(_flags & PublishNotified) && (_flags & ff) == ff) { // TODO also check if any of them succeed
-            QVariantMap meta = _metaData;
-            meta["type"]     = _mimeType;
-            if (_uris.count()) // if ever published something on external service
-                // like http
-                meta["uris"] = _uris;
-            if (_fileType == FileType::TempFile) {
-                auto cache = _manager->moveToCache(_sums, _fileName, meta, TEMP_TTL);
-                _fileType  = FileType::LocalFile;
-                _fileName  = _manager->cacheDir() + "/" + cache->fileName();
-            } else {
-                meta["link"] = _fileName;
-                _manager->saveToCache(_sums, QByteArray(), meta, FILE_TTL);
-            }
-            _flags |= PublishNotified;
-            emit publishFinished();
-        }
-    };
+    _flags |= PublishStarted;
 
     if (!(_flags & HttpFinished)) {
         auto hm = _acc->client()->httpFileUploadManager();
         if (hm->discoveryStatus() == HttpFileUploadManager::DiscoNotFound) {
             _flags |= HttpFinished;
-            checkFinished();
+            checkPublishFinished();
         } else {
             auto hfu = hm->upload(_fileName, displayName(), _mimeType);
             hfu->setParent(this);
@@ -325,7 +410,7 @@ void FileSharingItem::publish()
                 Q_UNUSED(bytesTotal)
                 emit publishProgress(size_t(bytesReceived));
             });
-            connect(hfu, &HttpFileUpload::finished, this, [hfu, this, checkFinished]() {
+            connect(hfu, &HttpFileUpload::finished, this, [hfu, this]() {
                 _flags |= HttpFinished;
                 if (hfu->success()) {
                     _log.append(tr("Published on HttpUpload service"));
@@ -335,7 +420,7 @@ void FileSharingItem::publish()
                         QString("%1: %2").arg(tr("Failed to publish on HttpUpload service"), hfu->statusString()));
                 }
                 emit logChanged();
-                checkFinished();
+                checkPublishFinished();
             });
         }
     }
@@ -343,7 +428,7 @@ void FileSharingItem::publish()
         // FIXME we have to add muc jids here if shared with muc
         // readyUris.append(QString::fromLatin1("xmpp:%1?jingle").arg(acc->jid().full()));
         _flags |= JingleFinished;
-        checkFinished();
+        checkPublishFinished();
     }
 }
 
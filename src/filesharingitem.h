@@ -23,12 +23,17 @@
 #include "xmpp_reference.h"
 
 #include <QDateTime>
+#include <QFutureWatcher>
 #include <QObject>
+#include <functional>
+#include <memory>
 
 class FileCacheItem;
+struct FileHashState;
 class FileShareDownloader;
 class FileSharingManager;
 class PsiAccount;
+class QFileInfo;
 
 namespace XMPP {
 class Jid;
@@ -60,6 +65,8 @@ public:
         JingleFinished  = 0x2,
         PublishNotified = 0x4,
         SizeKnown       = 0x8,
+        Hashing         = 0x10,
+        PublishStarted  = 0x20,
     };
     Q_DECLARE_FLAGS(Flags, Flag)
 
@@ -73,20 +80,28 @@ public:
                     FileSharingManager *manager);
     ~FileSharingItem();
 
-    QIcon                     thumbnail(const QSize &size) const;
+    // the file's icon right away, and for an image later its picture, read in a worker thread
+    void                      thumbnail(const QSize &size, QObject *context,
+                                        const std::function<void(const QIcon &)> &callback) const;
     QImage                    preview(const QSize &maxSize) const;
     QString                   displayName() const;
     QString                   fileName() const;
     inline const QString &    mimeType() const { return _mimeType; }
     inline const HashSums &   sums() const { return _sums; }
     inline QVariantMap        metaData() const { return _metaData; }
+    // waveform computed later, see FileSharingManager::amplitudes()
+    inline void               setAmplitudes(const QByteArray &a) { _metaData.insert(QLatin1String("amplitudes"), a); }
     inline qint64             fileSize() const { return _fileSize; }
     inline bool               isSizeKnown() const { return _flags & SizeKnown; }
+    inline bool               isHashing() const { return _flags & Hashing; }
     inline const QStringList &uris() const { return _uris; }
+    inline FileType           fileType() const { return _fileType; }
+    inline FileSharingManager *manager() const { return _manager; }
 
     // reborn flag updates ttl for the item
     FileCacheItem *          cache(bool reborn = false) const;
     inline bool              isCached() const { return cache() != nullptr; }
+    inline bool              isDownloading() const { return _downloader != nullptr; }
     PsiAccount *             account() const;
     inline const QStringList log() const { return _log; }
 
@@ -103,12 +118,16 @@ public:
 
 private:
     bool initFromCache(FileCacheItem *cache = nullptr);
+    void startHashing(const QFileInfo &fi);
+    void checkPublishFinished();
 
 signals:
     void publishFinished();
     void publishProgress(size_t transferredBytes);
     void downloadFinished();
     void logChanged();
+    void hashingProgress(qint64 processed, qint64 total);
+    void hashingFinished();
 
 private:
     PsiAccount *         _acc        = nullptr;
@@ -126,6 +145,9 @@ private:
     QVariantMap          _metaData;
     QStringList          _log;
     QList<XMPP::Jid>     _jids;
+
+    std::shared_ptr<FileHashState> _hashState;
+    QFutureWatcher<HashSums> *     _hashWatcher = nullptr;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(FileSharingItem::Flags)
@@ -23,8 +23,10 @@
 #include "filecache.h"
 #include "filesharingdownloader.h"
 #include "fileutil.h"
+#include "pixmaputil.h"
 #include "psiaccount.h"
 #include "psicon.h"
+#include "psioptions.h"
 #ifndef WEBKIT
 #include "qiteaudio.h"
 #endif
@@ -43,28 +45,233 @@
 #include "messageview.h"
 #include "textutil.h"
 
+#include <QAudioDecoder>
+#include <QBuffer>
+#include <QDataStream>
 #include <QDir>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QImageReader>
 #include <QMimeData>
+#include <QPointer>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+
+#include <memory>
+
+#define KNOWN_HASHES_VERSION 1
+#define KNOWN_HASHES_MAX 1024
+#define PREFETCH_MAX_SIZE (4 * 1024 * 1024)
+#define PREFETCH_PARALLEL 2
+#define PREVIEW_TTL (30 * 24 * 3600)
+
+// by FileSharingManager::PreviewSize
+static const QSize previewSizes[] = { QSize(64, 64), QSize(640, 480), QSize(1920, 1080) };
+static const int   previewCount   = sizeof(previewSizes) / sizeof(previewSizes[0]);
+
+static XMPP::Hash previewId(const XMPP::Hash &source, int size)
+{
+    return XMPP::Hash::from(XMPP::Hash::Sha1, source.data() + "/preview/" + QByteArray::number(size));
+}
+
+// decodes the image once and encodes it in every preview size. runs in a worker thread
+static QList<QByteArray> makePreviews(const QString &fileName)
+{
+    QList<QByteArray> ret;
+    QImageReader      reader(fileName);
+    reader.setAutoTransform(true);
+    // formats like jpeg decode faster right to the size we need. the orientation isn't applied yet here
+    const int largest = qMax(previewSizes[previewCount - 1].width(), previewSizes[previewCount - 1].height());
+    QSize     size    = reader.size();
+    if (size.width() > largest || size.height() > largest)
+        reader.setScaledSize(size.scaled(largest, largest, Qt::KeepAspectRatio));
+    QImage image = reader.read();
+    if (image.isNull())
+        return ret;
+
+    // from the biggest size down, each one scaled from the previous one
+    const bool alpha = image.hasAlphaChannel();
+    for (int i = previewCount - 1; i >= 0; --i) {
+        const QSize &bound = previewSizes[i];
+        if (image.width() > bound.width() || image.height() > bound.height())
+            image = PixmapUtil::scaledImage(image, bound);
+        QByteArray ba;
+        QBuffer    buffer(&ba);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, alpha ? "PNG" : "JPEG", alpha ? -1 : 85);
+        ret.prepend(ba);
+    }
+    return ret;
+}
+
+static const int amplitudesCount   = 100; // bars of a voice message waveform
+static const int amplitudesRate    = 8000;
+static const int amplitudesWindows = 100; // peaks per second before they are merged to bars
+
+static XMPP::Hash amplitudesId(const XMPP::Hash &source)
+{
+    return XMPP::Hash::from(XMPP::Hash::Sha1, source.data() + "/amplitudes");
+}
+
+// decodes the audio to mono pcm and takes the peak of every bar scaled to 0..255.
+// runs in a worker thread, the decoder needs an event loop of its own there
+static QByteArray makeAmplitudes(const QString &fileName)
+{
+    QAudioFormat format;
+    format.setCodec(QLatin1String("audio/pcm"));
+    format.setSampleRate(amplitudesRate);
+    format.setChannelCount(1);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+
+    QVector<int>  peaks;
+    int           peak   = 0;
+    int           window = 0;
+    QEventLoop    loop;
+    QAudioDecoder decoder;
+    decoder.setAudioFormat(format);
+    decoder.setSourceFilename(fileName);
+    QObject::connect(&decoder, &QAudioDecoder::bufferReady, &loop, [&]() {
+        const QAudioBuffer buffer = decoder.read();
+        const QAudioFormat f      = buffer.format();
+        if (f.sampleType() != QAudioFormat::SignedInt || f.sampleSize() != 16)
+            return;
+        const int     windowSize = qMax(1, f.sampleRate() / amplitudesWindows) * f.channelCount();
+        const qint16 *samples    = buffer.constData<qint16>();
+        for (int i = 0; i < buffer.sampleCount(); ++i) {
+            peak = qMax(peak, qAbs(int(samples[i])));
+            if (++window == windowSize) {
+                peaks.append(peak);
+                peak   = 0;
+                window = 0;
+            }
+        }
+    });
+    QObject::connect(&decoder, &QAudioDecoder::finished, &loop, &QEventLoop::quit);
+    QObject::connect(&decoder, SIGNAL(error(QAudioDecoder::Error)), &loop, SLOT(quit()));
+    decoder.start();
+    if (decoder.error() == QAudioDecoder::NoError)
+        loop.exec();
+    if (window)
+        peaks.append(peak);
+    if (decoder.error() != QAudioDecoder::NoError || peaks.isEmpty())
+        return QByteArray();
+
+    QByteArray ret(qMin(amplitudesCount, peaks.size()), 0);
+    int        top = 1;
+    for (int p : peaks)
+        top = qMax(top, p);
+    for (int i = 0; i < ret.size(); ++i) {
+        int bar = 0;
+        for (int j = i * peaks.size() / ret.size(); j < (i + 1) * peaks.size() / ret.size(); ++j)
+            bar = qMax(bar, peaks[j]);
+        ret[i] = char(bar * 255 / top);
+    }
+    return ret;
+}
 
 // ======================================================================
 // FileSharingManager
 // ======================================================================
 class FileSharingManager::Private {
 public:
+    struct KnownHashes {
+        qint64            size;
+        QDateTime         modified;
+        QDateTime         used;
+        QList<XMPP::Hash> sums;
+    };
+
     FileCache *                          cache;
     QHash<XMPP::Hash, FileSharingItem *> items;
+    QHash<QString, KnownHashes>          knownHashes; // by absolute file path
+    QList<QPointer<FileSharingItem>>     prefetchQueue;
+    int                                  prefetching = 0;
+
+    struct PreviewRequest {
+        FileSharingManager::PreviewSize      size;
+        QPointer<QObject>                    context;
+        std::function<void(const QImage &)> callback;
+    };
+    QHash<XMPP::Hash, QList<PreviewRequest>> previewRequests; // by source hash while the previews are made
+
+    struct AmplitudesRequest {
+        QPointer<QObject>                       context;
+        std::function<void(const QByteArray &)> callback;
+    };
+    QHash<XMPP::Hash, QList<AmplitudesRequest>> amplitudesRequests; // by source hash while they are computed
 
     void rememberItem(FileSharingItem *item)
     {
-        Q_ASSERT(item->sums().size());
+        if (item->isHashing()) { // remember when we know how to find it
+            QObject::connect(item, &FileSharingItem::hashingFinished, item, [this, item]() { rememberItem(item); });
+            return;
+        }
         for (auto const &v : item->sums())
             items.insert(v, item); // TODO ensure we don't overwrite
     }
+
+    QString knownHashesFileName() const { return FileSharingManager::cacheDir() + QLatin1String("/filehashes.dat"); }
+
+    void loadKnownHashes()
+    {
+        QFile f(knownHashesFileName());
+        if (!f.open(QIODevice::ReadOnly))
+            return;
+        QDataStream in(&f);
+        in.setVersion(QDataStream::Qt_5_6);
+        quint32 version, count;
+        in >> version >> count;
+        if (version != KNOWN_HASHES_VERSION)
+            return;
+        while (count-- && in.status() == QDataStream::Ok) {
+            QString     path;
+            KnownHashes kh;
+            quint32     sumsCount;
+            in >> path >> kh.size >> kh.modified >> kh.used >> sumsCount;
+            while (sumsCount-- && in.status() == QDataStream::Ok) {
+                qint32     type;
+                QByteArray data;
+                in >> type >> data;
+                kh.sums.append(XMPP::Hash(XMPP::Hash::Type(type), data));
+            }
+            if (in.status() == QDataStream::Ok)
+                knownHashes.insert(path, kh);
+        }
+    }
+
+    void saveKnownHashes()
+    {
+        while (knownHashes.size() > KNOWN_HASHES_MAX) {
+            auto oldest = knownHashes.begin();
+            for (auto it = knownHashes.begin(); it != knownHashes.end(); ++it)
+                if (it.value().used < oldest.value().used)
+                    oldest = it;
+            knownHashes.erase(oldest);
+        }
+
+        QSaveFile f(knownHashesFileName());
+        if (!f.open(QIODevice::WriteOnly))
+            return;
+        QDataStream out(&f);
+        out.setVersion(QDataStream::Qt_5_6);
+        out << quint32(KNOWN_HASHES_VERSION) << quint32(knownHashes.size());
+        for (auto it = knownHashes.constBegin(); it != knownHashes.constEnd(); ++it) {
+            const auto &kh = it.value();
+            out << it.key() << kh.size << kh.modified << kh.used << quint32(kh.sums.size());
+            for (const auto &h : kh.sums)
+                out << qint32(h.type()) << h.data();
+        }
+        if (!f.commit())
+            qWarning("failed to save known file hashes: %s", qPrintable(f.errorString()));
+    }
 };
 
 FileSharingManager::FileSharingManager(QObject *parent) : QObject(parent), d(new Private)
 {
     d->cache = new FileCache(cacheDir(), this);
+    d->loadKnownHashes();
 }
 
 FileSharingManager::~FileSharingManager() {}
@@ -118,6 +325,145 @@ FileCacheItem *FileSharingManager::moveToCache(const QList<XMPP::Hash> &sums, co
     return d->cache->moveToCache(sums, file, metadata, maxAge);
 }
 
+QList<Hash> FileSharingManager::knownFileHashes(const QFileInfo &fi) const
+{
+    auto it = d->knownHashes.find(fi.absoluteFilePath());
+    if (it == d->knownHashes.end() || it.value().size != fi.size() || it.value().modified != fi.lastModified())
+        return QList<Hash>();
+    it.value().used = QDateTime::currentDateTimeUtc();
+    return it.value().sums;
+}
+
+void FileSharingManager::rememberFileHashes(const QFileInfo &fi, const QList<Hash> &sums)
+{
+    Private::KnownHashes kh;
+    kh.size     = fi.size();
+    kh.modified = fi.lastModified();
+    kh.used     = QDateTime::currentDateTimeUtc();
+    kh.sums     = sums;
+    d->knownHashes.insert(fi.absoluteFilePath(), kh);
+    d->saveKnownHashes();
+}
+
+void FileSharingManager::preview(FileSharingItem *item, PreviewSize size, QObject *context,
+                                 const std::function<void(const QImage &)> &callback)
+{
+    const Hash source = item->sums().value(0);
+    if (!source.isValid() || !item->mimeType().startsWith(QLatin1String("image/"))) {
+        callback(QImage());
+        return;
+    }
+
+    auto cached = d->cache->get(previewId(source, int(size)), true);
+    if (cached) {
+        callback(QImage::fromData(cached->data()));
+        return;
+    }
+
+    QString fileName;
+    if (!cacheItem(item->sums(), false, &fileName)) {
+        if (item->fileType() == FileSharingItem::FileType::RemoteFile) {
+            callback(QImage()); // download it first
+            return;
+        }
+        fileName = item->fileName();
+    }
+
+    auto &requests = d->previewRequests[source];
+    requests.append({ size, context, callback });
+    if (requests.size() > 1)
+        return; // being made already
+
+    auto watcher = new QFutureWatcher<QList<QByteArray>>(this);
+    connect(watcher, &QFutureWatcher<QList<QByteArray>>::finished, this, [this, watcher, source]() {
+        const QList<QByteArray> previews = watcher->result();
+        watcher->deleteLater();
+        for (int i = 0; i < previews.size(); ++i) {
+            QVariantMap meta;
+            meta.insert(QLatin1String("type"), previews[i].startsWith("\x89PNG") ? QLatin1String("image/png")
+                                                                               : QLatin1String("image/jpeg"));
+            d->cache->append(QList<Hash>() << previewId(source, i), previews[i], meta, PREVIEW_TTL);
+        }
+        for (auto const &r : d->previewRequests.take(source)) {
+            if (r.context)
+                r.callback(QImage::fromData(previews.value(int(r.size))));
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(makePreviews, fileName));
+}
+
+void FileSharingManager::amplitudes(FileSharingItem *item, QObject *context,
+                                    const std::function<void(const QByteArray &)> &callback)
+{
+    if (!item->mimeType().startsWith(QLatin1String("audio/"))) {
+        callback(QByteArray());
+        return;
+    }
+    QByteArray known = item->metaData().value(QLatin1String("amplitudes")).toByteArray();
+    if (known.size()) {
+        callback(known);
+        return;
+    }
+
+    // no hash or no data yet, back here once there is
+    if (item->isHashing() || item->isDownloading()) {
+        auto conn  = std::make_shared<QMetaObject::Connection>();
+        auto retry = [this, item, context, callback, conn]() {
+            QObject::disconnect(*conn);
+            amplitudes(item, context, callback);
+        };
+        *conn = item->isHashing() ? connect(item, &FileSharingItem::hashingFinished, context, retry)
+                                  : connect(item, &FileSharingItem::downloadFinished, context, retry);
+        return;
+    }
+
+    const Hash source = item->sums().value(0);
+    if (!source.isValid()) {
+        callback(QByteArray());
+        return;
+    }
+
+    auto cached = d->cache->get(amplitudesId(source), true);
+    if (cached) {
+        item->setAmplitudes(cached->data());
+        callback(cached->data());
+        return;
+    }
+
+    QString fileName;
+    if (!cacheItem(item->sums(), false, &fileName)) {
+        if (item->fileType() == FileSharingItem::FileType::RemoteFile) {
+            callback(QByteArray()); // download it first
+            return;
+        }
+        fileName = item->fileName();
+    }
+
+    auto &requests = d->amplitudesRequests[source];
+    requests.append({ context, callback });
+    if (requests.size() > 1)
+        return; // being computed already
+
+    QPointer<FileSharingItem> itemPtr(item);
+    auto                      watcher = new QFutureWatcher<QByteArray>(this);
+    connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher, source, itemPtr]() {
+        const QByteArray ampl = watcher->result();
+        watcher->deleteLater();
+        if (ampl.size()) {
+            QVariantMap meta;
+            meta.insert(QLatin1String("type"), QLatin1String("application/x-psi-amplitudes"));
+            d->cache->append(QList<Hash>() << amplitudesId(source), ampl, meta, PREVIEW_TTL);
+            if (itemPtr)
+                itemPtr->setAmplitudes(ampl);
+        }
+        for (auto const &r : d->amplitudesRequests.take(source)) {
+            if (r.context)
+                r.callback(ampl);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(makeAmplitudes, fileName));
+}
+
 FileSharingItem *FileSharingManager::item(const Hash &id) { return d->items.value(id); }
 
 QList<FileSharingItem *> FileSharingManager::fromMimeData(const QMimeData *data, PsiAccount *acc)
@@ -162,6 +508,7 @@ QList<FileSharingItem *> FileSharingManager::fromMimeData(const QMimeData *data,
         for (auto const &f : files) {
             auto item = new FileSharingItem(f, acc, this);
             d->rememberItem(item);
+            amplitudes(item, item, [](const QByteArray &) {}); // sent along when ready by then
             ret.append(item);
         }
     }
@@ -179,6 +526,7 @@ QList<FileSharingItem *> FileSharingManager::fromFilesList(const QStringList &fi
         if (fi.isFile() && fi.isReadable()) {
             auto item = new FileSharingItem(file, acc, this);
             d->rememberItem(item);
+            amplitudes(item, item, [](const QByteArray &) {});
             ret << item;
         }
     }
@@ -206,6 +554,7 @@ void FileSharingManager::fillMessageView(MessageView &mv, const Message &m, PsiA
             auto item = new FileSharingItem(ms, m.from(), acc, this);
             d->rememberItem(item);
             mv.addReference(item);
+            prefetch(item);
 
             QString shareStr(QString::fromLatin1("<share id=\"%1\"/>").arg(item->sums()[0].toString()));
             if (r.begin() != -1 && r.begin() >= lastEnd
@@ -226,6 +575,39 @@ void FileSharingManager::fillMessageView(MessageView &mv, const Message &m, PsiA
     }
 }
 
+// Shares of incoming messages are downloaded to the cache in background,
+// so the chat view finds them there instead of waiting for the network.
+void FileSharingManager::prefetch(FileSharingItem *item)
+{
+    if (item->isCached() || !item->isSizeKnown() || item->fileSize() > PREFETCH_MAX_SIZE
+        || !PsiOptions::instance()->getOption("options.ui.chat.show-previews").toBool())
+        return;
+    d->prefetchQueue.append(item);
+    startPrefetches();
+}
+
+void FileSharingManager::startPrefetches()
+{
+    while (d->prefetching < PREFETCH_PARALLEL && !d->prefetchQueue.isEmpty()) {
+        FileSharingItem *item = d->prefetchQueue.takeFirst();
+        if (!item || item->isCached() || item->isDownloading())
+            continue;
+
+        auto downloader = item->download();
+        ++d->prefetching;
+        // the data is saved to the file as it's read. the item moves the file to the cache when finished
+        connect(downloader, &QIODevice::readyRead, downloader, [downloader]() {
+            char buf[16384];
+            while (downloader->read(buf, sizeof(buf)) > 0) { }
+        });
+        connect(downloader, &QObject::destroyed, this, [this]() {
+            --d->prefetching;
+            startPrefetches();
+        });
+        downloader->open();
+    }
+}
+
 bool FileSharingManager::jingleAutoAcceptIncomingDownloadRequest(Jingle::Session *session)
 {
     QList<QPair<Jingle::FileTransfer::Application *, FileCacheItem *>> toAccept;
@@ -24,6 +24,7 @@
 #include "qite.h"
 
 #include <QObject>
+#include <functional>
 
 class FileCache;
 class FileCacheItem;
@@ -76,6 +77,29 @@ public:
     FileCacheItem *moveToCache(const QList<XMPP::Hash> &sums, const QFileInfo &data, const QVariantMap &metadata,
                                unsigned int maxAge);
 
+    // hash sums of a local file, valid while its size and modification time stay the same
+    QList<XMPP::Hash> knownFileHashes(const QFileInfo &fi) const;
+    void              rememberFileHashes(const QFileInfo &fi, const QList<XMPP::Hash> &sums);
+
+    // preset sizes of image previews
+    enum class PreviewSize { Thumbnail, Inline, Screen };
+
+    // A scaled down image share, upright as its EXIF orientation says. All
+    // the sizes are made at once in a worker thread and kept in the cache,
+    // so a cached preview is passed to the callback right away. The image is
+    // null if the item is not an image or its data is not here yet. Nothing
+    // is called once context is gone.
+    void preview(FileSharingItem *item, PreviewSize size, QObject *context,
+                 const std::function<void(const QImage &)> &callback);
+
+    // The waveform of an audio share, bars of 0..255. One that came with the
+    // share is passed right away, otherwise it's computed from the decoded
+    // file in a worker thread once the file is hashed and here, kept in the
+    // cache next to the file and set to the item. Empty if the item is not
+    // audio, can't be decoded or is a remote file nobody downloads. Nothing
+    // is called once context is gone.
+    void amplitudes(FileSharingItem *item, QObject *context, const std::function<void(const QByteArray &)> &callback);
+
     FileSharingItem *item(const XMPP::Hash &id);
     // FileSharingItem* fromReference(const XMPP::Reference &ref, PsiAccount *acc);
     QList<FileSharingItem *> fromMimeData(const QMimeData *data, PsiAccount *acc);
@@ -96,6 +120,9 @@ signals:
 public slots:
 
 private:
+    void prefetch(FileSharingItem *item);
+    void startPrefetches();
+
     class Private;
     QScopedPointer<Private> d;
 };
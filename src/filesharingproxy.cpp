@@ -28,10 +28,13 @@
 #include "qhttpserverresponse.hpp"
 #include "webserver.h"
 
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
 #include <QTcpSocket>
 #include <tuple>
 
-#define HTTP_CHUNK (512 * 1024 * 1024)
+#define HTTP_CHUNK (512 * 1024)
 
 FileSharingProxy::FileSharingProxy(PsiAccount *acc, const QString &sourceIdHex, qhttp::server::QHttpRequest *req,
                                    qhttp::server::QHttpResponse *res) :
@@ -49,6 +52,11 @@ FileSharingProxy::FileSharingProxy(PsiAccount *acc, const QString &sourceIdHex,
         return;
     }
 
+    // shared files are addressed by their hash, so the hash is a perfect strong validator
+    auto sum = item->sums().value(0);
+    if (sum.isValid())
+        etag = '"' + sum.data().toHex() + '"';
+
     auto status = qhttp::TStatusCode(parseHttpRangeRequest());
     if (status != qhttp::ESTATUS_OK) {
         res->setStatusCode(status);
@@ -57,6 +65,10 @@ FileSharingProxy::FileSharingProxy(PsiAccount *acc, const QString &sourceIdHex,
         return; // handled with error
     }
 
+    auto ifRange = req->headers().value("if-range");
+    if (isRanged && ifRange.size() && ifRange != etag)
+        isRanged = false; // the client has another version. send everything
+
     if (isRanged && item->isSizeKnown()) {
         if (requestedStart == 0 && requestedSize == item->fileSize())
             isRanged = false;
@@ -70,6 +82,24 @@ FileSharingProxy::FileSharingProxy(PsiAccount *acc, const QString &sourceIdHex,
         return; // handled with success
     }
 
+    if (item->isDownloading()) { // already on its way to the cache (e.g. prefetched). don't download it twice
+        connect(item, &FileSharingItem::downloadFinished, this, [this]() {
+            auto cache = item->cache();
+            if (cache) {
+                proxyCache(cache);
+            } else {
+                response->setStatusCode(qhttp::ESTATUS_BAD_GATEWAY);
+                response->end();
+            }
+        });
+        return;
+    }
+
+    if (isNotModified(QDateTime())) {
+        sendNotModified();
+        return;
+    }
+
     downloader = item->download(isRanged, requestedStart, requestedSize);
     Q_ASSERT(downloader);
 
@@ -147,6 +177,37 @@ int FileSharingProxy::parseHttpRangeRequest()
     return qhttp::ESTATUS_OK;
 }
 
+bool FileSharingProxy::isNotModified(const QDateTime &lastModified) const
+{
+    auto inm = request->headers().value("if-none-match");
+    if (inm.size()) { // takes precedence over If-Modified-Since
+        if (etag.isEmpty())
+            return false;
+        for (auto tag : inm.split(',')) {
+            tag = tag.trimmed();
+            if (tag.startsWith("W/"))
+                tag = tag.mid(2);
+            if (tag == "*" || tag == etag)
+                return true;
+        }
+        return false;
+    }
+
+    auto ims = request->headers().value("if-modified-since");
+    if (!ims.size() || !lastModified.isValid())
+        return false;
+    auto since = QDateTime::fromString(QString::fromLatin1(ims), Qt::RFC2822Date);
+    return since.isValid() && lastModified.toMSecsSinceEpoch() / 1000 <= since.toMSecsSinceEpoch() / 1000;
+}
+
+void FileSharingProxy::sendNotModified()
+{
+    response->setStatusCode(qhttp::ESTATUS_NOT_MODIFIED);
+    if (etag.size())
+        response->addHeader("ETag", etag);
+    response->end();
+}
+
 void FileSharingProxy::setupHeaders(qint64 fileSize, QString contentType, QDateTime lastModified, bool isRanged,
                                     qint64 rangeStart, qint64 rangeSize)
 {
@@ -155,6 +216,11 @@ void FileSharingProxy::setupHeaders(qint64 fileSize, QString contentType, QDateT
     if (contentType.count())
         response->addHeader("Content-Type", contentType.toLatin1());
 
+    if (etag.size()) {
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache"); // revalidate and get 304 instead of the whole file
+    }
+
     bool keepAlive = true;
     response->addHeader("Accept-Ranges", "bytes");
     if (isRanged) {
@@ -181,38 +247,55 @@ void FileSharingProxy::proxyCache(FileCacheItem *cache)
 {
     QFile *   file = new QFile(acc->psi()->fileSharingManager()->cacheDir() + "/" + cache->fileName(), response);
     QFileInfo fi(*file);
-    auto      status = qhttp::TStatusCode(parseHttpRangeRequest());
-    if (status != qhttp::ESTATUS_OK) {
-        response->setStatusCode(status);
-        qWarning("http range parse failed: %d", status);
-        request->end();
-        return; // handled with error
+    if (isNotModified(fi.lastModified())) {
+        sendNotModified();
+        return;
     }
-    file->open(QIODevice::ReadOnly);
-    qint64 size = fi.size();
+    if (!file->open(QIODevice::ReadOnly)) {
+        qWarning("failed to open cached file %s: %s", qPrintable(file->fileName()), qPrintable(file->errorString()));
+        response->setStatusCode(qhttp::ESTATUS_INTERNAL_SERVER_ERROR);
+        response->end();
+        return;
+    }
+
+    qint64 start = 0;
+    qint64 size  = fi.size();
     if (isRanged) {
-        if (requestedSize)
-            size = (requestedStart + requestedSize) > fi.size() ? fi.size() - requestedStart : requestedSize;
+        start = requestedStart;
+        if (requestedSize && start + requestedSize <= fi.size())
+            size = requestedSize;
         else // remaining part
-            size = fi.size() - requestedStart;
-        file->seek(requestedStart);
+            size = fi.size() - start;
     }
-    // TODO If-Modified-Since
-    setupHeaders(fi.size(), item->mimeType(), fi.lastModified(), isRanged, requestedStart, size);
-    connect(response, &qhttp::server::QHttpResponse::allBytesWritten, file, [this, file, size]() {
-        qint64 toWrite = requestedStart + size - file->pos();
-        if (!toWrite) {
+    setupHeaders(fi.size(), item->mimeType(), fi.lastModified(), isRanged, start, size);
+    if (request->method() == qhttp::EHTTP_HEAD || size <= 0) {
+        response->end();
+        return;
+    }
+
+    // pages are mapped lazily, so only what the client really reads is loaded from the disk.
+    // if mapping is not possible we read chunk by chunk
+    const uchar *data = file->map(start, size);
+    if (!data)
+        file->seek(start);
+
+    // send the next chunk only when the previous one has left the socket
+    bytesLeft       = size;
+    auto writeChunk = [this, file, data, size]() {
+        if (bytesLeft <= 0)
             return;
-        }
-        if (toWrite > HTTP_CHUNK)
-            response->write(file->read(HTTP_CHUNK));
+        qint64     chunk = qMin(bytesLeft, qint64(HTTP_CHUNK));
+        QByteArray ba    = data
+            ? QByteArray::fromRawData(reinterpret_cast<const char *>(data + size - bytesLeft), int(chunk))
+            : file->read(chunk);
+        bytesLeft = ba.size() ? bytesLeft - ba.size() : 0;
+        if (bytesLeft)
+            response->write(ba);
         else
-            response->end(file->read(toWrite));
-    });
-
-    if (size < HTTP_CHUNK) {
-        response->end(file->read(size));
-    }
+            response->end(ba);
+    };
+    connect(response, &qhttp::server::QHttpResponse::allBytesWritten, file, writeChunk);
+    writeChunk();
 }
 
 void FileSharingProxy::onMetadataChanged()
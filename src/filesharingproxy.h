@@ -20,6 +20,7 @@
 #ifndef FILESHARINGPROXY_H
 #define FILESHARINGPROXY_H
 
+#include <QByteArray>
 #include <QObject>
 #include <QPointer>
 
@@ -49,6 +50,8 @@ private slots:
 
 private:
     int  parseHttpRangeRequest();
+    bool isNotModified(const QDateTime &lastModified) const;
+    void sendNotModified();
     void setupHeaders(qint64 fileSize, QString contentType, QDateTime lastModified, bool isRanged, qint64 rangeStart,
                       qint64 rangeSize);
     void proxyCache(FileCacheItem *item);
@@ -58,6 +61,7 @@ private:
     PsiAccount *                  acc;
     qhttp::server::QHttpRequest * request;
     qhttp::server::QHttpResponse *response;
+    QByteArray                    etag;
     QPointer<FileShareDownloader> downloader;
     qint64                        requestedStart = 0;
     qint64                        requestedSize  = 0;  // if == 0 then all the remaining
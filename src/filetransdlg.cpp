@@ -22,11 +22,13 @@
 #include <QDesktopServices>
 #include <QFileDialog>
 #include <QFileIconProvider>
+#include <QFutureWatcher>
 #include <QKeyEvent>
 #include <QMenu>
 #include <QMessageBox>
 #include <QPainter>
 #include <QTimer>
+#include <QtConcurrentRun>
 
 typedef quint64 LARGE_TYPE;
 
@@ -92,6 +94,42 @@ static bool active_file_check(const QString &s)
     return activeFiles->contains(s);
 }
 
+// file I/O of transfers is done on a worker thread, one block at a time
+struct FileIoResult
+{
+    QByteArray data;
+    QString error;
+};
+
+static FileIoResult readFileBlock(QFile *f, QByteArray buf, int size)
+{
+    FileIoResult r;
+    buf.resize(size);
+    qint64 n = f->read(buf.data(), size);
+    if(n < 0) {
+        r.error = f->errorString();
+        n = 0;
+    }
+    buf.resize(int(n));
+    r.data = buf;
+    return r;
+}
+
+static FileIoResult writeFileBlock(QFile *f, QByteArray buf)
+{
+    FileIoResult r;
+    if(f->write(buf) != buf.size())
+        r.error = f->errorString();
+    r.data = buf;
+    return r;
+}
+
+static int ioBlockSize()
+{
+    int size = PsiOptions::instance()->getOption("options.p2p.bytestreams.io-block-size").toInt();
+    return qBound(16 * 1024, size, 64 * 1024 * 1024);
+}
+
 //----------------------------------------------------------------------------
 // FileTransferHandler
 //----------------------------------------------------------------------------
@@ -111,6 +149,17 @@ public:
     int shift;
     int complement;
     QString activeFile;
+
+    // double buffered I/O. blocks are swapped between the GUI and the worker thread
+    int blockSize;
+    QFutureWatcher<FileIoResult> *io;
+    bool ioQueued; // a result is expected from io
+    bool sendWaiting;
+    qlonglong readOffset; // where the next read-ahead starts
+    QByteArray buf; // sending: read ahead data. receiving: data waiting to be written
+    int bufPos;
+    QByteArray spare;
+    qlonglong received;
 };
 
 FileTransferHandler::FileTransferHandler(PsiAccount *pa, FileTransfer *ft)
@@ -118,6 +167,14 @@ FileTransferHandler::FileTransferHandler(PsiAccount *pa, FileTransfer *ft)
     d = new Private;
     d->pa = pa;
     d->c = nullptr;
+    d->blockSize = ioBlockSize();
+    d->io = new QFutureWatcher<FileIoResult>(this);
+    d->ioQueued = false;
+    d->sendWaiting = false;
+    d->readOffset = 0;
+    d->bufPos = 0;
+    d->received = 0;
+    connect(d->io, SIGNAL(finished()), SLOT(io_finished()));
 
     if(ft) {
         d->sending = false;
@@ -141,6 +198,9 @@ FileTransferHandler::FileTransferHandler(PsiAccount *pa, FileTransfer *ft)
 
 FileTransferHandler::~FileTransferHandler()
 {
+    finishIo();
+    if(!d->sending && d->f.isOpen() && !d->buf.isEmpty())
+        d->f.write(d->buf); // don't lose the received data
     if(!d->activeFile.isEmpty())
         active_file_remove(d->activeFile);
 
@@ -355,6 +415,8 @@ void FileTransferHandler::ft_connected()
             return;
         }
 
+        d->readOffset = d->offset;
+        startReadAhead();
         if(d->sent == d->fileSize)
             QTimer::singleShot(0, this, SLOT(doFinish()));
         else
@@ -384,6 +446,8 @@ void FileTransferHandler::ft_connected()
 
         d->activeFile = d->f.fileName();
         active_file_add(d->activeFile);
+        d->received = d->sent;
+        d->buf.reserve(d->blockSize);
 
         // done already?  this means a file size of zero
         if(d->sent == d->fileSize)
@@ -397,16 +461,10 @@ void FileTransferHandler::ft_readyRead(const QByteArray &a)
 {
     if(!d->sending) {
         //printf("%d bytes read\n", a.size());
-        int r = int(d->f.write(a.data(), a.size()));
-        if(r < 0) {
-            d->f.close();
-            delete d->ft;
-            d->ft = nullptr;
-            error(ErrFile, 0, d->f.errorString());
-            return;
-        }
-        d->sent += a.size();
-        doFinish();
+        d->buf += a;
+        d->received += a.size();
+        if(d->buf.size() >= d->blockSize || d->received == d->fileSize)
+            startWriteBehind();
     }
 }
 
@@ -416,6 +474,7 @@ void FileTransferHandler::ft_bytesWritten(qint64 x)
         //printf("%d bytes written\n", x);
         d->sent += x;
         if(d->sent == d->fileSize) {
+            finishIo();
             d->f.close();
             delete d->ft;
             d->ft = nullptr;
@@ -428,6 +487,7 @@ void FileTransferHandler::ft_bytesWritten(qint64 x)
 
 void FileTransferHandler::ft_error(int x)
 {
+    finishIo();
     if(d->f.isOpen())
         d->f.close();
     delete d->ft;
@@ -464,26 +524,100 @@ void FileTransferHandler::trySend()
     if(!d->ft->bsConnection())
         return;
 
-    int blockSize = d->ft->dataSizeNeeded();
-    QByteArray a(blockSize, 0);
-    int r = 0;
-    if(blockSize > 0)
-        r = int(d->f.read(a.data(), a.size()));
-    if(r < 0) {
+    if(d->bufPos >= d->buf.size()) {
+        if(!d->ioQueued || d->io->isRunning()) {
+            d->sendWaiting = d->ioQueued;
+            return;
+        }
+        FileIoResult r = d->io->result();
+        d->ioQueued = false;
+        if(!r.error.isEmpty()) {
+            d->f.close();
+            delete d->ft;
+            d->ft = nullptr;
+            error(ErrFile, 0, r.error);
+            return;
+        }
+        d->spare = d->buf;
+        d->buf = r.data;
+        d->bufPos = 0;
+        startReadAhead();
+    }
+
+    int blockSize = qMin(d->ft->dataSizeNeeded(), d->buf.size() - d->bufPos);
+    QByteArray a = d->buf.mid(d->bufPos, blockSize);
+    d->bufPos += a.size();
+    d->ft->writeFileData(a);
+}
+
+void FileTransferHandler::startReadAhead()
+{
+    if(d->ioQueued || d->readOffset >= d->fileSize)
+        return;
+
+    int size = int(qMin(qlonglong(d->blockSize), d->fileSize - d->readOffset));
+    d->readOffset += size;
+    d->ioQueued = true;
+    d->io->setFuture(QtConcurrent::run(readFileBlock, &d->f, d->spare, size));
+    d->spare = QByteArray();
+}
+
+void FileTransferHandler::startWriteBehind()
+{
+    if(d->ioQueued || d->buf.isEmpty())
+        return;
+
+    d->ioQueued = true;
+    d->io->setFuture(QtConcurrent::run(writeFileBlock, &d->f, d->buf));
+    d->buf = d->spare;
+    d->buf.reserve(d->blockSize);
+    d->spare = QByteArray();
+}
+
+void FileTransferHandler::io_finished()
+{
+    if(d->sending) {
+        if(d->sendWaiting) {
+            d->sendWaiting = false;
+            trySend();
+        }
+        return;
+    }
+
+    FileIoResult r = d->io->result();
+    d->ioQueued = false;
+    if(!r.error.isEmpty()) {
         d->f.close();
         delete d->ft;
         d->ft = nullptr;
-        error(ErrFile, 0, d->f.errorString());
+        error(ErrFile, 0, r.error);
         return;
     }
-    if(r < int(a.size()))
-        a.resize(r);
-    d->ft->writeFileData(a);
+    d->sent += r.data.size();
+    d->spare = r.data;
+    d->spare.resize(0);
+
+    if(d->buf.size() >= d->blockSize || d->received == d->fileSize)
+        startWriteBehind();
+    doFinish();
+}
+
+// waits for the worker, so the file may be touched again
+void FileTransferHandler::finishIo()
+{
+    if(!d->ioQueued)
+        return;
+    d->io->waitForFinished();
+    d->ioQueued = false;
+    FileIoResult r = d->io->result();
+    if(!d->sending && r.error.isEmpty())
+        d->sent += r.data.size();
 }
 
 void FileTransferHandler::doFinish()
 {
     if(d->sent == d->fileSize) {
+        finishIo();
         d->f.close();
         delete d->ft;
         d->ft = nullptr;
@@ -69,12 +69,16 @@ private slots:
     void ft_error(int);
     void trySend();
     void doFinish();
+    void io_finished();
 
 private:
     class Private;
     Private *d;
 
     void mapSignals();
+    void startReadAhead();
+    void startWriteBehind();
+    void finishIo();
 };
 
 class FileRequestDlg : public QDialog, public Ui::FileTrans
@@ -33,10 +33,16 @@
 #include "xmpp_muc.h"
 
 #include <QItemDelegate>
+#include <QLocale>
 #include <QMenu>
 #include <QMimeData>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QSet>
+
+#include <algorithm>
+
+static const int maxRecentSpeakers = 32;
 
 //static bool caseInsensitiveLessThan(const QString &s1, const QString &s2)
 //{
@@ -288,7 +294,7 @@ GCUserModel::GCUserModel(PsiAccount *account, const Jid selfJid, QObject *parent
     _selfJid(selfJid),
     _selfContact(nullptr)
 {
-
+    _statusSort = PsiOptions::instance()->getOption("options.ui.muc.userlist.contact-sort-style").toString() == QLatin1String("status");
 }
 
 QModelIndex GCUserModel::index(int row, int column, const QModelIndex &parent) const
@@ -320,7 +326,7 @@ QVariant GCUserModel::data(const QModelIndex &index, int role) const
         if (index.row() >= cs.size()) {
             return QVariant();
         }
-        const MUCContact &contact = *(cs.at(index.row()));
+        MUCContact &contact = *(cs.at(index.row()));
 
         switch (role) {
         case Qt::DisplayRole:
@@ -330,6 +336,11 @@ QVariant GCUserModel::data(const QModelIndex &index, int role) const
         case StatusRole:
             return QVariant::fromValue<Status>(contact.status);
         case AvatarRole:
+            // loaded on first paint so joining big rooms doesn't touch every avatar
+            if (!contact.avatarLoaded) {
+                contact.avatar = _account->avatarFactory()->getMucAvatar(_selfJid.withResource(contact.name));
+                contact.avatarLoaded = true;
+            }
             return contact.avatar;
         case ClientIconRole:
         {
@@ -389,7 +400,7 @@ void GCUserModel::updateAvatar(const QString &nick)
 {
     QModelIndex index = findIndex(nick);
     if (index.isValid()) {
-        contacts[index.parent().row()][index.row()]->avatar = _account->avatarFactory()->getMucAvatar(_selfJid.withResource(nick));
+        contacts[index.parent().row()][index.row()]->avatarLoaded = false;
         emit dataChanged(index, index);
     }
 }
@@ -473,6 +484,9 @@ void GCUserModel::removeEntry(const QString &nick)
     if (index.isValid()) {
         beginRemoveRows(index.parent(), index.row(), index.row());
         contacts[index.parent().row()].removeAt(index.row());
+        contactsByNick.remove(nick);
+        unindexNick(nick);
+        recentSpeakers.removeOne(nick);
         endRemoveRows();
     }
     // TODO don't remove groups. just set display text to "" in data() (ex GCUserViewGroupItem::updateText)
@@ -494,6 +508,16 @@ GCUserModel::Role GCUserModel::groupRole(const Status &s)
     return newGroupRole;
 }
 
+int GCUserModel::compare(const QString &sortKey, const Status &s, const MUCContact &contact) const
+{
+    if (_statusSort) {
+        int rank = rankStatus(s.type()) - rankStatus(contact.status.type());
+        if (rank != 0)
+            return rank;
+    }
+    return QString::localeAwareCompare(sortKey, contact.sortKey);
+}
+
 void GCUserModel::updateEntry(const QString &nick, const Status &s)
 {
     if (nick.isEmpty()) { // MUC self-presence? It should not come here
@@ -506,26 +530,16 @@ void GCUserModel::updateEntry(const QString &nick, const Status &s)
     if (!contactIndex.isValid() || newGroupRole != contactIndex.parent().row()) {
         // either new contact or move between groups. we need to find destination position
 
-        bool doStatusSort = PsiOptions::instance()->getOption("options.ui.muc.userlist.contact-sort-style").toString() == QLatin1String("status");
         int insertRowNum = 0;
+        QString sortKey = contactIndex.isValid() ? contacts[contactIndex.parent().row()][contactIndex.row()]->sortKey
+                                                 : QLocale().toLower(nick);
         if (contacts[newGroupRole].size()) {
             // TODO use sorting filter model instad of code below.
-            QString lowerNick = QLocale().toLower(nick);
             int left = 0, right = contacts[newGroupRole].size();
             while (right - left > 0) { // std::lower_bound doesn't work here since we need index and not iterator
                 int mid = (right + left) >> 1;
 
-                int rank;
-                const MUCContact &contact = *(contacts[newGroupRole][mid]);
-                if (doStatusSort) {
-                    rank = rankStatus(s.type()) - rankStatus(contact.status.type());
-                    if (rank == 0)
-                        rank = QString::localeAwareCompare(lowerNick, QLocale().toLower(contact.name));
-                } else {
-                    rank = QString::localeAwareCompare(lowerNick, QLocale().toLower(contact.name));
-                }
-
-                if (rank <= 0) {
+                if (compare(sortKey, s, *(contacts[newGroupRole][mid])) <= 0) {
                     right = mid;
                 } else {
                     left = mid + 1;
@@ -548,9 +562,11 @@ void GCUserModel::updateEntry(const QString &nick, const Status &s)
             emit beginInsertRows(newParentIndex, insertRowNum, insertRowNum);
             auto contact = MUCContact::Ptr(new MUCContact);
             contact->name = nick;
+            contact->sortKey = sortKey;
             contact->status = s;
-            contact->avatar = _account->avatarFactory()->getMucAvatar(_selfJid.withResource(nick));
             contacts[newGroupRole].insert(insertRowNum, contact);
+            contactsByNick.insert(nick, contact);
+            indexNick(nick);
             if (nick == _selfJid.resource()) {
                 _selfContact = contact;
             }
@@ -560,11 +576,59 @@ void GCUserModel::updateEntry(const QString &nick, const Status &s)
         // just changed status. delegate will decide how to redraw properly
         auto contact = contacts[contactIndex.parent().row()].at(contactIndex.row());
         contact->status = s;
-        contact->avatar = _account->avatarFactory()->getMucAvatar(_selfJid.withResource(nick));
+        contact->avatarLoaded = false;
         emit dataChanged(contactIndex, contactIndex);
     }
 }
 
+/**
+ * Applies a burst of presences (e.g. the occupant list sent on join) with
+ * a single model reset instead of a row insert per occupant.
+ */
+void GCUserModel::updateEntries(const QList<Entry> &entries)
+{
+    if (entries.isEmpty()) {
+        return;
+    }
+
+    beginResetModel();
+    QLocale locale;
+    bool added = false;
+    for (const Entry &e : entries) {
+        if (e.first.isEmpty()) {
+            continue;
+        }
+        auto contact = contactsByNick.value(e.first);
+        if (contact) {
+            contacts[groupRole(contact->status)].removeOne(contact);
+        } else {
+            contact = MUCContact::Ptr(new MUCContact);
+            contact->name = e.first;
+            contact->sortKey = locale.toLower(e.first);
+            contactsByNick.insert(e.first, contact);
+            nickIndex.append(NickKey(e.first.toCaseFolded(), e.first));
+            added = true;
+            if (e.first == _selfJid.resource()) {
+                _selfContact = contact;
+            }
+        }
+        contact->status = e.second;
+        contact->avatarLoaded = false;
+        contacts[groupRole(e.second)].append(contact);
+    }
+
+    for (int gr = 0; gr < LastGroupRole; gr++) {
+        std::stable_sort(contacts[gr].begin(), contacts[gr].end(),
+                         [this](const MUCContact::Ptr &a, const MUCContact::Ptr &b) {
+                             return compare(a->sortKey, a->status, *b) < 0;
+                         });
+    }
+    if (added) {
+        std::sort(nickIndex.begin(), nickIndex.end());
+    }
+    endResetModel();
+}
+
 void GCUserModel::clear()
 {
     for (int i = LastGroupRole - 1; i >= 0; i--) {
@@ -574,10 +638,14 @@ void GCUserModel::clear()
             endRemoveRows();
         }
     }
+    contactsByNick.clear();
+    nickIndex.clear();
+    recentSpeakers.clear();
 }
 
 void GCUserModel::updateAll()
 {
+    _statusSort = PsiOptions::instance()->getOption("options.ui.muc.userlist.contact-sort-style").toString() == QLatin1String("status");
     layoutAboutToBeChanged();
     // TODO sort contacts here? convert all icons to pixmaps for caching purposes?
     layoutChanged();
@@ -598,16 +666,12 @@ bool GCUserModel::hasJid(const Jid& jid)
 
 QModelIndex GCUserModel::findIndex(const QString &nick) const
 {
-    for (int gr = 0; gr < LastGroupRole; gr++) {
-        const QList<MUCContact::Ptr> &cs = contacts[gr];
-        // it's possible to use binary search here since contacts are sorted by default.
-        // but sorting algo is going to change to QString::localeAwareCompare and for binary search it's
-        // quite heavy operation until we have really many contacts (maybe 200+).
-        // so let's try plain search.
-        for (int ci = 0; ci < cs.size(); ci++) {
-            if (cs[ci]->name == nick) {
-                return index(ci, 0, index(gr, 0));
-            }
+    auto contact = contactsByNick.value(nick);
+    if (contact) {
+        Role gr = groupRole(contact->status);
+        int ci = contacts[gr].indexOf(contact); // pointer compare, cheap even for huge rooms
+        if (ci != -1) {
+            return index(ci, 0, index(gr, 0));
         }
     }
 
@@ -622,15 +686,67 @@ GCUserModel::MUCContact *GCUserModel::findEntry(const QString &nick) const
 QStringList GCUserModel::nickList() const
 {
     QStringList nicks;
-    for(int gr = 0; gr < LastGroupRole; gr++) {
-        for (auto const &c : contacts[gr]) {
-            nicks << c->name;
+    nicks.reserve(nickIndex.size());
+    for (auto const &k : nickIndex) {
+        nicks << k.second;
+    }
+    return nicks;
+}
+
+/**
+ * Prefix lookup on the sorted index, so tab completion in huge rooms
+ * touches only the matching nicks.
+ */
+QStringList GCUserModel::nickCompletions(const QString &prefix) const
+{
+    const QString folded = prefix.toCaseFolded();
+    QSet<QString> recent;
+    QStringList nicks;
+    for (auto const &nick : recentSpeakers) {
+        if (nick.toCaseFolded().startsWith(folded)) {
+            recent.insert(nick);
+            nicks << nick;
+        }
+    }
+    auto it = std::lower_bound(nickIndex.constBegin(), nickIndex.constEnd(), NickKey(folded, QString()));
+    for (; it != nickIndex.constEnd() && it->first.startsWith(folded); ++it) {
+        if (!recent.contains(it->second)) {
+            nicks << it->second;
         }
     }
-    nicks.sort(Qt::CaseInsensitive);
     return nicks;
 }
 
+void GCUserModel::noteSpeaker(const QString &nick)
+{
+    if (!contactsByNick.contains(nick)) {
+        return;
+    }
+    if (!recentSpeakers.isEmpty() && recentSpeakers.first() == nick) {
+        return;
+    }
+    recentSpeakers.removeOne(nick);
+    recentSpeakers.prepend(nick);
+    if (recentSpeakers.size() > maxRecentSpeakers) {
+        recentSpeakers.removeLast();
+    }
+}
+
+void GCUserModel::indexNick(const QString &nick)
+{
+    NickKey key(nick.toCaseFolded(), nick);
+    nickIndex.insert(std::lower_bound(nickIndex.begin(), nickIndex.end(), key), key);
+}
+
+void GCUserModel::unindexNick(const QString &nick)
+{
+    NickKey key(nick.toCaseFolded(), nick);
+    auto it = std::lower_bound(nickIndex.begin(), nickIndex.end(), key);
+    if (it != nickIndex.end() && *it == key) {
+        nickIndex.erase(it);
+    }
+}
+
 //----------------------------------------------------------------------------
 // GCUserView
 //----------------------------------------------------------------------------
@@ -645,6 +761,8 @@ GCUserView::GCUserView(QWidget* parent)
     setContextMenuPolicy(Qt::DefaultContextMenu);
     setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     setDragDropMode(QAbstractItemView::DragOnly);
+    // moderators act on many occupants at once
+    setSelectionMode(QAbstractItemView::ExtendedSelection);
 
     setItemDelegate(new GCUserViewDelegate(this));
     //expandAll(); // doesn't work here
@@ -694,6 +812,16 @@ void GCUserView::contextMenuEvent(QContextMenuEvent *cm)
     emit contextMenuRequested(i.data().toString());
 }
 
+QStringList GCUserView::selectedNicks() const
+{
+    QStringList nicks;
+    foreach (const QModelIndex &i, selectionModel()->selectedRows()) {
+        if (i.parent().isValid())
+            nicks += i.data().toString();
+    }
+    return nicks;
+}
+
 void GCUserView::setLooks()
 {
     static_cast<GCUserViewDelegate*>(itemDelegate())->updateSettings();
@@ -24,7 +24,11 @@
 #include "xmpp_status.h"
 
 #include <QAbstractItemModel>
+#include <QHash>
+#include <QPair>
+#include <QStringList>
 #include <QTreeView>
+#include <QVector>
 
 class GCUserView;
 class PsiAccount;
@@ -52,20 +56,27 @@ public:
     public:
         typedef QSharedPointer<MUCContact> Ptr;
         QString name;
+        QString sortKey; // lowercased name for collation
         Status  status;
         QPixmap avatar;
+        bool    avatarLoaded = false;
     };
+    typedef QPair<QString, Status> Entry;
 
     GCUserModel(PsiAccount *account, const Jid selfJid, QObject *parent);
 
     // added
     void removeEntry(const QString &nick);
     void updateEntry(const QString &nick, const Status &);
+    void updateEntries(const QList<Entry> &entries);
     GCUserModel::MUCContact *findEntry(const QString &) const;
 
     void clear();
     bool hasJid(const Jid&);
     QStringList nickList() const;
+    // nicks starting with prefix (case-insensitive), recent speakers first
+    QStringList nickCompletions(const QString &prefix) const;
+    void noteSpeaker(const QString &nick);
     MUCContact *selfContact() const;
     void updateAvatar(const QString &nick);
 
@@ -83,11 +94,19 @@ public slots:
 
 private:
     QModelIndex findIndex(const QString &nick) const;
+    int compare(const QString &sortKey, const Status &s, const MUCContact &contact) const;
     QString makeToolTip(const MUCContact &contact) const;
     static Role groupRole(const Status &s);
+    void indexNick(const QString &nick);
+    void unindexNick(const QString &nick);
 
 private:
     QList<MUCContact::Ptr> contacts[LastGroupRole]; // splitted into groups
+    QHash<QString, MUCContact::Ptr> contactsByNick;
+    typedef QPair<QString, QString> NickKey; // case folded nick, nick
+    QVector<NickKey> nickIndex; // sorted, for completion
+    QStringList recentSpeakers; // most recent first
+    bool _statusSort;
 
     PsiAccount *_account;
     Jid _selfJid;
@@ -103,6 +122,7 @@ public:
     ~GCUserView();
 
     void setLooks();
+    QStringList selectedNicks() const;
 
 protected:
     void mousePressEvent(QMouseEvent *event);
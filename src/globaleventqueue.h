@@ -22,6 +22,7 @@
 
 #include "psievent.h"
 
+#include <QHash>
 #include <QObject>
 
 class GlobalEventQueue : public QObject
@@ -48,7 +49,7 @@ private:
 
     static GlobalEventQueue* instance_;
     QList<int> ids_;
-    QList<EventItem*> items_;
+    QHash<int, EventItem*> items_;
     friend class EventQueue;
 };
 
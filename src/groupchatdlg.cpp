@@ -28,6 +28,8 @@
 #include "bookmarkmanager.h"
 #include "busywidget.h"
 #include "coloropt.h"
+#include "discocache.h"
+#include "entityinfocache.h"
 #include "filesharedlg.h"
 #include "filesharingmanager.h"
 #include "gcuserview.h"
@@ -36,7 +38,6 @@
 #include "iconselect.h"
 #include "iconwidget.h"
 #include "languagemanager.h"
-#include "lastactivitytask.h"
 #include "mcmdmanager.h"
 #include "mcmdsimplesite.h"
 #include "messageview.h"
@@ -92,6 +93,7 @@
 #include <QMimeData>
 #include <QPointer>
 #include <QPushButton>
+#include <QRegularExpression>
 #include <QResizeEvent>
 #include <QScrollBar>
 #include <QSplitter>
@@ -102,6 +104,7 @@
 #include <QToolButton>
 #include <QToolTip>
 #include <QVBoxLayout>
+#include <algorithm>
 #include <functional>
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -223,6 +226,11 @@ public:
         trackBar = false;
         mCmdManager.registerProvider(this);
         actions = new ActionList("", 0, false);
+
+        connect(PsiOptions::instance(), &PsiOptions::optionChanged, this, [this](const QString &option) {
+            if (option == QLatin1String("options.ui.muc.highlight-words"))
+                highlightWordsValid = false;
+        });
     }
 
     ~Private()
@@ -258,6 +266,7 @@ public:
     int    pending;
     int    hPending; // highlight pending
     bool   connecting;
+    bool   joinBurst = false;
     bool   alert;
     bool   gcSelfPresenceSupported = false;
     bool   gcSelfAvatarRequested   = false; // when self presence is not supported
@@ -265,18 +274,71 @@ public:
     QStringList hist;
     int         histAt;
 
+    QList<GCUserModel::Entry> burstPresence;
+    QHash<QString, int>       burstIndex;
+
     QPointer<MUCConfigDlg>      configDlg;
     QPointer<GroupchatTopicDlg> topicDlg;
 
     int logSize;
     int rosterSize;
 
+    // highlight matchers are compiled once and checked for every message
+    QRegularExpression highlightWordsRe;
+    bool               highlightWordsValid = false;
+    QRegularExpression selfRe;
+    QString            selfReNick;
+
 public:
     bool trackBar;
     bool tabmode;
 
 public:
     ChatEdit *mle() const { return dlg->ui_.mle->chatEdit(); }
+
+    // one case-insensitive pattern for all the words, matching whole words only
+    static QRegularExpression wordsMatcher(QStringList words)
+    {
+        // longer words first, so the alternation prefers the longest match
+        std::sort(words.begin(), words.end(), [](const QString &a, const QString &b) { return a.size() > b.size(); });
+        QStringList alternatives;
+        for (const QString &w : words) {
+            QString t = w.trimmed();
+            if (!t.isEmpty())
+                alternatives += QRegularExpression::escape(t);
+        }
+        if (alternatives.isEmpty())
+            return QRegularExpression();
+
+        QRegularExpression re(QString("(?<!\\w)(?:%1)(?!\\w)").arg(alternatives.join('|')),
+                              QRegularExpression::CaseInsensitiveOption | QRegularExpression::UseUnicodePropertiesOption);
+        re.optimize();
+        return re;
+    }
+
+    static bool matches(const QRegularExpression &re, const QString &text)
+    {
+        return !re.pattern().isEmpty() && re.match(text).hasMatch();
+    }
+
+    bool mentionsSelf(const QString &body)
+    {
+        if (selfReNick != self) {
+            selfReNick = self;
+            selfRe     = wordsMatcher(QStringList() << self);
+        }
+        return matches(selfRe, body);
+    }
+
+    bool hasHighlightWords(const QString &body)
+    {
+        if (!highlightWordsValid) {
+            highlightWordsValid = true;
+            highlightWordsRe
+                = wordsMatcher(PsiOptions::instance()->getOption("options.ui.muc.highlight-words").toStringList());
+        }
+        return matches(highlightWordsRe, body);
+    }
     ChatView *te_log() const { return dlg->ui_.log; }
 
 public slots:
@@ -319,34 +381,31 @@ public slots:
         }
     }
 
-    void version_finished()
+    void version_finished(const Jid &jid, const EntityInfoCache::Info &version)
     {
-        JT_ClientVersion *version = static_cast<JT_ClientVersion *>(sender());
-        if (!version->success()) {
-            dlg->appendSysMsg(QString("No version information available for %1.").arg(version->jid().resource()), false);
+        if (!version.success) {
+            dlg->appendSysMsg(QString("No version information available for %1.").arg(jid.resource()), false);
             return;
         }
         dlg->appendSysMsg(QString("Version response from %1: N: %2 V: %3 OS: %4")
-                              .arg(version->jid().resource(), version->name(), version->version(), version->os()),
+                              .arg(jid.resource(), version.name, version.version, version.os),
                           false);
     }
 
-    void lastactivity_finished()
+    void lastactivity_finished(const Jid &jid, const EntityInfoCache::Info &idle)
     {
-        LastActivityTask *idle = static_cast<LastActivityTask *>(sender());
-
-        if (!idle->success()) {
-            dlg->appendSysMsg(QString("Can't determine last activity time for %1.").arg(idle->jid().resource()), false);
+        if (!idle.success) {
+            dlg->appendSysMsg(QString("Can't determine last activity time for %1.").arg(jid.resource()), false);
             return;
         }
 
-        if (idle->status().isEmpty()) {
+        if (idle.lastStatus.isEmpty()) {
             dlg->appendSysMsg(QString("Last activity from %1 at %2")
-                                  .arg(idle->jid().resource(), idle->time().toString()),
+                                  .arg(jid.resource(), idle.lastActivity.toString()),
                               false);
         } else {
             dlg->appendSysMsg(QString("Last activity from %1 at %2 (%3)")
-                                  .arg(idle->jid().resource(), idle->time().toString(), idle->status()),
+                                  .arg(jid.resource(), idle.lastActivity.toString(), idle.lastStatus),
                               false);
         }
     }
@@ -457,19 +516,18 @@ join <channel>{,<channel>} [pass{,<pass>}
                 topicMap.insert(id, topic);
                 dlg->sendNewTopic(topicMap);
             } else if (cmd == "version" && command.count() > 1) {
-                QString           nick    = command[1].trimmed();
-                Jid               target  = dlg->jid().withResource(nick);
-                JT_ClientVersion *version = new JT_ClientVersion(dlg->account()->client()->rootTask());
-                connect(version, SIGNAL(finished()), SLOT(version_finished()));
-                version->get(target);
-                version->go();
+                QString nick   = command[1].trimmed();
+                Jid     target = dlg->jid().withResource(nick);
+                dlg->account()->entityInfoCache()->query(
+                    EntityInfoCache::Version, target, this,
+                    [this, target](const EntityInfoCache::Info &info) { version_finished(target, info); });
                 newstate = nullptr;
             } else if (cmd == "idle" && command.count() > 1) {
-                QString           nick   = command[1].trimmed();
-                Jid               target = dlg->jid().withResource(nick);
-                LastActivityTask *idle   = new LastActivityTask(target, dlg->account()->client()->rootTask());
-                connect(idle, SIGNAL(finished()), SLOT(lastactivity_finished()));
-                idle->go();
+                QString nick   = command[1].trimmed();
+                Jid     target = dlg->jid().withResource(nick);
+                dlg->account()->entityInfoCache()->query(
+                    EntityInfoCache::LastActivity, target, this,
+                    [this, target](const EntityInfoCache::Info &info) { lastactivity_finished(target, info); });
                 newstate = nullptr;
             } else if (cmd == "quote") {
                 dlg->appendSysMsg(command.join("|"), false);
@@ -623,14 +681,10 @@ public:
             if (p_->mCmdSite.isActive()) {
                 return mCmdList_;
             }
-            QStringList suggestedNicks;
-            QStringList nicks = allNicks();
-
-            QString postAdd = atStart_ ? nickSeparator + " " : "";
-
-            foreach (QString nick, nicks) {
-                if (nick.left(toComplete_.length()).toLower() == toComplete_.toLower()) {
-                    suggestedNicks << nick + postAdd;
+            QStringList suggestedNicks = p_->dlg->d->usersModel->nickCompletions(toComplete_);
+            if (atStart_) {
+                for (QString &nick : suggestedNicks) {
+                    nick += nickSeparator + " ";
                 }
             }
             return suggestedNicks;
@@ -647,7 +701,7 @@ public:
                 guess += nickSeparator + " ";
             }
 
-            QStringList all = allNicks();
+            QStringList all = p_->dlg->d->usersModel->nickCompletions(QString());
 
             if (atStart_) {
                 QStringList::Iterator it = all.begin();
@@ -658,11 +712,6 @@ public:
             return all;
         };
 
-        QStringList allNicks()
-        {
-            return p_->dlg->d->usersModel->nickList();
-        }
-
         QStringList mCmdList_;
 
         // FIXME where to move this?
@@ -842,7 +891,16 @@ void GCMainDlg::doContactContextMenu(const QString &nick)
 
     if (x == -1 || !enabled)
         return;
-    lv_action(itm->name, itm->status, x);
+
+    // moderating from the occupant list acts on all the selected ones
+    QStringList nicks;
+    if (sender() == ui_.lv_users && x >= 10)
+        nicks = ui_.lv_users->selectedNicks();
+    nicks.removeAll(d->self);
+    if (nicks.count() > 1 && nicks.contains(itm->name))
+        moderate(nicks, x);
+    else
+        lv_action(itm->name, itm->status, x);
 }
 
 GCMainDlg::GCMainDlg(PsiAccount *pa, const Jid &j, TabManager *tabManager) :
@@ -1057,12 +1115,14 @@ GCMainDlg::GCMainDlg(PsiAccount *pa, const Jid &j, TabManager *tabManager) :
     // Connect signals from MUC manager
     connect(d->mucManager, SIGNAL(action_error(MUCManager::Action, int, const QString &)), SLOT(action_error(MUCManager::Action, int, const QString &)));
     connect(d->mucManager, SIGNAL(action_success(MUCManager::Action)), d->usersModel, SLOT(updateAll()));
+    connect(d->mucManager, SIGNAL(moderate_finished(MUCManager::Action, const QList<MUCManager::ItemResult> &)),
+            SLOT(moderate_finished(MUCManager::Action, const QList<MUCManager::ItemResult> &)));
 
     updateMucName();
     updateGCVCard();
-    JT_DiscoInfo *disco = new JT_DiscoInfo(account()->client()->rootTask()); // FIXME in fact xep says we should do this before entering.
-    connect(disco, SIGNAL(finished()), SLOT(discoInfoFinished()));           // but we need this just for name for now.
-    disco->get(jid());                                                       // From other side we could provide the name outside.
+    DiscoQuery *disco = new DiscoQuery(account()->discoCache(), DiscoQuery::Info); // FIXME in fact xep says we should do this before entering.
+    connect(disco, SIGNAL(finished()), SLOT(discoInfoFinished()));                 // but we need this just for name for now.
+    disco->get(jid());                                                             // From other side we could provide the name outside.
     disco->go(true);
 
     setLooks();
@@ -1232,6 +1292,7 @@ void GCMainDlg::logSelectionChanged()
 void GCMainDlg::setConnecting()
 {
     d->connecting = true;
+    d->joinBurst = true;
     QTimer::singleShot(5000, this, SLOT(unsetConnecting()));
 }
 
@@ -1268,6 +1329,7 @@ void GCMainDlg::openWhiteboard()
 
 void GCMainDlg::unsetConnecting()
 {
+    flushJoinBurst();
     d->connecting = false;
 }
 
@@ -1300,7 +1362,7 @@ void GCMainDlg::updateMucName()
 
 void GCMainDlg::discoInfoFinished()
 {
-    JT_DiscoInfo *               t = static_cast<JT_DiscoInfo *>(sender());
+    DiscoQuery *                 t = static_cast<DiscoQuery *>(sender());
     const DiscoItem::Identities &i = t->item().identities();
     if (i.count() > 0) {
         d->discoMucName = i.first().name;
@@ -1764,6 +1826,23 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
     }
 
     bool isSelf = (nick == d->self);
+
+    // Occupants' presences arrive before our own one when joining. Collect
+    // them and add them to the roster in one batch.
+    if (d->joinBurst) {
+        if (!isSelf && !nick.isEmpty() && s.isAvailable() && !s.getMUCStatuses().contains(201)
+            && (d->burstIndex.contains(nick) || !d->usersModel->findEntry(nick))) {
+            if (d->burstIndex.contains(nick)) {
+                d->burstPresence[d->burstIndex.value(nick)].second = s;
+            } else {
+                d->burstIndex.insert(nick, d->burstPresence.size());
+                d->burstPresence.append(GCUserModel::Entry(nick, s));
+            }
+            return;
+        }
+        flushJoinBurst();
+    }
+
     if (isSelf) {
         if (!d->gcSelfPresenceSupported && !d->gcSelfAvatarRequested) {
             d->gcSelfAvatarRequested = true;
@@ -1806,40 +1885,7 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
             //contact joining
             //ui_.log->updateAvatar(jid().withResource(nick), isSelf? ChatViewCommon::LocalParty: ChatViewCommon::Participant);
 
-            MessageView mv(MessageView::MUCJoin);
-            if ((!d->connecting || options_->getOption("options.ui.muc.show-initial-joins").toBool()) && options_->getOption("options.muc.show-joins").toBool()) {
-                QString message = tr("%1 has joined the room");
-                if (options_->getOption("options.muc.show-role-affiliation").toBool()) {
-                    if (s.mucItem().role() != MUCItem::NoRole) {
-                        if (s.mucItem().affiliation() != MUCItem::NoAffiliation) {
-                            message = tr("%3 has joined the room as %1 and %2").arg(MUCManager::roleToString(s.mucItem().role(), true), MUCManager::affiliationToString(s.mucItem().affiliation(), true));
-                        } else {
-                            message = tr("%2 has joined the room as %1").arg(MUCManager::roleToString(s.mucItem().role(), true));
-                        }
-                    } else if (s.mucItem().affiliation() != MUCItem::NoAffiliation) {
-                        message = tr("%2 has joined the room as %1").arg(MUCManager::affiliationToString(s.mucItem().affiliation(), true));
-                    }
-                }
-                if (!s.mucItem().jid().isEmpty()) {
-                    message = message.arg(QString("%1 (%2)").arg(nick, s.mucItem().jid().full()));
-                } else {
-                    message = message.arg(nick);
-                }
-
-                bool showStatusChanges = options_->getOption("options.muc.show-status-changes").toBool();
-                if (showStatusChanges) {
-                    message += tr(" and now is %1").arg(status2txt(s.type()));
-                }
-
-                mv = MessageView::mucJoinMessage(nick, int(s.type()), message, s.status(), s.priority());
-                mv.setStatusChangeHidden(!showStatusChanges);
-            } else {
-                mv = MessageView::mucJoinMessage(nick, int(s.type()), QString(), s.status(), s.priority());
-                mv.setStatusChangeHidden();
-                mv.setJoinLeaveHidden();
-            }
-            mv.setLocal(isSelf); // hack
-            dispatchMessage(mv);
+            dispatchJoinMessage(nick, s, isSelf);
         } else {
             // Status change
             if (!d->connecting && options_->getOption("options.muc.show-role-affiliation").toBool()) {
@@ -1976,6 +2022,71 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
         d->usersModel->removeEntry(nick);
     }
 
+    updateOccupantCaps(nick, s);
+}
+
+void GCMainDlg::dispatchJoinMessage(const QString &nick, const Status &s, bool isSelf)
+{
+    PsiOptions *options_ = PsiOptions::instance();
+
+    MessageView mv(MessageView::MUCJoin);
+    if ((!d->connecting || options_->getOption("options.ui.muc.show-initial-joins").toBool()) && options_->getOption("options.muc.show-joins").toBool()) {
+        QString message = tr("%1 has joined the room");
+        if (options_->getOption("options.muc.show-role-affiliation").toBool()) {
+            if (s.mucItem().role() != MUCItem::NoRole) {
+                if (s.mucItem().affiliation() != MUCItem::NoAffiliation) {
+                    message = tr("%3 has joined the room as %1 and %2").arg(MUCManager::roleToString(s.mucItem().role(), true), MUCManager::affiliationToString(s.mucItem().affiliation(), true));
+                } else {
+                    message = tr("%2 has joined the room as %1").arg(MUCManager::roleToString(s.mucItem().role(), true));
+                }
+            } else if (s.mucItem().affiliation() != MUCItem::NoAffiliation) {
+                message = tr("%2 has joined the room as %1").arg(MUCManager::affiliationToString(s.mucItem().affiliation(), true));
+            }
+        }
+        if (!s.mucItem().jid().isEmpty()) {
+            message = message.arg(QString("%1 (%2)").arg(nick, s.mucItem().jid().full()));
+        } else {
+            message = message.arg(nick);
+        }
+
+        bool showStatusChanges = options_->getOption("options.muc.show-status-changes").toBool();
+        if (showStatusChanges) {
+            message += tr(" and now is %1").arg(status2txt(s.type()));
+        }
+
+        mv = MessageView::mucJoinMessage(nick, int(s.type()), message, s.status(), s.priority());
+        mv.setStatusChangeHidden(!showStatusChanges);
+    } else {
+        mv = MessageView::mucJoinMessage(nick, int(s.type()), QString(), s.status(), s.priority());
+        mv.setStatusChangeHidden();
+        mv.setJoinLeaveHidden();
+    }
+    mv.setLocal(isSelf); // hack
+    dispatchMessage(mv);
+}
+
+/**
+ * Applies presences collected while joining (see presence()) in one go.
+ */
+void GCMainDlg::flushJoinBurst()
+{
+    d->joinBurst = false;
+    if (d->burstPresence.isEmpty())
+        return;
+
+    QList<GCUserModel::Entry> entries = d->burstPresence;
+    d->burstPresence.clear();
+    d->burstIndex.clear();
+
+    for (const GCUserModel::Entry &e : entries) {
+        dispatchJoinMessage(e.first, e.second, false);
+        updateOccupantCaps(e.first, e.second);
+    }
+    d->usersModel->updateEntries(entries);
+}
+
+void GCMainDlg::updateOccupantCaps(const QString &nick, const Status &s)
+{
     if (s.caps().isValid()) {
         Jid caps_jid(s.mucItem().jid().isEmpty() || !d->nonAnonymous ? Jid(jid()).withResource(nick) : s.mucItem().jid());
         account()->client()->capsManager()->updateCaps(caps_jid, s.caps());
@@ -2076,20 +2187,17 @@ void GCMainDlg::message(const Message &_m, const PsiEvent::Ptr &e)
         return;
 
     // code to determine if the speaker was addressing this client in chat
-    if (m.body().contains(d->self))
+    if (d->mentionsSelf(m.body()))
         d->alert = true;
 
     if (m.body().left(d->self.length()) == d->self)
         d->lastReferrer = m.from().resource();
 
-    if (options->getOption("options.ui.muc.use-highlighting").toBool()) {
-        QStringList highlightWords = options->getOption("options.ui.muc.highlight-words").toStringList();
-        foreach (QString word, highlightWords) {
-            if (m.body().contains((word), Qt::CaseInsensitive)) {
-                d->alert = true;
-            }
-        }
-    }
+    if (from != d->self)
+        d->usersModel->noteSpeaker(from);
+
+    if (!d->alert && options->getOption("options.ui.muc.use-highlighting").toBool() && d->hasHighlightWords(m.body()))
+        d->alert = true;
 
     // play sound?
     if (from == d->self) {
@@ -2121,6 +2229,8 @@ void GCMainDlg::joined()
 {
     if (d->state == Private::Connecting) {
         d->usersModel->clear();
+        d->burstPresence.clear();
+        d->burstIndex.clear();
         d->state = Private::Connected;
         ui_.pb_topic->setEnabled(true);
         setStatusTabIcon(STATUS_ONLINE);
@@ -2359,77 +2469,95 @@ void GCMainDlg::lv_action(const QString &nick, const Status &s, int x)
         account()->actionVoice(jid().withResource(nick));
     } else if (x == 6) {
         account()->actionExecuteCommandSpecific(jid().withResource(nick));
-    } else if (x == 10) {
-        d->mucManager->kick(nick);
-    } else if (x == 11) {
-        auto contact = d->usersModel->findEntry(nick);
-        d->mucManager->ban(contact->status.mucItem().jid());
-    } else if (x > 11 && x < 19) {
+    } else if ((x >= 10 && x < 19) || (x >= 100 && x < 300)) {
+        moderate(QStringList() << nick, x);
+    }
+}
+
+/**
+ * Kicks, bans or changes the role or affiliation of the occupants, x is
+ * the action of the contact menu. All of them go to the room in one go.
+ */
+void GCMainDlg::moderate(const QStringList &nicks, int x)
+{
+    QString reason;
+    if ((x > 11 && x < 19) || x == 100 || x == 200) {
         MUCReasonsEditor editor(this);
-        QString          reason;
-        if (editor.exec())
-            reason = editor.reason();
-        else
+        if (!editor.exec())
             return;
+        reason = editor.reason();
+    } else if (x > 100) {
+        QStringList reasons = PsiOptions::instance()->getOption("options.muc.reasons").toStringList();
+        int         idx     = (x < 200) ? x - 101 : x - 201;
+        if (idx < reasons.count())
+            reason = reasons[idx];
+    }
+    // kicks and bans from the reason submenus need one
+    if (x >= 100 && reason.isEmpty())
+        return;
+
+    const bool                 kick   = x == 10 || (x >= 100 && x < 200);
+    const bool                 ban    = x == 11 || x >= 200;
+    static const MUCItem::Role roles[] = { MUCItem::Visitor, MUCItem::Participant, MUCItem::Moderator };
+    static const MUCItem::Affiliation affiliations[]
+        = { MUCItem::NoAffiliation, MUCItem::Member, MUCItem::Admin, MUCItem::Owner };
+
+    QList<MUCItem> items;
+    for (const QString &nick : nicks) {
         auto contact = d->usersModel->findEntry(nick);
         if (!contact)
-            return;
-        switch (x) {
-        case 12:
-            if (contact->status.mucItem().role() != MUCItem::Visitor)
-                d->mucManager->setRole(nick, MUCItem::Visitor, reason);
-            break;
-        case 13:
-            if (contact->status.mucItem().role() != MUCItem::Participant)
-                d->mucManager->setRole(nick, MUCItem::Participant, reason);
-            break;
-        case 14:
-            if (contact->status.mucItem().role() != MUCItem::Moderator)
-                d->mucManager->setRole(nick, MUCItem::Moderator, reason);
-            break;
-        case 15:
-            if (contact->status.mucItem().affiliation() != MUCItem::NoAffiliation)
-                d->mucManager->setAffiliation(contact->status.mucItem().jid(), MUCItem::NoAffiliation, reason);
-            break;
-        case 16:
-            if (contact->status.mucItem().affiliation() != MUCItem::Member)
-                d->mucManager->setAffiliation(contact->status.mucItem().jid(), MUCItem::Member, reason);
-            break;
-        case 17:
-            if (contact->status.mucItem().affiliation() != MUCItem::Admin)
-                d->mucManager->setAffiliation(contact->status.mucItem().jid(), MUCItem::Admin, reason);
-            break;
-        case 18:
-            if (contact->status.mucItem().affiliation() != MUCItem::Owner)
-                d->mucManager->setAffiliation(contact->status.mucItem().jid(), MUCItem::Owner, reason);
-            break;
-        }
-    } else if (x >= 100 && x < 300) {
-        // Kick || Ban with reason
-        QString     reason;
-        QStringList reasons = PsiOptions::instance()->getOption("options.muc.reasons").toStringList();
-        if (x == 100 || x == 200) {
-            // Show custom reason dialog
-            MUCReasonsEditor *editor = new MUCReasonsEditor(this);
-            if (editor->exec())
-                reason = editor->reason();
-            delete editor;
+            continue;
+        const MUCItem &current = contact->status.mucItem();
+        const Jid      jid     = current.jid();
+
+        MUCItem item;
+        if (kick || (x >= 12 && x <= 14)) {
+            MUCItem::Role role = kick ? MUCItem::NoRole : roles[x - 12];
+            if (current.role() == role)
+                continue;
+            item = MUCItem(role, MUCItem::UnknownAffiliation);
+            item.setNick(nick);
         } else {
-            int idx = (x < 200) ? x - 101 : x - 201;
-            if (idx < reasons.count())
-                reason = reasons[idx];
-        }
-        if (!reason.isEmpty()) {
-            if (x < 200)
-                d->mucManager->kick(nick, reason);
-            else {
-                auto contact = d->usersModel->findEntry(nick);
-                if (!contact)
-                    return;
-                d->mucManager->ban(contact->status.mucItem().jid(), reason);
-            }
+            MUCItem::Affiliation affiliation = ban ? MUCItem::Outcast : affiliations[x - 15];
+            // the room knows the affiliations by jid only
+            if (current.affiliation() == affiliation || jid.isEmpty())
+                continue;
+            item = MUCItem(MUCItem::UnknownRole, affiliation);
+            item.setJid(jid.bare());
         }
+        if (!reason.isEmpty())
+            item.setReason(reason);
+        items += item;
     }
+    if (!items.isEmpty())
+        d->mucManager->moderate(items, kick ? MUCManager::Kick : ban ? MUCManager::Ban : MUCManager::Unknown);
+}
+
+void GCMainDlg::moderate_finished(MUCManager::Action action, const QList<MUCManager::ItemResult> &results)
+{
+    // the affiliation lists of the config dialog
+    if (action == MUCManager::SetAffiliation)
+        return;
+
+    QStringList failed;
+    QString     error;
+    for (const MUCManager::ItemResult &r : results) {
+        if (r.error.isEmpty())
+            continue;
+        failed += r.item.nick().isEmpty() ? r.item.jid().bare() : r.item.nick();
+        error = r.error;
+    }
+    if (failed.count() == 1)
+        appendSysMsg(error, false);
+    else if (!failed.isEmpty())
+        appendSysMsg(tr("%1 of %2 changes failed (%3): %4")
+                         .arg(failed.count())
+                         .arg(results.count())
+                         .arg(failed.join(", "))
+                         .arg(error),
+                     false);
+    // the occupants are refreshed once for the whole batch
+    d->usersModel->updateAll();
 }
 
 void GCMainDlg::contextMenuEvent(QContextMenuEvent *)
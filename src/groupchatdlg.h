@@ -125,6 +125,7 @@ private slots:
     void setConnecting();
     void unsetConnecting();
     void action_error(MUCManager::Action, int, const QString&);
+    void moderate_finished(MUCManager::Action, const QList<MUCManager::ItemResult>&);
     void updateMucName();
     void updateGCVCard();
     void discoInfoFinished();
@@ -156,6 +157,11 @@ private:
 
     void contextMenuEvent(QContextMenuEvent *);
 
+    void dispatchJoinMessage(const QString &nick, const Status &s, bool isSelf);
+    void flushJoinBurst();
+    void updateOccupantCaps(const QString &nick, const Status &s);
+    void moderate(const QStringList &nicks, int x);
+
     inline XMPP::Jid jidForNick(const QString &nick) const;
 
     void setMucSelfAvatar();
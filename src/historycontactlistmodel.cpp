@@ -25,6 +25,11 @@
 #include "psicontact.h"
 #include "psiiconset.h"
 
+#include <QTimer>
+
+// history-only contacts added to the model per event loop pass
+static const int appendChunkSize = 200;
+
 HistoryContactListModel::HistoryContactListModel(QObject *parent)
     : QAbstractItemModel(parent)
     , rootItem(nullptr)
@@ -33,11 +38,16 @@ HistoryContactListModel::HistoryContactListModel(QObject *parent)
     , confPrivate(nullptr)
     , dispPrivateContacts(false)
     , dispAllContacts(false)
+    , appendScheduled(false)
+    , psi_(nullptr)
+    , edbHandle(nullptr)
+    , requestedType(EDB::Contact)
 {
 }
 
 HistoryContactListModel::~HistoryContactListModel()
 {
+    delete edbHandle;
     delete rootItem;
 }
 
@@ -50,12 +60,120 @@ void HistoryContactListModel::clear()
     confPrivate  = nullptr;
 }
 
+/**
+ * The roster part of the list is there when this returns. The contacts
+ * known only from the history follow as the database answers, appended a
+ * chunk at a time, and contactsLoaded() is emitted after the last one.
+ */
 void HistoryContactListModel::updateContacts(PsiCon *psi, const QString &id)
 {
     beginResetModel();
     clear();
+    pending.clear();
+    pendingPrivate.clear();
+    c_list.clear();
+    psi_   = psi;
+    accId_ = id;
     loadContacts(psi, id);
     endResetModel();
+
+    // an answer to an older request is dropped when it arrives
+    edbHandle = new EDBHandle(psi->edb());
+    connect(edbHandle, SIGNAL(finished()), SLOT(edbFinished()));
+    requestedType = EDB::Contact;
+    edbHandle->contacts(id, EDB::Contact);
+}
+
+void HistoryContactListModel::edbFinished()
+{
+    EDBHandle *h = qobject_cast<EDBHandle*>(sender());
+    if (!h)
+        return;
+    if (h != edbHandle) {
+        h->deleteLater();
+        return;
+    }
+
+    if (requestedType == EDB::Contact)
+        pending += h->contactsResult();
+    else
+        pendingPrivate += h->contactsResult();
+    if (requestedType == EDB::Contact && dispPrivateContacts) {
+        requestedType = EDB::GroupChatContact;
+        h->contacts(accId_, EDB::GroupChatContact);
+    } else {
+        edbHandle = nullptr;
+        h->deleteLater();
+    }
+    if (!appendScheduled)
+        appendPending();
+}
+
+void HistoryContactListModel::appendPending()
+{
+    appendScheduled = false;
+    if (!rootItem) {
+        pending.clear();
+        pendingPrivate.clear();
+        return;
+    }
+
+    QList<TreeItem *> notInListItems;
+    QList<TreeItem *> privateItems;
+    int count = 0;
+    for ( ; count < appendChunkSize && !pending.isEmpty(); ++count) {
+        const EDB::ContactItem ci = pending.takeFirst();
+        QString cId = ci.accId + "|" + ci.jid.bare();
+        if (c_list.contains(cId))
+            continue;
+        QString tooltipStr = makeContactToolTip(psi_, accId_, ci.jid, true);
+        notInListItems.append(new TreeItem(NotInRosterContact, ci.jid.bare(), tooltipStr, cId));
+        c_list.insert(cId);
+    }
+    for ( ; count < appendChunkSize && !pendingPrivate.isEmpty(); ++count) {
+        const EDB::ContactItem ci = pendingPrivate.takeFirst();
+        QString cId = ci.accId + "|" + ci.jid.full();
+        QString tooltipStr = makeContactToolTip(psi_, accId_, ci.jid, false);
+        privateItems.append(new TreeItem(NotInRosterContact, ci.jid.resource(), tooltipStr, cId));
+    }
+
+    if (!notInListItems.isEmpty())
+        appendToGroup(ensureGroup(notInList, tr("Not in list"), "not-in-list", 10), notInListItems);
+    if (!privateItems.isEmpty())
+        appendToGroup(ensureGroup(confPrivate, tr("Private messages"), "conf-private", 11), privateItems);
+
+    if (!pending.isEmpty() || !pendingPrivate.isEmpty()) {
+        appendScheduled = true;
+        QTimer::singleShot(0, this, SLOT(appendPending()));
+    } else if (!edbHandle) {
+        emit contactsLoaded();
+    }
+}
+
+// a top level group, added to the model when first needed
+HistoryContactListModel::TreeItem *HistoryContactListModel::ensureGroup(TreeItem *&group, const QString &text,
+                                                                        const QString &id, int pos)
+{
+    if (!group) {
+        const int row = rootItem->childCount();
+        beginInsertRows(QModelIndex(), row, row);
+        group = new TreeItem(Group, text, id, pos);
+        rootItem->appendChild(group);
+        endInsertRows();
+    }
+    return group;
+}
+
+void HistoryContactListModel::appendToGroup(TreeItem *group, const QList<TreeItem *> &items)
+{
+    const QModelIndex groupIndex = createIndex(group->row(), 0, group);
+    const int first = group->childCount();
+    beginInsertRows(groupIndex, first, first + items.count() - 1);
+    foreach (TreeItem *item, items)
+        group->appendChild(item);
+    endInsertRows();
+    // the group shows the number of its contacts
+    emit dataChanged(groupIndex, groupIndex);
 }
 
 int HistoryContactListModel::rowCount(const QModelIndex &parent) const
@@ -155,7 +273,6 @@ void HistoryContactListModel::loadContacts(PsiCon *psi, const QString &acc_id)
         contactList = psi->contactList()->contacts();
     else
         contactList = psi->contactList()->getAccount(acc_id)->contactList();
-    QHash<QString, bool> c_list;
     QHash<QString, TreeItem*> groups;
     // Roster contacts
     foreach (PsiContact* contact, contactList)
@@ -163,7 +280,7 @@ void HistoryContactListModel::loadContacts(PsiCon *psi, const QString &acc_id)
         if (contact->isConference() || contact->isPrivate())
             continue;
         QString cId = contact->account()->id() + "|" + contact->jid().bare();
-        if (c_list.value(cId))
+        if (c_list.contains(cId))
             continue;
 
         TreeItem *groupItem = nullptr;
@@ -185,7 +302,7 @@ void HistoryContactListModel::loadContacts(PsiCon *psi, const QString &acc_id)
         }
         QString tooltipStr = makeContactToolTip(psi, acc_id, contact->jid(), true);
         groupItem->appendChild(new TreeItem(RosterContact, contact->name(), tooltipStr, cId));
-        c_list[cId] = true;
+        c_list.insert(cId);
     }
     // Self contact
     foreach (PsiAccount *pa, psi->contactList()->accounts())
@@ -194,47 +311,16 @@ void HistoryContactListModel::loadContacts(PsiCon *psi, const QString &acc_id)
         {
             PsiContact *self = pa->selfContact();
             QString cId = pa->id() + "|" + self->jid().bare();
-            if (c_list.value(cId))
+            if (c_list.contains(cId))
                 continue;
 
             QString tooltipStr = makeContactToolTip(psi, acc_id, self->jid(), true);
             generalGroup->appendChild(new TreeItem(RosterContact, self->name(), tooltipStr, cId));
-            c_list[cId] = true;
+            c_list.insert(cId);
             if (!acc_id.isEmpty())
                 break;
         }
     }
-    // Not in roster list
-    foreach (const EDB::ContactItem &ci, psi->edb()->contacts(acc_id, EDB::Contact))
-    {
-        QString cId = ci.accId + "|" + ci.jid.bare();
-        if (c_list.value(cId))
-            continue;
-
-        if (!notInList)
-        {
-            notInList = new TreeItem(Group, tr("Not in list"), "not-in-list", 10);
-            rootItem->appendChild(notInList);
-        }
-        QString tooltipStr = makeContactToolTip(psi, acc_id, ci.jid, true);
-        notInList->appendChild(new TreeItem(NotInRosterContact, ci.jid.bare(), tooltipStr, cId));
-        c_list[cId] = true;
-    }
-    // Private messages
-    if (dispPrivateContacts)
-    {
-        foreach (const EDB::ContactItem &ci, psi->edb()->contacts(acc_id, EDB::GroupChatContact))
-        {
-            if (!confPrivate)
-            {
-                confPrivate = new TreeItem(Group, tr("Private messages"), "conf-private", 11);
-                rootItem->appendChild(confPrivate);
-            }
-            QString cId = ci.accId + "|" + ci.jid.full();
-            QString tooltipStr = makeContactToolTip(psi, acc_id, ci.jid, false);
-            confPrivate->appendChild(new TreeItem(NotInRosterContact, ci.jid.resource(), tooltipStr, cId));
-        }
-    }
     if (dispAllContacts)
     {
         QString s = tr("All contacts");
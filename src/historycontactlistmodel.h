@@ -20,9 +20,11 @@
 #ifndef HISTORYCONTACTLISTMODEL_H
 #define HISTORYCONTACTLISTMODEL_H
 
+#include "eventdb.h"
 #include "psicon.h"
 
 #include <QAbstractItemModel>
+#include <QSet>
 #include <QSortFilterProxyModel>
 
 class HistoryContactListModel : public QAbstractItemModel
@@ -52,6 +54,14 @@ public:
     QModelIndex parent(const QModelIndex &child) const;
     bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex());
 
+signals:
+    // the contacts known only from the history are all in the model
+    void contactsLoaded();
+
+private slots:
+    void edbFinished();
+    void appendPending();
+
 private:
     class TreeItem
     {
@@ -82,6 +92,8 @@ private:
 
 private:
     void loadContacts(PsiCon *psi, const QString &acc_id);
+    TreeItem *ensureGroup(TreeItem *&group, const QString &text, const QString &id, int pos);
+    void appendToGroup(TreeItem *group, const QList<TreeItem *> &items);
     QString makeContactToolTip(PsiCon *psi, const QString &accId, const Jid &jid, bool bare) const;
     TreeItem *rootItem;
     TreeItem *generalGroup;
@@ -89,6 +101,14 @@ private:
     TreeItem *confPrivate;
     bool dispPrivateContacts;
     bool dispAllContacts;
+    bool appendScheduled;
+    PsiCon *psi_;
+    QString accId_;
+    EDBHandle *edbHandle;
+    int requestedType;
+    QList<EDB::ContactItem> pending;        // not in the roster
+    QList<EDB::ContactItem> pendingPrivate; // private messages of group chats
+    QSet<QString> c_list;
 
 };
 
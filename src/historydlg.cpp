@@ -22,6 +22,7 @@
 #include "coloropt.h"
 #include "common.h"
 #include "fileutil.h"
+#include "historyexport.h"
 #include "jidutil.h"
 #include "psiaccount.h"
 #include "psicon.h"
@@ -38,73 +39,23 @@
 #include <QProgressDialog>
 #include <QScrollBar>
 #include <QTextBlock>
+#include <QTreeWidget>
 
 #define SEARCH_PADDING_SIZE 20
 #define DISPLAY_PAGE_SIZE   200
+#define CACHED_PAGES        6
+#define CACHED_SEARCH_ITEMS 10000
 
 static const QString geometryOption = "options.ui.history.size";
 
-static QString getNext(QString *str)
-{
-    int n = 0;
-    // skip leading spaces (but *do* return them later!)
-    while(n < int(str->length()) && str->at(n).isSpace()) {
-        ++n;
-    }
-    if(n == int(str->length())) {
-        return QString();
-    }
-    // find end or next space
-    while(n < int(str->length()) && !str->at(n).isSpace()) {
-        ++n;
-    }
-    QString result = str->mid(0, n);
-    *str = str->mid(n);
-    return result;
-}
-
-// wraps a string against a fixed width
-static QStringList wrapString(const QString &str, int wid)
-{
-    QStringList lines;
-    QString cur;
-    QString tmp = str;
-    //printf("parsing: [%s]\n", tmp.latin1());
-    while(1) {
-        QString word = getNext(&tmp);
-        if(word == QString()) {
-            lines += cur;
-            break;
-        }
-        //printf("word:[%s]\n", word.latin1());
-        if(!cur.isEmpty()) {
-            if(int(cur.length()) + int(word.length()) > wid) {
-                lines += cur;
-                cur = "";
-            }
-        }
-        if(cur.isEmpty()) {
-            // trim the whitespace in front
-            for(int n = 0; n < int(word.length()); ++n) {
-                if(!word.at(n).isSpace()) {
-                    if(n > 0) {
-                        word = word.mid(n);
-                    }
-                    break;
-                }
-            }
-        }
-        cur += word;
-    }
-    return lines;
-}
-
 SearchProxy::SearchProxy(PsiCon *p, DisplayProxy *d)
     : QObject(nullptr)
     , active(false)
+    , findHandle(nullptr)
 {
     psi = p;
     dp = d;
+    results.setMaxCost(CACHED_SEARCH_ITEMS);
 }
 
 void SearchProxy::find(const QString &str, const QString &acc_id, const Jid &jid, int dir)
@@ -117,8 +68,21 @@ void SearchProxy::find(const QString &str, const QString &acc_id, const Jid &jid
         jid_ = jid;
         direction = dir;
         emit needRequest();
-        reqType = ReqFind;
-        getEDBHandle()->find(acc_id, str, jid, QDateTime(), EDB::Forward);
+        emit searchStarted();
+        findKey = QString("find|%1|%2|%3").arg(acc_id, jid.full(), str);
+        if (EDBResult *r = results.object(findKey)) {
+            const EDBResult hits = *r;
+            emit matchesFound(hits);
+            handleFoundData(hits);
+            emit found(total_found);
+            return;
+        }
+        // the hits are listed as they come, the jump waits for all of them
+        streamed.clear();
+        findHandle = new EDBHandle(psi->edb());
+        connect(findHandle, SIGNAL(matchesReady()), this, SLOT(handleMatches()));
+        connect(findHandle, SIGNAL(finished()), this, SLOT(handleFound()));
+        findHandle->findMatches(acc_id, str, jid);
         return;
     }
 
@@ -126,12 +90,28 @@ void SearchProxy::find(const QString &str, const QString &acc_id, const Jid &jid
     if (!dp->moveSearchCursor(dir, 1)) { // tries to move the search cursor into the history widget
         direction = dir;
         emit needRequest();
-        reqType = ReqPadding;
-        int r_dir = (dir == EDB::Forward) ? EDB::Backward : EDB::Forward;
-        getEDBHandle()->get(acc_id, jid, position.date, r_dir, 0, SEARCH_PADDING_SIZE);
+        requestPadding((dir == EDB::Forward) ? EDB::Backward : EDB::Forward);
     }
 }
 
+void SearchProxy::clearCache()
+{
+    results.clear();
+}
+
+// the events before a hit, jumping back and forth between hits reuses them
+void SearchProxy::requestPadding(int dir)
+{
+    cacheKey = QString("padding|%1|%2|%3|%4").arg(acc_, jid_.full(), position.date.toString(Qt::ISODate)).arg(dir);
+    if (EDBResult *r = results.object(cacheKey)) {
+        const EDBResult padding = *r;
+        cacheKey.clear();
+        handlePadding(padding);
+        return;
+    }
+    getEDBHandle()->get(acc_, jid_, position.date, dir, 0, SEARCH_PADDING_SIZE);
+}
+
 void SearchProxy::handleResult()
 {
     EDBHandle *h = qobject_cast<EDBHandle*>(sender());
@@ -139,18 +119,47 @@ void SearchProxy::handleResult()
         return;
 
     const EDBResult r = h->result();
-    switch (reqType) {
-    case ReqFind:
-        handleFoundData(r);
-        emit found(total_found);
-        break;
-    case ReqPadding:
-        handlePadding(r);
-        break;
+    if (!cacheKey.isEmpty()) {
+        results.insert(cacheKey, new EDBResult(r), r.count() + 1);
+        cacheKey.clear();
     }
+    handlePadding(r);
     delete h;
 }
 
+void SearchProxy::handleMatches()
+{
+    EDBHandle *h = qobject_cast<EDBHandle*>(sender());
+    if (!h || h != findHandle)
+        return;
+
+    const EDBResult r = h->result();
+    streamed += r;
+    emit matchesFound(r);
+}
+
+void SearchProxy::handleFound()
+{
+    EDBHandle *h = qobject_cast<EDBHandle*>(sender());
+    if (!h)
+        return;
+    if (h != findHandle) {
+        // a search replaced by a newer one
+        delete h;
+        return;
+    }
+    findHandle = nullptr;
+
+    const EDBResult last = h->result();
+    delete h;
+    EDBResult r = streamed + last;
+    streamed.clear();
+    emit matchesFound(last);
+    results.insert(findKey, new EDBResult(r), r.count() + 1);
+    handleFoundData(r);
+    emit found(total_found);
+}
+
 void SearchProxy::reset()
 {
     active = false;
@@ -260,9 +269,7 @@ void SearchProxy::handleFoundData(const EDBResult &r)
     position.num = invertSearchPosition(position, direction);
     general_pos = (direction == EDB::Forward) ? 1 : total_found;
 
-    reqType = ReqPadding;
-    int r_dir = (direction == EDB::Forward) ? EDB::Backward : EDB::Forward;
-    getEDBHandle()->get(acc_, jid_, position.date, r_dir, 0, SEARCH_PADDING_SIZE);
+    requestPadding((direction == EDB::Forward) ? EDB::Backward : EDB::Forward);
 }
 
 void SearchProxy::handlePadding(const EDBResult &r)
@@ -303,6 +310,8 @@ DisplayProxy::DisplayProxy(PsiCon *p, PsiTextView *v)
     can_forward = false;
     searchParams.searchPos = 0;
     searchParams.cursorPos = -1;
+    current = nullptr;
+    pages.setMaxCost(CACHED_PAGES * (DISPLAY_PAGE_SIZE + 1));
 }
 
 void DisplayProxy::displayEarliest(const QString &acc_id, const Jid &jid)
@@ -312,7 +321,7 @@ void DisplayProxy::displayEarliest(const QString &acc_id, const Jid &jid)
     resetSearch();
     updateQueryParams(EDB::Forward, 0);
     reqType = ReqEarliest;
-    getEDBHandle()->get(acc_id, jid, QDateTime(), EDB::Forward, 0, DISPLAY_PAGE_SIZE);
+    requestPage();
 }
 
 void DisplayProxy::displayLatest(const QString &acc_id, const Jid &jid)
@@ -322,7 +331,7 @@ void DisplayProxy::displayLatest(const QString &acc_id, const Jid &jid)
     resetSearch();
     updateQueryParams(EDB::Backward, 0);
     reqType = ReqLatest;
-    getEDBHandle()->get(acc_id, jid, QDateTime(), EDB::Backward, 0, DISPLAY_PAGE_SIZE);
+    requestPage();
 }
 
 void DisplayProxy::displayFromDate(const QString &acc_id, const Jid &jid, const QDateTime date)
@@ -332,7 +341,7 @@ void DisplayProxy::displayFromDate(const QString &acc_id, const Jid &jid, const
     resetSearch();
     updateQueryParams(EDB::Forward, 0, date);
     reqType = ReqDate;
-    getEDBHandle()->get(acc_id, jid, date, EDB::Forward, 0, DISPLAY_PAGE_SIZE);
+    requestPage();
 }
 
 void DisplayProxy::displayNext()
@@ -340,7 +349,7 @@ void DisplayProxy::displayNext()
     resetSearch();
     updateQueryParams(EDB::Forward, DISPLAY_PAGE_SIZE);
     reqType = ReqNext;
-    getEDBHandle()->get(acc_, jid_, queryParams.date, queryParams.direction, queryParams.offset, DISPLAY_PAGE_SIZE);
+    requestPage();
 }
 
 void DisplayProxy::displayPrevious()
@@ -348,7 +357,64 @@ void DisplayProxy::displayPrevious()
     resetSearch();
     updateQueryParams(EDB::Backward, DISPLAY_PAGE_SIZE);
     reqType = ReqPrevious;
-    getEDBHandle()->get(acc_, jid_, queryParams.date, queryParams.direction, queryParams.offset, DISPLAY_PAGE_SIZE);
+    requestPage();
+}
+
+void DisplayProxy::clearCache()
+{
+    pages.clear();
+    prefetching.clear();
+    awaitedPage.clear();
+}
+
+/**
+ * Shows the page of queryParams. The pages next to a shown one are fetched
+ * and rendered in advance, so paging through the history usually finds its
+ * page here and doesn't wait for the database.
+ */
+void DisplayProxy::requestPage()
+{
+    awaitedPage.clear();
+    const QString key = pageKey(queryParams);
+    if (Page *page = pages.object(key)) {
+        current = nullptr;
+        const Page cached = *page; // prefetching may evict it
+        showResult(cached);
+        return;
+    }
+    foreach (const Prefetch &p, prefetching) {
+        if (p.key == key) {
+            current = nullptr;
+            awaitedPage = key;
+            return;
+        }
+    }
+    current = getEDBHandle();
+    current->get(acc_, jid_, queryParams.date, queryParams.direction, queryParams.offset, DISPLAY_PAGE_SIZE);
+}
+
+QString DisplayProxy::pageKey(const QueryParams &params) const
+{
+    return QString("%1|%2|%3|%4|%5").arg(acc_, jid_.full(), params.date.toString(Qt::ISODate))
+                                    .arg(params.direction).arg(params.offset);
+}
+
+void DisplayProxy::prefetch(int dir)
+{
+    QueryParams params = queryParams;
+    advanceQueryParams(params, dir, DISPLAY_PAGE_SIZE);
+    const QString key = pageKey(params);
+    if (key == pageKey(queryParams) || pages.contains(key))
+        return;
+    foreach (const Prefetch &p, prefetching) {
+        if (p.key == key)
+            return;
+    }
+
+    EDBHandle *h = new EDBHandle(psi->edb());
+    connect(h, SIGNAL(finished()), this, SLOT(handleResult()));
+    prefetching.insert(h, Prefetch { params, key });
+    h->get(acc_, jid_, params.date, params.direction, params.offset, DISPLAY_PAGE_SIZE);
 }
 
 bool DisplayProxy::moveSearchCursor(int dir, int n)
@@ -424,7 +490,7 @@ void DisplayProxy::displayWithSearchCursor(const QString &acc_id, const Jid &jid
     updateQueryParams(dir, 0, ts);
 
     reqType = ReqDate;
-    getEDBHandle()->get(acc_id, jid, queryParams.date, queryParams.direction, 0, DISPLAY_PAGE_SIZE);
+    requestPage();
 }
 
 bool DisplayProxy::isMessage(const QTextCursor &cursor) const
@@ -442,7 +508,43 @@ void DisplayProxy::handleResult()
     if (!h)
         return;
 
-    const EDBResult r = h->result();
+    if (prefetching.contains(h)) {
+        const Prefetch p = prefetching.take(h);
+        const QString key = p.key;
+        // pages are rendered for the contact being shown
+        if (key != pageKey(p.params)) {
+            delete h;
+            return;
+        }
+        Page page;
+        page.items = h->result();
+        page.lines = renderPage(page.items, p.params.direction);
+        pages.insert(key, new Page(page), page.items.count() + 1);
+        delete h;
+        if (key == awaitedPage) {
+            awaitedPage.clear();
+            showResult(page);
+        }
+        return;
+    }
+    if (h != current) {
+        // answers a request the view has moved on from
+        delete h;
+        return;
+    }
+    current = nullptr;
+
+    Page page;
+    page.items = h->result();
+    page.lines = renderPage(page.items, queryParams.direction);
+    pages.insert(pageKey(queryParams), new Page(page), page.items.count() + 1);
+    delete h;
+    showResult(page);
+}
+
+void DisplayProxy::showResult(const Page &page)
+{
+    const EDBResult &r = page.items;
     can_backward = true;
     can_forward  = true;
     if (r.count() < DISPLAY_PAGE_SIZE)
@@ -473,7 +575,6 @@ void DisplayProxy::handleResult()
         if (r.count() == 0)
         {
             emit updated();
-            delete h;
             return;
         }
     }
@@ -486,26 +587,31 @@ void DisplayProxy::handleResult()
     }
     switch (reqType) {
     case ReqDate:
-        displayResult(r, queryParams.direction);
+        displayResult(page);
         moveSearchCursor(searchParams.searchDir, searchParams.searchPos);
         break;
     case ReqEarliest:
         can_backward = false;
-        displayResult(r, queryParams.direction);
+        displayResult(page);
         break;
     case ReqLatest:
         can_forward = false;
         PSI_FALLSTHROUGH; // falls through
     case ReqNext:
     case ReqPrevious:
-        displayResult(r, queryParams.direction);
+        displayResult(page);
         break;
     default:
         break;
     }
-    delete h;
+
+    if (can_forward)
+        prefetch(EDB::Forward);
+    if (can_backward)
+        prefetch(EDB::Backward);
 }
 
+
 EDBHandle *DisplayProxy::getEDBHandle()
 {
     EDBHandle *h = new EDBHandle(psi->edb());
@@ -521,33 +627,39 @@ void DisplayProxy::resetSearch()
 }
 
 void DisplayProxy::updateQueryParams(int dir, int increase, QDateTime date)
+{
+    advanceQueryParams(queryParams, dir, increase, date);
+}
+
+void DisplayProxy::advanceQueryParams(QueryParams &params, int dir, int increase, const QDateTime &date)
 {
     if (increase == 0)
     {
-        queryParams.direction = dir;
-        queryParams.offset = 0;
-        queryParams.date = date;
+        params.direction = dir;
+        params.offset = 0;
+        params.date = date;
     }
-    else if (queryParams.offset != 0 || dir == queryParams.direction || !queryParams.date.isNull())
+    else if (params.offset != 0 || dir == params.direction || !params.date.isNull())
     {
-        if (dir == queryParams.direction)
-            queryParams.offset += increase;
+        if (dir == params.direction)
+            params.offset += increase;
         else
         {
-            if (queryParams.offset == 0)
-                queryParams.direction = dir;
+            if (params.offset == 0)
+                params.direction = dir;
             else
             {
-                Q_ASSERT(queryParams.offset >= increase);
-                queryParams.offset -= increase;
+                Q_ASSERT(params.offset >= increase);
+                params.offset -= increase;
             }
         }
     }
 }
 
-void DisplayProxy::displayResult(const EDBResult &r, int dir)
+// done ahead for prefetched pages, so showing one only fills the view
+QStringList DisplayProxy::renderPage(const EDBResult &r, int dir) const
 {
-    viewWid->clear();
+    QStringList lines;
     int i, d;
     if (dir == EDB::Forward)
     {
@@ -566,6 +678,12 @@ void DisplayProxy::displayResult(const EDBResult &r, int dir)
         Q_ASSERT(acc);
     }
 
+    int flags = TextUtil::Linkify;
+    if (emoticons)
+        flags |= TextUtil::Emoticons;
+    if (formatting)
+        flags |= TextUtil::LegacyFormatting;
+
     bool fAllContacts = jid_.isEmpty();
     while (i >= 0 && i < r.count())
     {
@@ -575,13 +693,7 @@ void DisplayProxy::displayResult(const EDBResult &r, int dir)
             PsiAccount *pa = (acc) ? acc : e->account();
             QString from = getNick(e->account(), e->from());
             MessageEvent::Ptr me = e.staticCast<MessageEvent>();
-            QString msg = me->message().body();
-            msg = TextUtil::linkify(TextUtil::plain2rich(msg));
-
-            if (emoticons)
-                msg = TextUtil::emoticonify(msg);
-            if (formatting)
-                msg = TextUtil::legacyFormat(msg);
+            QString msg = TextUtil::formatPlain(me->message().body(), flags);
 
             if (me->originLocal())
             {
@@ -594,10 +706,18 @@ void DisplayProxy::displayResult(const EDBResult &r, int dir)
                 msg = "<span style='color:" + receivedColor + "'>" + me->timeStamp().toString("[dd.MM.yyyy hh:mm:ss]") + " &lt;"
                     +  TextUtil::plain2rich(from) + "&gt; " + msg + "</span>";
 
-            viewWid->appendText(msg);
+            lines.append(msg);
         }
         i += d;
     }
+    return lines;
+}
+
+void DisplayProxy::displayResult(const Page &page)
+{
+    viewWid->clear();
+    foreach (const QString &msg, page.lines)
+        viewWid->appendText(msg);
     viewWid->verticalScrollBar()->setValue(viewWid->verticalScrollBar()->maximum());
     emit updated();
 }
@@ -626,6 +746,12 @@ public:
     Jid jid;
     PsiAccount *pa;
     PsiCon *psi;
+    // a contact to select once the history-only contacts are listed
+    QStringList pendingIds;
+    bool openPending;
+    // the search listed in searchResults
+    QString searchString;
+    QSet<QString> searchContacts;
 #ifndef HAVE_X11
     bool autoCopyText;
 #endif
@@ -642,6 +768,7 @@ HistoryDlg::HistoryDlg(const Jid &jid, PsiAccount *pa)
     d->psi = pa->psi();
     d->jid = jid;
     d->pa = pa;
+    d->openPending = false;
     pa->dialogRegister(this, d->jid);
 
     displayProxy = new DisplayProxy(pa->psi(), ui_.msgLog);
@@ -650,6 +777,10 @@ HistoryDlg::HistoryDlg(const Jid &jid, PsiAccount *pa)
     connect(displayProxy, SIGNAL(searchCursorMoved()), this, SLOT(updateSearchHint()));
     connect(searchProxy, SIGNAL(found(int)), this, SLOT(showFoundResult(int)));
     connect(searchProxy, SIGNAL(needRequest()), this, SLOT(startRequest()));
+    connect(searchProxy, SIGNAL(searchStarted()), this, SLOT(clearSearchResults()));
+    connect(searchProxy, SIGNAL(matchesFound(EDBResult)), this, SLOT(addSearchResults(EDBResult)));
+    connect(ui_.searchResults, SIGNAL(itemActivated(QTreeWidgetItem*,int)), SLOT(openSearchResult(QTreeWidgetItem*)));
+    ui_.searchResults->setVisible(false);
 
     //workaround calendar size
     int minWidth = ui_.calendar->minimumSizeHint().width();
@@ -710,9 +841,14 @@ HistoryDlg::HistoryDlg(const Jid &jid, PsiAccount *pa)
         _contactListModel->displayPrivateContacts((f & EDB::PrivateContacts) != 0);
         _contactListModel->displayAllContacts((f & EDB::AllContacts) != 0);
     }
+    connect(_contactListModel, SIGNAL(contactsLoaded()), SLOT(contactsLoaded()));
     _contactListModel->updateContacts(pa->psi(), getCurrentAccountId());
-    selectContact(d->pa->id(), d->jid);
+    const bool found = selectContact(d->pa->id(), d->jid);
     openSelectedContact();
+    if (!found) {
+        d->pendingIds = contactIds(d->pa->id(), d->jid);
+        d->openPending = true;
+    }
     connect(proxy, SIGNAL(layoutChanged()), ui_.contactList, SLOT(expandAll()));
 
     ui_.contactFilterEdit->setVisible(false);
@@ -810,12 +946,17 @@ void HistoryDlg::changeAccount(const QString /*accountName*/)
     openSelectedContact();
 }
 
-bool HistoryDlg::selectContact(const QString &accId, const Jid &jid)
+QStringList HistoryDlg::contactIds(const QString &accId, const Jid &jid)
 {
     QStringList ids(accId + "|" + jid.full());
     if (!jid.resource().isEmpty())
         ids.append(accId + "|" + jid.bare());
-    return selectContact(ids);
+    return ids;
+}
+
+bool HistoryDlg::selectContact(const QString &accId, const Jid &jid)
+{
+    return selectContact(contactIds(accId, jid));
 }
 
 bool HistoryDlg::selectContact(const QStringList &ids)
@@ -877,6 +1018,8 @@ void HistoryDlg::resetWidgets()
     ui_.searchField->clear();
     ui_.searchResult->setVisible(false);
     ui_.searchResult->clear();
+    ui_.searchResults->setVisible(false);
+    ui_.searchResults->clear();
 }
 
 void HistoryDlg::listAccounts()
@@ -896,6 +1039,7 @@ void HistoryDlg::listAccounts()
 
 void HistoryDlg::openSelectedContact()
 {
+    d->pendingIds.clear();
     setFilterModeEnabled(false);
     ui_.contactFilterEdit->setText("");
     QModelIndex index = ui_.contactList->selectionModel()->currentIndex();
@@ -981,6 +1125,8 @@ void HistoryDlg::removeHistory()
                     ,QMessageBox::Ok | QMessageBox::Cancel);
     if(res == QMessageBox::Ok) {
         getEDBHandle()->erase(getCurrentAccountId(), d->jid);
+        displayProxy->clearCache();
+        searchProxy->clearCache();
         QModelIndex i_index = ui_.contactList->selectionModel()->currentIndex();
         QModelIndex p_index = i_index.parent();
         QString p_id = p_index.data(HistoryContactListModel::ItemIdRole).toString();
@@ -1010,112 +1156,37 @@ void HistoryDlg::exportHistory()
     QString fname = FileUtil::getSaveFileName(this,
                           tr("Export message history"),
                           s + ".txt",
-                          tr("Text files (*.txt);;All files (*.*)"));
+                          tr("Text files (*.txt);;XML files (*.xml *.xml.gz);;JSON files (*.json *.json.gz);;All files (*.*)"));
     if(fname.isEmpty())
         return;
 
-    QFile f(fname);
-    if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
-        QMessageBox::information(this, tr("Error"), tr("Error writing to file."));
-        return;
-    }
-    QTextStream stream(&f);
-
-    EDB *edb = nullptr;
-    QString us;
-    //PsiAccount *pa = nullptr;
-    if (d->pa) {
-        edb = d->pa->edb();
-        us  = d->pa->nick();
-    } else {
-        edb = d->psi->edb();
-        us  = d->psi->contactList()->defaultAccount()->nick();
-    }
-
-    EDBHandle *h;
-    int start = 0;
-    startRequest();
-    QString paId = getCurrentAccountId();
-    int max = 0;
-    {
-        quint64 edbCnt = d->psi->edb()->eventsCount(paId, d->jid);
-        if (edbCnt > 1000) {
-            max = int(edbCnt / 1000);
-            if ((edbCnt % 1000) != 0)
-                ++max;
-            showProgress(max);
-        }
-    }
     PsiAccount *acc = nullptr;
     if ((d->psi->edb()->features() & EDB::SeparateAccounts) == 0) {
         Q_ASSERT(d->pa);
         acc = d->pa;
     }
-    while(1) {
-        h = new EDBHandle(edb);
-        h->get(paId, d->jid, QDateTime(), EDB::Forward, start, 1000);
-        while(h->busy()) {
-            qApp->processEvents();
-        }
-
-        const EDBResult r = h->result();
-        int cnt = r.count();
-
-        // events are in forward order
-        for(int i = 0; i < cnt; ++i) {
-            EDBItemPtr item = r.value(i);
-            PsiEvent::Ptr e(item->event());
-            QString txt;
-
-            QString ts = e->timeStamp().toString(Qt::LocalDate);
-
-            QString nick;
-            if (e->originLocal()) {
-                if (acc)
-                    nick = acc->nick();
-                else if (e->account())
-                    nick = e->account()->nick();
-                else
-                    nick = tr("deleted");
-            }
-            else {
-                if (!them.isEmpty())
-                    nick = them;
-                else
-                    nick = e->from().full();
-            }
-
-            if(e->type() == PsiEvent::Message) {
-                MessageEvent::Ptr me = e.staticCast<MessageEvent>();
-                stream << QString("[%1] <%2>: ").arg(ts, nick)/* << endl*/;
-
-                QStringList lines = me->message().body().split('\n', QString::KeepEmptyParts);
-                foreach(const QString& str, lines) {
-                    QStringList sub = wrapString(str, 72);
-                    foreach(const QString& str2, sub) {
-                        txt += str2 + "\n" + QString("    ");
-                    }
-                }
-            }
-            else {
-                continue;
-            }
-
-            stream << txt << endl;
-        }
-        delete h;
-
-        if (max > 0)
-            incrementProgress();
 
-        // done!
-        if(cnt == 0)
-            break;
-
-        start += 1000;
+    HistoryExport *exp = new HistoryExport(d->psi, this);
+    exp->setNicks(acc ? acc->nick() : QString(), them);
+    if (!exp->exportTo(fname, getCurrentAccountId(), d->jid)) {
+        delete exp;
+        QMessageBox::information(this, tr("Error"), tr("Error writing to file."));
+        return;
     }
-    f.close();
-    stopRequest();
+
+    startRequest();
+    quint64 edbCnt = d->psi->edb()->eventsCount(getCurrentAccountId(), d->jid);
+    if (edbCnt > 1000)
+        showProgress(int(edbCnt / 1000));
+    connect(exp, &HistoryExport::progress, this, [this](quint64 count) {
+        ui_.progressBar->setValue(int(count / 1000));
+    });
+    connect(exp, &HistoryExport::finished, this, [this, exp](bool success) {
+        exp->deleteLater();
+        stopRequest();
+        if (!success)
+            QMessageBox::information(this, tr("Error"), exp->errorString());
+    });
 }
 
 void HistoryDlg::doMenu()
@@ -1177,6 +1248,8 @@ void HistoryDlg::setLooks(QWidget *w)
 
 void HistoryDlg::refresh()
 {
+    displayProxy->clearCache();
+    searchProxy->clearCache();
     ui_.calendar->setSelectedDate(QDate::currentDate());
     ui_.searchField->clear();
     getLatest();
@@ -1224,8 +1297,27 @@ void HistoryDlg::removedContact(PsiContact *pc)
 
     contactListModel()->updateContacts(d->psi, getCurrentAccountId());
 
-    if (!cid.isEmpty() && !selectContact(QStringList(cid)))
+    if (!cid.isEmpty() && !selectContact(QStringList(cid))) {
+        // it may be one of the contacts still being listed
+        d->pendingIds = QStringList(cid);
+        d->openPending = false;
+    }
+}
+
+void HistoryDlg::contactsLoaded()
+{
+    ui_.contactList->expandAll();
+    if (d->pendingIds.isEmpty())
+        return;
+
+    const QStringList ids = d->pendingIds;
+    d->pendingIds.clear();
+    if (selectContact(ids)) {
+        if (d->openPending)
+            openSelectedContact();
+    } else if (!d->openPending) {
         resetWidgets();
+    }
 }
 
 void HistoryDlg::optionUpdated(const QString &option)
@@ -1269,6 +1361,72 @@ void HistoryDlg::showFoundResult(int rows)
         updateSearchHint();
 }
 
+// the hit with some of the text around it, on one line
+static QString matchContext(const QString &text, const QString &str)
+{
+    const int span = 40;
+    const QString plain = text.simplified();
+    const int pos = plain.indexOf(str, 0, Qt::CaseInsensitive);
+    if (pos == -1)
+        return plain.left(2 * span);
+
+    const int begin = qMax(0, pos - span);
+    const int end   = qMin(plain.length(), pos + str.length() + span);
+    QString res = plain.mid(begin, end - begin);
+    if (begin > 0)
+        res.prepend(QChar(0x2026));
+    if (end < plain.length())
+        res.append(QChar(0x2026));
+    return res;
+}
+
+void HistoryDlg::clearSearchResults()
+{
+    d->searchString = ui_.searchField->text();
+    d->searchContacts.clear();
+    ui_.searchResults->clear();
+    ui_.searchResults->setVisible(false);
+    ui_.searchResult->setText(tr("Searching..."));
+    ui_.searchResult->setVisible(true);
+}
+
+void HistoryDlg::addSearchResults(const EDBResult &r)
+{
+    QList<QTreeWidgetItem *> items;
+    foreach (const EDBItemPtr &item, r) {
+        PsiEvent::Ptr e(item->event());
+        if (e->type() != PsiEvent::Message)
+            continue;
+        MessageEvent::Ptr me = e.staticCast<MessageEvent>();
+        PsiAccount *pa = e->account();
+        UserListItem *u = pa ? pa->findFirstRelevant(e->from()) : nullptr;
+        const QString contact = (u && !u->name().trimmed().isEmpty()) ? u->name().trimmed() : e->from().full();
+        d->searchContacts.insert((pa ? pa->id() : QString()) + "|" + e->from().full());
+
+        QTreeWidgetItem *ti = new QTreeWidgetItem(QStringList() << me->timeStamp().toString("dd.MM.yyyy hh:mm:ss")
+                                                                << contact
+                                                                << matchContext(me->message().body(), d->searchString));
+        ti->setData(0, Qt::UserRole, me->timeStamp());
+        items.append(ti);
+    }
+    ui_.searchResults->addTopLevelItems(items);
+
+    const int count = ui_.searchResults->topLevelItemCount();
+    ui_.searchResults->setVisible(count > 0);
+    if (count > 0)
+        ui_.searchResult->setText(tr("%1 messages in %2 contacts").arg(count).arg(d->searchContacts.size()));
+}
+
+// one request shows the page of the hit with the cursor on it
+void HistoryDlg::openSearchResult(QTreeWidgetItem *item)
+{
+    if (!item)
+        return;
+    startRequest();
+    displayProxy->displayWithSearchCursor(getCurrentAccountId(), d->jid, item->data(0, Qt::UserRole).toDateTime(),
+                                          EDB::Forward, d->searchString, 1);
+}
+
 void HistoryDlg::updateSearchHint()
 {
     int cnt = searchProxy->totalFound();
@@ -1314,11 +1472,6 @@ void HistoryDlg::showProgress(int max)
     ui_.progressBar->setVisible(true);
 }
 
-void HistoryDlg::incrementProgress()
-{
-    ui_.progressBar->setValue(ui_.progressBar->value() + 1);
-}
-
 EDBHandle* HistoryDlg::getEDBHandle()
 {
     EDBHandle* h = new EDBHandle(d->psi->edb());
@@ -25,6 +25,8 @@
 #include "historycontactlistmodel.h"
 #include "ui_history.h"
 
+#include <QCache>
+
 class DisplayProxy;
 class PsiAccount;
 class PsiContact;
@@ -43,13 +45,20 @@ public:
     void find(const QString &str, const QString &acc_id, const XMPP::Jid &jid, int dir);
     int totalFound() const { return total_found; }
     int cursorPosition() const { return general_pos; }
+    // forget the results of earlier searches and jumps
+    void clearCache();
 
 private slots:
     void handleResult();
+    void handleMatches();
+    void handleFound();
 
 signals:
     void found(int);
     void needRequest();
+    // a new search, its hits follow in matchesFound() batches
+    void searchStarted();
+    void matchesFound(const EDBResult &);
 
 private:
     struct Position {
@@ -62,6 +71,7 @@ private:
     int  invertSearchPosition(const Position &pos, int dir);
     void handleFoundData(const EDBResult &r);
     void handlePadding(const EDBResult &r);
+    void requestPadding(int dir);
 
 private:
     int general_pos;
@@ -75,8 +85,11 @@ private:
     DisplayProxy *dp;
     QString acc_;
     XMPP::Jid jid_;
-    enum RequestType { ReqFind, ReqPadding };
-    RequestType reqType;
+    EDBHandle *findHandle;
+    EDBResult streamed; // hits of the running search
+    QString findKey;
+    QString cacheKey; // of the padding request in progress
+    QCache<QString, EDBResult> results; // found events and padding around the hits
 };
 
 class DisplayProxy : public QObject
@@ -86,10 +99,12 @@ class DisplayProxy : public QObject
 public:
     DisplayProxy(PsiCon *p, PsiTextView *v);
 
-    void setEmoticonsFlag(bool f) { emoticons = f; }
-    void setFormattingFlag(bool f) { formatting = f; }
-    void setSentColor(const QString &c) { sentColor = c; }
-    void setReceivedColor(const QString &c) { receivedColor = c; }
+    // the pages rendered ahead were rendered with the old look
+    void setEmoticonsFlag(bool f) { emoticons = f; pages.clear(); }
+    void setFormattingFlag(bool f) { formatting = f; pages.clear(); }
+    void setSentColor(const QString &c) { sentColor = c; pages.clear(); }
+    void setReceivedColor(const QString &c) { receivedColor = c; pages.clear(); }
+    void clearCache();
 
     bool canBackward() const { return can_backward; }
     bool canForward() const { return can_forward; }
@@ -111,20 +126,37 @@ signals:
     void searchCursorMoved();
 
 private:
+    struct QueryParams {
+        int       direction;
+        int       offset;
+        QDateTime date;
+    };
+    // a page of events with its messages rendered in display order
+    struct Page {
+        EDBResult   items;
+        QStringList lines;
+    };
+    struct Prefetch {
+        QueryParams params;
+        QString     key; // of the contact shown when it was requested
+    };
+
     EDBHandle* getEDBHandle();
     void resetSearch();
     void updateQueryParams(int dir, int increase, QDateTime date = QDateTime());
-    void displayResult(const EDBResult &r, int dir);
+    static void advanceQueryParams(QueryParams &params, int dir, int increase, const QDateTime &date = QDateTime());
+    QString pageKey(const QueryParams &params) const;
+    void requestPage();
+    void showResult(const Page &page);
+    void prefetch(int dir);
+    QStringList renderPage(const EDBResult &r, int dir) const;
+    void displayResult(const Page &page);
     QString getNick(PsiAccount *pa, const XMPP::Jid &jid) const;
 
 private:
     QString acc_;
     XMPP::Jid jid_;
-    struct {
-        int       direction;
-        int       offset;
-        QDateTime date;
-    } queryParams;
+    QueryParams queryParams;
     struct {
         int     searchPos;
         int     cursorPos;
@@ -141,6 +173,10 @@ private:
     bool can_forward;
     QString sentColor;
     QString receivedColor;
+    EDBHandle *current;
+    QCache<QString, Page> pages;               // pages fetched and rendered ahead
+    QHash<EDBHandle *, Prefetch> prefetching;
+    QString awaitedPage;                       // a page being prefetched the view waits for
 };
 
 class HistoryDlg : public AdvancedWidget<QDialog>
@@ -168,12 +204,16 @@ private slots:
     void openChat();
     void doMenu();
     void removedContact(PsiContact*);
+    void contactsLoaded();
     void optionUpdated(const QString& option);
 #ifndef HAVE_X11
     void autoCopy();
 #endif
     void viewUpdated();
     void showFoundResult(int rows);
+    void clearSearchResults();
+    void addSearchResults(const EDBResult &r);
+    void openSearchResult(QTreeWidgetItem *item);
     void updateSearchHint();
     void startRequest();
 
@@ -190,7 +230,7 @@ private:
     UserListItem* currentUserListItem() const;
     void stopRequest();
     void showProgress(int max);
-    void incrementProgress();
+    static QStringList contactIds(const QString &accId, const Jid &jid);
     bool selectContact(const QString &accId, const Jid &jid);
     bool selectContact(const QStringList &ids);
     void selectDefaultContact(const QModelIndex &prefer_parent = QModelIndex(), int prefer_row = 0);
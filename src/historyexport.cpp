@@ -0,0 +1,708 @@
+/*
+ * historyexport.cpp - streamed export and import of the message history
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "historyexport.h"
+
+#include "edbsqlite.h"
+#include "eventdb.h"
+#include "psiaccount.h"
+#include "psicon.h"
+#include "psicontactlist.h"
+#include "psievent.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QTimer>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include <climits>
+#include <cstring>
+#include <zlib.h>
+
+static const int pageSize  = 1000; // events per EDB request
+static const int maxWrites = 16;   // outstanding appendBatch() requests while importing
+
+static QString getNext(QString *str)
+{
+    int n = 0;
+    // skip leading spaces (but *do* return them later!)
+    while(n < int(str->length()) && str->at(n).isSpace()) {
+        ++n;
+    }
+    if(n == int(str->length())) {
+        return QString();
+    }
+    // find end or next space
+    while(n < int(str->length()) && !str->at(n).isSpace()) {
+        ++n;
+    }
+    QString result = str->mid(0, n);
+    *str = str->mid(n);
+    return result;
+}
+
+// wraps a string against a fixed width
+static QStringList wrapString(const QString &str, int wid)
+{
+    QStringList lines;
+    QString cur;
+    QString tmp = str;
+    while(1) {
+        QString word = getNext(&tmp);
+        if(word == QString()) {
+            lines += cur;
+            break;
+        }
+        if(!cur.isEmpty()) {
+            if(int(cur.length()) + int(word.length()) > wid) {
+                lines += cur;
+                cur = "";
+            }
+        }
+        if(cur.isEmpty()) {
+            // trim the whitespace in front
+            for(int n = 0; n < int(word.length()); ++n) {
+                if(!word.at(n).isSpace()) {
+                    if(n > 0) {
+                        word = word.mid(n);
+                    }
+                    break;
+                }
+            }
+        }
+        cur += word;
+    }
+    return lines;
+}
+
+//----------------------------------------------------------------------------
+// GzipDevice - sequential gzip (de)compression on top of another device
+//----------------------------------------------------------------------------
+
+class GzipDevice : public QIODevice
+{
+public:
+    GzipDevice(QIODevice *device) : device_(device)
+    {
+        memset(&zs_, 0, sizeof(zs_));
+    }
+
+    ~GzipDevice()
+    {
+        close();
+    }
+
+    bool isSequential() const { return true; }
+
+    bool open(OpenMode mode)
+    {
+        int ret;
+        if (mode & WriteOnly) {
+            ret = deflateInit2(&zs_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        } else {
+            ret = inflateInit2(&zs_, 15 + 32); // gzip or zlib header
+        }
+        if (ret != Z_OK) {
+            setErrorString(QString::fromLatin1(zs_.msg ? zs_.msg : "zlib initialization failed"));
+            return false;
+        }
+        eof_ = false;
+        buffer_.resize(64 * 1024);
+        return QIODevice::open(mode);
+    }
+
+    void close()
+    {
+        if (!isOpen()) {
+            return;
+        }
+        if (openMode() & WriteOnly) {
+            deflateData(nullptr, 0, Z_FINISH);
+            deflateEnd(&zs_);
+        } else {
+            inflateEnd(&zs_);
+        }
+        QIODevice::close();
+    }
+
+    bool atEnd() const
+    {
+        return eof_ && QIODevice::atEnd();
+    }
+
+    bool failed() const
+    {
+        return failed_;
+    }
+
+protected:
+    qint64 writeData(const char *data, qint64 len)
+    {
+        return deflateData(data, len, Z_NO_FLUSH) ? len : -1;
+    }
+
+    qint64 readData(char *data, qint64 maxlen)
+    {
+        if (eof_) {
+            return -1;
+        }
+        zs_.next_out  = reinterpret_cast<Bytef *>(data);
+        zs_.avail_out = uInt(qMin<qint64>(maxlen, INT_MAX));
+        const uInt wanted = zs_.avail_out;
+        while (zs_.avail_out == wanted) {
+            if (zs_.avail_in == 0) {
+                qint64 n = device_->read(buffer_.data(), buffer_.size());
+                if (n <= 0) {
+                    eof_ = true; // truncated stream ends here
+                    break;
+                }
+                zs_.next_in  = reinterpret_cast<Bytef *>(buffer_.data());
+                zs_.avail_in = uInt(n);
+            }
+            int ret = inflate(&zs_, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                eof_ = true;
+                break;
+            }
+            if (ret != Z_OK) {
+                setErrorString(QString::fromLatin1(zs_.msg ? zs_.msg : "corrupt gzip stream"));
+                failed_ = true;
+                return -1;
+            }
+        }
+        qint64 produced = qint64(wanted - zs_.avail_out);
+        return (produced == 0 && eof_) ? -1 : produced;
+    }
+
+private:
+    bool deflateData(const char *data, qint64 len, int flush)
+    {
+        zs_.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs_.avail_in = uInt(len);
+        int ret;
+        do {
+            zs_.next_out  = reinterpret_cast<Bytef *>(buffer_.data());
+            zs_.avail_out = uInt(buffer_.size());
+            ret = deflate(&zs_, flush);
+            if (ret == Z_STREAM_ERROR) {
+                failed_ = true;
+                return false;
+            }
+            qint64 have = buffer_.size() - zs_.avail_out;
+            if (have > 0 && device_->write(buffer_.constData(), have) != have) {
+                setErrorString(device_->errorString());
+                failed_ = true;
+                return false;
+            }
+        } while (zs_.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+        return true;
+    }
+
+    QIODevice *device_;
+    z_stream zs_;
+    QByteArray buffer_;
+    bool eof_ = false;
+    bool failed_ = false;
+};
+
+//----------------------------------------------------------------------------
+// HistoryExport
+//----------------------------------------------------------------------------
+
+class HistoryExport::Private
+{
+public:
+    PsiCon *psi;
+    EDB *edb;
+    Format format = PlainText;
+    bool active = false;
+    bool importing = false;
+    QString accId;
+    XMPP::Jid jid;
+    QString localNick;
+    QString remoteNick;
+    QString error;
+    quint64 count = 0;
+
+    QFile file;
+    GzipDevice *gzip = nullptr;
+    QIODevice *dev = nullptr;
+    QTextStream *text = nullptr;
+    QXmlStreamWriter *xmlWriter = nullptr;
+    QXmlStreamReader *xmlReader = nullptr;
+
+    // export
+    EDBHandle *handle = nullptr;
+    int start = 0;
+
+    // import
+    QString batchAccId;
+    XMPP::Jid batchJid;
+    int batchType = EDB::Contact;
+    QList<PsiEvent::Ptr> batch;
+    int pendingWrites = 0;
+    int lineNo = 0;
+    bool eof = false;
+    bool readScheduled = false;
+
+    bool openFile(const QString &fileName, QIODevice::OpenMode mode)
+    {
+        file.setFileName(fileName);
+        bool compressed = fileName.endsWith(".gz", Qt::CaseInsensitive);
+        if (!compressed && format == PlainText) {
+            mode |= QIODevice::Text;
+        }
+        if (!file.open(mode)) {
+            error = file.errorString();
+            return false;
+        }
+        dev = &file;
+        if (compressed) {
+            gzip = new GzipDevice(&file);
+            if (!gzip->open(mode)) {
+                error = gzip->errorString();
+                closeFile();
+                return false;
+            }
+            dev = gzip;
+        }
+        return true;
+    }
+
+    void closeFile()
+    {
+        delete xmlReader;
+        xmlReader = nullptr;
+        delete xmlWriter;
+        xmlWriter = nullptr;
+        delete text;
+        text = nullptr;
+        delete gzip;
+        gzip = nullptr;
+        file.close();
+        dev = nullptr;
+    }
+
+    void writeEvent(const PsiEvent::Ptr &e)
+    {
+        if (e->type() != PsiEvent::Message) {
+            return;
+        }
+        const Message &m = e.staticCast<MessageEvent>()->message();
+        const QString acc = e->account() ? e->account()->id() : accId;
+        const QString dir = e->originLocal() ? "out" : "in";
+
+        switch (format) {
+        case PlainText: {
+            QString nick;
+            if (e->originLocal()) {
+                if (!localNick.isEmpty())
+                    nick = localNick;
+                else if (e->account())
+                    nick = e->account()->nick();
+                else
+                    nick = HistoryExport::tr("deleted");
+            } else {
+                nick = remoteNick.isEmpty() ? e->from().full() : remoteNick;
+            }
+            *text << '[' << e->timeStamp().toString(Qt::LocalDate) << "] <" << nick << ">: ";
+            foreach (const QString &str, m.body().split('\n', QString::KeepEmptyParts)) {
+                foreach (const QString &str2, wrapString(str, 72)) {
+                    *text << str2 << "\n    ";
+                }
+            }
+            *text << '\n';
+            break;
+        }
+        case Xml:
+            xmlWriter->writeStartElement("message");
+            xmlWriter->writeAttribute("account", acc);
+            xmlWriter->writeAttribute("jid", e->from().full());
+            xmlWriter->writeAttribute("time", m.timeStamp().toUTC().toString(Qt::ISODate));
+            xmlWriter->writeAttribute("dir", dir);
+            if (!m.type().isEmpty())
+                xmlWriter->writeAttribute("type", m.type());
+            if (!m.lang().isEmpty())
+                xmlWriter->writeAttribute("lang", m.lang());
+            if (!m.subject().isEmpty())
+                xmlWriter->writeTextElement("subject", m.subject());
+            xmlWriter->writeTextElement("body", m.body());
+            xmlWriter->writeEndElement();
+            break;
+        case Json: {
+            QJsonObject o;
+            o["account"] = acc;
+            o["jid"]     = e->from().full();
+            o["time"]    = m.timeStamp().toUTC().toString(Qt::ISODate);
+            o["dir"]     = dir;
+            if (!m.type().isEmpty())
+                o["type"] = m.type();
+            if (!m.lang().isEmpty())
+                o["lang"] = m.lang();
+            if (!m.subject().isEmpty())
+                o["subject"] = m.subject();
+            o["body"] = m.body();
+            dev->write(QJsonDocument(o).toJson(QJsonDocument::Compact));
+            dev->write("\n", 1);
+            break;
+        }
+        }
+    }
+
+    bool writeFailed() const
+    {
+        if (text && text->status() != QTextStream::Ok)
+            return true;
+        if (xmlWriter && xmlWriter->hasError())
+            return true;
+        return (gzip && gzip->failed()) || file.error() != QFileDevice::NoError;
+    }
+
+    PsiEvent::Ptr makeEvent(const QString &acc, const QString &from, const QString &time, const QString &dir,
+                            const QString &type, const QString &lang, const QString &subject, const QString &body)
+    {
+        Message m;
+        m.setFrom(XMPP::Jid(from));
+        m.setTimeStamp(QDateTime::fromString(time, Qt::ISODate).toLocalTime());
+        m.setType(type);
+        m.setLang(lang);
+        m.setSubject(subject);
+        m.setBody(body);
+        m.setSpooled(true);
+        MessageEvent::Ptr me(new MessageEvent(m, psi->contactList()->getAccount(acc)));
+        me->setOriginLocal(dir == "out");
+        return me.staticCast<PsiEvent>();
+    }
+
+    // reads the next message; false at the end of input or on error
+    bool readEvent(QString *acc, PsiEvent::Ptr *e)
+    {
+        if (format == Json) {
+            while (!dev->atEnd()) {
+                QByteArray line = dev->readLine();
+                ++lineNo;
+                if (line.trimmed().isEmpty())
+                    continue;
+                QJsonParseError err;
+                QJsonObject o = QJsonDocument::fromJson(line, &err).object();
+                if (err.error != QJsonParseError::NoError) {
+                    error = HistoryExport::tr("Malformed record at line %1").arg(lineNo);
+                    return false;
+                }
+                *acc = o.value("account").toString();
+                *e = makeEvent(*acc, o.value("jid").toString(), o.value("time").toString(), o.value("dir").toString(),
+                               o.value("type").toString(), o.value("lang").toString(), o.value("subject").toString(),
+                               o.value("body").toString());
+                return true;
+            }
+            return false;
+        }
+
+        while (!xmlReader->atEnd()) {
+            if (xmlReader->readNext() != QXmlStreamReader::StartElement || xmlReader->name() != QLatin1String("message"))
+                continue;
+            const QXmlStreamAttributes attrs = xmlReader->attributes();
+            QString subject, body;
+            while (xmlReader->readNextStartElement()) {
+                if (xmlReader->name() == QLatin1String("subject"))
+                    subject = xmlReader->readElementText();
+                else if (xmlReader->name() == QLatin1String("body"))
+                    body = xmlReader->readElementText();
+                else
+                    xmlReader->skipCurrentElement();
+            }
+            *acc = attrs.value("account").toString();
+            *e = makeEvent(*acc, attrs.value("jid").toString(), attrs.value("time").toString(),
+                           attrs.value("dir").toString(), attrs.value("type").toString(),
+                           attrs.value("lang").toString(), subject, body);
+            return true;
+        }
+        if (xmlReader->hasError()) {
+            error = xmlReader->errorString();
+        }
+        return false;
+    }
+};
+
+HistoryExport::HistoryExport(PsiCon *psi, QObject *parent) :
+    QObject(parent),
+    d(new Private)
+{
+    d->psi = psi;
+    d->edb = psi->edb();
+}
+
+HistoryExport::~HistoryExport()
+{
+    cancel();
+    delete d;
+}
+
+HistoryExport::Format HistoryExport::formatForFile(const QString &fileName)
+{
+    QString name = fileName.toLower();
+    if (name.endsWith(".gz"))
+        name.chop(3);
+    if (name.endsWith(".xml"))
+        return Xml;
+    if (name.endsWith(".json") || name.endsWith(".jsonl"))
+        return Json;
+    return PlainText;
+}
+
+void HistoryExport::setNicks(const QString &localNick, const QString &remoteNick)
+{
+    d->localNick  = localNick;
+    d->remoteNick = remoteNick;
+}
+
+bool HistoryExport::isActive() const
+{
+    return d->active;
+}
+
+QString HistoryExport::errorString() const
+{
+    return d->error;
+}
+
+bool HistoryExport::exportTo(const QString &fileName, const QString &accId, const XMPP::Jid &jid)
+{
+    if (d->active)
+        return false;
+
+    d->format    = formatForFile(fileName);
+    d->importing = false;
+    d->accId     = accId;
+    d->jid       = jid;
+    d->error.clear();
+    d->count = 0;
+    d->start = 0;
+    if (!d->openFile(fileName, QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    if (d->format == Xml) {
+        d->xmlWriter = new QXmlStreamWriter(d->dev);
+        d->xmlWriter->setAutoFormatting(true);
+        d->xmlWriter->writeStartDocument();
+        d->xmlWriter->writeStartElement("history");
+        d->xmlWriter->writeAttribute("version", "1");
+    } else if (d->format == PlainText) {
+        d->text = new QTextStream(d->dev);
+        d->text->setCodec("UTF-8");
+    }
+
+    d->active = true;
+    QTimer::singleShot(0, this, SLOT(requestPage()));
+    return true;
+}
+
+/**
+ * The DB is read page by page and every page is written out before the
+ * next one is requested. EDBSqLite remembers where a sequential read
+ * stopped, so a page costs the same at the end of a big archive as at the
+ * beginning.
+ */
+void HistoryExport::requestPage()
+{
+    if (!d->active)
+        return;
+    d->handle = new EDBHandle(d->edb);
+    connect(d->handle, SIGNAL(finished()), SLOT(pageReady()));
+    d->handle->get(d->accId, d->jid, QDateTime(), EDB::Forward, d->start, pageSize);
+}
+
+void HistoryExport::pageReady()
+{
+    EDBHandle *h = static_cast<EDBHandle *>(sender());
+    if (h != d->handle)
+        return;
+    d->handle = nullptr;
+    h->deleteLater();
+
+    const EDBResult r = h->result();
+    foreach (const EDBItemPtr &item, r) {
+        d->writeEvent(item->event());
+    }
+    d->count += quint64(r.count());
+    emit progress(d->count);
+
+    if (d->writeFailed()) {
+        d->error = tr("Error writing to file.");
+        finish();
+        return;
+    }
+    if (r.isEmpty()) {
+        if (d->xmlWriter) {
+            d->xmlWriter->writeEndElement();
+            d->xmlWriter->writeEndDocument();
+        }
+        if (d->text)
+            d->text->flush();
+        finish();
+        return;
+    }
+    d->start += pageSize;
+    QTimer::singleShot(0, this, SLOT(requestPage())); // flat file EDB answers synchronously; don't recurse
+}
+
+bool HistoryExport::importFrom(const QString &fileName)
+{
+    if (d->active)
+        return false;
+
+    d->format    = formatForFile(fileName);
+    d->importing = true;
+    d->error.clear();
+    d->count         = 0;
+    d->lineNo        = 0;
+    d->pendingWrites = 0;
+    d->eof           = false;
+    d->batch.clear();
+    if (d->format == PlainText) {
+        d->error = tr("Plain text history can not be imported.");
+        return false;
+    }
+    if (!d->openFile(fileName, QIODevice::ReadOnly))
+        return false;
+    if (d->format == Xml)
+        d->xmlReader = new QXmlStreamReader(d->dev);
+
+    EDBSqLite *sqlite = qobject_cast<EDBSqLite *>(d->edb);
+    if (sqlite)
+        sqlite->setInsertingMode(EDBSqLite::Import);
+
+    d->active        = true;
+    d->readScheduled = false;
+    scheduleRead();
+    return true;
+}
+
+/**
+ * Reads a page of records and hands it to the DB in per-contact batches.
+ * Reading pauses while maxWrites batches are queued, which keeps memory
+ * flat when the file can be parsed faster than the DB can store it.
+ */
+void HistoryExport::readRecords()
+{
+    d->readScheduled = false;
+    if (!d->active)
+        return;
+
+    for (int n = 0; n < pageSize && d->pendingWrites < maxWrites; ++n) {
+        QString acc;
+        PsiEvent::Ptr e;
+        if (!d->readEvent(&acc, &e)) {
+            d->eof = true;
+            break;
+        }
+        int type = e.staticCast<MessageEvent>()->message().type() == "groupchat" ? EDB::GroupChatContact : EDB::Contact;
+        if (!d->batch.isEmpty()
+            && (d->batch.size() >= pageSize || acc != d->batchAccId || type != d->batchType
+                || e->from().full() != d->batchJid.full())) {
+            flushBatch();
+        }
+        if (d->batch.isEmpty()) {
+            d->batchAccId = acc;
+            d->batchJid   = e->from();
+            d->batchType  = type;
+        }
+        d->batch.append(e);
+    }
+
+    if (d->eof) {
+        flushBatch();
+        if (d->pendingWrites == 0)
+            finish();
+    } else if (d->pendingWrites < maxWrites) {
+        scheduleRead();
+    }
+}
+
+void HistoryExport::writeFinished()
+{
+    EDBHandle *h = static_cast<EDBHandle *>(sender());
+    h->deleteLater();
+    if (!d->active)
+        return;
+    --d->pendingWrites;
+    if (!h->writeSuccess() && d->error.isEmpty()) {
+        d->error = tr("Error writing to the history database.");
+        d->eof   = true; // stop reading, wait for the rest
+    }
+
+    if (!d->eof)
+        scheduleRead();
+    else if (d->pendingWrites == 0)
+        finish();
+}
+
+void HistoryExport::flushBatch()
+{
+    if (d->batch.isEmpty())
+        return;
+    EDBHandle *h = new EDBHandle(d->edb);
+    h->setParent(this);
+    connect(h, SIGNAL(finished()), SLOT(writeFinished()));
+    ++d->pendingWrites;
+    d->count += quint64(d->batch.size());
+    QList<PsiEvent::Ptr> batch;
+    batch.swap(d->batch);
+    h->appendBatch(d->batchAccId, d->batchJid, batch, d->batchType);
+    emit progress(d->count);
+}
+
+void HistoryExport::scheduleRead()
+{
+    if (!d->readScheduled) {
+        d->readScheduled = true;
+        QTimer::singleShot(0, this, SLOT(readRecords()));
+    }
+}
+
+void HistoryExport::finish()
+{
+    d->active = false;
+    d->closeFile();
+    if (d->importing) {
+        EDBSqLite *sqlite = qobject_cast<EDBSqLite *>(d->edb);
+        if (sqlite)
+            sqlite->setInsertingMode(EDBSqLite::Normal);
+    }
+    emit finished(d->error.isEmpty());
+}
+
+void HistoryExport::cancel()
+{
+    if (!d->active)
+        return;
+    d->active = false;
+    delete d->handle;
+    d->handle = nullptr;
+    d->batch.clear();
+    d->closeFile();
+    if (d->importing) {
+        EDBSqLite *sqlite = qobject_cast<EDBSqLite *>(d->edb);
+        if (sqlite)
+            sqlite->setInsertingMode(EDBSqLite::Normal);
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * historyexport.h - streamed export and import of the message history
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTORYEXPORT_H
+#define HISTORYEXPORT_H
+
+#include "xmpp_jid.h"
+
+#include <QObject>
+
+class PsiCon;
+
+/**
+ * Copies history between the EDB and a file one page at a time, so memory
+ * use does not depend on the size of the archive. The format is picked from
+ * the file name: .txt (export only), .xml or .json (one message per line),
+ * each optionally followed by .gz.
+ */
+class HistoryExport : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format { PlainText, Xml, Json };
+
+    HistoryExport(PsiCon *psi, QObject *parent = nullptr);
+    ~HistoryExport();
+
+    static Format formatForFile(const QString &fileName);
+
+    // names used by the plain text format; empty means account nick / contact jid
+    void setNicks(const QString &localNick, const QString &remoteNick);
+
+    // empty accId / jid select all accounts / contacts, as in EDB::get()
+    bool exportTo(const QString &fileName, const QString &accId, const XMPP::Jid &jid);
+    bool importFrom(const QString &fileName);
+    void cancel();
+
+    bool isActive() const;
+    QString errorString() const;
+
+signals:
+    void progress(quint64 messages);
+    void finished(bool success);
+
+private slots:
+    void requestPage();
+    void pageReady();
+    void readRecords();
+    void writeFinished();
+
+private:
+    void flushBatch();
+    void finish();
+    void scheduleRead();
+
+    class Private;
+    Private *d;
+};
+
+#endif // HISTORYEXPORT_H
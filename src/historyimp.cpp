@@ -29,15 +29,22 @@
 #include <QDir>
 #include <QLayout>
 #include <QMessageBox>
+#include <QSet>
+#include <QThread>
 #include <QTimer>
+#include <QtConcurrentRun>
+
+#define IMPORT_BATCH_SIZE      1000
+#define IMPORT_MAX_WRITES      16
+#define IMPORT_CHECKPOINT_MSEC 5000
 
 HistoryImport::HistoryImport(PsiCon *psi) : QObject(),
     psi_(psi),
     srcEdb(nullptr),
     dstEdb(nullptr),
     hErase(nullptr),
-    hRead(nullptr),
-    hWrite(nullptr),
+    resumed(false),
+    importedCount(0),
     active(false),
     result_(ResultNone),
     recordsCount(0),
@@ -79,18 +86,16 @@ void HistoryImport::clear()
         delete hErase;
         hErase = nullptr;
     }
-    if (hRead) {
-        delete hRead;
-        hRead = nullptr;
-    }
+    // running parsers only use static functions, so they may safely finish on their own
+    qDeleteAll(parsing.keys());
+    parsing.clear();
+    qDeleteAll(writing.keys());
+    writing.clear();
+    pendingWrites.clear();
     if (srcEdb) {
         delete srcEdb;
         srcEdb = nullptr;
     }
-    if (hWrite) {
-        delete hWrite;
-        hWrite = nullptr;
-    }
     if (dlg) {
         delete dlg;
         dlg = nullptr;
@@ -110,8 +115,15 @@ int HistoryImport::exec()
     if (!srcEdb)
         srcEdb = new EDBFlatFile(psi_);
 
+    // contacts completed by an interrupted import are not imported again
+    doneContacts = dstEdb->getStorageParam("import_done").split('\n', QString::SkipEmptyParts);
+    resumed = !doneContacts.isEmpty();
+    const QSet<QString> done = doneContacts.toSet();
+
     foreach (const EDB::ContactItem &ci, srcEdb->contacts(QString(), EDB::Contact)) {
         const XMPP::Jid &jid = ci.jid;
+        if (done.contains(jid.full()))
+            continue;
         QStringList accIds;
         foreach (PsiAccount *acc, psi_->contactList()->accounts()) {
             foreach (PsiContact *contact, acc->contactList()) {
@@ -142,16 +154,20 @@ void HistoryImport::stop(int reason)
     stopTime = QDateTime::currentDateTime();
     result_ = reason;
     if (reason == ResultNormal) {
+        dstEdb->setStorageParam("import_done", QString());
         dstEdb->setStorageParam("import_start", QString());
         int sec = importDuration();
         int min = sec / 60;
         sec = sec % 60;
         qWarning("%s", QString("Import is finished. Duration is %1 min. %2 sec.").arg(min).arg(sec).toUtf8().constData());
     }
-    else if (reason == ResultCancel)
-        qWarning("Import canceled");
-    else
-        qWarning("Import error");
+    else {
+        saveCheckpoint();
+        if (reason == ResultCancel)
+            qWarning("Import canceled");
+        else
+            qWarning("Import error");
+    }
 
     active = false;
     emit finished(reason);
@@ -162,63 +178,112 @@ int HistoryImport::importDuration()
     return int(startTime.secsTo(stopTime));
 }
 
-void HistoryImport::readFromFiles()
+/*
+ * Keeps up to idealThreadCount() flat files being parsed on the thread pool
+ * while the parsed events are written to SQLite in large batches.
+ */
+void HistoryImport::schedule()
 {
     if (!active)
         return;
-    if (hWrite != nullptr) {
-        if (!hWrite->writeSuccess()) {
-            stop(ResultError); // Write error
+    if (hErase) {
+        if (hErase->busy())
+            return;
+        const bool ok = hErase->writeSuccess();
+        hErase->deleteLater();
+        hErase = nullptr;
+        if (!ok) {
+            stop(ResultError);
             return;
         }
     }
-    else if (hErase != nullptr && !hErase->writeSuccess()) {
-        stop(ResultError);
-        return;
+
+    const int maxParsers = qMax(1, QThread::idealThreadCount());
+    while (!importList.isEmpty() && parsing.size() < maxParsers && writing.size() < IMPORT_MAX_WRITES) {
+        const ImportItem item = importList.takeFirst();
+        qWarning("%s", QString("Importing %1").arg(JIDUtil::toString(item.jid, true)).toUtf8().constData());
+        ImportParseWatcher *watcher = new ImportParseWatcher(this);
+        connect(watcher, SIGNAL(finished()), SLOT(parseFinished()));
+        parsing.insert(watcher, item);
+        watcher->setFuture(QtConcurrent::run(EDBFlatFile::File::readEvents, item.jid));
     }
-    if (importList.isEmpty()) {
+
+    if (importList.isEmpty() && parsing.isEmpty() && writing.isEmpty())
         stop(ResultNormal);
+}
+
+void HistoryImport::parseFinished()
+{
+    ImportParseWatcher *watcher = static_cast<ImportParseWatcher *>(sender());
+    if (!active || !parsing.contains(watcher))
         return;
+    const ImportItem item = parsing.take(watcher);
+    const QList<PsiEvent::Ptr> events = watcher->result();
+    watcher->deleteLater();
+
+    const QString key = item.jid.full();
+    foreach (const QString &accId, item.accIds) {
+        if (resumed) {
+            // drop whatever an interrupted import has managed to write for this contact
+            EDBHandle *h = new EDBHandle(dstEdb);
+            connect(h, SIGNAL(finished()), SLOT(writeFinished()));
+            writing.insert(h, qMakePair(key, 0));
+            ++pendingWrites[key];
+            h->erase(accId, item.jid);
+        }
+        for (int i = 0; i < events.size(); i += IMPORT_BATCH_SIZE) {
+            const QList<PsiEvent::Ptr> batch = events.mid(i, IMPORT_BATCH_SIZE);
+            EDBHandle *h = new EDBHandle(dstEdb);
+            connect(h, SIGNAL(finished()), SLOT(writeFinished()));
+            writing.insert(h, qMakePair(key, batch.size()));
+            ++pendingWrites[key];
+            h->appendBatch(accId, item.jid, batch, EDB::Contact);
+        }
     }
-    if (hRead == nullptr) {
-        hRead = new EDBHandle(srcEdb);
-        connect(hRead, SIGNAL(finished()), this, SLOT(writeToSqlite()));
-    }
+    if (pendingWrites.value(key) == 0)
+        contactDone(key);
 
-    const ImportItem &item = importList.first();
-    int start = item.startNum;
-    if (start == 0)
-        qWarning("%s", QString("Importing %1").arg(JIDUtil::toString(item.jid, true)).toUtf8().constData());
-    --recordsCount;
-    if (dlg && (recordsCount % 100) == 0)
-        progressBar->setValue(progressBar->value() + 1);
-    hRead->get(item.accIds.first(), item.jid, QDateTime(), EDB::Forward, start, 1);
+    schedule();
 }
 
-void HistoryImport::writeToSqlite()
+void HistoryImport::writeFinished()
 {
-    if (!active)
-        return;
-    const EDBResult r = hRead->result();
-    if (hRead->lastRequestType() != EDBHandle::Read || r.size() > 1) {
-        stop(ResultError);
+    EDBHandle *h = static_cast<EDBHandle *>(sender());
+    if (!active || !writing.contains(h))
         return;
-    }
-    if (r.isEmpty()) {
-        importList.first().accIds.removeFirst();
-        if (importList.first().accIds.isEmpty())
-            importList.removeFirst();
-        QTimer::singleShot(0, this, SLOT(readFromFiles()));
+    const QPair<QString, int> info = writing.take(h);
+    const bool ok = h->writeSuccess();
+    h->deleteLater();
+    if (!ok) {
+        stop(ResultError); // Write error
         return;
     }
-    if (hWrite == nullptr) {
-        hWrite = new EDBHandle(dstEdb);
-        connect(hWrite, SIGNAL(finished()), this, SLOT(readFromFiles()));
+
+    importedCount += quint64(info.second);
+    if (dlg)
+        progressBar->setValue(int(importedCount / 100));
+    if (--pendingWrites[info.first] == 0) {
+        pendingWrites.remove(info.first);
+        contactDone(info.first);
     }
-    EDBItemPtr it = r.first();
-    ImportItem &item = importList.first();
-    hWrite->append(item.accIds.first(), item.jid, it->event(), EDB::Contact);
-    item.startNum += 1;
+
+    schedule();
+}
+
+void HistoryImport::contactDone(const QString &key)
+{
+    doneContacts.append(key);
+    if (!checkpointTimer.isValid() || checkpointTimer.elapsed() >= IMPORT_CHECKPOINT_MSEC)
+        saveCheckpoint();
+}
+
+// Storing a parameter commits all the records written so far
+void HistoryImport::saveCheckpoint()
+{
+    if (!dstEdb || doneContacts.isEmpty())
+        return;
+    dstEdb->setStorageParam("import_done", doneContacts.join('\n'));
+    checkpointTimer.start();
 }
 
 void HistoryImport::showDialog()
@@ -286,9 +351,15 @@ void HistoryImport::start()
     progressBar->setValue(0);
 
     lbStatus->setText(tr("Import"));
-    hErase = new EDBHandle(dstEdb);
-    connect(hErase, SIGNAL(finished()), this, SLOT(readFromFiles()));
-    hErase->erase(QString(), QString());
+    checkpointTimer.start();
+    if (resumed) {
+        QTimer::singleShot(0, this, SLOT(schedule()));
+    }
+    else {
+        hErase = new EDBHandle(dstEdb);
+        connect(hErase, SIGNAL(finished()), this, SLOT(schedule()));
+        hErase->erase(QString(), QString());
+    }
     while (active)
         qApp->processEvents();
     if (result_ == ResultNormal)
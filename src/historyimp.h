@@ -26,6 +26,8 @@
 #include "xmpp/jid/jid.h"
 
 #include <QDialog>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QLabel>
 #include <QObject>
 #include <QProgressBar>
@@ -36,10 +38,11 @@ struct ImportItem
 {
     QStringList   accIds;
     XMPP::Jid     jid;
-    int           startNum;
-    ImportItem(const QStringList &ids, const XMPP::Jid &j) { accIds = ids; jid = j; startNum = 0; }
+    ImportItem(const QStringList &ids, const XMPP::Jid &j) { accIds = ids; jid = j; }
 };
 
+typedef QFutureWatcher<QList<PsiEvent::Ptr> > ImportParseWatcher;
+
 class HistoryImport : public QObject
 {
     Q_OBJECT
@@ -58,8 +61,13 @@ private:
     EDB *srcEdb;
     EDB *dstEdb;
     EDBHandle *hErase;
-    EDBHandle *hRead;
-    EDBHandle *hWrite;
+    QHash<ImportParseWatcher*, ImportItem> parsing;
+    QHash<EDBHandle*, QPair<QString, int> > writing; // handle -> (contact, number of records)
+    QHash<QString, int> pendingWrites;
+    QStringList doneContacts;
+    QElapsedTimer checkpointTimer;
+    bool resumed;
+    quint64 importedCount;
     QDateTime startTime;
     QDateTime stopTime;
     bool active;
@@ -74,10 +82,13 @@ private:
 private:
     void clear();
     void showDialog();
+    void contactDone(const QString &key);
+    void saveCheckpoint();
 
 private slots:
-    void readFromFiles();
-    void writeToSqlite();
+    void schedule();
+    void parseFinished();
+    void writeFinished();
     void start();
     void stop(int reason = ResultCancel);
     void cancel();
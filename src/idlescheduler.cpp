@@ -0,0 +1,216 @@
+/*
+ * idlescheduler.cpp - runs deferrable housekeeping while the user is idle
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "idlescheduler.h"
+
+#include <QCoreApplication>
+#include <QEvent>
+
+#include <climits>
+
+static const int idleThreshold = 400; // msecs without input before tasks may run
+static const int sliceBudget   = 8;   // msecs of tasks per event loop iteration
+
+IdleScheduler *IdleScheduler::instance()
+{
+    static IdleScheduler *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new IdleScheduler();
+    }
+    return instance_;
+}
+
+IdleScheduler::IdleScheduler() : QObject(QCoreApplication::instance())
+{
+    clock_.start();
+    timer_.setSingleShot(true);
+    connect(&timer_, SIGNAL(timeout()), SLOT(run()));
+}
+
+void IdleScheduler::schedule(QObject *context, const QString &key, const std::function<void()> &task,
+                             Priority priority, int deadline, int delay)
+{
+    const qint64 now = clock_.elapsed();
+    const int    i   = find(context, key);
+    if (i != -1) {
+        Task &t    = tasks_[i];
+        t.run      = task;
+        t.priority = qMax(t.priority, priority);
+        t.readyAt  = now + delay;
+        t.deadline = qMin(t.deadline, now + deadline);
+    } else {
+        Task t;
+        t.context  = context;
+        t.key      = key;
+        t.run      = task;
+        t.priority = priority;
+        t.readyAt  = now + delay;
+        t.deadline = now + deadline;
+        tasks_.append(t);
+    }
+    setWatchingInput(true);
+    reschedule();
+}
+
+void IdleScheduler::cancel(QObject *context, const QString &key)
+{
+    const int i = find(context, key);
+    if (i != -1) {
+        tasks_.removeAt(i);
+    }
+    if (tasks_.isEmpty()) {
+        timer_.stop();
+        setWatchingInput(false);
+    }
+}
+
+bool IdleScheduler::isScheduled(QObject *context, const QString &key) const
+{
+    return find(context, key) != -1;
+}
+
+void IdleScheduler::runAll()
+{
+    timer_.stop();
+    while (!tasks_.isEmpty()) {
+        Task t = tasks_.takeFirst();
+        if (t.context) {
+            t.run();
+        }
+    }
+    setWatchingInput(false);
+}
+
+bool IdleScheduler::eventFilter(QObject *watched, QEvent *event)
+{
+    switch (event->type()) {
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+    case QEvent::TouchBegin:
+    case QEvent::TouchUpdate:
+    case QEvent::InputMethod:
+        lastInput_ = clock_.elapsed();
+        break;
+    default:
+        break;
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+/**
+ * Runs due tasks until the time slice is used up; the rest waits for the
+ * next event loop iteration.
+ */
+void IdleScheduler::run()
+{
+    QElapsedTimer slice;
+    slice.start();
+    do {
+        const qint64 now = clock_.elapsed();
+        const int    i   = next(now, now - lastInput_ >= idleThreshold);
+        if (i == -1) {
+            break;
+        }
+        Task t = tasks_.takeAt(i);
+        if (t.context) {
+            t.run();
+        }
+    } while (slice.elapsed() < sliceBudget);
+
+    reschedule();
+}
+
+int IdleScheduler::find(QObject *context, const QString &key) const
+{
+    for (int i = 0; i < tasks_.size(); ++i) {
+        if (tasks_[i].context == context && tasks_[i].key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// overdue tasks first, oldest deadline first; then ready ones by priority if the user is idle
+int IdleScheduler::next(qint64 now, bool idle) const
+{
+    int  best        = -1;
+    bool bestOverdue = false;
+    for (int i = 0; i < tasks_.size(); ++i) {
+        const Task &t       = tasks_[i];
+        const bool  overdue = now >= t.deadline;
+        if (!overdue && !(idle && now >= t.readyAt)) {
+            continue;
+        }
+        bool better;
+        if (best == -1 || overdue != bestOverdue) {
+            better = best == -1 || overdue;
+        } else if (overdue || t.priority == tasks_[best].priority) {
+            better = t.deadline < tasks_[best].deadline;
+        } else {
+            better = t.priority > tasks_[best].priority;
+        }
+        if (better) {
+            best        = i;
+            bestOverdue = overdue;
+        }
+    }
+    return best;
+}
+
+void IdleScheduler::reschedule()
+{
+    for (int i = tasks_.size() - 1; i >= 0; --i) {
+        if (!tasks_[i].context) {
+            tasks_.removeAt(i);
+        }
+    }
+    if (tasks_.isEmpty()) {
+        timer_.stop();
+        setWatchingInput(false);
+        return;
+    }
+
+    const qint64 now    = clock_.elapsed();
+    const qint64 idleAt = lastInput_ + idleThreshold;
+    qint64       wake   = tasks_.first().deadline;
+    for (const Task &t : tasks_) {
+        wake = qMin(wake, qMin(t.deadline, qMax(t.readyAt, idleAt)));
+    }
+    timer_.start(int(qBound(qint64(0), wake - now, qint64(INT_MAX))));
+}
+
+// input is only watched while something is waiting for the user to pause
+void IdleScheduler::setWatchingInput(bool watch)
+{
+    if (watch == watchingInput_) {
+        return;
+    }
+    watchingInput_ = watch;
+    if (watch) {
+        lastInput_ = clock_.elapsed(); // we don't know, so assume the user is busy
+        QCoreApplication::instance()->installEventFilter(this);
+    } else {
+        QCoreApplication::instance()->removeEventFilter(this);
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * idlescheduler.h - runs deferrable housekeeping while the user is idle
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef IDLESCHEDULER_H
+#define IDLESCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <functional>
+
+/**
+ * Runs tasks which don't have to happen right now (saving, cache syncs,
+ * queue processing) when there was no user input for a moment, a few at a
+ * time, so they don't get in the way of typing or scrolling. A task that
+ * reaches its deadline runs regardless.
+ */
+class IdleScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority { Low, Normal, High };
+
+    static IdleScheduler *instance();
+
+    /**
+     * Queues \a task under \a key of \a context; the task is dropped when the
+     * context is destroyed. Scheduling a queued key again replaces the task
+     * and restarts the \a delay, but keeps the earlier deadline. Times are
+     * in msecs from now.
+     */
+    void schedule(QObject *context, const QString &key, const std::function<void()> &task,
+                  Priority priority = Normal, int deadline = 5000, int delay = 0);
+    void cancel(QObject *context, const QString &key);
+    bool isScheduled(QObject *context, const QString &key) const;
+
+    // runs everything queued right away, e.g. before quitting
+    void runAll();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event);
+
+private slots:
+    void run();
+
+private:
+    struct Task
+    {
+        QPointer<QObject>     context;
+        QString               key;
+        std::function<void()> run;
+        Priority              priority;
+        qint64                readyAt;
+        qint64                deadline;
+    };
+
+    IdleScheduler();
+    int find(QObject *context, const QString &key) const;
+    int next(qint64 now, bool idle) const;
+    void reschedule();
+    void setWatchingInput(bool watch);
+
+    QList<Task>   tasks_;
+    QElapsedTimer clock_;
+    qint64        lastInput_ = 0;
+    bool          watchingInput_ = false;
+    QTimer        timer_;
+};
+
+#endif // IDLESCHEDULER_H
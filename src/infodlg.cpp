@@ -23,10 +23,10 @@
 #include "common.h"
 #include "desktoputil.h"
 #include "discodlg.h"
+#include "entityinfocache.h"
 #include "fileutil.h"
 #include "iconset.h"
 #include "iconwidget.h"
-#include "lastactivitytask.h"
 #include "msgmle.h"
 #include "psiaccount.h"
 #include "psioptions.h"
@@ -800,70 +800,49 @@ void InfoWidget::requestResourceInfo(const Jid &j)
 {
     d->infoRequested += j.full();
 
-    JT_ClientVersion *jcv = new JT_ClientVersion(d->pa->client()->rootTask());
-    connect(jcv, SIGNAL(finished()), SLOT(clientVersionFinished()));
-    jcv->get(j);
-    jcv->go(true);
-
-    JT_EntityTime *jet = new JT_EntityTime(d->pa->client()->rootTask());
-    connect(jet, SIGNAL(finished()), SLOT(entityTimeFinished()));
-    jet->get(j);
-    jet->go(true);
-}
-
-void InfoWidget::clientVersionFinished()
-{
-    JT_ClientVersion *j = static_cast<JT_ClientVersion *>(sender());
-    if (j->success()) {
-        foreach (UserListItem *u, d->findRelevant(j->jid())) {
-            UserResourceList::Iterator rit   = u->userResourceList().find(j->jid().resource());
-            bool                       found = (rit == u->userResourceList().end()) ? false : true;
-            if (!found) {
+    // answered right away when another dialog or a tooltip asked before
+    EntityInfoCache *cache = d->pa->entityInfoCache();
+    cache->query(EntityInfoCache::Version, j, this, [this, j](const EntityInfoCache::Info &info) {
+        if (!info.success)
+            return;
+        foreach (UserListItem *u, d->findRelevant(j)) {
+            UserResourceList::Iterator rit = u->userResourceList().find(j.resource());
+            if (rit == u->userResourceList().end())
                 continue;
-            }
 
-            (*rit).setClient(j->name(), j->version(), j->os());
+            (*rit).setClient(info.name, info.version, info.os);
             d->updateEntry(*u);
             updateStatus();
         }
-    }
-}
-
-void InfoWidget::entityTimeFinished()
-{
-    JT_EntityTime *j = static_cast<JT_EntityTime *>(sender());
-    if (j->success()) {
-        foreach (UserListItem *u, d->findRelevant(j->jid())) {
-            UserResourceList::Iterator rit   = u->userResourceList().find(j->jid().resource());
-            bool                       found = (rit == u->userResourceList().end()) ? false : true;
-            if (!found)
+    });
+    cache->query(EntityInfoCache::Time, j, this, [this, j](const EntityInfoCache::Info &info) {
+        if (!info.success)
+            return;
+        foreach (UserListItem *u, d->findRelevant(j)) {
+            UserResourceList::Iterator rit = u->userResourceList().find(j.resource());
+            if (rit == u->userResourceList().end())
                 continue;
 
-            (*rit).setTimezone(j->timezoneOffset());
+            (*rit).setTimezone(info.timezoneOffset);
             d->updateEntry(*u);
             updateStatus();
         }
-    }
+    });
 }
 
 void InfoWidget::requestLastActivity()
 {
-    LastActivityTask *jla = new LastActivityTask(d->jid.bare(), d->pa->client()->rootTask());
-    connect(jla, SIGNAL(finished()), SLOT(requestLastActivityFinished()));
-    jla->go(true);
-}
-
-void InfoWidget::requestLastActivityFinished()
-{
-    LastActivityTask *j = static_cast<LastActivityTask *>(sender());
-    if (j->success()) {
-        foreach (UserListItem *u, d->findRelevant(d->jid)) {
-            u->setLastUnavailableStatus(makeStatus(STATUS_OFFLINE, j->status()));
-            u->setLastAvailable(j->time());
-            d->updateEntry(*u);
-            updateStatus();
-        }
-    }
+    d->pa->entityInfoCache()->query(EntityInfoCache::LastActivity, d->jid.bare(), this,
+                                    [this](const EntityInfoCache::Info &info) {
+                                        if (!info.success)
+                                            return;
+                                        foreach (UserListItem *u, d->findRelevant(d->jid)) {
+                                            u->setLastUnavailableStatus(makeStatus(STATUS_OFFLINE, info.lastStatus));
+                                            u->setLastAvailable(info.lastActivity);
+                                            d->updateEntry(*u);
+                                            updateStatus();
+                                        }
+                                    });
 }
 
 void InfoWidget::contactAvailable(const Jid &j, const Resource &r)
@@ -59,9 +59,6 @@ private slots:
     void contactAvailable(const Jid &, const Resource &);
     void contactUnavailable(const Jid &, const Resource &);
     void contactUpdated(const Jid &);
-    void clientVersionFinished();
-    void entityTimeFinished();
-    void requestLastActivityFinished();
     void jt_finished();
     void doShowCal();
     void doUpdateFromCalendar(const QDate &);
@@ -1,16 +1,16 @@
 #include "irisprotocol/iris_discoinfoquerier.h"
-#include "xmpp_discoinfotask.h"
+#include "discocache.h"
 
 using namespace XMPP;
 
 namespace IrisProtocol {
-DiscoInfoQuerier::DiscoInfoQuerier(XMPP::Client* client) : client_(client)
+DiscoInfoQuerier::DiscoInfoQuerier(DiscoCache* cache) : cache_(cache)
 {
 }
 
 void DiscoInfoQuerier::getDiscoInfo(const XMPP::Jid& jid, const QString& node)
 {
-    JT_DiscoInfo* disco = new JT_DiscoInfo(client_->rootTask());
+    DiscoQuery* disco = new DiscoQuery(cache_, DiscoQuery::Info);
     connect(disco, SIGNAL(finished()), SLOT(discoFinished()));
     disco->get(jid, node);
     disco->go(true);
@@ -18,7 +18,7 @@ void DiscoInfoQuerier::getDiscoInfo(const XMPP::Jid& jid, const QString& node)
 
 void DiscoInfoQuerier::discoFinished()
 {
-    JT_DiscoInfo *disco = static_cast<JT_DiscoInfo*>(sender());
+    DiscoQuery *disco = static_cast<DiscoQuery*>(sender());
     Q_ASSERT(disco);
     if (disco->success()) {
         emit getDiscoInfo_success(disco->jid(), disco->node(), disco->item());
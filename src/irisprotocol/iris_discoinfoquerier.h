@@ -2,11 +2,12 @@
 #define IRIS_DISCOINFOQUERIER_H
 
 #include "protocol/discoinfoquerier.h"
-#include "xmpp_client.h"
 
 #include <QObject>
 #include <QPointer>
 
+class DiscoCache;
+
 namespace XMPP {
     class Jid;
 }
@@ -16,7 +17,7 @@ class DiscoInfoQuerier : public Protocol::DiscoInfoQuerier
 {
     Q_OBJECT
 public:
-    DiscoInfoQuerier(XMPP::Client* client);
+    DiscoInfoQuerier(DiscoCache* cache);
 
     void getDiscoInfo(const XMPP::Jid& jid, const QString& node);
 
@@ -24,7 +25,7 @@ private slots:
     void discoFinished();
 
 private:
-    QPointer<XMPP::Client> client_;
+    QPointer<DiscoCache> cache_;
 };
 }; // namespace IrisProtocol
 
@@ -0,0 +1,77 @@
+/*
+ * jidkey.cpp - interned jid strings for hash keys
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "jidkey.h"
+
+#include "xmpp_jid.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+
+// one pool for the whole process, whichever thread makes the key
+static QMutex &poolMutex()
+{
+    static QMutex m;
+    return m;
+}
+
+static QSet<QString> &pool()
+{
+    static QSet<QString> p;
+    return p;
+}
+
+JidKey::JidKey(const QString &jid)
+{
+    if (jid.isEmpty())
+        return;
+
+    hash_ = ::qHash(jid);
+    QMutexLocker locker(&poolMutex());
+    auto it = pool().constFind(jid);
+    if (it == pool().constEnd()) {
+        QString copy = jid;
+        copy.squeeze();
+        it = pool().insert(copy);
+    }
+    str_ = *it;
+}
+
+JidKey::JidKey(const XMPP::Jid &jid) : JidKey(jid.bare())
+{
+}
+
+void JidKey::squeezePool()
+{
+    QMutexLocker locker(&poolMutex());
+    for (auto it = pool().begin(); it != pool().end();) {
+        // the pool's copy is the only one left
+        if (it->isDetached())
+            it = pool().erase(it);
+        else
+            ++it;
+    }
+}
+
+int JidKey::poolSize()
+{
+    QMutexLocker locker(&poolMutex());
+    return pool().size();
+}
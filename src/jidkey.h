@@ -0,0 +1,65 @@
+/*
+ * jidkey.h - interned jid strings for hash keys
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JIDKEY_H
+#define JIDKEY_H
+
+#include <QHash>
+#include <QString>
+
+namespace XMPP {
+class Jid;
+}
+
+/**
+ * Key of the per-contact hashes: a jid string, usually a bare one, taken
+ * from a pool so every container keyed by the same contact shares one
+ * copy of it. The hash is computed once, when the key is made, and keys
+ * from the pool compare by pointer first. The string is used as it is,
+ * nothing gets parsed or prepared.
+ */
+class JidKey
+{
+public:
+    JidKey() = default;
+    explicit JidKey(const QString &jid);
+    explicit JidKey(const XMPP::Jid &jid); // the bare part of it
+
+    const QString &toString() const { return str_; }
+    bool           isEmpty() const { return str_.isEmpty(); }
+    uint           hash() const { return hash_; }
+
+    bool operator==(const JidKey &other) const
+    {
+        return hash_ == other.hash_ && (str_.constData() == other.str_.constData() || str_ == other.str_);
+    }
+    bool operator!=(const JidKey &other) const { return !(*this == other); }
+
+    // forgets the strings nobody holds a key for anymore
+    static void squeezePool();
+    static int  poolSize();
+
+private:
+    QString str_;
+    uint    hash_ = 0;
+};
+
+inline uint qHash(const JidKey &key, uint seed = 0) { return key.hash() ^ seed; }
+
+#endif // JIDKEY_H
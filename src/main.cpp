@@ -25,10 +25,12 @@
 #include "activeprofiles.h"
 #include "applicationinfo.h"
 #include "chatdlg.h"
+#include "debug.h"
 #ifdef USE_CRASH
 #    include"crash.h"
 #endif
 #include "eventdlg.h"
+#include "historyexport.h"
 #include "profiledlg.h"
 #include "psiapplication.h"
 #include "psicli.h"
@@ -119,6 +121,7 @@ bool PsiMain::useActiveInstance()
         return false;
     }
     else if (!cmdline.contains("help") && !cmdline.contains("version") && !cmdline.contains("choose-profile")
+        && !cmdline.contains("export-history") && !cmdline.contains("import-history")
         && ActiveProfiles::instance()->isAnyActive()
         && ((cmdline.contains("profile") && ActiveProfiles::instance()->isActive(cmdline["profile"])) || !cmdline.contains("profile"))) {
 
@@ -131,6 +134,15 @@ bool PsiMain::useActiveInstance()
             ActiveProfiles::instance()->setStatus(cmdline.value("profile"), cmdline.value("status"), cmdline.value("status-message"));
             raise = false;
         }
+        if (cmdline.contains("trim-caches")) {
+            ActiveProfiles::instance()->trimCaches(cmdline.value("profile"));
+            raise = false;
+        }
+        if (cmdline.contains("memory-report")) {
+            const QString report = ActiveProfiles::instance()->memoryReport(cmdline.value("profile"));
+            PsiCli().show(report.isEmpty() ? PsiCli::tr("The running instance can't be asked for its memory usage.") : report);
+            raise = false;
+        }
 
         if (raise) {
             ActiveProfiles::instance()->raise(cmdline.value("profile"), true);
@@ -138,7 +150,7 @@ bool PsiMain::useActiveInstance()
 
         return true;
     }
-    else if (cmdline.contains("remote")) {
+    else if (cmdline.contains("remote") || cmdline.contains("memory-report") || cmdline.contains("trim-caches")) {
         // there was no active instance to satisfy the request
         // but user doesn't want to start new instance
         return true;
@@ -177,6 +189,21 @@ void PsiMain::useLocalInstance()
         activeProfile = lastProfile = cmdline["profile"];
         QTimer::singleShot(0, this, SLOT(sessionStart()));
     }
+    else if (cmdline.contains("headless")) {
+        // nobody to choose a profile, run the last or the only one
+        if (!lastProfile.isEmpty() && profileExists(lastProfile))
+            activeProfile = lastProfile;
+        else if (getProfilesList().count() == 1)
+            activeProfile = getProfilesList()[0];
+
+        if (activeProfile.isEmpty()) {
+            qWarning("No profile to run headless, use --profile");
+            QTimer::singleShot(0, this, SLOT(bail()));
+        }
+        else {
+            QTimer::singleShot(0, this, SLOT(sessionStart()));
+        }
+    }
     else if(autoOpen && !lastProfile.isEmpty() && profileExists(lastProfile)) {
         // Auto-open the last profile
         activeProfile = lastProfile;
@@ -289,6 +316,7 @@ void PsiMain::sessionStart()
     PsiOptions::reset();
     // get a PsiCon
     pcon = new PsiCon();
+    pcon->setHeadless(cmdline.contains("headless"));
     if (!pcon->init()) {
         delete pcon;
         pcon = nullptr;
@@ -297,6 +325,11 @@ void PsiMain::sessionStart()
     }
     connect(pcon, SIGNAL(quit(int)), SLOT(sessionQuit(int)));
 
+    if (cmdline.contains("export-history") || cmdline.contains("import-history")) {
+        runHistoryTool();
+        return;
+    }
+
     if (cmdline.contains("uri")) {
         ActiveProfiles::instance()->openUriRequested(cmdline.value("uri"));
         cmdline.remove("uri");
@@ -308,11 +341,41 @@ void PsiMain::sessionStart()
     }
 }
 
+/**
+  * \brief Runs --export-history / --import-history on the opened profile and quits
+  */
+void PsiMain::runHistoryTool()
+{
+    const bool exporting = cmdline.contains("export-history");
+    const QString fileName = cmdline.value(exporting ? "export-history" : "import-history");
+    cmdline.remove("export-history");
+    cmdline.remove("import-history");
+
+    HistoryExport *tool = new HistoryExport(pcon, this);
+    bool started = exporting ? tool->exportTo(fileName, QString(), XMPP::Jid()) : tool->importFrom(fileName);
+    if (!started) {
+        qWarning("%s: %s", qPrintable(fileName), qPrintable(tool->errorString()));
+        delete tool;
+        QTimer::singleShot(0, this, SLOT(bail()));
+        return;
+    }
+    connect(tool, &HistoryExport::finished, this, [this, tool, fileName](bool success) {
+        if (!success) {
+            qWarning("%s: %s", qPrintable(fileName), qPrintable(tool->errorString()));
+        }
+        tool->deleteLater();
+        bail();
+    });
+}
+
 void PsiMain::sessionQuit(int x)
 {
     if(x == PsiCon::QuitProgram) {
         QTimer::singleShot(0, this, SLOT(bail()));
     }
+    else if(x == PsiCon::QuitProfile && cmdline.contains("headless")) {
+        QTimer::singleShot(0, this, SLOT(bail()));
+    }
     else if(x == PsiCon::QuitProfile) {
         QTimer::singleShot(0, this, SLOT(chooseProfile()));
     }
@@ -522,6 +585,9 @@ PSI_EXPORT_FUNC int main(int argc, char *argv[])
 #ifdef Q_OS_WIN
     QCoreApplication::addLibraryPath(appPath);
 #endif
+    // a headless session needs no display
+    if (cmdline.contains("headless") && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
     PsiApplication app(argc, argv);
     QApplication::setApplicationName(ApplicationInfo::name());
     QApplication::addLibraryPath(ApplicationInfo::resourcesDir());
@@ -576,6 +642,12 @@ PSI_EXPORT_FUNC int main(int argc, char *argv[])
                         QString::fromLocal8Bit(clIt.value().constData()));
     }
 
+    if (cmdlines.contains("trace"))
+        Trace::setEnabled(true);
+    if (cmdlines.contains("debug-log"))
+        DebugLog::start(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/logs",
+                        cmdlines.value("debug-log"));
+
     PsiMain *psi = new PsiMain(cmdlines);
     // check if we want to remote-control other psi instance
     if (psi->useActiveInstance()) {
@@ -602,6 +674,10 @@ PSI_EXPORT_FUNC int main(int argc, char *argv[])
     int returnValue = app.exec();
     delete psi;
 
+    if (cmdlines.contains("trace"))
+        Trace::save(cmdlines.value("trace"));
+    DebugLog::stop();
+
     return returnValue;
 }
 
@@ -53,6 +53,7 @@ private:
     PsiCon *pcon;
 
     void saveSettings();
+    void runHistoryTool();
 };
 
 #endif // MAIN_H
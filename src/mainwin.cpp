@@ -26,10 +26,12 @@
 #include "avatars.h"
 #include "avcall/avcall.h"
 #include "common.h"
+#include "debug.h"
 #include "desktoputil.h"
 #include "geolocationdlg.h"
 #include "globalstatusmenu.h"
 #include "mainwin_p.h"
+#include "memoryaccounting.h"
 #include "mooddlg.h"
 #include "mucjoindlg.h"
 #include "psiaccount.h"
@@ -299,6 +301,9 @@ void MainWin::Private::updateMenu(QStringList actions, QMenu* menu)
             QMenu* diagMenu = new QMenu(tr("Diagnostics"), menu);
             getAction("help_diag_qcaplugin")->addTo(diagMenu);
             getAction("help_diag_qcakeystore")->addTo(diagMenu);
+            getAction("help_diag_stalls")->addTo(diagMenu);
+            getAction("help_diag_memory")->addTo(diagMenu);
+            getAction("help_diag_trim_caches")->addTo(diagMenu);
             menu->addMenu(diagMenu);
             continue;
         }
@@ -512,6 +517,9 @@ MainWin::MainWin(bool _onTop, bool _asTool, PsiCon* psi)
     helpMenu->addMenu(diagMenu);
     d->getAction("help_diag_qcaplugin")->addTo (diagMenu);
     d->getAction("help_diag_qcakeystore")->addTo (diagMenu);
+    d->getAction("help_diag_stalls")->addTo (diagMenu);
+    d->getAction("help_diag_memory")->addTo (diagMenu);
+    d->getAction("help_diag_trim_caches")->addTo (diagMenu);
     if(AvCallManager::isSupported()) {
         helpMenu->addSeparator();
         d->getAction("help_about_psimedia")->addTo (helpMenu);
@@ -644,6 +652,9 @@ void MainWin::registerAction( IconAction* action )
         { "help_about_psimedia",   activated, this, SLOT( actAboutPsiMediaActivated() ) },
         { "help_diag_qcaplugin",   activated, this, SLOT( actDiagQCAPluginActivated() ) },
         { "help_diag_qcakeystore", activated, this, SLOT( actDiagQCAKeyStoreActivated() ) },
+        { "help_diag_stalls",      activated, this, SLOT( actDiagStallsActivated() ) },
+        { "help_diag_memory",      activated, this, SLOT( actDiagMemoryActivated() ) },
+        { "help_diag_trim_caches", activated, this, SLOT( actDiagTrimCachesActivated() ) },
 
         { "", nullptr, nullptr, nullptr }
     };
@@ -1119,6 +1130,27 @@ void MainWin::actDiagQCAKeyStoreActivated()
     w->show();
 }
 
+void MainWin::actDiagStallsActivated()
+{
+    ShowTextDlg* w = new ShowTextDlg(StallMonitor::report(), true, false, this);
+    w->setWindowTitle(CAP(tr("Interface Stalls")));
+    w->resize(640, 400);
+    w->show();
+}
+
+void MainWin::actDiagMemoryActivated()
+{
+    ShowTextDlg* w = new ShowTextDlg(MemoryAccounting::report(), true, false, this);
+    w->setWindowTitle(CAP(tr("Memory Usage")));
+    w->resize(640, 400);
+    w->show();
+}
+
+void MainWin::actDiagTrimCachesActivated()
+{
+    MemoryAccounting::trim();
+}
+
 void MainWin::actChooseStatusActivated()
 {
     PsiOptions* o = PsiOptions::instance();
@@ -1297,6 +1329,11 @@ void MainWin::setTrayToolTip()
             text = clipStatus(text, 40, 1);
             Tip += QString("<div style='white-space:pre'>%1: %2</div>").arg(tr("Status Message")).arg(TextUtil::escape(text));
         }
+        if(pa->autoJoinTotal() > 0) {
+            QString progress = tr("Joining rooms: %1 of %2").arg(pa->autoJoinDone()).arg(pa->autoJoinTotal());
+            Tip += QString("<div style='white-space:pre'>%1</div>").arg(TextUtil::escape(progress));
+            TipPlain += "\n" + progress;
+        }
 
         PsiEvent::Ptr e;
         e = pa->eventQueue()->peekNext();
@@ -1744,6 +1781,9 @@ PsiTrayIcon *MainWin::psiTrayIcon()
 void MainWin::numAccountsChanged()
 {
     d->statusButton->setEnabled(d->psi->contactList()->haveEnabledAccounts());
+    foreach(PsiAccount *pa, d->psi->contactList()->accounts()) {
+        connect(pa, SIGNAL(autoJoinProgress(int,int)), SLOT(setTrayToolTip()), Qt::UniqueConnection);
+    }
     setTrayToolTip();
     PsiAccount *acc = d->psi->contactList()->defaultAccount();
     if(acc && acc != d->defaultAccount) {
@@ -135,6 +135,9 @@ private slots:
     void actEnableGroupsActivated (bool);
     void actDiagQCAPluginActivated();
     void actDiagQCAKeyStoreActivated();
+    void actDiagStallsActivated();
+    void actDiagMemoryActivated();
+    void actDiagTrimCachesActivated();
     void actChooseStatusActivated();
     void actReconnectActivated();
     void actSetMoodActivated();
@@ -0,0 +1,156 @@
+/*
+ * mamquerytask.cpp - query of the server side message archive (XEP-0313)
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mamquerytask.h"
+
+#include "xmpp_client.h"
+#include "xmpp_jid.h"
+#include "xmpp_stream.h"
+#include "xmpp_xmlcommon.h"
+
+#include <QDateTime>
+
+using namespace XMPP;
+
+static const char *mamNS     = "urn:xmpp:mam:2";
+static const char *rsmNS     = "http://jabber.org/protocol/rsm";
+static const char *forwardNS = "urn:xmpp:forward:0";
+static const char *delayNS   = "urn:xmpp:delay";
+static const char *sidNS     = "urn:xmpp:sid:0";
+
+MamQueryTask::MamQueryTask(Task *parent) : Task(parent), complete_(false)
+{
+}
+
+/**
+ * \brief Requests up to \a max archived messages following \a archiveId.
+ */
+void MamQueryTask::queryAfter(const QString &archiveId, int max)
+{
+    buildQuery(archiveId, max);
+}
+
+/**
+ * \brief Requests the \a max most recent archived messages.
+ */
+void MamQueryTask::queryLatest(int max)
+{
+    buildQuery(QString(), max);
+}
+
+void MamQueryTask::buildQuery(const QString &after, int max)
+{
+    queryId_ = id();
+    iq_      = createIQ(doc(), "set", QString(), id());
+
+    QDomElement query = doc()->createElementNS(mamNS, "query");
+    query.setAttribute("queryid", queryId_);
+    QDomElement set = doc()->createElementNS(rsmNS, "set");
+    set.appendChild(textTag(doc(), "max", QString::number(max)));
+    if (after.isEmpty())
+        set.appendChild(doc()->createElement("before")); // the last page
+    else
+        set.appendChild(textTag(doc(), "after", after));
+    query.appendChild(set);
+    iq_.appendChild(query);
+}
+
+void MamQueryTask::onGo()
+{
+    send(iq_);
+}
+
+bool MamQueryTask::take(const QDomElement &x)
+{
+    if (x.tagName() == "message") {
+        QDomElement result = x.firstChildElement("result");
+        if (result.isNull() || result.namespaceURI() != mamNS || result.attribute("queryid") != queryId_)
+            return false;
+        // only our own server may feed the archive
+        Jid from(x.attribute("from"));
+        if (!from.isEmpty() && !from.compare(client()->jid(), false))
+            return false;
+        return takeResult(result);
+    }
+
+    if (!iqVerify(x, Jid(), id()))
+        return false;
+
+    if (x.attribute("type") == "result") {
+        QDomElement fin = x.firstChildElement("fin");
+        complete_       = fin.attribute("complete") == "true";
+        QDomElement set = fin.firstChildElement("set");
+        lastId_         = set.firstChildElement("last").text();
+        setSuccess();
+    } else {
+        setError(x);
+    }
+    return true;
+}
+
+bool MamQueryTask::takeResult(const QDomElement &result)
+{
+    QDomElement forwarded = result.firstChildElement("forwarded");
+    if (forwarded.namespaceURI() != forwardNS)
+        return true;
+    QDomElement msg = forwarded.firstChildElement("message");
+    if (msg.isNull())
+        return true;
+
+    Item item;
+    item.archiveId = result.attribute("id");
+    QDomElement origin = msg.firstChildElement("origin-id");
+    if (origin.namespaceURI() == sidNS)
+        item.originId = origin.attribute("id");
+    Stanza s       = client()->stream().createStanza(addCorrectNS(msg));
+    if (!item.message.fromStanza(s, client()->manualTimeZoneOffset(), client()->timeZoneOffset()))
+        return true;
+
+    QDomElement delay = forwarded.firstChildElement("delay");
+    if (delay.namespaceURI() == delayNS) {
+        QDateTime stamp = QDateTime::fromString(delay.attribute("stamp").left(19), Qt::ISODate);
+        if (stamp.isValid()) {
+            stamp.setTimeSpec(Qt::UTC);
+            item.message.setTimeStamp(stamp.toLocalTime());
+        }
+    }
+    items_.append(item);
+    return true;
+}
+
+const QList<MamQueryTask::Item> &MamQueryTask::items() const
+{
+    return items_;
+}
+
+/**
+ * \brief Archive id of the newest message in the returned page.
+ */
+const QString &MamQueryTask::lastId() const
+{
+    return lastId_;
+}
+
+/**
+ * \brief Tells if the page reached the end of the archive.
+ */
+bool MamQueryTask::complete() const
+{
+    return complete_;
+}
@@ -0,0 +1,63 @@
+/*
+ * mamquerytask.h - query of the server side message archive (XEP-0313)
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MAMQUERYTASK_H
+#define MAMQUERYTASK_H
+
+#include "xmpp_message.h"
+#include "xmpp_task.h"
+
+#include <QDomElement>
+#include <QList>
+#include <QString>
+
+class MamQueryTask : public XMPP::Task
+{
+public:
+    struct Item
+    {
+        QString       archiveId;
+        QString       originId; // XEP-0359, what the sender's own copy was known by
+        XMPP::Message message;
+    };
+
+    MamQueryTask(Task *parent);
+
+    void queryAfter(const QString &archiveId, int max);
+    void queryLatest(int max);
+
+    void onGo();
+    bool take(const QDomElement &);
+
+    const QList<Item> &items() const;
+    const QString &    lastId() const;
+    bool               complete() const;
+
+private:
+    QDomElement iq_;
+    QString     queryId_;
+    QList<Item> items_;
+    QString     lastId_;
+    bool        complete_;
+
+    void buildQuery(const QString &after, int max);
+    bool takeResult(const QDomElement &result);
+};
+
+#endif // MAMQUERYTASK_H
@@ -0,0 +1,140 @@
+/*
+ * memoryaccounting.cpp - memory used by caches and views
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "memoryaccounting.h"
+
+#include "debug.h"
+
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPixmapCache>
+
+#include <algorithm>
+
+namespace {
+
+struct Owner {
+    QObject *                       object;
+    QString                         name;
+    MemoryAccounting::UsageFunction usage;
+    MemoryAccounting::TrimFunction  trim;
+};
+
+QList<Owner> owners;
+
+QString formatBytes(qint64 bytes)
+{
+    if (bytes < 0)
+        return QString("?");
+    if (bytes < 10 * 1024)
+        return QString("%1 B").arg(bytes);
+    if (bytes < 10 * 1024 * 1024)
+        return QString("%1 KiB").arg(bytes / 1024);
+    return QString("%1 MiB").arg(bytes / (1024 * 1024));
+}
+
+// resident set size of the process, -1 where it's not known
+qint64 residentBytes()
+{
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        for (const QByteArray &line : status.readAll().split('\n')) {
+            if (line.startsWith("VmRSS:"))
+                return line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+        }
+    }
+#endif
+    return -1;
+}
+
+}
+
+void MemoryAccounting::add(QObject *owner, const QString &name, UsageFunction usage, TrimFunction trim)
+{
+    owners += Owner { owner, name, usage, trim };
+    QObject::connect(owner, &QObject::destroyed, [owner]() { remove(owner); });
+}
+
+void MemoryAccounting::remove(QObject *owner)
+{
+    for (auto it = owners.begin(); it != owners.end();) {
+        if (it->object == owner)
+            it = owners.erase(it);
+        else
+            ++it;
+    }
+}
+
+/**
+ * Usage of all owners as plain text, biggest first.
+ */
+QString MemoryAccounting::report()
+{
+    struct Total {
+        int    instances = 0;
+        qint64 bytes     = -1;
+        qint64 entries   = 0;
+    };
+    QMap<QString, Total> totals;
+    for (const Owner &o : owners) {
+        const Usage u = o.usage();
+        Total &     t = totals[o.name];
+        ++t.instances;
+        t.entries += u.entries;
+        if (u.bytes >= 0)
+            t.bytes = qMax(qint64(0), t.bytes) + u.bytes;
+    }
+
+    QList<QString> names = totals.keys();
+    std::stable_sort(names.begin(), names.end(),
+                     [&totals](const QString &a, const QString &b) { return totals[a].bytes > totals[b].bytes; });
+
+    qint64  known = 0;
+    QString text  = QString("%1 %2 %3 %4\n").arg("", -28).arg("instances", 10).arg("entries", 10).arg("memory", 10);
+    for (const QString &name : names) {
+        const Total &t = totals[name];
+        text += QString("%1 %2 %3 %4\n")
+                    .arg(name, -28)
+                    .arg(t.instances, 10)
+                    .arg(t.entries, 10)
+                    .arg(formatBytes(t.bytes), 10);
+        known += qMax(qint64(0), t.bytes);
+    }
+    text += QString("\nAccounted for: %1\n").arg(formatBytes(known));
+    text += QString("Resident: %1\n").arg(formatBytes(residentBytes()));
+    text += QString("Pixmap cache limit: %1\n").arg(formatBytes(qint64(QPixmapCache::cacheLimit()) * 1024));
+    return text;
+}
+
+/**
+ * Asks every owner to give back what it can reload later.
+ */
+void MemoryAccounting::trim()
+{
+    for (int i = 0; i < owners.size(); ++i) {
+        const TrimFunction trim = owners.at(i).trim;
+        if (trim)
+            trim();
+    }
+    QPixmapCache::clear();
+    DEBUG() << "[memory]" << "caches trimmed, resident" << formatBytes(residentBytes());
+}
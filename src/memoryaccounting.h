@@ -0,0 +1,54 @@
+/*
+ * memoryaccounting.h - memory used by caches and views
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <QString>
+
+#include <functional>
+
+class QObject;
+
+/**
+ * Registry of whatever holds on to a lot of memory. Each owner reports the
+ * bytes and entries it holds when asked, and may know how to give some of
+ * it back. Owners with the same name are summed up in the report. All of
+ * it is meant to be used from the GUI thread.
+ */
+class MemoryAccounting
+{
+public:
+    struct Usage {
+        qint64 bytes   = -1; // unknown
+        qint64 entries = 0;
+    };
+
+    typedef std::function<Usage()> UsageFunction;
+    typedef std::function<void()>  TrimFunction;
+
+    // owner is forgotten when it's destroyed
+    static void add(QObject *owner, const QString &name, UsageFunction usage, TrimFunction trim = TrimFunction());
+    static void remove(QObject *owner);
+
+    static QString report();
+    static void    trim();
+};
+
+#endif // MEMORYACCOUNTING_H
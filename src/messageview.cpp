@@ -27,6 +27,16 @@
 
 static const QString me_cmd = "/me ";
 
+// formatting options are read for every displayed message
+static OptionsTree::Handle useEmoticonsOption, legacyFormattingOption;
+
+static bool optionEnabled(OptionsTree::Handle &handle, const char *name)
+{
+    if (!handle.isValid())
+        handle = PsiOptions::instance()->handle(QLatin1String(name));
+    return handle.toBool();
+}
+
 // ======================================================================
 // MessageView
 // ======================================================================
@@ -61,7 +71,7 @@ MessageView MessageView::urlsMessage(const QMap<QString, QString> &urls)
 MessageView MessageView::subjectMessage(const QString &subject, const QString &prefix)
 {
     MessageView mv(Subject);
-    mv._text     = TextUtil::escape(prefix);
+    mv.setText(TextUtil::escape(prefix));
     mv._userText = subject;
     return mv;
 }
@@ -113,10 +123,8 @@ void MessageView::setPlainText(const QString &text)
         if (_type == Message) {
             setEmote(text.startsWith(me_cmd));
         }
-        _text = TextUtil::plain2rich(text);
-        if (_type == Message) {
-            _text = TextUtil::linkify(_text);
-        }
+        _plainText = text;
+        _text      = TextUtil::formatPlain(text, _type == Message ? TextUtil::Linkify : 0);
     }
 }
 
@@ -130,20 +138,35 @@ void MessageView::setHtml(const QString &text)
             return;
         }
     }
-    _text = text;
+    setText(text);
 }
 
 QString MessageView::formattedText() const
 {
+    const bool emoticons = optionEnabled(useEmoticonsOption, "options.ui.emoticons.use-emoticons");
+    const bool legacy    = optionEnabled(legacyFormattingOption, "options.ui.chat.legacy-formatting");
+
+    if (!_plainText.isEmpty()) {
+        // format straight from the source in one pass
+        QString plain = _plainText;
+        int     flags = (emoticons ? TextUtil::Emoticons : 0) | (legacy ? TextUtil::LegacyFormatting : 0);
+        if (_type == Message) {
+            flags |= TextUtil::Linkify;
+            if (isEmote())
+                plain.remove(plain.indexOf(me_cmd), me_cmd.length());
+        }
+        return TextUtil::formatPlain(plain, flags);
+    }
+
     QString txt = _text;
 
     if (isEmote() && _type == Message) {
         int cmd = txt.indexOf(me_cmd);
         txt     = txt.remove(cmd, me_cmd.length());
     }
-    if (PsiOptions::instance()->getOption("options.ui.emoticons.use-emoticons").toBool())
+    if (emoticons)
         txt = TextUtil::emoticonify(txt);
-    if (PsiOptions::instance()->getOption("options.ui.chat.legacy-formatting").toBool())
+    if (legacy)
         txt = TextUtil::legacyFormat(txt);
 
     return txt;
@@ -152,13 +175,12 @@ QString MessageView::formattedText() const
 QString MessageView::formattedUserText() const
 {
     if (!_userText.isEmpty()) {
-        QString text = TextUtil::plain2rich(_userText);
-        text         = TextUtil::linkify(text);
-        if (PsiOptions::instance()->getOption("options.ui.emoticons.use-emoticons").toBool())
-            text = TextUtil::emoticonify(text);
-        if (PsiOptions::instance()->getOption("options.ui.chat.legacy-formatting").toBool())
-            text = TextUtil::legacyFormat(text);
-        return text;
+        int flags = TextUtil::Linkify;
+        if (optionEnabled(useEmoticonsOption, "options.ui.emoticons.use-emoticons"))
+            flags |= TextUtil::Emoticons;
+        if (optionEnabled(legacyFormattingOption, "options.ui.chat.legacy-formatting"))
+            flags |= TextUtil::LegacyFormatting;
+        return TextUtil::formatPlain(_userText, flags);
     }
     return "";
 }
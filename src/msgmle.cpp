@@ -19,13 +19,13 @@
 
 #include "msgmle.h"
 
+#include "chatspellchecker.h"
 #include "htmltextcontroller.h"
 #include "psiiconset.h"
 #include "psioptions.h"
 #include "qiteaudiorecorder.h"
 #include "shortcutmanager.h"
 #include "spellchecker/spellchecker.h"
-#include "spellchecker/spellhighlighter.h"
 #include "textutil.h"
 
 #include <QAbstractTextDocumentLayout>
@@ -272,7 +272,7 @@ void ChatEdit::setCheckSpelling(bool b)
     check_spelling_ = b;
     if (check_spelling_) {
         if (!spellhighlighter_)
-            spellhighlighter_.reset(new SpellHighlighter(document()));
+            spellhighlighter_.reset(new ChatSpellHighlighter(document()));
     } else {
         spellhighlighter_.reset();
     }
@@ -343,9 +343,9 @@ void ChatEdit::contextMenuEvent(QContextMenuEvent *e)
         tc.movePosition(QTextCursor::StartOfWord, QTextCursor::MoveAnchor);
         tc.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
         QString selected_word = tc.selectedText();
-        if (!selected_word.isEmpty() && !QRegExp("\\d+").exactMatch(selected_word) && !SpellChecker::instance()->isCorrect(selected_word)) {
-            QList<QString> suggestions = SpellChecker::instance()->suggestions(selected_word);
-            if (!suggestions.isEmpty() || SpellChecker::instance()->writable()) {
+        if (!selected_word.isEmpty() && !QRegExp("\\d+").exactMatch(selected_word) && !ChatSpellChecker::instance()->isCorrect(selected_word)) {
+            QList<QString> suggestions = ChatSpellChecker::instance()->suggestions(selected_word);
+            if (!suggestions.isEmpty() || ChatSpellChecker::instance()->writable()) {
                 QMenu spell_menu;
                 if (!suggestions.isEmpty()) {
                     foreach (QString suggestion, suggestions) {
@@ -354,7 +354,7 @@ void ChatEdit::contextMenuEvent(QContextMenuEvent *e)
                     }
                     spell_menu.addSeparator();
                 }
-                if (SpellChecker::instance()->writable()) {
+                if (ChatSpellChecker::instance()->writable()) {
                     QAction *act_add = spell_menu.addAction(tr("Add to dictionary"));
                     connect(act_add, SIGNAL(triggered()), SLOT(addToDictionary()));
                 }
@@ -414,7 +414,7 @@ void ChatEdit::addToDictionary()
     // Get the selected word
     tc.movePosition(QTextCursor::StartOfWord, QTextCursor::MoveAnchor);
     tc.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
-    SpellChecker::instance()->add(tc.selectedText());
+    ChatSpellChecker::instance()->add(tc.selectedText());
 
     // Put the cursor where it belongs
     tc.clearSelection();
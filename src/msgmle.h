@@ -38,7 +38,7 @@ class QLabel;
 class QResizeEvent;
 class QTimer;
 class QToolButton;
-class SpellHighlighter;
+class ChatSpellHighlighter;
 
 class ChatEdit : public QTextEdit
 {
@@ -109,7 +109,7 @@ private:
 private:
     QWidget    *dialog_ = nullptr;
     bool check_spelling_ = false;
-    std::unique_ptr<SpellHighlighter> spellhighlighter_;
+    std::unique_ptr<ChatSpellHighlighter> spellhighlighter_;
     QPoint last_click_;
     int previous_position_ = 0;
     QStringList typedMsgsHistory;
@@ -21,32 +21,130 @@
 
 #include <QFont>
 #include <QMimeData>
+#include <QSet>
 #include <QVariant>
 
 using namespace XMPP;
 
-MUCAffiliationsModel::MUCAffiliationsModel() : QStandardItemModel(Unknown,2)
+// internal id of the rows in a list, the lists themselves have 0
+static inline quintptr listId(int list) { return quintptr(list + 1); }
+
+MUCAffiliationsModel::MUCAffiliationsModel() : QAbstractItemModel()
 {
-    QFont font;
-    font.setBold(true);
-    QVariant font_variant = qVariantFromValue(font);
-    for (int i = 0; i < Unknown; i++) {
-        QModelIndex ind = index(i, 0, QModelIndex());
-        setData(ind,QVariant(affiliationlistindexToString(AffiliationListIndex(i))));
-        setData(ind,font_variant,Qt::FontRole);
-        insertColumns(0,1,ind);
-        insertColumns(1,1,ind);
-        enabled_[AffiliationListIndex(i)] = false;
+}
+
+QModelIndex MUCAffiliationsModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (row < 0 || column < 0 || column >= 2)
+        return QModelIndex();
+    if (!parent.isValid())
+        return row < Unknown ? createIndex(row, column, quintptr(0)) : QModelIndex();
+    if (parent.internalId() != 0 || parent.column() != 0)
+        return QModelIndex();
+    if (row >= lists_[parent.row()].rows.count())
+        return QModelIndex();
+    return createIndex(row, column, listId(parent.row()));
+}
+
+QModelIndex MUCAffiliationsModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.internalId() == 0)
+        return QModelIndex();
+    return createIndex(int(index.internalId() - 1), 0, quintptr(0));
+}
+
+int MUCAffiliationsModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return Unknown;
+    if (parent.internalId() != 0 || parent.column() != 0)
+        return 0;
+    return lists_[parent.row()].rows.count();
+}
+
+int MUCAffiliationsModel::columnCount(const QModelIndex &) const
+{
+    return 2;
+}
+
+QVariant MUCAffiliationsModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    if (index.internalId() == 0) {
+        if (index.column() != 0)
+            return QVariant();
+        if (role == Qt::DisplayRole || role == Qt::EditRole)
+            return affiliationlistindexToString(AffiliationListIndex(index.row()));
+        if (role == Qt::FontRole) {
+            QFont font;
+            font.setBold(true);
+            return font;
+        }
+        return QVariant();
     }
-    setHorizontalHeaderLabels(QStringList() << tr("JID") << tr("Reason"));
+
+    if (role != Qt::DisplayRole && role != Qt::EditRole)
+        return QVariant();
+    const Row &r = lists_[index.internalId() - 1].rows.at(index.row());
+    return index.column() == 0 ? r.jid : r.reason;
+}
+
+bool MUCAffiliationsModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || index.internalId() == 0 || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return false;
+    Row &r = lists_[index.internalId() - 1].rows[index.row()];
+    if (index.column() == 0)
+        r.jid = value.toString();
+    else
+        r.reason = value.toString();
+    emit dataChanged(index, index);
+    return true;
+}
+
+QVariant MUCAffiliationsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+        return section == 0 ? tr("JID") : tr("Reason");
+    return QVariant();
+}
+
+bool MUCAffiliationsModel::insertRows(int row, int count, const QModelIndex &parent)
+{
+    if (!parent.isValid() || parent.internalId() != 0 || count <= 0)
+        return false;
+    List &l = lists_[parent.row()];
+    if (row < 0 || row > l.rows.count())
+        return false;
+    beginInsertRows(parent, row, row + count - 1);
+    l.rows.insert(row, count, Row());
+    endInsertRows();
+    return true;
+}
+
+bool MUCAffiliationsModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (!parent.isValid() || parent.internalId() != 0 || count <= 0)
+        return false;
+    List &l = lists_[parent.row()];
+    if (row < 0 || row + count > l.rows.count())
+        return false;
+    beginRemoveRows(parent, row, row + count - 1);
+    l.rows.remove(row, count);
+    endRemoveRows();
+    return true;
 }
 
 Qt::ItemFlags MUCAffiliationsModel::flags(const QModelIndex &index) const
 {
     Qt::ItemFlags a;
+    if (!index.isValid())
+        return a;
     if (!index.parent().isValid()) {
         // List headers
-        if (enabled_[AffiliationListIndex(index.row())]) {
+        if (lists_[index.row()].enabled) {
             a |= Qt::ItemIsDropEnabled | Qt::ItemIsSelectable | Qt::ItemIsEnabled;
         }
     }
@@ -154,21 +252,23 @@ void MUCAffiliationsModel::resetAffiliationLists()
 
 void MUCAffiliationsModel::resetAffiliationList(MUCItem::Affiliation a)
 {
-    emit layoutAboutToBeChanged();
-    enabled_[AffiliationListIndex(affiliationToIndex(a))] = false;
     QModelIndex index = affiliationListIndex(a);
+    if (!index.isValid())
+        return;
+    lists_[index.row()].enabled = false;
     if (hasChildren(index)) {
         removeRows(0,rowCount(index),index);
     }
-    emit layoutChanged();
+    emit dataChanged(index, index);
 }
 
 void MUCAffiliationsModel::setAffiliationListEnabled(MUCItem::Affiliation a, bool b)
 {
-    emit layoutAboutToBeChanged();
     QModelIndex index = affiliationListIndex(a);
-    enabled_[AffiliationListIndex(index.row())] = b;
-    emit layoutChanged();
+    if (!index.isValid())
+        return;
+    lists_[index.row()].enabled = b;
+    emit dataChanged(index, index);
 }
 
 QString MUCAffiliationsModel::affiliationlistindexToString(AffiliationListIndex list)
@@ -210,65 +310,61 @@ MUCAffiliationsModel::AffiliationListIndex MUCAffiliationsModel::affiliationToIn
 
 void MUCAffiliationsModel::addItems(const QList<MUCItem>& items)
 {
-    bool dirty = false;
-    foreach(MUCItem item, items) {
-        QModelIndex list = affiliationListIndex(item.affiliation());
-        if (list.isValid() && !item.jid().isEmpty()) {
-            if (!dirty) {
-                emit layoutAboutToBeChanged();
-            }
-            int row = rowCount(list);
-            if (row == 0) {
-                enabled_[AffiliationListIndex(list.row())] = true;
-            }
-            insertRows(row,1,list);
-            setData(index(row,0,list),QVariant(item.jid().full()));
-            setData(index(row,1,list),QVariant(item.reason()));
-            MUCItem i(MUCItem::UnknownRole,item.affiliation());
-            i.setJid(item.jid());
-            items_ += i;
-            dirty = true;
+    // one insertion per list, not per item
+    QVector<Row> added[Unknown];
+    foreach(const MUCItem &item, items) {
+        AffiliationListIndex list = affiliationToIndex(item.affiliation());
+        if (list != Unknown && !item.jid().isEmpty()) {
+            added[list] += Row { item.jid().full(), item.reason() };
+            items_.insert(item.jid().full(), item.affiliation());
         }
         else {
             qDebug("Unexpected item");
         }
     }
-    if (dirty)
-        emit layoutChanged();
+
+    for (int i = 0; i < Unknown; i++) {
+        if (added[i].isEmpty())
+            continue;
+        List &l = lists_[i];
+        QModelIndex parent = index(i, 0, QModelIndex());
+        int row = l.rows.count();
+        beginInsertRows(parent, row, row + added[i].count() - 1);
+        l.rows += added[i];
+        endInsertRows();
+        if (!l.enabled) {
+            l.enabled = true;
+            emit dataChanged(parent, parent);
+        }
+    }
 }
 
 QList<MUCItem> MUCAffiliationsModel::changes() const
 {
-    QList<MUCItem> items_old = items_;
     QList<MUCItem> items_delta;
+    QSet<QString> present;
 
-    // Add all new items
-    for (int i = 0; i < rowCount(QModelIndex()); i++) {
-        QModelIndex list = index(i,0,QModelIndex());
-        for(int j = 0; j < rowCount(list); j++) {
-            Jid jid(data(index(j,0,list)).toString());
-            MUCItem item(MUCItem::UnknownRole,indexToAffiliation(i));
-            item.setJid(jid);
-            if (!items_.contains(item)) {
+    // new items and the ones moved to another list
+    for (int i = 0; i < Unknown; i++) {
+        MUCItem::Affiliation a = indexToAffiliation(i);
+        foreach (const Row &r, lists_[i].rows) {
+            Jid jid(r.jid);
+            QString key = jid.full();
+            present.insert(key);
+            auto it = items_.constFind(key);
+            if (it == items_.constEnd() || it.value() != a) {
+                MUCItem item(MUCItem::UnknownRole, a);
+                item.setJid(jid);
                 items_delta += item;
             }
-            else
-                items_old.removeAll(item);
         }
     }
 
-    // Remove all old items not present in the delta
-    foreach(MUCItem item_old, items_old) {
-        bool found = false;
-        foreach(MUCItem item_new, items_delta) {
-            if (item_new.jid().compare(item_old.jid(),false)) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            MUCItem item(MUCItem::UnknownRole,MUCItem::NoAffiliation);
-            item.setJid(item_old.jid());
+    // items removed from all the lists
+    for (auto it = items_.constBegin(); it != items_.constEnd(); ++it) {
+        if (!present.contains(it.key())) {
+            MUCItem item(MUCItem::UnknownRole, MUCItem::NoAffiliation);
+            item.setJid(Jid(it.key()));
             items_delta += item;
         }
     }
@@ -276,6 +372,20 @@ QList<MUCItem> MUCAffiliationsModel::changes() const
     return items_delta;
 }
 
+/**
+ * The room took these changes, the rows show them already and they are
+ * no longer changes.
+ */
+void MUCAffiliationsModel::applied(const QList<MUCItem> &items)
+{
+    foreach (const MUCItem &item, items) {
+        if (item.affiliation() == MUCItem::NoAffiliation)
+            items_.remove(item.jid().full());
+        else
+            items_.insert(item.jid().full(), item.affiliation());
+    }
+}
+
 MUCItem::Affiliation MUCAffiliationsModel::indexToAffiliation(int li)
 {
     if (li == Members)
@@ -22,19 +22,35 @@
 
 #include "xmpp_muc.h"
 
+#include <QAbstractItemModel>
+#include <QHash>
 #include <QList>
-#include <QMap>
-#include <QStandardItemModel>
+#include <QVector>
 
 class QMimeData;
 
-class MUCAffiliationsModel : public QStandardItemModel
+/**
+ * The four affiliation lists of a room as top-level items with the jids
+ * below them. The rows are plain strings rather than items, big public
+ * rooms have member lists with tens of thousands of entries.
+ */
+class MUCAffiliationsModel : public QAbstractItemModel
 {
     Q_OBJECT
 
 public:
     MUCAffiliationsModel();
 
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &index) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex());
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex());
+
     virtual Qt::ItemFlags flags(const QModelIndex &index) const;
     virtual Qt::DropActions supportedDropActions() const;
     bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent);
@@ -46,6 +62,7 @@ public:
     QModelIndex affiliationListIndex(XMPP::MUCItem::Affiliation);
     void addItems(const QList<XMPP::MUCItem>&);
     QList<XMPP::MUCItem> changes() const;
+    void applied(const QList<XMPP::MUCItem>&);
 
 protected:
     enum AffiliationListIndex {
@@ -57,8 +74,17 @@ protected:
     static XMPP::MUCItem::Affiliation indexToAffiliation(int);
 
 private:
-    QList<XMPP::MUCItem> items_;
-    QMap<AffiliationListIndex,bool> enabled_;
+    struct Row {
+        QString jid;
+        QString reason;
+    };
+    struct List {
+        QVector<Row> rows;
+        bool enabled = false;
+    };
+
+    List lists_[Unknown];
+    QHash<QString, XMPP::MUCItem::Affiliation> items_; // as received from the room, by jid
 };
 
 #endif // MUCAFFILIATIONSMODEL_H
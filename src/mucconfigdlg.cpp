@@ -61,8 +61,7 @@ MUCConfigDlg::MUCConfigDlg(MUCManager* manager, QWidget* parent)
     connect(manager_, SIGNAL(setConfiguration_success()), SLOT(setConfiguration_success()));
     connect(manager_, SIGNAL(setConfiguration_error(int, const QString&)), SLOT(setConfiguration_error(int, const QString&)));
     connect(manager_, SIGNAL(getItemsByAffiliation_success(MUCItem::Affiliation, const QList<MUCItem>&)), SLOT(getItemsByAffiliation_success(MUCItem::Affiliation, const QList<MUCItem>&)));
-    connect(manager_, SIGNAL(setItems_success()), SLOT(setItems_success()));
-    connect(manager_, SIGNAL(setItems_error(int, const QString&)), SLOT(setItems_error(int, const QString&)));
+    connect(manager_, SIGNAL(moderate_finished(MUCManager::Action, const QList<MUCManager::ItemResult>&)), SLOT(moderate_finished(MUCManager::Action, const QList<MUCManager::ItemResult>&)));
     connect(manager_, SIGNAL(getItemsByAffiliation_error(MUCItem::Affiliation, int, const QString&)), SLOT(getItemsByAffiliation_error(MUCItem::Affiliation, int, const QString&)));
     connect(manager_, SIGNAL(destroy_success()), SLOT(destroy_success()));
     connect(manager_, SIGNAL(destroy_error(int, const QString&)), SLOT(destroy_error(int, const QString&)));
@@ -219,7 +218,7 @@ void MUCConfigDlg::apply()
         QList<MUCItem> changes = affiliations_model_->changes();
         if (!changes.isEmpty()) {
             ui_.busy->start();
-            manager_->setItems(changes);
+            manager_->moderate(changes, MUCManager::SetAffiliation);
         }
     }
     else if (ui_.tabs->currentWidget() == ui_.tab_vcard) {
@@ -319,20 +318,26 @@ void MUCConfigDlg::getItemsByAffiliation_error(MUCItem::Affiliation a, int, cons
     }
 }
 
-void MUCConfigDlg::setItems_success()
+void MUCConfigDlg::moderate_finished(MUCManager::Action action, const QList<MUCManager::ItemResult>& results)
 {
-    if (ui_.tabs->currentWidget() == ui_.tab_affiliations) {
-        ui_.busy->stop();
-        refreshAffiliations();
+    if (action != MUCManager::SetAffiliation)
+        return;
+
+    QList<MUCItem> applied;
+    QStringList failed;
+    foreach (const MUCManager::ItemResult &r, results) {
+        if (r.error.isEmpty())
+            applied += r.item;
+        else
+            failed += r.item.jid().full();
     }
-}
-
-void MUCConfigDlg::setItems_error(int, const QString&)
-{
+    affiliations_model_->applied(applied);
     if (ui_.tabs->currentWidget() == ui_.tab_affiliations) {
         ui_.busy->stop();
-        QMessageBox::critical(this, tr("Error"), tr("There was an error setting modifying the affiliations."));
-        refreshAffiliations();
+        if (!failed.isEmpty()) {
+            QMessageBox::critical(this, tr("Error"), tr("There was an error modifying the affiliations of:\n%1").arg(failed.join("\n")));
+            refreshAffiliations();
+        }
     }
 }
 
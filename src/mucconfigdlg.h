@@ -20,6 +20,7 @@
 #ifndef MUCCONFIG_H
 #define MUCCONFIG_H
 
+#include "mucmanager.h"
 #include "ui_mucconfig.h"
 #include "xmpp_muc.h"
 
@@ -28,7 +29,6 @@
 class InfoWidget;
 class MUCAffiliationsModel;
 class MUCAffiliationsProxyModel;
-class MUCManager;
 class QScrollArea;
 class XDataWidget;
 
@@ -66,8 +66,7 @@ protected slots:
     void getConfiguration_error(int, const QString&);
     void setConfiguration_success();
     void setConfiguration_error(int, const QString&);
-    void setItems_success();
-    void setItems_error(int, const QString&);
+    void moderate_finished(MUCManager::Action, const QList<MUCManager::ItemResult>&);
     void getItemsByAffiliation_success(MUCItem::Affiliation, const QList<MUCItem>&);
     void getItemsByAffiliation_error(MUCItem::Affiliation, int, const QString&);
     void destroy_success();
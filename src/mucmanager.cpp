@@ -107,6 +107,10 @@ public:
         return affiliation_;
     }
 
+    // the items sent by set(), for the moderation batches
+    QList<MUCItem> sent;
+    int batch = -1;
+
 private:
     QDomElement iq_;
     Jid room_;
@@ -115,6 +119,10 @@ private:
     QList<MUCItem> items_;
 };
 
+// a room applies all the items of an admin query or none of them, so a
+// refused query is tried again item by item to tell which ones it refuses
+static const int maxItemsPerQuery = 50;
+
 // -----------------------------------------------------------------------------
 
 class MUCConfigurationTask : public Task
@@ -281,6 +289,77 @@ void MUCManager::getItemsByAffiliation(MUCItem::Affiliation affiliation)
     t->go(true);
 }
 
+/**
+ * Changes the roles and affiliations of many occupants at once, as done
+ * when cleaning up after a flood. Items with a role are matched by nick,
+ * the other ones by jid. They are put into as few admin queries as the
+ * room takes, which are all sent without waiting for each other, and
+ * moderate_finished() reports the outcome of every item once the last
+ * reply is in.
+ */
+void MUCManager::moderate(const QList<MUCItem>& items, Action action)
+{
+    const int batch = nextBatch_++;
+    Batch &b = batches_[batch];
+    b.action = action;
+
+    QList<MUCItem> roles, affiliations;
+    foreach (const MUCItem &item, items) {
+        if (item.role() != MUCItem::UnknownRole)
+            roles += item;
+        else
+            affiliations += item;
+    }
+    // one query never mixes roles with affiliations
+    for (const QList<MUCItem> &list : { roles, affiliations }) {
+        for (int i = 0; i < list.count(); i += maxItemsPerQuery)
+            sendModeration(batch, list.mid(i, maxItemsPerQuery));
+    }
+    if (b.pending == 0) {
+        batches_.remove(batch);
+        emit moderate_finished(action, QList<ItemResult>());
+    }
+}
+
+void MUCManager::sendModeration(int batch, const QList<MUCItem>& items)
+{
+    MUCItemsTask* t = new MUCItemsTask(room_, client()->rootTask());
+    connect(t,SIGNAL(finished()),SLOT(moderate_taskFinished()));
+    t->set(items, batches_[batch].action);
+    t->sent = items;
+    t->batch = batch;
+    ++batches_[batch].pending;
+    t->go(true);
+}
+
+void MUCManager::moderate_taskFinished()
+{
+    MUCItemsTask* t = static_cast<MUCItemsTask*>(sender());
+    auto it = batches_.find(t->batch);
+    if (it == batches_.end())
+        return;
+
+    if (t->success()) {
+        foreach (const MUCItem &item, t->sent)
+            it->results += ItemResult { item, 0, QString() };
+    }
+    else if (t->sent.count() > 1 && t->statusCode() != Task::ErrDisc) {
+        foreach (const MUCItem &item, t->sent)
+            sendModeration(t->batch, QList<MUCItem>() << item);
+    }
+    else {
+        const QString text = actionErrorText(t->action(), t->statusCode(), t->statusString());
+        foreach (const MUCItem &item, t->sent)
+            it->results += ItemResult { item, t->statusCode(), text };
+    }
+
+    if (--it->pending == 0) {
+        const Batch b = *it;
+        batches_.erase(it);
+        emit moderate_finished(b.action, b.results);
+    }
+}
+
 void MUCManager::kick(const QString& nick, const QString& reason)
 {
     setRole(nick, MUCItem::NoRole, reason, Kick);
@@ -548,41 +627,45 @@ void MUCManager::action_finished()
         emit action_success(t->action());
     }
     else {
-        QString text;
-        Action action = t->action();
-        if (t->statusCode() == 405) {
-            if (action == Kick)
-                text = tr("You are not allowed to kick this user.");
-            else if (action == Ban)
-                text = tr("You are not allowed to ban this user.");
-            else if (action == GrantVoice)
-                text = tr("You are not allowed to grant voice to this user.");
-            else if (action == RevokeVoice)
-                text = tr("You are not allowed to revoke voice from this user.");
-            else if (action == GrantMember)
-                text = tr("You are not allowed to grant membership to this user.");
-            else if (action == RevokeMember)
-                text = tr("You are not allowed to revoke membership from this user.");
-            else if (action == GrantModerator)
-                text = tr("You are not allowed to grant moderator privileges to this user.");
-            else if (action == RevokeModerator)
-                text = tr("You are not allowed to revoke moderator privileges from this user.");
-            else if (action == GrantAdmin)
-                text = tr("You are not allowed to grant administrative privileges to this user.");
-            else if (action == RevokeAdmin)
-                text = tr("You are not allowed to revoke administrative privileges from this user.");
-            else if (action == GrantOwner)
-                text = tr("You are not allowed to grant ownership privileges to this user.");
-            else if (action == RevokeOwner)
-                text = tr("You are not allowed to revoke ownership privileges from this user.");
-            else
-                text = tr("You are not allowed to perform this operation.");
-        }
-        else {
-            text = tr("Failed to perform operation: ") + t->statusString();
-        }
-        emit action_error(t->action(), t->statusCode(), text);
+        emit action_error(t->action(), t->statusCode(), actionErrorText(t->action(), t->statusCode(), t->statusString()));
+    }
+}
+
+QString MUCManager::actionErrorText(Action action, int code, const QString& status)
+{
+    QString text;
+    if (code == 405) {
+        if (action == Kick)
+            text = tr("You are not allowed to kick this user.");
+        else if (action == Ban)
+            text = tr("You are not allowed to ban this user.");
+        else if (action == GrantVoice)
+            text = tr("You are not allowed to grant voice to this user.");
+        else if (action == RevokeVoice)
+            text = tr("You are not allowed to revoke voice from this user.");
+        else if (action == GrantMember)
+            text = tr("You are not allowed to grant membership to this user.");
+        else if (action == RevokeMember)
+            text = tr("You are not allowed to revoke membership from this user.");
+        else if (action == GrantModerator)
+            text = tr("You are not allowed to grant moderator privileges to this user.");
+        else if (action == RevokeModerator)
+            text = tr("You are not allowed to revoke moderator privileges from this user.");
+        else if (action == GrantAdmin)
+            text = tr("You are not allowed to grant administrative privileges to this user.");
+        else if (action == RevokeAdmin)
+            text = tr("You are not allowed to revoke administrative privileges from this user.");
+        else if (action == GrantOwner)
+            text = tr("You are not allowed to grant ownership privileges to this user.");
+        else if (action == RevokeOwner)
+            text = tr("You are not allowed to revoke ownership privileges from this user.");
+        else
+            text = tr("You are not allowed to perform this operation.");
+    }
+    else {
+        text = tr("Failed to perform operation: ") + status;
     }
+    return text;
 }
 
 void MUCManager::getItemsByAffiliation_finished()
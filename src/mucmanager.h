@@ -23,6 +23,7 @@
 #include "xmpp_jid.h"
 #include "xmpp_muc.h"
 
+#include <QHash>
 #include <QObject>
 
 class PsiAccount;
@@ -49,6 +50,13 @@ public:
         SetRole, SetAffiliation
     };
 
+    // the outcome of one item of moderate(), code and error are unset on success
+    struct ItemResult {
+        MUCItem item;
+        int code = 0;
+        QString error;
+    };
+
     MUCManager(PsiAccount* account, const Jid&);
 
     const Jid& room() const;
@@ -77,6 +85,7 @@ public:
     void revokeAdmin(const Jid&, const QString& = QString());
     void setRole(const QString&, MUCItem::Role, const QString& = QString(), Action = Unknown);
     void setAffiliation(const Jid&, MUCItem::Affiliation, const QString& = QString(), Action = Unknown);
+    void moderate(const QList<MUCItem>&, Action = Unknown);
 
     // Tests
     static QString roleToString(XMPP::MUCItem::Role, bool p = false);
@@ -110,6 +119,7 @@ signals:
 
     void action_success(MUCManager::Action);
     void action_error(MUCManager::Action, int, const QString&);
+    void moderate_finished(MUCManager::Action, const QList<MUCManager::ItemResult>&);
 
 protected slots:
     void getConfiguration_finished();
@@ -118,10 +128,22 @@ protected slots:
     void action_finished();
     void getItemsByAffiliation_finished();
     void setItems_finished();
+    void moderate_taskFinished();
 
 private:
+    struct Batch {
+        Action action = Unknown;
+        int pending = 0; // queries without a reply yet
+        QList<ItemResult> results;
+    };
+
+    void sendModeration(int batch, const QList<MUCItem>&);
+    static QString actionErrorText(Action, int, const QString&);
+
     PsiAccount* account_;
     Jid room_;
+    QHash<int, Batch> batches_;
+    int nextBatch_ = 0;
 };
 
 #endif // MUCMANAGER_H
@@ -19,11 +19,14 @@
 
 #include "multifiletransferitem.h"
 
-#include <QContiguousCache>
 #include <QDateTime>
 #include <QElapsedTimer>
 #include <QIcon>
 
+#include <cmath>
+
+static const double speedSmoothing = 2000.0; // msecs, time constant of the speed average
+
 struct MultiFileTransferItem::Private
 {
     QString       displayName;       // usually base filename
@@ -37,11 +40,12 @@ struct MultiFileTransferItem::Private
     quint64       lastSize = 0;
     quint64       offset = 0; // initial offset if only part of file is transferred
     quint32       timeRemaining = 0; // secs
-    quint32       speed; // bytes per second
+    quint32       speed = 0; // bytes per second
+    double        smoothSpeed = 0;   // bytes per second, unrounded
+    bool          sizeChanged = false; // since the last updateStats()
     MultiFileTransferModel::Direction direction;
     MultiFileTransferModel::State    state = MultiFileTransferModel::State::Pending;
     QIcon         thumbnail;
-    QContiguousCache<quint32>         lastSpeeds = QContiguousCache<quint32>(5);      // bytes per second
     QElapsedTimer lastTimer;         // last speed value update
 };
 
@@ -147,7 +151,12 @@ QIcon MultiFileTransferItem::thumbnail() const
 void MultiFileTransferItem::setCurrentSize(quint64 newCurrentSize)
 {
     d->currentSize = newCurrentSize;
-    emit updated();
+    // progress comes in for every chunk, the model only needs to hear about
+    // it once until it picks up the stats
+    if (!d->sizeChanged) {
+        d->sizeChanged = true;
+        emit updated();
+    }
 }
 
 void MultiFileTransferItem::setThumbnail(const QIcon &img)
@@ -210,20 +219,19 @@ void MultiFileTransferItem::setOffset(quint64 offset)
 
 void MultiFileTransferItem::updateStats()
 {
+    d->sizeChanged = false;
     auto elapsed = d->lastTimer.elapsed();
-    if (!elapsed) {
+    if (!elapsed || d->state != MultiFileTransferModel::Active) {
         return;
     }
     double speedf = double(d->currentSize - d->lastSize) * 1000.0 / double(elapsed); // bytes per second
-    d->lastSpeeds.append(uint(speedf));
 
-    quint64 sum = 0;
-    for (int i = d->lastSpeeds.firstIndex(); i < d->lastSpeeds.lastIndex(); i++) {
-        sum += d->lastSpeeds.at(i);
-    }
-    d->speed = quint32(sum / qulonglong(d->lastSpeeds.size()));
+    // exponential average over time, so it doesn't depend on how often we are called
+    double weight = 1.0 - std::exp(-double(elapsed) / speedSmoothing);
+    d->smoothSpeed = d->smoothSpeed > 0 ? d->smoothSpeed + (speedf - d->smoothSpeed) * weight : speedf;
+    d->speed = quint32(d->smoothSpeed);
 
-    d->timeRemaining = quint32((d->fullSize - d->currentSize) / speedf);
+    d->timeRemaining = d->speed ? quint32((d->fullSize - d->currentSize) / d->speed) : 0;
     d->lastSize = d->currentSize;
     d->lastTimer.start();
 }
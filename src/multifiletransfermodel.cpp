@@ -32,16 +32,22 @@ MultiFileTransferModel::MultiFileTransferModel(QObject *parent) :
     QAbstractListModel(parent)
 {
     updateTimer.setSingleShot(true);
-    updateTimer.setInterval(1000);
+    updateTimer.setInterval(100); // no more than 10 repaints a second
     connect(&updateTimer, &QTimer::timeout, this, [this](){
         auto s = updatedTransfers;
         updatedTransfers.clear();
-        for (const auto &v: s) {
-            v->updateStats();
-            int row = transfers.indexOf(v); // what about thousands of active transfers? probably we can build a map from trasfers
-            if (row >= 0) {
-                auto ind = index(row, 0, QModelIndex());
-                emit dataChanged(ind, ind);
+        // one pass over the rows, neighbouring updated rows go out as one range
+        int first = -1;
+        for (int row = 0; row <= transfers.size(); row++) {
+            bool changed = row < transfers.size() && s.contains(transfers[row]);
+            if (changed) {
+                transfers[row]->updateStats();
+                if (first < 0) {
+                    first = row;
+                }
+            } else if (first >= 0) {
+                emit dataChanged(index(first, 0, QModelIndex()), index(row - 1, 0, QModelIndex()));
+                first = -1;
             }
         }
     });
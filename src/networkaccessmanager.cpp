@@ -20,20 +20,37 @@
 
 #include "networkaccessmanager.h"
 
+#include "applicationinfo.h"
 #include "bytearrayreply.h"
+#include "filecache.h"
 
 #include <QCoreApplication>
+#include <QNetworkDiskCache>
 
 NetworkAccessManager::NetworkAccessManager(QObject *parent)
     : QNetworkAccessManager(parent)
     , _handlerSeed(0)
 {
+    // images and previews in chats are fetched again every time a chat is opened.
+    // stale entries are revalidated with If-None-Match / If-Modified-Since.
+    QNetworkDiskCache *diskCache = new QNetworkDiskCache(this);
+    diskCache->setCacheDirectory(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + QLatin1String("/http"));
+    diskCache->setMaximumCacheSize(FileCache::DefaultFileCacheSize);
+    setCache(diskCache);
 }
 
 QNetworkReply *NetworkAccessManager::createRequest(Operation op, const QNetworkRequest & req,
                                                    QIODevice * outgoingData = nullptr)
 {
     if (req.url().host() != QLatin1String("psi")) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+        // one multiplexed connection per host instead of up to six
+        if (req.url().scheme() == QLatin1String("https") && !req.attribute(QNetworkRequest::HTTP2AllowedAttribute).isValid()) {
+            QNetworkRequest r(req);
+            r.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+            return QNetworkAccessManager::createRequest(op, r, outgoingData);
+        }
+#endif
         return QNetworkAccessManager::createRequest(op, req, outgoingData);
     }
 
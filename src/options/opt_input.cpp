@@ -1,5 +1,6 @@
 #include "opt_input.h"
 
+#include "chatspellchecker.h"
 #include "psioptions.h"
 #include "spellchecker/spellchecker.h"
 #include "ui_opt_input.h"
@@ -40,8 +41,21 @@ QWidget *OptionsTabInput::widget()
     w_ = new OptInputUI();
     OptInputUI *d = static_cast<OptInputUI *>(w_);
 
-    availableDicts_ = SpellChecker::instance()->getAllLanguages();
+    // the dictionaries are listed on the spell checker's worker
+    ChatSpellChecker *checker = ChatSpellChecker::instance();
+    availableDicts_ = checker->availableLanguages();
     defaultLangs_ = LanguageManager::bestUiMatch(availableDicts_).toSet();
+    connect(checker, &ChatSpellChecker::languagesListed, w_, [this, checker]() {
+        if (checker->availableLanguages() == availableDicts_) {
+            return;
+        }
+        availableDicts_ = checker->availableLanguages();
+        defaultLangs_ = LanguageManager::bestUiMatch(availableDicts_).toSet();
+        restoreOptions();
+    });
+    if (!checker->hasLanguageList()) {
+        checker->listLanguages();
+    }
 
     d->isSpellCheck->setWhatsThis(tr("Check this option if you want your spelling to be checked"));
 
@@ -61,7 +75,7 @@ void OptionsTabInput::applyOptions()
 
     OptInputUI *d = static_cast<OptInputUI *>(w_);
     PsiOptions* o = PsiOptions::instance();
-    SpellChecker *s = SpellChecker::instance();
+    ChatSpellChecker *s = ChatSpellChecker::instance();
 
     bool isEnabled = d->isSpellCheck->isChecked();
     o->setOption(ENABLED_OPTION, isEnabled);
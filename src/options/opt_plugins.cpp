@@ -4,6 +4,7 @@
 #include "iconwidget.h"
 #include "optionsdlgbase.h"
 #include "pluginmanager.h"
+#include "pluginworkerpool.h"
 #include "psicon.h"
 #include "psiiconset.h"
 #include "psioptions.h"
@@ -207,6 +208,9 @@ void OptionsTabPlugins::showPluginInfo(int item)
         infoDialog->setWindowTitle(QString("%1 %2").arg(infoDialog->windowTitle()).arg(name));
         infoDialog->setWindowIcon(QIcon(IconsetFactory::iconPixmap("psi/logo_128")));
         ui_.te_info->setText(PluginManager::instance()->pluginInfo(name));
+        const QString jobs = PluginWorkerPool::instance()->summary(name);
+        if (!jobs.isEmpty())
+            ui_.te_info->append(jobs);
         infoDialog->setAttribute(Qt::WA_DeleteOnClose);
         infoDialog->show();
     }
@@ -234,10 +234,11 @@ void OptionsDlgBase::Private::setTabs(QList<OptionsTab*> t)
         if ( opttab->id().isEmpty() )
             continue;
 
+        // don't make the item current, that would create the tab's widget.
+        // widgets are created when their tab is opened
         dlg->lv_tabs->addItem(opttab->tabName());
         QListWidgetItem* item = dlg->lv_tabs->item(dlg->lv_tabs->count() - 1);
-        dlg->lv_tabs->setCurrentItem(item);
-        QModelIndex index = dlg->lv_tabs->currentIndex();
+        QModelIndex index = dlg->lv_tabs->model()->index(dlg->lv_tabs->count() - 1, 0);
         if (opttab->tabIcon())
             item->setData(Qt::DecorationRole, opttab->tabIcon()->icon());
         item->setData(Qt::UserRole, opttab->id());
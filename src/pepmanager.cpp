@@ -428,8 +428,15 @@ private:
 
 // -----------------------------------------------------------------------------
 
+// Events arriving within this window are merged into one delivery, so the
+// login flood results in a single update per contact.
+static const int pepDeliverDelay = 250; // msecs
+
 PEPManager::PEPManager(Client* client, ServerInfoManager* serverInfo) : client_(client), serverInfo_(serverInfo)
 {
+    deliverTimer_.setSingleShot(true);
+    deliverTimer_.setInterval(pepDeliverDelay);
+    connect(&deliverTimer_, SIGNAL(timeout()), SLOT(deliverPending()));
     connect(client_, SIGNAL(messageReceived(const Message &)), SLOT(messageReceived(const Message &)));
 }
 
@@ -588,10 +595,49 @@ void PEPManager::messageReceived(const Message& m)
 {
     if (m.type() != "error") {
         foreach(PubSubRetraction i, m.pubsubRetractions()) {
+            // don't deliver a queued item after its retraction
+            auto pit = pendingItems_.find(m.from().full());
+            if (pit != pendingItems_.end()) {
+                auto iit = pit->find(m.pubsubNode());
+                if (iit != pit->end() && iit->id() == i.id()) {
+                    pit->erase(iit);
+                }
+            }
             emit itemRetracted(m.from(),m.pubsubNode(), i);
         }
         foreach(PubSubItem i, m.pubsubItems()) {
-            emit itemPublished(m.from(),m.pubsubNode(),i);
+            queueItem(m.from(),m.pubsubNode(),i);
+        }
+    }
+}
+
+void PEPManager::queueItem(const Jid& jid, const QString& node, const PubSubItem& item)
+{
+    const QString key = jid.full();
+    auto it = pendingItems_.find(key);
+    if (it == pendingItems_.end()) {
+        pendingOrder_.append(key);
+        it = pendingItems_.insert(key, PEPItems());
+    }
+    it->insert(node, item); // only the latest one per node matters
+
+    // not restarted on purpose: a steady stream must not starve consumers
+    if (!deliverTimer_.isActive()) {
+        deliverTimer_.start();
+    }
+}
+
+void PEPManager::deliverPending()
+{
+    QStringList order;
+    QHash<QString, PEPItems> items;
+    order.swap(pendingOrder_);
+    items.swap(pendingItems_);
+
+    foreach (const QString &key, order) {
+        const PEPItems &nodes = items[key];
+        if (!nodes.isEmpty()) {
+            emit itemsPublished(Jid(key), nodes);
         }
     }
 }
@@ -616,7 +662,7 @@ void PEPManager::getFinished()
         // Act as if the item was published. This is a convenience
         // implementation, probably should be changed later.
         if (!task->items().isEmpty()) {
-            emit itemPublished(task->jid(),task->node(),task->items().first());
+            queueItem(task->jid(),task->node(),task->items().first());
         }
     }
     else {
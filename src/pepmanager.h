@@ -20,7 +20,13 @@
 #ifndef PEPMANAGER_H
 #define PEPMANAGER_H
 
+#include "xmpp_pubsubitem.h"
+
+#include <QHash>
+#include <QMap>
 #include <QObject>
+#include <QStringList>
+#include <QTimer>
 
 class PubSubSubscription;
 class QString;
@@ -29,12 +35,14 @@ namespace XMPP {
     class Client;
     class Jid;
     class Message;
-    class PubSubItem;
     class PubSubRetraction;
     class ServerInfoManager;
 }
 using namespace XMPP;
 
+// node -> latest item
+typedef QMap<QString, PubSubItem> PEPItems;
+
 class PEPManager : public QObject
 {
     Q_OBJECT
@@ -65,7 +73,7 @@ public:
 signals:
     void publish_success(const QString&, const PubSubItem&);
     void publish_error(const QString&, const PubSubItem&);
-    void itemPublished(const Jid& jid, const QString& node, const PubSubItem&);
+    void itemsPublished(const Jid& jid, const PEPItems& items);
     void itemRetracted(const Jid& jid, const QString& node, const PubSubRetraction&);
     //void ready(const QString& node);
     //void getSubscriptions_success(const Jid& jid, const QList<PubSubSubscription>& subscriptions);
@@ -79,6 +87,7 @@ protected slots:
     //void getSelfSubscriptionsTaskFinished();
     //void getSubscriptionsTaskFinished();
     void publishFinished();
+    void deliverPending();
     //void subscribeFinished();
     //void unsubscribeFinished();
     //void createFinished();
@@ -86,11 +95,16 @@ protected slots:
 protected:
     //void createNode(const QString& node);
     //void saveSubscriptions();
+    void queueItem(const Jid& jid, const QString& node, const PubSubItem& item);
 
 private:
     XMPP::Client* client_;
     ServerInfoManager* serverInfo_;
 
+    QTimer deliverTimer_;
+    QStringList pendingOrder_; // full jids in arrival order
+    QHash<QString, PEPItems> pendingItems_;
+
     //QStringList nodes_, ensured_nodes_;
 };
 
@@ -107,35 +107,26 @@ PGPKeyDlg::PGPKeyDlg(Type t, const QString& defaultKeyID, QWidget *parent)
     KeyViewItem* selectedItem = nullptr;
     int row = 0;
 
-    foreach(QCA::KeyStore *ks, PGPUtil::instance().keystores_) {
-        if (ks->type() == QCA::KeyStore::PGPKeyring && ks->holdsIdentities()) {
-            foreach(QCA::KeyStoreEntry ke, ks->entryList()) {
-                bool publicKey = (t == Public && ke.type() == QCA::KeyStoreEntry::TypePGPPublicKey) ||
-                    (ke.type() == QCA::KeyStoreEntry::TypePGPSecretKey);
-                bool secretKey = t == Secret && ke.type() == QCA::KeyStoreEntry::TypePGPSecretKey;
-                if (publicKey || secretKey) {
-                    KeyViewItem *i = new KeyViewItem(ke,  ke.id().right(8));
-                    KeyViewItem *i2 = new KeyViewItem(ke, ke.name());
-                    QStandardItem* root = model_->invisibleRootItem();
-                    root->setChild(row, 0, i);
-                    root->setChild(row, 1, i2);
-                    ++row;
-
-                    QString keyId;
-                    if (publicKey)
-                        keyId = ke.pgpPublicKey().keyId();
-                    else
-                        keyId = ke.pgpSecretKey().keyId();
-
-                    if (!defaultKeyID.isEmpty() && keyId == defaultKeyID) {
-                        selectedItem = i;
-                    }
-
-                    if (!firstItem) {
-                        firstItem = i;
-                    }
-                }
-            }
+    foreach(QCA::KeyStoreEntry ke, PGPUtil::instance().findKeys(QString(), t == Secret)) {
+        KeyViewItem *i = new KeyViewItem(ke,  ke.id().right(8));
+        KeyViewItem *i2 = new KeyViewItem(ke, ke.name());
+        QStandardItem* root = model_->invisibleRootItem();
+        root->setChild(row, 0, i);
+        root->setChild(row, 1, i2);
+        ++row;
+
+        QString keyId;
+        if (t == Public)
+            keyId = ke.pgpPublicKey().keyId();
+        else
+            keyId = ke.pgpSecretKey().keyId();
+
+        if (!defaultKeyID.isEmpty() && keyId == defaultKeyID) {
+            selectedItem = i;
+        }
+
+        if (!firstItem) {
+            firstItem = i;
         }
     }
 
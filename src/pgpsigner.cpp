@@ -0,0 +1,163 @@
+/*
+ * pgpsigner.cpp - shared detached signing of presence
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pgpsigner.h"
+
+#include "pgptransaction.h"
+#include "pgputil.h"
+
+#include <QCoreApplication>
+
+static const int cacheSize = 200; // signatures
+
+PGPSigner *PGPSigner::instance()
+{
+    static PGPSigner *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new PGPSigner();
+    }
+    return instance_;
+}
+
+PGPSigner::PGPSigner() :
+    QObject(QCoreApplication::instance()),
+    cache_(cacheSize)
+{
+    // a removed or replaced key must not sign anymore
+    connect(&PGPUtil::instance(), SIGNAL(pgpKeysUpdated()), SLOT(clearCache()));
+}
+
+QString PGPSigner::cacheKey(const QCA::PGPKey &key, const QString &text)
+{
+    return key.keyId() + QLatin1Char('\n') + text;
+}
+
+/**
+ * Calls \a callback with the signature of \a text, right away if \a key
+ * signed the same text before.
+ */
+void PGPSigner::sign(const QCA::PGPKey &key, const QString &text, QObject *context, const Callback &callback)
+{
+    const QString ck = cacheKey(key, text);
+    if (QString *signature = cache_.object(ck)) {
+        Result r;
+        r.success = true;
+        r.signature = *signature;
+        callback(r);
+        return;
+    }
+
+    Waiter w;
+    w.context = context;
+    w.callback = callback;
+    auto it = requests_.find(ck);
+    const bool running = it != requests_.end();
+    if (!running) {
+        Request req;
+        req.key = key;
+        req.text = text;
+        it = requests_.insert(ck, req);
+    }
+    it->waiters.append(w);
+    if (!running)
+        start(ck);
+}
+
+/**
+ * Runs gpg one text at a time for what isn't cached or signed already, so
+ * a status change to one of the \a texts goes out at once.
+ */
+void PGPSigner::presign(const QCA::PGPKey &key, const QStringList &texts)
+{
+    if (key.isNull() || !unlockedKeys_.contains(key.keyId()))
+        return;
+    for (const QString &text : texts)
+        presignQueue_.append(qMakePair(key, text));
+    presignNext();
+}
+
+void PGPSigner::presignNext()
+{
+    while (presignRunning_.isEmpty() && !presignQueue_.isEmpty()) {
+        const auto next = presignQueue_.takeFirst();
+        const QString ck = cacheKey(next.first, next.second);
+        if (!unlockedKeys_.contains(next.first.keyId()) || cache_.contains(ck) || requests_.contains(ck))
+            continue;
+        Request req;
+        req.key = next.first;
+        req.text = next.second;
+        requests_.insert(ck, req);
+        presignRunning_ = ck;
+        start(ck);
+    }
+}
+
+void PGPSigner::start(const QString &ck)
+{
+    const Request &req = requests_[ck];
+    QCA::SecureMessageKey skey;
+    skey.setPGPSecretKey(req.key);
+    PGPTransaction *t = new PGPTransaction(new QCA::OpenPGP());
+    connect(t, SIGNAL(finished()), SLOT(transactionFinished()));
+    running_.insert(t, ck);
+    t->setFormat(QCA::SecureMessage::Ascii);
+    t->setSigner(skey);
+    t->startSign(QCA::SecureMessage::Detached);
+    t->update(req.text.toUtf8());
+    t->end();
+}
+
+void PGPSigner::transactionFinished()
+{
+    PGPTransaction *t = static_cast<PGPTransaction *>(sender());
+    const QString ck = running_.take(t);
+    const Request req = requests_.take(ck);
+
+    Result r;
+    r.success = t->success();
+    if (r.success) {
+        r.signature = PGPUtil::instance().stripHeaderFooter(QString(t->signature()));
+        cache_.insert(ck, new QString(r.signature));
+        unlockedKeys_.insert(req.key.keyId());
+    } else {
+        // a wrong passphrase or a key gone from gpg, ask again next time
+        r.error = t->errorCode();
+        r.diagnostic = t->diagnosticText();
+        unlockedKeys_.remove(req.key.keyId());
+    }
+    t->deleteLater();
+
+    for (const Waiter &w : req.waiters) {
+        if (w.context) {
+            w.callback(r);
+        }
+    }
+
+    if (ck == presignRunning_) {
+        presignRunning_.clear();
+        presignNext();
+    }
+}
+
+void PGPSigner::clearCache()
+{
+    cache_.clear();
+    unlockedKeys_.clear();
+    presignQueue_.clear();
+}
@@ -0,0 +1,94 @@
+/*
+ * pgpsigner.h - shared detached signing of presence
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PGPSIGNER_H
+#define PGPSIGNER_H
+
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QStringList>
+#include <QtCrypto>
+#include <functional>
+
+class PGPTransaction;
+
+/**
+ * Signs the status text of presence stanzas for all accounts. Signatures
+ * are cached by key and text, so accounts sharing a key and the same
+ * status sent again don't run gpg, and identical requests in flight share
+ * one run. Once a key signed successfully, and so its passphrase is
+ * known, texts likely to come can be signed ahead in the background.
+ */
+class PGPSigner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result
+    {
+        bool success = false;
+        QString signature; // without the armor header and footer
+        QCA::SecureMessage::Error error = QCA::SecureMessage::ErrorUnknown;
+        QString diagnostic;
+    };
+    typedef std::function<void(const Result &result)> Callback;
+
+    static PGPSigner *instance();
+
+    // the callback is dropped if context is deleted before the result is known
+    void sign(const QCA::PGPKey &key, const QString &text, QObject *context, const Callback &callback);
+    // signs the texts not cached yet, if the key signed before without errors
+    void presign(const QCA::PGPKey &key, const QStringList &texts);
+
+private slots:
+    void transactionFinished();
+    void clearCache();
+
+private:
+    struct Waiter
+    {
+        QPointer<QObject> context;
+        Callback callback;
+    };
+
+    struct Request
+    {
+        QCA::PGPKey key;
+        QString text;
+        QList<Waiter> waiters;
+    };
+
+    PGPSigner();
+    static QString cacheKey(const QCA::PGPKey &key, const QString &text);
+    void start(const QString &key);
+    void presignNext();
+
+    QCache<QString, QString> cache_;
+    QHash<QString, Request> requests_;
+    QHash<PGPTransaction *, QString> running_;
+    QSet<QString> unlockedKeys_; // key ids
+    QList<QPair<QCA::PGPKey, QString>> presignQueue_;
+    QString presignRunning_; // cache key of the one gpg run at a time for presign()
+};
+
+#endif // PGPSIGNER_H
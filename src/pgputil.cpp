@@ -6,12 +6,15 @@
 #include <QDialog>
 #include <QMessageBox>
 #include <QStringList>
+#include <QtConcurrentRun>
 #include <QtCore>
 
 PGPUtil* PGPUtil::instance_ = nullptr;
 
-PGPUtil::PGPUtil() : qcaEventHandler_(nullptr), passphraseDlg_(nullptr), cache_no_pgp_(false)
+PGPUtil::PGPUtil() : qcaEventHandler_(nullptr), passphraseDlg_(nullptr), cache_no_pgp_(false),
+    keyIndexReady_(false), keyIndexDirty_(false)
 {
+    connect(&keyIndexWatcher_, SIGNAL(finished()), SLOT(keyIndexBuilt()));
     qcaEventHandler_ = new QCA::EventHandler(this);
     connect(qcaEventHandler_,SIGNAL(eventReady(int,const QCA::Event&)),SLOT(handleEvent(int,const QCA::Event&)));
     qcaEventHandler_->start();
@@ -25,6 +28,7 @@ PGPUtil::PGPUtil() : qcaEventHandler_(nullptr), passphraseDlg_(nullptr), cache_n
 
 PGPUtil::~PGPUtil()
 {
+    keyIndexWatcher_.waitForFinished();
     foreach(QCA::KeyStore* ks,keystores_)  {
         delete ks;
     }
@@ -197,8 +201,73 @@ QString PGPUtil::addHeaderFooter(const QString &str, int type)
     return s;
 }
 
+/**
+ * Listing a keyring makes the backend run gpg, so all keys are indexed on
+ * a worker thread whenever a keystore appears or changes. Until the first
+ * index is done, lookups fall back to asking the keystores directly.
+ */
+PGPUtil::KeyIndex PGPUtil::buildKeyIndex(const QList<QCA::KeyStore*>& keystores)
+{
+    KeyIndex index;
+    foreach(QCA::KeyStore *ks, keystores) {
+        if (ks->type() == QCA::KeyStore::PGPKeyring && ks->holdsIdentities()) {
+            foreach(QCA::KeyStoreEntry ke, ks->entryList()) {
+                if (ke.type() == QCA::KeyStoreEntry::TypePGPSecretKey) {
+                    if (!index.secretKeys.contains(ke.pgpSecretKey().keyId()))
+                        index.secretKeys.insert(ke.pgpSecretKey().keyId(), ke);
+                } else if (ke.type() != QCA::KeyStoreEntry::TypePGPPublicKey) {
+                    continue;
+                }
+                if (!index.publicKeys.contains(ke.pgpPublicKey().keyId()))
+                    index.publicKeys.insert(ke.pgpPublicKey().keyId(), ke);
+                index.entries.append(ke);
+            }
+        }
+    }
+    return index;
+}
+
+void PGPUtil::updateKeyIndex()
+{
+    if (keyIndexWatcher_.isRunning()) {
+        keyIndexDirty_ = true;
+        return;
+    }
+    keyIndexDirty_ = false;
+    keyIndexWatcher_.setFuture(QtConcurrent::run(&PGPUtil::buildKeyIndex, keystores_.toList()));
+}
+
+void PGPUtil::keyIndexBuilt()
+{
+    if (keyIndexDirty_) {
+        updateKeyIndex();
+        return;
+    }
+    keyIndex_ = keyIndexWatcher_.result();
+    keyIndexReady_ = true;
+    emit pgpKeysUpdated();
+}
+
+QList<QCA::KeyStoreEntry> PGPUtil::findKeys(const QString& text, bool secretOnly)
+{
+    const QList<QCA::KeyStoreEntry> entries = keyIndexReady_ ? keyIndex_.entries
+                                                            : buildKeyIndex(keystores_.toList()).entries;
+    QList<QCA::KeyStoreEntry> res;
+    foreach(const QCA::KeyStoreEntry &ke, entries) {
+        if (secretOnly && ke.type() != QCA::KeyStoreEntry::TypePGPSecretKey)
+            continue;
+        if (!text.isEmpty() && !ke.id().contains(text, Qt::CaseInsensitive)
+            && !ke.name().contains(text, Qt::CaseInsensitive))
+            continue;
+        res.append(ke);
+    }
+    return res;
+}
+
 QCA::KeyStoreEntry PGPUtil::getSecretKeyStoreEntry(const QString& keyID)
 {
+    if (keyIndexReady_)
+        return keyIndex_.secretKeys.value(keyID);
     foreach(QCA::KeyStore *ks, keystores_) {
         if (ks->type() == QCA::KeyStore::PGPKeyring && ks->holdsIdentities()) {
             foreach(QCA::KeyStoreEntry ke, ks->entryList()) {
@@ -214,6 +283,8 @@ QCA::KeyStoreEntry PGPUtil::getSecretKeyStoreEntry(const QString& keyID)
 
 QCA::KeyStoreEntry PGPUtil::getPublicKeyStoreEntry(const QString& keyID)
 {
+    if (keyIndexReady_)
+        return keyIndex_.publicKeys.value(keyID);
     foreach(QCA::KeyStore *ks, keystores_) {
         if (ks->type() == QCA::KeyStore::PGPKeyring && ks->holdsIdentities()) {
             foreach(QCA::KeyStoreEntry ke, ks->entryList()) {
@@ -288,8 +359,10 @@ void PGPUtil::addPassphrase(const QString &id, const QString &pass)
 void PGPUtil::keyStoreAvailable(const QString& k)
 {
     QCA::KeyStore* ks = new QCA::KeyStore(k, &qcaKeyStoreManager_);
-    connect(ks, SIGNAL(updated()), SIGNAL(pgpKeysUpdated()));
+    // pgpKeysUpdated() is emitted once the index has caught up
+    connect(ks, SIGNAL(updated()), SLOT(updateKeyIndex()));
     keystores_ += ks;
+    updateKeyIndex();
 }
 
 void PGPUtil::showDiagnosticText(const QString& event, const QString& diagnostic)
@@ -3,6 +3,8 @@
 
 // FIXME: instead of a singleton, make it a member of PsiCon.
 
+#include <QFutureWatcher>
+#include <QHash>
 #include <QList>
 #include <QMap>
 #include <QSet>
@@ -31,6 +33,8 @@ public:
 
     QCA::KeyStoreEntry getSecretKeyStoreEntry(const QString& key);
     QCA::KeyStoreEntry getPublicKeyStoreEntry(const QString& key);
+    // keys whose ID or user ID contains text; all keys if it is empty
+    QList<QCA::KeyStoreEntry> findKeys(const QString& text, bool secretOnly);
 
     QString stripHeaderFooter(const QString &);
     QString addHeaderFooter(const QString &, int);
@@ -56,10 +60,19 @@ protected slots:
     void handleEvent(int id, const QCA::Event& event);
     void passphraseDone(int);
     void keyStoreAvailable(const QString&);
+    void updateKeyIndex();
+    void keyIndexBuilt();
 
 private:
     static PGPUtil* instance_;
 
+    struct KeyIndex {
+        QList<QCA::KeyStoreEntry> entries;
+        QHash<QString, QCA::KeyStoreEntry> publicKeys;
+        QHash<QString, QCA::KeyStoreEntry> secretKeys;
+    };
+    static KeyIndex buildKeyIndex(const QList<QCA::KeyStore*>& keystores);
+
     struct EventItem {
         int id;
         QCA::Event event;
@@ -75,8 +88,10 @@ private:
     QString currentEntryId_;
     bool cache_no_pgp_;
 
-    // FIXME
-    friend class PGPKeyDlg;
+    KeyIndex keyIndex_;
+    bool keyIndexReady_;
+    bool keyIndexDirty_;
+    QFutureWatcher<KeyIndex> keyIndexWatcher_;
 };
 
 #endif // PGPUTIL_H
@@ -0,0 +1,119 @@
+/*
+ * pgpverifier.cpp - shared, cached verification of signed presence
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pgpverifier.h"
+
+#include "pgptransaction.h"
+#include "pgputil.h"
+
+#include <QCoreApplication>
+
+static const int cacheSize  = 2000; // signatures
+static const int maxRunning = 3;    // gpg processes at a time
+
+PGPVerifier *PGPVerifier::instance()
+{
+    static PGPVerifier *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new PGPVerifier();
+    }
+    return instance_;
+}
+
+PGPVerifier::PGPVerifier() :
+    QObject(QCoreApplication::instance()),
+    cache_(cacheSize)
+{
+    // an imported or removed key changes what a signature verifies to
+    connect(&PGPUtil::instance(), SIGNAL(pgpKeysUpdated()), SLOT(clearCache()));
+}
+
+QString PGPVerifier::cacheKey(const QString &signature, const QString &text)
+{
+    return signature + QLatin1Char('\n') + text;
+}
+
+/**
+ * Calls \a callback with the result, right away if the same signature over
+ * the same text was verified before.
+ */
+void PGPVerifier::verify(const QString &signature, const QString &text, QObject *context, const Callback &callback)
+{
+    const QString key = cacheKey(signature, text);
+    if (Result *r = cache_.object(key)) {
+        callback(r->success, r->signer);
+        return;
+    }
+
+    Waiter w;
+    w.context = context;
+    w.callback = callback;
+    auto it = requests_.find(key);
+    if (it == requests_.end()) {
+        Request req;
+        req.signature = signature;
+        req.text = text;
+        it = requests_.insert(key, req);
+        queue_.append(key);
+    }
+    it->waiters.append(w);
+    startNext();
+}
+
+void PGPVerifier::startNext()
+{
+    while (running_.size() < maxRunning && !queue_.isEmpty()) {
+        const QString key = queue_.takeFirst();
+        const Request &req = requests_[key];
+        PGPTransaction *t = new PGPTransaction(new QCA::OpenPGP());
+        connect(t, SIGNAL(finished()), SLOT(transactionFinished()));
+        running_.insert(t, key);
+        t->startVerify(PGPUtil::instance().addHeaderFooter(req.signature, 1).toUtf8());
+        t->update(req.text.toUtf8());
+        t->end();
+    }
+}
+
+void PGPVerifier::transactionFinished()
+{
+    PGPTransaction *t = static_cast<PGPTransaction *>(sender());
+    const QString key = running_.take(t);
+    const Request req = requests_.take(key);
+
+    Result r;
+    r.success = t->success();
+    if (r.success) {
+        r.signer = t->signer();
+        cache_.insert(key, new Result(r));
+    }
+    // failures are not cached, as they may come from gpg itself
+    t->deleteLater();
+
+    for (const Waiter &w : req.waiters) {
+        if (w.context) {
+            w.callback(r.success, r.signer);
+        }
+    }
+    startNext();
+}
+
+void PGPVerifier::clearCache()
+{
+    cache_.clear();
+}
@@ -0,0 +1,86 @@
+/*
+ * pgpverifier.h - shared, cached verification of signed presence
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PGPVERIFIER_H
+#define PGPVERIFIER_H
+
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QtCrypto>
+#include <functional>
+
+class PGPTransaction;
+
+/**
+ * Verifies detached signatures of presence stanzas for all accounts.
+ * Each gpg run is expensive, so results are cached by signature and text,
+ * identical requests in flight share one run, and only a few runs are
+ * started at a time.
+ */
+class PGPVerifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<void(bool success, const QCA::SecureMessageSignature &signer)> Callback;
+
+    static PGPVerifier *instance();
+
+    // the callback is dropped if context is deleted before the result is known
+    void verify(const QString &signature, const QString &text, QObject *context, const Callback &callback);
+
+private slots:
+    void transactionFinished();
+    void clearCache();
+
+private:
+    struct Result
+    {
+        bool success;
+        QCA::SecureMessageSignature signer;
+    };
+
+    struct Waiter
+    {
+        QPointer<QObject> context;
+        Callback callback;
+    };
+
+    struct Request
+    {
+        QString signature;
+        QString text;
+        QList<Waiter> waiters;
+    };
+
+    PGPVerifier();
+    static QString cacheKey(const QString &signature, const QString &text);
+    void startNext();
+
+    QCache<QString, Result> cache_;
+    QHash<QString, Request> requests_;
+    QStringList queue_;
+    QHash<PGPTransaction *, QString> running_;
+};
+
+#endif // PGPVERIFIER_H
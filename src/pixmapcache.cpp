@@ -0,0 +1,68 @@
+/*
+ * pixmapcache.cpp - QPixmapCache entries grouped for invalidation
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pixmapcache.h"
+
+#include <QHash>
+#include <QPixmap>
+#include <QPixmapCache>
+#include <QSet>
+
+// beyond that the old generation is left to the LRU
+static const int maxTrackedKeys = 2000;
+
+namespace {
+
+struct Space {
+    uint          generation = 0;
+    QSet<QString> keys; // of the current generation, some possibly evicted already
+};
+
+QHash<QString, Space> spaces;
+
+QString fullKey(const QString &space, const Space &s, const QString &key)
+{
+    return space + QLatin1Char('/') + QString::number(s.generation) + QLatin1Char('/') + key;
+}
+
+}
+
+bool PixmapCache::find(const QString &space, const QString &key, QPixmap *pixmap)
+{
+    return QPixmapCache::find(fullKey(space, spaces[space], key), pixmap);
+}
+
+void PixmapCache::insert(const QString &space, const QString &key, const QPixmap &pixmap)
+{
+    Space &       s    = spaces[space];
+    const QString full = fullKey(space, s, key);
+    if (QPixmapCache::insert(full, pixmap) && s.keys.size() < maxTrackedKeys)
+        s.keys.insert(full);
+}
+
+void PixmapCache::invalidate(const QString &space)
+{
+    auto it = spaces.find(space);
+    if (it == spaces.end())
+        return;
+    for (const QString &key : it->keys)
+        QPixmapCache::remove(key);
+    it->keys.clear();
+    ++it->generation;
+}
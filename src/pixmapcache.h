@@ -0,0 +1,43 @@
+/*
+ * pixmapcache.h - QPixmapCache entries grouped for invalidation
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PIXMAPCACHE_H
+#define PIXMAPCACHE_H
+
+#include <QString>
+
+class QPixmap;
+
+/**
+ * Pixmaps rendered from an iconset or a theme, kept in QPixmapCache under
+ * the name of what they came from. When that changes, invalidate() drops
+ * just its pixmaps, instead of everything QPixmapCache::clear() would.
+ * Each invalidation starts a new generation of keys, so entries that
+ * weren't tracked can't be found anymore and age out of the LRU.
+ * GUI thread only, like QPixmapCache.
+ */
+class PixmapCache
+{
+public:
+    static bool find(const QString &space, const QString &key, QPixmap *pixmap);
+    static void insert(const QString &space, const QString &key, const QPixmap &pixmap);
+    static void invalidate(const QString &space);
+};
+
+#endif // PIXMAPCACHE_H
@@ -1,7 +1,17 @@
 #include "pixmaputil.h"
 
+#include "pixmapcache.h"
+
 #include <QBitmap>
+#include <QFutureWatcher>
 #include <QImage>
+#include <QImageReader>
+#include <QPainter>
+#include <QtConcurrentRun>
+
+// smooth scaling costs in proportion to the source, so past this ratio the
+// source is first brought down to this many times the target by sampling
+static const int fastPassRatio = 4;
 
 QPixmap PixmapUtil::createTransparentPixmap(int width, int height)
 {
@@ -22,3 +32,75 @@ QPixmap PixmapUtil::createTransparentPixmap(int width, int height)
 #endif
     return pix;
 }
+
+QImage PixmapUtil::scaledImage(const QImage &image, const QSize &size, Qt::AspectRatioMode mode)
+{
+    if (image.isNull() || size.isEmpty())
+        return QImage();
+
+    const QSize target = image.size().scaled(size, mode);
+    if (target == image.size())
+        return image;
+
+    QImage source = image;
+    if (source.width() > target.width() * fastPassRatio && source.height() > target.height() * fastPassRatio)
+        source = source.scaled(target * fastPassRatio, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    return source.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+QImage PixmapUtil::centered(const QImage &image, const QSize &canvas)
+{
+    QImage back(canvas, QImage::Format_ARGB32_Premultiplied);
+    back.fill(Qt::transparent);
+    QPainter painter(&back);
+    QRect    rect = image.rect();
+    rect.moveCenter(back.rect().center());
+    painter.drawImage(rect, image);
+    return back;
+}
+
+QPixmap PixmapUtil::scaled(const QPixmap &pixmap, const QSize &size, Qt::AspectRatioMode mode)
+{
+    if (pixmap.isNull() || pixmap.size().scaled(size, mode) == pixmap.size())
+        return pixmap;
+
+    // cacheKey() changes along with the pixmap, entries of replaced sources
+    // just age out of the LRU
+    const QString key
+        = QString(QLatin1String("%1/%2x%3/%4")).arg(pixmap.cacheKey()).arg(size.width()).arg(size.height()).arg(int(mode));
+    QPixmap result;
+    if (PixmapCache::find(QLatin1String("scaled"), key, &result))
+        return result;
+
+    result = QPixmap::fromImage(scaledImage(pixmap.toImage(), size, mode));
+    PixmapCache::insert(QLatin1String("scaled"), key, result);
+    return result;
+}
+
+static QImage readScaled(const QString &fileName, const QSize &size)
+{
+    QImageReader reader(fileName);
+    reader.setAutoTransform(true);
+    // the orientation isn't applied yet to the size the reader decodes to,
+    // so it is only brought close and scaled to fit afterwards
+    const int   largest = qMax(size.width(), size.height());
+    const QSize full    = reader.size();
+    if (full.width() > largest * 2 || full.height() > largest * 2)
+        reader.setScaledSize(full.scaled(largest * 2, largest * 2, Qt::KeepAspectRatio));
+    QImage image = reader.read();
+    if (image.isNull())
+        return image;
+    return PixmapUtil::scaledImage(image, image.size().boundedTo(size));
+}
+
+void PixmapUtil::loadScaled(const QString &fileName, const QSize &size, QObject *context,
+                            const std::function<void(const QImage &)> &done)
+{
+    // parented to the context, so the result is dropped with it
+    auto watcher = new QFutureWatcher<QImage>(context);
+    QObject::connect(watcher, &QFutureWatcherBase::finished, context, [watcher, done]() {
+        watcher->deleteLater();
+        done(watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run(readScaled, fileName, size));
+}
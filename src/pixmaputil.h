@@ -1,10 +1,33 @@
 #ifndef PIXMAPUTIL_H
 #define PIXMAPUTIL_H
 
+#include <QImage>
+#include <QSize>
+#include <Qt>
+
+#include <functional>
+
+class QObject;
 class QPixmap;
+class QString;
 
 namespace PixmapUtil {
     QPixmap createTransparentPixmap(int width, int height);
+
+    // smooth scaling, where a big reduction takes a fast pass first. any thread
+    QImage scaledImage(const QImage &image, const QSize &size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
+    // image drawn in the middle of a transparent canvas of the given size
+    QImage centered(const QImage &image, const QSize &canvas);
+
+    // scaled copies of what is painted over and over, memoized by the source
+    // pixmap and the size. GUI thread only
+    QPixmap scaled(const QPixmap &pixmap, const QSize &size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
+
+    // reads an image file scaled to fit size in a worker thread, decoding it
+    // right at the reduced size where the format allows. done gets a null
+    // image if the file can't be read, and isn't called once context is gone
+    void loadScaled(const QString &fileName, const QSize &size, QObject *context,
+                    const std::function<void(const QImage &)> &done);
 }
 
 #endif // PIXMAPUTIL_H
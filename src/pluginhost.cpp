@@ -6,10 +6,12 @@
 #include "pluginhost.h"
 
 #include <QAction>
+#include <QBuffer>
 #include <QByteArray>
 #include <QDomElement>
 #include <QKeySequence>
 #include <QObject>
+#include <QPixmap>
 #include <QPluginLoader>
 #include <QRegExp>
 #include <QSplitter>
@@ -19,7 +21,9 @@
 #include <QWidget>
 
 #include "accountinfoaccessor.h"
+#include "accountsnapshotaccessor.h"
 #include "activetabaccessor.h"
+#include "adhoccommandaccessor.h"
 #include "applicationinfo.h"
 #include "applicationinfoaccessor.h"
 #include "chatdlg.h"
@@ -41,6 +45,7 @@
 #include "pluginaccessor.h"
 #include "plugininfoprovider.h"
 #include "pluginmanager.h"
+#include "pluginworkerpool.h"
 #include "popupaccessor.h"
 #include "psiaccount.h"
 #include "psiaccountcontroller.h"
@@ -49,12 +54,14 @@
 #include "shortcutaccessor.h"
 #include "soundaccessor.h"
 #include "stanzafilter.h"
+#include "stanzaobserver.h"
 #include "stanzasender.h"
 #include "tabmanager.h"
 #include "textutil.h"
 #include "toolbariconaccessor.h"
 #include "webkitaccessor.h"
 #include "widgets/iconaction.h"
+#include "workerpoolaccessor.h"
 //#include "xmpp_message.h"
 
 /**
@@ -69,21 +76,31 @@
  * \param manager PluginManager instance that manages all plugins
  * \param pluginFile path to plugin file
  */
-PluginHost::PluginHost(PluginManager* manager, const QString& pluginFile)
+PluginHost::PluginHost(PluginManager* manager, const QString& pluginFile, const QJsonObject& cachedInfo)
     : manager_(manager)
     , plugin_(nullptr)
+    , stanzaFilter_(nullptr)
+    , eventFilter_(nullptr)
+    , stanzaObserver_(nullptr)
+    , hasIqFilter_(false)
     , file_(pluginFile)
     , priority_(PsiPlugin::PriorityNormal)
     , loader_(nullptr)
     , iconset_(nullptr)
+    , hasToolBarButton_(false)
+    , hasGCToolBarButton_(false)
     , valid_(false)
     , connected_(false)
     , enabled_(false)
     , hasInfo_(false)
     , infoString_(QString())
 {
-    load();    // reads plugin name, etc
-    unload();
+    if (!cachedInfo.isEmpty()) {
+        restoreInfo(cachedInfo);
+    } else {
+        load();    // reads plugin name, etc
+        unload();
+    }
 }
 
 /**
@@ -101,6 +118,53 @@ PluginHost::~PluginHost()
     }
 }
 
+/**
+ * \brief Returns basic plugin info for the plugin manager's cache.
+ *
+ * Empty if the file is not a valid plugin, so it will be probed again.
+ */
+QJsonObject PluginHost::cacheInfo() const
+{
+    QJsonObject info;
+    if (!valid_) {
+        return info;
+    }
+    info.insert(QLatin1String("name"), name_);
+    info.insert(QLatin1String("shortName"), shortName_);
+    info.insert(QLatin1String("version"), version_);
+    info.insert(QLatin1String("priority"), priority_);
+    info.insert(QLatin1String("toolbar"), hasToolBarButton_);
+    info.insert(QLatin1String("gctoolbar"), hasGCToolBarButton_);
+    if (hasInfo_) {
+        info.insert(QLatin1String("info"), infoString_);
+    }
+    if (!icon_.isNull()) {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        icon_.pixmap(icon_.availableSizes().value(0, QSize(16, 16))).save(&buffer, "PNG");
+        info.insert(QLatin1String("icon"), QString::fromLatin1(png.toBase64()));
+    }
+    return info;
+}
+
+void PluginHost::restoreInfo(const QJsonObject& info)
+{
+    valid_ = true;
+    name_ = info.value(QLatin1String("name")).toString();
+    shortName_ = info.value(QLatin1String("shortName")).toString();
+    version_ = info.value(QLatin1String("version")).toString();
+    priority_ = info.value(QLatin1String("priority")).toInt(PsiPlugin::PriorityNormal);
+    hasToolBarButton_ = info.value(QLatin1String("toolbar")).toBool();
+    hasGCToolBarButton_ = info.value(QLatin1String("gctoolbar")).toBool();
+    hasInfo_ = info.contains(QLatin1String("info"));
+    infoString_ = info.value(QLatin1String("info")).toString();
+    QPixmap pix;
+    if (pix.loadFromData(QByteArray::fromBase64(info.value(QLatin1String("icon")).toString().toLatin1()), "PNG")) {
+        icon_ = QIcon(pix);
+    }
+}
+
 /**
  * \brief Returns true if wrapped file is a valid Psi plugin.
  *
@@ -246,6 +310,10 @@ bool PluginHost::load()
                 icon_ = QIcon(psiPlugin->icon());
                 hasToolBarButton_ = qobject_cast<ToolbarIconAccessor*>(plugin_) ? true : false;
                 hasGCToolBarButton_ = qobject_cast<GCToolbarIconAccessor*>(plugin_) ? true : false;
+                stanzaFilter_ = qobject_cast<StanzaFilter*>(plugin_);
+                eventFilter_ = qobject_cast<EventFilter*>(plugin_);
+                stanzaObserver_ = qobject_cast<StanzaObserver*>(plugin_);
+                hasIqFilter_ = qobject_cast<IqFilter*>(plugin_) ? true : false;
                 PluginInfoProvider *pip = qobject_cast<PluginInfoProvider*>(plugin_);
                 if (pip) {
                     hasInfo_ = true;
@@ -287,6 +355,11 @@ bool PluginHost::unload()
             qWarning("Plugin %s's loader wasn't found when trying to unload", qPrintable(name_));
             return false;
         }
+        else if (!PluginWorkerPool::instance()->waitForJobs(name_, 5000)) {
+            // the code of the job would be gone under it
+            qWarning("Plugin %s still runs a background job, not unloading it", qPrintable(name_));
+            return false;
+        }
         else if (loader_->unload()) {
             //if we're done with the plugin completely and it's unloaded
             // we can delete the loader;
@@ -294,6 +367,10 @@ bool PluginHost::unload()
             delete loader_;
             plugin_ = nullptr;
             loader_ = nullptr;
+            stanzaFilter_ = nullptr;
+            eventFilter_ = nullptr;
+            stanzaObserver_ = nullptr;
+            hasIqFilter_ = false;
             delete iconset_;
             iconset_ = nullptr;
             connected_ = false;
@@ -398,6 +475,13 @@ bool PluginHost::enable()
 #endif
                 ai->setAccountInfoAccessingHost(this);
             }
+            AccountSnapshotAccessor* asa = qobject_cast<AccountSnapshotAccessor*>(plugin_);
+            if (asa) {
+#ifndef PLUGINS_NO_DEBUG
+                qDebug("connecting account snapshot accessor");
+#endif
+                asa->setAccountSnapshotAccessingHost(this);
+            }
             ToolbarIconAccessor *tia = qobject_cast<ToolbarIconAccessor*>(plugin_);
             if (tia) {
 #ifndef PLUGINS_NO_DEBUG
@@ -466,11 +550,22 @@ bool PluginHost::enable()
             if (wka) {
                 wka->setWebkitAccessingHost(this);
             }
+            auto aca = qobject_cast<AdHocCommandAccessor*>(plugin_);
+            if (aca) {
+                aca->setAdHocCommandAccessingHost(this);
+            }
+            auto wpa = qobject_cast<WorkerPoolAccessor*>(plugin_);
+            if (wpa) {
+                wpa->setWorkerPoolAccessingHost(this);
+            }
 
             connected_ = true;
         }
 
+        PluginWorkerPool::instance()->start(name_);
         enabled_ = qobject_cast<PsiPlugin*>(plugin_)->enable();
+        if (!enabled_)
+            PluginWorkerPool::instance()->stop(name_);
     }
 
     return enabled_;
@@ -488,6 +583,8 @@ bool PluginHost::disable()
 {
     if (enabled_) {
         enabled_ = !qobject_cast<PsiPlugin*>(plugin_)->disable();
+        if (!enabled_)
+            PluginWorkerPool::instance()->stop(name_);
     }
     return !enabled_;
 }
@@ -502,6 +599,34 @@ bool PluginHost::isEnabled() const
 
 //-- for StanzaFilter and IqNamespaceFilter -------------------------
 
+/**
+ * \brief Returns the namespace of the first namespaced child of iq stanza \a e.
+ */
+QString PluginHost::iqNamespace(const QDomElement &e)
+{
+    for (QDomNode n = e.firstChild(); !n.isNull(); n = n.nextSibling()) {
+        QDomElement i = n.toElement();
+        if (!i.isNull() && !i.namespaceURI().isNull()) {
+            return i.namespaceURI();
+        }
+    }
+    return QString();
+}
+
+/**
+ * \brief Returns true if any filter of the plugin may handle the incoming stanza.
+ *
+ * \param tagName Stanza element name
+ * \param iqNs Namespace of iq stanza payload (see iqNamespace())
+ */
+bool PluginHost::wantsIncomingXml(const QString &tagName, const QString &iqNs) const
+{
+    if (stanzaFilter_) {
+        return true;
+    }
+    return tagName == QLatin1String("iq") && (iqNsFilters_.contains(iqNs) || !iqNsxFilters_.isEmpty());
+}
+
 /**
  * \brief Give plugin the opportunity to process incoming xml
  *
@@ -512,29 +637,19 @@ bool PluginHost::isEnabled() const
  *
  * \param account Identifier of the PsiAccount responsible
  * \param xml Incoming XML (may be modified)
+ * \param iqNs Namespace of iq stanza payload, computed once by the caller
  * \return Continue processing the XML stanza; true if the stanza should be silently discarded.
  */
-bool PluginHost::incomingXml(int account, const QDomElement &e)
+bool PluginHost::incomingXml(int account, const QDomElement &e, const QString &iqNs)
 {
     bool handled = false;
 
     // try stanza filter first
-    StanzaFilter* sf = qobject_cast<StanzaFilter*>(plugin_);
-    if (sf && sf->incomingStanza(account, e)) {
+    if (stanzaFilter_ && stanzaFilter_->incomingStanza(account, e)) {
         handled = true;
     }
     // try iq filters
-    else if (e.tagName() == "iq") {
-        // get iq namespace
-        QString ns;
-        for (QDomNode n = e.firstChild(); !n.isNull(); n = n.nextSibling()) {
-            QDomElement i = n.toElement();
-            if (!i.isNull() && !i.namespaceURI().isNull()) {
-                ns = i.namespaceURI();
-                break;
-            }
-        }
-
+    else if (e.tagName() == "iq" && (iqNsFilters_.contains(iqNs) || !iqNsxFilters_.isEmpty())) {
         // choose handler function depending on iq type
         bool (IqNamespaceFilter::*handler)(int account, const QDomElement& xml) = nullptr;
         const QString type = e.attribute("type");
@@ -550,8 +665,8 @@ bool PluginHost::incomingXml(int account, const QDomElement &e)
 
         if (handler) {
             // normal filters
-            foreach (IqNamespaceFilter* f, iqNsFilters_.values(ns)) {
-                if ((f->*handler)(account, e)) {
+            for (auto it = iqNsFilters_.constFind(iqNs); it != iqNsFilters_.constEnd() && it.key() == iqNs; ++it) {
+                if ((it.value()->*handler)(account, e)) {
                     handled = true;
                     break;
                 }
@@ -560,7 +675,8 @@ bool PluginHost::incomingXml(int account, const QDomElement &e)
             // regex filters
             QMapIterator<QRegExp, IqNamespaceFilter*> i(iqNsxFilters_);
             while (!handled && i.hasNext()) {
-                if (i.key().indexIn(ns) >= 0 && (i.value()->*handler)(account, e)) {
+                i.next();
+                if (i.key().indexIn(iqNs) >= 0 && (i.value()->*handler)(account, e)) {
                     handled = true;
                 }
             }
@@ -573,13 +689,28 @@ bool PluginHost::incomingXml(int account, const QDomElement &e)
 bool PluginHost::outgoingXml(int account, QDomElement &e)
 {
     bool handled = false;
-    StanzaFilter *ef = qobject_cast<StanzaFilter*>(plugin_);
-    if (ef && ef->outgoingStanza(account, e)) {
+    if (stanzaFilter_ && stanzaFilter_->outgoingStanza(account, e)) {
         handled = true;
     }
     return handled;
 }
 
+//-- for StanzaObserver --------------------------------------------
+
+void PluginHost::observeIncomingXml(int account, const QDomElement &e)
+{
+    if (stanzaObserver_) {
+        stanzaObserver_->incomingStanzaObserved(account, e);
+    }
+}
+
+void PluginHost::observeOutgoingXml(int account, const QDomElement &e)
+{
+    if (stanzaObserver_) {
+        stanzaObserver_->outgoingStanzaObserved(account, e);
+    }
+}
+
 //-- for EventFilter ------------------------------------------------
 
 /**
@@ -597,8 +728,7 @@ bool PluginHost::outgoingXml(int account, QDomElement &e)
 bool PluginHost::processEvent(int account, QDomElement& e)
 {
     bool handled = false;
-    EventFilter *ef = qobject_cast<EventFilter*>(plugin_);
-    if (ef && ef->processEvent(account, e)) {
+    if (eventFilter_ && eventFilter_->processEvent(account, e)) {
         handled = true;
     }
     return handled;
@@ -622,8 +752,7 @@ bool PluginHost::processEvent(int account, QDomElement& e)
 bool PluginHost::processMessage(int account, const QString& jidFrom, const QString& body, const QString& subject)
 {
     bool handled = false;
-    EventFilter *ef = qobject_cast<EventFilter*>(plugin_);
-    if (ef && ef->processMessage(account, jidFrom, body, subject)) {
+    if (eventFilter_ && eventFilter_->processMessage(account, jidFrom, body, subject)) {
         handled = true;
     }
     return handled;
@@ -632,8 +761,7 @@ bool PluginHost::processMessage(int account, const QString& jidFrom, const QStri
 bool PluginHost::processOutgoingMessage(int account, const QString& jidTo, QString& body, const QString& type, QString& subject)
 {
     bool handled = false;
-    EventFilter *ef = qobject_cast<EventFilter*>(plugin_);
-    if (ef && ef->processOutgoingMessage(account, jidTo, body, type, subject)) {
+    if (eventFilter_ && eventFilter_->processOutgoingMessage(account, jidTo, body, type, subject)) {
         handled = true;
     }
     return handled;
@@ -641,9 +769,8 @@ bool PluginHost::processOutgoingMessage(int account, const QString& jidTo, QStri
 
 void PluginHost::logout(int account)
 {
-    EventFilter *ef = qobject_cast<EventFilter*>(plugin_);
-    if (ef) {
-        ef->logout(account);
+    if (eventFilter_) {
+        eventFilter_->logout(account);
     }
 }
 
@@ -657,10 +784,7 @@ void PluginHost::logout(int account)
  */
 void PluginHost::sendStanza(int account, const QDomElement& stanza)
 {
-    QTextStream stream;
-    stream.setString(new QString());
-    stanza.save(stream, 0);
-    manager_->sendXml(account, *stream.string());
+    manager_->sendXml(account, stanza);
 }
 
 /**
@@ -1369,6 +1493,80 @@ void PluginHost::playSound(const QString &fileName)
     soundPlay(fileName);
 }
 
+/**
+ * AdHocCommandAccessingHost
+ */
+
+bool PluginHost::executeCommand(int account, const QString& jid, const QString& node, const QVariantMap& fields,
+                                QObject *receiver, const char* slot)
+{
+    return manager_->executeCommand(account, jid, node, fields, receiver, slot);
+}
+
+/**
+ * AccountSnapshotAccessingHost
+ */
+
+quint64 PluginHost::accountVersion(int account)
+{
+    return manager_->accountVersion(account);
+}
+
+QVariantMap PluginHost::accountSnapshot(int account)
+{
+    return manager_->accountSnapshot(account);
+}
+
+QStringList PluginHost::rosterSnapshot(int account, quint64 *version)
+{
+    return manager_->rosterSnapshot(account, version);
+}
+
+QVariantMap PluginHost::contactsSnapshot(int account, const QStringList &jids, quint64 *version)
+{
+    return manager_->contactsSnapshot(account, jids, version);
+}
+
+/**
+ * AccountSnapshotAccessor
+ */
+
+void PluginHost::accountSnapshotChanged(int account, quint64 version, int changes)
+{
+    if (!enabled_)
+        return;
+    AccountSnapshotAccessor *asa = qobject_cast<AccountSnapshotAccessor*>(plugin_);
+    if (asa)
+        asa->accountSnapshotChanged(account, version, changes);
+}
+
+/**
+ * WorkerPoolAccessingHost
+ */
+
+int PluginHost::runJob(std::function<QVariant()> job, QObject *context,
+                       std::function<void(const QVariant &result)> done)
+{
+    if (!enabled_)
+        return 0;
+    return PluginWorkerPool::instance()->run(name_, job, context, done);
+}
+
+bool PluginHost::cancelJob(int id)
+{
+    return PluginWorkerPool::instance()->cancel(name_, id);
+}
+
+bool PluginHost::isJobCancelled() const
+{
+    return PluginWorkerPool::isCancelled();
+}
+
+void PluginHost::postToGui(QObject *context, std::function<void()> fn)
+{
+    PluginWorkerPool::instance()->post(name_, context, fn);
+}
+
 /**
  * EncryptionSupport
  */
@@ -7,6 +7,7 @@
 #define PLUGINHOST_H
 
 #include <QDomElement>
+#include <QJsonObject>
 #include <QMultiMap>
 #include <QPointer>
 #include <QRegExp>
@@ -14,7 +15,9 @@
 #include <QVariant>
 
 #include "accountinfoaccessinghost.h"
+#include "accountsnapshotaccessinghost.h"
 #include "activetabaccessinghost.h"
+#include "adhoccommandaccessinghost.h"
 #include "applicationinfo.h"
 #include "applicationinfoaccessinghost.h"
 #include "contactinfoaccessinghost.h"
@@ -35,11 +38,15 @@
 #include "tabdlg.h"
 #include "userlist.h"
 #include "webkitaccessinghost.h"
+#include "workerpoolaccessinghost.h"
 
+class EventFilter;
 class IqNamespaceFilter;
 class PluginManager;
 class QPluginLoader;
 class QWidget;
+class StanzaFilter;
+class StanzaObserver;
 
 class PluginHost: public QObject,
         public StanzaSendingHost,
@@ -58,7 +65,10 @@ class PluginHost: public QObject,
         public SoundAccessingHost,
         public EncryptionSupport,
         public PluginAccessingHost,
-        public WebkitAccessingHost
+        public WebkitAccessingHost,
+        public AdHocCommandAccessingHost,
+        public AccountSnapshotAccessingHost,
+        public WorkerPoolAccessingHost
 {
     Q_OBJECT
     Q_INTERFACES(StanzaSendingHost
@@ -77,12 +87,17 @@ class PluginHost: public QObject,
                  SoundAccessingHost
                  EncryptionSupport
                  PluginAccessingHost
-                 WebkitAccessingHost)
+                 WebkitAccessingHost
+                 AdHocCommandAccessingHost
+                 AccountSnapshotAccessingHost
+                 WorkerPoolAccessingHost)
 
 public:
-    PluginHost(PluginManager* manager, const QString& pluginFile);
+    PluginHost(PluginManager* manager, const QString& pluginFile, const QJsonObject& cachedInfo = QJsonObject());
     virtual ~PluginHost();
 
+    QJsonObject cacheInfo() const;
+
     bool isValid() const;
     const QString& path() const;
     QWidget* optionsWidget() const;
@@ -106,10 +121,22 @@ public:
     bool disable();
     bool isEnabled() const;
 
+    // implemented filter interfaces, cached on load
+    bool hasStanzaFilter() const { return stanzaFilter_ != nullptr; }
+    bool hasIqFilter() const { return hasIqFilter_; }
+    bool hasEventFilter() const { return eventFilter_ != nullptr; }
+    bool hasStanzaObserver() const { return stanzaObserver_ != nullptr; }
+
     // for StanzaFilter and IqNamespaceFilter
-    bool incomingXml(int account, const QDomElement& e);
+    static QString iqNamespace(const QDomElement &e);
+    bool wantsIncomingXml(const QString &tagName, const QString &iqNs) const;
+    bool incomingXml(int account, const QDomElement& e, const QString &iqNs);
     bool outgoingXml(int account, QDomElement &e);
 
+    // for StanzaObserver
+    void observeIncomingXml(int account, const QDomElement &e);
+    void observeOutgoingXml(int account, const QDomElement &e);
+
     // for EventFilter
     bool processEvent(int account, QDomElement& e);
     bool processMessage(int account, const QString& jidFrom, const QString& body, const QString& subject);
@@ -241,6 +268,25 @@ public:
 
     void playSound(const QString& fileName);
 
+    // AdHocCommandAccessingHost
+    bool executeCommand(int account, const QString& jid, const QString& node, const QVariantMap& fields,
+                        QObject *receiver, const char* slot);
+
+    // AccountSnapshotAccessingHost
+    quint64 accountVersion(int account);
+    QVariantMap accountSnapshot(int account);
+    QStringList rosterSnapshot(int account, quint64 *version = nullptr);
+    QVariantMap contactsSnapshot(int account, const QStringList &jids = QStringList(), quint64 *version = nullptr);
+
+    // AccountSnapshotAccessor
+    void accountSnapshotChanged(int account, quint64 version, int changes);
+
+    // WorkerPoolAccessingHost
+    int runJob(std::function<QVariant()> job, QObject *context, std::function<void(const QVariant &result)> done);
+    bool cancelJob(int id);
+    bool isJobCancelled() const;
+    void postToGui(QObject *context, std::function<void()> fn);
+
     // EncryptionSupport
     bool decryptMessageElement(int account, QDomElement &message);
     bool encryptMessageElement(int account, QDomElement &message);
@@ -257,6 +303,10 @@ public:
 private:
     PluginManager* manager_;
     QPointer<QObject> plugin_;
+    StanzaFilter* stanzaFilter_;
+    EventFilter* eventFilter_;
+    StanzaObserver* stanzaObserver_;
+    bool hasIqFilter_;
     QString file_;
     QString name_;
     QString shortName_;
@@ -274,6 +324,8 @@ private:
     bool hasInfo_;
     QString infoString_;
 
+    void restoreInfo(const QJsonObject& info);
+
     QMultiMap<QString, IqNamespaceFilter*> iqNsFilters_;
     QMultiMap<QRegExp, IqNamespaceFilter*> iqNsxFilters_;
     QList< QVariantHash > buttons_;
@@ -5,9 +5,11 @@
 
 #include "pluginmanager.h"
 
+#include "accountsnapshotaccessor.h"
 #include "applicationinfo.h"
 #include "avatars.h"
 #include "chatdlg.h"
+#include "debug.h"
 #include "eventfilter.h"
 #include "groupchatdlg.h"
 #include "iqfilter.h"
@@ -71,6 +73,44 @@ static QStringList pluginDirs()
     return ApplicationInfo::pluginDirs();
 }
 
+// Basic info of plugins seen before, so they don't have to be loaded just to list them
+static QString pluginCacheFile()
+{
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + QLatin1String("/plugins.json");
+}
+
+static QJsonObject readPluginCache()
+{
+    QFile f(pluginCacheFile());
+    if (!f.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+    QJsonObject cache = QJsonDocument::fromJson(f.readAll()).object();
+    // a different Psi may reject plugins the old one accepted
+    if (cache.value(QLatin1String("psi")).toString() != ApplicationInfo::version()) {
+        return QJsonObject();
+    }
+    return cache.value(QLatin1String("plugins")).toObject();
+}
+
+static void writePluginCache(const QJsonObject &plugins)
+{
+    QJsonObject cache;
+    cache.insert(QLatin1String("psi"), ApplicationInfo::version());
+    cache.insert(QLatin1String("plugins"), plugins);
+    QFile f(pluginCacheFile());
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("Failed to save plugins cache to %s", qPrintable(f.fileName()));
+        return;
+    }
+    f.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+}
+
+static QString pluginStamp(const QFileInfo &fi)
+{
+    return QString::number(fi.size()) + QLatin1Char('|') + QString::number(fi.lastModified().toMSecsSinceEpoch());
+}
+
 /**
  * Method for accessing the singleton instance of the class.
  * Instanciates if no instance yet exists.
@@ -102,6 +142,11 @@ PluginManager::PluginManager() : QObject(nullptr), psi_(nullptr)
     _messageViewJSFiltersTimer->setInterval(10); // to be able to restart in case of batch events
     connect(_messageViewJSFiltersTimer, &QTimer::timeout, this, &PluginManager::jsFiltersUpdated);
 
+    snapshotTimer_ = new QTimer(this);
+    snapshotTimer_->setSingleShot(true);
+    snapshotTimer_->setInterval(100);
+    connect(snapshotTimer_, SIGNAL(timeout()), SLOT(deliverSnapshotChanges()));
+
     connect(PsiOptions::instance(), SIGNAL(optionChanged(const QString&)), this, SLOT(optionChanged(const QString&)));
 }
 
@@ -120,6 +165,8 @@ void PluginManager::initNewSession(PsiCon *psi)
 QList<PluginHost*> PluginManager::updatePluginsList()
 {
     QList<PluginHost*> newPlugins;
+    QJsonObject cache = readPluginCache();
+    bool cacheChanged = false;
 
     foreach (const QString& d, pluginDirs()) {
         QDir dir(d);
@@ -130,7 +177,22 @@ QList<PluginHost*> PluginManager::updatePluginsList()
                 qDebug("Found plugin: %s", qPrintable(file));
 #endif
                 if (!pluginByFile_.contains(file)) {
-                    PluginHost* host = new PluginHost(this, file);
+                    const QString stamp = pluginStamp(fileInfo);
+                    QJsonObject info = cache.value(file).toObject();
+                    if (info.value(QLatin1String("stamp")).toString() != stamp) {
+                        info = QJsonObject();
+                    }
+                    PluginHost* host = new PluginHost(this, file, info);
+                    if (info.isEmpty()) {
+                        info = host->cacheInfo();
+                        if (info.isEmpty()) {
+                            cache.remove(file);
+                        } else {
+                            info.insert(QLatin1String("stamp"), stamp);
+                            cache.insert(file, info);
+                        }
+                        cacheChanged = true;
+                    }
                     if (host->isValid() && !hosts_.contains(host->name())) {
                         hosts_[host->name()] = host;
                         pluginByFile_[file] = host;
@@ -145,6 +207,8 @@ QList<PluginHost*> PluginManager::updatePluginsList()
                             }
                             pluginsByPriority_.insert(i, host);
                         }
+                    } else {
+                        delete host;
                     }
                 } else {
 #ifndef PLUGINS_NO_DEBUG
@@ -155,6 +219,9 @@ QList<PluginHost*> PluginManager::updatePluginsList()
         }
     }
 
+    if (cacheChanged) {
+        writePluginCache(cache);
+    }
     return newPlugins;
 }
 
@@ -172,6 +239,7 @@ void PluginManager::dirsChanged()
 void PluginManager::accountDestroyed()
 {
     PsiAccount* pa = static_cast<PsiAccount*>(sender());
+    snapshots_.remove(accountIds_.id(pa));
     accountIds_.removeAccount(pa);
 }
 
@@ -198,6 +266,37 @@ void PluginManager::loadPluginIfEnabled(PluginHost *plugin)
         qDebug("Plugin %s is enabled in config: loading", qPrintable(plugin->shortName()));
 #endif
         plugin->enable();
+        updateDispatchLists();
+    }
+}
+
+/**
+ * Rebuilds the per-hook lists of plugins, so incoming and outgoing stanzas
+ * only visit plugins implementing the matching filter interface.
+ * Must be called whenever a plugin is loaded or unloaded.
+ */
+void PluginManager::updateDispatchLists()
+{
+    incomingXmlHosts_.clear();
+    stanzaFilterHosts_.clear();
+    eventFilterHosts_.clear();
+    stanzaObserverHosts_.clear();
+    foreach (PluginHost* host, pluginsByPriority_) {
+        if (!host->isLoaded()) {
+            continue;
+        }
+        if (host->hasStanzaFilter() || host->hasIqFilter()) {
+            incomingXmlHosts_.append(host);
+        }
+        if (host->hasStanzaFilter()) {
+            stanzaFilterHosts_.append(host);
+        }
+        if (host->hasEventFilter()) {
+            eventFilterHosts_.append(host);
+        }
+        if (host->hasStanzaObserver()) {
+            stanzaObserverHosts_.append(host);
+        }
     }
 }
 
@@ -224,6 +323,7 @@ void PluginManager::optionChanged(const QString& option)
                     delete optionsWidget_;
                 plugin->unload();
             }
+            updateDispatchLists();
             if (shouldUpdateFeatures) {
                 updateFeatures();
             }
@@ -260,6 +360,7 @@ void PluginManager::loadAllPlugins()
         plugin->load();
         plugin->enable();
     }
+    updateDispatchLists();
 }
 
 /**
@@ -278,6 +379,7 @@ bool PluginManager::unloadAllPlugins()
             ok = false;
         }
     }
+    updateDispatchLists();
     return ok;
 }
 
@@ -398,9 +500,11 @@ void PluginManager::setShortcuts()
  */
 bool PluginManager::processMessage(PsiAccount* account, const QString& jidFrom, const QString& body, const QString& subject)
 {
+    TRACE_FUNCTION();
     bool handled = false;
-    foreach (PluginHost* host, pluginsByPriority_) {
-        if (host->processMessage(accountIds_.id(account), jidFrom, body, subject)) {
+    const int acc_id = accountIds_.id(account);
+    foreach (PluginHost* host, eventFilterHosts_) {
+        if (host->processMessage(acc_id, jidFrom, body, subject)) {
             handled = true;
             break;
         }
@@ -408,6 +512,28 @@ bool PluginManager::processMessage(PsiAccount* account, const QString& jidFrom,
     return handled;
 }
 
+static bool sameNode(const QDomNode &a, const QDomNode &b)
+{
+    if (a.nodeType() != b.nodeType() || a.nodeName() != b.nodeName() || a.nodeValue() != b.nodeValue())
+        return false;
+    if (a.isElement()) {
+        const QDomNamedNodeMap aa = a.attributes(), ba = b.attributes();
+        if (aa.count() != ba.count() || a.namespaceURI() != b.namespaceURI())
+            return false;
+        for (int i = 0; i < aa.count(); ++i) {
+            const QDomNode attr = aa.item(i);
+            if (!ba.contains(attr.nodeName()) || ba.namedItem(attr.nodeName()).nodeValue() != attr.nodeValue())
+                return false;
+        }
+    }
+    QDomNode ac = a.firstChild(), bc = b.firstChild();
+    for (; !ac.isNull() && !bc.isNull(); ac = ac.nextSibling(), bc = bc.nextSibling()) {
+        if (!sameNode(ac, bc))
+            return false;
+    }
+    return ac.isNull() && bc.isNull();
+}
+
 /**
  * \brief Give each plugin the opportunity to process the incoming event
  *
@@ -418,27 +544,44 @@ bool PluginManager::processMessage(PsiAccount* account, const QString& jidFrom,
  * \param event Incoming event
  * \return Continue processing the event; true if the event should be silently discarded.
  */
-bool PluginManager::processEvent(PsiAccount* account, QDomElement& event)
+bool PluginManager::processEvent(PsiAccount* account, QDomElement& event, bool *modified)
 {
+    TRACE_FUNCTION();
     bool handled = false;
     const int acc_id = accountIds_.id(account);
-    foreach (PluginHost* host, pluginsByPriority_) {
+    // most filters only look, the caller needn't parse what they left alone
+    QDomElement original;
+    if (modified && !eventFilterHosts_.isEmpty())
+        original = event.cloneNode(true).toElement();
+    foreach (PluginHost* host, eventFilterHosts_) {
         if (host->processEvent(acc_id, event)) {
             handled = true;
             break;
         }
     }
+    if (modified)
+        *modified = !original.isNull() && !sameNode(original, event);
     return handled;
 }
 
+/**
+ * Whether any loaded plugin filters events, without one there's no point
+ * in serializing them for processEvent().
+ */
+bool PluginManager::hasEventFilters() const
+{
+    return !eventFilterHosts_.isEmpty();
+}
+
 /**
  * process an outgoing message
  */
 bool PluginManager::processOutgoingMessage(PsiAccount* account, const QString& jidTo, QString& body, const QString& type, QString& subject)
 {
+    TRACE_FUNCTION();
     bool handled = false;
     const int acc_id = accountIds_.id(account);
-    foreach (PluginHost* host, pluginByFile_.values()) {
+    foreach (PluginHost* host, eventFilterHosts_) {
         if (host->processOutgoingMessage(acc_id, jidTo, body, type, subject)) {
             handled = true;
             break;
@@ -449,12 +592,16 @@ bool PluginManager::processOutgoingMessage(PsiAccount* account, const QString& j
 
 void PluginManager::processOutgoingStanza(PsiAccount* account, QDomElement &stanza)
 {
+    TRACE_FUNCTION();
     const int acc_id = accountIds_.id(account);
-    foreach (PluginHost* host, pluginByFile_.values()) {
+    foreach (PluginHost* host, stanzaFilterHosts_) {
         if (host->outgoingXml(acc_id, stanza)) {
             break;
         }
     }
+    foreach (PluginHost* host, stanzaObserverHosts_) {
+        host->observeOutgoingXml(acc_id, stanza);
+    }
 }
 
 /**
@@ -483,9 +630,19 @@ void PluginManager::logout(PsiAccount* account)
  */
 bool PluginManager::incomingXml(int account, const QDomElement &xml)
 {
+    TRACE_FUNCTION();
     bool handled = false;
-    foreach (PluginHost* host, pluginsByPriority_) {
-        if (host->incomingXml(account, xml)) {
+    foreach (PluginHost* host, stanzaObserverHosts_) {
+        host->observeIncomingXml(account, xml);
+    }
+    if (incomingXmlHosts_.isEmpty()) {
+        return handled;
+    }
+    // route iq stanzas by payload namespace; computed once for all plugins
+    const QString tagName = xml.tagName();
+    const QString iqNs = tagName == QLatin1String("iq") ? PluginHost::iqNamespace(xml) : QString();
+    foreach (PluginHost* host, incomingXmlHosts_) {
+        if (host->wantsIncomingXml(tagName, iqNs) && host->incomingXml(account, xml, iqNs)) {
             handled = true;
             break;
         }
@@ -514,6 +671,21 @@ void PluginManager::sendXml(int account, const QString& xml)
     }
 }
 
+/**
+ * Called by PluginHost when its hosted plugin wants to send xml element.
+ * The element goes to the stream as is, without serializing it to a string
+ * and parsing it back.
+ *
+ * \param account Identifier of the PsiAccount responsible
+ * \param xml XML stanza to be sent
+ */
+void PluginManager::sendXml(int account, const QDomElement& xml)
+{
+    if (account < clients_.size()) {
+        clients_[account]->send(xml);
+    }
+}
+
 /**
  * Returns unique stanza identifier in account's stream
  *
@@ -593,14 +765,7 @@ QStringList PluginManager::getRoster(int account) const
     QStringList list;
     list << "-1";
     if (accountIds_.isValidRange(account)) {
-        list.clear();
-        PsiAccount *pa = accountIds_.account(account);
-        if(pa) {
-            QList<PsiContact*> roster = pa->contactList();
-            for(int i = 0; i < roster.size(); i++) {
-                list.push_back(roster.at(i)->jid().bare());
-            }
-        }
+        list = const_cast<PluginManager*>(this)->rosterSnapshot(account, nullptr);
     }
     return list;
 }
@@ -779,6 +944,7 @@ void PluginManager::setupGCTab(QWidget *tab, PsiAccount *account, const QString&
 bool PluginManager::appendingChatMessage(PsiAccount *account, const QString &contact,
                      QString &body, QDomElement &html, bool local)
 {
+    TRACE_FUNCTION();
     bool handled = false;
     foreach (PluginHost* host, pluginsByPriority_) {
         if (host->appendingChatMessage(accountIds_.id(account), contact, body, html, local)) {
@@ -834,6 +1000,14 @@ void PluginManager::addAccount(PsiAccount* account, XMPP::Client* client)
     new StreamWatcher(client->rootTask(), this, id); // this StreamWatcher instance isn't stored anywhere
     // and probably leaks (if go(true) isn't called somewhere else)
     connect(account, SIGNAL(accountDestroyed()), this, SLOT(accountDestroyed()));
+
+    using Snapshot = AccountSnapshotAccessor;
+    connect(account, &PsiAccount::addedContact, this, [this, id]() { snapshotChanged(id, Snapshot::RosterChange); });
+    connect(account, &PsiAccount::removedContact, this, [this, id]() { snapshotChanged(id, Snapshot::RosterChange); });
+    connect(account, static_cast<void (PsiAccount::*)(const XMPP::Jid &)>(&PsiAccount::updateContact), this,
+            [this, id]() { snapshotChanged(id, Snapshot::ContactChange); });
+    connect(account, &PsiAccount::updatedAccount, this, [this, id]() { snapshotChanged(id, Snapshot::AccountChange); });
+    connect(account, &PsiAccount::updatedActivity, this, [this, id]() { snapshotChanged(id, Snapshot::AccountChange); });
 }
 
 /**
@@ -972,6 +1146,17 @@ void PluginManager::createNewMessageEvent(int account, QDomElement const &elemen
     }
 }
 
+bool PluginManager::executeCommand(int account, const QString &jid, const QString &node, const QVariantMap &fields,
+                                   QObject *receiver, const char *slot)
+{
+    PsiAccount *acc = accountIds_.account(account);
+    if (!acc || !acc->isAvailable()) {
+        return false;
+    }
+    acc->executePluginCommand(jid, node, fields, receiver, slot);
+    return true;
+}
+
 QString PluginManager::installChatLogJSDataFilter(const QString &js, PsiPlugin::Priority priority)
 {
     QString uuid = QUuid::createUuid().toString();
@@ -1135,6 +1320,109 @@ QStringList PluginManager::mucNicks(int account, const QString &mucJid) const
     return {};
 }
 
+quint64 PluginManager::accountVersion(int account) const
+{
+    return snapshots_.value(account).version;
+}
+
+QVariantMap PluginManager::accountSnapshot(int account) const
+{
+    QVariantMap map;
+    PsiAccount *pa = accountIds_.account(account);
+    if (!pa)
+        return map;
+    const ProxySettings proxy = ProxyManager::instance()->getItem(getProxyId(pa)).settings;
+    map.insert("jid", pa->jid().bare());
+    map.insert("id", pa->id());
+    map.insert("name", pa->name());
+    map.insert("status", pa->status().typeString());
+    map.insert("statusMessage", pa->status().status());
+    map.insert("proxyHost", proxy.host);
+    map.insert("proxyPort", proxy.port);
+    map.insert("version", accountVersion(account));
+    return map;
+}
+
+/**
+ * The bare jids of the roster of \a account. The list is built once per
+ * change of the roster and shared by all callers until the next one.
+ */
+QStringList PluginManager::rosterSnapshot(int account, quint64 *version)
+{
+    PsiAccount *pa = accountIds_.account(account);
+    if (!pa)
+        return QStringList();
+    AccountSnapshot &snapshot = snapshots_[account];
+    if (!snapshot.rosterValid) {
+        snapshot.roster.clear();
+        for (PsiContact *contact: pa->contactList())
+            snapshot.roster.push_back(contact->jid().bare());
+        snapshot.rosterValid = true;
+    }
+    if (version)
+        *version = snapshot.version;
+    return snapshot.roster;
+}
+
+QVariantMap PluginManager::contactsSnapshot(int account, const QStringList &jids, quint64 *version) const
+{
+    QVariantMap map;
+    PsiAccount *pa = accountIds_.account(account);
+    if (!pa)
+        return map;
+
+    auto add = [&map](PsiContact *contact) {
+        QVariantMap c;
+        c.insert("name", contact->name());
+        c.insert("status", contact->status().typeString());
+        c.insert("statusMessage", contact->status().status());
+        QStringList resources;
+        for (const UserResource &r: contact->userListItem().userResourceList())
+            resources << r.name();
+        c.insert("resources", resources);
+        map.insert(contact->jid().bare(), c);
+    };
+    if (jids.isEmpty()) {
+        for (PsiContact *contact: pa->contactList())
+            add(contact);
+    } else {
+        for (const QString &jid: jids) {
+            PsiContact *contact = pa->findContact(XMPP::Jid(jid));
+            if (contact)
+                add(contact);
+        }
+    }
+    if (version)
+        *version = accountVersion(account);
+    return map;
+}
+
+void PluginManager::snapshotChanged(int account, int changes)
+{
+    AccountSnapshot &snapshot = snapshots_[account];
+    ++snapshot.version;
+    snapshot.changes |= changes;
+    if (changes & AccountSnapshotAccessor::RosterChange)
+        snapshot.rosterValid = false;
+    if (!snapshotTimer_->isActive())
+        snapshotTimer_->start();
+}
+
+void PluginManager::deliverSnapshotChanges()
+{
+    for (auto it = snapshots_.begin(); it != snapshots_.end(); ++it) {
+        const int changes = it->changes;
+        if (!changes)
+            continue;
+        it->changes = 0;
+        const int account = it.key();
+        const quint64 version = it->version;
+        foreach (PluginHost* host, pluginsByPriority_) {
+            host->accountSnapshotChanged(account, version, changes);
+        }
+    }
+}
+
 bool PluginManager::decryptMessageElement(PsiAccount *account, QDomElement &message) const
 {
     foreach (PluginHost* host, pluginByFile_.values()) {
@@ -71,7 +71,8 @@ public:
 
     void setShortcuts();
 
-    bool processEvent(PsiAccount* account, QDomElement& eventXml);
+    bool hasEventFilters() const;
+    bool processEvent(PsiAccount* account, QDomElement& eventXml, bool *modified = nullptr);
     bool processMessage(PsiAccount* account, const QString& jidFrom, const QString& body, const QString& subject);
     bool processOutgoingMessage(PsiAccount* account, const QString& jidTo, QString& body, const QString& type, QString& subject);
     void processOutgoingStanza(PsiAccount* account, QDomElement &stanza);
@@ -115,6 +116,7 @@ private:
     bool verifyStanza(const QString& stanza);
     QList<PluginHost*> updatePluginsList();
     void loadPluginIfEnabled(PluginHost* plugin);
+    void updateDispatchLists();
 
     static PluginManager* instance_;
 
@@ -130,6 +132,11 @@ private:
     QMap<QString, PluginHost*> pluginByFile_;
     //sorted by priority
     QList<PluginHost*> pluginsByPriority_;
+    //loaded plugins implementing a filter interface, sorted by priority
+    QList<PluginHost*> incomingXmlHosts_;
+    QList<PluginHost*> stanzaFilterHosts_;
+    QList<PluginHost*> eventFilterHosts_;
+    QList<PluginHost*> stanzaObserverHosts_;
 
     QList<QCA::DirWatch*> dirWatchers_;
 
@@ -139,9 +146,20 @@ private:
     QMultiMap<PsiPlugin::Priority,std::pair<QString,QString>> _messageViewJSFilters; // priority -> <js, uuid>
     QTimer *_messageViewJSFiltersTimer = nullptr;
 
+    // what plugins may cache of an account, and the changes they weren't told about yet
+    struct AccountSnapshot {
+        quint64 version = 1;
+        int changes = 0;
+        bool rosterValid = false;
+        QStringList roster;
+    };
+    QHash<int, AccountSnapshot> snapshots_; // by account id
+    QTimer *snapshotTimer_ = nullptr;
+
     class StreamWatcher;
     bool incomingXml(int account, const QDomElement &eventXml);
     void sendXml(int account, const QString& xml);
+    void sendXml(int account, const QDomElement& xml);
     QString uniqueId(int account) const;
 
     QString getStatus(int account) const;
@@ -187,6 +205,14 @@ private:
 
     void createNewEvent(int account, const QString& jid, const QString& descr, QObject *receiver, const char* slot);
     void createNewMessageEvent(int account, QDomElement const &element);
+    bool executeCommand(int account, const QString& jid, const QString& node, const QVariantMap& fields,
+                        QObject *receiver, const char* slot);
+
+    quint64 accountVersion(int account) const;
+    QVariantMap accountSnapshot(int account) const;
+    QStringList rosterSnapshot(int account, quint64 *version);
+    QVariantMap contactsSnapshot(int account, const QStringList &jids, quint64 *version) const;
+    void snapshotChanged(int account, int changes);
 
     void updateFeatures();
 
@@ -202,6 +228,7 @@ private slots:
     void dirsChanged();
     void optionChanged(const QString& option);
     void accountDestroyed();
+    void deliverSnapshotChanges();
 };
 
 #endif // PLUGINMANAGER_H
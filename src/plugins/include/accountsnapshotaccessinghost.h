@@ -0,0 +1,33 @@
+#ifndef ACCOUNTSNAPSHOTACCESSINGHOST_H
+#define ACCOUNTSNAPSHOTACCESSINGHOST_H
+
+#include <QStringList>
+#include <QVariantMap>
+
+class AccountSnapshotAccessingHost
+{
+public:
+    virtual ~AccountSnapshotAccessingHost() {}
+
+    // Counts up with every change of the account, its roster or its contacts.
+    // A plugin keeping what it got from the calls below only has to ask again
+    // when this differs, or when AccountSnapshotAccessor tells about a change.
+    virtual quint64 accountVersion(int account) = 0;
+
+    // What AccountInfoAccessingHost and the proxy getters tell, in one call:
+    // "jid", "id", "name", "status", "statusMessage", "proxyHost", "proxyPort"
+    // and "version". Empty if account is out of range.
+    virtual QVariantMap accountSnapshot(int account) = 0;
+
+    // Bare jids of the roster, the same list getRoster() returns.
+    virtual QStringList rosterSnapshot(int account, quint64 *version = nullptr) = 0;
+
+    // Bare jid => map of "name", "status", "statusMessage" and "resources"
+    // for the given contacts, or for all of the roster if jids is empty.
+    virtual QVariantMap contactsSnapshot(int account, const QStringList &jids = QStringList(),
+                                         quint64 *version = nullptr) = 0;
+};
+
+Q_DECLARE_INTERFACE(AccountSnapshotAccessingHost, "org.psi-im.AccountSnapshotAccessingHost/0.1");
+
+#endif // ACCOUNTSNAPSHOTACCESSINGHOST_H
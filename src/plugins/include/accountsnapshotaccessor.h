@@ -0,0 +1,26 @@
+#ifndef ACCOUNTSNAPSHOTACCESSOR_H
+#define ACCOUNTSNAPSHOTACCESSOR_H
+
+class AccountSnapshotAccessingHost;
+
+class AccountSnapshotAccessor
+{
+public:
+    enum Change {
+        AccountChange = 0x1, // status, jid, name or connection settings
+        RosterChange  = 0x2, // contacts added or removed
+        ContactChange = 0x4  // presence or name of a contact
+    };
+
+    virtual ~AccountSnapshotAccessor() {}
+
+    virtual void setAccountSnapshotAccessingHost(AccountSnapshotAccessingHost* host) = 0;
+
+    // Changes of account since the last call, or-ed Change values. Calls are
+    // collected, a plugin hears at most ten times a second about an account.
+    virtual void accountSnapshotChanged(int account, quint64 version, int changes) = 0;
+};
+
+Q_DECLARE_INTERFACE(AccountSnapshotAccessor, "org.psi-im.AccountSnapshotAccessor/0.1");
+
+#endif // ACCOUNTSNAPSHOTACCESSOR_H
@@ -0,0 +1,26 @@
+#ifndef ADHOCCOMMANDACCESSINGHOST_H
+#define ADHOCCOMMANDACCESSINGHOST_H
+
+#include <QVariantMap>
+
+class QObject;
+class QString;
+
+class AdHocCommandAccessingHost
+{
+public:
+    virtual ~AdHocCommandAccessingHost() {}
+
+    // Runs the ad-hoc command node of jid. If it asks for a form, the form is
+    // submitted once with fields (var => string or string list). Commands of
+    // an account run a few at a time, the others wait. When done, slot is
+    // called as slot(QString jid, QString node, QString status, QVariantMap fields, QString error)
+    // with status "completed", "executing", "canceled" or "error".
+    // Returns false if the account isn't online.
+    virtual bool executeCommand(int account, const QString& jid, const QString& node, const QVariantMap& fields,
+                                QObject *receiver, const char* slot) = 0;
+};
+
+Q_DECLARE_INTERFACE(AdHocCommandAccessingHost, "org.psi-im.AdHocCommandAccessingHost/0.1");
+
+#endif // ADHOCCOMMANDACCESSINGHOST_H
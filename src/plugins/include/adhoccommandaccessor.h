@@ -0,0 +1,16 @@
+#ifndef ADHOCCOMMANDACCESSOR_H
+#define ADHOCCOMMANDACCESSOR_H
+
+class AdHocCommandAccessingHost;
+
+class AdHocCommandAccessor
+{
+public:
+    virtual ~AdHocCommandAccessor() {}
+
+    virtual void setAdHocCommandAccessingHost(AdHocCommandAccessingHost* host) = 0;
+};
+
+Q_DECLARE_INTERFACE(AdHocCommandAccessor, "org.psi-im.AdHocCommandAccessor/0.1");
+
+#endif // ADHOCCOMMANDACCESSOR_H
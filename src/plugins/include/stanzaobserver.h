@@ -0,0 +1,22 @@
+#ifndef STANZAOBSERVER_H
+#define STANZAOBSERVER_H
+
+class QDomElement;
+
+// Read-only access to the stanza stream. The element is the one Psi itself
+// processes, it is not copied and must not be modified. Plugins that need
+// to change or drop stanzas should implement StanzaFilter instead.
+class StanzaObserver
+{
+public:
+    virtual ~StanzaObserver() {}
+
+    // called before incoming stanzas are passed to filters
+    virtual void incomingStanzaObserved(int account, const QDomElement& xml) = 0;
+    // called after outgoing stanzas were passed to filters
+    virtual void outgoingStanzaObserved(int account, const QDomElement& xml) = 0;
+};
+
+Q_DECLARE_INTERFACE(StanzaObserver, "org.psi-im.StanzaObserver/0.1");
+
+#endif // STANZAOBSERVER_H
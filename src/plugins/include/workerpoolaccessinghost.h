@@ -0,0 +1,35 @@
+#ifndef WORKERPOOLACCESSINGHOST_H
+#define WORKERPOOLACCESSINGHOST_H
+
+#include <QVariant>
+
+#include <functional>
+
+class QObject;
+
+class WorkerPoolAccessingHost
+{
+public:
+    virtual ~WorkerPoolAccessingHost() {}
+
+    // Runs job on a thread of a pool all plugins share, then done with its
+    // result on the gui thread. done isn't called once context is gone, the
+    // job is cancelled or the plugin is disabled. Jobs of a plugin still
+    // waiting then are dropped, and the plugin isn't unloaded while one of
+    // its jobs runs. Returns an id for cancelJob().
+    virtual int runJob(std::function<QVariant()> job, QObject *context,
+                       std::function<void(const QVariant &result)> done) = 0;
+    // False when the job already finished or was cancelled before.
+    virtual bool cancelJob(int id) = 0;
+    // Inside a job: whether its result is going to be dropped, a long job
+    // should check it now and then and return early.
+    virtual bool isJobCancelled() const = 0;
+
+    // Calls fn on the gui thread, from a job or any other thread. Nothing is
+    // called once context is gone or the plugin is disabled.
+    virtual void postToGui(QObject *context, std::function<void()> fn) = 0;
+};
+
+Q_DECLARE_INTERFACE(WorkerPoolAccessingHost, "org.psi-im.WorkerPoolAccessingHost/0.1");
+
+#endif // WORKERPOOLACCESSINGHOST_H
@@ -0,0 +1,16 @@
+#ifndef WORKERPOOLACCESSOR_H
+#define WORKERPOOLACCESSOR_H
+
+class WorkerPoolAccessingHost;
+
+class WorkerPoolAccessor
+{
+public:
+    virtual ~WorkerPoolAccessor() {}
+
+    virtual void setWorkerPoolAccessingHost(WorkerPoolAccessingHost* host) = 0;
+};
+
+Q_DECLARE_INTERFACE(WorkerPoolAccessor, "org.psi-im.WorkerPoolAccessor/0.1");
+
+#endif // WORKERPOOLACCESSOR_H
@@ -5,8 +5,12 @@ include_directories(
 list(APPEND PLUGINS_INCLUDES
     plugins/include/accountinfoaccessinghost.h
     plugins/include/accountinfoaccessor.h
+    plugins/include/accountsnapshotaccessinghost.h
+    plugins/include/accountsnapshotaccessor.h
     plugins/include/activetabaccessinghost.h
     plugins/include/activetabaccessor.h
+    plugins/include/adhoccommandaccessinghost.h
+    plugins/include/adhoccommandaccessor.h
     plugins/include/applicationinfoaccessinghost.h
     plugins/include/applicationinfoaccessor.h
     plugins/include/chattabaccessor.h
@@ -41,11 +45,14 @@ list(APPEND PLUGINS_INCLUDES
     plugins/include/soundaccessinghost.h
     plugins/include/soundaccessor.h
     plugins/include/stanzafilter.h
+    plugins/include/stanzaobserver.h
     plugins/include/stanzasender.h
     plugins/include/stanzasendinghost.h
     plugins/include/toolbariconaccessor.h
     plugins/include/webkitaccessor.h
     plugins/include/webkitaccessinghost.h
+    plugins/include/workerpoolaccessinghost.h
+    plugins/include/workerpoolaccessor.h
 )
 list(APPEND HEADERS
     ${PLUGINS_INCLUDES}
@@ -3,6 +3,7 @@ INCLUDEPATH += $$PWD/include
 HEADERS += \
     $$PWD/include/psiplugin.h \
     $$PWD/include/stanzafilter.h \
+    $$PWD/include/stanzaobserver.h \
     $$PWD/include/stanzasender.h \
     $$PWD/include/stanzasendinghost.h \
     $$PWD/include/iqfilter.h \
@@ -37,8 +38,14 @@ HEADERS += \
     $$PWD/include/contactinfoaccessinghost.h \
     $$PWD/include/soundaccessor.h \
     $$PWD/include/soundaccessinghost.h \
+    $$PWD/include/adhoccommandaccessor.h \
+    $$PWD/include/adhoccommandaccessinghost.h \
+    $$PWD/include/accountsnapshotaccessor.h \
+    $$PWD/include/accountsnapshotaccessinghost.h \
     $$PWD/include/chattabaccessor.h \
     $$PWD/include/webkitaccessor.h \
-    $$PWD/include/webkitaccessinghost.h
+    $$PWD/include/webkitaccessinghost.h \
+    $$PWD/include/workerpoolaccessor.h \
+    $$PWD/include/workerpoolaccessinghost.h
 
 OTHER_FILES += $$PWD/psiplugin.pri
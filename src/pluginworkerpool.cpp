@@ -0,0 +1,264 @@
+/*
+ * pluginworkerpool.cpp - threads the plugins run their heavy work on
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pluginworkerpool.h"
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QtConcurrentRun>
+
+static const int maxThreads = 4;
+
+// the state of the job the thread runs
+static thread_local const std::atomic<int> *currentJobState = nullptr;
+
+PluginWorkerPool *PluginWorkerPool::instance()
+{
+    static PluginWorkerPool *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new PluginWorkerPool();
+    }
+    return instance_;
+}
+
+PluginWorkerPool::PluginWorkerPool() : QObject(QCoreApplication::instance())
+{
+    // a core is left to the gui thread
+    pool_.setMaxThreadCount(qBound(1, QThread::idealThreadCount() - 1, maxThreads));
+    clock_.start();
+    connect(this, SIGNAL(wake()), SLOT(deliver()), Qt::QueuedConnection);
+}
+
+int PluginWorkerPool::run(const QString &owner, std::function<QVariant()> job, QObject *context,
+                          std::function<void(const QVariant &)> done)
+{
+    JobPtr j = std::make_shared<Job>();
+    {
+        QMutexLocker locker(&mutex_);
+        if (stopped_.contains(owner))
+            return 0;
+        j->id      = nextId_++;
+        j->owner   = owner;
+        j->fn      = job;
+        j->context = context;
+        j->done    = done;
+        j->queued  = clock_.elapsed();
+        jobs_.insert(j->id, j);
+    }
+    QtConcurrent::run(&pool_, [this, j]() { execute(j); });
+    return j->id;
+}
+
+bool PluginWorkerPool::cancel(const QString &owner, int id)
+{
+    QMutexLocker locker(&mutex_);
+    JobPtr       job = jobs_.value(id);
+    if (job && job->owner == owner) {
+        int waiting = Waiting;
+        if (job->state.compare_exchange_strong(waiting, Cancelled)) {
+            // never runs, the thread it gets only drops it
+            jobs_.remove(id);
+            job->fn = nullptr;
+            ++stats_[owner].cancelled;
+        } else {
+            job->state = Cancelled;
+        }
+        job->done = nullptr;
+        return true;
+    }
+
+    // done, but not delivered yet
+    for (int i = 0; i < finished_.size(); ++i) {
+        if (finished_[i]->id == id && finished_[i]->owner == owner) {
+            finished_.removeAt(i);
+            --stats_[owner].jobs;
+            ++stats_[owner].cancelled;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PluginWorkerPool::isCancelled() { return currentJobState && *currentJobState == Cancelled; }
+
+void PluginWorkerPool::post(const QString &owner, QObject *context, std::function<void()> fn)
+{
+    {
+        QMutexLocker locker(&mutex_);
+        if (stopped_.contains(owner))
+            return;
+        posts_ += Post { owner, context, fn };
+    }
+    scheduleDelivery();
+}
+
+void PluginWorkerPool::start(const QString &owner)
+{
+    QMutexLocker locker(&mutex_);
+    stopped_.remove(owner);
+}
+
+void PluginWorkerPool::stop(const QString &owner)
+{
+    QMutexLocker locker(&mutex_);
+    stopped_.insert(owner);
+    for (auto it = jobs_.begin(); it != jobs_.end();) {
+        const JobPtr &job = it.value();
+        if (job->owner != owner) {
+            ++it;
+            continue;
+        }
+        job->done   = nullptr;
+        int waiting = Waiting;
+        if (job->state.compare_exchange_strong(waiting, Cancelled)) {
+            job->fn = nullptr;
+            ++stats_[owner].cancelled;
+            it = jobs_.erase(it);
+        } else {
+            // a running one is dropped once it returns
+            job->state = Cancelled;
+            ++it;
+        }
+    }
+    for (int i = finished_.size() - 1; i >= 0; --i) {
+        if (finished_[i]->owner == owner) {
+            finished_.removeAt(i);
+            --stats_[owner].jobs;
+            ++stats_[owner].cancelled;
+        }
+    }
+    for (int i = posts_.size() - 1; i >= 0; --i) {
+        if (posts_[i].owner == owner)
+            posts_.removeAt(i);
+    }
+}
+
+bool PluginWorkerPool::waitForJobs(const QString &owner, int msecs)
+{
+    QElapsedTimer waited;
+    waited.start();
+    QMutexLocker locker(&mutex_);
+    while (running_.contains(owner)) {
+        const qint64 left = msecs - waited.elapsed();
+        if (left <= 0)
+            return false;
+        jobDone_.wait(&mutex_, ulong(left));
+    }
+    return true;
+}
+
+PluginWorkerPool::Stats PluginWorkerPool::stats(const QString &owner) const
+{
+    QMutexLocker locker(&mutex_);
+    return stats_.value(owner);
+}
+
+QString PluginWorkerPool::summary(const QString &owner) const
+{
+    const Stats s = stats(owner);
+    if (!s.jobs && !s.cancelled)
+        return QString();
+    const int runs = qMax(1, s.runs);
+    return tr("Background jobs: %1 finished, %2 cancelled. Running %3 ms on average, %4 ms at most. "
+              "Waiting for a thread %5 ms on average, %6 ms at most.")
+        .arg(s.jobs)
+        .arg(s.cancelled)
+        .arg(s.runTime / runs)
+        .arg(s.maxRun)
+        .arg(s.waitTime / runs)
+        .arg(s.maxWait);
+}
+
+void PluginWorkerPool::deliver()
+{
+    wakePending_ = false;
+
+    QList<JobPtr> finished;
+    QList<Post>   posts;
+    {
+        QMutexLocker locker(&mutex_);
+        finished.swap(finished_);
+        posts.swap(posts_);
+    }
+    for (const JobPtr &job : finished) {
+        if (job->context && job->done)
+            job->done(job->result);
+        job->done   = nullptr;
+        job->result = QVariant();
+    }
+    for (const Post &p : posts) {
+        if (p.context)
+            p.fn();
+    }
+}
+
+void PluginWorkerPool::execute(const JobPtr &job)
+{
+    const qint64 started = clock_.elapsed();
+    {
+        // at once, so a plugin being stopped is waited for
+        QMutexLocker locker(&mutex_);
+        int          waiting = Waiting;
+        if (!job->state.compare_exchange_strong(waiting, Running))
+            return;
+        ++running_[job->owner];
+    }
+    currentJobState  = &job->state;
+    QVariant result  = job->fn();
+    currentJobState  = nullptr;
+    const qint64 ran = clock_.elapsed() - started;
+    // whatever the plugin left in there goes before its library may
+    job->fn = nullptr;
+
+    bool delivered;
+    {
+        QMutexLocker locker(&mutex_);
+        Stats &      s      = stats_[job->owner];
+        const qint64 waited = started - job->queued;
+        ++s.runs;
+        s.runTime += ran;
+        s.waitTime += waited;
+        s.maxRun  = qMax(s.maxRun, ran);
+        s.maxWait = qMax(s.maxWait, waited);
+
+        int running = Running;
+        delivered   = job->state.compare_exchange_strong(running, Finished);
+        if (delivered) {
+            ++s.jobs;
+            job->result = result;
+            finished_ += job;
+        } else {
+            ++s.cancelled;
+        }
+        jobs_.remove(job->id);
+        result = QVariant();
+        if (--running_[job->owner] == 0)
+            running_.remove(job->owner);
+        jobDone_.wakeAll();
+    }
+    if (delivered)
+        scheduleDelivery();
+}
+
+void PluginWorkerPool::scheduleDelivery()
+{
+    // one wake up for everything that comes in meanwhile
+    if (!wakePending_.exchange(true))
+        emit wake();
+}
@@ -0,0 +1,130 @@
+/*
+ * pluginworkerpool.h - threads the plugins run their heavy work on
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PLUGINWORKERPOOL_H
+#define PLUGINWORKERPOOL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QThreadPool>
+#include <QVariant>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/**
+ * A pool of a few threads shared by all plugins, for crypto, parsing and
+ * other work that would stall the gui thread. Results come back to the
+ * gui thread, and all of it is tied to the plugin it was started for: a
+ * stopped plugin hears nothing anymore, and its library isn't unloaded
+ * while one of its jobs still runs.
+ *
+ * How long the jobs of each plugin run and wait for a thread is recorded,
+ * so a plugin keeping the pool busy for the others can be told apart.
+ */
+class PluginWorkerPool : public QObject {
+    Q_OBJECT
+public:
+    struct Stats {
+        int    jobs      = 0; // delivered
+        int    cancelled = 0;
+        int    runs      = 0; // got a thread, cancelled or not
+        qint64 runTime   = 0; // msecs, in total
+        qint64 waitTime  = 0;
+        qint64 maxRun    = 0;
+        qint64 maxWait   = 0;
+    };
+
+    static PluginWorkerPool *instance();
+
+    // 0 when owner is stopped
+    int  run(const QString &owner, std::function<QVariant()> job, QObject *context,
+             std::function<void(const QVariant &)> done);
+    bool cancel(const QString &owner, int id);
+    // from inside a job
+    static bool isCancelled();
+    // from any thread
+    void post(const QString &owner, QObject *context, std::function<void()> fn);
+
+    // owner takes jobs again
+    void start(const QString &owner);
+    // drops what owner has waiting or to deliver, its running jobs are told to stop
+    void stop(const QString &owner);
+    // false when a job of owner still runs after msecs
+    bool waitForJobs(const QString &owner, int msecs);
+
+    Stats   stats(const QString &owner) const;
+    QString summary(const QString &owner) const;
+
+signals:
+    void wake();
+
+private slots:
+    void deliver();
+
+private:
+    enum State { Waiting, Running, Finished, Cancelled };
+
+    struct Job {
+        int                                   id = 0;
+        QString                               owner;
+        std::function<QVariant()>             fn;
+        QPointer<QObject>                     context;
+        std::function<void(const QVariant &)> done;
+        std::atomic<int>                      state { Waiting };
+        qint64                                queued = 0; // msecs on the clock
+        QVariant                              result;
+    };
+    using JobPtr = std::shared_ptr<Job>;
+
+    struct Post {
+        QString               owner;
+        QPointer<QObject>     context;
+        std::function<void()> fn;
+    };
+
+    PluginWorkerPool();
+
+    void execute(const JobPtr &job);
+    void scheduleDelivery();
+
+    QThreadPool       pool_;
+    QElapsedTimer     clock_;
+    std::atomic<bool> wakePending_ { false };
+
+    // shared with the workers
+    mutable QMutex        mutex_;
+    QWaitCondition        jobDone_;
+    int                   nextId_ = 1;
+    QHash<int, JobPtr>    jobs_; // waiting or running
+    QList<JobPtr>         finished_;
+    QList<Post>           posts_;
+    QSet<QString>         stopped_;
+    QHash<QString, int>   running_; // by owner
+    QHash<QString, Stats> stats_;
+};
+
+#endif // PLUGINWORKERPOOL_H
@@ -19,18 +19,35 @@
 
 #include "popupmanager.h"
 
+#include "iconset.h"
 #include "psiaccount.h"
 #include "psicon.h"
 #include "psioptions.h"
 #include "psipopupinterface.h"
+#include "textutil.h"
+#include "userlist.h"
 #include "xmpp_jid.h"
 
+#include <QElapsedTimer>
+#include <QPixmap>
 #include <QPluginLoader>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTimer>
 #include <QtPlugin>
 
+#include <algorithm>
+
 static const int defaultTimeout = 5;
 static const QString defaultType = "Classic";
 
+// popups shown within burstWindow / estimated to be on screen; anything above waits in the queue
+static const int burstWindow   = 1000; // msecs
+static const int maxPerBurst   = 3;
+static const int maxVisible    = 5;
+static const int flushInterval = 250;  // msecs
+static const int summaryNames  = 5;
+
 struct OptionValue
 {
     OptionValue(const QString& name, const QString& path, int value, int _id = 0)
@@ -52,14 +69,50 @@ struct OptionValue
     }
 };
 
+/**
+ * A copy of everything a doPopup() call passed in, so the popup can be
+ * shown after the caller's objects are gone.
+ */
+struct PendingPopup
+{
+    QPointer<PsiAccount> account;
+    bool hasAccount = false;
+    PopupManager::PopupType type = PopupManager::AlertNone;
+    Jid jid;
+    QString key;
+    int priority = 0;
+    int merged = 0; // events replaced by this one
+
+    // contact popup
+    bool contact = false;
+    Resource resource;
+    bool hasItem = false;
+    UserListItem item;
+    PsiEvent::Ptr event;
+
+    // text popup
+    QSharedPointer<PsiIcon> titleIcon;
+    QString titleText;
+    bool hasAvatar = false;
+    QPixmap avatar;
+    QSharedPointer<PsiIcon> icon;
+    QString text;
+    int duration = 0; // summaries pick their own
+};
+
 class PopupManager::Private
 {
 
 public:
-    Private()
-        : psi_(nullptr)
+    Private(PopupManager *q)
+        : q_(q)
+        , psi_(nullptr)
         , lastCustomType_(PopupManager::AlertCustom)
     {
+        clock_.start();
+        flushTimer_.setSingleShot(true);
+        flushTimer_.setInterval(flushInterval);
+        QObject::connect(&flushTimer_, &QTimer::timeout, [this]() { flush(); });
     }
 
     PsiPopupInterface* popup(const QString& name)
@@ -108,15 +161,165 @@ public:
         return defaultTimeout*1000;
     }
 
+    static int priority(PopupType type)
+    {
+        switch (type) {
+        case AlertMessage:
+        case AlertChat:
+        case AlertAvCall:
+        case AlertFile:
+        case AlertGcHighlight:
+            return 2;
+        case AlertOnline:
+        case AlertOffline:
+        case AlertStatusChange:
+        case AlertComposing:
+            return 0;
+        default:
+            return 1;
+        }
+    }
+
+    // events of the same kind from one contact or room replace each other while queued
+    static QString key(const PendingPopup &p)
+    {
+        return QString("%1\n%2\n%3").arg(p.account ? p.account->id() : QString(), p.jid.bare()).arg(p.priority);
+    }
+
+    void enqueue(PendingPopup p)
+    {
+        p.priority = priority(p.type);
+        p.key = key(p);
+        for (PendingPopup &q : queue_) {
+            if (q.key == p.key) {
+                p.merged = q.merged + 1;
+                q = p;
+                return;
+            }
+        }
+        if (queue_.isEmpty() && capacity() > 0) {
+            show(p);
+            return;
+        }
+        queue_.append(p);
+        if (!flushTimer_.isActive()) {
+            flushTimer_.start();
+        }
+    }
+
+    int capacity()
+    {
+        const qint64 now = clock_.elapsed();
+        int inBurst = 0;
+        for (auto it = shown_.begin(); it != shown_.end();) {
+            if (it->second <= now) {
+                it = shown_.erase(it);
+                continue;
+            }
+            if (it->first > now - burstWindow) {
+                ++inBurst;
+            }
+            ++it;
+        }
+        return qMin(maxPerBurst - inBurst, maxVisible - shown_.size());
+    }
+
+    /**
+     * Shows the most important of the queued popups. When more are waiting
+     * than may be shown, the rest go into a single summary popup.
+     */
+    void flush()
+    {
+        int cap = capacity();
+        if (cap <= 0) {
+            flushTimer_.start();
+            return;
+        }
+
+        QList<PendingPopup> queue;
+        queue.swap(queue_);
+        std::stable_sort(queue.begin(), queue.end(), [](const PendingPopup &a, const PendingPopup &b) {
+            return a.priority > b.priority;
+        });
+        const bool summarize = queue.size() > cap;
+        if (summarize) {
+            --cap;
+        }
+        for (int i = 0; i < cap && i < queue.size(); ++i) {
+            show(queue[i]);
+        }
+        if (summarize) {
+            show(summary(queue.mid(cap)));
+        }
+    }
+
+    PendingPopup summary(const QList<PendingPopup> &list)
+    {
+        PendingPopup s;
+        int count = 0;
+        QStringList names;
+        for (const PendingPopup &p : list) {
+            count += p.merged + 1;
+            QString name = p.jid.bare();
+            if (p.contact && p.hasItem && !p.item.name().isEmpty()) {
+                name = p.item.name();
+            } else if (name.isEmpty()) {
+                name = p.titleText;
+            }
+            if (!name.isEmpty() && !names.contains(name)) {
+                names.append(name);
+            }
+            s.duration = qMax(s.duration, timeout(p.type));
+        }
+
+        s.titleText = QObject::tr("%n new notifications", "", count);
+        s.text = TextUtil::escape(QStringList(names.mid(0, summaryNames)).join(", "));
+        if (names.size() > summaryNames) {
+            s.text += ' ' + QObject::tr("and %n more", "", names.size() - summaryNames);
+        }
+        const PsiIcon *icon = IconsetFactory::iconPtr("psi/headline");
+        if (icon) {
+            s.titleIcon = QSharedPointer<PsiIcon>(new PsiIcon(*icon));
+        }
+        return s;
+    }
+
+    void show(const PendingPopup &p)
+    {
+        if (p.hasAccount && !p.account) {
+            return;
+        }
+        PsiPopupInterface *popup = this->popup(q_->currentType());
+        if (!popup) {
+            return;
+        }
+        const int duration = p.duration > 0 ? p.duration : timeout(p.type);
+        popup->setDuration(duration);
+        if (p.contact) {
+            popup->popup(p.account, p.type, p.jid, p.resource, p.hasItem ? &p.item : nullptr, p.event);
+        } else {
+            popup->popup(p.account, p.type, p.jid, p.titleIcon.data(), p.titleText,
+                         p.hasAvatar ? &p.avatar : nullptr, p.icon.data(), p.text);
+        }
+        const qint64 now = clock_.elapsed();
+        shown_.append(qMakePair(now, now + duration));
+    }
+
+    PopupManager* q_;
     PsiCon* psi_;
     int lastCustomType_;
     QList<OptionValue> options_;
     QMap<QString, PsiPopupPluginInterface*> popups_;
+
+    QList<PendingPopup> queue_;
+    QList<QPair<qint64, qint64>> shown_; // when each popup went up and when it is expected to go away
+    QElapsedTimer clock_;
+    QTimer flushTimer_;
 };
 
 PopupManager::PopupManager(PsiCon *psi)
 {
-    d = new Private;
+    d = new Private(this);
     d->psi_ = psi;
 
     QList<OptionValue> initList;
@@ -207,33 +410,54 @@ const QStringList PopupManager::optionsNamesList() const
 void PopupManager::doPopup(PsiAccount *account, PopupType pType, const Jid &j, const Resource &r,
                UserListItem *u, const PsiEvent::Ptr &e, bool checkNoPopup)
 {
-    if (!PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.enabled").toBool())
+    if (d->psi_->isHeadless()
+        || !PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.enabled").toBool())
         return;
 
     if(checkNoPopup && d->noPopup(account))
         return;
 
-    PsiPopupInterface *popup = d->popup(currentType());
-    if(popup) {
-        popup->setDuration(d->timeout(pType));
-        popup->popup(account, pType, j, r, u, e);
+    PendingPopup p;
+    p.account = account;
+    p.hasAccount = account;
+    p.type = pType;
+    p.jid = j;
+    p.contact = true;
+    p.resource = r;
+    if (u) {
+        p.hasItem = true;
+        p.item = *u;
     }
+    p.event = e;
+    d->enqueue(p);
 }
 
 void PopupManager::doPopup(PsiAccount *account, const Jid &j, const PsiIcon *titleIcon, const QString &titleText,
                const QPixmap *avatar, const PsiIcon *icon, const QString &text, bool checkNoPopup, PopupType pType)
 {
-    if (!PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.enabled").toBool())
+    if (d->psi_->isHeadless()
+        || !PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.enabled").toBool())
         return;
 
     if(checkNoPopup && d->noPopup(account))
         return;
 
-    PsiPopupInterface *popup = d->popup(currentType());
-    if(popup) {
-        popup->setDuration(d->timeout(pType));
-        popup->popup(account, pType, j, titleIcon, titleText, avatar, icon, text);
+    PendingPopup p;
+    p.account = account;
+    p.hasAccount = account;
+    p.type = pType;
+    p.jid = j;
+    if (titleIcon)
+        p.titleIcon = QSharedPointer<PsiIcon>(new PsiIcon(*titleIcon));
+    p.titleText = titleText;
+    if (avatar) {
+        p.hasAvatar = true;
+        p.avatar = *avatar;
     }
+    if (icon)
+        p.icon = QSharedPointer<PsiIcon>(new PsiIcon(*icon));
+    p.text = text;
+    d->enqueue(p);
 }
 
 QStringList PopupManager::availableTypes() const
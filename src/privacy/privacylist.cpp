@@ -55,6 +55,13 @@ void PrivacyList::appendItem(const PrivacyListItem& item)
     insertItem(items_.count(), item);
 }
 
+// Takes the items in the given order, renumbering them only once
+void PrivacyList::setItems(const QList<PrivacyListItem>& items)
+{
+    items_ = items;
+    reNumber();
+}
+
 void PrivacyList::reNumber()
 {
     unsigned int order = 100;
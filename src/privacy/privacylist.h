@@ -43,6 +43,7 @@ public:
     void removeItem(int index) { items_.removeAt(index); }
     void insertItem(int index, const PrivacyListItem& item);
     void appendItem(const PrivacyListItem& item);
+    void setItems(const QList<PrivacyListItem>& items);
     bool moveItemUp(int index);
     bool moveItemDown(int index);
     bool onlyBlockItems() const;
@@ -31,6 +31,7 @@
 
 #include <QDebug>
 #include <QObject>
+#include <QTimer>
 
 #define PRIVACY_NS "jabber:iq:privacy"
 
@@ -43,12 +44,6 @@ static XMPP::Jid processJid(const XMPP::Jid& jid)
     return jid.withResource("");
 }
 
-static bool privacyListItemForJid(const PrivacyListItem& item, const Jid& jid)
-{
-    return item.type() == PrivacyListItem::JidType &&
-           processJid(item.value()) == processJid(jid);
-}
-
 // -----------------------------------------------------------------------------
 //
 class PrivacyListListener : public Task
@@ -288,6 +283,7 @@ PsiPrivacyManager::PsiPrivacyManager(PsiAccount* account, XMPP::Task* rootTask)
         , account_(account)
         , accountAvailable_(false)
         , isAvailable_(false)
+        , flushScheduled_(false)
 {
     blockedListName_ = BLOCKED_LIST_NAME;
     listener_ = new PrivacyListListener(rootTask_);
@@ -349,8 +345,10 @@ void PsiPrivacyManager::block_getDefaultList_success(const PrivacyList& l_)
     disconnect(this,SIGNAL(defaultListAvailable(const PrivacyList&)),this,SLOT(block_getDefault_success(const PrivacyList&)));
     disconnect(this,SIGNAL(defaultListError()),this,SLOT(block_getDefault_error()));
     block_waiting_ = false;
+    QList<PrivacyListItem> items;
     while (!block_targets_.isEmpty())
-        l.insertItem(0,PrivacyListItem::blockItem(block_targets_.takeFirst()));
+        items.prepend(PrivacyListItem::blockItem(block_targets_.takeFirst()));
+    l.setItems(items + l.items());
     changeList(l);
 }
 
@@ -542,19 +540,9 @@ void PsiPrivacyManager::accountStateChanged()
     accountAvailable_ = account_->isAvailable();
 }
 
-static QStringList findDifferences(QStringList previous, QStringList current)
-{
-    QStringList result;
-    foreach(QString i, previous) {
-        if (!current.contains(i))
-            result += i;
-    }
-    return result;
-}
-
 void PsiPrivacyManager::newListReceived(const PrivacyList& list)
 {
-    QStringList previouslyBlockedContacts = blockedContacts();
+    QSet<QString> previouslyBlockedContacts = blockedContacts();
 
     if (lists_.contains(list.name()))
         *lists_[list.name()] = list;
@@ -564,10 +552,10 @@ void PsiPrivacyManager::newListReceived(const PrivacyList& list)
     if (list.name() == blockedListName_)
         invalidateBlockedListCache();
 
-    QStringList currentlyBlockedContacts = blockedContacts();
+    QSet<QString> currentlyBlockedContacts = blockedContacts();
     QStringList updatedContacts;
-    updatedContacts += findDifferences(previouslyBlockedContacts, currentlyBlockedContacts);
-    updatedContacts += findDifferences(currentlyBlockedContacts, previouslyBlockedContacts);
+    updatedContacts += (previouslyBlockedContacts - currentlyBlockedContacts).values();
+    updatedContacts += (currentlyBlockedContacts - previouslyBlockedContacts).values();
 
     foreach(QString contact, updatedContacts) {
         //emit simulateContactOffline(contact);
@@ -652,9 +640,9 @@ PrivacyList* PsiPrivacyManager::blockedList() const
     return nullptr;
 }
 
-QStringList PsiPrivacyManager::blockedContacts() const
+QSet<QString> PsiPrivacyManager::blockedContacts() const
 {
-    QStringList result;
+    QSet<QString> result;
     if (blockedList()) {
         foreach(PrivacyListItem item, blockedList()->items()) {
             if (item.type() == PrivacyListItem::JidType &&
@@ -676,7 +664,7 @@ void PsiPrivacyManager::invalidateBlockedListCache()
     foreach(PrivacyListItem item, blockedList()->items()) {
         if (item.type() == PrivacyListItem::JidType &&
             item.action() == PrivacyListItem::Deny) {
-            isBlocked_[processJid(item.value()).full()] = true;
+            isBlocked_.insert(processJid(item.value()).full());
         }
     }
 }
@@ -707,7 +695,8 @@ void PsiPrivacyManager::setContactBlocked(const XMPP::Jid& jid, bool blocked)
         return;
     }
 
-    if (isContactBlocked(jid) == blocked)
+    const QString bare = processJid(jid).full();
+    if (pendingBlocked_.value(bare, isContactBlocked(jid)) == blocked)
         return;
 
     if (blocked && isAuthorized(jid)) {
@@ -716,19 +705,37 @@ void PsiPrivacyManager::setContactBlocked(const XMPP::Jid& jid, bool blocked)
         p->go(true);
     }
 
-    PrivacyList newList(*blockedList());
-    newList.clear();
+    // the server only takes whole lists, so blocking a bunch of contacts
+    // in a row goes out as one list
+    pendingBlocked_[bare] = blocked;
+    if (!flushScheduled_) {
+        flushScheduled_ = true;
+        QTimer::singleShot(0, this, SLOT(flushBlockedChanges()));
+    }
+}
 
-    foreach(PrivacyListItem item, blockedList()->items()) {
-        if (privacyListItemForJid(item, jid))
-            continue;
+void PsiPrivacyManager::flushBlockedChanges()
+{
+    flushScheduled_ = false;
+    QHash<QString, bool> changes = pendingBlocked_;
+    pendingBlocked_.clear();
+    if (changes.isEmpty() || !blockedList())
+        return;
 
-        newList.appendItem(item);
+    QList<PrivacyListItem> items;
+    for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
+        if (it.value())
+            items += blockItemFor(it.key());
     }
+    foreach(const PrivacyListItem &item, blockedList()->items()) {
+        if (item.type() == PrivacyListItem::JidType && changes.contains(processJid(item.value()).full()))
+            continue;
 
-    if (blocked)
-        newList.insertItem(0, blockItemFor(jid));
+        items += item;
+    }
 
+    PrivacyList newList(*blockedList());
+    newList.setItems(items);
     changeList(newList);
 }
 
@@ -25,6 +25,7 @@
 
 #include <QHash>
 #include <QObject>
+#include <QSet>
 #include <QStringList>
 
 class PrivacyList;
@@ -110,13 +111,16 @@ private slots:
 
 private slots:
     void privacyListChanged(const QString& name);
+    void flushBlockedChanges();
 
 private:
     PsiAccount* account_;
     bool accountAvailable_;
     bool isAvailable_;
     QHash<QString, PrivacyList*> lists_;
-    QHash<QString, bool> isBlocked_;
+    QSet<QString> isBlocked_;
+    QHash<QString, bool> pendingBlocked_; // changes not sent yet, by bare jid
+    bool flushScheduled_;
 
     void invalidateBlockedListCache();
     void setIsAvailable(bool available);
@@ -125,7 +129,7 @@ private:
     PrivacyList* blockedList() const;
     PrivacyListItem blockItemFor(const XMPP::Jid& jid) const;
 
-    QStringList blockedContacts() const;
+    QSet<QString> blockedContacts() const;
 
     QString blockedListName_, tmpActiveListName_;
     bool isAuthorized(const XMPP::Jid& jid) const;
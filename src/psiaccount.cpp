@@ -33,11 +33,13 @@
 #include "activity.h"
 #include "activitydlg.h"
 #include "adduserdlg.h"
+#include "ahcbatch.h"
 #include "ahcommanddlg.h"
 #include "ahcservermanager.h"
 #include "alertable.h"
 #include "alertmanager.h"
 #include "applicationinfo.h"
+#include "archivesync.h"
 #include "avatars.h"
 #include "avcall/avcall.h"
 #include "avcall/calldlg.h"
@@ -48,8 +50,13 @@
 #include "captchadlg.h"
 #include "changepwdlg.h"
 #include "chatdlg.h"
+#include "chatstatemanager.h"
+#include "contactmanager/contactmanagerbatch.h"
 #include "contactupdatesmanager.h"
+#include "debug.h"
+#include "discocache.h"
 #include "discodlg.h"
+#include "entityinfocache.h"
 #include "eventdb.h"
 #include "eventdlg.h"
 #include "filesharedlg.h"
@@ -63,6 +70,7 @@
 #include "httpauthmanager.h"
 #include "httpfileupload.h"
 #include "iconwidget.h"
+#include "idlescheduler.h"
 #include "infodlg.h"
 #include "irisprotocol/iris_discoinfoquerier.h"
 #include "jidutil.h"
@@ -97,9 +105,15 @@
 #include "rc.h"
 #include "registrationdlg.h"
 #include "rosteritemexchangetask.h"
+#include "rostersnapshot.h"
+#include "rosterversiontask.h"
 #include "s5b.h"
 #include "searchdlg.h"
+#include "seenmessages.h"
+#include "sessionjournal.h"
+#include "stanzapacer.h"
 #include "statusdlg.h"
+#include "statuspreset.h"
 #include "systeminfo.h"
 #include "tabdlg.h"
 #include "tabmanager.h"
@@ -129,7 +143,9 @@
 #ifdef HAVE_PGPUTIL
 #include "multifiletransferdlg.h"
 #include "pgpkeydlg.h"
+#include "pgpsigner.h"
 #include "pgputil.h"
+#include "pgpverifier.h"
 #endif
 #ifdef WHITEBOARDING
 #include "sxe/sxemanager.h"
@@ -137,9 +153,13 @@
 #endif
 
 #include <QApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QFrame>
+#include <QHash>
+#include <QHostAddress>
 #include <QHostInfo>
 #include <QIcon>
 #include <QInputDialog>
@@ -147,11 +167,13 @@
 #include <QList>
 #include <QMap>
 #include <QMessageBox>
+#include <QMultiHash>
 #include <QObject>
 #include <QPixmap>
 #include <QPointer>
 #include <QPushButton>
 #include <QQueue>
+#include <QSet>
 #include <QTimer>
 #include <QUrl>
 #include <QtCrypto>
@@ -170,6 +192,48 @@ typedef int socklen_t;
 
 using namespace XMPP;
 
+/**
+ * Where accounts of a server domain got a connection lately, shared by all
+ * accounts. Reconnects, and other accounts on the same domain, go there
+ * directly instead of looking up SRV and host records again. An entry is
+ * trusted for half an hour, and dropped as soon as connecting to it fails.
+ */
+class EndpointCache {
+public:
+    static bool find(const QString &domain, QHostAddress *address, quint16 *port)
+    {
+        auto it = entries().constFind(domain);
+        if (it == entries().constEnd() || it->expires < QDateTime::currentMSecsSinceEpoch())
+            return false;
+        *address = it->address;
+        *port    = it->port;
+        return true;
+    }
+
+    static void insert(const QString &domain, const QHostAddress &address, quint16 port)
+    {
+        Entry &e  = entries()[domain];
+        e.address = address;
+        e.port    = port;
+        e.expires = QDateTime::currentMSecsSinceEpoch() + 1800 * 1000;
+    }
+
+    static void remove(const QString &domain) { entries().remove(domain); }
+
+private:
+    struct Entry {
+        QHostAddress address;
+        quint16      port    = 0;
+        qint64       expires = 0; // msecs since epoch
+    };
+
+    static QHash<QString, Entry> &entries()
+    {
+        static QHash<QString, Entry> e;
+        return e;
+    }
+};
+
 static AdvancedConnector::Proxy convert_proxy(const UserAccount &acc, const Jid &jid)
 {
     bool    useHost = false;
@@ -351,12 +415,15 @@ struct ReconnectData {
 
 static const int RECONNECT_TIMEOUT_ERROR = -10;
 
+static const QString stanzaPacingOptionPath = "options.outgoing-pacing";
+
 static QList<ReconnectData> reconnectData()
 {
     static QList<ReconnectData> data;
     static const int            max_timeout = 5 * 60;
     if (data.isEmpty()) {
-        data << ReconnectData(15, max_timeout);
+        // most drops are brief, so the first try comes right away
+        data << ReconnectData(2, max_timeout);
         data << ReconnectData(15, max_timeout);
         data << ReconnectData(15, max_timeout);
         data << ReconnectData(15, max_timeout);
@@ -378,10 +445,18 @@ public:
     Private(PsiAccount *parent) :
         Alertable(parent), account(parent), xmlRingbuf(1000)
     {
+        reconnectTimer_ = new QTimer(this);
+        reconnectTimer_->setSingleShot(true);
+        connect(reconnectTimer_, SIGNAL(timeout()), account, SLOT(reconnect()));
+
         reconnectTimeoutTimer_ = new QTimer(this);
         reconnectTimeoutTimer_->setSingleShot(true);
         connect(reconnectTimeoutTimer_, SIGNAL(timeout()), SLOT(reconnectTimerTimeout()));
 
+        resumeWindowTimer = new QTimer(this);
+        resumeWindowTimer->setSingleShot(true);
+        connect(resumeWindowTimer, SIGNAL(timeout()), account, SLOT(finishResumeWindow()));
+
         updateOnlineContactsCountTimer_ = new QTimer(this);
         updateOnlineContactsCountTimer_->setInterval(500);
         updateOnlineContactsCountTimer_->setSingleShot(true);
@@ -392,6 +467,25 @@ public:
         logoutTimer->setInterval(500);
         logoutTimer->setSingleShot(true);
         connect(logoutTimer, SIGNAL(timeout()), SLOT(finishLogout()));
+
+        presenceFlushTimer = new QTimer(this);
+        presenceFlushTimer->setInterval(250);
+        presenceFlushTimer->setSingleShot(true);
+        connect(presenceFlushTimer, SIGNAL(timeout()), account, SLOT(flushPendingPresence()));
+
+        autoJoinTimer = new QTimer(this);
+        autoJoinTimer->setInterval(250);
+        connect(autoJoinTimer, SIGNAL(timeout()), account, SLOT(autoJoinNext()));
+
+        backlogTimer = new QTimer(this);
+        backlogTimer->setInterval(2000);
+        backlogTimer->setSingleShot(true);
+        connect(backlogTimer, SIGNAL(timeout()), account, SLOT(finishBacklog()));
+
+        backlogChatTimer = new QTimer(this);
+        backlogChatTimer->setInterval(100);
+        backlogChatTimer->setSingleShot(true);
+        connect(backlogChatTimer, SIGNAL(timeout()), account, SLOT(flushBacklogChats()));
     }
 
     PsiContactList *         contactList             = nullptr;
@@ -405,6 +499,8 @@ public:
     Status                   loginStatus;
     QMetaObject::Connection  reconnectConnection;
     bool                     loginWithPriority = false;
+    bool                     cachedEndpoint    = false; // connecting to an EndpointCache entry
+    bool                     endpointReached   = false;
     //bool reconnectingOnce;
     bool                     nickFromVCard = false;
     bool                     pepAvailable  = false;
@@ -413,6 +509,14 @@ public:
     XmlConsole *             xmlConsole    = nullptr;
     UserList                 userList;
     UserListItem             self;
+
+    // version the in-list items of userList are at least as new as
+    QString                  rosterVersion;
+    Jid                      rosterVersionJid; // the account it was loaded for
+    Roster                   rosterSnapshot; // stored items, until the server confirms them
+    bool                     rosterSnapshotDeleted = false;
+    QPointer<ChatDlg>        warmChat; // built in advance, bound by the next ensureChatDlg()
+    SeenMessages             seenMessages;
     QCA::PGPKey              cur_pgpSecretKey;
     QList<Message>           messageQueue;
     BlockTransportPopupList *blockTransportPopupList = nullptr;
@@ -424,6 +528,36 @@ public:
     QTimer *                 updateOnlineContactsCountTimer_ = nullptr;
     QTimer *                 logoutTimer                     = nullptr;
 
+    // presence received right after login is applied in batches
+    QTimer *                 presenceFlushTimer = nullptr;
+    QList<Jid>               pendingPresenceJids;
+    QHash<QString, Resource> pendingPresence;
+
+    // after a drop the contacts keep their presence for a while, a quick
+    // reconnect refreshes it and only what didn't come back goes offline
+    QTimer *                 resumeWindowTimer = nullptr;
+    QSet<QString>            resumedResources;
+
+    // a burst of offline messages or carbons, as it comes after a
+    // reconnect, is not announced message by message
+    QTimer *                                   backlogTimer     = nullptr; // quiet time ending a burst
+    QTimer *                                   backlogChatTimer = nullptr;
+    QList<QPair<QPointer<ChatDlg>, Message>>   backlogChats;               // not shown in their chats yet
+    int                                        backlogCount     = 0;       // delayed messages of the burst
+    int                                        backlogAlerts    = 0;       // popups and sounds held back
+    bool                                       backlogActive    = false;
+
+    // bookmarked conferences are joined a few at a time after login
+    QTimer *                  autoJoinTimer = nullptr;
+    QList<ConferenceBookmark> autoJoinQueue;
+    QHash<QString, qint64>    autoJoinPending; // room jid -> when the join was sent
+    QElapsedTimer             autoJoinClock;
+    int                       autoJoinDone  = 0;
+    int                       autoJoinTotal = 0;
+
+    // last message seen in rooms we are not in, so joining asks only for newer history
+    QHash<QString, QDateTime> mucLastSeen;
+
     // Tune
     Tune lastTune;
 
@@ -463,6 +597,21 @@ public:
     // Bookmarks
     BookmarkManager *bookmarkManager = nullptr;
 
+    // chat state notifications of all chat dialogs
+    ChatStateManager *chatStateManager = nullptr;
+
+    // holds background traffic back under the budget of the account
+    StanzaPacer *stanzaPacer = nullptr;
+
+    // disco#info and disco#items results, shared by all dialogs
+    DiscoCache *discoCache = nullptr;
+
+    // versions, times and last activity of contacts, shared by all dialogs
+    EntityInfoCache *entityInfoCache = nullptr;
+
+    // Server side message archive
+    ArchiveSync *archiveSync = nullptr;
+
     // HttpAuth
     HttpAuthManager *httpAuthManager = nullptr;
 
@@ -480,8 +629,9 @@ public:
 
     QHostAddress localAddress;
 
-    QList<PsiContact *> contacts;
-    int                 onlineContactsCount = 0;
+    QList<PsiContact *>                contacts;
+    QMultiHash<QString, PsiContact *> contactsByBareJid;
+    int                                onlineContactsCount = 0;
 
 private:
     bool doPopups_ = true;
@@ -489,7 +639,7 @@ private:
 public:
     bool noPopup(ActivationType activationType) const
     {
-        if (activationType == FromXml || !doPopups_)
+        if (activationType == FromXml || !doPopups_ || psi->isHeadless())
             return true;
 
         if (lastManualStatus().isAvailable()) {
@@ -508,7 +658,7 @@ public:
 
     bool noPopupDialogs(ActivationType activationType) const
     {
-        if (activationType == FromXml || !doPopups_)
+        if (activationType == FromXml || !doPopups_ || psi->isHeadless())
             return true;
 
         if (lastManualStatus().isAvailable()) {
@@ -529,6 +679,7 @@ private slots:
     {
         Q_ASSERT(contacts.contains(contact));
         contacts.removeAll(contact);
+        contactsByBareJid.remove(contact->jid().bare(), contact);
         emit account->removedContact(contact);
     }
 
@@ -542,6 +693,7 @@ private slots:
         // PsiContactGroup* parent = groupsForUserListItem(u).first();
         PsiContact *contact = new PsiContact(u, account);
         contacts.append(contact);
+        contactsByBareJid.insert(contact->jid().bare(), contact);
         connect(contact, SIGNAL(destroyed(PsiContact *)), SLOT(removeContact(PsiContact *)));
         emit account->addedContact(contact);
         return contact;
@@ -550,11 +702,14 @@ private slots:
 public:
     PsiContact *findContact(const Jid &jid) const
     {
-        foreach (PsiContact *contact, contacts)
-            if (contact->find(jid))
-                return contact;
-
-        return nullptr;
+        PsiContact *res = nullptr;
+        const QString bare = jid.bare();
+        for (auto it = contactsByBareJid.constFind(bare); it != contactsByBareJid.constEnd() && it.key() == bare; ++it) {
+            // contacts never share a jid, but keep the old "first added wins" rule just in case
+            if (it.value()->find(jid) && (!res || contacts.indexOf(it.value()) < contacts.indexOf(res)))
+                res = it.value();
+        }
+        return res;
     }
 
     PsiContact *findContactOrSelf(const Jid &jid) const
@@ -701,6 +856,13 @@ public slots:
         emit account->updatedAccount();
     }
 
+    void updateStanzaPacer()
+    {
+        PsiOptions *o = PsiOptions::instance();
+        stanzaPacer->setBudget(o->getOption(stanzaPacingOptionPath + ".stanzas-per-second").toInt(),
+                               o->getOption(stanzaPacingOptionPath + ".bytes-per-second").toInt());
+    }
+
     void finishLogout()
     {
         account->cleanupStream();
@@ -710,6 +872,7 @@ public slots:
 
     void client_xmlIncoming(const QString &s)
     {
+        XML_DEBUG() << account->name() << "in:" << s;
         xmlRingbuf[xmlRingbufWrite].type = RingXmlIn;
         xmlRingbuf[xmlRingbufWrite].xml  = s;
         xmlRingbuf[xmlRingbufWrite].time = QDateTime::currentDateTime();
@@ -717,6 +880,8 @@ public slots:
     }
     void client_xmlOutgoing(const QString &s)
     {
+        XML_DEBUG() << account->name() << "out:" << s;
+        stanzaPacer->written(s.size()); // characters, close enough to bytes
         xmlRingbuf[xmlRingbufWrite].type = RingXmlOut;
         xmlRingbuf[xmlRingbufWrite].xml  = s;
         xmlRingbuf[xmlRingbufWrite].time = QDateTime::currentDateTime();
@@ -767,7 +932,12 @@ private:
         Jid      jid;
     };
 
-    QList<item_dialog2 *> dialogList;
+    QList<item_dialog2 *>                  dialogList;   // in registration order
+    QList<item_dialog2 *>                  chatDialogs;  // the ChatDlgs of dialogList, what makes contacts active
+    QHash<QString, QList<item_dialog2 *>>  dialogsByJid; // bare jid => dialogs for any of its resources
+    QHash<const QWidget *, item_dialog2 *> dialogByWidget;
+
+    QHash<QString, JT_BitsOfBinary *> bobRequests; // cid => running request
 
     bool compareJids(const Jid &j1, const Jid &j2, bool compareResource) const
     {
@@ -790,7 +960,10 @@ public:
     }
     QWidget *findDialog(const QMetaObject &mo, const Jid &jid, bool compareResource) const
     {
-        foreach (item_dialog2 *i, dialogList) {
+        auto it = dialogsByJid.constFind(jid.bare());
+        if (it == dialogsByJid.constEnd())
+            return nullptr;
+        for (item_dialog2 *i : it.value()) {
             if (mo.cast(i->widget) && compareJids(i->jid, jid, compareResource)) {
                 return i->widget;
             }
@@ -801,7 +974,10 @@ public:
     void findDialogs(const QMetaObject &mo, const Jid &jid, bool compareResource,
                      QList<void *> *list) const
     {
-        foreach (item_dialog2 *i, dialogList) {
+        auto it = dialogsByJid.constFind(jid.bare());
+        if (it == dialogsByJid.constEnd())
+            return;
+        for (item_dialog2 *i : it.value()) {
             if (mo.cast(i->widget) && compareJids(i->jid, jid, compareResource)) {
                 list->append(i->widget);
             }
@@ -823,26 +999,54 @@ public:
         i->widget       = w;
         i->jid          = jid;
         dialogList.append(i);
+        dialogsByJid[jid.bare()].append(i);
+        dialogByWidget.insert(w, i);
+        if (qobject_cast<ChatDlg *>(w)) {
+            chatDialogs.append(i);
+            // the unbound chat waiting for the next one has no jid yet
+            if (!jid.isEmpty())
+                SessionJournal::instance()->chatOpened(acc.id, jid.full());
+        }
     }
 
-    void dialogUnregister(QWidget *w)
+    QList<PsiContact *> activeContacts() const
     {
-        foreach (item_dialog2 *i, dialogList) {
-            if (i->widget == w) {
-                dialogList.removeAll(i);
-                delete i;
-                return;
+        QList<PsiContact *> ret;
+        for (item_dialog2 *i : chatDialogs) {
+            const QString bare = i->jid.bare();
+            for (auto it = contactsByBareJid.constFind(bare); it != contactsByBareJid.constEnd() && it.key() == bare;
+                 ++it) {
+                if (!ret.contains(it.value()) && it.value()->isActiveContact())
+                    ret.append(it.value());
             }
         }
+        return ret;
+    }
+
+    void dialogUnregister(QWidget *w)
+    {
+        item_dialog2 *i = dialogByWidget.take(w);
+        if (!i)
+            return;
+        dialogList.removeOne(i);
+        if (chatDialogs.removeOne(i) && !i->jid.isEmpty())
+            SessionJournal::instance()->chatClosed(acc.id, i->jid.full());
+        auto it = dialogsByJid.find(i->jid.bare());
+        if (it != dialogsByJid.end()) {
+            it.value().removeOne(i);
+            if (it.value().isEmpty())
+                dialogsByJid.erase(it);
+        }
+        delete i;
     }
 
     void deleteDialogList()
     {
         while (!dialogList.isEmpty()) {
-            item_dialog2 *i = dialogList.takeFirst();
+            QWidget *w = dialogList.first()->widget;
 
-            delete i->widget;
-            delete i;
+            dialogUnregister(w);
+            delete w;
         }
     }
 
@@ -1004,24 +1208,34 @@ private:
     }
 
 public slots:
-    void startReconnect()
+    // immediately skips the back-off, for when the network is known to be fine
+    void startReconnect(bool immediately = false)
     {
         reconnectData_++;
         Q_ASSERT(::reconnectData().count());
         reconnectData_     = qMax(0, qMin(reconnectData_, ::reconnectData().count() - 1));
         ReconnectData data = ::reconnectData()[reconnectData_];
 
-        int delay = data.delay * 1000;
+        int delay = immediately ? 0 : data.delay * 1000;
         reconnectTimeoutTimer_->stop();
         reconnectTimeoutTimer_->setInterval(data.timeout * 1000);
         account->doReconnect = true;
 
         reconnectScheduledAt_ = QDateTime::currentDateTime();
-        reconnectScheduledAt_ = reconnectScheduledAt_.addSecs(data.delay);
-        QTimer::singleShot(delay, account, SLOT(reconnect()));
+        reconnectScheduledAt_ = reconnectScheduledAt_.addMSecs(delay);
+        reconnectTimer_->start(delay);
         emit account->stateChanged();
     }
 
+    // the network came back, no point in waiting for the scheduled attempt
+    void reconnectNow()
+    {
+        if (account->doReconnect && reconnectTimer_->isActive()) {
+            reconnectTimer_->stop();
+            account->reconnect();
+        }
+    }
+
     void startReconnectTimeout()
     {
         reconnectScheduledAt_ = QDateTime();
@@ -1034,6 +1248,7 @@ public slots:
         reconnectScheduledAt_ = QDateTime();
         reconnectData_        = -1;
         account->doReconnect  = false;
+        reconnectTimer_->stop();
         reconnectTimeoutTimer_->stop();
     }
 
@@ -1047,6 +1262,7 @@ private slots:
 
 public:
     QDateTime reconnectScheduledAt_;
+    QTimer *  reconnectTimer_        = nullptr;
     QTimer *  reconnectTimeoutTimer_ = nullptr;
     int       reconnectData_         = -1;
     bool      reconnectInfrequently_ = false;
@@ -1182,8 +1398,8 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
 
     // Initialize PubSub stuff
     d->pepManager = new PEPManager(d->client, d->client->serverInfoManager());
-    connect(d->pepManager, SIGNAL(itemPublished(const Jid &, const QString &, const PubSubItem &)),
-            SLOT(itemPublished(const Jid &, const QString &, const PubSubItem &)));
+    connect(d->pepManager, SIGNAL(itemsPublished(const Jid &, const PEPItems &)),
+            SLOT(itemsPublished(const Jid &, const PEPItems &)));
     connect(d->pepManager, SIGNAL(itemRetracted(const Jid &, const QString &, const PubSubRetraction &)), SLOT(itemRetracted(const Jid &, const QString &, const PubSubRetraction &)));
     d->pepAvailable = false;
 
@@ -1202,10 +1418,24 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
     connect(VCardFactory::instance(), SIGNAL(vcardChanged(const Jid &)), d,
             SLOT(vcardChanged(const Jid &)));
 
+    d->discoCache      = new DiscoCache(d->client, this);
+    d->entityInfoCache = new EntityInfoCache(d->client, this);
+
     // Bookmarks
     d->bookmarkManager = new BookmarkManager(this);
     connect(d->bookmarkManager, SIGNAL(availabilityChanged()), SLOT(bookmarksAvailabilityChanged()));
 
+    d->chatStateManager = new ChatStateManager(this);
+
+    d->stanzaPacer = new StanzaPacer(this);
+    d->updateStanzaPacer();
+    connect(PsiOptions::instance(), &PsiOptions::optionChanged, d, [this](const QString &option) {
+        if (option.startsWith(stanzaPacingOptionPath))
+            d->updateStanzaPacer();
+    });
+
+    d->archiveSync = new ArchiveSync(this);
+
 #ifdef USE_PEP
     // Tune Controller
     connect(d->psi->tuneManager(), SIGNAL(stopped()), SLOT(tuneStopped()));
@@ -1309,6 +1539,9 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
 
     d->contactList->link(this);
 
+    if (enabled())
+        loadRosterSnapshot();
+
     d->updateContacts(); //update always visible contacts state
 }
 
@@ -1320,6 +1553,7 @@ PsiAccount::~PsiAccount()
 
     emit accountDestroyed();
     // nuke all related dialogs
+    delete d->warmChat;
     deleteAllDialogs();
 
     d->messageQueue.clear();
@@ -1340,6 +1574,9 @@ PsiAccount::~PsiAccount()
     delete d->sxeManager;
 #endif
     delete d->bookmarkManager;
+    delete d->chatStateManager;
+    delete d->discoCache;
+    delete d->entityInfoCache;
     delete d->client;
     delete d->httpAuthManager;
     cleanupStream();
@@ -1359,6 +1596,9 @@ PsiAccount::~PsiAccount()
 
 void PsiAccount::cleanupStream()
 {
+    if (d->archiveSync)
+        d->archiveSync->stop();
+
     // GSOC: Get SM state out of stream
     delete d->stream;
 
@@ -1757,9 +1997,18 @@ void PsiAccount::login()
     }
     d->conn->setProxy(p);
 
+    d->cachedEndpoint  = false;
+    d->endpointReached = false;
     if (useHost) {
         d->conn->setOptHostPort(host, quint16(port));
         d->conn->setOptSSL(d->acc.ssl == UserAccount::SSL_Legacy);
+    } else if (d->acc.proxyID.isEmpty() && d->acc.ssl != UserAccount::SSL_Legacy) {
+        QHostAddress address;
+        quint16      cachedPort;
+        if (EndpointCache::find(d->jid.domain(), &address, &cachedPort)) {
+            d->conn->setOptHostPort(address.toString(), cachedPort);
+            d->cachedEndpoint = true;
+        }
     }
 
     d->stream = new ClientStream(d->conn, d->tlsHandler);
@@ -1806,6 +2055,11 @@ void PsiAccount::logout(bool fast, const Status &s)
     clearCurrentConnectionError();
 
     d->stopReconnect();
+    d->autoJoinQueue.clear();
+    d->autoJoinPending.clear();
+    d->autoJoinTimer->stop();
+    d->autoJoinDone = d->autoJoinTotal = 0;
+    emit autoJoinProgress(0, 0);
 
     if (loggedIn()) {
         if (fast) {
@@ -1824,6 +2078,14 @@ void PsiAccount::logout(bool fast, const Status &s)
 
     isDisconnecting = true;
 
+    // while the statuses are still there
+    if (rosterDone && !d->rosterSnapshotDeleted) {
+        IdleScheduler::instance()->cancel(this, "roster-snapshot");
+        saveRosterSnapshot();
+    }
+
+    if (d->resumeWindowTimer->isActive())
+        finishResumeWindow();
     if (!fast)
         simulateRosterOffline();
 
@@ -1883,7 +2145,13 @@ void PsiAccount::cs_connected()
         return;
 
     if (bs->inherits("BSocket") || bs->inherits("XMPP::BSocket")) {
-        d->localAddress = static_cast<BSocket *>(bs)->address();
+        BSocket *socket = static_cast<BSocket *>(bs);
+        d->localAddress = socket->address();
+
+        // only what the SRV lookup found is worth sharing, not a manual host
+        d->endpointReached = true;
+        if (!d->acc.opt_host && d->acc.proxyID.isEmpty() && !socket->peerAddress().isNull())
+            EndpointCache::insert(d->jid.domain(), socket->peerAddress(), socket->peerPort());
 
         if (d->avCallManager)
             d->avCallManager->setSelfAddress(d->localAddress);
@@ -2035,7 +2303,185 @@ void PsiAccount::sessionStarted()
     }
 
     // ask for roster
-    d->client->rosterRequest();
+    requestRoster();
+}
+
+/**
+ * Asks for the roster as of the version we have, so an unchanged roster
+ * doesn't have to be downloaded and rebuilt on every login.
+ */
+void PsiAccount::requestRoster()
+{
+    if (!d->rosterVersionJid.compare(d->jid, false)) {
+        d->rosterVersionJid = d->jid.bare();
+        d->rosterVersion.clear();
+        d->rosterSnapshot.clear();
+        RosterSnapshot snapshot(id(), d->jid);
+        if (snapshot.load()) {
+            d->rosterVersion  = snapshot.version();
+            d->rosterSnapshot = snapshot.roster();
+        }
+    }
+
+    // an empty version asks the server to start versioning
+    RosterVersionTask *t = new RosterVersionTask(d->rosterVersion, d->client->rootTask());
+    connect(t, SIGNAL(finished()), SLOT(rosterVersionFinished()));
+    t->go(true);
+}
+
+static bool sameRosterItem(const RosterItem &a, const RosterItem &b)
+{
+    return a.name() == b.name() && a.groups() == b.groups() && a.subscription().type() == b.subscription().type()
+        && a.ask() == b.ask();
+}
+
+void PsiAccount::rosterVersionFinished()
+{
+    RosterVersionTask *t = static_cast<RosterVersionTask *>(sender());
+    if (!t->success()) {
+        if (t->statusCode() == Task::ErrDisc)
+            return;
+        qWarning("PsiAccount: [%s] versioned roster request failed, asking for the whole roster",
+                 qPrintable(name()));
+        d->rosterVersion.clear();
+        d->rosterSnapshot.clear();
+        d->client->rosterRequest();
+        return;
+    }
+
+    Roster roster;
+    if (t->hasRoster()) {
+        roster           = t->roster();
+        d->rosterVersion = t->version();
+    } else if (!d->rosterSnapshot.isEmpty()) {
+        roster = d->rosterSnapshot;
+    } else {
+        // what we had before the reconnect is still current
+        foreach (UserListItem *u, d->userList) {
+            if (u->inList())
+                roster += *u;
+        }
+    }
+    d->rosterSnapshot.clear();
+
+    // iris only fills its roster from its own roster request, so mirror ours
+    // there; it's empty of presence this early
+    LiveRoster &live = const_cast<LiveRoster &>(d->client->roster());
+    live.clear();
+    for (const RosterItem &item : roster)
+        live += LiveRosterItem(item);
+
+    // touch only what changed, the rest just keeps its place
+    for (const RosterItem &item : roster) {
+        UserListItem *u = d->userList.find(item.jid());
+        if (u && u->inList() && sameRosterItem(*u, item))
+            u->setFlagForDelete(false);
+        else
+            client_rosterItemUpdated(item);
+    }
+
+    client_rosterRequestFinished(true, 0, QString());
+}
+
+/**
+ * Fills the contact list from the stored snapshot, so it's there at startup
+ * instead of being built contact by contact once the roster arrives. The
+ * contacts show up offline with their last known status, login reconciles
+ * them with the server roster later.
+ */
+void PsiAccount::loadRosterSnapshot()
+{
+    RosterSnapshot snapshot(id(), d->jid);
+    if (!snapshot.load())
+        return;
+    d->mucLastSeen = snapshot.rooms();
+    if (snapshot.roster().isEmpty())
+        return;
+
+    // requestRoster() takes it from here, the items are in the user list now
+    d->rosterVersionJid = d->jid.bare();
+    d->rosterVersion    = snapshot.version();
+    d->rosterSnapshot.clear();
+
+    emit beginBulkContactUpdate();
+    for (const RosterItem &item : snapshot.roster()) {
+        if (d->userList.find(item.jid()))
+            continue;
+        UserListItem *u = new UserListItem;
+        u->setRosterItem(item);
+        u->setAvatarFactory(avatarFactory());
+        u->setInList(true);
+
+        auto it = snapshot.lastSeen().constFind(item.jid().bare());
+        if (it != snapshot.lastSeen().constEnd()) {
+            u->setLastUnavailableStatus(makeStatus(STATUS_OFFLINE, it->status));
+            u->setLastAvailable(it->time);
+        }
+        d->userList.append(u);
+        profileUpdateEntry(*u);
+    }
+    emit endBulkContactUpdate();
+}
+
+void PsiAccount::saveRosterSnapshot()
+{
+    Roster                      roster;
+    RosterSnapshot::LastSeenMap lastSeen;
+    const QDateTime             now = QDateTime::currentDateTime();
+    foreach (UserListItem *u, d->userList) {
+        if (!u->inList())
+            continue;
+        roster += *u;
+        if (u->isAvailable())
+            lastSeen.insert(u->jid().bare(), { u->priority()->status().status(), now });
+        else if (!u->lastUnavailableStatus().status().isEmpty() || u->lastAvailable().isValid())
+            lastSeen.insert(u->jid().bare(), { u->lastUnavailableStatus().status(), u->lastAvailable() });
+    }
+    RosterSnapshot::RoomMap rooms = d->mucLastSeen;
+#ifdef GROUPCHAT
+    for (GCMainDlg *w : findAllDialogs<GCMainDlg *>()) {
+        if (w->lastMsgTime().isValid())
+            rooms.insert(w->jid().bare(), w->lastMsgTime());
+    }
+#endif
+    RosterSnapshot(id(), d->jid).save(d->rosterVersion, roster, lastSeen, rooms);
+}
+
+void PsiAccount::scheduleRosterSnapshot()
+{
+    // an unversioned snapshot is still good for filling the contact list at
+    // startup, the next login simply asks for the whole roster then
+    if (d->rosterSnapshotDeleted)
+        return;
+
+    IdleScheduler::instance()->schedule(this, "roster-snapshot", [this]() { saveRosterSnapshot(); },
+                                        IdleScheduler::Low, 60000);
+}
+
+// building a chat dialog with its chat view takes a noticeable while, so one
+// is built when the client is idle and the next opened chat only binds it
+void PsiAccount::scheduleWarmChatDlg()
+{
+    if (d->warmChat || d->psi->isHeadless())
+        return;
+
+    IdleScheduler::instance()->schedule(this, "warm-chat",
+                                        [this]() {
+                                            if (d->warmChat || !isActive())
+                                                return;
+                                            d->warmChat = ChatDlg::createUnbound(this, d->tabManager);
+                                            // its looks follow the options while it waits
+                                            connect(d->psi, SIGNAL(emitOptionsUpdate()), d->warmChat,
+                                                    SLOT(optionsUpdate()));
+                                        },
+                                        IdleScheduler::Low, 300000, 2000);
+}
+
+void PsiAccount::deleteRosterSnapshot()
+{
+    d->rosterSnapshotDeleted = true;
+    IdleScheduler::instance()->cancel(this, "roster-snapshot");
+    RosterSnapshot(id(), d->jid).remove();
 }
 
 void PsiAccount::cs_connectionClosed()
@@ -2262,6 +2708,10 @@ void PsiAccount::cs_error(int err)
     if (!isActive())
         return; // all cleaned up already
 
+    // the server moved, the next attempt looks it up again
+    if (d->cachedEndpoint && !d->endpointReached)
+        EndpointCache::remove(d->jid.domain());
+
     bool disableAutoConnect;
     getErrorInfo(err, d->conn, d->stream, d->tlsHandler, &str, &reconn, &badPass, &disableAutoConnect,
                  &isTemporaryAuthFailure, &needAlert);
@@ -2282,16 +2732,26 @@ void PsiAccount::cs_error(int err)
 
     isDisconnecting = true;
 
+    // a failed reconnect attempt leaves the grace period running
+    bool autoReconnect = d->acc.opt_reconn && reconn && !badPass;
+    if (d->resumeWindowTimer->isActive() && (loggedIn() || !autoReconnect))
+        finishResumeWindow();
     if (loggedIn()) { // FIXME: is this condition okay?
-        simulateRosterOffline();
+        if (autoReconnect) {
+            d->resumedResources.clear();
+            d->resumeWindowTimer->start(30000);
+        } else {
+            simulateRosterOffline();
+        }
     }
 
     presenceSent = false; // this stops the idle detector?? (FIXME)
 
     // Auto-Reconnect?
-    if (d->acc.opt_reconn && reconn && !badPass) {
+    if (autoReconnect) {
         isDisconnecting = false;
-        d->startReconnect();
+        // the server is there, it just lost our session: log in again right away
+        d->startReconnect(err == XMPP::ClientStream::ErrSmResume);
         return;
     }
 
@@ -2361,6 +2821,9 @@ void PsiAccount::client_rosterRequestFinished(bool success, int, const QString &
         }
 
         d->stopReconnect();
+        d->archiveSync->start();
+        scheduleRosterSnapshot();
+        scheduleWarmChatDlg();
     } else {
         //printf("PsiAccount: [%s] error retrieving roster: [%d, %s]\n", name().latin1(), code, str.latin1());
     }
@@ -2376,6 +2839,25 @@ void PsiAccount::client_rosterRequestFinished(bool success, int, const QString &
     d->vcardChanged(jid());
     setStatusDirect(d->loginStatus, d->loginWithPriority);
 
+#ifdef GROUPCHAT
+    // back into the rooms the crashed session was in, like into bookmarked ones
+    QList<ConferenceBookmark> rooms;
+    for (const SessionJournal::Room &r : SessionJournal::instance()->takeRecoveredRooms(id())) {
+        // passwords aren't journaled, a bookmarked room has its own
+        QString password;
+        for (const ConferenceBookmark &c : d->bookmarkManager->conferences()) {
+            if (c.jid().bare() == r.jid)
+                password = c.password();
+        }
+        rooms += ConferenceBookmark(QString(), r.jid, ConferenceBookmark::Always, r.nick, password);
+    }
+    autoJoin(rooms);
+#endif
+
+    // give the contacts a moment to tell they're still there
+    if (d->resumeWindowTimer->isActive())
+        d->resumeWindowTimer->start(10000);
+
     emit rosterRequestFinished();
 }
 
@@ -2485,19 +2967,110 @@ void PsiAccount::bookmarksAvailabilityChanged()
     }
 
 #ifdef GROUPCHAT
-    foreach (ConferenceBookmark c, d->bookmarkManager->conferences()) {
+    d->autoJoinQueue.clear();
+    autoJoin(d->bookmarkManager->conferences());
+#endif
+}
+
+/**
+ * Queues the rooms for joining. Joining many rooms at once floods the
+ * connection and the ui with presences and history and gets us throttled by
+ * the server, so only a few joins are in flight at a time and they are sent
+ * a bit apart.
+ */
+void PsiAccount::autoJoin(const QList<ConferenceBookmark> &rooms)
+{
+#ifdef GROUPCHAT
+    for (const ConferenceBookmark &c : rooms) {
         Jid cj = c.jid().withResource(QString());
-        if (!findDialog<GCMainDlg *>(cj) && c.needJoin()) {
-            auto ul = findRelevant(Jid(QString(), cj.domain()));
-            if (ul.isEmpty() || !ul[0]->isTransport()
-                || !ul[0]->resourceList().isEmpty()) { // don't join to MUCs on disconnected transports
-                actionJoin(c, true, MucAutoJoin);
-            }
+        if (c.needJoin() && !findDialog<GCMainDlg *>(cj) && !d->autoJoinPending.contains(cj.bare())) {
+            d->autoJoinQueue += c;
+            ++d->autoJoinTotal;
         }
     }
+    if (!d->autoJoinQueue.isEmpty() && !d->autoJoinTimer->isActive()) {
+        if (!d->autoJoinClock.isValid())
+            d->autoJoinClock.start();
+        d->autoJoinTimer->start();
+        autoJoinNext();
+    }
+#else
+    Q_UNUSED(rooms);
 #endif
 }
 
+void PsiAccount::autoJoinNext()
+{
+#ifdef GROUPCHAT
+    static const int maxParallel = 4;
+    static const int joinTimeout = 30000; // msecs
+
+    const int    done = d->autoJoinDone;
+    const qint64 now  = d->autoJoinClock.elapsed();
+
+    // a room that never answers doesn't keep its slot
+    for (auto it = d->autoJoinPending.begin(); it != d->autoJoinPending.end();) {
+        if (now - it.value() >= joinTimeout) {
+            it = d->autoJoinPending.erase(it);
+            ++d->autoJoinDone;
+        } else {
+            ++it;
+        }
+    }
+
+    // one join per tick at most
+    while (!d->autoJoinQueue.isEmpty() && d->autoJoinPending.size() < maxParallel) {
+        if (!d->stanzaPacer->admit(StanzaPacer::Bulk, d->autoJoinTimer, [this]() { autoJoinNext(); }))
+            break;
+        ConferenceBookmark c  = d->autoJoinQueue.takeFirst();
+        Jid                cj = c.jid().withResource(QString());
+        if (findDialog<GCMainDlg *>(cj) || !c.needJoin() || d->autoJoinPending.contains(cj.bare())) {
+            ++d->autoJoinDone;
+            continue;
+        }
+        auto ul = findRelevant(Jid(QString(), cj.domain()));
+        if (!ul.isEmpty() && ul[0]->isTransport()
+            && ul[0]->resourceList().isEmpty()) { // don't join to MUCs on disconnected transports
+            ++d->autoJoinDone;
+            continue;
+        }
+        d->autoJoinPending.insert(cj.bare(), now);
+        actionJoin(c, true, MucAutoJoin);
+        break;
+    }
+
+    if (d->autoJoinDone != done)
+        reportAutoJoinProgress();
+#endif
+    if (d->autoJoinQueue.isEmpty() && d->autoJoinPending.isEmpty())
+        d->autoJoinTimer->stop();
+}
+
+void PsiAccount::autoJoinFinished(const Jid &room)
+{
+    if (d->autoJoinPending.remove(room.bare())) {
+        ++d->autoJoinDone;
+        reportAutoJoinProgress();
+    }
+}
+
+void PsiAccount::reportAutoJoinProgress()
+{
+    if (d->autoJoinDone >= d->autoJoinTotal)
+        d->autoJoinDone = d->autoJoinTotal = 0;
+    emit autoJoinProgress(d->autoJoinDone, d->autoJoinTotal);
+}
+
+int PsiAccount::autoJoinDone() const
+{
+    return d->autoJoinDone;
+}
+
+int PsiAccount::autoJoinTotal() const
+{
+    return d->autoJoinTotal;
+}
+
 void PsiAccount::incomingHttpAuthRequest(const PsiHttpAuthRequest &req)
 {
     HttpAuthEvent::Ptr e(new HttpAuthEvent(req, this));
@@ -2530,6 +3103,8 @@ void PsiAccount::client_rosterItemUpdated(const RosterItem &r)
     u->setInList(true);
 
     profileUpdateEntry(*u);
+    if (rosterDone)
+        scheduleRosterSnapshot();
 }
 
 void PsiAccount::client_rosterItemRemoved(const RosterItem &r)
@@ -2552,6 +3127,8 @@ void PsiAccount::client_rosterItemRemoved(const RosterItem &r)
         d->userList.removeAll(u);
         delete u;
     }
+    if (rosterDone)
+        scheduleRosterSnapshot();
 }
 
 void PsiAccount::tryVerify(UserListItem *u, UserResource *ur)
@@ -2570,6 +3147,44 @@ void PsiAccount::incomingVoiceCall(const Jid &j)
 }
 
 void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
+{
+    if (d->resumeWindowTimer->isActive())
+        d->resumedResources += j.full();
+
+    // The initial presence storm would otherwise update the roster once per
+    // resource, so until online notifications are enabled coalesce updates
+    // per full JID and apply them together.
+    if (rosterDone && !notifyOnlineOk) {
+        if (!d->pendingPresence.contains(j.full()))
+            d->pendingPresenceJids.append(j);
+        d->pendingPresence.insert(j.full(), r);
+        if (!d->presenceFlushTimer->isActive())
+            d->presenceFlushTimer->start();
+        return;
+    }
+
+    flushPendingPresence();
+    resourceAvailable(j, r);
+}
+
+void PsiAccount::flushPendingPresence()
+{
+    d->presenceFlushTimer->stop();
+    if (d->pendingPresenceJids.isEmpty())
+        return;
+
+    QList<Jid>               jids = d->pendingPresenceJids;
+    QHash<QString, Resource> res  = d->pendingPresence;
+    d->pendingPresenceJids.clear();
+    d->pendingPresence.clear();
+
+    emit beginBulkContactUpdate();
+    foreach (const Jid &j, jids)
+        resourceAvailable(j, res.value(j.full()));
+    emit endBulkContactUpdate();
+}
+
+void PsiAccount::resourceAvailable(const Jid &j, const Resource &r)
 {
     // Notification
     enum PopupType {
@@ -2644,13 +3259,13 @@ void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
 
 #ifdef GROUPCHAT
         if (u->isTransport()) {
+            // now join MUCs on connected transport
+            QList<ConferenceBookmark> rooms;
             foreach (ConferenceBookmark c, d->bookmarkManager->conferences()) {
-                Jid cj = c.jid().withResource(QString());
-                if (u->jid().domain() == cj.domain() && !findDialog<GCMainDlg *>(cj) && c.needJoin()) {
-                    // now join MUCs on connected transport
-                    actionJoin(c, true, MucAutoJoin);
-                }
+                if (u->jid().domain() == c.jid().domain())
+                    rooms += c;
             }
+            autoJoin(rooms);
         }
 #endif
     }
@@ -2704,6 +3319,8 @@ void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
 
 void PsiAccount::client_resourceUnavailable(const Jid &j, const Resource &r)
 {
+    flushPendingPresence();
+
     bool doSound = false;
     bool doPopup = false;
 
@@ -2833,6 +3450,29 @@ void PsiAccount::wbRequest(const Jid &j, int id)
 }
 #endif
 
+/**
+ * Tells if \param m came before, as a carbon, live, delivered offline or in
+ * the history of a room, and remembers it otherwise.
+ */
+bool PsiAccount::isDuplicate(const Message &m)
+{
+    // an error bounces with the id of the message it's about
+    if (m.body().isEmpty() || m.type() == "error")
+        return false;
+
+    if (!d->seenMessages.testAndInsert(SeenMessages::idsOf(m, jid())))
+        return false;
+#ifdef GROUPCHAT
+    // the history a room replays to a new window isn't shown there yet
+    if (m.type() == "groupchat" && m.spooled()) {
+        GCMainDlg *w = findDialog<GCMainDlg *>(Jid(m.from().bare()));
+        if (!w || !w->lastMsgTime().isValid())
+            return false;
+    }
+#endif
+    return true;
+}
+
 /**
  * Handles the passed Message \param m. Also message's type could be modified
  * here, if certain options are set.
@@ -2847,6 +3487,9 @@ void PsiAccount::processIncomingMessage(const Message &_m)
     if (_m.body().isEmpty() && _m.urlList().isEmpty() && _m.invite().isEmpty() && !_m.containsEvents() && _m.chatState() == StateNone && _m.subject().isNull() && _m.rosterExchangeItems().isEmpty() && _m.mucInvites().isEmpty() && _m.getForm().fields().empty() && _m.messageReceipt() == ReceiptNone && _m.getMUCStatuses().isEmpty())
         return;
 
+    if (isDuplicate(_m))
+        return;
+
     // skip headlines?
     if (_m.type() == "headline"
         && PsiOptions::instance()->getOption("options.messages.ignore-headlines").toBool())
@@ -3011,9 +3654,7 @@ void PsiAccount::client_subscription(const Jid &j, const QString &str, const QSt
 
 void PsiAccount::client_debugText(const QString &txt)
 {
-    Q_UNUSED(txt);
-    //printf("%s\n", qPrintable(txt));
-    //fflush(stdout);
+    CLIENT_DEBUG() << name() << txt;
 }
 
 #ifdef GOOGLE_FT
@@ -3226,16 +3867,48 @@ void PsiAccount::savePassword()
 void PsiAccount::loadBob(const Jid &jid, const QString &cid, QObject *context,
                          std::function<void(bool success, const QByteArray &, const QByteArray &)> callback)
 {
-    JT_BitsOfBinary *task = new JT_BitsOfBinary(d->client->rootTask());
-    QObject::connect(task, &JT_BitsOfBinary::finished, context, [task, callback]() {
-        if (task->success()) {
-            callback(true, task->data().data(), task->data().type().toLatin1());
-        } else {
-            callback(false, QByteArray(), QByteArray());
-        }
-    });
-    task->get(jid, cid);
-    task->go(true);
+    // the same data may be already on its way, e.g. prefetched
+    JT_BitsOfBinary *task    = d->bobRequests.value(cid);
+    bool             running = task != nullptr;
+    if (!running) {
+        task = new JT_BitsOfBinary(d->client->rootTask());
+        d->bobRequests.insert(cid, task);
+        QString source = jid.bare();
+        QObject::connect(task, &JT_BitsOfBinary::finished, this, [this, task, cid, source]() {
+            if (d->bobRequests.value(cid) == task)
+                d->bobRequests.remove(cid);
+            if (task->success()) {
+                BoBFileCache::instance()->setSource(task->data().hash(), source);
+            }
+        });
+        QObject::connect(task, &QObject::destroyed, this, [this, task, cid]() {
+            if (d->bobRequests.value(cid) == task)
+                d->bobRequests.remove(cid);
+        });
+    }
+    if (callback) {
+        QObject::connect(task, &JT_BitsOfBinary::finished, context, [task, callback]() {
+            if (task->success()) {
+                callback(true, task->data().data(), task->data().type().toLatin1());
+            } else {
+                callback(false, QByteArray(), QByteArray());
+            }
+        });
+    }
+    if (!running) {
+        task->get(jid, cid);
+        task->go(true);
+    }
+}
+
+/**
+ * Starts fetching bits of binary before the chatlog asks for them
+ */
+void PsiAccount::prefetchBob(const Jid &jid, const QString &cid)
+{
+    if (isAvailable()) {
+        loadBob(jid, cid, this, nullptr);
+    }
 }
 
 void PsiAccount::setStatusDirect(const Status &_s, bool withPriority)
@@ -3442,25 +4115,44 @@ QString PsiAccount::localHostName()
         return hostname;
 }
 
-bool PsiAccount::validRosterExchangeItem(const RosterExchangeItem &item)
+/**
+ * The items of an exchange that change the roster, each jid once. The
+ * roster is looked up through an index, exchanges run into thousands of
+ * items.
+ */
+RosterExchangeItems PsiAccount::rosterExchangeChanges(const RosterExchangeItems &items) const
 {
-    if (item.action() == RosterExchangeItem::Add) {
-        return (d->client->roster().find(item.jid(), true) == d->client->roster().end());
-    } else if (item.action() == RosterExchangeItem::Delete) {
-        LiveRoster::ConstIterator i = d->client->roster().find(item.jid(), true);
-        if (i == d->client->roster().end())
-            return false;
+    QHash<QString, QStringList> roster; // groups by bare jid
+    foreach (UserListItem *u, d->userList) {
+        if (u->inList())
+            roster.insert(u->jid().bare(), u->groups());
+    }
 
-        foreach (QString group, item.groups()) {
-            if (!(*i).groups().contains(group))
-                return false;
+    RosterExchangeItems changes;
+    QSet<QString>       seen;
+    foreach (const RosterExchangeItem &item, items) {
+        const QString bare = item.jid().bare();
+        if (seen.contains(bare))
+            continue;
+        auto i = roster.constFind(bare);
+        bool valid = false;
+        if (item.action() == RosterExchangeItem::Add) {
+            valid = i == roster.constEnd() && !item.jid().compare(jid(), false);
+        } else if (item.action() == RosterExchangeItem::Delete) {
+            valid = i != roster.constEnd();
+            foreach (const QString &group, item.groups()) {
+                if (valid && !i->contains(group))
+                    valid = false;
+            }
+        } else if (item.action() == RosterExchangeItem::Modify) {
+            // TODO
+        }
+        if (valid) {
+            seen.insert(bare);
+            changes += item;
         }
-        return true;
-    } else if (item.action() == RosterExchangeItem::Modify) {
-        // TODO
-        return false;
     }
-    return false;
+    return changes;
 }
 
 ChatDlg *PsiAccount::findChatDialog(const Jid &jid, bool compareResource) const
@@ -3492,15 +4184,13 @@ QList<ChatDlg *> PsiAccount::findChatDialogs(const Jid &jid, bool compareResourc
     return findDialogs<ChatDlg *>(jid, compareResource);
 }
 
+/**
+ * Contacts with an open chat, found from the chat dialogs rather than by
+ * asking every contact of the account.
+ */
 QList<PsiContact *> PsiAccount::activeContacts() const
 {
-    QList<PsiContact *> ret;
-    foreach (PsiContact *pc, contactList()) {
-        if (pc->isActiveContact()) {
-            ret.append(pc);
-        }
-    }
-    return ret;
+    return d->activeContacts();
 }
 
 QWidget *PsiAccount::findDialog(const QMetaObject &mo, const Jid &jid, bool compareResource) const
@@ -3770,6 +4460,10 @@ void PsiAccount::simulateRosterOffline()
 {
     emit beginBulkContactUpdate();
 
+    d->presenceFlushTimer->stop();
+    d->pendingPresenceJids.clear();
+    d->pendingPresence.clear();
+
     notifyOnlineOk = false;
     foreach (UserListItem *u, d->userList)
         simulateContactOffline(u);
@@ -3794,6 +4488,43 @@ void PsiAccount::simulateRosterOffline()
     emit endBulkContactUpdate();
 }
 
+/**
+ * Ends the grace period after a connection drop: whatever presence wasn't
+ * refreshed by the new session is stale now. Goes quietly either way, the
+ * contacts were offline only as far as the server is concerned.
+ */
+void PsiAccount::finishResumeWindow()
+{
+    d->resumeWindowTimer->stop();
+
+    bool wasDisconnecting = isDisconnecting;
+    isDisconnecting       = true;
+    if (!loggedIn()) {
+        simulateRosterOffline();
+    } else {
+        flushPendingPresence();
+        emit beginBulkContactUpdate();
+        QList<UserListItem *> items = d->userList;
+        items += &d->self;
+        foreach (UserListItem *u, items) {
+            const UserResourceList rl = u->userResourceList();
+            for (const UserResource &r : rl) {
+                Jid j = u->jid().resource().isEmpty() ? u->jid().withResource(r.name()) : u->jid();
+                if (!d->resumedResources.contains(j.full()))
+                    client_resourceUnavailable(j, r);
+            }
+        }
+        emit endBulkContactUpdate();
+    }
+    isDisconnecting = wasDisconnecting;
+    d->resumedResources.clear();
+}
+
+void PsiAccount::networkChanged()
+{
+    d->reconnectNow();
+}
+
 bool PsiAccount::notifyOnline() const
 {
     return notifyOnlineOk;
@@ -3804,8 +4535,10 @@ void PsiAccount::enableNotifyOnline()
     if (d->userCounter > 1) {
         QTimer::singleShot(15000, this, SLOT(enableNotifyOnline()));
         d->userCounter = 0;
-    } else
+    } else {
+        flushPendingPresence();
         notifyOnlineOk = true;
+    }
 }
 
 void PsiAccount::itemRetracted(const Jid &j, const QString &n, const PubSubRetraction &item)
@@ -3843,52 +4576,60 @@ void PsiAccount::itemRetracted(const Jid &j, const QString &n, const PubSubRetra
     }
 }
 
-void PsiAccount::itemPublished(const Jid &j, const QString &n, const PubSubItem &item)
+void PsiAccount::itemsPublished(const Jid &j, const PEPItems &items)
 {
-    // User Tune
-    if (n == "http://jabber.org/protocol/tune") {
-        // Parse tune
-        QDomElement element = item.payload();
-        QDomElement e;
-        QString     tune;
-
-        e = element.firstChildElement("artist");
-        if (!e.isNull())
-            tune += e.text() + " - ";
-
-        e = element.firstChildElement("title");
-        if (!e.isNull())
-            tune += e.text();
+    QList<UserListItem *> relevant = findRelevant(j);
+    if (relevant.isEmpty())
+        return;
 
-        foreach (UserListItem *u, findRelevant(j)) {
-            // FIXME: try to find the right resource using XEP-33 'replyto'
-            //UserResourceList::Iterator rit = u->userResourceList().find(<resource>);
-            //bool found = (rit == u->userResourceList().end()) ? false: true;
-            //if(found)
-            //    (*rit).setTune(tune);
-            u->setTune(tune);
-            cpUpdate(*u);
-        }
-    } else if (n == "http://jabber.org/protocol/mood") {
-        Mood mood(item.payload());
-        foreach (UserListItem *u, findRelevant(j)) {
-            u->setMood(mood);
-            cpUpdate(*u);
-        }
-    } else if (n == "http://jabber.org/protocol/activity") {
-        Activity activity(item.payload());
-        foreach (UserListItem *u, findRelevant(j)) {
-            u->setActivity(activity);
-            cpUpdate(*u);
+    // FIXME: try to find the right resource using XEP-33 'replyto'
+    //UserResourceList::Iterator rit = u->userResourceList().find(<resource>);
+    //bool found = (rit == u->userResourceList().end()) ? false: true;
+    //if(found)
+    //    (*rit).setTune(tune);
+    bool changed = false;
+    for (auto it = items.constBegin(); it != items.constEnd(); ++it) {
+        const QString &n = it.key();
+        const PubSubItem &item = it.value();
+        // User Tune
+        if (n == "http://jabber.org/protocol/tune") {
+            // Parse tune
+            QDomElement element = item.payload();
+            QDomElement e;
+            QString     tune;
+
+            e = element.firstChildElement("artist");
+            if (!e.isNull())
+                tune += e.text() + " - ";
+
+            e = element.firstChildElement("title");
+            if (!e.isNull())
+                tune += e.text();
+
+            foreach (UserListItem *u, relevant)
+                u->setTune(tune);
+        } else if (n == "http://jabber.org/protocol/mood") {
+            Mood mood(item.payload());
+            foreach (UserListItem *u, relevant)
+                u->setMood(mood);
+        } else if (n == "http://jabber.org/protocol/activity") {
+            Activity activity(item.payload());
+            foreach (UserListItem *u, relevant)
+                u->setActivity(activity);
+        } else if (n == "http://jabber.org/protocol/geoloc") {
+            GeoLocation geoloc(item.payload());
+            foreach (UserListItem *u, relevant)
+                u->setGeoLocation(geoloc);
+        } else {
+            continue;
         }
-    } else if (n == "http://jabber.org/protocol/geoloc") {
-        // FIXME: try to find the right resource using XEP-33 'replyto'
-        // see tune case above
-        GeoLocation geoloc(item.payload());
-        foreach (UserListItem *u, findRelevant(j)) {
-            u->setGeoLocation(geoloc);
+        changed = true;
+    }
+
+    // one roster update per contact, no matter how many nodes changed
+    if (changed) {
+        foreach (UserListItem *u, relevant)
             cpUpdate(*u);
-        }
     }
 }
 
@@ -3914,10 +4655,7 @@ QList<UserListItem *> PsiAccount::findRelevant(const Jid &j) const
     if (j.compare(d->self.jid(), false))
         list.append(&d->self);
     else {
-        foreach (UserListItem *u, d->userList) {
-            if (!u->jid().compare(j, false))
-                continue;
-
+        foreach (UserListItem *u, d->userList.findAll(j.bare())) {
             if (!u->jid().resource().isEmpty()) {
                 if (u->jid().resource() != j.resource())
                     continue;
@@ -4023,15 +4761,22 @@ ChatDlg *PsiAccount::ensureChatDlg(const Jid &j)
     /*ChatDlg *c = findChatDialog(j);*/
     ChatDlg *c = findChatDialogEx(j);
     if (!c) {
-        // create the chatbox
-        c = ChatDlg::create(j, this, d->tabManager);
+        // create the chatbox, or take the one built in advance
+        if (d->warmChat) {
+            c           = d->warmChat;
+            d->warmChat = nullptr;
+            c->bindTo(j);
+        } else {
+            c = ChatDlg::create(j, this, d->tabManager);
+        }
+        scheduleWarmChatDlg();
         connect(c, SIGNAL(aSend(Message &)), SLOT(dj_sendMessage(Message &)));
         connect(c, SIGNAL(messagesRead(const Jid &)), SLOT(chatMessagesRead(const Jid &)));
         connect(c, SIGNAL(aInfo(const Jid &)), SLOT(actionInfo(const Jid &)));
         connect(c, SIGNAL(aHistory(const Jid &)), SLOT(actionHistory(const Jid &)));
         connect(c, SIGNAL(aFile(const Jid &)), SLOT(sendFiles(const Jid &)));
         connect(c, SIGNAL(aVoice(const Jid &)), SLOT(actionVoice(const Jid &)));
-        connect(d->psi, SIGNAL(emitOptionsUpdate()), c, SLOT(optionsUpdate()));
+        connect(d->psi, SIGNAL(emitOptionsUpdate()), c, SLOT(optionsUpdate()), Qt::UniqueConnection);
         connect(this, SIGNAL(updateContact(const Jid &, bool)), c, SLOT(updateContact(const Jid &, bool)));
     } else {
         c->setJid(j);
@@ -4179,21 +4924,21 @@ void PsiAccount::sendFiles(const Jid &j, const QStringList &fileList)
 
 void PsiAccount::actionQueryVersion(const Jid &j)
 {
-    JT_ClientVersion *task = new JT_ClientVersion(d->client->rootTask());
-    task->get(j);
-    connect(task, SIGNAL(finished()), SLOT(queryVersionFinished()));
-    task->go(true);
-}
-
-void PsiAccount::queryVersionFinished()
-{
-    JT_ClientVersion *j = static_cast<JT_ClientVersion *>(sender());
-    QString           text;
-    text += tr("Name:\t") + j->name();
-    text += "\n" + tr("Version:\t") + j->version();
-    text += "\n" + tr("Os:\t") + j->os();
+    d->entityInfoCache->query(EntityInfoCache::Version, j, this, [](const EntityInfoCache::Info &info) {
+        QString text;
+        if (info.success) {
+            text += tr("Name:\t") + info.name;
+            text += "\n" + tr("Version:\t") + info.version;
+            text += "\n" + tr("Os:\t") + info.os;
+        } else {
+            text = tr("No version information available.") + "\n" + info.statusString;
+        }
 
-    QMessageBox::information(nullptr, QString(tr("Version Query Information")), text);
+        // doesn't hold up the event loop while it is open
+        QMessageBox *box = new QMessageBox(QMessageBox::Information, tr("Version Query Information"), text);
+        box->setAttribute(Qt::WA_DeleteOnClose);
+        box->show();
+    });
 }
 
 void PsiAccount::actionExecuteCommand(const Jid &j, const QString &node)
@@ -5037,20 +5782,25 @@ void PsiAccount::dj_remove(const Jid &j)
 
 void PsiAccount::dj_rosterExchange(const RosterExchangeItems &items)
 {
-    foreach (RosterExchangeItem item, items) {
-        if (!validRosterExchangeItem(item))
-            continue;
-
+    // sent paced, and the roster pushes make one contact list update
+    ContactManagerBatch *batch = new ContactManagerBatch(this, this);
+    batch->setRateLimit(20);
+    foreach (const RosterExchangeItem &item, rosterExchangeChanges(items)) {
         if (item.action() == RosterExchangeItem::Add) {
-            if (d->client->roster().find(item.jid(), true) == d->client->roster().end()) {
-                dj_add(item.jid(), item.name(), item.groups(), true);
-            }
+            batch->set(item.jid(), item.name(), item.groups(), true);
         } else if (item.action() == RosterExchangeItem::Delete) {
             //dj_remove(item.jid());
         } else if (item.action() == RosterExchangeItem::Modify) {
             // TODO
         }
     }
+
+    if (batch->total() == 0) {
+        delete batch;
+        return;
+    }
+    connect(batch, SIGNAL(finished()), batch, SLOT(deleteLater()));
+    batch->start();
 }
 
 void PsiAccount::eventFromXml(const PsiEvent::Ptr &e)
@@ -5075,6 +5825,13 @@ void PsiAccount::createNewMessageEvent(const QDomElement &element)
     message.fromStanza(stanza, client()->manualTimeZoneOffset(), client()->timeZoneOffset());
     processIncomingMessage(message);
 }
+
+void PsiAccount::executePluginCommand(const QString &jid, const QString &node, const QVariantMap &fields,
+                                      QObject *receiver, const char *slot)
+{
+    AHCBatchJob *job = d->ahcManager->batch()->add(jid, node, fields);
+    connect(job, SIGNAL(finished(QString, QString, QString, QVariantMap, QString)), receiver, slot);
+}
 #endif
 
 // handle an incoming event
@@ -5120,12 +5877,15 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
     e->setJid(j);
 
 #if defined(PSI_PLUGINS) && defined(DEPRECATED_EVENT_FILTER)
-    QDomDocument doc;
-    QDomElement  eXml = e->toXml(&doc);
-    if (PluginManager::instance()->processEvent(this, eXml)) {
-        return;
-    } else {
-        e->fromXml(psi(), this, &eXml);
+    if (PluginManager::instance()->hasEventFilters()) {
+        QDomDocument doc;
+        QDomElement  eXml = e->toXml(&doc);
+        bool         modified;
+        if (PluginManager::instance()->processEvent(this, eXml, &modified)) {
+            return;
+        } else if (modified) {
+            e->fromXml(psi(), this, &eXml);
+        }
     }
 #endif
 
@@ -5164,9 +5924,12 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         }
     }
 
+    bool inBacklog = false;
     if (e->type() == PsiEvent::Message) {
         MessageEvent::Ptr me = e.staticCast<MessageEvent>();
         const Message &   m  = me->message();
+        if (activationType == IncomingStanza)
+            inBacklog = noteBacklog(m);
 
 #ifdef PSI_PLUGINS
         //TODO(mck): clean up
@@ -5232,7 +5995,7 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
             //if the chat exists, and is either open in a tab,
             //or in a window
             if (c && (d->tabManager->isChatTabbed(c) || !c->isHidden())) {
-                c->incomingMessage(m);
+                deliverToChat(c, m);
                 soundType = eChat2;
                 if (m.carbonDirection() != Message::Sent && ((o->getOption("options.ui.chat.alert-for-already-open-chats").toBool() && !c->isActiveTab()) || (c->isTabbed() && c->getManagingTabDlg()->isHidden()))) {
 
@@ -5308,12 +6071,8 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         doPopup   = true;
         popupType = PopupManager::AlertAvCall;
     } else if (e->type() == PsiEvent::RosterExchange) {
-        RosterExchangeEvent::Ptr re = e.staticCast<RosterExchangeEvent>();
-        RosterExchangeItems      items;
-        foreach (RosterExchangeItem item, re->rosterExchangeItems()) {
-            if (validRosterExchangeItem(item))
-                items += item;
-        }
+        RosterExchangeEvent::Ptr  re    = e.staticCast<RosterExchangeEvent>();
+        const RosterExchangeItems items = rosterExchangeChanges(re->rosterExchangeItems());
         if (items.isEmpty()) {
             return;
         }
@@ -5353,6 +6112,14 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         doPopup    = false;
     }
 
+    if (inBacklog) {
+        // the summary of finishBacklog() stands in for these
+        if ((doPopup && !d->noPopup(activationType)) || soundType != eNone)
+            ++d->backlogAlerts;
+        doPopup   = false;
+        soundType = eNone;
+    }
+
     if (doPopup && !d->noPopup(activationType)) {
         Resource      r;
         UserListItem *u = findFirstRelevant(j);
@@ -5394,6 +6161,69 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         queueEvent(e, activationType);
 }
 
+/**
+ * Tells whether \a m belongs to a backlog burst: offline messages and
+ * carbons coming in quick succession, as they do after a reconnect. The
+ * first few of a burst are handled like any other message.
+ */
+bool PsiAccount::noteBacklog(const Message &m)
+{
+    if (!m.spooled() && m.carbonDirection() == Message::NoCarbon)
+        return false;
+    if (m.body().isEmpty() || m.type() == "groupchat")
+        return false;
+
+    d->backlogTimer->start();
+    if (++d->backlogCount >= 10)
+        d->backlogActive = true;
+    return d->backlogActive;
+}
+
+// passes a message to an open chat, during a burst they go in batches
+void PsiAccount::deliverToChat(ChatDlg *c, const Message &m)
+{
+    // later messages wait behind the batch to keep the order
+    if (!d->backlogActive && d->backlogChats.isEmpty()) {
+        c->incomingMessage(m);
+        return;
+    }
+    d->backlogChats.append(qMakePair(QPointer<ChatDlg>(c), m));
+    if (!d->backlogChatTimer->isActive())
+        d->backlogChatTimer->start();
+}
+
+void PsiAccount::flushBacklogChats()
+{
+    const QList<QPair<QPointer<ChatDlg>, Message>> batch = d->backlogChats;
+    d->backlogChats.clear();
+    for (const auto &p : batch) {
+        if (p.first)
+            p.first->incomingMessage(p.second);
+    }
+}
+
+void PsiAccount::finishBacklog()
+{
+    const int alerts = d->backlogAlerts;
+    const bool was   = d->backlogActive;
+    d->backlogCount  = 0;
+    d->backlogAlerts = 0;
+    d->backlogActive = false;
+    if (!was || !alerts)
+        return;
+
+    PsiOptions *o = PsiOptions::instance();
+    if (!d->noPopup(IncomingStanza)
+        && o->getOption("options.ui.notifications.passive-popups.incoming-message").toBool()) {
+        psi()->popupManager()->doPopup(this, jid(), IconsetFactory::iconPtr("psi/message"), tr("Messages"), nullptr,
+                                       nullptr, tr("%n delayed message(s) received", "", alerts), false,
+                                       PopupManager::AlertMessage);
+    }
+    playSound(eMessage);
+    if (o->getOption("options.ui.contactlist.raise-on-new-event").toBool())
+        d->psi->raiseMainwin();
+}
+
 UserListItem *PsiAccount::addUserListItem(const Jid &jid, const QString &nick)
 {
     // create item
@@ -5484,6 +6314,8 @@ void PsiAccount::queueEvent(const PsiEvent::Ptr &e, ActivationType activationTyp
     d->eventQueue->enqueue(e);
 
     updateReadNext(e->jid());
+    if (d->backlogActive)
+        return; // neither raise nor open anything for every message of a burst
     if (PsiOptions::instance()->getOption("options.ui.contactlist.raise-on-new-event").toBool())
         d->psi->raiseMainwin();
 
@@ -5788,15 +6620,14 @@ void PsiAccount::logEvent(const Jid &j, const PsiEvent::Ptr &e, int type)
             return;
     }
 
-    EDBHandle *h = new EDBHandle(d->psi->edb());
-    connect(h, SIGNAL(finished()), SLOT(edb_finished()));
-    h->append(id(), j, e, type);
-}
-
-void PsiAccount::edb_finished()
-{
-    EDBHandle *h = static_cast<EDBHandle *>(sender());
-    delete h;
+    if (e->type() == PsiEvent::Message) {
+        // so the copy in the server archive is known, sent messages included
+        SeenMessages::Ids ids;
+        ids.conversation = j.bare();
+        ids.id           = e.staticCast<MessageEvent>()->message().id();
+        d->seenMessages.insert(ids);
+    }
+    d->psi->edb()->appendDeferred(id(), j, e, type);
 }
 
 void PsiAccount::openGroupChat(const Jid &j, ActivationType activationType, MucJoinReason reason)
@@ -5826,6 +6657,8 @@ bool PsiAccount::groupChatJoin(const QString &host, const QString &room, const Q
         GCMainDlg *w = findDialog<GCMainDlg *>(Jid(room, host));
         if (w)
             since = w->lastMsgTime();
+        else
+            since = d->mucLastSeen.value(Jid(room, host).bare());
 
         Status s = d->loginStatus;
         s.setXSigned("");
@@ -5845,13 +6678,21 @@ void PsiAccount::groupChatChangeNick(const QString &host, const QString &room, c
 
 void PsiAccount::groupChatSetStatus(const QString &host, const QString &room, const Status &s)
 {
-    d->client->groupChatSetStatus(host, room, s);
+    // goes to every room at once, only the latest status of a room waits
+    d->stanzaPacer->send(StanzaPacer::Bulk, room + '@' + host, this,
+                         [this, host, room, s]() { d->client->groupChatSetStatus(host, room, s); });
 }
 
 void PsiAccount::groupChatLeave(const QString &host, const QString &room)
 {
     Jid j(room + '@' + host);
     d->groupchats.removeAll(j.bare());
+    SessionJournal::instance()->roomLeft(id(), j.bare());
+#ifdef GROUPCHAT
+    GCMainDlg *w = findDialog<GCMainDlg *>(j);
+    if (w && w->lastMsgTime().isValid())
+        d->mucLastSeen.insert(j.bare(), w->lastMsgTime());
+#endif
     d->client->groupChatLeave(host, room,
                               PsiOptions::instance()->getOption("options.muc.leave-status-message").toString());
     UserListItem *u = find(j);
@@ -5938,6 +6779,9 @@ void PsiAccount::client_groupChatJoined(const Jid &j)
 #ifdef GROUPCHAT
     //d->client->groupChatSetStatus(j.host(), j.user(), d->loginStatus);
 
+    autoJoinFinished(j);
+    SessionJournal::instance()->roomJoined(id(), j.bare(), j.resource());
+
     GCMainDlg *m = findDialog<GCMainDlg *>(Jid(j.bare()));
     if (m) {
         m->setPassword(d->client->groupChatPassword(j.domain(), j.node()));
@@ -6029,6 +6873,9 @@ void PsiAccount::client_groupChatError(const Jid &j, int code, const QString &st
             w->error(code, str);
         }
     }
+    // unless the join dialog tries again with another nick
+    if (!findDialog<MUCJoinDlg *>(Jid(j.bare()), false))
+        autoJoinFinished(j);
 #endif
 }
 
@@ -6119,35 +6966,26 @@ void PsiAccount::newPgpPassPhase(const QString &id, const QString &pass)
 
 void PsiAccount::trySignPresence()
 {
-    QCA::SecureMessageKey skey;
-    skey.setPGPSecretKey(d->cur_pgpSecretKey);
 #ifdef HAVE_PGPUTIL
     if (!d->cur_pgpSecretKey.isNull() && !d->acc.pgpPassPhrase.isEmpty()) {
         PGPUtil::instance().addPassphrase(d->cur_pgpSecretKey.keyId(), d->acc.pgpPassPhrase);
     }
-#endif
-    QByteArray plain = d->loginStatus.status().toUtf8();
-
-    PGPTransaction *t = new PGPTransaction(new QCA::OpenPGP());
-    connect(t, SIGNAL(finished()), SLOT(pgp_signFinished()));
-    t->setFormat(QCA::SecureMessage::Ascii);
-    t->setSigner(skey);
-    t->startSign(QCA::SecureMessage::Detached);
-    t->update(plain);
-    t->end();
-}
+    // other accounts with this key, and this one again, get a signature already made
+    const QString text = d->loginStatus.status();
+    PGPSigner::instance()->sign(d->cur_pgpSecretKey, text, this, [this, text](const PGPSigner::Result &r) {
+        if (d->loginStatus.status() != text)
+            return; // changed meanwhile, its own signature is on the way
+        if (r.success) {
+            Status s = d->loginStatus;
+            s.setXSigned(r.signature);
+            setStatusActual(s);
+            IdleScheduler::instance()->schedule(this, "pgp-presign", [this]() { presignStatuses(); },
+                                                IdleScheduler::Low, 60000);
+            return;
+        }
 
-void PsiAccount::pgp_signFinished()
-{
-#ifdef HAVE_PGPUTIL
-    PGPTransaction *t = static_cast<PGPTransaction *>(sender());
-    if (t->success()) {
-        Status s = d->loginStatus;
-        s.setXSigned(PGPUtil::instance().stripHeaderFooter(QString(t->signature())));
-        setStatusActual(s);
-    } else {
         // Clear passphrase from cache
-        if (t->errorCode() == QCA::SecureMessage::ErrorPassphrase) {
+        if (r.error == QCA::SecureMessage::ErrorPassphrase) {
             d->acc.pgpPassPhrase.clear();
             QCA::KeyStoreEntry ke = PGPUtil::instance().getSecretKeyStoreEntry(d->cur_pgpSecretKey.keyId());
             if (!ke.isNull())
@@ -6155,64 +6993,66 @@ void PsiAccount::pgp_signFinished()
         }
 
         PGPUtil::showDiagnosticText(tr("There was an error trying to sign your status.\nReason: %1.")
-                                        .arg(PGPUtil::instance().messageErrorString(t->errorCode())),
-                                    t->diagnosticText());
-
+                                        .arg(PGPUtil::instance().messageErrorString(r.error)),
+                                    r.diagnostic);
         logout(false, loggedOutStatus());
-        return;
-    }
-    t->deleteLater();
+    });
 #else
     Q_ASSERT(false);
 #endif
 }
 
-void PsiAccount::verifyStatus(const Jid &j, const Status &s)
+// the status texts likely to be sent, so a change to one of them goes out
+// without waiting for gpg
+void PsiAccount::presignStatuses()
 {
 #ifdef HAVE_PGPUTIL
-    PGPTransaction *t = new PGPTransaction(new QCA::OpenPGP());
-    t->setJid(j);
-    connect(t, SIGNAL(finished()), SLOT(pgp_verifyFinished()));
-    t->startVerify(PGPUtil::instance().addHeaderFooter(s.xsigned(), 1).toUtf8());
-    t->update(s.status().toUtf8());
-    t->end();
+    if (d->cur_pgpSecretKey.isNull())
+        return;
+    PsiOptions *o = PsiOptions::instance();
+    QStringList texts;
+    for (const QVariant &name : o->mapKeyList("options.status.presets", true)) {
+        StatusPreset sp;
+        sp.fromOptions(o, name.toString());
+        texts << sp.message();
+    }
+    texts << o->getOption("options.status.auto-away.message").toString();
+    texts << d->lastManualStatus().status();
+    texts.removeDuplicates();
+    PGPSigner::instance()->presign(d->cur_pgpSecretKey, texts);
 #endif
 }
 
-void PsiAccount::pgp_verifyFinished()
+void PsiAccount::verifyStatus(const Jid &j, const Status &s)
 {
 #ifdef HAVE_PGPUTIL
-    PGPTransaction *t = static_cast<PGPTransaction *>(sender());
-    Jid             j = t->jid();
-    foreach (UserListItem *u, findRelevant(j)) {
-        UserResourceList::Iterator rit   = u->userResourceList().find(j.resource());
-        bool                       found = (rit == u->userResourceList().end()) ? false : true;
-        if (!found)
-            continue;
-        UserResource &ur = *rit;
-
-        QCA::SecureMessageSignature signer;
-        if (t->success()) {
-            signer = t->signer();
-
-            ur.setPublicKeyID(signer.key().pgpPublicKey().keyId());
-            ur.setPGPVerifyStatus(signer.identityResult());
-            ur.setSigTimestamp(signer.timestamp());
-
-            if (u->publicKeyID().isEmpty() && PsiOptions::instance()->getOption("options.pgp.auto-assign").toBool()) {
-                QString            keyId = signer.key().pgpPublicKey().keyId();
-                QCA::KeyStoreEntry key   = PGPUtil::instance().getPublicKeyStoreEntry(keyId);
-                if (!key.isNull()) {
-                    u->setPublicKeyID(keyId);
+    PGPVerifier::instance()->verify(s.xsigned(), s.status(), this,
+                                    [this, j](bool success, const QCA::SecureMessageSignature &signer) {
+        foreach (UserListItem *u, findRelevant(j)) {
+            UserResourceList::Iterator rit   = u->userResourceList().find(j.resource());
+            bool                       found = (rit == u->userResourceList().end()) ? false : true;
+            if (!found)
+                continue;
+            UserResource &ur = *rit;
+
+            if (success) {
+                ur.setPublicKeyID(signer.key().pgpPublicKey().keyId());
+                ur.setPGPVerifyStatus(signer.identityResult());
+                ur.setSigTimestamp(signer.timestamp());
+
+                if (u->publicKeyID().isEmpty() && PsiOptions::instance()->getOption("options.pgp.auto-assign").toBool()) {
+                    QString            keyId = signer.key().pgpPublicKey().keyId();
+                    QCA::KeyStoreEntry key   = PGPUtil::instance().getPublicKeyStoreEntry(keyId);
+                    if (!key.isNull()) {
+                        u->setPublicKeyID(keyId);
+                    }
                 }
+            } else {
+                ur.setPGPVerifyStatus(-1);
             }
-        } else {
-            ur.setPGPVerifyStatus(-1);
+            cpUpdate(*u);
         }
-        cpUpdate(*u);
-    }
-
-    t->deleteLater();
+    });
 #endif
 }
 
@@ -6600,6 +7440,36 @@ BookmarkManager *PsiAccount::bookmarkManager()
     return d->bookmarkManager;
 }
 
+ChatStateManager *PsiAccount::chatStateManager()
+{
+    return d->chatStateManager;
+}
+
+StanzaPacer *PsiAccount::stanzaPacer()
+{
+    return d->stanzaPacer;
+}
+
+SeenMessages *PsiAccount::seenMessages()
+{
+    return &d->seenMessages;
+}
+
+AHCServerManager *PsiAccount::ahcManager()
+{
+    return d->ahcManager;
+}
+
+DiscoCache *PsiAccount::discoCache() const
+{
+    return d->discoCache;
+}
+
+EntityInfoCache *PsiAccount::entityInfoCache() const
+{
+    return d->entityInfoCache;
+}
+
 QStringList PsiAccount::groupList() const
 {
     return d->groupList();
@@ -29,6 +29,7 @@
 #include "filesharingdownloader.h"
 #include "geolocation.h"
 #include "mood.h"
+#include "pepmanager.h"
 #include "psiactions.h"
 #include "psievent.h"
 #include "xmpp_encryptionhandler.h"
@@ -38,15 +39,20 @@
 
 #include <QList>
 #include <QUrl>
+#include <QVariantMap>
 #include <functional>
 
+class AHCServerManager;
 class AvatarFactory;
 class AvCallManager;
 class BookmarkManager;
 class ChatDlg;
+class ChatStateManager;
 class ConferenceBookmark;
 class ContactProfile;
+class DiscoCache;
 class EDB;
+class EntityInfoCache;
 class EventDlg;
 class EventQueue;
 class FileSharingDeviceOpener;
@@ -68,6 +74,8 @@ class QMimeData;
 class QSSLCert;
 class QString;
 class QWidget;
+class SeenMessages;
+class StanzaPacer;
 class TabManager;
 class Tune;
 class URLBookmark;
@@ -213,6 +221,7 @@ public:
     void changeStatus(int, bool forceDialog = false);
     void doDisco();
     void doWakeup();
+    void networkChanged();
 
     void        showXmlConsole();
     void        openAddUserDlg();
@@ -264,6 +273,8 @@ public:
 #ifdef PSI_PLUGINS
     void createNewPluginEvent(int account, const QString &jid, const QString &descr, QObject *receiver, const char *slot);
     void createNewMessageEvent(const QDomElement &element);
+    void executePluginCommand(const QString &jid, const QString &node, const QVariantMap &fields, QObject *receiver,
+                              const char *slot);
 #endif
 
     QStringList hiddenChats(const Jid &) const;
@@ -284,10 +295,21 @@ public:
                              bool *_isTemporaryAuthFailure, bool *_needAlert);
 
     void deleteQueueFile();
+    void deleteRosterSnapshot();
+
+    // bookmarked rooms joined so far out of those being joined, both 0 when idle
+    int autoJoinDone() const;
+    int autoJoinTotal() const;
 
     PEPManager *       pepManager();
     ServerInfoManager *serverInfoManager();
     BookmarkManager *  bookmarkManager();
+    ChatStateManager * chatStateManager();
+    SeenMessages *     seenMessages();
+    StanzaPacer *      stanzaPacer();
+    AHCServerManager * ahcManager();
+    DiscoCache *       discoCache() const;
+    EntityInfoCache *  entityInfoCache() const;
     AvCallManager *    avCallManager();
 
     void    clearCurrentConnectionError();
@@ -314,6 +336,7 @@ public:
     void savePassword();
 #endif
     void loadBob(const Jid &jid, const QString &cid, QObject *context, std::function<void(bool, const QByteArray &, const QByteArray &)> callback);
+    void prefetchBob(const Jid &jid, const QString &cid);
     void shareFiles(QWidget *parent, const std::function<void(const QList<Reference> &, const QString &)> &callback);
     void shareFiles(QWidget *parent, const QMimeData *mdata, const std::function<void(const QList<Reference> &, const QString &)> &callback);
 
@@ -325,6 +348,7 @@ signals:
     void disconnected();
     void reconnecting();
     void updatedActivity();
+    void autoJoinProgress(int done, int total);
     void updatedAccount();
     void queueChanged();
     void updateContact(const UserListItem &);
@@ -451,6 +475,7 @@ private slots:
     void cs_warning(int);
     void cs_error(int);
     void client_rosterRequestFinished(bool, int, const QString &);
+    void rosterVersionFinished();
     void jt_resolveContactName();
     void client_rosterItemAdded(const RosterItem &);
     void client_rosterItemUpdated(const RosterItem &);
@@ -476,6 +501,7 @@ private slots:
     void setPEPAvailable(bool);
 
     void bookmarksAvailabilityChanged();
+    void autoJoinNext();
 
     void incomingHttpAuthRequest(const PsiHttpAuthRequest &);
 
@@ -486,20 +512,18 @@ private slots:
     void wbRequest(const Jid &j, int id);
 #endif
 
-    void itemPublished(const Jid &, const QString &, const PubSubItem &);
+    void itemsPublished(const Jid &, const PEPItems &);
     void itemRetracted(const Jid &, const QString &, const PubSubRetraction &);
 
     void chatMessagesRead(const Jid &);
 #ifdef GROUPCHAT
     void groupChatMessagesRead(const Jid &);
 #endif
-    void edb_finished();
     //void pgpToggled(bool);
     void pgpKeysUpdated();
 
     void trySignPresence();
-    void pgp_signFinished();
-    void pgp_verifyFinished();
+    void presignStatuses();
     void pgp_encryptFinished();
     void pgp_decryptFinished();
 
@@ -510,10 +534,9 @@ private slots:
 
     void processReadNext(const UserListItem &);
     void processReadNext(const Jid &);
-    void queryVersionFinished();
 
 protected:
-    bool    validRosterExchangeItem(const RosterExchangeItem &);
+    RosterExchangeItems rosterExchangeChanges(const RosterExchangeItems &) const;
     QString localHostName();
 
     void publishTune(const Tune &);
@@ -530,6 +553,10 @@ protected:
 private slots:
     void eventFromXml(const PsiEvent::Ptr &e);
     void simulateContactOffline(const XMPP::Jid &contact);
+    void flushPendingPresence();
+    void flushBacklogChats();
+    void finishBacklog();
+    void finishResumeWindow();
     void newPgpPassPhase(const QString &id, const QString &pass);
 
 private:
@@ -541,18 +568,31 @@ private:
 
     void login();
     void logout(bool fast, const Status &s);
+    void requestRoster();
+    void loadRosterSnapshot();
+    void saveRosterSnapshot();
+    void scheduleRosterSnapshot();
+    void scheduleWarmChatDlg();
+
+    void autoJoin(const QList<ConferenceBookmark> &rooms);
+    void autoJoinFinished(const Jid &room);
+    void reportAutoJoinProgress();
 
     void          deleteAllDialogs();
     void          simulateContactOffline(UserListItem *);
     void          simulateRosterOffline();
     void          cpUpdate(const UserListItem &, const QString &rname = "", bool fromPresence = false);
+    void          resourceAvailable(const Jid &, const Resource &);
     UserListItem *addUserListItem(const Jid &jid, const QString &nick = "");
     void          logEvent(const Jid &, const PsiEvent::Ptr &, int);
     void          queueEvent(const PsiEvent::Ptr &e, ActivationType activationType);
+    bool          noteBacklog(const Message &m);
+    void          deliverToChat(ChatDlg *c, const Message &m);
     void          openNextEvent(const UserListItem &, ActivationType activationType);
     void          updateReadNext(const Jid &);
     ChatDlg *     ensureChatDlg(const Jid &);
     void          lastStepLogin();
+    bool          isDuplicate(const Message &m);
     void          processIncomingMessage(const Message &);
     void          processEncryptedMessage(const Message &);
     void          processMessageQueue();
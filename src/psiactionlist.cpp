@@ -384,6 +384,12 @@ void PsiActionList::Private::createMainWin()
 
         IconAction *actDiagQCAKeyStore = new IconAction (tr("Key Storage"), tr("&Key Storage"), 0, this);
 
+        IconAction *actDiagStalls = new IconAction (tr("Interface Stalls"), tr("Interface &Stalls"), 0, this);
+
+        IconAction *actDiagMemory = new IconAction (tr("Memory Usage"), tr("&Memory Usage"), 0, this);
+
+        IconAction *actDiagTrimCaches = new IconAction (tr("Trim Caches"), tr("&Trim Caches"), 0, this);
+
         ActionNames actions[] = {
             { "help_readme",           actReadme          },
             { "help_tip",              actTip             },
@@ -397,6 +403,9 @@ void PsiActionList::Private::createMainWin()
             { "help_about_psimedia",   actAboutPsiMedia   },
             { "help_diag_qcaplugin",   actDiagQCAPlugin   },
             { "help_diag_qcakeystore", actDiagQCAKeyStore },
+            { "help_diag_stalls",      actDiagStalls      },
+            { "help_diag_memory",      actDiagMemory      },
+            { "help_diag_trim_caches", actDiagTrimCaches  },
             { "", nullptr }
         };
 
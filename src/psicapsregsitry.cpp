@@ -3,30 +3,81 @@
 #include "applicationinfo.h"
 #include "iodeviceopener.h"
 
+#include <QSaveFile>
+#include <QtConcurrentRun>
+
+static const int capsSaveDelay = 30000; // msecs
+
+static QString capsFileName()
+{
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/caps.xml";
+}
+
 PsiCapsRegistry::PsiCapsRegistry(QObject *parent) :
     CapsRegistry(parent)
 {
+    saveTimer_.setSingleShot(true);
+    saveTimer_.setInterval(capsSaveDelay);
+    connect(&saveTimer_, SIGNAL(timeout()), SLOT(flush()));
+}
 
+PsiCapsRegistry::~PsiCapsRegistry()
+{
+    saving_.waitForFinished();
+    if (saveTimer_.isActive()) {
+        saveTimer_.stop();
+        writeFile(pendingData_);
+    }
 }
 
+/**
+ * The registry hands over the whole cache on every new caps node. Presence
+ * floods would rewrite the file over and over, so only the latest snapshot
+ * is written, at most once per capsSaveDelay and off the GUI thread.
+ */
 void PsiCapsRegistry::saveData(const QByteArray &data)
 {
-    QFile file(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/caps.xml");
-    IODeviceOpener opener(&file, QIODevice::WriteOnly);
-    if (!opener.isOpen()) {
+    pendingData_ = data;
+    if (!saveTimer_.isActive()) {
+        saveTimer_.start();
+    }
+}
+
+void PsiCapsRegistry::flush()
+{
+    if (!saving_.isFinished()) {
+        saveTimer_.start(); // previous snapshot is still being written
+        return;
+    }
+    if (pendingData_ == savedData_) {
+        return;
+    }
+    savedData_ = pendingData_;
+    saving_ = QtConcurrent::run(&PsiCapsRegistry::writeFile, savedData_);
+}
+
+void PsiCapsRegistry::writeFile(const QByteArray &data)
+{
+    // never leave a truncated cache behind
+    QSaveFile file(capsFileName());
+    if (!file.open(QIODevice::WriteOnly)) {
         qWarning("Caps: Unable to open IO device");
         return;
     }
     file.write(data);
+    if (!file.commit()) {
+        qWarning("Caps: Unable to save %s", qPrintable(file.fileName()));
+    }
 }
 
 QByteArray PsiCapsRegistry::loadData()
 {
-    QFile file(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/caps.xml");
+    QFile file(capsFileName());
     if (file.exists()) {
         IODeviceOpener opener(&file, QIODevice::ReadOnly);
         if (opener.isOpen()) {
-            return file.readAll();
+            savedData_ = file.readAll();
+            return savedData_;
         } else {
             qWarning("CapsRegistry: Cannot open input device");
         }
@@ -3,15 +3,31 @@
 
 #include "xmpp_caps.h"
 
+#include <QByteArray>
+#include <QFuture>
+#include <QTimer>
+
 class PsiCapsRegistry : public XMPP::CapsRegistry
 {
     Q_OBJECT
 
 public:
     PsiCapsRegistry(QObject *parent = nullptr);
+    ~PsiCapsRegistry();
 
     void saveData(const QByteArray &data);
     QByteArray loadData();
+
+private slots:
+    void flush();
+
+private:
+    QTimer saveTimer_;
+    QByteArray pendingData_;
+    QByteArray savedData_;
+    QFuture<void> saving_;
+
+    static void writeFile(const QByteArray &data);
 };
 
 #endif // PSICAPSREGSITRY_H
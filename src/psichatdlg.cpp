@@ -6,6 +6,7 @@
 #include "avatars.h"
 #include "avcall/avcall.h"
 #include "coloropt.h"
+#include "entityinfocache.h"
 #include "fancylabel.h"
 #include "filesharingmanager.h"
 #include "iconaction.h"
@@ -13,9 +14,9 @@
 #include "iconselect.h"
 #include "iconwidget.h"
 #include "jidutil.h"
-#include "lastactivitytask.h"
 #include "messageview.h"
 #include "msgmle.h"
+#include "pixmaputil.h"
 #include "psiaccount.h"
 #include "psiactionlist.h"
 #include "psicon.h"
@@ -71,17 +72,12 @@ public:
             QString cmd;
             if (command.count() > 0) cmd = command[0].toLower();
             if (cmd == "version") {
-                JT_ClientVersion *version = new JT_ClientVersion(dlg_->account()->client()->rootTask());
-                connect(version, SIGNAL(finished()), SLOT(version_finished()));
-
-                //qDebug() << "querying: " << dlg_->jid().full();
-                version->get(dlg_->jid());
-                version->go();
+                dlg_->account()->entityInfoCache()->query(EntityInfoCache::Version, dlg_->jid(), this,
+                    [this](const EntityInfoCache::Info &info) { version_finished(info); });
                 newstate = nullptr;
             } else if (cmd == "idle") {
-                LastActivityTask *idle = new LastActivityTask(dlg_->jid(), dlg_->account()->client()->rootTask());
-                connect(idle, SIGNAL(finished()), SLOT(lastactivity_finished()));
-                idle->go();
+                dlg_->account()->entityInfoCache()->query(EntityInfoCache::LastActivity, dlg_->jid(), this,
+                    [this](const EntityInfoCache::Info &info) { lastactivity_finished(info); });
                 newstate = nullptr;
             } else if (cmd == "clear") {
                 dlg_->doClear();
@@ -140,32 +136,29 @@ public:
     virtual void mCmdSiteDestroyed() {};
     virtual ~ChatDlgMCmdProvider() {};
 
-public slots:
-    void version_finished() {
-        JT_ClientVersion *version = qobject_cast<JT_ClientVersion*>(sender());
-        if (!version) {
+private:
+    void version_finished(const EntityInfoCache::Info &version) {
+        if (!version.success) {
             dlg_->appendSysMsg("No version information available.");
             return;
         }
         dlg_->appendSysMsg(TextUtil::escape(QString("Version response: N: %2 V: %3 OS: %4")
-            .arg(version->name(), version->version(), version->os())));
+            .arg(version.name, version.version, version.os)));
     };
 
-    void lastactivity_finished()
+    void lastactivity_finished(const EntityInfoCache::Info &idle)
     {
-        LastActivityTask *idle = static_cast<LastActivityTask *>(sender());
-
-        if (!idle->success()) {
+        if (!idle.success) {
             dlg_->appendSysMsg("Could not determine time of last activity.");
             return;
         }
 
-        if (idle->status().isEmpty()) {
+        if (idle.lastStatus.isEmpty()) {
             dlg_->appendSysMsg(QString("Last activity at %1")
-                .arg(idle->time().toString()));
+                .arg(idle.lastActivity.toString()));
         } else {
             dlg_->appendSysMsg(QString("Last activity at %1 (%2)")
-                .arg(idle->time().toString(), TextUtil::escape(idle->status())));
+                .arg(idle.lastActivity.toString(), TextUtil::escape(idle.lastStatus)));
         }
     }
 
@@ -196,27 +189,7 @@ void PsiChatDlg::initUi()
     le_autojid = new ActionLineEdit(ui_.le_jid);
     ui_.le_jid->setLineEdit(le_autojid);
     ui_.le_jid->lineEdit()->setReadOnly(true);
-    if (autoSelectContact_) {
-        QStringList excl = PsiOptions::instance()->getOption("options.ui.chat.default-jid-mode-ignorelist").toString().toLower().split(",", QString::SkipEmptyParts);
-        if (excl.indexOf(jid().bare()) == -1) {
-            ui_.le_jid->insertItem(0, "auto", jid().full());
-            ui_.le_jid->setCurrentIndex(0);
-        } else {
-            autoSelectContact_ = false;
-        }
-    }
     connect(ui_.le_jid, SIGNAL(activated(int)), this, SLOT(contactChanged()));
-    UserListItem *ul = account()->findFirstRelevant(jid());
-    if (!ul || !ul->isPrivate()) {
-        act_autojid = new IconAction(this);
-        updateAutojidIcon();
-        connect(act_autojid, SIGNAL(triggered()), SLOT(doSwitchJidMode()));
-        le_autojid->addAction(act_autojid);
-
-        QAction *act_copy_user_jid = new QAction(tr("Copy user JID"), this);
-        le_autojid->addAction(act_copy_user_jid);
-        connect(act_copy_user_jid, SIGNAL(triggered()), SLOT(copyUserJid()));
-    }
 
     ui_.lb_ident->setAccount(account());
     ui_.lb_ident->setShowJid(false);
@@ -236,15 +209,9 @@ void PsiChatDlg::initUi()
 
     initToolButtons();
     initToolBar();
-    updateAvatar();
 
     PsiToolTip::install(ui_.avatar);
 
-    UserListItem* u = account()->findFirstRelevant(jid());
-    if (u && u->isSecure(jid().resource()) && account()->hasPGP()) {
-        setPGPEnabled(true);
-    }
-
     connect(account()->avatarFactory(), SIGNAL(avatarChanged(const Jid&)), this, SLOT(updateAvatar(const Jid&)));
 
     pm_settings_ = new QMenu(this);
@@ -277,10 +244,43 @@ void PsiChatDlg::initUi()
     if (throbber_icon == nullptr) {
         throbber_icon = const_cast<PsiIcon *>(IconsetFactory::iconPtr("psi/throbber"));
     }
+    ui_.mle->chatEdit()->addSoundRecButton();
+}
+
+void PsiChatDlg::bindUi()
+{
+    if (autoSelectContact_) {
+        QStringList excl = PsiOptions::instance()->getOption("options.ui.chat.default-jid-mode-ignorelist").toString().toLower().split(",", QString::SkipEmptyParts);
+        if (excl.indexOf(jid().bare()) == -1) {
+            ui_.le_jid->insertItem(0, "auto", jid().full());
+            ui_.le_jid->setCurrentIndex(0);
+        } else {
+            autoSelectContact_ = false;
+        }
+    }
+    UserListItem *ul = account()->findFirstRelevant(jid());
+    if (!ul || !ul->isPrivate()) {
+        act_autojid = new IconAction(this);
+        updateAutojidIcon();
+        connect(act_autojid, SIGNAL(triggered()), SLOT(doSwitchJidMode()));
+        le_autojid->addAction(act_autojid);
+
+        QAction *act_copy_user_jid = new QAction(tr("Copy user JID"), this);
+        le_autojid->addAction(act_copy_user_jid);
+        connect(act_copy_user_jid, SIGNAL(triggered()), SLOT(copyUserJid()));
+    }
+
+    // plugin buttons are made for the contact
+    updateToolbuttons();
+    updateAvatar();
+
+    if (ul && ul->isSecure(jid().resource()) && account()->hasPGP()) {
+        setPGPEnabled(true);
+    }
+
 #ifdef PSI_PLUGINS
     PluginManager::instance()->setupChatTab(this, account(), jid().full());
 #endif
-    ui_.mle->chatEdit()->addSoundRecButton();
 }
 
 void PsiChatDlg::updateCountVisibility()
@@ -528,8 +528,6 @@ void PsiChatDlg::initToolBar()
     ui_.toolbar->setWindowTitle(tr("Chat Toolbar"));
     int s = PsiIconset::instance()->system().iconSize();
     ui_.toolbar->setIconSize(QSize(s, s));
-
-    updateToolbuttons();
 }
 
 void PsiChatDlg::contextMenuEvent(QContextMenuEvent *)
@@ -762,7 +760,7 @@ void PsiChatDlg::updateAvatar()
     int avatarSize = p.width(); //qMax(p.width(), p.height());
     if (avatarSize > optSize)
         avatarSize = optSize;
-    ui_.avatar->setPixmap(p.scaled(QSize(avatarSize, avatarSize), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    ui_.avatar->setPixmap(PixmapUtil::scaled(p, QSize(avatarSize, avatarSize)));
     ui_.avatar->show();
 }
 
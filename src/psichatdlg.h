@@ -59,6 +59,7 @@ private:
 
     // reimplemented
     void initUi();
+    void bindUi();
     void capsChanged();
     bool isEncryptionEnabled() const;
     void updateJidWidget(const QList<UserListItem*> &ul, int status, bool fromPresence);
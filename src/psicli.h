@@ -44,6 +44,35 @@ public:
                 tr("Set status message. Must be used together with --status.",
                     "do not translate --status"));
 
+        defineParam("export-history", tr("FILE", "translate in UPPER_CASE with no spaces"),
+                tr("Export the whole message history of the profile to FILE and exit. "
+                   "The format follows the file extension: .txt, .xml or .json, "
+                   "optionally followed by .gz for compressed output."));
+
+        defineParam("import-history", tr("FILE", "translate in UPPER_CASE with no spaces"),
+                tr("Import messages from an .xml or .json history export (optionally .gz compressed) "
+                   "into the profile and exit."));
+
+        defineParam("trace", tr("FILE", "translate in UPPER_CASE with no spaces"),
+                tr("Record a performance trace and save it to FILE on exit. "
+                   "It can be opened in chrome://tracing."));
+
+        defineParam("debug-log", tr("CATEGORIES", "translate in UPPER_CASE with no spaces"),
+                tr("Write debug output to rotating files in the logs folder of the cache directory, "
+                   "in the background. CATEGORIES is a comma separated list of "
+                   "`general', `edb', `cl', `xml', `client' or `all'.",
+                   "do not translate `general', `edb', etc"));
+
+        defineSwitch("headless",
+                 tr("Run the profile without any windows: accounts, history, plugins and "
+                    "the remote control only."));
+
+        defineSwitch("memory-report",
+                 tr("Show how much memory the caches of the running instance use, and exit."));
+
+        defineSwitch("trim-caches",
+                 tr("Make the running instance drop what it can reload from its caches, and exit."));
+
         defineSwitch("help", tr("Show this help message and exit."));
         defineAlias("h", "help");
         defineAlias("?", "help");
@@ -35,23 +35,29 @@
 #include "avcall/mediadevicewatcher.h"
 #include "bosskey.h"
 #include "chatdlg.h"
+#include "chatspellchecker.h"
 #include "common.h"
 #include "contactupdatesmanager.h"
 #include "dbus.h"
+#include "debug.h"
 #include "desktoputil.h"
 #include "edbsqlite.h"
 #include "eventdlg.h"
+#include "filecache.h"
 #include "globalshortcut/globalshortcutmanager.h"
 #ifdef GROUPCHAT
 #include "groupchatdlg.h"
 #endif
 #include "iconselect.h"
 #include "idle/idle.h"
+#include "idlescheduler.h"
 #include "iris/processquit.h"
 #include "iris/tcpportreserver.h"
+#include "jidkey.h"
 #include "jidutil.h"
 #include "jingle-s5b.h"
 #include "mainwin.h"
+#include "memoryaccounting.h"
 #include "mucjoindlg.h"
 #include "networkaccessmanager.h"
 #include "options/opt_toolbars.h"
@@ -77,6 +83,7 @@
 #include "psithememanager.h"
 #include "psitoolbar.h"
 #include "s5b.h"
+#include "sessionjournal.h"
 #include "shortcutmanager.h"
 #include "spellchecker/aspellchecker.h"
 #include "statusdlg.h"
@@ -119,6 +126,7 @@
 #include <QColor>
 #include <QDesktopWidget>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QIcon>
 #include <QImage>
@@ -128,14 +136,68 @@
 #include <QMessageBox>
 #include <QNetworkConfigurationManager>
 #include <QPixmap>
-#include <QPixmapCache>
 #include <QPointer>
 #include <QSessionManager>
+#include <QTimer>
+
+static const int loginStaggerTimeout = 3000; // msecs
 
 static const char *tunePublishOptionPath          = "options.extended-presence.tune.publish";
 static const char *tuneUrlFilterOptionPath        = "options.extended-presence.tune.url-filter";
 static const char *tuneTitleFilterOptionPath      = "options.extended-presence.tune.title-filter";
 static const char *tuneControllerFilterOptionPath = "options.extended-presence.tune.controller-filter";
+static const char *stallMonitorOptionPath         = "options.stall-monitor.enable";
+static const char *stallThresholdOptionPath       = "options.stall-monitor.threshold";
+
+static void applyStallMonitorOptions()
+{
+    if (PsiOptions::instance()->getOption(stallMonitorOptionPath).toBool())
+        StallMonitor::start(PsiOptions::instance()->getOption(stallThresholdOptionPath).toInt());
+    else
+        StallMonitor::stop();
+}
+
+//----------------------------------------------------------------------------
+// StartupPhases
+//----------------------------------------------------------------------------
+// logs how long each phase of the startup takes
+class StartupPhases {
+public:
+    StartupPhases()
+    {
+        total_.start();
+    }
+
+    ~StartupPhases()
+    {
+        finish();
+        qDebug("[startup] total: %lld ms", total_.elapsed());
+    }
+
+    void begin(const char *name)
+    {
+        finish();
+        name_ = name;
+        phase_.start();
+        if (Trace::isEnabled())
+            Trace::begin(name_);
+    }
+
+private:
+    void finish()
+    {
+        if (!name_)
+            return;
+        if (Trace::isEnabled())
+            Trace::end(name_);
+        qDebug("[startup] %s: %lld ms", name_, phase_.elapsed());
+        name_ = nullptr;
+    }
+
+    QElapsedTimer total_;
+    QElapsedTimer phase_;
+    const char *  name_ = nullptr;
+};
 
 //----------------------------------------------------------------------------
 // PsiConObject
@@ -263,7 +325,27 @@ private slots:
         }
 
         iconSelect->setIconset(iss);
-        QPixmapCache::clear();
+    }
+
+public slots:
+    // logs in the next account once the previous one got its roster
+    void loginNextAccount()
+    {
+        loginTimer->stop();
+        disconnect(loginConnection);
+        while (!pendingLogins.isEmpty()) {
+            PsiAccount *account = pendingLogins.takeFirst();
+            if (!account)
+                continue;
+            account->autoLogin();
+            if (!account->isActive())
+                continue;
+
+            loginConnection = connect(account, SIGNAL(rosterRequestFinished()), SLOT(loginNextAccount()),
+                                      Qt::QueuedConnection);
+            loginTimer->start();
+            return;
+        }
     }
 
 public:
@@ -294,6 +376,7 @@ public:
     QMenuBar *                   defaultMenuBar       = nullptr;
     TabManager *                 tabManager           = nullptr;
     bool                         quitting             = false;
+    bool                         headless             = false;
     bool                         wakeupPending        = false;
     QTimer *                     updatedAccountTimer_ = nullptr;
     AutoUpdater *                autoUpdater          = nullptr;
@@ -305,6 +388,11 @@ public:
     quint16                      byteStreamsPort = 0;
     QString                      externalByteStreamsAddress;
 
+    // accounts waiting for their auto-login, in the order of the accounts list
+    QList<QPointer<PsiAccount>> pendingLogins;
+    QTimer *                    loginTimer = nullptr;
+    QMetaObject::Connection     loginConnection;
+
     struct IdleSettings {
         IdleSettings() = default;
 
@@ -367,6 +455,9 @@ PsiCon::~PsiCon()
 
 bool PsiCon::init()
 {
+    StartupPhases phases;
+    phases.begin("profile");
+
     // check active profiles
     if (!ActiveProfiles::instance()->setThisProfile(activeProfile))
         return false;
@@ -378,9 +469,11 @@ bool PsiCon::init()
 
 #ifdef HAVE_PGPUTIL
     // PGP initialization (needs to be before any gpg usage!)
+    phases.begin("pgp");
     PGPUtil::instance();
 #endif
 
+    phases.begin("network session");
     initNetSession();
 
     d->contactList = new PsiContactList(this);
@@ -398,7 +491,9 @@ bool PsiCon::init()
     connect(d->updatedAccountTimer_, SIGNAL(timeout()), SLOT(saveAccounts()));
 
     QString oldConfig = pathToProfileConfig(activeProfile);
-    if (QFile::exists(oldConfig)) {
+    if (QFile::exists(oldConfig) && d->headless) {
+        qWarning("Found no more supported configuration file from some very old version: %s", qPrintable(oldConfig));
+    } else if (QFile::exists(oldConfig)) {
         QMessageBox::warning(d->mainwin, tr("Migration is impossible"),
                              tr("Found no more supported configuration file from some very old version:\n%1\n\n"
                                 "Migration is possible with Psi-0.15")
@@ -414,6 +509,7 @@ bool PsiCon::init()
                                                    << ApplicationInfo::homeDir(ApplicationInfo::CacheLocation));
 
     // To allow us to upgrade from old hardcoded options gracefully, be careful about the order here
+    phases.begin("options");
     PsiOptions *options = PsiOptions::instance();
     // load the system-wide defaults, if they exist
     QString systemDefaults = ApplicationInfo::resourcesDir();
@@ -439,6 +535,10 @@ bool PsiCon::init()
     // do some late migration work
     d->optionsMigration.lateMigration();
 
+    applyStallMonitorOptions();
+    // before the first cache is made
+    FileCache::setShared(options->getOption("options.cache.shared-between-profiles").toBool());
+
 #ifdef USE_PEP
     // Create the tune controller
     d->tuneManager = new TuneControllerManager();
@@ -460,6 +560,7 @@ bool PsiCon::init()
         common_smallFontSize = minimumFontSize;
     FancyLabel::setSmallFontSize(common_smallFontSize);
 
+    phases.begin("accounts tree");
     QFile accountsFile(pathToProfile(activeProfile, ApplicationInfo::ConfigLocation) + "/accounts.xml");
     bool  accountMigration = false;
     if (!accountsFile.exists()) {
@@ -488,58 +589,73 @@ bool PsiCon::init()
     QDir profileDir(pathToProfile(activeProfile, ApplicationInfo::DataLocation));
     profileDir.rmdir("info"); // remove unused dir
 
-    d->iconSelect = new IconSelectPopup(nullptr);
-    connect(PsiIconset::instance(), SIGNAL(emoticonsChanged()), d, SLOT(updateIconSelect()));
+    // a headless session has no widgets: no iconsets, themes, web server, main window
+    // and popups, only the accounts, history, plugins and the remote control
+    bool result = true;
+    if (!d->headless) {
+        d->iconSelect = new IconSelectPopup(nullptr);
+        d->iconSelect->setRecentTexts(options->getOption("options.ui.emoticons.recent").toStringList());
+        connect(d->iconSelect, &IconSelectPopup::textSelected, this, [this]() {
+            PsiOptions::instance()->setOption("options.ui.emoticons.recent", d->iconSelect->recentTexts());
+        });
+        connect(PsiIconset::instance(), SIGNAL(emoticonsChanged()), d, SLOT(updateIconSelect()));
+
+        const QString css = options->getOption("options.ui.chat.css").toString();
+        if (!css.isEmpty())
+            d->iconSelect->setStyleSheet(css);
 
-    const QString css = options->getOption("options.ui.chat.css").toString();
-    if (!css.isEmpty())
-        d->iconSelect->setStyleSheet(css);
+        // first thing, try to load the iconset. emoticons are loaded once the roster is up
+        phases.begin("iconsets");
+        if (!PsiIconset::instance()->loadAll(false)) {
+            // LEGOPTS.iconset = "stellar";
+            // if(!is.load(LEGOPTS.iconset)) {
+            QMessageBox::critical(nullptr, tr("Error"),
+                                  tr("Unable to load iconset!  Please make sure Psi is properly installed."));
+            result = false;
+            //}
+        }
 
-    // first thing, try to load the iconset
-    bool result = true;
-    if (!PsiIconset::instance()->loadAll()) {
-        // LEGOPTS.iconset = "stellar";
-        // if(!is.load(LEGOPTS.iconset)) {
-        QMessageBox::critical(nullptr, tr("Error"),
-                              tr("Unable to load iconset!  Please make sure Psi is properly installed."));
-        result = false;
-        //}
+        QTimer::singleShot(0, PsiIconset::instance(), SLOT(loadEmoticons()));
     }
 
+    phases.begin("web server");
     d->nam                = new NetworkAccessManager(this);
     d->fileSharingManager = new FileSharingManager(this);
+    if (!d->headless) {
 #ifdef HAVE_WEBSERVER
-    d->webServer = new WebServer(this);
-    d->webServer->route(
-        "/psi/account", [this](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
-            if (req->method() != qhttp::EHTTP_GET)
-                return false;
-            QString path      = req->url().path();
-            auto    pathParts = path.midRef(sizeof("/psi/account")).split('/');
-            if (pathParts.size() < 3 || pathParts[1] != QLatin1String("sharedfile")
-                || pathParts[2].isEmpty()) // <acoount_uuid>/sharedfile/<file_hash>
-                return false;
-
-            foreach (PsiAccount *account, d->contactList->enabledAccounts()) {
-                if (!account->isActive() || account->id() != pathParts[0])
-                    continue;
-
-                return d->fileSharingManager->downloadHttpRequest(account, pathParts[2].toString(), req, res);
-            }
+        d->webServer = new WebServer(this);
+        d->webServer->route(
+            "/psi/account",
+            [this](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
+                QString path      = req->url().path();
+                auto    pathParts = path.midRef(sizeof("/psi/account")).split('/');
+                if (pathParts.size() < 3 || pathParts[1] != QLatin1String("sharedfile")
+                    || pathParts[2].isEmpty()) // <acoount_uuid>/sharedfile/<file_hash>
+                    return false;
 
-            return true;
-        });
+                foreach (PsiAccount *account, d->contactList->enabledAccounts()) {
+                    if (!account->isActive() || account->id() != pathParts[0])
+                        continue;
+
+                    return d->fileSharingManager->downloadHttpRequest(account, pathParts[2].toString(), req, res);
+                }
+
+                return true;
+            },
+            WebServer::Methods() << qhttp::EHTTP_GET);
 #endif
-    d->themeManager = new PsiThemeManager(this);
+        phases.begin("themes");
+        d->themeManager = new PsiThemeManager(this);
 #ifdef WEBKIT
-    d->themeManager->registerProvider(new ChatViewThemeProvider(this), true);
-    d->themeManager->registerProvider(new GroupChatViewThemeProvider(this), true);
+        d->themeManager->registerProvider(new ChatViewThemeProvider(this), true);
+        d->themeManager->registerProvider(new GroupChatViewThemeProvider(this), true);
 #endif
 
-    if (!d->themeManager->loadAll()) {
-        QMessageBox::critical(nullptr, tr("Error"),
-                              tr("Unable to load theme!  Please make sure Psi is properly installed."));
-        result = false;
+        if (!d->themeManager->loadAll()) {
+            QMessageBox::critical(nullptr, tr("Error"),
+                                  tr("Unable to load theme!  Please make sure Psi is properly installed."));
+            result = false;
+        }
     }
 
     if (!d->actionList)
@@ -550,33 +666,36 @@ bool PsiCon::init()
     Anim::setMainThread(QThread::currentThread());
 
     // setup the main window
-    d->mainwin = new MainWin(options->getOption("options.ui.contactlist.always-on-top").toBool(),
-                             (options->getOption("options.ui.systemtray.enable").toBool()
-                              && options->getOption("options.contactlist.use-toolwindow").toBool()),
-                             this);
-    d->mainwin->setUseDock(options->getOption("options.ui.systemtray.enable").toBool());
-    d->bossKey = new BossKey(d->mainwin);
-
-    Q_UNUSED(psiConObject);
-
-    connect(d->mainwin, SIGNAL(closeProgram()), SLOT(closeProgram()));
-    connect(d->mainwin, SIGNAL(changeProfile()), SLOT(changeProfile()));
-    connect(d->mainwin, SIGNAL(doGroupChat()), SLOT(doGroupChat()));
-    connect(d->mainwin, SIGNAL(blankMessage()), SLOT(doNewBlankMessage()));
-    connect(d->mainwin, SIGNAL(statusChanged(XMPP::Status::Type)), SLOT(statusMenuChanged(XMPP::Status::Type)));
-    connect(d->mainwin, SIGNAL(statusMessageChanged(QString)), SLOT(setStatusMessage(QString)));
-    connect(d->mainwin, SIGNAL(doOptions()), SLOT(doOptions()));
-    connect(d->mainwin, SIGNAL(doToolbars()), SLOT(doToolbars()));
-    connect(d->mainwin, SIGNAL(doFileTransDlg()), SLOT(doFileTransDlg()));
-    connect(d->mainwin, SIGNAL(recvNextEvent()), SLOT(recvNextEvent()));
-    connect(this, SIGNAL(emitOptionsUpdate()), d->mainwin, SLOT(optionsUpdate()));
-
-    d->mainwin->setGeometryOptionPath("options.ui.contactlist.saved-window-geometry");
-
-    if (result
-        && !(options->getOption("options.ui.systemtray.enable").toBool()
-             && options->getOption("options.contactlist.hide-on-start").toBool())) {
-        d->mainwin->show();
+    if (!d->headless) {
+        phases.begin("main window");
+        d->mainwin = new MainWin(options->getOption("options.ui.contactlist.always-on-top").toBool(),
+                                 (options->getOption("options.ui.systemtray.enable").toBool()
+                                  && options->getOption("options.contactlist.use-toolwindow").toBool()),
+                                 this);
+        d->mainwin->setUseDock(options->getOption("options.ui.systemtray.enable").toBool());
+        d->bossKey = new BossKey(d->mainwin);
+
+        Q_UNUSED(psiConObject);
+
+        connect(d->mainwin, SIGNAL(closeProgram()), SLOT(closeProgram()));
+        connect(d->mainwin, SIGNAL(changeProfile()), SLOT(changeProfile()));
+        connect(d->mainwin, SIGNAL(doGroupChat()), SLOT(doGroupChat()));
+        connect(d->mainwin, SIGNAL(blankMessage()), SLOT(doNewBlankMessage()));
+        connect(d->mainwin, SIGNAL(statusChanged(XMPP::Status::Type)), SLOT(statusMenuChanged(XMPP::Status::Type)));
+        connect(d->mainwin, SIGNAL(statusMessageChanged(QString)), SLOT(setStatusMessage(QString)));
+        connect(d->mainwin, SIGNAL(doOptions()), SLOT(doOptions()));
+        connect(d->mainwin, SIGNAL(doToolbars()), SLOT(doToolbars()));
+        connect(d->mainwin, SIGNAL(doFileTransDlg()), SLOT(doFileTransDlg()));
+        connect(d->mainwin, SIGNAL(recvNextEvent()), SLOT(recvNextEvent()));
+        connect(this, SIGNAL(emitOptionsUpdate()), d->mainwin, SLOT(optionsUpdate()));
+
+        d->mainwin->setGeometryOptionPath("options.ui.contactlist.saved-window-geometry");
+
+        if (result
+            && !(options->getOption("options.ui.systemtray.enable").toBool()
+                 && options->getOption("options.contactlist.hide-on-start").toBool())) {
+            d->mainwin->show();
+        }
     }
 
     connect(&d->idle, SIGNAL(secondsIdle(int)), SLOT(secondsIdle(int)));
@@ -618,6 +737,7 @@ bool PsiCon::init()
 
 #ifdef PSI_PLUGINS
     // Plugin Manager
+    phases.begin("plugins");
     PluginManager::instance()->initNewSession(this);
 #endif
 
@@ -625,6 +745,7 @@ bool PsiCon::init()
     setShortcuts();
 
     // load accounts
+    phases.begin("accounts");
     {
         QList<UserAccount> accs;
         QStringList        bases = d->accountTree.getChildOptionNames("accounts", true, true);
@@ -669,12 +790,16 @@ bool PsiCon::init()
             }
         }
 
+        // before the accounts, whose chats and rooms it journals
+        SessionJournal::instance()->open(pathToProfile(activeProfile, ApplicationInfo::DataLocation)
+                                         + "/session.journal");
         d->contactList->loadAccounts(accs);
     }
 
     checkAccountsEmpty();
 
     // Import for SQLite history
+    phases.begin("history");
     if (d->contactList->defaultAccount()) {
         EDBSqLite *edb = new EDBSqLite(this);
         d->edb         = edb;
@@ -693,48 +818,101 @@ bool PsiCon::init()
             SLOT(setStatusFromCommandline(const QString &, const QString &)));
     connect(ActiveProfiles::instance(), SIGNAL(openUriRequested(const QString &)), SLOT(openUri(const QString &)));
     connect(ActiveProfiles::instance(), SIGNAL(raiseRequested()), SLOT(raiseMainwin()));
+    connect(ActiveProfiles::instance(), &ActiveProfiles::trimCachesRequested, this, &MemoryAccounting::trim);
+    // keys let go of by owners registered later are squeezed on the next trim
+    MemoryAccounting::add(
+        this, "jid keys",
+        []() {
+            MemoryAccounting::Usage u;
+            u.entries = JidKey::poolSize();
+            return u;
+        },
+        &JidKey::squeezePool);
 
     DesktopUtil::setUrlHandler("xmpp", this, "openUri");
     DesktopUtil::setUrlHandler("x-psi-atstyle", this, "openAtStyleUri");
 
     if (AvCallManager::isSupported()) {
-        auto config = MediaDeviceWatcher::instance()->configuration();
-        AvCallManager::setAudioOutDevice(config.audioOutDeviceId);
-        AvCallManager::setAudioInDevice(config.audioInDeviceId);
-        AvCallManager::setVideoInDevice(config.videoInDeviceId);
+        // the chosen devices until the media device watcher knows better
+        AvCallManager::setAudioOutDevice(options->getOption("options.media.devices.audio-output").toString());
+        AvCallManager::setAudioInDevice(options->getOption("options.media.devices.audio-input").toString());
+        AvCallManager::setVideoInDevice(options->getOption("options.media.devices.video-input").toString());
         AvCallManager::setBasePort(options->getOption("options.p2p.bytestreams.listen-port").toInt());
         AvCallManager::setExternalAddress(options->getOption("options.p2p.bytestreams.external-address").toString());
     }
 
+    // tune controllers and spell checker dictionaries are slow to start,
+    // but aren't needed to show the roster
+    phases.begin("finish");
 #ifdef USE_PEP
-    optionChanged(tuneControllerFilterOptionPath);
     optionChanged(tuneUrlFilterOptionPath);
 #endif
+    QTimer::singleShot(0, this, [this]() {
+        StartupPhases phases;
+#ifdef USE_PEP
+        phases.begin("tune controllers");
+        optionChanged(tuneControllerFilterOptionPath);
+#endif
 
-    // init spellchecker
-    optionChanged("options.ui.spell-check.langs");
+        // init spellchecker
+        phases.begin("spell checker");
+        optionChanged("options.ui.spell-check.langs");
+
+        // the provider lists the devices in the background from here on, and
+        // the watcher hands the defaults to calls as they come and go
+        if (AvCallManager::isSupported()) {
+            phases.begin("media devices");
+            MediaDeviceWatcher::instance();
+        }
+    });
+
+    // the chats a crashed session had open are there again right away, the
+    // rooms are joined again once their account is logged in
+    if (!d->headless) {
+        for (PsiAccount *account : d->contactList->enabledAccounts()) {
+            for (const QString &jid : SessionJournal::instance()->recoveredChats(account->id()))
+                account->openChat(Jid(jid), UserPassiveAction);
+        }
+    }
 
-    // try autologin if needed
+    // try autologin if needed. accounts connect one after another, so the first ones
+    // become usable quickly even with many accounts. the next account doesn't wait
+    // for longer than loginStaggerTimeout
     foreach (PsiAccount *account, d->contactList->accounts()) {
-        account->autoLogin();
+        d->pendingLogins << account;
     }
+    d->loginTimer = new QTimer(d);
+    d->loginTimer->setSingleShot(true);
+    d->loginTimer->setInterval(loginStaggerTimeout);
+    connect(d->loginTimer, SIGNAL(timeout()), d, SLOT(loginNextAccount()));
+    d->loginNextAccount();
 
     return result;
 }
 
+void PsiCon::setHeadless(bool headless) { d->headless = headless; }
+
+bool PsiCon::isHeadless() const { return d->headless; }
+
 bool PsiCon::haveAutoUpdater() const { return d->autoUpdater != nullptr; }
 
 void PsiCon::updateStatusPresets() { emit statusPresetsChanged(); }
 
 void PsiCon::deinit()
 {
+    StallMonitor::stop();
+    // nothing to recover from a session that ended like this
+    SessionJournal::instance()->close();
+
     // this deletes all dialogs except for mainwin
     deleteAllDialogs();
 
 #ifdef WEBKIT
     // unload webkit themes early (before realease of webengine profile)
-    delete d->themeManager->unregisterProvider(QString::fromLatin1("groupchatview"));
-    delete d->themeManager->unregisterProvider(QString::fromLatin1("chatview"));
+    if (d->themeManager) {
+        delete d->themeManager->unregisterProvider(QString::fromLatin1("groupchatview"));
+        delete d->themeManager->unregisterProvider(QString::fromLatin1("chatview"));
+    }
 #endif
     delete d->themeManager;
     d->themeManager = nullptr;
@@ -777,6 +955,9 @@ void PsiCon::deinit()
     GlobalShortcutManager::clear();
 
     DesktopUtil::unsetUrlHandler("xmpp");
+
+    // don't leave housekeeping which was waiting for the user to pause
+    IdleScheduler::instance()->runAll();
 }
 
 // will gracefully finish all network activity and other async stuff
@@ -792,6 +973,9 @@ void PsiCon::gracefulDeinit(std::function<void()> callback)
 
 void PsiCon::setShortcuts()
 {
+    if (d->headless)
+        return;
+
     // FIX-ME: GlobalShortcutManager::clear() is one big hack,
     // but people wanted to change global hotkeys without restarting in 0.11
     GlobalShortcutManager::clear();
@@ -1236,6 +1420,8 @@ void PsiCon::updateMainwinStatus()
             state    = makeSTATUS(account->status());
         }
     }
+    if (!d->mainwin)
+        return;
     if (loggedIn)
         d->mainwin->decorateButton(state);
     else {
@@ -1267,7 +1453,9 @@ void PsiCon::doFileTransDlg()
 
 void PsiCon::checkAccountsEmpty()
 {
-    if (d->contactList->accounts().count() == 0) {
+    if (d->contactList->accounts().count() == 0 && d->headless) {
+        qWarning("The profile has no accounts");
+    } else if (d->contactList->accounts().count() == 0) {
         promptUserToCreateAccount();
     }
 }
@@ -1420,23 +1608,25 @@ void PsiCon::optionChanged(const QString &option)
 
     if (option == "options.ui.chat.css") {
         QString css = PsiOptions::instance()->getOption(option).toString();
-        if (!css.isEmpty())
+        if (!css.isEmpty() && d->iconSelect)
             d->iconSelect->setStyleSheet(css);
         return;
     }
 
     if (option == QString::fromLatin1("options.ui.spell-check.langs")) {
         if (PsiOptions::instance()->getOption("options.ui.spell-check.enabled").toBool()) {
+            // loaded in the background, chats check words once it's done
             auto langs = LanguageManager::deserializeLanguageSet(PsiOptions::instance()->getOption(option).toString());
-            if (langs.isEmpty()) {
-                langs = SpellChecker::instance()->getAllLanguages();
-                langs = LanguageManager::bestUiMatch(langs).toSet();
-            }
-            SpellChecker::instance()->setActiveLanguages(langs);
+            ChatSpellChecker::instance()->setActiveLanguages(langs, true);
         }
         return;
     }
 
+    if (option == stallMonitorOptionPath || option == stallThresholdOptionPath) {
+        applyStallMonitorOptions();
+        return;
+    }
+
 #ifdef USE_PEP
     if (option == tuneUrlFilterOptionPath || option == tuneTitleFilterOptionPath) {
         d->tuneManager->setTuneFilters(
@@ -1490,6 +1680,10 @@ void PsiCon::slotApplyOptions()
     }
 
     // mainwin stuff
+    if (!d->mainwin) {
+        emit emitOptionsUpdate();
+        return;
+    }
     d->mainwin->setWindowOpts(o->getOption("options.ui.contactlist.always-on-top").toBool(),
                               (o->getOption("options.ui.systemtray.enable").toBool()
                                && o->getOption("options.contactlist.use-toolwindow").toBool()));
@@ -1521,7 +1715,8 @@ void PsiCon::queueChanged()
     }
 #endif
 
-    d->mainwin->updateReadNext(nextAnim, nextAmount);
+    if (d->mainwin)
+        d->mainwin->updateReadNext(nextAnim, nextAmount);
 }
 
 void PsiCon::startBounce()
@@ -1562,15 +1757,20 @@ void PsiCon::recvNextEvent()
 
 void PsiCon::playSound(const QString &str)
 {
-    if (str.isEmpty() || !PsiOptions::instance()->getOption("options.ui.notifications.sounds.enable").toBool())
+    if (str.isEmpty() || d->headless
+        || !PsiOptions::instance()->getOption("options.ui.notifications.sounds.enable").toBool())
         return;
 
     soundPlay(str);
 }
 
-void PsiCon::raiseMainwin() { d->mainwin->showNoFocus(); }
+void PsiCon::raiseMainwin()
+{
+    if (d->mainwin)
+        d->mainwin->showNoFocus();
+}
 
-bool PsiCon::mainWinVisible() const { return d->mainwin->isVisible(); }
+bool PsiCon::mainWinVisible() const { return d->mainwin && d->mainwin->isVisible(); }
 
 QStringList PsiCon::recentGCList() const
 {
@@ -1867,6 +2067,10 @@ void PsiCon::networkSessionOpened()
 
         if (d->contactList && d->contactList->defaultAccount())
             emit statusMessageChanged(d->contactList->defaultAccount()->status().status());
+    } else if (d->contactList) {
+        foreach (PsiAccount *account, d->contactList->enabledAccounts()) {
+            account->networkChanged();
+        }
     }
 }
 
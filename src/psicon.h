@@ -74,6 +74,10 @@ public:
     PsiCon();
     ~PsiCon();
 
+    // call before init(), a headless session builds no widgets
+    void setHeadless(bool headless);
+    bool isHeadless() const;
+
     bool init();
     void deinit();
     void gracefulDeinit(std::function<void()> callback);
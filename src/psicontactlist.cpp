@@ -226,6 +226,7 @@ void PsiContactList::removeAccount(PsiAccount* account)
 {
     emit accountRemoved(account);
     account->deleteQueueFile();
+    account->deleteRosterSnapshot();
     delete account;
     emit saveAccounts();
 }
@@ -35,6 +35,7 @@
 #include "textutil.h"
 #include "userlist.h"
 
+#include <QCoreApplication>
 #include <QDBusArgument>
 #include <QDBusConnection>
 #include <QDBusInterface>
@@ -46,6 +47,8 @@
 #include <QtPlugin>
 
 static const int minLifeTime = 5000;
+static const int coalesceWindow = 5000; // msecs since a notification was updated
+static const int maxPerSecond = 4;
 static const QString markupCaps = "body-markup";
 
 class iiibiiay
@@ -106,20 +109,13 @@ static QDBusMessage createMessage(const QString& method)
 
 PsiDBusNotifier::PsiDBusNotifier(QObject *parent)
     : QObject(parent)
-    , id_(0)
     , account_(nullptr)
-    , lifeTimer_(new QTimer(this))
 {
-    QDBusConnection::sessionBus().connect("org.freedesktop.Notifications",
-                          "/org/freedesktop/Notifications",
-                          "org.freedesktop.Notifications",
-                          "NotificationClosed", this, SLOT(popupClosed(uint,uint)));
-    lifeTimer_->setSingleShot(true);
-    connect(lifeTimer_, SIGNAL(timeout()), SLOT(readyToDie()));
 }
 
 PsiDBusNotifier::~PsiDBusNotifier()
 {
+    PsiDBusNotificationQueue::instance()->release(this);
 }
 
 bool PsiDBusNotifier::isAvailable()
@@ -288,26 +284,7 @@ void PsiDBusNotifier::popup(PsiAccount* account, PopupManager::PopupType type, c
     bool bodyMarkup = capabilities().contains(markupCaps);
     text = TextUtil::rich2plain(text);
     text = bodyMarkup ? TextUtil::escape(text) : text;
-    QDBusMessage m = createMessage("Notify");
-    QVariantList args;
-    args << QString(ApplicationInfo::name());
-    args << QVariant(QVariant::UInt);
-    args << QVariant("");
-    args << QString(title);
-    args << QString(text);
-    args << QStringList();
-    args << hints;
-    args << lifeTime;
-    m.setArguments(args);
-    QDBusPendingCall call = QDBusConnection::sessionBus().asyncCall(m);
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
-
-    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
-             this, SLOT(asyncCallFinished(QDBusPendingCallWatcher*)));
-
-    lifeTime = (lifeTime < 0) ? lifeTime : qMax(minLifeTime, lifeTime);
-    if(lifeTime >= 0)
-        lifeTimer_->start(lifeTime);
+    PsiDBusNotificationQueue::instance()->notify(this, title, text, hints, lifeTime);
 }
 
 void PsiDBusNotifier::popup(PsiAccount *account, PopupManager::PopupType /*type*/, const Jid &j, const PsiIcon *titleIcon, const QString &titleText,
@@ -331,73 +308,232 @@ void PsiDBusNotifier::popup(PsiAccount *account, PopupManager::PopupType /*type*
     bool bodyMarkup = capabilities().contains(markupCaps);
     QString plainText = TextUtil::rich2plain(text);
     plainText = bodyMarkup ? TextUtil::escape(plainText) : plainText;
+    PsiDBusNotificationQueue::instance()->notify(this, titleText, plainText, hints, lifeTime);
+}
+
+QString PsiDBusNotifier::key() const
+{
+    // popups without a contact or room are never merged
+    if (!jid_.isValid())
+        return QString();
+    return QString::number(quintptr(account_), 16) + '/' + jid_.bare();
+}
+
+void PsiDBusNotifier::activated()
+{
+    if(account_) {
+        if(event_) {
+            account_->psi()->processEvent(event_, UserAction);
+        }
+        else if(jid_.isValid()) {
+            account_->actionDefault(Jid(jid_.bare()));
+        }
+    }
+}
+
+void PsiDBusNotifier::readyToDie()
+{
+    PsiDBusNotificationQueue::instance()->release(this);
+    deleteLater();
+}
+
+//----------------------------------------------------------------------------
+// PsiDBusNotificationQueue
+//----------------------------------------------------------------------------
+
+PsiDBusNotificationQueue *PsiDBusNotificationQueue::instance()
+{
+    static PsiDBusNotificationQueue *queue = nullptr;
+    if (!queue)
+        queue = new PsiDBusNotificationQueue;
+    return queue;
+}
+
+PsiDBusNotificationQueue::PsiDBusNotificationQueue()
+    : QObject(QCoreApplication::instance())
+{
+    // one subscription for all notifications, rather than one for each
+    QDBusConnection::sessionBus().connect("org.freedesktop.Notifications",
+                          "/org/freedesktop/Notifications",
+                          "org.freedesktop.Notifications",
+                          "NotificationClosed", this, SLOT(popupClosed(uint,uint)));
+    clock_.start();
+    flushTimer_.setSingleShot(true);
+    connect(&flushTimer_, SIGNAL(timeout()), SLOT(flush()));
+    expireTimer_.setSingleShot(true);
+    connect(&expireTimer_, SIGNAL(timeout()), SLOT(expire()));
+}
+
+void PsiDBusNotificationQueue::notify(PsiDBusNotifier *notifier, const QString &title, const QString &text, const QVariantMap &hints, int lifeTime)
+{
+    const qint64 now = clock_.elapsed();
+    const QString key = notifier->key();
+
+    quint64 serial = latest_.value(key);
+    auto it = key.isEmpty() ? notifications_.end() : notifications_.find(serial);
+    if (it != notifications_.end() && now - it->updated < coalesceWindow) {
+        // the contact's notification is updated in place, the one it came from is done
+        if (it->notifier && it->notifier != notifier)
+            it->notifier->deleteLater();
+    } else {
+        serial = ++nextSerial_;
+        it = notifications_.insert(serial, Notification());
+        it->key = key;
+        if (!key.isEmpty())
+            latest_.insert(key, serial);
+    }
+    it->notifier = notifier;
+    it->title = title;
+    it->text = text;
+    it->hints = hints;
+    it->lifeTime = lifeTime;
+    it->updated = now;
+    ++it->count;
+    send(serial);
+}
+
+void PsiDBusNotificationQueue::release(PsiDBusNotifier *notifier)
+{
+    for (auto it = notifications_.begin(); it != notifications_.end();) {
+        if (it->notifier == notifier || !it->notifier) {
+            if (latest_.value(it->key) == it.key())
+                latest_.remove(it->key);
+            waiting_.removeOne(it.key());
+            it = notifications_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void PsiDBusNotificationQueue::send(quint64 serial)
+{
+    Notification &n = notifications_[serial];
+    if (n.inFlight) {
+        // goes out with the id of the notification to replace
+        n.pending = true;
+        return;
+    }
+
+    const qint64 now = clock_.elapsed();
+    while (!sent_.isEmpty() && now - sent_.first() >= 1000)
+        sent_.removeFirst();
+    if (sent_.size() >= maxPerSecond) {
+        n.pending = true;
+        if (!waiting_.contains(serial))
+            waiting_.append(serial);
+        if (!flushTimer_.isActive())
+            flushTimer_.start(int(sent_.first() + 1000 - now));
+        return;
+    }
+    sent_.append(now);
+    n.pending = false;
+    n.inFlight = true;
+
+    QString title = n.title;
+    if (n.count > 1)
+        title = tr("%1 (%2 new)").arg(title).arg(n.count);
     QDBusMessage m = createMessage("Notify");
     QVariantList args;
     args << QString(ApplicationInfo::name());
-    args << QVariant(QVariant::UInt);
+    args << QVariant(n.id);
     args << QVariant("");
-    args << QString(titleText);
-    args << QString(plainText);
+    args << title;
+    args << n.text;
     args << QStringList();
-    args << hints;
-    args << lifeTime;
+    args << n.hints;
+    args << n.lifeTime;
     m.setArguments(args);
     QDBusPendingCall call = QDBusConnection::sessionBus().asyncCall(m);
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
-
-    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
-             this, SLOT(asyncCallFinished(QDBusPendingCallWatcher*)));
-
-    lifeTime = (lifeTime < 0) ? lifeTime : qMax(minLifeTime, lifeTime);
-    if(lifeTime >= 0)
-        lifeTimer_->start(lifeTime);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this,
+            [this, serial](QDBusPendingCallWatcher *w) { replyReceived(serial, w); });
 }
 
-void PsiDBusNotifier::asyncCallFinished(QDBusPendingCallWatcher *watcher)
+void PsiDBusNotificationQueue::replyReceived(quint64 serial, QDBusPendingCallWatcher *watcher)
 {
-    QDBusMessage m = watcher->reply();
-    if(m.type() == QDBusMessage::InvalidMessage || m.arguments().isEmpty()) {
-        readyToDie();
+    watcher->deleteLater();
+    auto it = notifications_.find(serial);
+    if (it == notifications_.end())
         return;
-    }
+    it->inFlight = false;
 
-    QVariant repl = m.arguments().first();
-    if(repl.type() != QVariant::UInt || repl.toUInt() == 0) {
-        readyToDie();
+    QDBusMessage m = watcher->reply();
+    uint id = 0;
+    if (m.type() != QDBusMessage::InvalidMessage && !m.arguments().isEmpty()) {
+        QVariant repl = m.arguments().first();
+        if (repl.type() == QVariant::UInt)
+            id = repl.toUInt();
     }
-    else {
-        id_ = repl.toUInt();
+    if (id == 0) {
+        if (it->notifier)
+            it->notifier->readyToDie();
+        else
+            release(nullptr);
+        return;
     }
+
+    it->id = id;
+    const int lifeTime = (it->lifeTime < 0) ? it->lifeTime : qMax(minLifeTime, it->lifeTime);
+    it->expires = lifeTime < 0 ? -1 : clock_.elapsed() + lifeTime;
+    scheduleExpiry();
+    if (it->pending)
+        send(serial);
 }
 
-void PsiDBusNotifier::popupClosed(uint id, uint reason)
+void PsiDBusNotificationQueue::popupClosed(uint id, uint reason)
 {
-    if(id_ != 0 && id_ == id) {
-        if(reason == 2) {
-            if(account_) {
-                if(event_) {
-                    account_->psi()->processEvent(event_, UserAction);
-                }
-                else if(jid_.isValid()) {
-                    account_->actionDefault(Jid(jid_.bare()));
-                }
-            }
+    for (auto it = notifications_.begin(); it != notifications_.end(); ++it) {
+        if (it->id != id)
+            continue;
+        QPointer<PsiDBusNotifier> notifier = it->notifier;
+        if (notifier) {
+            if (reason == 2)
+                notifier->activated();
+            if (notifier)
+                notifier->readyToDie();
+        } else {
+            release(nullptr);
         }
-        readyToDie();
+        return;
     }
 }
 
-void PsiDBusNotifier::readyToDie()
+void PsiDBusNotificationQueue::flush()
 {
-    if(lifeTimer_->isActive()) {
-        lifeTimer_->stop();
+    const QList<quint64> waiting = waiting_;
+    waiting_.clear();
+    for (quint64 serial : waiting) {
+        if (notifications_.contains(serial))
+            send(serial);
     }
+}
 
-    QDBusConnection::sessionBus().disconnect("org.freedesktop.Notifications",
-                         "/org/freedesktop/Notifications",
-                         "org.freedesktop.Notifications",
-                         "NotificationClosed", this, SLOT(popupClosed(uint,uint)));
-    deleteLater();
+void PsiDBusNotificationQueue::expire()
+{
+    const qint64 now = clock_.elapsed();
+    QList<QPointer<PsiDBusNotifier>> expired;
+    for (const Notification &n : notifications_) {
+        if (n.expires >= 0 && n.expires <= now && !n.inFlight && !n.pending)
+            expired += n.notifier;
+    }
+    for (const QPointer<PsiDBusNotifier> &notifier : expired) {
+        if (notifier)
+            notifier->readyToDie();
+    }
+    release(nullptr);
+    scheduleExpiry();
 }
 
-QStringList PsiDBusNotifier::caps_ = QStringList();
+void PsiDBusNotificationQueue::scheduleExpiry()
+{
+    qint64 next = -1;
+    for (const Notification &n : notifications_) {
+        if (n.expires >= 0 && (next < 0 || n.expires < next))
+            next = n.expires;
+    }
+    if (next < 0)
+        expireTimer_.stop();
+    else
+        expireTimer_.start(int(qMax<qint64>(0, next - clock_.elapsed())));
+}
@@ -32,8 +32,13 @@
 #include "psipopupinterface.h"
 #include "xmpp_jid.h"
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QTimer>
+#include <QVariantMap>
+
 class QDBusPendingCallWatcher;
-class QTimer;
 
 class PsiDBusNotifier : public QObject, public PsiPopupInterface
 {
@@ -48,24 +53,77 @@ public:
     virtual void popup(PsiAccount* account, PopupManager::PopupType type, const Jid& j, const PsiIcon* titleIcon, const QString& titleText,
                const QPixmap* avatar, const PsiIcon* icon, const QString& text);
 
-private slots:
-    void popupClosed(uint id, uint reason);
-    void asyncCallFinished(QDBusPendingCallWatcher*);
-    void readyToDie();
-
 private:
+    friend class PsiDBusNotificationQueue;
+
     static bool checkServer();
     static QStringList capabilities();
 
+    QString key() const;
+    void activated();
+    void readyToDie();
+
 private:
     Jid jid_;
-    uint id_;
     PsiAccount *account_;
     PsiEvent::Ptr event_;
-    QTimer *lifeTimer_;
     static QStringList caps_;
 };
 
+/**
+ * Sends the notifications of all PsiDBusNotifiers without waiting for the
+ * session bus. A popup for a contact or room whose notification was updated
+ * a moment ago replaces that notification instead of opening another one,
+ * and no more than a few notifications go out per second, those over the
+ * cap wait and collapse meanwhile.
+ */
+class PsiDBusNotificationQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    static PsiDBusNotificationQueue *instance();
+
+    void notify(PsiDBusNotifier *notifier, const QString &title, const QString &text, const QVariantMap &hints, int lifeTime);
+    void release(PsiDBusNotifier *notifier);
+
+private slots:
+    void popupClosed(uint id, uint reason);
+    void flush();
+    void expire();
+
+private:
+    struct Notification {
+        QPointer<PsiDBusNotifier> notifier;
+        QString key;
+        QString title;
+        QString text;
+        QVariantMap hints;
+        int lifeTime = 0;
+        uint id = 0;            // given by the server, 0 until it answered
+        bool inFlight = false;
+        bool pending = false;   // an update waits for the answer or the cap
+        int count = 0;          // popups collapsed into it
+        qint64 updated = 0;     // msecs on the clock
+        qint64 expires = -1;
+    };
+
+    PsiDBusNotificationQueue();
+
+    void send(quint64 serial);
+    void replyReceived(quint64 serial, QDBusPendingCallWatcher *watcher);
+    void scheduleExpiry();
+
+    QHash<quint64, Notification> notifications_; // by serial
+    QHash<QString, quint64> latest_;              // serial by key
+    QList<quint64> waiting_;                      // for the cap, oldest first
+    QList<qint64> sent_;                          // times of the sends within the last second
+    quint64 nextSerial_ = 0;
+    QElapsedTimer clock_;
+    QTimer flushTimer_;
+    QTimer expireTimer_;
+};
+
 class PsiDBusNotifierPlugin : public QObject, public PsiPopupPluginInterface
 {
     Q_OBJECT
@@ -25,6 +25,7 @@
 #include "dummystream.h"
 #include "filetransfer.h"
 #include "jingle.h"
+#include "memoryaccounting.h"
 #include "psiaccount.h"
 #include "psicon.h"
 #include "psicontactlist.h"
@@ -34,7 +35,6 @@
 #include <QCoreApplication>
 #include <QDomElement>
 #include <QList>
-#include <QSet>
 #include <QTextStream>
 
 using namespace XMLHelper;
@@ -813,6 +813,12 @@ EventQueue::EventQueue(PsiAccount *account)
 {
     account_ = account;
     psi_ = account_->psi();
+
+    MemoryAccounting::add(this, "event queue", [this]() {
+        MemoryAccounting::Usage u;
+        u.entries = list_.count();
+        return u;
+    });
 }
 
 EventQueue::EventQueue(const EventQueue &from)
@@ -831,6 +837,8 @@ EventQueue::~EventQueue()
     setEnabled(false);
     qDeleteAll(list_);
     list_.clear();
+    byJid_.clear();
+    byFrom_.clear();
 }
 
 bool EventQueue::enabled() const
@@ -845,8 +853,10 @@ void EventQueue::setEnabled(bool enabled)
 
 EventQueue &EventQueue::operator= (const EventQueue &from)
 {
-    while(!list_.isEmpty())
-        delete list_.takeFirst();
+    qDeleteAll(list_);
+    list_.clear();
+    byJid_.clear();
+    byFrom_.clear();
 
     psi_ = from.psi_;
     account_ = from.account_;
@@ -859,6 +869,51 @@ EventQueue &EventQueue::operator= (const EventQueue &from)
     return *this;
 }
 
+// inserts after all events with higher or equal priority
+void EventQueue::insertByPriority(QList<EventItem*> &list, EventItem *i)
+{
+    const int prior = i->event()->priority();
+    for (int n = 0; n < list.size(); ++n) {
+        if (list.at(n)->event()->priority() < prior) {
+            list.insert(n, i);
+            return;
+        }
+    }
+    list.append(i);
+}
+
+void EventQueue::addToIndex(EventItem *i)
+{
+    insertByPriority(byJid_[JidKey(i->event()->jid())], i);
+    insertByPriority(byFrom_[JidKey(i->event()->from())], i);
+}
+
+void EventQueue::removeFromIndex(EventItem *i)
+{
+    const JidKey jid(i->event()->jid());
+    Index::Iterator it = byJid_.find(jid);
+    if (it != byJid_.end()) {
+        it->removeOne(i);
+        if (it->isEmpty())
+            byJid_.erase(it);
+    }
+
+    const JidKey from(i->event()->from());
+    it = byFrom_.find(from);
+    if (it != byFrom_.end()) {
+        it->removeOne(i);
+        if (it->isEmpty())
+            byFrom_.erase(it);
+    }
+}
+
+void EventQueue::removeItem(EventItem *i)
+{
+    removeFromIndex(i);
+    list_.removeOne(i);
+    delete i;
+}
+
 int EventQueue::nextId() const
 {
     if (list_.isEmpty())
@@ -877,17 +932,17 @@ int EventQueue::count() const
 
 int EventQueue::contactCount() const
 {
-    QSet<QString> set;
-    foreach(EventItem *i, list_) {
-        set.insert(i->event()->jid().bare());
-    }
-    return set.size();
+    return byJid_.size();
 }
 
 int EventQueue::count(const Jid &j, bool compareRes) const
 {
+    const QList<EventItem*> items = byJid_.value(JidKey(j));
+    if (!compareRes)
+        return items.count();
+
     int total = 0;
-    foreach(EventItem *i, list_) {
+    foreach(EventItem *i, items) {
         Jid j2(i->event()->jid());
         if(j.compare(j2, compareRes))
             ++total;
@@ -898,22 +953,8 @@ int EventQueue::count(const Jid &j, bool compareRes) const
 void EventQueue::enqueue(const PsiEvent::Ptr &e)
 {
     EventItem *i = new EventItem(e);
-
-    int prior  = e->priority();
-    bool found = false;
-
-    // skip all with higher or equal priority
-    foreach(EventItem *ei, list_) {
-        if (ei && ei->event()->priority() < prior ) {
-            list_.insert(list_.indexOf(ei), i);
-            found = true;
-            break;
-        }
-    }
-
-    // everything else
-    if ( !found )
-        list_.append(i);
+    insertByPriority(list_, i);
+    addToIndex(i);
 
     emit queueChanged();
 }
@@ -923,11 +964,10 @@ void EventQueue::dequeue(const PsiEvent::Ptr &e)
     if ( !e )
         return;
 
-    foreach(EventItem *i, list_) {
+    foreach(EventItem *i, byJid_.value(JidKey(e->jid()))) {
         if ( e == i->event() ) {
-            list_.removeAll(i);
+            removeItem(i);
             emit queueChanged();
-            delete i;
             return;
         }
     }
@@ -935,13 +975,12 @@ void EventQueue::dequeue(const PsiEvent::Ptr &e)
 
 PsiEvent::Ptr EventQueue::dequeue(const Jid &j, bool compareRes)
 {
-    foreach(EventItem *i, list_) {
+    foreach(EventItem *i, byJid_.value(JidKey(j))) {
         PsiEvent::Ptr e = i->event();
         Jid j2(e->jid());
         if(j.compare(j2, compareRes)) {
-            list_.removeAll(i);
+            removeItem(i);
             emit queueChanged();
-            delete i;
             return e;
         }
     }
@@ -951,7 +990,7 @@ PsiEvent::Ptr EventQueue::dequeue(const Jid &j, bool compareRes)
 
 PsiEvent::Ptr EventQueue::peek(const Jid &j, bool compareRes) const
 {
-    foreach(EventItem *i, list_) {
+    foreach(EventItem *i, byJid_.value(JidKey(j))) {
         PsiEvent::Ptr e = i->event();
         Jid j2(e->jid());
         if(j.compare(j2, compareRes)) {
@@ -971,9 +1010,8 @@ PsiEvent::Ptr EventQueue::dequeueNext()
     if(!i)
         return PsiEvent::Ptr();
     PsiEvent::Ptr e = i->event();
-    list_.removeAll(i);
+    removeItem(i);
     emit queueChanged();
-    delete i;
     return e;
 }
 
@@ -990,7 +1028,7 @@ PsiEvent::Ptr EventQueue::peekNext() const
 
 PsiEvent::Ptr EventQueue::peekFirstChat(const Jid &j, bool compareRes) const
 {
-    foreach(EventItem *i, list_) {
+    foreach(EventItem *i, byFrom_.value(JidKey(j))) {
         PsiEvent::Ptr e = i->event();
         if(e->type() == PsiEvent::Message) {
             MessageEvent::Ptr me = e.staticCast<MessageEvent>();
@@ -1012,8 +1050,8 @@ void EventQueue::extractChats(QList<PsiEvent::Ptr> *el, const Jid &j, bool compa
 {
     bool changed = false;
 
-    for(QList<EventItem*>::Iterator it = list_.begin(); it != list_.end();) {
-        PsiEvent::Ptr e = (*it)->event();
+    foreach(EventItem *i, byFrom_.value(JidKey(j))) {
+        PsiEvent::Ptr e = i->event();
         bool extract = false;
         if(e->type() == PsiEvent::Message) {
             MessageEvent::Ptr me = e.staticCast<MessageEvent>();
@@ -1027,14 +1065,9 @@ void EventQueue::extractChats(QList<PsiEvent::Ptr> *el, const Jid &j, bool compa
         }
 
         if (extract && removeEvents) {
-            EventItem* ei = *it;
-            it = list_.erase(it);
-            delete ei;
+            removeItem(i);
             changed = true;
-            continue;
         }
-
-        ++it;
     }
 
     if ( changed )
@@ -1043,11 +1076,8 @@ void EventQueue::extractChats(QList<PsiEvent::Ptr> *el, const Jid &j, bool compa
 
 void EventQueue::extractByJid(QList<PsiEvent::Ptr> *list, const XMPP::Jid &jid)
 {
-    for (QList<EventItem*>::Iterator it = list_.begin(); it != list_.end(); it++) {
-        PsiEvent::Ptr e = (*it)->event();
-        if (jid.compare(e->from(), false)) {
-            list->append(e);
-        }
+    foreach(EventItem *i, byFrom_.value(JidKey(jid))) {
+        list->append(i->event());
     }
 }
 
@@ -1068,6 +1098,7 @@ void EventQueue::extractByType(int type, QList<PsiEvent::Ptr> *el)
             el->append(e);
             EventItem* ei = *it;
             it = list_.erase(it);
+            removeFromIndex(ei);
             delete ei;
             changed = true;
             continue;
@@ -1089,11 +1120,10 @@ void EventQueue::printContent() const
 
 void EventQueue::clear()
 {
-    while(!list_.isEmpty())
-    {
-        EventItem *i = list_.takeFirst();
-        delete i;
-    }
+    qDeleteAll(list_);
+    list_.clear();
+    byJid_.clear();
+    byFrom_.clear();
 
     emit queueChanged();
 }
@@ -1103,17 +1133,12 @@ void EventQueue::clear(const Jid &j, bool compareRes)
 {
     bool changed = false;
 
-    for(QList<EventItem*>::Iterator it = list_.begin(); it != list_.end();) {
-        PsiEvent::Ptr e = (*it)->event();
-        Jid j2(e->jid());
+    foreach(EventItem *i, byJid_.value(JidKey(j))) {
+        Jid j2(i->event()->jid());
         if(j.compare(j2, compareRes)) {
-            EventItem* ei = *it;
-            it = list_.erase(it);
-            delete ei;
+            removeItem(i);
             changed = true;
         }
-        else
-            ++it;
     }
 
     if ( changed )
@@ -1183,7 +1208,7 @@ QList<EventQueue::PsiEventId> EventQueue::eventsFor(const XMPP::Jid& jid, bool c
 {
     QList<PsiEventId> result;
 
-    foreach(EventItem* i, list_) {
+    foreach(EventItem* i, byFrom_.value(JidKey(jid))) {
         if (i->event()->from().compare(jid, compareRes))
             result << QPair<int, PsiEvent::Ptr>(i->id(), i->event());
     }
@@ -20,6 +20,7 @@
 #ifndef PSIEVENT_H
 #define PSIEVENT_H
 
+#include "jidkey.h"
 #include "xmpp_jid.h"
 #include "xmpp_message.h"
 #include "xmpp_rosterx.h"
@@ -28,6 +29,7 @@
 #include <QDateTime>
 #include <QDomDocument>
 #include <QDomElement>
+#include <QHash>
 #include <QList>
 #include <QObject>
 #include <QPointer>
@@ -423,7 +425,17 @@ signals:
     void queueChanged();
 
 private:
+    typedef QHash<JidKey, QList<EventItem*> > Index;
+
+    static void insertByPriority(QList<EventItem*> &list, EventItem *i);
+    void addToIndex(EventItem *i);
+    void removeFromIndex(EventItem *i);
+    void removeItem(EventItem *i);
+
     QList<EventItem*> list_;
+    // bare jid -> events in queue order, by event jid() and by sender
+    Index byJid_;
+    Index byFrom_;
     PsiCon* psi_;
     PsiAccount* account_;
     bool enabled_;
@@ -22,6 +22,9 @@
 #include "anim.h"
 #include "applicationinfo.h"
 #include "common.h"
+#include "emoticonmatcher.h"
+#include "memoryaccounting.h"
+#include "pixmapcache.h"
 #include "psievent.h"
 #include "psioptions.h"
 #include "userlist.h"
@@ -91,6 +94,8 @@ public:
     ClientIconMap client2icon;
     QString cur_system, cur_status, cur_moods, cur_clients, cur_activity, cur_affiliations;
     QStringList cur_emoticons;
+    EmoticonMatcher emoticonMatcher;
+    bool emoticonMatcherDirty = true;
     QMap<QString, QString> cur_service_status;
     QMap<QString, QString> cur_custom_status;
     struct StatusIconsets {
@@ -102,6 +107,9 @@ public:
         QList<IconsetItem> list;
         QList<IconsetItem> customList;
     } status_icons;
+    // jid2icon() results by icon name and bare jid, misses too. roster rows ask
+    // for the same few on every repaint, and the rules don't change in between
+    QHash<QString, PsiIcon *> jidIcons;
 
     Private(PsiIconset *_psi) {
         psi = _psi;
@@ -179,6 +187,21 @@ public:
     }
 
     PsiIcon *jid2icon(const Jid &jid, const QString &iconName)
+    {
+        const QString key = iconName + QLatin1Char('\n') + jid.bare();
+        auto          it  = jidIcons.constFind(key);
+        if (it != jidIcons.constEnd()) {
+            return it.value();
+        }
+        if (jidIcons.size() > 20000) {
+            jidIcons.clear(); // a long session with lots of mucs. start over
+        }
+        PsiIcon *icon = resolveJidIcon(jid, iconName);
+        jidIcons.insert(key, icon);
+        return icon;
+    }
+
+    PsiIcon *resolveJidIcon(const Jid &jid, const QString &iconName)
     {
         // first level -- global default icon
         PsiIcon *icon = const_cast<PsiIcon *>(IconsetFactory::iconPtr(iconName));
@@ -341,9 +364,25 @@ PsiIconset::PsiIconset()
     : QObject(QCoreApplication::instance())
 {
     d = new Private(this);
+    Iconset::setCacheDir(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/iconsets");
     d->status_icons.useServicesIcons = PsiOptions::instance()->getOption("options.ui.contactlist.use-transport-icons").toBool();
     connect(PsiOptions::instance(), SIGNAL(optionChanged(const QString&)), SLOT(optionChanged(const QString&)));
     connect(PsiOptions::instance(), SIGNAL(destroyed()), SLOT(reset()));
+
+    MemoryAccounting::add(this, "iconsets", [this]() {
+        QList<const Iconset *> sets { &system(), &moods, &activities, &clients, &affiliations };
+        for (const Iconset *is : roster)
+            sets += is;
+        for (const Iconset *is : emoticons)
+            sets += is;
+        MemoryAccounting::Usage u;
+        u.bytes = 0;
+        for (const Iconset *is : sets) {
+            u.bytes += is->byteCount();
+            u.entries += is->count();
+        }
+        return u;
+    });
 }
 
 PsiIconset::~PsiIconset()
@@ -375,6 +414,8 @@ bool PsiIconset::loadSystem()
         d->system.addToFactory();
 
         d->cur_system = cur_system;
+        d->jidIcons.clear();
+        PixmapCache::invalidate("system");
     }
 
     return ok;
@@ -383,6 +424,7 @@ bool PsiIconset::loadSystem()
 bool PsiIconset::loadRoster()
 {
     // load roster
+    d->jidIcons.clear();
     qDeleteAll(roster);
     roster.clear();
 
@@ -444,10 +486,25 @@ void PsiIconset::loadEmoticons()
         emoticons = d->emoticons();
 
         d->cur_emoticons = cur_emoticons;
+        d->emoticonMatcherDirty = true;
+        PixmapCache::invalidate("emoticons");
         emit emoticonsChanged();
     }
 }
 
+/**
+ * Returns matcher for the texts of all loaded emoticons, rebuilt lazily
+ * after the emoticon iconsets change.
+ */
+const EmoticonMatcher &PsiIconset::emoticonMatcher()
+{
+    if (d->emoticonMatcherDirty) {
+        d->emoticonMatcher.build(emoticons);
+        d->emoticonMatcherDirty = false;
+    }
+    return d->emoticonMatcher;
+}
+
 bool PsiIconset::loadMoods()
 {
     bool ok = true;
@@ -562,6 +619,7 @@ bool PsiIconset::loadAffiliations()
 
 void PsiIconset::loadStatusIconDefinitions()
 {
+    d->jidIcons.clear();
     d->status_icons.list.clear();
     d->status_icons.customList.clear();
     foreach(const QVariant& serviceV, PsiOptions::instance()->mapKeyList("options.iconsets.service-status")) {
@@ -612,12 +670,17 @@ void PsiIconset::loadStatusIconDefinitions()
     }
 }
 
-bool PsiIconset::loadAll()
+/**
+ * Loads all iconsets. Emoticons are only needed by chats, so loading them
+ * can be postponed with \a withEmoticons and done with loadEmoticons().
+ */
+bool PsiIconset::loadAll(bool withEmoticons)
 {
     if (!loadSystem() || !loadRoster())
         return false;
 
-    loadEmoticons();
+    if (withEmoticons)
+        loadEmoticons();
     loadMoods();
     loadActivity();
     loadClients();
@@ -648,6 +711,7 @@ void PsiIconset::optionChanged(const QString& option)
     }
     else if (option == "options.ui.contactlist.use-transport-icons") {
         d->status_icons.useServicesIcons = PsiOptions::instance()->getOption("options.ui.contactlist.use-transport-icons").toBool();
+        d->jidIcons.clear();
     }
 
     // currently we rely on PsiCon calling reloadRoster() when
@@ -681,6 +745,9 @@ void PsiIconset::reloadRoster()
         roster.insert(cur_status, oldDef);
         delete newDef;
         d->cur_status = cur_status;
+        d->jidIcons.clear();
+        PixmapCache::invalidate("roster");
+        emit rosterIconsChanged();
     }
 
     QMap<QString, QString> cur_service_status;
@@ -759,6 +826,9 @@ void PsiIconset::reloadRoster()
 
         d->cur_service_status = cur_service_status;
         d->cur_custom_status  = cur_custom_status;
+        loadStatusIconDefinitions(); // the rules point to these iconsets
+        PixmapCache::invalidate("roster");
+        emit rosterIconsChanged();
     }
 }
 
@@ -25,6 +25,7 @@
 
 #include <QMap>
 
+class EmoticonMatcher;
 class UserListItem;
 
 namespace XMPP {
@@ -40,7 +41,7 @@ public:
 
     bool loadSystem();
     void reloadRoster();
-    bool loadAll();
+    bool loadAll(bool withEmoticons = true);
 
     QHash<QString, Iconset*> roster;
     QList<Iconset*> emoticons;
@@ -54,6 +55,8 @@ public:
 
     PsiIcon *event2icon(const PsiEvent::Ptr &e);
 
+    const EmoticonMatcher &emoticonMatcher();
+
     // these two can possibly fail (and return 0)
     PsiIcon *statusPtr(int);
     PsiIcon *statusPtr(const XMPP::Status &);
@@ -84,9 +87,11 @@ signals:
     void emoticonsChanged();
     void systemIconsSizeChanged(int);
     void rosterIconsSizeChanged(int);
+    void rosterIconsChanged();
 
 public slots:
     static void reset();
+    void loadEmoticons();
 
 private slots:
     void optionChanged(const QString& option);
@@ -101,7 +106,6 @@ private:
     static PsiIconset* instance_;
 
     bool loadRoster();
-    void loadEmoticons();
     bool loadMoods();
     bool loadActivity();
     bool loadClients();
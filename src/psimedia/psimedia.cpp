@@ -19,6 +19,12 @@
 #include "psimedia_p.h"
 
 #include <QMetaMethod>
+#ifdef QT_GUI_LIB
+#ifndef QT_NO_OPENGL
+#include <QOpenGLContext>
+#include <QOpenGLWidget>
+#endif
+#endif
 
 namespace PsiMedia {
 static AudioParams importAudioParams(const PAudioParams &pp)
@@ -265,7 +271,46 @@ bool Device::isDefault() const { return d->isDefault; }
 // VideoWidget
 //----------------------------------------------------------------------------
 
-VideoWidget::VideoWidget(QWidget *parent) : QWidget(parent) { d = new VideoWidgetPrivate(this); }
+#ifndef QT_NO_OPENGL
+// the provider paints frames with QPainter. on an OpenGL surface the frame is
+//   uploaded as a texture and scaled by the GPU instead of by the raster engine
+class VideoSurface : public QOpenGLWidget {
+public:
+    VideoSurface(VideoWidgetPrivate *_d, QWidget *parent) : QOpenGLWidget(parent), d(_d) {}
+
+    static bool isAvailable()
+    {
+        static int available = -1;
+        if (available == -1) {
+            QOpenGLContext context;
+            available = (qgetenv("PSI_VIDEO_NO_OPENGL").isEmpty() && context.create()) ? 1 : 0;
+        }
+        return available == 1;
+    }
+
+protected:
+    virtual void paintGL()
+    {
+        QPainter p(this);
+        p.fillRect(rect(), Qt::black);
+        emit d->paintEvent(&p);
+    }
+
+private:
+    VideoWidgetPrivate *d;
+};
+#endif
+
+VideoWidget::VideoWidget(QWidget *parent) : QWidget(parent)
+{
+    d = new VideoWidgetPrivate(this);
+#ifndef QT_NO_OPENGL
+    if (VideoSurface::isAvailable()) {
+        d->surface = new VideoSurface(d, this);
+        d->surface->setGeometry(rect());
+    }
+#endif
+}
 
 VideoWidget::~VideoWidget() { delete d; }
 
@@ -274,6 +319,8 @@ QSize VideoWidget::sizeHint() const { return d->videoSize; }
 void VideoWidget::paintEvent(QPaintEvent *event)
 {
     Q_UNUSED(event);
+    if (d->surface != this)
+        return;
     QPainter p(this);
     emit     d->paintEvent(&p);
 }
@@ -281,6 +328,8 @@ void VideoWidget::paintEvent(QPaintEvent *event)
 void VideoWidget::resizeEvent(QResizeEvent *event)
 {
     Q_UNUSED(event);
+    if (d->surface != this)
+        d->surface->setGeometry(rect());
     emit d->resized(size());
 }
 #endif
@@ -503,6 +552,41 @@ void RtpChannel::write(const RtpPacket &rtp)
     }
 }
 
+int RtpChannel::readAll(QVector<RtpRawPacket> &packets)
+{
+    if (!d->c)
+        return 0;
+
+    int count = 0;
+    while (d->c->packetsAvailable() > 0) {
+        PRtpPacket pp = d->c->read();
+        packets.resize(packets.size() + 1);
+        RtpRawPacket &p = packets.last();
+        p.rawValue      = pp.rawValue;
+        p.portOffset    = pp.portOffset;
+        ++count;
+    }
+    return count;
+}
+
+void RtpChannel::write(const QVector<RtpRawPacket> &packets)
+{
+    if (!d->c || packets.isEmpty())
+        return;
+
+    if (!d->enabled) {
+        d->enabled = true;
+        d->c->setEnabled(true);
+    }
+
+    PRtpPacket pp;
+    for (const RtpRawPacket &p : packets) {
+        pp.rawValue   = p.rawValue;
+        pp.portOffset = p.portOffset;
+        d->c->write(pp);
+    }
+}
+
 void RtpChannel::connectNotify(const QMetaMethod &signal)
 {
     int oldtotal = d->readyReadListeners;
@@ -23,6 +23,7 @@
 #include <QSharedDataPointer>
 #include <QSize>
 #include <QStringList>
+#include <QVector>
 #ifdef QT_GUI_LIB
 #include <QWidget>
 #endif
@@ -190,6 +191,14 @@ private:
     QSharedDataPointer<Private> d;
 };
 
+// plain packet for bulk transfers. unlike RtpPacket it doesn't allocate anything
+// besides the (shared) raw value
+class RtpRawPacket {
+public:
+    QByteArray rawValue;
+    int        portOffset = 0;
+};
+
 // may drop packets if not read fast enough.
 // may queue no packets at all, if nobody is listening to readyRead.
 class RtpChannel : public QObject {
@@ -200,6 +209,11 @@ public:
     RtpPacket read();
     void      write(const RtpPacket &rtp);
 
+    // bulk versions of read() and write(). readAll() appends all the available packets
+    // and returns their count. reuse the vector to avoid reallocations
+    int  readAll(QVector<RtpRawPacket> &packets);
+    void write(const QVector<RtpRawPacket> &packets);
+
 signals:
     void readyRead();
     void packetsWritten(int count);
@@ -458,6 +472,8 @@ private:
 };
 }; // namespace PsiMedia
 
+Q_DECLARE_TYPEINFO(PsiMedia::RtpRawPacket, Q_MOVABLE_TYPE);
+
 Q_DECLARE_METATYPE(PsiMedia::AudioParams)
 Q_DECLARE_METATYPE(PsiMedia::VideoParams)
 
@@ -39,11 +39,14 @@ public:
     VideoWidget *q;
     QSize        videoSize;
 
-    VideoWidgetPrivate(VideoWidget *_q) : QObject(_q), q(_q) {}
+    // the widget the provider paints on, either q or a child that covers it
+    QWidget *surface;
+
+    VideoWidgetPrivate(VideoWidget *_q) : QObject(_q), q(_q), surface(_q) {}
 
     virtual QObject *qobject() { return this; }
 
-    virtual QWidget *qwidget() { return q; }
+    virtual QWidget *qwidget() { return surface; }
 
     virtual void setVideoSize(const QSize &size)
     {
@@ -21,6 +21,8 @@
 
 #include "applicationinfo.h"
 #include "common.h"
+#include "idlescheduler.h"
+#include "optionstreewriter.h"
 #ifdef PSI_PLUGINS
 #    include "pluginmanager.h"
 #endif
@@ -31,8 +33,10 @@
 #include "xmpp_task.h"
 #include "xmpp_xmlcommon.h"
 
+#include <QBuffer>
 #include <QCoreApplication>
-#include <QTimer>
+#include <QSaveFile>
+#include <QtConcurrent>
 
 using namespace XMPP;
 
@@ -277,14 +281,22 @@ bool PsiOptions::save(QString file)
     return saveOptions(file, "options", ApplicationInfo::optionsNS(), ApplicationInfo::version());
 }
 
+static bool writeOptionsFile(const QString &fileName, const QByteArray &data)
+{
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size()) {
+        return false;
+    }
+    return f.commit();
+}
+
 PsiOptions::PsiOptions()
     : OptionsTree()
-    , autoSaveTimer_(nullptr)
+    , autoSaveWatcher_(nullptr)
+    , autoSavePending_(false)
 {
-    autoSaveTimer_ = new QTimer(this);
-    autoSaveTimer_->setSingleShot(true);
-    autoSaveTimer_->setInterval(1000);
-    connect(autoSaveTimer_, SIGNAL(timeout()), SLOT(saveToAutoFile()));
+    autoSaveWatcher_ = new QFutureWatcher<bool>(this);
+    connect(autoSaveWatcher_, SIGNAL(finished()), SLOT(autoSaveFinished()));
 
     setParent(QCoreApplication::instance());
     autoSave(false);
@@ -306,8 +318,9 @@ PsiOptions::~PsiOptions()
     // since we queue connection to saveToAutoFile, so if some option was saved prior
     // to program termination, the PsiOptions is never given the chance to save
     // the changed option
+    autoSaveWatcher_->waitForFinished();
     if (!autoFile_.isEmpty()) {
-        saveToAutoFile();
+        save(autoFile_);
     }
 }
 
@@ -320,22 +333,56 @@ PsiOptions::~PsiOptions()
 void PsiOptions::autoSave(bool autoSave, QString autoFile)
 {
     if (autoSave) {
-        connect(this, SIGNAL(optionChanged(const QString&)), autoSaveTimer_, SLOT(start()));
+        connect(this, SIGNAL(optionChanged(const QString&)), SLOT(scheduleAutoSave()), Qt::UniqueConnection);
         autoFile_ = autoFile;
     }
     else {
-        disconnect(this, SIGNAL(optionChanged(const QString&)), autoSaveTimer_, SLOT(start()));
+        disconnect(this, SIGNAL(optionChanged(const QString&)), this, SLOT(scheduleAutoSave()));
         autoFile = "";
     }
 }
 
+// a second after the last change, once the user pauses; within ten seconds in any case
+void PsiOptions::scheduleAutoSave()
+{
+    IdleScheduler::instance()->schedule(this, "autosave", [this]() { saveToAutoFile(); },
+                                        IdleScheduler::Normal, 10000, 1000);
+}
+
 /**
- * Saves to the previously set file, if automatic saving is enabled
+ * Saves to the previously set file, if automatic saving is enabled.
+ * The tree is serialized right away and the file is written in background,
+ * changes made meanwhile are saved by one more write once it finishes.
  */
 void PsiOptions::saveToAutoFile()
 {
-    if (!autoFile_.isEmpty()) {
-        save(autoFile_);
+    if (autoFile_.isEmpty()) {
+        return;
+    }
+    if (autoSaveWatcher_->isRunning()) {
+        autoSavePending_ = true;
+        return;
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    OptionsTreeWriter writer(this);
+    writer.setName("options");
+    writer.setNameSpace(ApplicationInfo::optionsNS());
+    writer.setVersion(ApplicationInfo::version());
+    writer.write(&buffer);
+
+    autoSaveWatcher_->setFuture(QtConcurrent::run(writeOptionsFile, autoFile_, buffer.data()));
+}
+
+void PsiOptions::autoSaveFinished()
+{
+    if (!autoSaveWatcher_->result()) {
+        qWarning("Failed to save options to %s", qPrintable(autoFile_));
+    }
+    if (autoSavePending_) {
+        autoSavePending_ = false;
+        saveToAutoFile();
     }
 }
 
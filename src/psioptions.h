@@ -22,11 +22,12 @@
 
 #include "optionstree.h"
 
+#include <QFutureWatcher>
+
 // Some hard coded options
 #define MINIMUM_OPACITY 10
 
 class QString;
-class QTimer;
 
 namespace XMPP {
     class Client;
@@ -53,12 +54,15 @@ public:
     PsiOptions();
 
 private slots:
+    void scheduleAutoSave();
     void saveToAutoFile();
+    void autoSaveFinished();
     void getOptionsStorage_finished();
 
 private:
     QString autoFile_;
-    QTimer *autoSaveTimer_;
+    QFutureWatcher<bool> *autoSaveWatcher_;
+    bool autoSavePending_;
     static PsiOptions* instance_;
     static PsiOptions* defaults_;
 };
@@ -11,6 +11,7 @@
 #include <QHBoxLayout>
 #include <QMessageBox>
 #include <QTextDocument>
+#include <QTimer>
 #include <QVBoxLayout>
 #include <QVariant>
 
@@ -118,9 +119,14 @@ PsiOptionsEditor::PsiOptionsEditor(QWidget *parent)
     filterLe->setProperty("isOption", false);
     filterLe->setToolTip(tr("Options filter"));
     layout->addWidget(filterLe);
-    connect(filterLe, &QLineEdit::textChanged, this, [this, filterLe](){
+    // filter once typing pauses, not over all the options on every key
+    auto filterTimer = new QTimer(this);
+    filterTimer->setSingleShot(true);
+    filterTimer->setInterval(200);
+    connect(filterTimer, &QTimer::timeout, this, [this, filterLe](){
         tpm_->setFilterWildcard(filterLe->text());
     });
+    connect(filterLe, &QLineEdit::textChanged, filterTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
 
     tv_ = new QTreeView(this);
     tv_->setModel(tpm_);
@@ -161,9 +167,10 @@ PsiOptionsEditor::PsiOptionsEditor(QWidget *parent)
     cb_->setText(tr("Flat"));
     cb_->setToolTip(tr("Display all options as a flat list."));
     cb_->setProperty("isOption", false);
-    connect(cb_, &QCheckBox::toggled, tm_, [this, filterLe](bool b){
+    connect(cb_, &QCheckBox::toggled, tm_, [this, filterLe, filterTimer](bool b){
         if (tm_->setFlat(b)) {
             if (!b) {
+                filterTimer->stop();
                 tpm_->setFilterWildcard(QString());
             }
             filterLe->setVisible(b);
@@ -55,6 +55,30 @@ static int MaxPopups = 5;
  */
 static QList<PsiPopup *> *psiPopupList = nullptr;
 
+/**
+ * Hidden popup windows kept for reuse, so bursts of events
+ * don't create and destroy a top-level window each.
+ */
+static QList<FancyPopup *> *fancyPopupPool = nullptr;
+
+static FancyPopup *takePooledPopup()
+{
+    if ( !fancyPopupPool || fancyPopupPool->isEmpty() )
+        return nullptr;
+    return fancyPopupPool->takeLast();
+}
+
+static void recyclePopup(FancyPopup *popup)
+{
+    if ( !fancyPopupPool )
+        fancyPopupPool = new QList<FancyPopup *>();
+
+    if ( fancyPopupPool->count() < MaxPopups && !fancyPopupPool->contains(popup) )
+        fancyPopupPool->append(popup);
+    else
+        popup->deleteLater();
+}
+
 //----------------------------------------------------------------------------
 // PsiPopup::Private
 //----------------------------------------------------------------------------
@@ -71,6 +95,7 @@ public:
 
 private slots:
     void popupDestroyed();
+    void popupReleased();
     void popupClicked(int);
 
 public:
@@ -105,8 +130,11 @@ PsiPopup::Private::~Private()
     if ( psiPopupList )
         psiPopupList->removeAll(psiPopup);
 
-    if ( popup )
-        delete popup;
+    if ( popup ) {
+        popup->disconnect(this);
+        popup->hide();
+        recyclePopup(popup);
+    }
     if ( titleIcon )
         delete titleIcon;
     popup = nullptr;
@@ -137,8 +165,15 @@ void PsiPopup::Private::init(const PsiIcon *_titleIcon, const QString& titleText
     FancyPopup::setHideTimeout(psiPopup->duration());
     FancyPopup::setBorderColor(ColorOpt::instance()->color("options.ui.look.colors.passive-popup.border"));
 
-    popup = new FancyPopup(titleText, titleIcon, lastPopup, false);
+    popup = takePooledPopup();
+    if ( popup )
+        popup->reset(titleText, titleIcon, lastPopup, false);
+    else {
+        popup = new FancyPopup(titleText, titleIcon, lastPopup, false);
+        popup->setRecyclable(true);
+    }
     connect(popup, SIGNAL(clicked(int)), SLOT(popupClicked(int)));
+    connect(popup, SIGNAL(released()), SLOT(popupReleased()));
     connect(popup, SIGNAL(destroyed()), SLOT(popupDestroyed()));
 
     // create id
@@ -153,6 +188,14 @@ void PsiPopup::Private::popupDestroyed()
     psiPopup->deleteLater();
 }
 
+void PsiPopup::Private::popupReleased()
+{
+    popup->disconnect(this);
+    recyclePopup(popup);
+    popup = nullptr;
+    psiPopup->deleteLater();
+}
+
 void PsiPopup::Private::popupClicked(int button)
 {
     if ( button == int(Qt::LeftButton) ) {
@@ -169,7 +212,7 @@ void PsiPopup::Private::popupClicked(int button)
         event->account()->psi()->removeEvent(event);
     }
 
-    popup->deleteLater();
+    popup->hide();
 }
 
 QBoxLayout *PsiPopup::Private::createContactInfo(const QPixmap *avatar, const PsiIcon *icon, const QString& text)
@@ -435,6 +478,12 @@ FancyPopup *PsiPopup::popup() const
 
 void PsiPopup::deleteAll()
 {
+    if ( fancyPopupPool ) {
+        qDeleteAll(*fancyPopupPool);
+        delete fancyPopupPool;
+        fancyPopupPool = nullptr;
+    }
+
     if ( !psiPopupList )
         return;
 
@@ -34,10 +34,12 @@
 #include "widgets/actionlineedit.h"
 #include "widgets/iconaction.h"
 
+#include <QHash>
 #include <QKeyEvent>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QSet>
 #include <QSortFilterProxyModel>
 #include <QStackedWidget>
 #include <QVBoxLayout>
@@ -68,25 +70,69 @@ public:
         setSortLocaleAware(true);
     }
 
+    void setSourceModel(QAbstractItemModel* model)
+    {
+        if (sourceModel()) {
+            // the base class has its own connections to the old model
+            disconnect(sourceModel(), nullptr, this, SLOT(forgetRows(QModelIndex, QModelIndex)));
+            disconnect(sourceModel(), nullptr, this, SLOT(forgetAll()));
+        }
+        QSortFilterProxyModel::setSourceModel(model);
+        // a changed row is searched again, anything bigger starts over
+        connect(model, SIGNAL(dataChanged(QModelIndex, QModelIndex)), SLOT(forgetRows(QModelIndex, QModelIndex)));
+        connect(model, SIGNAL(rowsRemoved(QModelIndex, int, int)), SLOT(forgetAll()));
+        connect(model, SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)), SLOT(forgetAll()));
+        connect(model, SIGNAL(layoutChanged()), SLOT(forgetAll()));
+        connect(model, SIGNAL(modelReset()), SLOT(forgetAll()));
+        forgetAll();
+    }
+
+    /**
+     * Shows the rows whose name, jid or group contains \a text. When the
+     * text only got longer, rows which didn't match before aren't looked
+     * at again.
+     */
+    void setFilterText(const QString& text)
+    {
+        QString query = text.toCaseFolded();
+        if (query == query_)
+            return;
+        if (query.startsWith(query_))
+            narrowFrom_ = rejected_;
+        else
+            narrowFrom_.clear();
+        rejected_.clear();
+        query_ = query;
+        invalidateFilter();
+    }
+
 protected:
     // reimplemented
     bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const
     {
         QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
+        if (!index.isValid())
+            return false;
 
-        QStringList data;
-        if (index.isValid()) {
-            // TODO: also check for vCard value
-            data
-                << index.data(Qt::DisplayRole).toString()
-                << index.data(ContactListModel::JidRole).toString();
+        const void* item = index.internalPointer();
+        if (narrowFrom_.contains(item)) {
+            rejected_.insert(item);
+            return false;
         }
 
-        foreach(const QString& str, data) {
-            if (str.contains(filterRegExp()))
-                return true;
+        auto it = index_.constFind(item);
+        if (it == index_.constEnd()) {
+            // TODO: also check for vCard value
+            QString text = index.data(Qt::DisplayRole).toString() + QLatin1Char('\n')
+                + index.data(ContactListModel::JidRole).toString();
+            if (sourceParent.isValid())
+                text += QLatin1Char('\n') + sourceParent.data(Qt::DisplayRole).toString();
+            it = index_.insert(item, text.toCaseFolded());
         }
+        if (it.value().contains(query_))
+            return true;
 
+        rejected_.insert(item);
         return false;
     }
 
@@ -99,6 +145,30 @@ protected:
             return false;
         return item1->lessThan(item2);
     }
+
+private slots:
+    void forgetRows(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+    {
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            const void* item = topLeft.sibling(row, 0).internalPointer();
+            index_.remove(item);
+            narrowFrom_.remove(item);
+            rejected_.remove(item);
+        }
+    }
+
+    void forgetAll()
+    {
+        index_.clear();
+        narrowFrom_.clear();
+        rejected_.clear();
+    }
+
+private:
+    QString                                query_;
+    mutable QHash<const void*, QString>    index_;      // case folded text searched per item
+    mutable QSet<const void*>              rejected_;   // items not matching query_
+    QSet<const void*>                      narrowFrom_; // items not matching a prefix of query_
 };
 
 //----------------------------------------------------------------------------
@@ -259,7 +329,7 @@ void PsiRosterWidget::setShowStatusMsg(bool enabled)
 void PsiRosterWidget::filterEditTextChanged(const QString& text)
 {
     if (filterModel_)
-        filterModel_->setFilterRegExp(QRegExp::escape(text));
+        filterModel_->setFilterText(text);
 }
 
 void PsiRosterWidget::quitFilteringMode()
@@ -19,29 +19,97 @@
 
 #include "psithememodel.h"
 
+#include "applicationinfo.h"
 #include "psithememanager.h"
 #include "psiiconset.h"
 #include "textutil.h"
 
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QPixmap>
 #include <QtConcurrentMap>
 
+// Themes metadata from previous scans, so unchanged themes don't have to be loaded
+static QString themeCacheFile()
+{
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + QLatin1String("/themes.json");
+}
+
+static QJsonObject readThemeCache()
+{
+    QFile f(themeCacheFile());
+    if (!f.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(f.readAll()).object();
+}
+
+static QString themeStamp(Theme &theme)
+{
+    if (!theme.exists()) {
+        return QString();
+    }
+    QFileInfo fi(theme.filePath());
+    return fi.filePath() + QLatin1Char('|') + QString::number(fi.lastModified().toMSecsSinceEpoch());
+}
+
 class PsiThemeModel;
 
 struct PsiThemeModel::Loader
 {
     Loader(PsiThemeProvider *provider_)
-    : provider(provider_) { }
+    : provider(provider_)
+    {
+        QJsonObject themes = readThemeCache().value(QLatin1String(provider->type())).toObject();
+        for (auto it = themes.constBegin(); it != themes.constEnd(); ++it) {
+            QJsonObject o = it.value().toObject();
+            ThemeItemInfo ti;
+            ti.id = it.key();
+            ti.stamp = o.value(QLatin1String("stamp")).toString();
+            ti.title = o.value(QLatin1String("title")).toString();
+            ti.version = o.value(QLatin1String("version")).toString();
+            ti.description = o.value(QLatin1String("description")).toString();
+            for (const QJsonValue &a : o.value(QLatin1String("authors")).toArray()) {
+                ti.authors.append(a.toString());
+            }
+            ti.creation = o.value(QLatin1String("creation")).toString();
+            ti.homeUrl = o.value(QLatin1String("homeUrl")).toString();
+            ti.hasPreview = o.value(QLatin1String("hasPreview")).toBool();
+            ti.isValid = true;
+            cache.insert(ti.id, ti);
+        }
+    }
 
     typedef ThemeItemInfo result_type;
 
+    // may be called from several threads. the cache is not modified after construction
+    bool fromCache(ThemeItemInfo &ti, const QString &stamp) const
+    {
+        auto it = cache.constFind(ti.id);
+        if (stamp.isEmpty() || it == cache.constEnd() || it->stamp != stamp) {
+            return false;
+        }
+        ti = it.value();
+        ti.isCurrent = provider->current().id() == ti.id;
+        return true;
+    }
+
     ThemeItemInfo operator()(const QString &id)
     {
         ThemeItemInfo ti;
         ti.id = id;
         Theme theme = provider->theme(id);
+        QString stamp = themeStamp(theme);
+        if (fromCache(ti, stamp)) {
+            return ti;
+        }
         if (theme.load()) {
             fillThemeInfo(ti, theme);
+            ti.stamp = stamp;
         } else {
             ti.title = ":-(";
         }
@@ -53,13 +121,21 @@ struct PsiThemeModel::Loader
     void asyncLoad(const QString &id, std::function<void(const ThemeItemInfo&)> loadCallback)
     {
         Theme theme = provider->theme(id);
-        if (!theme.isValid() || !theme.load([this, theme, loadCallback](bool success) {
+        QString stamp = themeStamp(theme);
+        ThemeItemInfo cached;
+        cached.id = id;
+        if (fromCache(cached, stamp)) {
+            loadCallback(cached);
+            return;
+        }
+        if (!theme.isValid() || !theme.load([this, theme, stamp, loadCallback](bool success) {
             qDebug("%s theme loading status: %s", qPrintable(theme.id()), success? "success" : "failure");
             // TODO invent something smarter
 
             ThemeItemInfo ti;
             if (success) { // if loaded
                 fillThemeInfo(ti, theme);
+                ti.stamp = stamp;
             }
             loadCallback(ti);
         })) {
@@ -83,6 +159,7 @@ struct PsiThemeModel::Loader
     }
 
     PsiThemeProvider *provider;
+    QHash<QString, ThemeItemInfo> cache;
 };
 
 //------------------------------------------------------------------------------
@@ -116,6 +193,36 @@ void PsiThemeModel::onThreadedResultReadyAt(int index)
 void PsiThemeModel::loadComplete()
 {
     qDebug("Themes loading finished");
+    saveCache();
+}
+
+void PsiThemeModel::saveCache() const
+{
+    QJsonObject themes;
+    for (const ThemeItemInfo &ti : themesInfo) {
+        if (ti.stamp.isEmpty()) {
+            continue;
+        }
+        QJsonObject o;
+        o.insert(QLatin1String("stamp"), ti.stamp);
+        o.insert(QLatin1String("title"), ti.title);
+        o.insert(QLatin1String("version"), ti.version);
+        o.insert(QLatin1String("description"), ti.description);
+        o.insert(QLatin1String("authors"), QJsonArray::fromStringList(ti.authors));
+        o.insert(QLatin1String("creation"), ti.creation);
+        o.insert(QLatin1String("homeUrl"), ti.homeUrl);
+        o.insert(QLatin1String("hasPreview"), ti.hasPreview);
+        themes.insert(ti.id, o);
+    }
+
+    QJsonObject all = readThemeCache();
+    all.insert(QLatin1String(provider->type()), themes);
+    QFile f(themeCacheFile());
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("Failed to save themes cache to %s", qPrintable(f.fileName()));
+        return;
+    }
+    f.write(QJsonDocument(all).toJson(QJsonDocument::Compact));
 }
 
 void PsiThemeModel::load()
@@ -127,6 +234,7 @@ void PsiThemeModel::load()
     } else {
         QStringList ids = provider->themeIds();
         qDebug() << ids;
+        pendingLoads = ids.size();
         foreach (const QString &id, ids) {
             loader->asyncLoad(id, [this](const ThemeItemInfo &ti) {
                 if (ti.isValid) {
@@ -134,6 +242,9 @@ void PsiThemeModel::load()
                     themesInfo.append(ti);
                     endInsertRows();
                 }
+                if (--pendingLoads == 0) {
+                    loadComplete();
+                }
             });
 
         }
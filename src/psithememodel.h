@@ -36,6 +36,7 @@ struct ThemeItemInfo
     QStringList authors;
     QString creation;
     QString homeUrl;
+    QString stamp; // path and modification time of the theme the info was read from
 
     bool hasPreview;
     bool isValid = false;
@@ -77,6 +78,9 @@ private:
     QFutureWatcher<ThemeItemInfo> themeWatcher;
     QFuture<ThemeItemInfo> themesFuture;
     QList<ThemeItemInfo> themesInfo;
+    int pendingLoads = 0;
+
+    void saveCache() const;
 };
 
 #endif // PSITHEMEMODEL_H
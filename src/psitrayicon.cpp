@@ -3,11 +3,11 @@
 #include "alerticon.h"
 #include "common.h"
 #include "iconset.h"
+#include "psiiconset.h"
 
 #include <QApplication> // old
 #include <QHelpEvent>
 #include <QPixmap>
-#include <QPixmapCache>
 #include <QSystemTrayIcon>
 
 // TODO: remove the QPoint parameter from the signals when we finally move
@@ -18,11 +18,13 @@ PsiTrayIcon::PsiTrayIcon(const QString &tip, QMenu *popup, QObject *parent)
     , icon_(nullptr)
     , trayicon_(new QSystemTrayIcon())
     , realIcon_(0)
+    , shownKey_(0)
 {    
     trayicon_->setContextMenu(popup);
     setToolTip(tip);
     connect(trayicon_,SIGNAL(activated(QSystemTrayIcon::ActivationReason)),SLOT(trayicon_activated(QSystemTrayIcon::ActivationReason)));
     trayicon_->installEventFilter(this);
+    connect(PsiIconset::instance(), SIGNAL(rosterIconsChanged()), SLOT(dropFrames()));
 }
 
 PsiTrayIcon::~PsiTrayIcon()
@@ -60,6 +62,7 @@ void PsiTrayIcon::setIcon(const PsiIcon *icon, bool alert)
     }
 
     realIcon_ = quintptr(icon);
+    frames_.clear();
     if ( icon ) {
         if ( !alert )
             icon_ = new PsiIcon(*icon);
@@ -67,6 +70,7 @@ void PsiTrayIcon::setIcon(const PsiIcon *icon, bool alert)
             icon_ = new AlertIcon(icon);
 
         connect(icon_, SIGNAL(pixmapChanged()), SLOT(animate()));
+        connect(icon_, SIGNAL(iconModified()), SLOT(dropFrames()));
         icon_->activated();
     }
     else
@@ -184,22 +188,32 @@ void PsiTrayIcon::trayicon_activated(QSystemTrayIcon::ActivationReason reason)
 #endif
 }
 
+// an alert blinks all day long, each frame is made once and the tray is
+// only bothered when the frame is a different one
 void PsiTrayIcon::animate()
 {
     if ( !icon_ )
         return;
 
-    QString cachedName = "PsiTray/" + icon_->name() + "/" + QString::number(realIcon_) + "/"
-            + QString::number( icon_->frameNumber() );
-
-    QPixmap p;
-    if ( !QPixmapCache::find(cachedName, &p) ) {
+    const int frame = icon_->frameNumber();
+    if ( frame >= frames_.size() )
+        frames_.resize(frame + 1);
+    QPixmap &p = frames_[frame];
+    if ( p.isNull() )
         p = makeIcon();
-        QPixmapCache::insert( cachedName, p );
-    }
+
+    if ( p.cacheKey() == shownKey_ )
+        return;
+    shownKey_ = p.cacheKey();
     trayicon_->setIcon(p);
 }
 
+void PsiTrayIcon::dropFrames()
+{
+    frames_.clear();
+    animate();
+}
+
 bool PsiTrayIcon::eventFilter(QObject *obj, QEvent *event)
 {
     if(obj == trayicon_ && event->type() == QEvent::ToolTip) {
@@ -2,12 +2,13 @@
 #define PSITRAYICON_H
 
 #include <QObject>
+#include <QPixmap>
 #include <QRgb>
 #include <QSystemTrayIcon>
+#include <QVector>
 
 class PsiIcon;
 class QMenu;
-class QPixmap;
 class QPoint;
 
 class PsiTrayIcon : public QObject
@@ -37,6 +38,7 @@ public slots:
 
 private slots:
     void animate();
+    void dropFrames();
     void trayicon_activated(QSystemTrayIcon::ActivationReason);
 
 protected:
@@ -48,6 +50,9 @@ private:
     PsiIcon* icon_;
     QSystemTrayIcon* trayicon_;
     quintptr realIcon_;
+    QVector<QPixmap> frames_; // of icon_ by frame number, made when first shown
+    qint64 shownKey_; // cache key of the pixmap the tray has
+
 };
 
 #endif // PSITRAYICON_H
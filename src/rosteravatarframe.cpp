@@ -20,6 +20,7 @@
 #include "rosteravatarframe.h"
 
 #include "iconset.h"
+#include "pixmaputil.h"
 #include "psioptions.h"
 #include "qpainter.h"
 
@@ -70,10 +71,10 @@ void RosterAvatarFrame::drawAvatar()
     if(!av.isNull()) {
         int radius = PsiOptions::instance()->getOption("options.ui.contactlist.avatars.radius").toInt();
         if(!radius)
-            av = av.scaled(avSize,avSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            av = PixmapUtil::scaled(av, QSize(avSize, avSize));
         else {
             avSize = qMax(avSize, radius*2);
-            av = av.scaled(avSize, avSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            av = PixmapUtil::scaled(av, QSize(avSize, avSize));
             int w = av.width(), h = av.height();
             QPainterPath pp;
             pp.addRoundedRect(0, 0, w, h, radius, radius);
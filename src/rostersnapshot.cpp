@@ -0,0 +1,112 @@
+/*
+ * rostersnapshot.cpp - the last known roster of an account, kept on disk
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rostersnapshot.h"
+
+#include "applicationinfo.h"
+#include "profiles.h"
+
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+using namespace XMPP;
+
+RosterSnapshot::RosterSnapshot(const QString &accountId, const Jid &jid) : jid_(jid.bare())
+{
+    fileName_ = pathToProfile(activeProfile, ApplicationInfo::CacheLocation) + "/roster-" + accountId + ".xml";
+}
+
+bool RosterSnapshot::load()
+{
+    version_.clear();
+    roster_.clear();
+    lastSeen_.clear();
+    rooms_.clear();
+
+    QFile f(fileName_);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+    QDomDocument doc;
+    if (!doc.setContent(&f, true)) {
+        qWarning("RosterSnapshot: %s is damaged", qPrintable(fileName_));
+        return false;
+    }
+
+    // the account may have been moved to another server since
+    QDomElement q = doc.documentElement();
+    if (q.attribute("jid") != jid_.full() || !q.hasAttribute("ver"))
+        return false;
+
+    for (QDomElement i = q.firstChildElement("item"); !i.isNull(); i = i.nextSiblingElement("item")) {
+        RosterItem item;
+        if (!item.fromXml(i))
+            continue;
+        roster_ += item;
+        if (i.hasAttribute("last-status") || i.hasAttribute("last-seen"))
+            lastSeen_.insert(item.jid().bare(),
+                             { i.attribute("last-status"), QDateTime::fromString(i.attribute("last-seen"), Qt::ISODate) });
+    }
+    for (QDomElement r = q.firstChildElement("room"); !r.isNull(); r = r.nextSiblingElement("room")) {
+        QDateTime time = QDateTime::fromString(r.attribute("last-seen"), Qt::ISODate);
+        if (time.isValid())
+            rooms_.insert(r.attribute("jid"), time);
+    }
+    version_ = q.attribute("ver");
+    return true;
+}
+
+void RosterSnapshot::save(const QString &version, const Roster &roster, const LastSeenMap &lastSeen,
+                          const RoomMap &rooms) const
+{
+    QDomDocument doc;
+    QDomElement  q = doc.createElementNS("jabber:iq:roster", "query");
+    q.setAttribute("jid", jid_.full());
+    q.setAttribute("ver", version);
+    for (const RosterItem &item : roster) {
+        QDomElement i  = item.toXml(&doc);
+        auto        it = lastSeen.constFind(item.jid().bare());
+        if (it != lastSeen.constEnd()) {
+            if (!it->status.isEmpty())
+                i.setAttribute("last-status", it->status);
+            if (it->time.isValid())
+                i.setAttribute("last-seen", it->time.toString(Qt::ISODate));
+        }
+        q.appendChild(i);
+    }
+    for (auto it = rooms.constBegin(); it != rooms.constEnd(); ++it) {
+        QDomElement r = doc.createElement("room");
+        r.setAttribute("jid", it.key());
+        r.setAttribute("last-seen", it.value().toString(Qt::ISODate));
+        q.appendChild(r);
+    }
+    doc.appendChild(q);
+
+    QDir().mkpath(QFileInfo(fileName_).absolutePath());
+    QSaveFile f(fileName_);
+    if (!f.open(QIODevice::WriteOnly) || f.write(doc.toByteArray(0)) == -1 || !f.commit())
+        qWarning("RosterSnapshot: can't write %s", qPrintable(fileName_));
+}
+
+void RosterSnapshot::remove() const
+{
+    QFile::remove(fileName_);
+}
@@ -0,0 +1,69 @@
+/*
+ * rostersnapshot.h - the last known roster of an account, kept on disk
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ROSTERSNAPSHOT_H
+#define ROSTERSNAPSHOT_H
+
+#include "xmpp_jid.h"
+#include "xmpp_roster.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+
+/**
+ * Roster items together with the roster version they are at least as new
+ * as, so the next login only has to fetch what changed since then. It also
+ * keeps the last known status of each contact, so the contact list can be
+ * shown at startup before the account is even connected.
+ */
+class RosterSnapshot
+{
+public:
+    struct LastSeen {
+        QString   status;
+        QDateTime time;
+    };
+    typedef QHash<QString, LastSeen> LastSeenMap; // by bare jid
+    typedef QHash<QString, QDateTime> RoomMap;    // last message seen, by room jid
+
+    RosterSnapshot(const QString &accountId, const XMPP::Jid &jid);
+
+    // false if there is no usable snapshot for this jid
+    bool load();
+    void save(const QString &version, const XMPP::Roster &roster, const LastSeenMap &lastSeen = LastSeenMap(),
+              const RoomMap &rooms = RoomMap()) const;
+    void remove() const;
+
+    // empty if the server doesn't do versioning
+    const QString &     version() const { return version_; }
+    const XMPP::Roster &roster() const { return roster_; }
+    const LastSeenMap & lastSeen() const { return lastSeen_; }
+    const RoomMap &     rooms() const { return rooms_; }
+
+private:
+    QString      fileName_;
+    XMPP::Jid    jid_;
+    QString      version_;
+    XMPP::Roster roster_;
+    LastSeenMap  lastSeen_;
+    RoomMap      rooms_;
+};
+
+#endif // ROSTERSNAPSHOT_H
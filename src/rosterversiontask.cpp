@@ -0,0 +1,82 @@
+/*
+ * rosterversiontask.cpp - roster request carrying a roster version
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rosterversiontask.h"
+
+#include "xmpp_client.h"
+#include "xmpp_xmlcommon.h"
+
+using namespace XMPP;
+
+RosterVersionTask::RosterVersionTask(const QString &version, Task *parent) :
+    Task(parent), version_(version), hasRoster_(false)
+{
+}
+
+void RosterVersionTask::onGo()
+{
+    QDomElement iq    = createIQ(doc(), "get", "", id());
+    QDomElement query = doc()->createElementNS("jabber:iq:roster", "query");
+    query.setAttribute("ver", version_);
+    iq.appendChild(query);
+    send(iq);
+}
+
+bool RosterVersionTask::take(const QDomElement &x)
+{
+    if (!iqVerify(x, client()->host(), id()))
+        return false;
+
+    if (x.attribute("type") == "result") {
+        QDomElement q = queryTag(x);
+        hasRoster_    = !q.isNull();
+        if (hasRoster_) {
+            // servers without versioning leave it out, then there's nothing to resume from
+            version_ = q.attribute("ver");
+            for (QDomNode n = q.firstChild(); !n.isNull(); n = n.nextSibling()) {
+                QDomElement i = n.toElement();
+                if (i.isNull() || i.tagName() != "item")
+                    continue;
+                RosterItem item;
+                if (item.fromXml(i))
+                    roster_ += item;
+            }
+        }
+        setSuccess();
+    } else {
+        setError(x);
+    }
+
+    return true;
+}
+
+bool RosterVersionTask::hasRoster() const
+{
+    return hasRoster_;
+}
+
+const Roster &RosterVersionTask::roster() const
+{
+    return roster_;
+}
+
+const QString &RosterVersionTask::version() const
+{
+    return version_;
+}
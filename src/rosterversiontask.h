@@ -0,0 +1,53 @@
+/*
+ * rosterversiontask.h - roster request carrying a roster version
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ROSTERVERSIONTASK_H
+#define ROSTERVERSIONTASK_H
+
+#include "xmpp_roster.h"
+#include "xmpp_task.h"
+
+#include <QDomElement>
+#include <QString>
+
+/**
+ * Asks for the roster as of \a version (RFC 6121, section 2.6). When the
+ * server knows the version it may answer with an empty result and send the
+ * changes as roster pushes instead of the whole roster.
+ */
+class RosterVersionTask : public XMPP::Task
+{
+public:
+    RosterVersionTask(const QString &version, Task *parent);
+
+    void onGo();
+    bool take(const QDomElement &);
+
+    // false if only the changes since the requested version will follow
+    bool hasRoster() const;
+    const XMPP::Roster &roster() const;
+    const QString &version() const;
+
+private:
+    QString      version_;
+    bool         hasRoster_;
+    XMPP::Roster roster_;
+};
+
+#endif // ROSTERVERSIONTASK_H
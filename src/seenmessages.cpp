@@ -0,0 +1,98 @@
+/*
+ * seenmessages.cpp - ids of the messages an account already got
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "seenmessages.h"
+
+#include "xmpp_jid.h"
+#include "xmpp_message.h"
+
+// a sender's id means something only in its conversation, an archive id
+// is unique in the whole archive of the account
+static QString conversationKey(const QString &conversation, const QString &id)
+{
+    return QLatin1String("m:") + conversation + QLatin1Char('\t') + id;
+}
+
+static QString archiveKey(const QString &archiveId) { return QLatin1String("a:") + archiveId; }
+
+static QStringList keysOf(const SeenMessages::Ids &ids)
+{
+    QStringList keys;
+    if (!ids.conversation.isEmpty()) {
+        if (!ids.id.isEmpty())
+            keys << conversationKey(ids.conversation, ids.id);
+        if (!ids.originId.isEmpty() && ids.originId != ids.id)
+            keys << conversationKey(ids.conversation, ids.originId);
+    }
+    if (!ids.archiveId.isEmpty())
+        keys << archiveKey(ids.archiveId);
+    return keys;
+}
+
+SeenMessages::SeenMessages(int capacity) : capacity_(capacity) { }
+
+SeenMessages::Ids SeenMessages::idsOf(const XMPP::Message &m, const XMPP::Jid &account)
+{
+    Ids ids;
+    if (m.type() == "groupchat")
+        ids.conversation = m.from().full(); // senders pick their ids, the room doesn't
+    else if (m.carbonDirection() == XMPP::Message::Sent || m.from().compare(account, false))
+        ids.conversation = m.to().bare();
+    else
+        ids.conversation = m.from().bare();
+    ids.id = m.id();
+    return ids;
+}
+
+bool SeenMessages::contains(const Ids &ids) const
+{
+    for (const QString &key : keysOf(ids))
+        if (keys_.contains(key))
+            return true;
+    return false;
+}
+
+void SeenMessages::insert(const Ids &ids)
+{
+    for (const QString &key : keysOf(ids))
+        add(key);
+}
+
+bool SeenMessages::testAndInsert(const Ids &ids)
+{
+    bool seen = contains(ids);
+    insert(ids);
+    return seen;
+}
+
+void SeenMessages::fromList(const QStringList &keys)
+{
+    for (const QString &key : keys)
+        add(key);
+}
+
+void SeenMessages::add(const QString &key)
+{
+    if (keys_.contains(key))
+        return;
+    keys_.insert(key);
+    order_.enqueue(key);
+    while (order_.size() > capacity_)
+        keys_.remove(order_.dequeue());
+}
@@ -0,0 +1,76 @@
+/*
+ * seenmessages.h - ids of the messages an account already got
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SEENMESSAGES_H
+#define SEENMESSAGES_H
+
+#include <QQueue>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+namespace XMPP {
+class Jid;
+class Message;
+}
+
+/**
+ * The ids of the latest messages of an account, so a message that comes
+ * again another way is recognized before it's shown or logged a second
+ * time: as a carbon and live, from the server archive after it was seen
+ * live, in the history a room replays on rejoin, or delivered offline
+ * after it was read elsewhere.
+ *
+ * A message is known by the id the sender gave it and its origin id, both
+ * within the conversation, and by its archive id within the account. The
+ * oldest ids are forgotten once there are more than the capacity.
+ */
+class SeenMessages
+{
+public:
+    struct Ids {
+        QString conversation; // bare jid of the contact, the occupant jid in rooms
+        QString id;
+        QString originId;
+        QString archiveId;
+    };
+
+    SeenMessages(int capacity = 4000);
+
+    // ids of a message sent or received on the account's jid
+    static Ids idsOf(const XMPP::Message &m, const XMPP::Jid &account);
+
+    bool contains(const Ids &ids) const;
+    void insert(const Ids &ids);
+    // inserts, and tells if any of the ids was there before
+    bool testAndInsert(const Ids &ids);
+
+    // oldest first, to keep them over a restart
+    QStringList toList() const { return QStringList(order_); }
+    void        fromList(const QStringList &keys);
+
+private:
+    void add(const QString &key);
+
+    int             capacity_;
+    QSet<QString>   keys_;
+    QQueue<QString> order_;
+};
+
+#endif // SEENMESSAGES_H
@@ -19,94 +19,284 @@
 
 #include "serverlistquerier.h"
 
+#include "applicationinfo.h"
+
+#include <QDir>
+#include <QDnsLookup>
 #include <QDomDocument>
 #include <QDomElement>
 #include <QDomNodeList>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QPointer>
+#include <QSaveFile>
 #include <QStringList>
+#include <QTcpSocket>
+#include <QTimer>
 #include <QUrl>
 
 // #define XML_SERVER_LIST
 #define SERVERLIST_MAX_REDIRECT  5
+#define SERVERLIST_MAX_PROBES    4
+#define SERVERLIST_PROBE_TIMEOUT 5000 /* msecs */
 
 // legacy format could be found here as well
 // https://list.jabber.at/api/?format=services-full.xml
 // original http://xmpp.org/services/services.xml does not work anymore (checked on 2016-03-27)
 
-ServerListQuerier::ServerListQuerier(QObject* parent)
+static QString cacheFileName()
+{
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/serverlist.txt";
+}
+
+ServerListQuerier::ServerListQuerier(QNetworkAccessManager* http, QObject* parent)
     : QObject(parent)
+    , http_(http)
     , redirectCount_(0)
+    , haveCache_(false)
+    , probesRunning_(0)
 {
-    http_ = new QNetworkAccessManager(this);
     url_ = QUrl("https://xmpp.net/directory.php");
 }
 
 void ServerListQuerier::getList()
 {
     redirectCount_ = 0;
-    QNetworkReply *reply = http_->get(QNetworkRequest(url_));
+    haveCache_ = loadCache();
+    if (haveCache_) {
+        QStringList cached = servers_;
+        QTimer::singleShot(0, this, [this, cached]() { emit listReceived(cached); });
+    }
+    get();
+}
+
+void ServerListQuerier::get()
+{
+    QNetworkRequest request(url_);
+    if (haveCache_) {
+        // asks for the list only if it changed since
+        if (!etag_.isEmpty())
+            request.setRawHeader("If-None-Match", etag_.toLatin1());
+        if (!lastModified_.isEmpty())
+            request.setRawHeader("If-Modified-Since", lastModified_.toLatin1());
+    }
+    buffer_.clear();
+    QNetworkReply *reply = http_->get(request);
+    connect(reply, SIGNAL(readyRead()), SLOT(get_readyRead()));
     connect(reply, SIGNAL(finished()), SLOT(get_finished()));
 }
 
+QStringList ServerListQuerier::parse(const QString& contents) const
+{
+    QStringList servers;
+#ifdef XML_SERVER_LIST
+    // Parse the XML file
+    QDomDocument doc;
+    if (!doc.setContent(contents))
+        return servers;
+
+    // Fill the list
+    QDomNodeList items = doc.elementsByTagName("item");
+    for (int i = 0; i < items.count(); i++) {
+        QString jid = items.item(i).toElement().attribute("jid");
+        if (!jid.isEmpty()) {
+            servers.push_back(jid);
+        }
+    }
+#else
+    int index = -1;
+    QRegExp re("data-original-title=\"([^\"]+)\"");
+    while ((index = contents.indexOf(re, index + 1)) != -1) {
+        servers.append(re.cap(1));
+    }
+#endif
+    return servers;
+}
+
+void ServerListQuerier::get_readyRead()
+{
+#ifndef XML_SERVER_LIST
+    QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    if (haveCache_ || reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200)
+        return;
+
+    // up to the last complete tag, multibyte characters never contain a '>'
+    buffer_ += reply->readAll();
+    int cut = buffer_.lastIndexOf('>');
+    if (cut == -1)
+        return;
+    QStringList found = parse(QString::fromUtf8(buffer_.constData(), cut + 1));
+    buffer_.remove(0, cut + 1);
+    if (!found.isEmpty()) {
+        servers_ += found;
+        emit serversFound(found);
+    }
+#endif
+}
+
 void ServerListQuerier::get_finished()
 {
     QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
 
     if (reply->error()) {
-        emit error(reply->errorString());
+        // the cached list is still good then
+        if (!haveCache_)
+            emit error(reply->errorString());
+        return;
     }
-    else {
-        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        if(status == 200) {
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 304) {
+        return;
+    }
+    else if (status == 200) {
+        QStringList servers;
 #ifdef XML_SERVER_LIST
-            // Parse the XML file
-            QDomDocument doc;
-            if (!doc.setContent(reply->readAll())) {
-                emit error(tr("Unable to parse server list"));
-                return;
-            }
-
-            // Fill the list
-            QStringList servers;
-            QDomNodeList items = doc.elementsByTagName("item");
-            for (int i = 0; i < items.count(); i++) {
-                QString jid = items.item(i).toElement().attribute("jid");
-                if (!jid.isEmpty()) {
-                    servers.push_back(jid);
-                }
-            }
+        servers = parse(QString::fromUtf8(reply->readAll()));
+        if (servers.isEmpty()) {
+            emit error(tr("Unable to parse server list"));
+            return;
+        }
 #else
-            QStringList servers;
-            QString contents = QString::fromUtf8(reply->readAll());
-            int index = 0;
-            QRegExp re("data-original-title=\"([^\"]+)\"");
-            while ((index = contents.indexOf(re, index + 1)) != -1) {
-                servers.append(re.cap(1));
-            }
+        if (haveCache_) {
+            servers = parse(QString::fromUtf8(reply->readAll()));
+        } else {
+            buffer_ += reply->readAll();
+            servers = servers_ + parse(QString::fromUtf8(buffer_));
+            buffer_.clear();
+        }
 #endif
-            emit listReceived(servers);
+        servers_ = servers;
+        saveCache(reply);
+        emit listReceived(servers);
+    }
+    else if(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).isValid()) {
+        if (redirectCount_ >= SERVERLIST_MAX_REDIRECT) {
+            emit error(tr("Maximum redirect count reached"));
+            return;
         }
-        else if(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).isValid()) {
-            if (redirectCount_ >= SERVERLIST_MAX_REDIRECT) {
-                emit error(tr("Maximum redirect count reached"));
-                return;
-            }
-
-            url_ = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).value<QUrl>().resolved(url_);
-            if (url_.isValid()) {
-                QNetworkReply *newReply = http_->get(QNetworkRequest(url_));
-                connect(newReply, SIGNAL(finished()),SLOT(get_finished()));
-                ++redirectCount_;
-            } else {
-                emit error(tr("Invalid redirect URL %1").arg(url_.toString()));
-                return;
-            }
+
+        url_ = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).value<QUrl>().resolved(url_);
+        if (url_.isValid()) {
+            ++redirectCount_;
+            get();
+        } else {
+            emit error(tr("Invalid redirect URL %1").arg(url_.toString()));
         }
-        else {
-            emit error(tr("Unexpected HTTP status code: %1").arg(status));
+    }
+    else if (!haveCache_) {
+        emit error(tr("Unexpected HTTP status code: %1").arg(status));
+    }
+}
+
+// the file has the validators of the response, an empty line and the servers
+bool ServerListQuerier::loadCache()
+{
+    servers_.clear();
+    etag_.clear();
+    lastModified_.clear();
+
+    QFile f(cacheFileName());
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    bool header = true;
+    while (!f.atEnd()) {
+        QString line = QString::fromUtf8(f.readLine()).trimmed();
+        if (header) {
+            if (line.isEmpty())
+                header = false;
+            else if (line.startsWith("etag: "))
+                etag_ = line.mid(6);
+            else if (line.startsWith("last-modified: "))
+                lastModified_ = line.mid(15);
+        }
+        else if (!line.isEmpty()) {
+            servers_ += line;
         }
     }
-    reply->deleteLater();
+    return !servers_.isEmpty();
+}
+
+void ServerListQuerier::saveCache(QNetworkReply* reply) const
+{
+    QByteArray data;
+    if (reply->hasRawHeader("ETag"))
+        data += "etag: " + reply->rawHeader("ETag") + '\n';
+    if (reply->hasRawHeader("Last-Modified"))
+        data += "last-modified: " + reply->rawHeader("Last-Modified") + '\n';
+    data += '\n';
+    data += servers_.join('\n').toUtf8() + '\n';
+
+    QDir().mkpath(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation));
+    QSaveFile f(cacheFileName());
+    if (!f.open(QIODevice::WriteOnly) || f.write(data) == -1 || !f.commit())
+        qWarning("ServerListQuerier: can't write %s", qPrintable(cacheFileName()));
+}
+
+void ServerListQuerier::probe(const QStringList& servers)
+{
+    probeQueue_ = servers;
+    while (probesRunning_ < SERVERLIST_MAX_PROBES && !probeQueue_.isEmpty())
+        probeNext();
+}
+
+void ServerListQuerier::probeNext()
+{
+    const QString server = probeQueue_.takeFirst();
+    ++probesRunning_;
+
+    QDnsLookup *dns = new QDnsLookup(QDnsLookup::SRV, "_xmpp-client._tcp." + server, this);
+    connect(dns, &QDnsLookup::finished, this, [this, dns, server]() {
+        dns->deleteLater();
+        if (dns->error() == QDnsLookup::NoError && !dns->serviceRecords().isEmpty())
+            probeConnect(server, dns->serviceRecords().first().target(), dns->serviceRecords().first().port());
+        else
+            probeConnect(server, server, 5222);
+    });
+    dns->lookup();
+}
+
+void ServerListQuerier::probeConnect(const QString& server, const QString& host, quint16 port)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    QElapsedTimer timer;
+    timer.start();
+    QPointer<QTcpSocket> guard(socket);
+    connect(socket, &QTcpSocket::connected, this, [this, socket, server, timer]() {
+        int msecs = int(timer.elapsed());
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+        probeDone(server, msecs);
+    });
+    connect(socket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+            this, [this, socket, server]() {
+        socket->deleteLater();
+        socket->disconnect(this);
+        probeDone(server, -1);
+    });
+    QTimer::singleShot(SERVERLIST_PROBE_TIMEOUT, this, [this, guard, server]() {
+        if (guard && guard->state() != QAbstractSocket::UnconnectedState && guard->state() != QAbstractSocket::ConnectedState) {
+            guard->disconnect(this);
+            guard->abort();
+            guard->deleteLater();
+            probeDone(server, -1);
+        }
+    });
+    socket->connectToHost(host, port);
+}
+
+void ServerListQuerier::probeDone(const QString& server, int msecs)
+{
+    --probesRunning_;
+    emit serverProbed(server, msecs);
+    if (!probeQueue_.isEmpty())
+        probeNext();
+    else if (probesRunning_ == 0)
+        emit probingFinished();
 }
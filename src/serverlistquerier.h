@@ -20,30 +20,58 @@
 #ifndef SERVERLISTQUERIER_H
 #define SERVERLISTQUERIER_H
 
+#include <QByteArray>
 #include <QObject>
+#include <QStringList>
 #include <QUrl>
 
 class QNetworkAccessManager;
+class QNetworkReply;
 
 class ServerListQuerier : public QObject
 {
     Q_OBJECT
 
 public:
-    ServerListQuerier(QObject* parent = nullptr);
+    ServerListQuerier(QNetworkAccessManager* http, QObject* parent = nullptr);
+
+    // the cached list comes right away, a fresh one follows if it changed
     void getList();
 
+    // measures how long connecting to each server takes, a few at a time
+    void probe(const QStringList& servers);
+
 signals:
     void listReceived(const QStringList&);
+    void serversFound(const QStringList&); // while downloading without a cached list
     void error(const QString&);
+    void serverProbed(const QString& server, int msecs); // -1 if unreachable
+    void probingFinished();
 
 protected slots:
+    void get_readyRead();
     void get_finished();
 
 private:
+    void get();
+    QStringList parse(const QString& contents) const;
+    bool loadCache();
+    void saveCache(QNetworkReply* reply) const;
+    void probeNext();
+    void probeConnect(const QString& server, const QString& host, quint16 port);
+    void probeDone(const QString& server, int msecs);
+
     QNetworkAccessManager* http_;
     QUrl url_;
     int redirectCount_;
+
+    QStringList servers_;
+    QString etag_, lastModified_;
+    bool haveCache_;
+    QByteArray buffer_;
+
+    QStringList probeQueue_;
+    int probesRunning_;
 };
 
 #endif // SERVERLISTQUERIER_H
@@ -0,0 +1,231 @@
+/*
+ * sessionjournal.cpp - open chats and joined rooms, to recover from a crash
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sessionjournal.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QSaveFile>
+#include <QUrl>
+#include <QtConcurrentRun>
+
+static const int flushDelay = 1000; // msecs, what a crash may lose at most
+static const int minCompact = 500;  // records
+
+// a record is a line of percent-encoded fields separated by spaces
+static QString encodeRecord(const QStringList &fields)
+{
+    QStringList encoded;
+    for (const QString &f : fields)
+        encoded += QString::fromLatin1(QUrl::toPercentEncoding(f));
+    return encoded.join(' ');
+}
+
+static QStringList decodeRecord(const QString &line)
+{
+    QStringList fields;
+    for (const QString &f : line.split(' '))
+        fields += QUrl::fromPercentEncoding(f.toLatin1());
+    return fields;
+}
+
+static QString keyOf(const QString &account, const QString &jid) { return account + '\t' + jid; }
+
+SessionJournal *SessionJournal::instance()
+{
+    static SessionJournal *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new SessionJournal();
+    }
+    return instance_;
+}
+
+SessionJournal::SessionJournal() : QObject(QCoreApplication::instance())
+{
+    pool_.setMaxThreadCount(1);
+    timer_.setSingleShot(true);
+    timer_.setInterval(flushDelay);
+    connect(&timer_, SIGNAL(timeout()), SLOT(flush()));
+}
+
+void SessionJournal::open(const QString &path)
+{
+    path_ = path;
+    open_ = true;
+
+    // small enough to be read right away, the chats are reopened from it
+    // before the accounts even connect
+    QFile f(path_);
+    if (!f.open(QIODevice::ReadOnly))
+        return;
+    while (!f.atEnd()) {
+        // a line cut short by the crash is dropped
+        const QByteArray line = f.readLine();
+        if (line.endsWith('\n'))
+            apply(decodeRecord(QString::fromLatin1(line.trimmed())));
+    }
+    f.close();
+    recoveredChats_ = chats_;
+    recoveredRooms_ = rooms_;
+
+    // what wasn't recovered yet survives another crash
+    const QStringList records = snapshot();
+    written_                  = records.size();
+    QtConcurrent::run(&pool_, &SessionJournal::write, path_, records, true);
+}
+
+void SessionJournal::close()
+{
+    if (!open_)
+        return;
+    open_ = false;
+    timer_.stop();
+    pending_.clear();
+    pool_.waitForDone();
+    QFile::remove(path_);
+}
+
+QStringList SessionJournal::recoveredChats(const QString &account) const
+{
+    QStringList jids;
+    const QString prefix = keyOf(account, QString());
+    for (const QString &key : recoveredChats_) {
+        if (key.startsWith(prefix))
+            jids += key.mid(prefix.length());
+    }
+    return jids;
+}
+
+QList<SessionJournal::Room> SessionJournal::takeRecoveredRooms(const QString &account)
+{
+    QList<Room>   rooms;
+    const QString prefix = keyOf(account, QString());
+    for (auto it = recoveredRooms_.begin(); it != recoveredRooms_.end();) {
+        if (!it.key().startsWith(prefix)) {
+            ++it;
+            continue;
+        }
+        const QString jid = it.key().mid(prefix.length());
+        rooms += Room { jid, it.value() };
+        // journaled again once joined
+        roomLeft(account, jid);
+        it = recoveredRooms_.erase(it);
+    }
+    return rooms;
+}
+
+void SessionJournal::chatOpened(const QString &account, const QString &jid)
+{
+    if (!chats_.contains(keyOf(account, jid)))
+        append({ "c+", account, jid });
+}
+
+void SessionJournal::chatClosed(const QString &account, const QString &jid)
+{
+    recoveredChats_.remove(keyOf(account, jid));
+    if (chats_.contains(keyOf(account, jid)))
+        append({ "c-", account, jid });
+}
+
+void SessionJournal::roomJoined(const QString &account, const QString &jid, const QString &nick)
+{
+    auto it = rooms_.constFind(keyOf(account, jid));
+    if (it == rooms_.constEnd() || *it != nick)
+        append({ "r+", account, jid, nick });
+}
+
+void SessionJournal::roomLeft(const QString &account, const QString &jid)
+{
+    if (rooms_.contains(keyOf(account, jid)))
+        append({ "r-", account, jid });
+}
+
+void SessionJournal::flush()
+{
+    if (!open_ || pending_.isEmpty())
+        return;
+
+    // rewritten once mostly made of changes that cancel out
+    const int live = chats_.size() + rooms_.size();
+    if (written_ + pending_.size() > qMax(minCompact, 2 * live)) {
+        const QStringList records = snapshot();
+        written_                  = records.size();
+        QtConcurrent::run(&pool_, &SessionJournal::write, path_, records, true);
+    } else {
+        written_ += pending_.size();
+        QtConcurrent::run(&pool_, &SessionJournal::write, path_, pending_, false);
+    }
+    pending_.clear();
+}
+
+void SessionJournal::append(const QStringList &fields)
+{
+    apply(fields);
+    if (!open_)
+        return;
+    pending_ += encodeRecord(fields);
+    if (!timer_.isActive())
+        timer_.start();
+}
+
+void SessionJournal::apply(const QStringList &fields)
+{
+    if (fields.size() < 3)
+        return;
+    const QString &op  = fields[0];
+    const QString  key = keyOf(fields[1], fields[2]);
+    if (op == "c+")
+        chats_.insert(key);
+    else if (op == "c-")
+        chats_.remove(key);
+    else if (op == "r+" && fields.size() >= 4)
+        rooms_.insert(key, fields[3]);
+    else if (op == "r-")
+        rooms_.remove(key);
+}
+
+QStringList SessionJournal::snapshot() const
+{
+    QStringList records;
+    for (const QString &key : chats_)
+        records += encodeRecord(QStringList { "c+" } + key.split('\t'));
+    for (auto it = rooms_.constBegin(); it != rooms_.constEnd(); ++it)
+        records += encodeRecord(QStringList { "r+" } + it.key().split('\t') + QStringList { it.value() });
+    return records;
+}
+
+void SessionJournal::write(const QString &path, const QStringList &records, bool rewrite)
+{
+    QByteArray data;
+    for (const QString &r : records)
+        data += r.toLatin1() + '\n';
+
+    if (rewrite) {
+        // a crash while rewriting leaves the old journal
+        QSaveFile f(path);
+        if (f.open(QIODevice::WriteOnly)) {
+            f.write(data);
+            f.commit();
+        }
+    } else {
+        QFile f(path);
+        if (f.open(QIODevice::WriteOnly | QIODevice::Append))
+            f.write(data);
+    }
+}
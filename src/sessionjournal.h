@@ -0,0 +1,95 @@
+/*
+ * sessionjournal.h - open chats and joined rooms, to recover from a crash
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SESSIONJOURNAL_H
+#define SESSIONJOURNAL_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+/**
+ * Keeps track of the chats open in tabs and the rooms joined, by account,
+ * in a small journal in the profile, so a session that crashed can be put
+ * back together on the next start instead of from scratch.
+ *
+ * Changes are appended to the journal in batches on a worker thread, and
+ * the journal is rewritten with just the current state once it grew long.
+ * A clean exit removes it: only a session that didn't end leaves one.
+ *
+ * Pending events don't need to be journaled, the event queue of every
+ * account is saved on each change already, and neither do the positions
+ * in the rooms, the roster snapshot keeps the time of the last message
+ * seen in each of them for asking the history since then.
+ */
+class SessionJournal : public QObject {
+    Q_OBJECT
+public:
+    struct Room {
+        QString jid; // bare
+        QString nick;
+    };
+
+    static SessionJournal *instance();
+
+    // reads what the last session left behind and journals this one there
+    void open(const QString &path);
+    // stops journaling and removes the journal, the session ended cleanly
+    void close();
+
+    // chats and rooms the last session left open, until taken
+    QStringList recoveredChats(const QString &account) const;
+    QList<Room> takeRecoveredRooms(const QString &account);
+
+    void chatOpened(const QString &account, const QString &jid);
+    void chatClosed(const QString &account, const QString &jid);
+    void roomJoined(const QString &account, const QString &jid, const QString &nick);
+    void roomLeft(const QString &account, const QString &jid);
+
+private slots:
+    void flush();
+
+private:
+    SessionJournal();
+
+    void        append(const QStringList &fields);
+    void        apply(const QStringList &fields);
+    QStringList snapshot() const;
+
+    static void write(const QString &path, const QStringList &records, bool rewrite);
+
+    QString     path_;
+    bool        open_    = false;
+    int         written_ = 0; // records in the journal
+    QStringList pending_;
+    QTimer      timer_;
+    QThreadPool pool_; // of one thread, so the writes land in order
+
+    // by account id and jid, tab separated
+    QSet<QString>           chats_;
+    QHash<QString, QString> rooms_; // the nick
+    QSet<QString>           recoveredChats_;
+    QHash<QString, QString> recoveredRooms_;
+};
+
+#endif // SESSIONJOURNAL_H
@@ -0,0 +1,386 @@
+/*
+ * soundengine.cpp - in-process playback of notification sounds
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "soundengine.h"
+
+#include "applicationinfo.h"
+#include "psioptions.h"
+
+#include <QAudioDeviceInfo>
+#include <QAudioOutput>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QtEndian>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static const int outputRate         = 44100;
+static const int outputFrameBytes   = 4;    // 16 bit stereo
+static const int outputBufferMsecs  = 40;
+static const int maxVoices          = 8;
+static const int duplicateInterval  = 100;  // msecs
+static const int idleSuspendDelay   = 5000; // msecs
+static const qint64 maxClipFileSize = 10 * 1024 * 1024;
+
+static const QString soundsOptionPath = "options.ui.notifications.sounds";
+
+static QString soundFilePath(const QString &name)
+{
+    if (name.isEmpty() || name == "!beep") {
+        return QString();
+    }
+    return QDir::isRelativePath(name) ? ApplicationInfo::resourcesDir() + '/' + name : name;
+}
+
+static inline quint16 le16(const char *p)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar *>(p));
+}
+
+static inline quint32 le32(const char *p)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(p));
+}
+
+/**
+ * Decodes integer or float PCM from a RIFF/WAVE file and converts it to
+ * the output format, so playing only has to add samples together.
+ */
+static SoundEngine::Samples decodeWav(const QByteArray &data)
+{
+    if (data.size() < 12 || !data.startsWith("RIFF") || data.mid(8, 4) != "WAVE") {
+        return SoundEngine::Samples();
+    }
+
+    int format = 0, channels = 0, rate = 0, bits = 0;
+    const char *pcm = nullptr;
+    qint64 pcmSize = 0;
+    for (qint64 pos = 12; pos + 8 <= data.size();) {
+        const char *chunk = data.constData() + pos;
+        const qint64 size = le32(chunk + 4);
+        const qint64 avail = qMin(size, data.size() - pos - 8);
+        if (memcmp(chunk, "fmt ", 4) == 0 && avail >= 16) {
+            format = le16(chunk + 8);
+            channels = le16(chunk + 10);
+            rate = int(le32(chunk + 12));
+            bits = le16(chunk + 22);
+            if (format == 0xFFFE && avail >= 40) { // WAVE_FORMAT_EXTENSIBLE
+                format = le16(chunk + 8 + 24);
+            }
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            pcm = chunk + 8;
+            pcmSize = avail;
+        }
+        pos += 8 + size + (size & 1);
+    }
+
+    const bool isFloat = (format == 3 && bits == 32);
+    const bool isInt = (format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32));
+    if (!pcm || channels < 1 || rate <= 0 || (!isFloat && !isInt)) {
+        return SoundEngine::Samples();
+    }
+
+    const int sampleBytes = bits / 8;
+    const qint64 frames = pcmSize / (sampleBytes * channels);
+    if (frames == 0) {
+        return SoundEngine::Samples();
+    }
+    auto sample = [=](qint64 frame, int channel) -> double {
+        const char *p = pcm + (frame * channels + qMin(channel, channels - 1)) * sampleBytes;
+        if (isFloat) {
+            float f;
+            memcpy(&f, p, sizeof(f));
+            return f;
+        }
+        switch (bits) {
+        case 8:  return (uchar(*p) - 128) / 128.0;
+        case 16: return qint16(le16(p)) / 32768.0;
+        case 24: return (qint32(uint(uchar(p[0])) << 8 | uint(uchar(p[1])) << 16 | uint(uchar(p[2])) << 24) >> 8) / 8388608.0;
+        default: return qint32(le32(p)) / 2147483648.0;
+        }
+    };
+
+    // linear resampling is good enough for notification beeps
+    const qint64 outFrames = frames * outputRate / rate;
+    QVector<qint16> *out = new QVector<qint16>(int(outFrames * 2));
+    qint16 *dst = out->data();
+    for (qint64 i = 0; i < outFrames; ++i) {
+        const double srcPos = double(i) * rate / outputRate;
+        const qint64 f = qint64(srcPos);
+        const double frac = srcPos - f;
+        const qint64 next = qMin(f + 1, frames - 1);
+        for (int ch = 0; ch < 2; ++ch) {
+            const double a = sample(f, ch);
+            const double v = a + (sample(next, ch) - a) * frac;
+            *dst++ = qint16(qBound(-32768L, std::lrint(v * 32767.0), 32767L));
+        }
+    }
+    return SoundEngine::Samples(out);
+}
+
+//----------------------------------------------------------------------------
+// SoundMixer
+//----------------------------------------------------------------------------
+
+// Pulled by QAudioOutput; adds up the sounds currently playing
+class SoundMixer : public QIODevice
+{
+public:
+    struct Voice
+    {
+        QString file;
+        SoundEngine::Samples samples;
+        int pos = 0;
+        QElapsedTimer requested;
+        bool started = false;
+    };
+
+    SoundMixer(SoundEngine *engine) : QIODevice(engine), engine_(engine)
+    {
+        open(QIODevice::ReadOnly);
+    }
+
+    void add(const Voice &voice)
+    {
+        if (voices_.size() >= maxVoices) {
+            voices_.removeFirst();
+        }
+        voices_.append(voice);
+    }
+
+    bool isIdle() const { return voices_.isEmpty(); }
+
+    bool isSequential() const override { return true; }
+
+    // there is always something to read, silence if nothing else
+    qint64 bytesAvailable() const override
+    {
+        return outputRate * outputFrameBytes + QIODevice::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override
+    {
+        const int count = int(maxlen / outputFrameBytes) * 2;
+        mix_.assign(count, 0);
+        for (auto it = voices_.begin(); it != voices_.end();) {
+            const int n = qMin(count, it->samples->size() - it->pos);
+            const qint16 *src = it->samples->constData() + it->pos;
+            for (int i = 0; i < n; ++i) {
+                mix_[i] += src[i];
+            }
+            it->pos += n;
+            if (!it->started) {
+                it->started = true;
+                engine_->voiceStarted(it->file, int(it->requested.elapsed()));
+            }
+            if (it->pos >= it->samples->size()) {
+                it = voices_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        qint16 *out = reinterpret_cast<qint16 *>(data);
+        for (int i = 0; i < count; ++i) {
+            out[i] = qint16(qBound(-32768, mix_[i], 32767));
+        }
+        return qint64(count) * sizeof(qint16);
+    }
+
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    SoundEngine *engine_;
+    QList<Voice> voices_;
+    std::vector<int> mix_;
+};
+
+//----------------------------------------------------------------------------
+// SoundEngine
+//----------------------------------------------------------------------------
+
+SoundEngine *SoundEngine::instance()
+{
+    static SoundEngine *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new SoundEngine();
+    }
+    return instance_;
+}
+
+SoundEngine::SoundEngine() : QObject(QCoreApplication::instance())
+{
+    idleTimer_.setSingleShot(true);
+    idleTimer_.setInterval(idleSuspendDelay);
+    connect(&idleTimer_, SIGNAL(timeout()), SLOT(suspendIfIdle()));
+    connect(PsiOptions::instance(), SIGNAL(optionChanged(QString)), SLOT(optionChanged(QString)));
+
+    // decode the configured sounds once the sound that created us is playing
+    QTimer::singleShot(0, this, [this]() {
+        PsiOptions *o = PsiOptions::instance();
+        for (const QString &option : o->getChildOptionNames(soundsOptionPath, true)) {
+            const QVariant v = o->getOption(option);
+            if (v.type() == QVariant::String) {
+                preload(v.toString());
+            }
+        }
+    });
+}
+
+/**
+ * Starts playing \a file, which must be an absolute path. Returns true if
+ * the sound was taken care of, which includes dropping a repeat of the
+ * same sound within a short interval.
+ */
+bool SoundEngine::play(const QString &file)
+{
+    QElapsedTimer requested;
+    requested.start();
+
+    Samples samples = clip(file);
+    if (!samples || !ensureOutput()) {
+        return false;
+    }
+
+    QElapsedTimer &last = lastPlayed_[file];
+    if (last.isValid() && last.elapsed() < duplicateInterval) {
+        return true;
+    }
+    last.start();
+
+    SoundMixer::Voice voice;
+    voice.file = file;
+    voice.samples = samples;
+    voice.requested = requested;
+    mixer_->add(voice);
+    if (output_->state() == QAudio::SuspendedState) {
+        output_->resume();
+    }
+    idleTimer_.start();
+    return true;
+}
+
+void SoundEngine::preload(const QString &file)
+{
+    const QString path = soundFilePath(file);
+    if (!path.isEmpty()) {
+        clip(path);
+    }
+}
+
+void SoundEngine::optionChanged(const QString &option)
+{
+    if (option.startsWith(soundsOptionPath + '.')) {
+        const QVariant v = PsiOptions::instance()->getOption(option);
+        if (v.type() == QVariant::String) {
+            preload(v.toString());
+        }
+    }
+}
+
+// an open but silent stream still costs wakeups, so let go of it after a while
+void SoundEngine::suspendIfIdle()
+{
+    if (!output_) {
+        return;
+    }
+    if (mixer_->isIdle()) {
+        output_->suspend();
+    } else {
+        idleTimer_.start();
+    }
+}
+
+bool SoundEngine::ensureOutput()
+{
+    if (output_) {
+        return true;
+    }
+    if (failed_) {
+        return false;
+    }
+
+    QAudioFormat format;
+    format.setSampleRate(outputRate);
+    format.setChannelCount(2);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+
+    QAudioDeviceInfo device = QAudioDeviceInfo::defaultOutputDevice();
+    if (device.isNull() || !device.isFormatSupported(format)) {
+        qWarning("SoundEngine: no suitable audio output, falling back to the sound player");
+        failed_ = true;
+        return false;
+    }
+
+    output_ = new QAudioOutput(device, format, this);
+    output_->setBufferSize(outputRate * outputFrameBytes * outputBufferMsecs / 1000);
+    mixer_ = new SoundMixer(this);
+    output_->start(mixer_);
+    if (output_->error() != QAudio::NoError) {
+        qWarning("SoundEngine: failed to open audio output (error %d)", int(output_->error()));
+        delete output_;
+        output_ = nullptr;
+        delete mixer_;
+        mixer_ = nullptr;
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+SoundEngine::Samples SoundEngine::clip(const QString &file)
+{
+    QFileInfo fi(file);
+    if (!fi.isFile()) {
+        return Samples();
+    }
+    auto it = clips_.constFind(file);
+    if (it != clips_.constEnd() && it->size == fi.size() && it->modified == fi.lastModified()) {
+        return it->samples;
+    }
+
+    Clip c;
+    c.size = fi.size();
+    c.modified = fi.lastModified();
+    // unsupported files are remembered too, so they go to the player without being read again
+    QFile f(file);
+    if (c.size <= maxClipFileSize && f.open(QIODevice::ReadOnly)) {
+        c.samples = decodeWav(f.readAll());
+    }
+    clips_.insert(file, c);
+    return c.samples;
+}
+
+void SoundEngine::voiceStarted(const QString &file, int latency)
+{
+    // the sample also has to get through the device buffer
+    if (output_) {
+        latency += output_->bufferSize() * 1000 / (outputRate * outputFrameBytes);
+    }
+    lastLatency_ = latency;
+    emit started(file, latency);
+}
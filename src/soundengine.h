@@ -0,0 +1,87 @@
+/*
+ * soundengine.h - in-process playback of notification sounds
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SOUNDENGINE_H
+#define SOUNDENGINE_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVector>
+
+class QAudioOutput;
+class SoundMixer;
+
+/**
+ * Plays WAV files through one audio output that stays open while sounds
+ * are coming in. Files are decoded once and kept in memory; overlapping
+ * sounds are mixed, and the same file requested again right away is
+ * played only once.
+ */
+class SoundEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef QSharedPointer<const QVector<qint16>> Samples; // interleaved stereo
+
+    static SoundEngine *instance();
+
+    // false if the file can not be played here and another player should be used
+    bool play(const QString &file);
+    void preload(const QString &file);
+
+    // from play() to the first sample handed to the audio device, in msecs
+    int lastLatency() const { return lastLatency_; }
+
+signals:
+    void started(const QString &file, int latency);
+
+private slots:
+    void optionChanged(const QString &option);
+    void suspendIfIdle();
+
+private:
+    struct Clip
+    {
+        QDateTime modified;
+        qint64    size = -1;
+        Samples   samples;
+    };
+
+    friend class SoundMixer;
+
+    SoundEngine();
+    bool ensureOutput();
+    Samples clip(const QString &file);
+    void voiceStarted(const QString &file, int latency);
+
+    QHash<QString, Clip> clips_;
+    QHash<QString, QElapsedTimer> lastPlayed_;
+    QAudioOutput *output_ = nullptr;
+    SoundMixer *mixer_ = nullptr;
+    QTimer idleTimer_;
+    bool failed_ = false;
+    int lastLatency_ = -1;
+};
+
+#endif // SOUNDENGINE_H
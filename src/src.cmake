@@ -80,6 +80,8 @@ list(APPEND HEADERS
     activeprofiles.h
     activitydlg.h
     adduserdlg.h
+    ahcbatch.h
+    ahcbatchdlg.h
     ahcformdlg.h
     ahcommanddlg.h
     alertable.h
@@ -95,7 +97,9 @@ list(APPEND HEADERS
     changepwdlg.h
     chatdlg.h
     chateditproxy.h
+    chatspellchecker.h
     chatsplitter.h
+    chatstatemanager.h
     coloropt.h
     contactlistaccountmenu.h
     contactlistdragmodel.h
@@ -111,8 +115,11 @@ list(APPEND HEADERS
     contactlistviewdelegate.h
     contactlistviewdelegate_p.h
     contactupdatesmanager.h
+    discocache.h
     discodlg.h
     edbflatfile.h
+    emoticonmatcher.h
+    entityinfocache.h
     eventdb.h
     eventdlg.h
     filecache.h
@@ -135,15 +142,18 @@ list(APPEND HEADERS
     groupmenu.h
     historycontactlistmodel.h
     historydlg.h
+    historyexport.h
     hoverabletreeview.h
     htmltextcontroller.h
     httpauthmanager.h
+    idlescheduler.h
     infodlg.h
     invitetogroupchatmenu.h
     main.h
     mainwin.h
     mainwin_p.h
     mcmdmanager.h
+    memoryaccounting.h
     miniclient.h
     mooddlg.h
     msgmle.h
@@ -159,10 +169,13 @@ list(APPEND HEADERS
     passphrasedlg.h
     pepmanager.h
     pgpkeydlg.h
+    pgpsigner.h
     pgptransaction.h
     pgputil.h
+    pgpverifier.h
     pluginhost.h
     pluginmanager.h
+    pluginworkerpool.h
     profiledlg.h
     proxy.h
     psiaccount.h
@@ -192,9 +205,15 @@ list(APPEND HEADERS
     resourcemenu.h
     rosteravatarframe.h
     rosteritemexchangetask.h
+    rostersnapshot.h
+    rosterversiontask.h
     searchdlg.h
+    seenmessages.h
     serverlistquerier.h
+    sessionjournal.h
     showtextdlg.h
+    soundengine.h
+    stanzapacer.h
     statuscombobox.h
     statusdlg.h
     statusmenu.h
@@ -203,6 +222,7 @@ list(APPEND HEADERS
     translationmanager.h
     vcardfactory.h
     vcardphotodlg.h
+    vcardstore.h
     voicecalldlg.h
     voicecaller.h
     xdata_widget.h
@@ -215,6 +235,7 @@ list(APPEND HEADERS
     ahcommandserver.h
     ahcservermanager.h
     applicationinfo.h
+    archivesync.h
     chatview.h
     chatviewcommon.h
     common.h
@@ -224,13 +245,16 @@ list(APPEND HEADERS
     desktoputil.h
     dummystream.h
     geolocation.h
+    jidkey.h
     jidutil.h
     lastactivitytask.h
+    mamquerytask.h
     mcmdcompletion.h
     messageview.h
     minicmd.h
     mood.h
     moodcatalog.h
+    pixmapcache.h
     pixmaputil.h
     popupmanager.h
     profiles.h
@@ -310,7 +334,9 @@ list(APPEND SOURCES
     alerticon.cpp
     avatars.cpp
     contactlistaccountmenu.cpp
+    discocache.cpp
     discodlg.cpp
+    entityinfocache.cpp
     eventdlg.cpp
     filetransdlg.cpp
     gcuserview.cpp
@@ -346,6 +372,8 @@ list(APPEND SOURCES
     activitycatalog.cpp
     activitydlg.cpp
     adduserdlg.cpp
+    ahcbatch.cpp
+    ahcbatchdlg.cpp
     ahcexecutetask.cpp
     ahcformdlg.cpp
     ahcommand.cpp
@@ -353,6 +381,7 @@ list(APPEND SOURCES
     alertable.cpp
     alertmanager.cpp
     applicationinfo.cpp
+    archivesync.cpp
     bobfilecache.cpp
     bookmarkmanagedlg.cpp
     bookmarkmanager.cpp
@@ -362,7 +391,9 @@ list(APPEND SOURCES
     changepwdlg.cpp
     chatdlg.cpp
     chateditproxy.cpp
+    chatspellchecker.cpp
     chatsplitter.cpp
+    chatstatemanager.cpp
     chatviewcommon.cpp
     coloropt.cpp
     common.cpp
@@ -382,6 +413,7 @@ list(APPEND SOURCES
     desktoputil.cpp
     dummystream.cpp
     edbflatfile.cpp
+    emoticonmatcher.cpp
     eventdb.cpp
     filecache.cpp
     filesharingmanager.cpp
@@ -397,16 +429,21 @@ list(APPEND SOURCES
     groupmenu.cpp
     historycontactlistmodel.cpp
     historydlg.cpp
+    historyexport.cpp
     hoverabletreeview.cpp
+    idlescheduler.cpp
     infodlg.cpp
     invitetogroupchatmenu.cpp
+    jidkey.cpp
     jidutil.cpp
     lastactivitytask.cpp
+    mamquerytask.cpp
     main.cpp
     mainwin.cpp
     mcmdcompletion.cpp
     mcmdmanager.cpp
     mcmdsimplesite.cpp
+    memoryaccounting.cpp
     messageview.cpp
     miniclient.cpp
     mood.cpp
@@ -428,11 +465,15 @@ list(APPEND SOURCES
     passphrasedlg.cpp
     pepmanager.cpp
     pgpkeydlg.cpp
+    pgpsigner.cpp
     pgptransaction.cpp
     pgputil.cpp
+    pgpverifier.cpp
+    pixmapcache.cpp
     pixmaputil.cpp
     pluginhost.cpp
     pluginmanager.cpp
+    pluginworkerpool.cpp
     popupmanager.cpp
     profiledlg.cpp
     psicapsregsitry.cpp
@@ -455,10 +496,16 @@ list(APPEND SOURCES
     resourcemenu.cpp
     rosteravatarframe.cpp
     rosteritemexchangetask.cpp
+    rostersnapshot.cpp
+    rosterversiontask.cpp
     rtparse.cpp
+    seenmessages.cpp
     serverlistquerier.cpp
+    sessionjournal.cpp
     shortcutmanager.cpp
     showtextdlg.cpp
+    soundengine.cpp
+    stanzapacer.cpp
     statuscombobox.cpp
     statusdlg.cpp
     statusmenu.cpp
@@ -474,6 +521,7 @@ list(APPEND SOURCES
     varlist.cpp
     vcardfactory.cpp
     vcardphotodlg.cpp
+    vcardstore.cpp
     voicecalldlg.cpp
     xmlconsole.cpp
     edbsqlite.cpp
@@ -98,8 +98,10 @@ include($$PWD/../iris/iris.pri)
 HEADERS += \
     $$PWD/debug.h \
     $$PWD/varlist.h \
+    $$PWD/jidkey.h \
     $$PWD/jidutil.h \
     $$PWD/showtextdlg.h \
+    $$PWD/soundengine.h \
     $$PWD/profiles.h \
     $$PWD/activeprofiles.h \
     $$PWD/profiledlg.h \
@@ -107,6 +109,8 @@ HEADERS += \
     $$PWD/desktoputil.h \
     $$PWD/fileutil.h \
     $$PWD/textutil.h \
+    $$PWD/emoticonmatcher.h \
+    $$PWD/pixmapcache.h \
     $$PWD/pixmaputil.h \
     $$PWD/psiaccount.h \
     $$PWD/psicon.h \
@@ -120,6 +124,10 @@ HEADERS += \
     $$PWD/theme.h \
     $$PWD/theme_p.h \
     $$PWD/applicationinfo.h \
+    $$PWD/archivesync.h \
+    $$PWD/seenmessages.h \
+    $$PWD/sessionjournal.h \
+    $$PWD/stanzapacer.h \
     $$PWD/pgptransaction.h \
     $$PWD/userlist.h \
     $$PWD/mainwin.h \
@@ -148,6 +156,8 @@ HEADERS += \
     $$PWD/psichatdlg.h \
     $$PWD/chatsplitter.h \
     $$PWD/chateditproxy.h \
+    $$PWD/chatspellchecker.h \
+    $$PWD/chatstatemanager.h \
     $$PWD/adduserdlg.h \
     $$PWD/minicmd.h \
     $$PWD/mcmdmanager.h \
@@ -157,6 +167,8 @@ HEADERS += \
     $$PWD/edbflatfile.h \
     $$PWD/edbsqlite.h \
     $$PWD/historydlg.h \
+    $$PWD/historyexport.h \
+    $$PWD/idlescheduler.h \
     $$PWD/historyimp.h \
     $$PWD/historycontactlistmodel.h \
     $$PWD/searchdlg.h \
@@ -165,7 +177,9 @@ HEADERS += \
     $$PWD/passphrasedlg.h \
     $$PWD/vcardfactory.h \
     $$PWD/tasklist.h \
+    $$PWD/discocache.h \
     $$PWD/discodlg.h \
+    $$PWD/entityinfocache.h \
     $$PWD/alerticon.h \
     $$PWD/alertable.h \
     $$PWD/psipopup.h \
@@ -173,12 +187,14 @@ HEADERS += \
     $$PWD/psipopupinterface.h \
     $$PWD/psiapplication.h \
     $$PWD/filecache.h \
+    $$PWD/memoryaccounting.h \
     $$PWD/avatars.h \
     $$PWD/actionlist.h \
     $$PWD/psiactionlist.h \
     $$PWD/xdata_widget.h \
     $$PWD/statuspreset.h \
     $$PWD/lastactivitytask.h \
+    $$PWD/mamquerytask.h \
     $$PWD/bobfilecache.h \
     $$PWD/mucmanager.h \
     $$PWD/mucconfigdlg.h \
@@ -187,6 +203,8 @@ HEADERS += \
     $$PWD/mucaffiliationsview.h \
     $$PWD/mucreasonseditor.h \
     $$PWD/rosteritemexchangetask.h \
+    $$PWD/rostersnapshot.h \
+    $$PWD/rosterversiontask.h \
     $$PWD/mood.h \
     $$PWD/moodcatalog.h \
     $$PWD/mooddlg.h \
@@ -207,6 +225,8 @@ HEADERS += \
     $$PWD/ahcommandserver.h \
     $$PWD/ahcommanddlg.h \
     $$PWD/ahcformdlg.h \
+    $$PWD/ahcbatch.h \
+    $$PWD/ahcbatchdlg.h \
     $$PWD/ahcexecutetask.h \
     $$PWD/ahcservermanager.h \
     $$PWD/serverlistquerier.h \
@@ -222,6 +242,7 @@ HEADERS += \
     $$PWD/psiactions.h \
     $$PWD/bookmarkmanagedlg.h \
     $$PWD/vcardphotodlg.h \
+    $$PWD/vcardstore.h \
     $$PWD/psicli.h \
     $$PWD/coloropt.h \
     $$PWD/geolocationdlg.h \
@@ -243,8 +264,10 @@ HEADERS += \
 SOURCES += \
     $$PWD/debug.cpp \
     $$PWD/varlist.cpp \
+    $$PWD/jidkey.cpp \
     $$PWD/jidutil.cpp \
     $$PWD/showtextdlg.cpp \
+    $$PWD/soundengine.cpp \
     $$PWD/psi_profiles.cpp \
     $$PWD/activeprofiles.cpp \
     $$PWD/profiledlg.cpp \
@@ -252,6 +275,8 @@ SOURCES += \
     $$PWD/desktoputil.cpp \
     $$PWD/fileutil.cpp \
     $$PWD/textutil.cpp \
+    $$PWD/emoticonmatcher.cpp \
+    $$PWD/pixmapcache.cpp \
     $$PWD/pixmaputil.cpp \
     $$PWD/accountscombobox.cpp \
     $$PWD/psievent.cpp \
@@ -263,6 +288,10 @@ SOURCES += \
     $$PWD/theme.cpp \
     $$PWD/theme_p.cpp \
     $$PWD/applicationinfo.cpp \
+    $$PWD/archivesync.cpp \
+    $$PWD/seenmessages.cpp \
+    $$PWD/sessionjournal.cpp \
+    $$PWD/stanzapacer.cpp \
     $$PWD/pgptransaction.cpp \
     $$PWD/userlist.cpp \
     $$PWD/mainwin.cpp \
@@ -290,6 +319,8 @@ SOURCES += \
     $$PWD/psichatdlg.cpp \
     $$PWD/chatsplitter.cpp \
     $$PWD/chateditproxy.cpp \
+    $$PWD/chatspellchecker.cpp \
+    $$PWD/chatstatemanager.cpp \
     $$PWD/adduserdlg.cpp \
     $$PWD/mcmdmanager.cpp \
     $$PWD/mcmdsimplesite.cpp \
@@ -299,6 +330,8 @@ SOURCES += \
     $$PWD/edbflatfile.cpp \
     $$PWD/edbsqlite.cpp \
     $$PWD/historydlg.cpp \
+    $$PWD/historyexport.cpp \
+    $$PWD/idlescheduler.cpp \
     $$PWD/historyimp.cpp \
     $$PWD/historycontactlistmodel.cpp \
     $$PWD/searchdlg.cpp \
@@ -306,7 +339,9 @@ SOURCES += \
     $$PWD/psitoolbar.cpp \
     $$PWD/passphrasedlg.cpp \
     $$PWD/vcardfactory.cpp \
+    $$PWD/discocache.cpp \
     $$PWD/discodlg.cpp \
+    $$PWD/entityinfocache.cpp \
     $$PWD/alerticon.cpp \
     $$PWD/alertable.cpp \
     $$PWD/psipopup.cpp \
@@ -314,11 +349,13 @@ SOURCES += \
     $$PWD/psipopupinterface.cpp \
     $$PWD/psiapplication.cpp \
     $$PWD/filecache.cpp \
+    $$PWD/memoryaccounting.cpp \
     $$PWD/avatars.cpp \
     $$PWD/actionlist.cpp \
     $$PWD/psiactionlist.cpp \
     $$PWD/xdata_widget.cpp \
     $$PWD/lastactivitytask.cpp \
+    $$PWD/mamquerytask.cpp \
     $$PWD/bobfilecache.cpp \
     $$PWD/statuspreset.cpp \
     $$PWD/mucmanager.cpp \
@@ -328,6 +365,8 @@ SOURCES += \
     $$PWD/mucaffiliationsview.cpp \
     $$PWD/mucreasonseditor.cpp \
     $$PWD/rosteritemexchangetask.cpp \
+    $$PWD/rostersnapshot.cpp \
+    $$PWD/rosterversiontask.cpp \
     $$PWD/mood.cpp \
     $$PWD/moodcatalog.cpp \
     $$PWD/mooddlg.cpp \
@@ -347,6 +386,8 @@ SOURCES += \
     $$PWD/ahcommandserver.cpp \
     $$PWD/ahcommanddlg.cpp \
     $$PWD/ahcformdlg.cpp \
+    $$PWD/ahcbatch.cpp \
+    $$PWD/ahcbatchdlg.cpp \
     $$PWD/ahcexecutetask.cpp \
     $$PWD/ahcservermanager.cpp \
     $$PWD/serverlistquerier.cpp \
@@ -362,6 +403,7 @@ SOURCES += \
     $$PWD/accountlabel.cpp \
     $$PWD/bookmarkmanagedlg.cpp \
     $$PWD/vcardphotodlg.cpp \
+    $$PWD/vcardstore.cpp \
     $$PWD/coloropt.cpp \
     $$PWD/geolocationdlg.cpp \
     $$PWD/rosteravatarframe.cpp \
@@ -529,11 +571,15 @@ pgputil {
     DEFINES += HAVE_PGPUTIL
     HEADERS += \
         $$PWD/pgputil.h \
-        $$PWD/pgpkeydlg.h
+        $$PWD/pgpkeydlg.h \
+        $$PWD/pgpsigner.h \
+        $$PWD/pgpverifier.h
 
     SOURCES += \
         $$PWD/pgputil.cpp \
-        $$PWD/pgpkeydlg.cpp
+        $$PWD/pgpkeydlg.cpp \
+        $$PWD/pgpsigner.cpp \
+        $$PWD/pgpverifier.cpp
 
     FORMS += \
         $$PWD/pgpkey.ui
@@ -609,11 +655,13 @@ psi_plugins {
 
     HEADERS += \
         $$PWD/pluginmanager.h \
-        $$PWD/pluginhost.h
+        $$PWD/pluginhost.h \
+        $$PWD/pluginworkerpool.h
 
     SOURCES += \
         $$PWD/pluginmanager.cpp \
-        $$PWD/pluginhost.cpp
+        $$PWD/pluginhost.cpp \
+        $$PWD/pluginworkerpool.cpp
 
     include($$PWD/plugins/plugins.pri)
 }
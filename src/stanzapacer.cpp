@@ -0,0 +1,154 @@
+/*
+ * stanzapacer.cpp - outgoing traffic budget of an account
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "stanzapacer.h"
+
+#include <cmath>
+
+static const int minWait = 10; // msecs
+
+StanzaPacer::StanzaPacer(QObject *parent) : QObject(parent)
+{
+    timer_.setSingleShot(true);
+    connect(&timer_, SIGNAL(timeout()), SLOT(dispatch()));
+    clock_.start();
+}
+
+StanzaPacer::~StanzaPacer() { }
+
+void StanzaPacer::setBudget(int stanzasPerSecond, int bytesPerSecond)
+{
+    stanzaRate_ = qMax(0, stanzasPerSecond);
+    byteRate_   = qMax(0, bytesPerSecond);
+    stanzas_    = stanzaRate_;
+    bytes_      = byteRate_;
+    refilled_   = clock_.nsecsElapsed();
+    timer_.stop();
+    schedule();
+}
+
+bool StanzaPacer::admit(Priority priority, QObject *context, std::function<void()> retry)
+{
+    refill();
+    // the retry being run goes ahead of those still waiting
+    if (priority == Interactive || (hasRoom() && (context == current_ || isFree(priority))))
+        return true;
+    enqueue(priority, QString("ctx:%1").arg(quintptr(context), 0, 16), context, retry);
+    return false;
+}
+
+void StanzaPacer::send(Priority priority, const QString &key, QObject *context, std::function<void()> fn)
+{
+    refill();
+    if (priority == Interactive || (hasRoom() && isFree(priority))) {
+        fn();
+        return;
+    }
+    enqueue(priority, key, context, fn);
+}
+
+void StanzaPacer::written(int bytes)
+{
+    ++stanzasWritten_;
+    bytesWritten_ += bytes;
+    refill();
+    // a flood of interactive traffic holds the rest back for a second at most
+    if (stanzaRate_)
+        stanzas_ = qMax<double>(-stanzaRate_, stanzas_ - 1);
+    if (byteRate_)
+        bytes_ = qMax<double>(-byteRate_, bytes_ - bytes);
+    emit countersChanged();
+}
+
+QString StanzaPacer::summary() const
+{
+    return tr("Sent: %1 stanzas, %2 KiB. Held back: %3 bulk, %4 background, %5 waiting")
+        .arg(stanzasWritten_)
+        .arg(bytesWritten_ / 1024)
+        .arg(held_[Bulk])
+        .arg(held_[Background])
+        .arg(bulk_.size() + background_.size());
+}
+
+void StanzaPacer::dispatch()
+{
+    refill();
+    // each waiter gets one turn, one running out of budget again waits anew
+    int turns = bulk_.size() + background_.size();
+    while (turns-- > 0 && hasRoom()) {
+        const Waiter w = !bulk_.isEmpty() ? bulk_.takeFirst() : background_.takeFirst();
+        if (!w.context)
+            continue;
+        current_ = w.context;
+        w.fn();
+        current_ = nullptr;
+    }
+    emit countersChanged();
+    schedule();
+}
+
+void StanzaPacer::refill()
+{
+    const qint64 now  = clock_.nsecsElapsed();
+    const double secs = (now - refilled_) / 1e9;
+    refilled_         = now;
+    stanzas_          = qMin<double>(stanzaRate_, stanzas_ + stanzaRate_ * secs);
+    bytes_            = qMin<double>(byteRate_, bytes_ + byteRate_ * secs);
+}
+
+bool StanzaPacer::hasRoom() const { return (!stanzaRate_ || stanzas_ >= 1) && (!byteRate_ || bytes_ > 0); }
+
+bool StanzaPacer::isFree(Priority priority) const
+{
+    return bulk_.isEmpty() && (priority == Bulk || background_.isEmpty());
+}
+
+void StanzaPacer::enqueue(Priority priority, const QString &key, QObject *context, std::function<void()> fn)
+{
+    QList<Waiter> &list = waiters(priority);
+    ++held_[priority];
+    if (!key.isEmpty()) {
+        for (Waiter &w : list) {
+            if (w.key == key) {
+                w.context = context;
+                w.fn      = fn;
+                return;
+            }
+        }
+    }
+    list += Waiter { key, context, fn };
+    if (!timer_.isActive())
+        schedule();
+    emit countersChanged();
+}
+
+void StanzaPacer::schedule()
+{
+    if (bulk_.isEmpty() && background_.isEmpty()) {
+        timer_.stop();
+        return;
+    }
+    // until one more stanza fits into the budget
+    double wait = 0;
+    if (stanzaRate_ && stanzas_ < 1)
+        wait = (1 - stanzas_) * 1000 / stanzaRate_;
+    if (byteRate_ && bytes_ <= 0)
+        wait = qMax(wait, (1 - bytes_) * 1000 / byteRate_);
+    timer_.start(qMax(minWait, int(std::ceil(wait))));
+}
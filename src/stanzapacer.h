@@ -0,0 +1,102 @@
+/*
+ * stanzapacer.h - outgoing traffic budget of an account
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STANZAPACER_H
+#define STANZAPACER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <functional>
+
+/**
+ * Keeps the background work of an account, like room joins, avatar fetches
+ * and contact list edits, under a budget of stanzas and bytes per second,
+ * so a server with strict rate limits doesn't throttle the whole stream.
+ *
+ * Everything the account writes is counted, and the budget allows a burst
+ * of one second. Interactive traffic, messages and own presence, is never
+ * held back. Bulk work waits while the budget is used up, and background
+ * work also waits for bulk work to get through first.
+ */
+class StanzaPacer : public QObject {
+    Q_OBJECT
+public:
+    enum Priority { Interactive, Bulk, Background };
+
+    StanzaPacer(QObject *parent = nullptr);
+    ~StanzaPacer();
+
+    // 0 for no limit
+    void setBudget(int stanzasPerSecond, int bytesPerSecond);
+
+    // true when work of that priority may go out now, otherwise retry() is
+    // called once it may. A context waits with one retry at most, and the
+    // retry is dropped with the context
+    bool admit(Priority priority, QObject *context, std::function<void()> retry);
+    // calls fn() now or once the budget allows. A waiting fn() with the same
+    // non-empty key is replaced, so only the latest of them goes out
+    void send(Priority priority, const QString &key, QObject *context, std::function<void()> fn);
+
+    // the account wrote a stanza of that many bytes
+    void written(int bytes);
+
+    QString summary() const;
+
+signals:
+    void countersChanged();
+
+private slots:
+    void dispatch();
+
+private:
+    struct Waiter {
+        QString               key;
+        QPointer<QObject>     context;
+        std::function<void()> fn;
+    };
+
+    void            refill();
+    bool            hasRoom() const;
+    bool            isFree(Priority priority) const;
+    void            enqueue(Priority priority, const QString &key, QObject *context, std::function<void()> fn);
+    void            schedule();
+    QList<Waiter> & waiters(Priority priority) { return priority == Bulk ? bulk_ : background_; }
+
+    int           stanzaRate_ = 0;
+    int           byteRate_   = 0;
+    double        stanzas_    = 0; // left of the budget
+    double        bytes_      = 0;
+    QElapsedTimer clock_;
+    qint64        refilled_ = 0; // nsecs on the clock
+    QTimer        timer_;
+    QList<Waiter> bulk_;
+    QList<Waiter> background_;
+    QObject *     current_ = nullptr; // of the retry being run
+
+    // counters
+    qint64 stanzasWritten_ = 0;
+    qint64 bytesWritten_   = 0;
+    qint64 held_[3]        = { 0, 0, 0 }; // by priority
+};
+
+#endif // STANZAPACER_H
@@ -153,3 +153,10 @@ QString SxeNewEdit::processingInstructionTarget() const {
 QString SxeNewEdit::processingInstructionData() const {
     return data_;
 }
+
+void SxeNewEdit::rebase(const QString &parent, double primaryWeight, const QString &identifier, const QString &data) {
+    parent_ = parent;
+    primaryWeight_ = primaryWeight;
+    identifier_ = identifier;
+    data_ = data;
+}
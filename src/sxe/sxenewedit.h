@@ -56,6 +56,9 @@ class SxeNewEdit : public SxeEdit {
         /*! \brief Returns the target of the processing instruction, if any.*/
         QString processingInstructionData() const;
 
+        /*! \brief Replaces the initial state of the node, used when folding later edits into this one.*/
+        void rebase(const QString &parent, double primaryWeight, const QString &identifier, const QString &data);
+
     private:
         QString type_;
         QString parent_;
@@ -28,6 +28,7 @@ static bool referencedEditLessThan(const SxeEdit* e1, const SxeEdit* e2) { retur
 SxeRecord::SxeRecord(QString rid)
     : rid_(rid)
     , version_(0)
+    , compactedVersion_(0)
     , primaryWeight_(0.)
     , lastPrimaryWeight_(0.)
 {
@@ -67,6 +68,38 @@ QList<const SxeEdit*> SxeRecord::edits() const {
     return edits;
 };
 
+void SxeRecord::compact(int keep) {
+    const int last = edits_.size() - 1 - keep;
+    if(last <= compactedVersion_ || node_.isNull())
+        return;
+
+    for(int i = 1; i <= last; i++) {
+        if(edits_[i]->type() != SxeEdit::Record)
+            return;
+    }
+
+    // replay the edits to be folded the same way reorderEdits() does
+    const QString parent = parent_, identifier = identifier_, data = data_;
+    const double primaryWeight = primaryWeight_;
+
+    revertToZero();
+    for(int i = 1; i <= last; i++) {
+        SxeRecordEdit* edit = dynamic_cast<SxeRecordEdit*>(edits_[i]);
+        if(i == edit->version() && (i+1 == edits_.size() || !edit->overridenBy(*edits_[i+1])))
+            processInOrderRecordEdit(edit);
+    }
+
+    dynamic_cast<SxeNewEdit*>(edits_[0])->rebase(parent_, primaryWeight_, identifier_, data_);
+    for(int i = 1; i <= last; i++)
+        edits_[i]->nullify();
+
+    parent_ = parent;
+    primaryWeight_ = primaryWeight;
+    identifier_ = identifier;
+    data_ = data;
+    compactedVersion_ = last;
+}
+
 bool SxeRecord::applySxeNewEdit(QDomDocument &doc, SxeNewEdit* edit) {
     if(!(edits_.size() == 0 && node_.isNull())) {
         qDebug("Someone's not behaving! Tried to apply a SxeNewEdit to an existing node.");
@@ -44,6 +44,10 @@ class SxeRecord : public QObject {
         void apply(QDomDocument &doc, SxeEdit* edit);
         /*! \brief Returns a list of edits to the node.*/
         QList<const SxeEdit*> edits() const;
+        /*! \brief Folds all but the last \a keep record edits into the initial SxeNewEdit.
+         *  The folded edits are kept as empty placeholders so that the version numbers stay intact.
+         */
+        void compact(int keep);
         /*! \brief Returns the rid of the node that the record belongs to. */
         QString rid() const;
         /*! \brief Returns the rid of the parent.*/
@@ -124,6 +128,8 @@ class SxeRecord : public QObject {
 
         QString rid_;
         int version_;
+        /*! \brief The last version folded by compact(). */
+        int compactedVersion_;
 
         /* The last* variants hold the values that were last put to the DOM node.*/
         QString parent_, lastParent_;
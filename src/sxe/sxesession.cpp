@@ -28,6 +28,12 @@ using namespace XMPP;
 
 // The maxlength of a chdata that gets put in one edit
 enum {MAXCHDATA = 1024};
+// Edits flushed within FLUSHDELAY msecs are sent together, and <sxe/> elements
+// are kept at least MINSENDINTERVAL msecs apart to stay within server rate limits
+enum {FLUSHDELAY = 50, MINSENDINTERVAL = 250};
+// The most recent edits of a record are kept as is, so that late concurrent edits
+// can still be reordered against them
+enum {UNCOMPACTEDEDITS = 16, COMPACTINTERVAL = 60000};
 
 //----------------------------------------------------------------------------
 // SxeSession
@@ -48,12 +54,34 @@ SxeSession::SxeSession(SxeManager *manager, const Jid &target, const QString &se
 
 {
     setUUIDPrefix();
+
+    flushTimer_ = new QTimer(this);
+    flushTimer_->setSingleShot(true);
+    connect(flushTimer_, SIGNAL(timeout()), SLOT(sendQueuedEdits()));
+
+    compactTimer_ = new QTimer(this);
+    connect(compactTimer_, SIGNAL(timeout()), SLOT(compactRecords()));
+    compactTimer_->start(COMPACTINTERVAL);
+}
+
+namespace {
+    // QDomNode has no qHash(). Its identity, as compared by operator==, is the
+    // shared private pointer, which a member pointer named through a subclass
+    // can read.
+    struct DomNodeAccess : public QDomNode {
+        static const void* of(const QDomNode &node) { return node.*(&DomNodeAccess::impl); }
+    };
+}
+
+const void* SxeSession::nodeKey(const QDomNode &node) {
+    return DomNodeAccess::of(node);
 }
 
 SxeSession::~SxeSession() {
     qDebug("destruct SxeSession");
     qDeleteAll(recordByNodeId_);
     recordByNodeId_.clear();
+    recordByNode_.clear();
     emit sessionEnded(this);
 }
 
@@ -66,7 +94,7 @@ void SxeSession::initializeDocument(const QDomDocument &doc) {
     doc_ = QDomDocument();
     foreach(SxeRecord* meta, recordByNodeId_.values())
         meta->deleteLater();
-    // recordByNode_.clear();
+    recordByNode_.clear();
     recordByNodeId_.clear();
     queuedIncomingEdits_.clear();
     queuedOutgoingEdits_.clear();
@@ -106,12 +134,9 @@ bool SxeSession::processSxe(const QDomElement &sxe, const QString &id) {
     if(!id.isEmpty())
         usedSxeIds_ += id;
 
-    // store incoming edits when queueing
+    // store incoming edits when queueing. the id check above already
+    // keeps duplicates out of the queue
     if(queueing_) {
-        // Make sure the element is not already in the queue.
-        foreach(IncomingEdit i, queuedIncomingEdits_)
-            if(i.xml == sxe)  return false;
-
         IncomingEdit incoming;
         incoming.id = id;
         incoming.xml = sxe.cloneNode(true).toElement();
@@ -183,6 +208,9 @@ QList<const SxeEdit*> SxeSession::startQueueing() {
 
     queueing_ = true;
 
+    // keep the snapshot proportional to the document rather than to its history
+    compactRecords();
+
     // Return all the effective Edits to the session so far (snapshot)
     // make sure that they are added in the right order (parents first)
     QString rootid;
@@ -257,6 +285,8 @@ void SxeSession::stopImporting() {
 }
 
 void SxeSession::endSession() {
+    // don't lose edits that are waiting for the flush timer
+    sendQueuedEdits();
     deleteLater();
 }
 
@@ -461,6 +491,22 @@ void SxeSession::setNodeValue(const QDomNode &node, const QString &value, int fr
 }
 
 void SxeSession::flush() {
+    if(queuedOutgoingEdits_.isEmpty() || flushTimer_->isActive())
+        return;
+
+    int delay = FLUSHDELAY;
+    if(sinceSent_.isValid())
+        delay = qMax(delay, int(MINSENDINTERVAL - sinceSent_.elapsed()));
+    flushTimer_->start(delay);
+}
+
+void SxeSession::compactRecords() {
+    foreach(SxeRecord* meta, recordByNodeId_)
+        meta->compact(UNCOMPACTEDEDITS);
+}
+
+void SxeSession::sendQueuedEdits() {
+    flushTimer_->stop();
     if(queuedOutgoingEdits_.isEmpty())
         return;
 
@@ -475,6 +521,7 @@ void SxeSession::flush() {
     }
 
     // pass the bundle to SxeManager
+    sinceSent_.start();
     emit newSxeElement(sxe, target(), groupChat_);
 }
 
@@ -645,6 +692,10 @@ void SxeSession::reposition(const QDomNode &node, bool remote) {
 // }
 
 void SxeSession::handleNodeToBeAdded(const QDomNode &node, bool remote) {
+    SxeRecord* meta = qobject_cast<SxeRecord*>(sender());
+    if(meta)
+        recordByNode_[nodeKey(node)] = meta;
+
     emit nodeToBeAdded(node, remote);
     reposition(node, remote);
     emit nodeAdded(node, remote);
@@ -662,14 +713,9 @@ void SxeSession::handleNodeToBeRemoved(const QDomNode &node, bool remote) {
 }
 
 void SxeSession::removeRecord(const QDomNode &node) {
-    QMutableHashIterator<QString, SxeRecord*> i(recordByNodeId_);
-
-    while(i.hasNext()) {
-        if(node == i.next().value()->node()) {
-            i.remove();
-            return;
-        }
-    }
+    SxeRecord* meta = recordByNode_.take(nodeKey(node));
+    if(meta)
+        recordByNodeId_.remove(meta->rid());
 }
 
 bool SxeSession::removeSmaller(SxeRecord* meta1, SxeRecord* meta2) {
@@ -693,7 +739,7 @@ void SxeSession::addUsedSxeId(QString id) {
     usedSxeIds_ += id;
 }
 
-QList<QString> SxeSession::usedSxeIds() {
+QSet<QString> SxeSession::usedSxeIds() {
     return usedSxeIds_;
 }
 
@@ -738,14 +784,7 @@ SxeRecord* SxeSession::record(const QDomNode &node) const {
     if(node.isNull())
         return nullptr;
 
-    // go through all the SxeRecord's
-    foreach(SxeRecord* meta, recordByNodeId_.values()) {
-        // qDebug() << QString("id: %1").arg(meta->rid()).toLatin1();
-        if(node == meta->node())
-            return meta;
-    }
-
-    return nullptr;
+    return recordByNode_.value(nodeKey(node));
 }
 
 void SxeSession::setUUIDPrefix(const QString uuidPrefix) {
@@ -25,13 +25,16 @@
 #include "sxerecord.h"
 
 #include <QDomNode>
+#include <QElapsedTimer>
 #include <QList>
 #include <QObject>
 #include <QPointer>
+#include <QSet>
 
 #define SXENS "http://jabber.org/protocol/sxe"
 /*  ^^^^ make sure corresponds to NS used for parsing in iris/src/xmpp/xmpp-im/types.cpp ^^^^ */
 
+class QTimer;
 class SxeManager;
 
 namespace XMPP {
@@ -103,8 +106,8 @@ class SxeSession : public QObject {
 
         /*! \brief Add the given ID to the list of used IDs for <sxe/> elements.*/
         void addUsedSxeId(QString id);
-        /*! \brief Return the list of used IDs for <sxe/> elements.*/
-        QList<QString> usedSxeIds();
+        /*! \brief Return the set of used IDs for <sxe/> elements.*/
+        QSet<QString> usedSxeIds();
 
         void setUUIDPrefix(const QString uuidPrefix = QString());
         /*! \brief Returns a random UUID without enclosing { }. */
@@ -132,7 +135,10 @@ class SxeSession : public QObject {
         /*! \brief Sets the value of \a node to \a value. */
         void setNodeValue(const QDomNode &node, const QString &value, int from = -1, int n = 0);
 
-        /*! \brief Sends all queued edits.*/
+        /*! \brief Sends all queued edits.
+         *  Edits flushed within a short window, and while the previous <sxe/> is too recent,
+         *  go out together in a single <sxe/> element.
+         */
         void flush();
 
     signals:
@@ -176,12 +182,18 @@ class SxeSession : public QObject {
         void handleNodeToBeRemoved(const QDomNode &node, bool remote);
         /*! \brief Add a node node to the lookup table. */
         // void addToLookup(const QDomNode &node, bool, const QString &rid);
+        /*! \brief Sends the queued edits in one <sxe/> element right away. */
+        void sendQueuedEdits();
+        /*! \brief Folds the older edits of each record, so the history doesn't grow with the session. */
+        void compactRecords();
 
     private:
         /*! \brief Inserts or moves a node according to it's record (parent and primary-weight). */
         void reposition(const QDomNode &node, bool remote);
         /*! \brief Remove the record associated with \a node from the lookup tables. */
         void removeRecord(const QDomNode &node);
+        /*! \brief Returns a key identifying \a node for recordByNode_. */
+        static const void* nodeKey(const QDomNode &node);
         /*! \brief Remove the item with smaller secondary weight.
             Returns true iff \a meta1 was removed. */
         bool removeSmaller(SxeRecord* meta1, SxeRecord* meta2);
@@ -223,10 +235,18 @@ class SxeSession : public QObject {
                 QString,
                 SxeRecord*
              > recordByNodeId_;
+        /*! \brief Hash used for node -> SxeRecord* lookups, keyed by nodeKey().*/
+        QHash<const void*, SxeRecord*> recordByNode_;
         /*! \brief List of queued incoming sxe elements.*/
         QList<IncomingEdit> queuedIncomingEdits_;
         /*! \brief List of queued outgoing sxe elements.*/
         QList<QDomNode> queuedOutgoingEdits_;
+        /*! \brief Delays flushes so that they can be sent together.*/
+        QTimer *flushTimer_;
+        /*! \brief Time since the last <sxe/> element was sent.*/
+        QElapsedTimer sinceSent_;
+        /*! \brief Triggers compactRecords() periodically.*/
+        QTimer *compactTimer_;
         /*! \brief QDomDocument representing the the contents when queueing_ was set true.*/
         QList<SxeEdit*> snapshot_;
         /*! \brief True if the target is a groupchat.*/
@@ -240,7 +260,7 @@ class SxeSession : public QObject {
         /*! \brief A list of supported features for the session.*/
         QList<QString> features_;
          /*! \brief Identifiers for the <sxe/> elements that have been processed already.*/
-        QList<QString> usedSxeIds_;
+        QSet<QString> usedSxeIds_;
         /*! \brief A unique id is generated as "uuidPrefix.counter".*/
         QString uuidPrefix_;
         int uuidMaxPostfix_;
@@ -70,26 +70,21 @@ void TabCompletion::moveCursorToOffset(QTextCursor &cur, int offset, QTextCursor
 
 /** Find longest common (case insensitive) prefix of \a list.
     */
-QString TabCompletion::longestCommonPrefix(QStringList list) {
+QString TabCompletion::longestCommonPrefix(const QStringList &list) {
     QString candidate = list.first().toLower();
     int len = candidate.length();
-    while (len > 0) {
-        bool found = true;
-        foreach(QString str, list) {
-            if (str.left(len).toLower() != candidate) {
-                found = false;
-                break;
-            }
+    for (const QString &str : list) { // shrink once per string, no rescans
+        int i = 0;
+        int n = qMin(len, str.length());
+        while (i < n && str.at(i).toLower() == candidate.at(i)) {
+            ++i;
         }
-
-        if (found) {
+        len = i;
+        if (len == 0) {
             break;
         }
-
-        --len;
-        candidate = candidate.left(len);
     }
-    return candidate;
+    return candidate.left(len);
 }
 
 void TabCompletion::setup(QString text, int pos, int &start, int &end) {
@@ -51,7 +51,7 @@ protected:
 
 private:
 
-    QString longestCommonPrefix(QStringList list);
+    QString longestCommonPrefix(const QStringList &list);
     QString suggestCompletion(bool *replaced);
 
     void moveCursorToOffset(QTextCursor &cur, int offset, QTextCursor::MoveMode mode = QTextCursor::MoveAnchor);
@@ -52,6 +52,14 @@ TabbableWidget::TabbableWidget(const Jid &jid, PsiAccount *pa, TabManager *tabMa
             deactivated();
         }
     });
+    hibernateTimer_.setSingleShot(true);
+    connect(&hibernateTimer_, &QTimer::timeout, this, [this](){
+        // a tab still on screen keeps its content, it is hibernated on the next deactivation
+        if (isVisible() && !window()->isMinimized()) {
+            return;
+        }
+        hibernate();
+    });
     //QTimer::singleShot(0, this, SLOT(ensureTabbedCorrectly()));
 }
 
@@ -156,9 +164,30 @@ const QString& TabbableWidget::getDisplayName() const
 
 void TabbableWidget::deactivated()
 {
+    int minutes = PsiOptions::instance()->getOption("options.ui.tabs.hibernate-after").toInt();
+    if (minutes > 0) {
+        hibernateTimer_.start(minutes * 60 * 1000);
+    }
 }
 
 void TabbableWidget::activated()
+{
+    hibernateTimer_.stop();
+    wake();
+}
+
+/**
+ * Called when the tab was not looked at for options.ui.tabs.hibernate-after
+ * minutes. Reimplement to release heavy resources which can be rebuilt in wake().
+ */
+void TabbableWidget::hibernate()
+{
+}
+
+/**
+ * Called before a hibernated tab is shown again.
+ */
+void TabbableWidget::wake()
 {
 }
 
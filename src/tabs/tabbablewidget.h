@@ -86,6 +86,8 @@ protected:
     virtual void setJid(const Jid&);
     virtual void deactivated();
     virtual void activated();
+    virtual void hibernate();
+    virtual void wake();
 
     // reimplemented
     void changeEvent(QEvent* e);
@@ -94,6 +96,7 @@ private:
     enum class ActivationState : char { Activated, Deactivated };
     ActivationState state_;
     QTimer stateCommitTimer_;
+    QTimer hibernateTimer_;
 
     Jid jid_;
     PsiAccount *pa_;
@@ -3,6 +3,7 @@
 #include "textutil.h"
 
 #include "coloropt.h"
+#include "emoticonmatcher.h"
 #include "psiiconset.h"
 #include "psioptions.h"
 #include "rtparse.h"
@@ -471,73 +472,30 @@ QString TextUtil::linkify(const QString &in)
 // sickening
 QString TextUtil::emoticonify(const QString &in)
 {
+    const EmoticonMatcher &matcher = PsiIconset::instance()->emoticonMatcher();
+
     RTParse p(in);
     while ( !p.atEnd() ) {
         // returns us the first chunk as a plaintext string
         QString str = p.next();
 
         int i = 0;
-        while ( i >= 0 ) {
-            // find closest emoticon
-            int ePos = -1;
-            PsiIcon *closest = nullptr;
-
-            int foundPos = -1, foundLen = -1;
-
-            foreach(const Iconset* iconset, PsiIconset::instance()->emoticons) {
-                QListIterator<PsiIcon*> it = iconset->iterator();
-                while ( it.hasNext()) {
-                    PsiIcon *icon = it.next();
-                    if ( icon->regExp().isEmpty() )
-                        continue;
-
-                    // some hackery
-                    int iii = i;
-                    bool searchAgain;
-
-                    do {
-                        searchAgain = false;
-
-                        // find the closest match
-                        const QRegExp &rx = icon->regExp();
-                        int n = rx.indexIn(str, iii);
-                        if ( n == -1 )
-                            continue;
-
-                        if(ePos == -1 || n < ePos || (rx.matchedLength() > foundLen && n < ePos + foundLen)) {
-                            bool leftSpace  = n == 0 || (n > 0 && str[n-1].isSpace());
-                            bool rightSpace = (n+rx.matchedLength() == int(str.length())) || (n+rx.matchedLength() < int(str.length()) && str[n+rx.matchedLength()].isSpace());
-                            // there must be whitespace at least on one side of the emoticon
-                            if (leftSpace || rightSpace) {
-                                ePos = n;
-                                closest = icon;
-
-                                foundPos = n;
-                                foundLen = rx.matchedLength();
-                                break;
-                            }
-
-                            searchAgain = true;
-                        }
-
-                        iii = n + rx.matchedLength();
-                    } while ( searchAgain );
-                }
-            }
-
-            QString s;
-            if(ePos == -1)
-                s = str.mid(i);
-            else
-                s = str.mid(i, ePos-i);
-            p.putPlain(s);
+        foreach(const EmoticonMatcher::Match &m, matcher.findAll(str)) {
+            if ( m.pos < i )
+                continue;
 
-            if ( !closest )
-                break;
+            int end = m.pos + m.length;
+            bool leftSpace  = m.pos == 0 || str[m.pos-1].isSpace();
+            bool rightSpace = end == str.length() || str[end].isSpace();
+            // there must be whitespace at least on one side of the emoticon
+            if ( !leftSpace && !rightSpace )
+                continue;
 
-            p.putRich( QString("<icon name=\"%1\" text=\"%2\">").arg(TextUtil::escape(closest->name())).arg(TextUtil::escape(str.mid(foundPos, foundLen))) );
-            i = foundPos + foundLen;
+            p.putPlain(str.mid(i, m.pos-i));
+            p.putRich( QString("<icon name=\"%1\" text=\"%2\">").arg(TextUtil::escape(m.icon->name())).arg(TextUtil::escape(str.mid(m.pos, m.length))) );
+            i = end;
         }
+        p.putPlain(str.mid(i));
     }
 
     QString out = p.output();
@@ -570,6 +528,196 @@ QString TextUtil::legacyFormat(const QString& in)
     return out;
 }
 
+static inline bool format_isEmailChar(const QChar &c)
+{
+    return c.isLetterOrNumber() || linkify_isOneOf(c, "_.-+");
+}
+
+// end of the url starting at x1, with trailing punctuation hacked off like in linkify()
+static int format_urlEnd(const QString &in, int x1, int from, int limit)
+{
+    int brackets[6] = { 0, 0, 0, 0, 0, 0 };
+    static const QString bracketChars = QStringLiteral("()[]{}");
+
+    int x2;
+    for (x2 = from; x2 < limit; ++x2) {
+        const QChar c = in.at(x2);
+        if (c.isSpace() || linkify_isOneOf(c, "\"\'`<>"))
+            break;
+        int b = bracketChars.indexOf(c);
+        if (b != -1)
+            ++brackets[b];
+    }
+
+    int cutoff;
+    for (cutoff = x2 - 1; cutoff >= x1; --cutoff) {
+        const QChar c = in.at(cutoff);
+        if (!linkify_isOneOf(c, "!?,.()[]{}<>\""))
+            break;
+        int b = bracketChars.indexOf(c);
+        if (b != -1 && (b & 1) && brackets[b] - brackets[b - 1] <= 0)
+            break; // closing bracket which has its opening one inside the url
+        if (b != -1)
+            --brackets[b];
+    }
+    return cutoff + 1;
+}
+
+/**
+ * Produces the same markup as the plain2rich/linkify/emoticonify/legacyFormat
+ * chain (modulo corner cases where the chain produced broken nesting), but
+ * reads the text once and writes to a single buffer.
+ */
+QString TextUtil::formatPlain(const QString &plain, int flags)
+{
+    struct Prefix {
+        const char *text;
+        int         skip; // part of the prefix which can't be the end of url
+        const char *href;
+    };
+    static const Prefix prefixes[] = { { "xmpp:", 5, "" },    { "mailto:", 7, "" }, { "http://", 7, "" },
+                                       { "https://", 8, "" }, { "ftp://", 6, "" },  { "news://", 7, "" },
+                                       { "ed2k://", 7, "" },  { "file://", 7, "" }, { "magnet:", 7, "" },
+                                       { "www.", 0, "http://" }, { "ftp.", 0, "ftp://" } };
+
+    QList<EmoticonMatcher::Match> emoticons;
+    if (flags & Emoticons)
+        emoticons = PsiIconset::instance()->emoticonMatcher().findAll(plain);
+    int nextEmoticon = 0;
+
+    QString linkStyle; // computed on first link
+    QString out;
+    out.reserve(plain.size() + plain.size() / 8 + 16);
+
+    const int len           = plain.length();
+    int       noLinkUntil   = 0;
+    int       noEmailUntil  = 0;
+    int       afterTag      = 0;  // position right after emitted markup, it separates words like a space
+    int       closeAt       = -1; // position of the closing legacy formatting marker
+    int       openedAt      = -1;
+    QString   closeTag;
+
+    for (int i = 0; i < len; ++i) {
+        const int   limit = closeAt != -1 ? closeAt : len;
+        const QChar c     = plain.at(i);
+
+        // legacy formatting: _underline_ *bold* /italic/ on whole words
+        if ((flags & LegacyFormatting) && closeAt == -1 && linkify_isOneOf(c, "_*/")
+            && (i == 0 || plain.at(i - 1).isSpace() || i == afterTag)) {
+            int j = i + 1;
+            while (j < len && !plain.at(j).isSpace())
+                ++j;
+            if (j - i >= 3 && plain.at(j - 1) == c) {
+                const char *tag = c == '_' ? "u" : c == '*' ? "b" : "i";
+                out += QString("<%1>").arg(QLatin1String(tag));
+                out += c;
+                closeTag = QString("</%1>").arg(QLatin1String(tag));
+                closeAt  = j - 1;
+                openedAt = i;
+                continue;
+            }
+        }
+
+        if ((flags & Linkify) && i >= noLinkUntil && !(i > 0 && plain.at(i - 1).isLetterOrNumber())) {
+            const Prefix *p = nullptr;
+            for (const Prefix &pr : prefixes) {
+                if (linkify_pmatch(plain, i, QLatin1String(pr.text))) {
+                    p = &pr;
+                    break;
+                }
+            }
+            if (p && i + p->skip <= limit) {
+                int     end  = format_urlEnd(plain, i, i + p->skip, limit);
+                QString link = plain.mid(i, end - i);
+                if (!link.isEmpty() && linkify_okUrl(link)) {
+                    QString href = linkify_htmlsafe(escape(QLatin1String(p->href) + link));
+#ifdef WEBKIT
+                    out += QString("<a href=\"%1\">").arg(href);
+#else
+                    if (linkStyle.isEmpty())
+                        linkStyle = ColorOpt::instance()->color("options.ui.look.colors.messages.link").name();
+                    out += QString("<a href=\"%1\" style=\"color:%2\">").arg(href, linkStyle);
+#endif
+                    out += escape(link) + "</a>";
+                    i        = end - 1;
+                    afterTag = end;
+                    continue;
+                }
+                noLinkUntil = i + link.length() + 1;
+            }
+        }
+
+        if ((flags & Linkify) && i >= noEmailUntil && format_isEmailChar(c)
+            && (i == 0 || !format_isEmailChar(plain.at(i - 1)) || i == openedAt + 1)) {
+            int j = i;
+            while (j < limit && format_isEmailChar(plain.at(j)))
+                ++j;
+            if (j < limit && plain.at(j) == '@') {
+                int k = j + 1;
+                while (k < limit && format_isEmailChar(plain.at(k)))
+                    ++k;
+                QString addy = plain.mid(i, k - i);
+                if (linkify_okEmail(addy)) {
+                    out += QString("<a href=\"x-psi-atstyle:%1\">").arg(addy) + addy + "</a>";
+                    i        = k - 1;
+                    afterTag = k;
+                    continue;
+                }
+            }
+            noEmailUntil = j;
+        }
+
+        if (flags & Emoticons) {
+            while (nextEmoticon < emoticons.size() && emoticons[nextEmoticon].pos < i)
+                ++nextEmoticon;
+            if (nextEmoticon < emoticons.size() && emoticons[nextEmoticon].pos == i) {
+                const EmoticonMatcher::Match &m = emoticons[nextEmoticon];
+                int  end        = m.pos + m.length;
+                bool leftSpace  = i == 0 || plain.at(i - 1).isSpace() || i == afterTag;
+                bool rightSpace = end == len || plain.at(end).isSpace();
+                // there must be whitespace at least on one side of the emoticon
+                if (end <= limit && (leftSpace || rightSpace)) {
+                    out += QString("<icon name=\"%1\" text=\"%2\">")
+                               .arg(escape(m.icon->name()), escape(plain.mid(m.pos, m.length)));
+                    i = end - 1;
+                    continue;
+                }
+            }
+        }
+
+#ifdef Q_OS_WIN
+        if (c == '\r' && i + 1 < len && plain.at(i + 1) == '\n')
+            continue; // Qt/Win sees \r\n as two new line chars
+#endif
+        if (c == '\n')
+            out += "<br>";
+        else if (c == ' ' && !out.isEmpty() && out.at(out.size() - 1) == ' ')
+            out += "&nbsp;"; // instead of pre-wrap, which prewraps \n as well
+        else if (c == '\t')
+            out += "&nbsp; &nbsp; &nbsp; ";
+        else if (c == '<')
+            out += "&lt;";
+        else if (c == '>')
+            out += "&gt;";
+        else if (c == '\"')
+            out += "&quot;";
+        else if (c == '\'')
+            out += "&apos;";
+        else if (c == '&')
+            out += "&amp;";
+        else
+            out += c;
+
+        if (i == closeAt) {
+            out += closeTag;
+            closeAt  = -1;
+            afterTag = i + 1;
+        }
+    }
+
+    return out;
+}
+
 QString TextUtil::sizeUnit(qlonglong n, qlonglong *div)
 {
     qlonglong gb = 1024 * 1024 * 1024;
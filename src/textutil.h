@@ -16,6 +16,15 @@ namespace TextUtil {
     QString emoticonify(const QString &in);
     QString img2title(const QString &in);
 
+    enum FormatFlags {
+        Linkify          = 0x1,
+        Emoticons        = 0x2,
+        LegacyFormatting = 0x4
+    };
+    // plain2rich() followed by linkify(), emoticonify() and legacyFormat()
+    // as selected by flags, done in a single scan
+    QString formatPlain(const QString &plain, int flags);
+
     QString prepareMessageText(const QString& text, bool isEmote=false, bool isHtml=false);
     QString sizeUnit(qlonglong n, qlonglong *div = nullptr);
 }; // namespace TextUtil
@@ -19,15 +19,16 @@
 
 #include "anim.h"
 
+#include "animtimer.h"
 #include "iconset.h"
 
 //#include <QApplication>
 #include <QBuffer>
 #include <QImage>
 #include <QImageReader>
+#include <QMetaMethod>
 #include <QObject>
 #include <QThread>
-#include <QTimer>
 
 /**
  * \class Anim
@@ -46,7 +47,7 @@ class Anim::Private : public QObject, public QSharedData
 {
     Q_OBJECT
 public:
-    QTimer *frametimer;
+    AnimTimer *frametimer;
 
     bool empty;
     bool paused;
@@ -68,7 +69,7 @@ public:
 public:
     void init()
     {
-        frametimer = new QTimer();
+        frametimer = new AnimTimer();
         if (animMainThread && animMainThread != QThread::currentThread()) {
             frametimer->moveToThread(animMainThread);
             moveToThread(animMainThread);
@@ -181,9 +182,15 @@ public:
         return frames.count();
     }
 
+    // nobody is going to repaint the frame, so don't waste the clock on it
+    bool hasListeners() const
+    {
+        return isSignalConnected(QMetaMethod::fromSignal(&Private::areaChanged));
+    }
+
     void restartTimer()
     {
-        if ( !paused && speed > 0 ) {
+        if ( !paused && speed > 0 && hasListeners() ) {
             int frameperiod = frames[frame].period;
             int i = frameperiod >= 0 ? frameperiod * 100/speed : 0;
             if ( i != lasttimerinterval || !frametimer->isActive() ) {
@@ -195,6 +202,19 @@ public:
         }
     }
 
+protected:
+    void connectNotify(const QMetaMethod &signal)
+    {
+        if ( signal == QMetaMethod::fromSignal(&Private::areaChanged) )
+            restartTimer();
+    }
+
+    void disconnectNotify(const QMetaMethod &signal)
+    {
+        if ( !signal.isValid() || signal == QMetaMethod::fromSignal(&Private::areaChanged) )
+            restartTimer();
+    }
+
 signals:
     void areaChanged();
 
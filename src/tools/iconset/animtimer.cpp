@@ -0,0 +1,231 @@
+/*
+ * animtimer.cpp - timer driven by the shared animation clock
+ * Copyright (C) 2003-2006  Michail Pishchagin
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "animtimer.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QList>
+#include <QPointer>
+#include <QTimer>
+
+/**
+ * \class AnimTimer
+ * \brief QTimer replacement for animations
+ *
+ * All active AnimTimers share one underlying QTimer. Deadlines are rounded
+ * to a common tick, so timers which are due at about the same time fire
+ * together on a single wakeup. The clock sleeps while the application
+ * is hidden or suspended.
+ */
+
+static const int animTick = 20; /* msecs */
+
+//! \if _hide_doc_
+class AnimClock : public QObject
+{
+    Q_OBJECT
+public:
+    static AnimClock *instance()
+    {
+        if (!instance_)
+            instance_ = new AnimClock();
+        return instance_;
+    }
+
+    // doesn't create the clock, e.g. for timers destroyed after the application
+    static AnimClock *existing()
+    {
+        return instance_;
+    }
+
+    qint64 now() const
+    {
+        return elapsed_.elapsed();
+    }
+
+    void schedule(AnimTimer *t)
+    {
+        if (!timers_.contains(t))
+            timers_.append(t);
+        reschedule();
+    }
+
+    void unschedule(AnimTimer *t)
+    {
+        timers_.removeOne(t);
+        if (timers_.isEmpty())
+            timer_->stop();
+    }
+
+private:
+    AnimClock()
+        : QObject(QCoreApplication::instance())
+        , timer_(new QTimer(this))
+        , suspended_(false)
+    {
+        elapsed_.start();
+        timer_->setSingleShot(true);
+        connect(timer_, SIGNAL(timeout()), SLOT(tick()));
+
+        QGuiApplication *app = qobject_cast<QGuiApplication*>(QCoreApplication::instance());
+        if (app)
+            connect(app, SIGNAL(applicationStateChanged(Qt::ApplicationState)), SLOT(stateChanged(Qt::ApplicationState)));
+    }
+
+    void reschedule()
+    {
+        if (timers_.isEmpty() || suspended_) {
+            timer_->stop();
+            return;
+        }
+
+        qint64 due = timers_.first()->due_;
+        foreach(AnimTimer *t, timers_)
+            due = qMin(due, t->due_);
+
+        // align the wakeup to the common tick
+        due = ((due + animTick - 1) / animTick) * animTick;
+        timer_->start(int(qMax(qint64(0), due - now())));
+    }
+
+private slots:
+    void tick()
+    {
+        const qint64 t = now() + animTick / 2;
+
+        QList<QPointer<AnimTimer> > fired;
+        QMutableListIterator<AnimTimer*> it(timers_);
+        while (it.hasNext()) {
+            AnimTimer *at = it.next();
+            if (at->due_ > t)
+                continue;
+
+            if (at->singleShot_) {
+                at->due_ = -1;
+                it.remove();
+            }
+            else {
+                at->due_ = now() + at->interval_;
+            }
+            fired << at;
+        }
+
+        foreach(QPointer<AnimTimer> at, fired) {
+            if (at)
+                emit at->timeout();
+        }
+
+        reschedule();
+    }
+
+    void stateChanged(Qt::ApplicationState state)
+    {
+        suspended_ = (state == Qt::ApplicationHidden || state == Qt::ApplicationSuspended);
+        reschedule();
+    }
+
+private:
+    static QPointer<AnimClock> instance_;
+
+    QTimer *timer_;
+    QElapsedTimer elapsed_;
+    QList<AnimTimer*> timers_;
+    bool suspended_;
+};
+
+QPointer<AnimClock> AnimClock::instance_;
+//! \endif
+
+/**
+ * Creates an inactive repeating timer.
+ */
+AnimTimer::AnimTimer(QObject *parent)
+    : QObject(parent)
+    , interval_(0)
+    , singleShot_(false)
+    , due_(-1)
+{
+}
+
+AnimTimer::~AnimTimer()
+{
+    stop();
+}
+
+int AnimTimer::interval() const
+{
+    return interval_;
+}
+
+void AnimTimer::setInterval(int msecs)
+{
+    interval_ = msecs;
+    if (isActive())
+        start();
+}
+
+bool AnimTimer::isSingleShot() const
+{
+    return singleShot_;
+}
+
+void AnimTimer::setSingleShot(bool singleShot)
+{
+    singleShot_ = singleShot;
+}
+
+bool AnimTimer::isActive() const
+{
+    return due_ >= 0;
+}
+
+/**
+ * Returns the granularity of the shared clock in milliseconds.
+ */
+int AnimTimer::tickInterval()
+{
+    return animTick;
+}
+
+void AnimTimer::start()
+{
+    AnimClock *clock = AnimClock::instance();
+    due_ = clock->now() + interval_;
+    clock->schedule(this);
+}
+
+void AnimTimer::start(int msecs)
+{
+    interval_ = msecs;
+    start();
+}
+
+void AnimTimer::stop()
+{
+    if (!isActive())
+        return;
+
+    due_ = -1;
+    if (AnimClock::existing())
+        AnimClock::existing()->unschedule(this);
+}
+
+#include "animtimer.moc"
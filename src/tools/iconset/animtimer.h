@@ -0,0 +1,58 @@
+/*
+ * animtimer.h - timer driven by the shared animation clock
+ * Copyright (C) 2003-2006  Michail Pishchagin
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ANIMTIMER_H
+#define ANIMTIMER_H
+
+#include <QObject>
+
+class AnimTimer : public QObject
+{
+    Q_OBJECT
+public:
+    AnimTimer(QObject *parent = nullptr);
+    ~AnimTimer();
+
+    int interval() const;
+    void setInterval(int msecs);
+
+    bool isSingleShot() const;
+    void setSingleShot(bool singleShot);
+
+    bool isActive() const;
+
+    static int tickInterval();
+
+public slots:
+    void start();
+    void start(int msecs);
+    void stop();
+
+signals:
+    void timeout();
+
+private:
+    int interval_;
+    bool singleShot_;
+    qint64 due_;
+
+    friend class AnimClock;
+};
+
+#endif // ANIMTIMER_H
@@ -35,13 +35,22 @@
 
 #include <QBuffer>
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
 #include <QDomDocument>
 #include <QFile>
 #include <QFileInfo>
+#include <QHash>
 #include <QIcon>
+#include <QImageReader>
 #include <QLocale>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QObject>
 #include <QRegExp>
+#include <QSaveFile>
 #include <QTextCodec>
 #include <QThread>
 #include <QTimer>
@@ -49,7 +58,6 @@
 #include <QSharedData>
 #include <QSharedDataPointer>
 #ifdef ICONSET_SOUND
-#    include <QDataStream>
 #    include <qca_basic.h>
 #endif
 
@@ -138,6 +146,14 @@ bool Impix::isNull() const
     return !d->image.isNull() || d->pixmap ? false: true;
 }
 
+qint64 Impix::byteCount() const
+{
+    qint64 bytes = qint64(d->image.bytesPerLine()) * d->image.height();
+    if (d->pixmap)
+        bytes += qint64(d->pixmap->width()) * d->pixmap->height() * d->pixmap->depth() / 8;
+    return bytes;
+}
+
 const QPixmap & Impix::pixmap() const
 {
     if (!d->pixmap) {
@@ -215,6 +231,54 @@ private:
 
 static IconSharedObject *iconSharedObject = nullptr;
 
+static QString iconsetCacheDir;
+static const quint32 iconsetCacheMagic = 0x50534943; // "PSIC"
+static const quint32 iconsetCacheVersion = 1;
+
+//----------------------------------------------------------------------------
+// IconCache
+//----------------------------------------------------------------------------
+
+// Keeps track of lazily decoded icons, so decoded frames of the icons which
+// weren't used for a while could be dropped when the limit is exceeded.
+// They're decoded again from the retained source data on next use.
+class IconCache : public QObject
+{
+    Q_OBJECT
+public:
+    static IconCache *instance()
+    {
+        static IconCache *cache = nullptr;
+        if ( !cache ) {
+            cache = new IconCache();
+            if ( QCoreApplication::instance() )
+                cache->moveToThread(QCoreApplication::instance()->thread());
+        }
+        return cache;
+    }
+
+    void touch(PsiIcon::Private *p, qint64 bytes);
+    void remove(PsiIcon::Private *p);
+
+    qint64 limit;
+
+private slots:
+    void trim();
+
+private:
+    IconCache()
+        : limit(16 * 1024 * 1024)
+        , total_(0)
+        , trimScheduled_(false)
+    {}
+
+    QMutex mutex_;
+    QList<PsiIcon::Private*> lru_;
+    QHash<PsiIcon::Private*, qint64> sizes_;
+    qint64 total_;
+    bool trimScheduled_;
+};
+
 //----------------------------------------------------------------------------
 // PsiIcon
 //----------------------------------------------------------------------------
@@ -244,10 +308,15 @@ public:
         anim = nullptr;
         icon = nullptr;
         activatedCount = 0;
+        sourceIsAnim = false;
+        stripFirstFrame = false;
+        pending = false;
     }
 
     ~Private()
     {
+        if ( !source.isEmpty() )
+            IconCache::instance()->remove(this);
         unloadAnim();
         if ( icon ) {
             delete icon;
@@ -269,6 +338,12 @@ public:
         anim = from.anim ? new Anim ( *from.anim ) : nullptr;
         icon = nullptr;
         activatedCount = from.activatedCount;
+        source = from.source;
+        sourceIsAnim = from.sourceIsAnim;
+        stripFirstFrame = from.stripFirstFrame;
+        pending = from.pending;
+        if ( !source.isEmpty() && !pending )
+            IconCache::instance()->touch(this, decodedSize());
     }
 
     void unloadAnim()
@@ -279,6 +354,63 @@ public:
         anim = nullptr;
     }
 
+    void clearSource()
+    {
+        if ( !source.isEmpty() )
+            IconCache::instance()->remove(this);
+        source.clear();
+        pending = false;
+    }
+
+    // decodes the source data on first use
+    void materialize()
+    {
+        if ( !pending )
+            return;
+        pending = false;
+
+        bool ret = false;
+        if ( sourceIsAnim ) {
+            Anim a(source);
+            if ( a.numFrames() > 0 ) {
+                impix = a.frame(0);
+                ret = true;
+            }
+            if ( a.numFrames() > 1 ) {
+                anim = new Anim(a);
+                if ( stripFirstFrame )
+                    anim->stripFirstFrame();
+            }
+        }
+        if ( !ret )
+            impix.loadFromData(source);
+
+        IconCache::instance()->touch(this, decodedSize());
+    }
+
+    // drops decoded frames, returns false if icon is in use or can't be decoded again
+    bool evict()
+    {
+        if ( pending || source.isEmpty() || activatedCount > 0 )
+            return false;
+
+        unloadAnim();
+        impix = Impix();
+        if ( icon ) {
+            delete icon;
+            icon = nullptr;
+        }
+        pending = true;
+        return true;
+    }
+
+    qint64 decodedSize() const
+    {
+        const QImage &img = impix.image();
+        qint64 frames = anim ? anim->numFrames() + 1 : 1;
+        return qint64(img.width()) * img.height() * 4 * frames;
+    }
+
     void connectInstance(PsiIcon *icon)
     {
         connect(this, SIGNAL(pixmapChanged()), icon, SIGNAL(pixmapChanged()));
@@ -298,6 +430,7 @@ signals:
 public:
     const QPixmap &pixmap() const
     {
+        const_cast<Private*>(this)->materialize();
         if ( anim ) {
             return anim->framePixmap();
         }
@@ -319,10 +452,52 @@ public:
     mutable QByteArray rawData;
 
     int activatedCount;
+
+    QByteArray source;
+    bool sourceIsAnim;
+    bool stripFirstFrame;
+    bool pending;
     friend class PsiIcon;
 };
 //! \endif
 
+void IconCache::touch(PsiIcon::Private *p, qint64 bytes)
+{
+    QMutexLocker locker(&mutex_);
+    lru_.removeOne(p);
+    lru_.append(p);
+    total_ += bytes - sizes_.value(p);
+    sizes_.insert(p, bytes);
+
+    // trim from the event loop, so references returned by pixmap() stay valid
+    if ( limit > 0 && total_ > limit && !trimScheduled_ ) {
+        trimScheduled_ = true;
+        QMetaObject::invokeMethod(this, "trim", Qt::QueuedConnection);
+    }
+}
+
+void IconCache::remove(PsiIcon::Private *p)
+{
+    QMutexLocker locker(&mutex_);
+    if ( lru_.removeOne(p) )
+        total_ -= sizes_.take(p);
+}
+
+void IconCache::trim()
+{
+    QMutexLocker locker(&mutex_);
+    trimScheduled_ = false;
+
+    QMutableListIterator<PsiIcon::Private*> it(lru_);
+    while ( total_ > limit && it.hasNext() ) {
+        PsiIcon::Private *p = it.next();
+        if ( p->evict() ) {
+            total_ -= sizes_.take(p);
+            it.remove();
+        }
+    }
+}
+
 /**
  * Constructs empty PsiIcon.
  */
@@ -387,6 +562,7 @@ void PsiIcon::detach()
  */
 bool PsiIcon::isAnimated() const
 {
+    const_cast<Private*>(d.data())->materialize();
     return d->anim != nullptr;
 }
 
@@ -403,6 +579,7 @@ const QPixmap &PsiIcon::pixmap() const
  */
 const QImage &PsiIcon::image() const
 {
+    const_cast<Private*>(d.data())->materialize();
     if ( d->anim ) {
         return d->anim->frameImage();
     }
@@ -415,6 +592,7 @@ const QImage &PsiIcon::image() const
  */
 const Impix &PsiIcon::impix() const
 {
+    const_cast<Private*>(d.data())->materialize();
     return d->impix;
 }
 
@@ -424,6 +602,7 @@ const Impix &PsiIcon::impix() const
  */
 const Impix &PsiIcon::frameImpix() const
 {
+    const_cast<Private*>(d.data())->materialize();
     if ( d->anim ) {
         return d->anim->frameImpix();
     }
@@ -440,6 +619,7 @@ const QIcon &PsiIcon::icon() const
         return *d->icon;
     }
 
+    const_cast<Private*>(d.data())->materialize();
     const_cast<Private*>(d.data())->icon = new QIcon( d->impix.pixmap() );
     return *d->icon;
 }
@@ -472,6 +652,7 @@ void PsiIcon::setImpix(const Impix &impix, bool doDetach)
         detach();
     }
 
+    d->clearSource();
     d->impix = impix;
     if ( d->icon ) {
         delete d->icon;
@@ -487,9 +668,20 @@ void PsiIcon::setImpix(const Impix &impix, bool doDetach)
  */
 const Anim *PsiIcon::anim() const
 {
+    const_cast<Private*>(d.data())->materialize();
     return d->anim;
 }
 
+qint64 PsiIcon::byteCount() const
+{
+    qint64 bytes = d->impix.byteCount();
+    if (d->anim) {
+        for (int i = 0; i < d->anim->numFrames(); ++i)
+            bytes += d->anim->frame(i).byteCount();
+    }
+    return bytes;
+}
+
 /**
  * Sets the animation for icon to \a anim. Also sets Impix to be the first frame of animation.
  * If animation have less than two frames, it is deleted.
@@ -501,6 +693,8 @@ void PsiIcon::setAnim(const Anim &anim, bool doDetach)
         detach();
     }
 
+    d->materialize();
+    d->clearSource();
     d->unloadAnim();
     d->anim = new Anim(anim);
 
@@ -532,6 +726,8 @@ void PsiIcon::removeAnim(bool doDetach)
         detach();
     }
 
+    d->materialize();
+    d->clearSource();
     if ( !d->anim ) {
         return;
     }
@@ -552,7 +748,7 @@ void PsiIcon::removeAnim(bool doDetach)
  */
 int PsiIcon::frameNumber() const
 {
-    if ( d->anim ) {
+    if ( !d->pending && d->anim ) {
         return d->anim->frameNumber();
     }
 
@@ -693,6 +889,8 @@ bool PsiIcon::blockSignals(bool b)
 
 /**
  * Initializes PsiIcon's Impix (or Anim, if \a isAnim equals \c true).
+ * Only the image header is checked here, actual decoding is postponed
+ * until the icon is used for the first time.
  * Iconset::load uses this function.
  */
 bool PsiIcon::loadFromData(const QByteArray &ba, bool isAnim)
@@ -703,18 +901,31 @@ bool PsiIcon::loadFromData(const QByteArray &ba, bool isAnim)
         d->rawData = ba;
     }
 #endif
-    bool ret = false;
-    if ( isAnim ) {
-        Anim *anim = new Anim(ba);
-        setAnim(*anim);
-        ret = anim->numFrames() > 0;
-        delete anim; // shared data rules ;)
-    }
-
-    if ( !ret && d->impix.loadFromData(ba) )
-        ret = true;
+    QBuffer buffer;
+    buffer.setData(ba);
+    buffer.open(QBuffer::ReadOnly);
+    QImageReader reader(&buffer);
+    bool ret = reader.canRead();
 
     if ( ret ) {
+        d->clearSource();
+        d->unloadAnim();
+        d->impix = Impix();
+        if ( d->icon ) {
+            delete d->icon;
+            d->icon = nullptr;
+        }
+
+        d->source = ba;
+        d->sourceIsAnim = isAnim;
+        d->stripFirstFrame = false;
+        d->pending = true;
+
+        if ( d->activatedCount > 0 ) {
+            d->activatedCount = 0;
+            activated(false); // restart the animation, but don't play the sound
+        }
+
         emit d->pixmapChanged();
         emit d->iconModified();
     }
@@ -749,6 +960,7 @@ void PsiIcon::activated(bool playSound)
     Q_UNUSED(iconSharedObject);
 #endif
 
+    d->materialize();
     if ( d->anim ) {
         d->anim->unpause();
 
@@ -785,7 +997,9 @@ void PsiIcon::stripFirstAnimFrame()
 {
     detach();
 
-    if ( d->anim ) {
+    // applied on decoding, so it isn't lost when decoded frames are dropped
+    d->stripFirstFrame = true;
+    if ( !d->pending && d->anim ) {
         d->anim->stripFirstFrame();
     }
 }
@@ -881,8 +1095,13 @@ public:
 
 IconsetFactoryPrivate* IconsetFactoryPrivate::instance_ = nullptr;
 
+// bumped on every change of any iconset, so IconsetFactory::Handle knows
+// when what it found could be gone
+static quint64 iconsetGeneration = 1;
+
 void IconsetFactoryPrivate::registerIconset(const Iconset *i)
 {
+    ++iconsetGeneration;
     if (!iconsets_) {
         iconsets_ = new QList<Iconset*>;
     }
@@ -894,6 +1113,7 @@ void IconsetFactoryPrivate::registerIconset(const Iconset *i)
 
 void IconsetFactoryPrivate::unregisterIconset(const Iconset *i)
 {
+    ++iconsetGeneration;
     if (iconsets_ && iconsets_->contains(const_cast<Iconset*>(i))) {
         iconsets_->removeAll(const_cast<Iconset*>(i));
     }
@@ -920,6 +1140,7 @@ const PsiIcon *IconsetFactoryPrivate::icon(const QString &name) const
 
 void IconsetFactory::reset()
 {
+    ++iconsetGeneration;
     IconsetFactoryPrivate::reset();
 }
 
@@ -977,6 +1198,25 @@ const QStringList IconsetFactory::icons()
     return IconsetFactoryPrivate::instance()->icons();
 }
 
+const PsiIcon *IconsetFactory::Handle::iconPtr() const
+{
+    if (generation_ != iconsetGeneration) {
+        icon_       = IconsetFactory::iconPtr(name_);
+        generation_ = iconsetGeneration;
+    }
+    return icon_;
+}
+
+const QPixmap &IconsetFactory::Handle::pixmap() const
+{
+    const PsiIcon *i = iconPtr();
+    if ( i ) {
+        return i->impix().pixmap();
+    }
+
+    return IconsetFactoryPrivate::instance()->emptyPixmap();
+}
+
 #ifdef WEBKIT
 /**
  * Returs image raw data aka original image
@@ -1020,6 +1260,8 @@ private:
         //creation = "1900-01-01";
         homeUrl = QString();
         iconSize_ = 16;
+        cacheIcons = nullptr;
+        cacheCount = 0;
     }
 
 public:
@@ -1030,6 +1272,10 @@ public:
     QHash<QString, QString> info;
     int iconSize_;
 
+    // compiled icons gathered while loading, see saveCache()
+    QByteArray *cacheIcons;
+    quint32 cacheCount;
+
 public:
     Private()
     {
@@ -1184,6 +1430,8 @@ public:
 
         QString name;
         name.sprintf("icon_%04d", icon_counter++);
+        const QString autoName = name;
+        QByteArray graphicData;
         bool isAnimated = false;
         bool isImage = false;
 
@@ -1293,6 +1541,7 @@ public:
                     QByteArray ba = loadData(graphic[*it], dir);
 
                     if ( icon.loadFromData( ba, isAnimated ) ) {
+                        graphicData = ba;
                         loadSuccess = true;
                         break;
                     }
@@ -1320,6 +1569,9 @@ public:
                             break;
                         }
 
+                        // unpacked sounds don't outlive the session
+                        cacheIcons = nullptr;
+
                         QFileInfo ext(sound[*it]);
                         path += "/" + QCA::Hash("sha1").hashToString(QString(fi.absoluteFilePath() + '/' + sound[*it]).toUtf8()) + '.' + ext.suffix();
 
@@ -1357,6 +1609,16 @@ public:
         icon.blockSignals(false);
 
         if ( loadSuccess ) {
+            if ( cacheIcons ) {
+                QDataStream out(cacheIcons, QIODevice::WriteOnly | QIODevice::Append);
+                out.setVersion(QDataStream::Qt_5_6);
+                out << name << (name == autoName) << quint32(text.count());
+                foreach(const PsiIcon::IconText &t, text) {
+                    out << t.lang << t.text;
+                }
+                out << icon.regExp().pattern() << icon.sound() << isAnimated << graphicData;
+                cacheCount++;
+            }
             append( name, new PsiIcon(icon) );
         }
         else {
@@ -1401,6 +1663,132 @@ public:
         return success;
     }
 
+    static bool cacheKey(const QString &dir, QString *file, qint64 *mtime, qint64 *size)
+    {
+        if ( iconsetCacheDir.isEmpty() ) {
+            return false;
+        }
+
+        QFileInfo fi(dir);
+        if ( !Iconset::isSourceAllowed(fi) ) {
+            return false;
+        }
+        QFileInfo src = fi.isDir() ? QFileInfo(dir + "/icondef.xml") : fi;
+        if ( !src.exists() ) {
+            return false;
+        }
+
+        QByteArray hash = QCryptographicHash::hash(fi.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+        *file = iconsetCacheDir + '/' + QString::fromLatin1(hash.toHex()) + ".cache";
+        *mtime = src.lastModified().toMSecsSinceEpoch();
+        *size = src.size();
+        return true;
+    }
+
+    // loads previously compiled iconset, if it's still up to date
+    bool loadCache(const QString &dir)
+    {
+        QString fileName;
+        qint64 mtime, size;
+        if ( !cacheKey(dir, &fileName, &mtime, &size) ) {
+            return false;
+        }
+
+        QFile file(fileName);
+        if ( !file.open(QIODevice::ReadOnly) ) {
+            return false;
+        }
+
+        QByteArray ba;
+        uchar *mapped = file.map(0, file.size());
+        if ( mapped ) {
+            ba = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(file.size()));
+        }
+        else {
+            ba = file.readAll();
+        }
+
+        QDataStream in(ba);
+        in.setVersion(QDataStream::Qt_5_6);
+
+        quint32 magic, formatVersion;
+        qint64 cachedMtime, cachedSize;
+        QString cachedDir;
+        in >> magic >> formatVersion >> cachedDir >> cachedMtime >> cachedSize;
+        if ( magic != iconsetCacheMagic || formatVersion != iconsetCacheVersion ||
+             cachedDir != QFileInfo(dir).absoluteFilePath() || cachedMtime != mtime || cachedSize != size ) {
+            return false;
+        }
+
+        quint32 count;
+        in >> name >> version >> description >> creation >> homeUrl >> authors >> info >> iconSize_ >> count;
+        for ( quint32 n = 0; n < count && in.status() == QDataStream::Ok; n++ ) {
+            QString iconName, pattern, sound;
+            bool autoName, isAnimated;
+            quint32 textCount;
+            QList<PsiIcon::IconText> text;
+            QByteArray graphic;
+
+            in >> iconName >> autoName >> textCount;
+            for ( quint32 t = 0; t < textCount && in.status() == QDataStream::Ok; t++ ) {
+                QString lang, str;
+                in >> lang >> str;
+                text.append(PsiIcon::IconText(lang, str));
+            }
+            in >> pattern >> sound >> isAnimated >> graphic;
+
+            if ( autoName ) {
+                iconName.sprintf("icon_%04d", icon_counter++);
+            }
+
+            PsiIcon icon;
+            icon.blockSignals(true);
+            icon.setText(text);
+            icon.setName(iconName);
+            if ( !pattern.isEmpty() ) {
+                icon.setRegExp(QRegExp(pattern));
+            }
+            if ( !sound.isEmpty() ) {
+                icon.setSound(sound);
+            }
+            icon.loadFromData(graphic, isAnimated);
+            icon.blockSignals(false);
+
+            append( iconName, new PsiIcon(icon) );
+        }
+
+        if ( in.status() != QDataStream::Ok ) {
+            qWarning("Iconset::load(\"%s\"): cache file %s is corrupted", qPrintable(dir), qPrintable(fileName));
+            clear();
+            init();
+            return false;
+        }
+
+        return true;
+    }
+
+    void saveCache(const QString &dir)
+    {
+        QString fileName;
+        qint64 mtime, size;
+        if ( !cacheIcons || !cacheKey(dir, &fileName, &mtime, &size) ) {
+            return;
+        }
+
+        QDir().mkpath(iconsetCacheDir);
+        QSaveFile file(fileName);
+        if ( !file.open(QIODevice::WriteOnly) ) {
+            return;
+        }
+
+        QDataStream out(&file);
+        out.setVersion(QDataStream::Qt_5_6);
+        out << iconsetCacheMagic << iconsetCacheVersion << QFileInfo(dir).absoluteFilePath() << mtime << size;
+        out << name << version << description << creation << homeUrl << authors << info << iconSize_ << cacheCount;
+        out.writeRawData(cacheIcons->constData(), cacheIcons->size());
+        file.commit();
+    }
+
     void setInformation(const Private &from) {
         name = from.name;
         version = from.version;
@@ -1452,6 +1840,7 @@ Iconset::~Iconset()
  */
 Iconset &Iconset::operator=(const Iconset &from)
 {
+    ++iconsetGeneration;
     d = from.d;
 
     return *this;
@@ -1467,6 +1856,8 @@ Iconset Iconset::copy() const
 
 void Iconset::detach()
 {
+    // called before every change
+    ++iconsetGeneration;
     d.detach();
 }
 
@@ -1524,6 +1915,15 @@ bool Iconset::load(const QString &dir)
     bool ret = false;
     d->id = dir.section('/', -2);
 
+    if ( d->loadCache(dir) ) {
+        d->filename = dir;
+        return true;
+    }
+
+    QByteArray cacheIcons;
+    d->cacheIcons = iconsetCacheDir.isEmpty() ? nullptr : &cacheIcons;
+    d->cacheCount = 0;
+
     QByteArray ba;
     ba = d->loadData ("icondef.xml", dir);
     if ( !ba.isEmpty() ) {
@@ -1531,6 +1931,7 @@ bool Iconset::load(const QString &dir)
         if ( doc.setContent(ba, false) ) {
             if ( d->load(doc, dir) ) {
                 d->filename = dir;
+                d->saveCache(dir);
                 ret = true;
             }
         }
@@ -1544,6 +1945,7 @@ bool Iconset::load(const QString &dir)
 
     //QPixmap::setDefaultOptimization( optimization );
 
+    d->cacheIcons = nullptr;
     return ret;
 }
 
@@ -1647,6 +2049,14 @@ const QString &Iconset::homeUrl() const
     return d->homeUrl;
 }
 
+qint64 Iconset::byteCount() const
+{
+    qint64 bytes = 0;
+    for (const PsiIcon *icon : d->list)
+        bytes += icon->byteCount();
+    return bytes;
+}
+
 QListIterator<PsiIcon *> Iconset::iterator() const
 {
     QListIterator<PsiIcon *> it( d->list );
@@ -1755,4 +2165,27 @@ void Iconset::setSoundPrefs(QString unpackPath, QObject *receiver, const char *s
 #endif
 }
 
+/**
+ * Enables the compiled iconset cache in directory \a dir. Iconset::load() stores
+ * parsed icon definitions together with the graphic data there, and on the
+ * next load reads them back instead of unpacking the archive and parsing
+ * icondef.xml, as long as the iconset file wasn't modified. Empty \a dir
+ * disables the cache.
+ */
+void Iconset::setCacheDir(const QString &dir)
+{
+    iconsetCacheDir = dir;
+}
+
+/**
+ * Icon graphics are decoded on first use. When decoded frames of all
+ * iconsets take more than \a bytes, frames of the icons that weren't
+ * used recently and aren't shown at the moment are dropped, and decoded
+ * again when needed. Zero disables the limit. Default is 16 MB.
+ */
+void Iconset::setDecodedLimit(qint64 bytes)
+{
+    IconCache::instance()->limit = bytes;
+}
+
 #include "iconset.moc"
@@ -43,6 +43,7 @@ public:
 
     void unload();
     bool isNull() const;
+    qint64 byteCount() const; // of what's loaded now
 
     const QPixmap & pixmap() const;
     const QImage & image() const;
@@ -127,6 +128,7 @@ public:
     void setImpix(const Impix &, bool doDetach = true);
 
     const Anim *anim() const;
+    qint64 byteCount() const; // without loading it
     void setAnim(const Anim &, bool doDetach = true);
     void removeAnim(bool doDetach = true);
 
@@ -191,6 +193,7 @@ public:
 
     void clear();
     int count() const;
+    qint64 byteCount() const; // of the loaded images and animation frames
 
     bool load(const QString &dir);
 
@@ -222,6 +225,8 @@ public:
 
     static bool isSourceAllowed(const QFileInfo &fi);
     static void setSoundPrefs(QString unpackPath, QObject *receiver, const char *slot);
+    static void setDecodedLimit(qint64 bytes);
+    static void setCacheDir(const QString &dir);
 
     Iconset copy() const;
     void detach();
@@ -245,6 +250,27 @@ public:
 #ifdef WEBKIT
     static const QByteArray raw(const QString &name);
 #endif
+
+    /**
+     * An icon name resolved once, for paint code that asks for the same icon
+     * all the time. Reading it is a counter check as long as no iconset
+     * changed, the name is looked up again after that.
+     */
+    class Handle
+    {
+    public:
+        explicit Handle(const QString &name) : name_(name) {}
+        explicit Handle(const char *name) : name_(QLatin1String(name)) {}
+
+        const QString &name() const { return name_; }
+        const PsiIcon *iconPtr() const;
+        const QPixmap &pixmap() const; // the empty pixmap if there is no such icon
+
+    private:
+        QString                 name_;
+        mutable const PsiIcon * icon_       = nullptr;
+        mutable quint64         generation_ = 0; // not resolved yet
+    };
 };
 
 #endif // ICONSET_H
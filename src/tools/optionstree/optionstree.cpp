@@ -41,7 +41,47 @@ OptionsTree::OptionsTree(QObject *parent)
  */
 OptionsTree::~OptionsTree()
 {
+    foreach (const QSharedPointer<Handle::Data> &h, handles_) {
+        h->tree   = nullptr;
+        h->exists = false;
+    }
+}
+
+/**
+ * Returns a handle for the option \a name. Handles for the same name share
+ * their data, so it's fine to request them often, but hot code should keep
+ * the handle instead of resolving it on every access.
+ */
+OptionsTree::Handle OptionsTree::handle(const QString &name) const
+{
+    Handle h;
+    h.d = handles_.value(name);
+    if (!h.d) {
+        h.d = QSharedPointer<Handle::Data>(new Handle::Data { this, name, QVariant(), false });
+        updateHandle(h.d.data());
+        handles_.insert(name, h.d);
+    }
+    return h;
+}
 
+void OptionsTree::updateHandle(Handle::Data *h) const
+{
+    h->value  = tree_.getValue(h->name);
+    h->exists = h->value != VariantTree::missingValue;
+}
+
+/**
+ * Refreshes handles of \a prefix and of options below it, or all handles
+ * when \a prefix is empty.
+ */
+void OptionsTree::updateHandles(const QString &prefix) const
+{
+    QString sub = prefix + '.';
+    foreach (const QSharedPointer<Handle::Data> &h, handles_) {
+        if (prefix.isEmpty() || h->name == prefix || h->name.startsWith(sub)) {
+            updateHandle(h.data());
+        }
+    }
 }
 
 /**
@@ -81,6 +121,10 @@ void OptionsTree::setOption(const QString& name, const QVariant& value)
         emit optionAboutToBeInserted(name);
     }
     tree_.setValue(name, value);
+    QSharedPointer<Handle::Data> h = handles_.value(name);
+    if (h) {
+        updateHandle(h.data());
+    }
     if (!prev.isValid()) {
         emit optionInserted(name);
     }
@@ -118,6 +162,7 @@ bool OptionsTree::removeOption(const QString &name, bool internal_nodes)
 {
     emit optionAboutToBeRemoved(name);
     bool ok = tree_.remove(name, internal_nodes);
+    updateHandles(name);
     emit optionRemoved(name);
     return ok;
 }
@@ -273,6 +318,7 @@ bool OptionsTree::saveOptions(const QString& fileName, const QString& configName
  * \param configName Name of the root element to check for
  * \param configVersion If specified, the function will fail if the file version doesn't match
  * \param configNS Namespace of the config format
+ * \param streamReader Parse with QXmlStreamReader instead of building a QDomDocument
  * \return 'true' if the file loads, 'false' if it fails
  */
 bool OptionsTree::loadOptions(const QString& fileName, const QString& configName, const QString& configNS,  const QString& configVersion, bool streamReader)
@@ -280,7 +326,15 @@ bool OptionsTree::loadOptions(const QString& fileName, const QString& configName
     AtomicXmlFile f(fileName);
     if (streamReader) {
         OptionsTreeReader reader(this);
-        return f.loadDocument(&reader);
+        if (f.loadDocument(&reader)) {
+            updateHandles();
+            return true;
+        }
+        // whatever was read is overwritten by the DOM based loader below
+        if (reader.error() != QXmlStreamReader::NoError) {
+            qWarning("Failed to stream-read %s, falling back to DOM: %s", qPrintable(fileName),
+                     qPrintable(reader.errorString()));
+        }
     }
 
     QDomDocument doc;
@@ -321,5 +375,6 @@ bool OptionsTree::loadOptions(const QDomElement& base, const QString& configName
 
     // Convert
     tree_.fromXml(base);
+    updateHandles();
     return true;
 }
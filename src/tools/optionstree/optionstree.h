@@ -22,6 +22,8 @@
 
 #include "varianttree.h"
 
+#include <QSharedPointer>
+
 /**
  * \class OptionsTree
  * \brief Dynamic hierachical options structure
@@ -32,9 +34,39 @@ class OptionsTree : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * \class Handle
+     * \brief Option resolved once by name
+     * The tree keeps the cached value of every handle in sync on change, so
+     * reading through a handle is O(1) and doesn't touch the option path.
+     * A handle becomes invalid when its tree is destroyed.
+     */
+    class Handle {
+    public:
+        bool     isValid() const { return d && d->tree; }
+        QString  name() const { return d ? d->name : QString(); }
+        QVariant value(const QVariant &defaultValue = QVariant::Invalid) const
+        { return d && d->exists ? d->value : defaultValue; }
+        bool    toBool() const { return value().toBool(); }
+        int     toInt() const { return value().toInt(); }
+        QString toString() const { return value().toString(); }
+
+    private:
+        friend class OptionsTree;
+        struct Data {
+            const OptionsTree *tree;
+            QString            name;
+            QVariant           value;
+            bool               exists;
+        };
+        QSharedPointer<Data> d;
+    };
+
     OptionsTree(QObject *parent = nullptr);
     ~OptionsTree();
 
+    Handle handle(const QString &name) const;
+
     QVariant getOption(const QString& name, const QVariant &defaultValue = QVariant::Invalid) const;
     inline QVariant getOption(const char *name, const QVariant &defaultValue = QVariant::Invalid) const
     { return getOption(QString(QString::fromLatin1(name)), defaultValue); }
@@ -61,7 +93,7 @@ public:
     QVariantList mapKeyList(const QString &basename, bool sortedByNumbers = false) const;
 
     bool saveOptions(const QString& fileName, const QString& configName, const QString& configNS, const QString& configVersion, bool streamWriter = false) const;
-    bool loadOptions(const QString& fileName, const QString& configName, const QString& configNS = "", const QString& configVersion = "", bool streamReader = false);
+    bool loadOptions(const QString& fileName, const QString& configName, const QString& configNS = "", const QString& configVersion = "", bool streamReader = true);
     bool loadOptions(const QDomElement& name, const QString& configName, const QString& configNS = "", const QString& configVersion = "");
     static bool exists(QString fileName);
 
@@ -73,7 +105,11 @@ signals:
     void optionRemoved(const QString& option);
 
 private:
+    void updateHandle(Handle::Data *h) const;
+    void updateHandles(const QString &prefix = QString()) const;
+
     VariantTree tree_;
+    mutable QHash<QString, QSharedPointer<Handle::Data>> handles_;
     friend class OptionsTreeReader;
     friend class OptionsTreeWriter;
 };
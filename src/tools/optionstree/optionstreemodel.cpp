@@ -23,6 +23,8 @@
 
 #include <QStringList>
 
+#include <algorithm>
+
 // Enable this if you have Trolltech Labs' ModelTest and are not going
 // to distribute the source or binary. You need to include modeltest.pri
 // somewhere too.
@@ -35,7 +37,8 @@ OptionsTreeModel::OptionsTreeModel(OptionsTree* tree, QObject* parent)
         : QAbstractItemModel(parent),
         tree_(tree),
         flat_(false),
-        nextIdx(0)
+        nextIdx(0),
+        flatValid_(false)
 {
     connect(tree_, SIGNAL(optionChanged(const QString&)), SLOT(optionChanged(const QString&)));
     connect(tree_, SIGNAL(optionAboutToBeInserted(const QString&)), SLOT(optionAboutToBeInserted(const QString&)));
@@ -59,6 +62,52 @@ bool OptionsTreeModel::setFlat(bool b)
     return false;
 }
 
+/**
+ * Row of @a option in the sorted list @a options, or the row it would be
+ * inserted at
+ */
+static int lowerBound(const QStringList &options, const QString &option)
+{
+    return int(std::lower_bound(options.constBegin(), options.constEnd(), option) - options.constBegin());
+}
+
+/**
+ * Sorted children of @a parent, or all options when the model is flat
+ */
+const QStringList &OptionsTreeModel::childOptions(const QString &parent) const
+{
+    if (flat_) {
+        if (!flatValid_) {
+            flatOptions_ = tree_->getChildOptionNames("",false,false);
+            flatOptions_.sort();
+            flatValid_ = true;
+        }
+        return flatOptions_;
+    }
+
+    auto it = children_.find(parent);
+    if (it == children_.end()) {
+        QStringList children = tree_->getChildOptionNames(parent,true,true);
+        children.sort();
+        it = children_.insert(parent, children);
+    }
+    return it.value();
+}
+
+/**
+ * Forgets the children of @a option and of the nodes below it
+ */
+void OptionsTreeModel::dropChildOptions(const QString &option)
+{
+    const QString prefix = option + '.';
+    for (auto it = children_.begin(); it != children_.end();) {
+        if (it.key() == option || it.key().startsWith(prefix))
+            it = children_.erase(it);
+        else
+            ++it;
+    }
+}
+
 /**
  * Get the parent option of @a option
  * @param option the option name to be splitted
@@ -86,20 +135,12 @@ QModelIndex OptionsTreeModel::index(const QString &option, Section sec) const
         return QModelIndex();
     }
 
-    if (flat_) {
-        QStringList options = tree_->getChildOptionNames("",false,false);
-        options.sort();
-        int row = options.indexOf(option);
-        return createIndex(row, sec, quintptr(nameToIndex(options.at(row))));
-    } else {
-        QString parentname(getParentName(option));
-
-        QStringList children = tree_->getChildOptionNames(parentname,true,true);
-        children.sort();
-        int row = children.indexOf(option);
-
-        return createIndex(row, sec, quintptr(nameToIndex(option)));
+    const QStringList &options = childOptions(flat_ ? QString() : getParentName(option));
+    int row = lowerBound(options, option);
+    if (row == options.size() || options.at(row) != option) {
+        return QModelIndex();
     }
+    return createIndex(row, sec, quintptr(nameToIndex(option)));
 }
 
 Qt::ItemFlags OptionsTreeModel::flags(const QModelIndex& index) const
@@ -117,14 +158,13 @@ Qt::ItemFlags OptionsTreeModel::flags(const QModelIndex& index) const
 int OptionsTreeModel::rowCount(const QModelIndex& parent) const
 {
     if (Section(parent.column()) == Name || !parent.isValid()) {
-        if (flat_) {
-            return (parent.isValid() ? 0 : tree_->getChildOptionNames("",false,false).count());
-        } else {
-            QString option;
-            if (parent.isValid())
-                option = indexToOptionName(parent);
-            return tree_->getChildOptionNames(option,true,true).count();
+        if (flat_ && parent.isValid()) {
+            return 0;
         }
+        QString option;
+        if (parent.isValid())
+            option = indexToOptionName(parent);
+        return childOptions(option).count();
     }
     return 0;
 }
@@ -187,23 +227,18 @@ QModelIndex OptionsTreeModel::index(int row, int column, const QModelIndex & par
     if  (column < 0  || column >= SectionBound || row < 0) {
         return QModelIndex();
     }
-    int id = 0;
-    QStringList options;
-    if (flat_) {
-        options = tree_->getChildOptionNames("",false,false);
-    } else {
-        QString parent_option;
-        if (parent.isValid()) {
-            parent_option = indexToOptionName(parent);
+    QString parent_option;
+    if (parent.isValid()) {
+        if (flat_) {
+            return QModelIndex();
         }
-        options = tree_->getChildOptionNames(parent_option,true,true);
+        parent_option = indexToOptionName(parent);
     }
+    const QStringList &options = childOptions(parent_option);
     if (row >= options.size()) {
         return QModelIndex();
     }
-    options.sort();
-    id = nameToIndex(options.at(row));
-    return createIndex(row,column,quintptr(id));
+    return createIndex(row,column,quintptr(nameToIndex(options.at(row))));
 }
 
 QModelIndex OptionsTreeModel::parent(const QModelIndex& modelindex) const
@@ -237,48 +272,83 @@ bool OptionsTreeModel::setData ( const QModelIndex & index, const QVariant & val
 
 void OptionsTreeModel::optionAboutToBeInserted(const QString& option)
 {
-    QString parentname(getParentName(option));
-
-    // FIXME? handle cases when parent doesn't exist either.
-
-    QModelIndex parent(index(parentname));
-
-    QStringList children = tree_->getChildOptionNames(parentname,true,true);
-    children << option;
-    children.sort();
-    int row = children.indexOf(option);
-
-    emit beginInsertRows(parent, row, row);
-
+    Change c;
+    if (flat_) {
+        c.node = option;
+        c.row = lowerBound(childOptions(QString()), option);
+        beginInsertRows(QModelIndex(), c.row, c.row);
+    } else {
+        // missing parents are created too, the view gets the topmost new node
+        QString parentname;
+        foreach (const QString &part, option.split('.')) {
+            QString node = parentname.isEmpty() ? part : parentname + '.' + part;
+            const QStringList &children = childOptions(parentname);
+            int row = lowerBound(children, node);
+            if (row == children.size() || children.at(row) != node) {
+                c.parent = parentname;
+                c.node = node;
+                c.row = row;
+                beginInsertRows(index(parentname), row, row);
+                break;
+            }
+            parentname = node;
+        }
+    }
+    changes_.push(c);
 }
 
 void OptionsTreeModel::optionInserted(const QString& option)
 {
     Q_UNUSED(option)
-    endInsertRows ();
+    Change c = changes_.pop();
+    if (flat_) {
+        children_.clear();
+        flatOptions_.insert(c.row, c.node);
+    } else {
+        flatValid_ = false;
+        if (c.row != -1) {
+            dropChildOptions(c.node);
+            children_[c.parent].insert(c.row, c.node);
+        }
+    }
+    if (c.row != -1) endInsertRows();
 }
 
 void OptionsTreeModel::optionAboutToBeRemoved(const QString& option)
 {
-    QString parentname(getParentName(option));
-
-    QModelIndex parent(index(parentname));
-
-    QStringList children = tree_->getChildOptionNames(parentname,true,true);
-    children.sort();
-    int row = children.indexOf(option);
-
-    if (row != -1) {
-        realRemove.push(true);
-        emit beginRemoveRows(parent, row, row);
-    } else {
-        realRemove.push(false);
+    Change c;
+    c.parent = flat_ ? QString() : getParentName(option);
+    c.node = option;
+    const QStringList &children = childOptions(c.parent);
+    int row = lowerBound(children, option);
+    if (row != children.size() && children.at(row) == option) {
+        c.row = row;
+        beginRemoveRows(index(c.parent), row, row);
+    } else if (flat_ && row != children.size() && children.at(row).startsWith(option + '.')) {
+        // all the options below an internal node go
+        c.reset = true;
+        beginResetModel();
     }
+    changes_.push(c);
 }
+
 void OptionsTreeModel::optionRemoved(const QString& option)
 {
-    Q_UNUSED(option)
-    if (realRemove.pop()) endRemoveRows ();
+    Change c = changes_.pop();
+    dropChildOptions(option);
+    if (flat_) {
+        children_.clear();
+        if (c.row != -1)
+            flatOptions_.removeAt(c.row);
+        else
+            flatValid_ = false;
+    } else {
+        flatValid_ = false;
+        if (c.row != -1)
+            children_[c.parent].removeAt(c.row);
+    }
+    if (c.row != -1) endRemoveRows();
+    if (c.reset) endResetModel();
 }
 
 void OptionsTreeModel::optionChanged(const QString& option)
@@ -286,7 +356,8 @@ void OptionsTreeModel::optionChanged(const QString& option)
     // only need to notify about options the view can possibly know anything about.
     if (nameMap.contains(option)) {
         QModelIndex modelindex(index(option, Value));
-        emit dataChanged(modelindex, modelindex);
+        if (modelindex.isValid())
+            emit dataChanged(modelindex, modelindex);
     }
 }
 bool OptionsTreeModel::internalNode(QString option) const
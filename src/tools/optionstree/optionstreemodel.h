@@ -23,6 +23,7 @@
 #include <QAbstractItemModel>
 #include <QHash>
 #include <QStack>
+#include <QStringList>
 #include <QVariant>
 
 class OptionsTree;
@@ -56,6 +57,8 @@ protected:
     QModelIndex index(const QString &option, Section sec=Name) const;
     int nameToIndex(QString name) const;
     bool internalNode(QString name) const;
+    const QStringList &childOptions(const QString &parent) const;
+    void dropChildOptions(const QString &option);
 
 protected slots:
     void optionChanged(const QString& option);
@@ -70,7 +73,21 @@ private:
     mutable QHash<int, QString> indexMap;
     mutable QHash<QString, int> nameMap;
     mutable int nextIdx;
-    QStack<bool> realRemove;
+
+    // sorted children of the nodes asked for so far, by the parent name.
+    // kept up to date on insertions and removals instead of scanning the tree
+    // on every lookup
+    mutable QHash<QString, QStringList> children_;
+    mutable QStringList flatOptions_;
+    mutable bool flatValid_;
+
+    struct Change {
+        QString parent;
+        QString node;
+        int row = -1; // -1 if the view isn't told about it
+        bool reset = false;
+    };
+    QStack<Change> changes_;
 };
 
 #endif // OPTIONSTREEMODEL_H
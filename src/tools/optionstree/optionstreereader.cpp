@@ -71,6 +71,17 @@ QVariant OptionsTreeReader::readVariant(const QString& type)
     else if (type == "QVariantList") {
         result = readVariantList();
     }
+    else if (type == "QVariantMap") {
+        result = readVariantMap();
+    }
+    else if (type == "QVariantHash") {
+        QVariantHash hash;
+        QVariantMap map = readVariantMap();
+        for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+            hash.insert(it.key(), it.value());
+        }
+        result = hash;
+    }
     else if (type == "QSize") {
         result = readSize();
     }
@@ -91,6 +102,8 @@ QVariant OptionsTreeReader::readVariant(const QString& type)
             varianttype = QVariant::Bool;
         } else if (type=="int") {
             varianttype = QVariant::Int;
+        } else if (type=="qulonglong") {
+            varianttype = QVariant::ULongLong;
         } else if (type == "QKeySequence") {
             varianttype = QVariant::KeySequence;
         } else if (type == "QColor") {
@@ -136,6 +149,9 @@ QStringList OptionsTreeReader::readStringList()
             if (name() == "item") {
                 list << readElementText();
             }
+            else {
+                skipCurrentElement();
+            }
         }
     }
     return list;
@@ -152,13 +168,37 @@ QVariantList OptionsTreeReader::readVariantList()
 
         if (isStartElement()) {
             if (name() == "item") {
-                list << readVariant(attributes().value("type").toString());
+                QVariant v = readVariant(attributes().value("type").toString());
+                if (v.isValid())
+                    list << v;
+            }
+            else {
+                skipCurrentElement();
             }
         }
     }
     return list;
 }
 
+QVariantMap OptionsTreeReader::readVariantMap()
+{
+    QVariantMap map;
+    while (!atEnd()) {
+        readNext();
+
+        if (isEndElement())
+            break;
+
+        if (isStartElement()) {
+            QString key = name().toString();
+            QVariant v = readVariant(attributes().value("type").toString());
+            if (v.isValid())
+                map.insert(key, v);
+        }
+    }
+    return map;
+}
+
 QSize OptionsTreeReader::readSize()
 {
     int width = 0, height = 0;
@@ -175,6 +215,9 @@ QSize OptionsTreeReader::readSize()
             else if (name() == "height") {
                 height = readElementText().toInt();
             }
+            else {
+                skipCurrentElement();
+            }
         }
     }
     return QSize(width, height);
@@ -202,6 +245,9 @@ QRect OptionsTreeReader::readRect()
             else if (name() == "y") {
                 y = readElementText().toInt();
             }
+            else {
+                skipCurrentElement();
+            }
         }
     }
     return QRect(x, y, width, height);
@@ -26,6 +26,7 @@ protected:
 
     QStringList readStringList();
     QVariantList readVariantList();
+    QVariantMap readVariantMap();
     QSize readSize();
     QRect readRect();
 
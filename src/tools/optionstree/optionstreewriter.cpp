@@ -4,9 +4,12 @@
 #include "varianttree.h"
 
 #include <QBuffer>
+#include <QColor>
+#include <QDomDocumentFragment>
 #include <QKeySequence>
 #include <QRect>
 #include <QSize>
+#include <QTextStream>
 
 OptionsTreeWriter::OptionsTreeWriter(const OptionsTree* options)
     : options_(options)
@@ -74,6 +77,15 @@ void OptionsTreeWriter::writeTree(const VariantTree* tree)
     foreach(QString unknown, tree->unknowns2_.keys()) {
         writeUnknown(tree->unknowns2_[unknown]);
     }
+
+    // unknown types preserved by the DOM based reader
+    foreach(const QDomDocumentFragment &df, tree->unknowns_) {
+        QString unknown;
+        QTextStream ts(&unknown);
+        df.save(ts, 0);
+        ts.flush();
+        writeUnknown(unknown);
+    }
 }
 
 void OptionsTreeWriter::writeVariant(const QVariant& variant)
@@ -93,6 +105,22 @@ void OptionsTreeWriter::writeVariant(const QVariant& variant)
             writeEndElement();
         }
     }
+    else if (variant.type() == QVariant::Map) {
+        QVariantMap map = variant.toMap();
+        for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+            writeStartElement(it.key());
+            writeVariant(it.value());
+            writeEndElement();
+        }
+    }
+    else if (variant.type() == QVariant::Hash) {
+        QVariantHash hash = variant.toHash();
+        for (auto it = hash.constBegin(); it != hash.constEnd(); ++it) {
+            writeStartElement(it.key());
+            writeVariant(it.value());
+            writeEndElement();
+        }
+    }
     else if (variant.type() == QVariant::Size) {
         writeTextElement("width", QString::number(variant.toSize().width()));
         writeTextElement("height", QString::number(variant.toSize().height()));
@@ -110,6 +138,11 @@ void OptionsTreeWriter::writeVariant(const QVariant& variant)
         QKeySequence k = variant.value<QKeySequence>();
         writeCharacters(k.toString());
     }
+    else if (variant.type() == QVariant::Color) {
+        // save invalid colors as empty string
+        if (variant.value<QColor>().isValid())
+            writeCharacters(variant.toString());
+    }
     else {
         writeCharacters(variant.toString());
     }
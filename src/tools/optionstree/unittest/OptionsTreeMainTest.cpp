@@ -2,6 +2,8 @@
 #include "qttestutil/qttestutil.h"
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
 #include <QMap>
 #include <QMapIterator>
 #include <QObject>
@@ -64,6 +66,14 @@ private slots:
         goodValues_["verona.size"] = QVariant(QSize(210,295));
         goodValues_["verona.stuff"] = l;
         goodValues_["verona.stringstuff"] = sl;
+        QVariantMap m;
+        m["montague"] = QVariant(QString("romeo"));
+        m["capulet"] = QVariant(3);
+        goodValues_["verona.families"] = m;
+        QVariantHash h;
+        h["friar"] = QVariant(true);
+        goodValues_["verona.church"] = h;
+        goodValues_["verona.population"] = QVariant(qulonglong(1) << 40);
         // qWarning() << goodValues_;
 
         badValues_["capulet.Juliet.dead"] = QVariant(true);
@@ -100,6 +110,57 @@ private slots:
         // tree2.saveOptions(dir() + "/options2.xml","OptionsTest","https://psi-im.org/optionstest","0.1");
         tree2.saveOptions(dir() + "/options3.xml","OptionsTest","https://psi-im.org/optionstest","0.1", true);
         verifyTree(&tree2);
+
+        // stream writer output read back by both loaders
+        OptionsTree tree3;
+        tree3.loadOptions(dir() + "/options3.xml","OptionsTest","https://psi-im.org/optionstest","0.1", true);
+        verifyTree(&tree3);
+        OptionsTree tree4;
+        tree4.loadOptions(dir() + "/options3.xml","OptionsTest","https://psi-im.org/optionstest","0.1", false);
+        verifyTree(&tree4);
+    }
+
+    void benchLoadLargeTree_data() {
+        QTest::addColumn<bool>("streamReader");
+        QTest::newRow("dom") << false;
+        QTest::newRow("stream") << true;
+    }
+
+    void benchLoadLargeTree() {
+        QFETCH(bool, streamReader);
+        QString fileName = QDir::tempPath() + "/optionstree_large.xml";
+        if (!QFile::exists(fileName)) {
+            OptionsTree tree;
+            initTreeValues(&tree, generateStressTestValues(200, 20));
+            tree.saveOptions(fileName, "options", "https://psi-im.org/options", "0.1", true);
+        }
+        QBENCHMARK {
+            OptionsTree tree;
+            tree.loadOptions(fileName, "options", "https://psi-im.org/options", "0.1", streamReader);
+        }
+    }
+
+    void handleTest() {
+        OptionsTree tree;
+        initTree(&tree);
+
+        OptionsTree::Handle h = tree.handle("verona.lovers");
+        QVERIFY(h.isValid());
+        QCOMPARE(h.toInt(), 2);
+        QVERIFY(tree.handle("verona.lovers").value() == h.value());
+
+        tree.setOption("verona.lovers", 3);
+        QCOMPARE(h.toInt(), 3);
+
+        OptionsTree::Handle missing = tree.handle("verona.missing");
+        QVERIFY(!missing.value().isValid());
+        QCOMPARE(missing.value(42).toInt(), 42);
+        tree.setOption("verona.missing", 7);
+        QCOMPARE(missing.toInt(), 7);
+
+        tree.removeOption("verona", true);
+        QVERIFY(!h.value().isValid());
+        QVERIFY(!missing.value().isValid());
     }
 
 #if 0
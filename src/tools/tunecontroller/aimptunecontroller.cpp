@@ -21,22 +21,69 @@
 
 #include "plugins/aimp/third-party/apiRemote.h"
 
+#include <QCoreApplication>
+
 /**
  * \class AimpTuneController
  * \brief A controller class for AIMP3 player.
+ *
+ * Track changes are announced by AIMP to a message-only window; polling
+ * is only needed to notice the player starting or going away.
  */
 
 static const int PLAYING = 2;
 static const int STOPPED = 0;
 static const WCHAR* AIMP_REMOTE_CLASS = const_cast<WCHAR *>(L"AIMP2_RemoteInfo");
+static const int PolledInterval = 10000;
+static const int NotifiedInterval = 30000;
 
 AimpTuneController::AimpTuneController()
 : PollingTuneController(),
-  _tuneSent(false)
+  _tuneSent(false),
+  _notifyAimp(nullptr)
 {
+    _notifyWindow = CreateWindowEx(0, L"STATIC", nullptr, 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, GetModuleHandle(nullptr), nullptr);
+    if (_notifyWindow) {
+        QCoreApplication::instance()->installNativeEventFilter(this);
+    }
     startPoll();
 }
 
+AimpTuneController::~AimpTuneController()
+{
+    if (_notifyWindow) {
+        QCoreApplication::instance()->removeNativeEventFilter(this);
+        registerNotify(nullptr);
+        DestroyWindow(_notifyWindow);
+    }
+}
+
+bool AimpTuneController::nativeEventFilter(const QByteArray &, void *message, long *)
+{
+    MSG *msg = static_cast<MSG *>(message);
+    if (msg->hwnd == _notifyWindow && msg->message == WM_AIMP_NOTIFY) {
+        // don't talk back to AIMP from inside its notification
+        QMetaObject::invokeMethod(this, "wake", Qt::QueuedConnection);
+        return true;
+    }
+    return false;
+}
+
+void AimpTuneController::registerNotify(HWND aimp)
+{
+    if (aimp == _notifyAimp || !_notifyWindow) {
+        return;
+    }
+    if (_notifyAimp && IsWindow(_notifyAimp)) {
+        SendMessage(_notifyAimp, WM_AIMP_COMMAND, AIMP_RA_CMD_UNREGISTER_NOTIFY, LPARAM(_notifyWindow));
+    }
+    _notifyAimp = aimp;
+    if (aimp) {
+        SendMessage(aimp, WM_AIMP_COMMAND, AIMP_RA_CMD_REGISTER_NOTIFY, LPARAM(_notifyWindow));
+    }
+    setInterval(aimp ? NotifiedInterval : PolledInterval);
+}
+
 HWND AimpTuneController::findAimp() const
 {
     return FindWindow(AIMP_REMOTE_CLASS, AIMP_REMOTE_CLASS);
@@ -53,6 +100,7 @@ int AimpTuneController::getAimpStatus(const HWND &aimp) const
 void AimpTuneController::check()
 {
     HWND aimp = findAimp();
+    registerNotify(aimp);
     if (getAimpStatus(aimp) == PLAYING) {
         sendTune(getTune());
     }
@@ -24,14 +24,19 @@
 #include "tune.h"
 #include "windows.h"
 
-class AimpTuneController : public PollingTuneController
+#include <QAbstractNativeEventFilter>
+
+class AimpTuneController : public PollingTuneController, public QAbstractNativeEventFilter
 {
     Q_OBJECT
 
 public:
     AimpTuneController();
+    ~AimpTuneController();
     Tune currentTune() const;
 
+    bool nativeEventFilter(const QByteArray &eventType, void *message, long *result);
+
 protected slots:
     void check();
 
@@ -41,10 +46,13 @@ private:
     int getAimpStatus(const HWND &aimp) const;
     void sendTune(const Tune &tune);
     void clearTune();
+    void registerNotify(HWND aimp);
 
 private:
     Tune _currentTune;
     bool _tuneSent;
+    HWND _notifyWindow;
+    HWND _notifyAimp;
 };
 
 #endif // AIMPTUNECONTROLLER_H
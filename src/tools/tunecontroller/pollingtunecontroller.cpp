@@ -29,12 +29,16 @@
  *
  * An implementing class only has to implement currentTune(), and the correct
  * signals will be emitted.
+ *
+ * While nothing is playing the interval doubles on every poll up to
+ * MaxIdleInterval, so an idle player costs a wakeup a minute at most.
  */
 
 /**
  * \brief Constructs the controller.
  */
 PollingTuneController::PollingTuneController()
+    : _interval(DefaultInterval)
 {
     connect(&_timer, SIGNAL(timeout()), SLOT(check()));
     _timer.setInterval(DefaultInterval);
@@ -46,7 +50,8 @@ PollingTuneController::PollingTuneController()
 void PollingTuneController::check()
 {
     Tune tune = currentTune();
-    if (_prevTune != tune) {
+    bool changed = _prevTune != tune;
+    if (changed) {
         _prevTune = tune;
         if (tune.isNull()) {
             emit stopped();
@@ -55,4 +60,20 @@ void PollingTuneController::check()
             emit playing(tune);
         }
     }
+
+    int next = _interval;
+    if (!changed && tune.isNull()) {
+        next = qMin(_timer.interval() * 2, qMax(_interval, int(MaxIdleInterval)));
+    }
+    if (isPolling() && next != _timer.interval()) {
+        _timer.setInterval(next);
+    }
+}
+
+void PollingTuneController::wake()
+{
+    if (isPolling()) {
+        _timer.start(_interval);
+    }
+    check();
 }
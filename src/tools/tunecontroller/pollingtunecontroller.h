@@ -31,17 +31,22 @@ class PollingTuneController : public TuneController
 
 private:
     static const int DefaultInterval = 10000;
+    static const int MaxIdleInterval = 60000;
     QTimer _timer;
+    int _interval;
 public:
     PollingTuneController();
     inline bool isPolling() const { return _timer.isActive(); }
-    inline void startPoll() { _timer.start(DefaultInterval); }
+    inline void startPoll() { _timer.start(_interval); }
     inline void stopPoll() { _timer.stop(); }
-    inline void setInterval(int interval) { _timer.setInterval(interval); }
+    inline void setInterval(int interval) { _interval = interval; _timer.setInterval(interval); }
 
 protected slots:
     virtual void check();
 
+    // for players that announce changes: look now and poll at the normal rate again
+    void wake();
+
 private:
     Tune _prevTune;
 };
@@ -29,13 +29,24 @@
 #include <QPluginLoader>
 #include <QtCore>
 
+// skipping through a playlist should not publish every track on the way
+static const int PublishDelay = 2000;
+
 /**
  * \class TuneControllerManager
  * \brief A manager for all tune controller plugins.
+ *
+ * playing() and stopped() are only emitted once the state has been
+ * stable for PublishDelay, and only if it differs from the last one.
  */
 
 TuneControllerManager::TuneControllerManager()
+    : published_(false)
 {
+    publishTimer_.setSingleShot(true);
+    publishTimer_.setInterval(PublishDelay);
+    connect(&publishTimer_, &QTimer::timeout, this, &TuneControllerManager::publishPendingTune);
+
     foreach(QObject* plugin,QPluginLoader::staticInstances()) {
         loadPlugin(plugin);
     }
@@ -53,16 +64,18 @@ void TuneControllerManager::updateControllers(const QStringList &blacklist)
         isInBlacklist = blacklist.contains(name);
         if (!c && !isInBlacklist) {
             c = TuneControllerPtr(plugins_[name]->createController());
-            connect(c.data(), &TuneController::stopped, this, &TuneControllerManager::stopped);
+            connect(c.data(), &TuneController::stopped, this, [this](){
+                setPendingTune(Tune());
+            });
             connect(c.data(), &TuneController::playing, this, [this](const Tune &tune){
                 if (checkTune(tune)) {
-                    emit playing(tune);
+                    setPendingTune(tune);
                 }
             });
             controllers_.insert(name, c);
         }
         else if (c && isInBlacklist) {
-            emit stopped();
+            setPendingTune(Tune());
             controllers_.remove(name);
         }
     }
@@ -120,6 +133,27 @@ bool TuneControllerManager::loadPlugin(QObject* plugin)
     return false;
 }
 
+void TuneControllerManager::setPendingTune(const Tune &tune)
+{
+    pendingTune_ = tune;
+    publishTimer_.start();
+}
+
+void TuneControllerManager::publishPendingTune()
+{
+    if (published_ && pendingTune_ == publishedTune_) {
+        return;
+    }
+    published_ = true;
+    publishedTune_ = pendingTune_;
+    if (publishedTune_.isNull()) {
+        emit stopped();
+    }
+    else {
+        emit playing(publishedTune_);
+    }
+}
+
 void TuneControllerManager::setTuneFilters(const QStringList &filters, const QString &pattern)
 {
     tuneUrlFilters_ = filters;
@@ -27,6 +27,7 @@
 #include <QObject>
 #include <QSharedPointer>
 #include <QStringList>
+#include <QTimer>
 
 class TuneController;
 class TuneControllerPlugin;
@@ -57,12 +58,18 @@ protected:
 
 private:
     bool checkTune(const Tune &tune) const;
+    void setPendingTune(const Tune &tune);
+    void publishPendingTune();
 
 private:
     QMap<QString,TuneControllerPluginPtr> plugins_;
     QMap<QString,TuneControllerPtr> controllers_;
     QStringList tuneUrlFilters_;
     QString tuneTitleFilterPattern_;
+    QTimer publishTimer_;
+    Tune pendingTune_;
+    Tune publishedTune_;
+    bool published_;
 };
 
 #endif // TUNECONTROLLERMANAGER_H
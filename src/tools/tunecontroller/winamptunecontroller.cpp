@@ -154,7 +154,6 @@ void WinAmpTuneController::check()
         tune = getTune(h);
     }
     prevTune_ = tune;
-    setInterval(NormInterval);
     PollingTuneController::check();
 }
 
@@ -175,7 +174,10 @@ Tune WinAmpTuneController::getTune(const HWND &hWnd)
                 setInterval(interval);
                 return Tune();
             }
-            antiscrollCounter_ = 0;
+            if (antiscrollCounter_) {
+                antiscrollCounter_ = 0;
+                setInterval(NormInterval);
+            }
             tune.setName(trackpair.second);
             tune.setURL(trackpair.second);
             tune.setTrack(QString::number(position + 1));
@@ -25,6 +25,9 @@
 #include <QCoreApplication>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QLibraryInfo>
 #include <QTranslator>
 
@@ -126,6 +129,13 @@ void TranslationManager::loadTranslation(const QString& language)
     }
 }
 
+// Language names from previous scans, so the catalogs of an unchanged
+// directory don't have to be loaded again just to list them
+static QString translationCacheFile()
+{
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + QLatin1String("/translations.json");
+}
+
 VarList TranslationManager::availableTranslations()
 {
     VarList langs;
@@ -133,39 +143,65 @@ VarList TranslationManager::availableTranslations()
     // We always support english
     langs.set("en", "English");
 
+    QJsonObject cache;
+    QFile       cacheFile(translationCacheFile());
+    if (cacheFile.open(QIODevice::ReadOnly)) {
+        cache = QJsonDocument::fromJson(cacheFile.readAll()).object();
+        cacheFile.close();
+    }
+    bool cacheChanged = false;
+
     // Search the paths
     foreach(QString dirName, translationDirs()) {
         if(!QFile::exists(dirName))
             continue;
 
         QDir d(dirName);
-        foreach(QString str, d.entryList()) {
-            // verify that it is a language file
-            if(str.left(4) != "psi_")
-                continue;
-            int n = str.indexOf('.', 4);
-            if(n == -1)
-                continue;
-            if(str.mid(n) != ".qm")
-                continue;
-            QString lang = str.mid(4, n-4);
-
-            //printf("found [%s], lang=[%s]\n", str.latin1(), lang.latin1());
-
-            // get the language_name
-            QString name = QString("[") + str + "]";
-            QTranslator t(nullptr);
-            if(!t.load(str, dirName))
-                continue;
-
-            //Is translate equivalent to the old findMessage? I hope so
-            //Qt4 conversion
-            QString s = t.translate("@default", "language_name");
-            if(!s.isEmpty())
-                name = s;
-
-            langs.set(lang, name);
+        QFileInfoList files = d.entryInfoList(QStringList() << "psi_*.qm", QDir::Files, QDir::Name);
+        qint64 newest = QFileInfo(dirName).lastModified().toMSecsSinceEpoch();
+        foreach(const QFileInfo &fi, files) {
+            newest = qMax(newest, fi.lastModified().toMSecsSinceEpoch());
         }
+        QString stamp = QString::number(files.count()) + '|' + QString::number(newest);
+
+        QJsonObject entry = cache.value(d.absolutePath()).toObject();
+        if (entry.value("stamp").toString() != stamp) {
+            QJsonObject names;
+            foreach(const QFileInfo &fi, files) {
+                // verify that it is a language file
+                QString str = fi.fileName();
+                int n = str.indexOf('.', 4);
+                if(str.mid(n) != ".qm")
+                    continue;
+                QString lang = str.mid(4, n-4);
+
+                // get the language_name
+                QString name = QString("[") + str + "]";
+                QTranslator t(nullptr);
+                if(!t.load(str, dirName))
+                    continue;
+
+                QString s = t.translate("@default", "language_name");
+                if(!s.isEmpty())
+                    name = s;
+
+                names.insert(lang, name);
+            }
+            entry = QJsonObject();
+            entry.insert("stamp", stamp);
+            entry.insert("languages", names);
+            cache.insert(d.absolutePath(), entry);
+            cacheChanged = true;
+        }
+
+        QJsonObject names = entry.value("languages").toObject();
+        for (auto it = names.constBegin(); it != names.constEnd(); ++it) {
+            langs.set(it.key(), it.value().toString());
+        }
+    }
+
+    if (cacheChanged && cacheFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        cacheFile.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
     }
 
     return langs;
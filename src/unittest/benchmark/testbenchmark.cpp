@@ -0,0 +1,338 @@
+/*
+ * testbenchmark.cpp - timings of the hot text, model and history paths
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "contactlistmodel.h"
+#include "contactlistproxymodel.h"
+#include "edbflatfile.h"
+#include "edbsqlite.h"
+#include "eventdb.h"
+#include "gcuserview.h"
+#include "psiaccount.h"
+#include "psicon.h"
+#include "psicontactlist.h"
+#include "psievent.h"
+#include "textutil.h"
+#include "userlist.h"
+#include "varianttree.h"
+#include "xmpp_message.h"
+
+#include <QSignalSpy>
+#include <QtCrypto>
+#include <QtTest/QtTest>
+
+/*
+ * The fixtures are generated from a fixed seed, so every build works on
+ * the same input and the numbers of two commits can be compared.
+ */
+class Fixture
+{
+public:
+    Fixture() : state_(20190101) { }
+
+    int next(int max)
+    {
+        state_ = state_ * 1103515245u + 12345u;
+        return int((state_ >> 16) % unsigned(max));
+    }
+
+    QString word()
+    {
+        static const char *words[] = { "hello", "there", "psi", "jabber", "message", "room", "what",
+                                       "about", "tomorrow", "ok", "lunch", "build", "release", "patch" };
+        return QString::fromLatin1(words[next(sizeof(words) / sizeof(words[0]))]);
+    }
+
+    QString line(int words)
+    {
+        QStringList l;
+        for (int i = 0; i < words; ++i) {
+            switch (next(16)) {
+            case 0:
+                l << QString("https://example.org/%1/%2").arg(word()).arg(next(1000));
+                break;
+            case 1:
+                l << ":-)";
+                break;
+            case 2:
+                l << "<b>&amp;</b>";
+                break;
+            default:
+                l << word();
+            }
+        }
+        return l.join(" ");
+    }
+
+    XMPP::Jid jid(int i) { return XMPP::Jid(QString("contact%1@example%2.org").arg(i).arg(i % 7)); }
+
+private:
+    unsigned state_;
+};
+
+class TestBenchmark : public QObject
+{
+    Q_OBJECT
+private:
+    QCA::Initializer *qca_init;
+    PsiCon *          psi;
+    PsiAccount *      account;
+
+    QList<PsiEvent::Ptr> historyEvents(int count)
+    {
+        Fixture              f;
+        QList<PsiEvent::Ptr> events;
+        QDateTime            time(QDate(2019, 1, 1), QTime(12, 0));
+        for (int i = 0; i < count; ++i) {
+            XMPP::Message m(f.jid(0));
+            m.setBody(f.line(12));
+            m.setTimeStamp(time.addSecs(i * 60));
+            events += PsiEvent::Ptr(new MessageEvent(m, account));
+        }
+        return events;
+    }
+
+    void fillHistory(EDB *edb, const XMPP::Jid &jid, int count)
+    {
+        EDBHandle  h(edb);
+        QSignalSpy spy(&h, SIGNAL(finished()));
+        h.erase(account->id(), jid);
+        QVERIFY(spy.wait(60000));
+        h.appendBatch(account->id(), jid, historyEvents(count), EDB::Contact);
+        QVERIFY(spy.wait(60000));
+    }
+
+private slots:
+    void initTestCase()
+    {
+        qca_init = new QCA::Initializer();
+        psi      = new PsiCon();
+        psi->init();
+        account = psi->contactList()->createAccount("benchmark", XMPP::Jid("benchmark@example.org"));
+    }
+
+    void cleanupTestCase()
+    {
+        delete psi;
+        QCA::unloadAllPlugins();
+        delete qca_init;
+    }
+
+    // text
+
+    void linkify()
+    {
+        Fixture     f;
+        QStringList lines;
+        for (int i = 0; i < 100; ++i)
+            lines << TextUtil::plain2rich(f.line(40));
+        QBENCHMARK {
+            for (const QString &l : lines)
+                TextUtil::linkify(l);
+        }
+    }
+
+    void emoticonify()
+    {
+        Fixture     f;
+        QStringList lines;
+        for (int i = 0; i < 100; ++i)
+            lines << TextUtil::plain2rich(f.line(40));
+        QBENCHMARK {
+            for (const QString &l : lines)
+                TextUtil::emoticonify(l);
+        }
+    }
+
+    void plain2rich()
+    {
+        Fixture     f;
+        QStringList lines;
+        for (int i = 0; i < 100; ++i)
+            lines << f.line(40);
+        QBENCHMARK {
+            for (const QString &l : lines)
+                TextUtil::plain2rich(l);
+        }
+    }
+
+    // options
+
+    void variantTreeGetValue()
+    {
+        Fixture     f;
+        VariantTree tree;
+        QStringList paths;
+        for (int i = 0; i < 2000; ++i) {
+            const QString path = QString("options.%1.%2.%3").arg(f.word()).arg(f.word()).arg(i);
+            tree.setValue(path, i);
+            paths << path;
+        }
+        QBENCHMARK {
+            for (const QString &p : paths)
+                tree.getValue(p);
+        }
+    }
+
+    // roster
+
+    void userListFind()
+    {
+        Fixture                 f;
+        UserList                list;
+        QList<XMPP::Jid>        jids;
+        for (int i = 0; i < 5000; ++i) {
+            UserListItem *u = new UserListItem;
+            u->setJid(f.jid(i));
+            list.append(u);
+            jids << f.jid(f.next(5000)).withResource("home");
+        }
+        QBENCHMARK {
+            for (const XMPP::Jid &j : jids)
+                list.find(j);
+        }
+        qDeleteAll(list);
+    }
+
+    void contactListProxySort()
+    {
+        Fixture f;
+        for (int i = 0; i < 2000; ++i) {
+            UserListItem u;
+            u.setJid(f.jid(i));
+            u.setName(f.word() + QString::number(f.next(10000)));
+            u.setGroups(QStringList() << f.word());
+            u.setInList(true);
+            account->updateEntry(u);
+        }
+        ContactListModel      model(psi->contactList());
+        ContactListProxyModel proxy(nullptr);
+        proxy.setSourceModel(&model);
+        QBENCHMARK {
+            proxy.sort(0, Qt::DescendingOrder);
+            proxy.sort(0, Qt::AscendingOrder);
+        }
+    }
+
+    void gcUserModelUpdateEntry()
+    {
+        Fixture     f;
+        GCUserModel model(account, XMPP::Jid("room@conference.example.org/benchmark"), nullptr);
+        QStringList nicks;
+        for (int i = 0; i < 10000; ++i) {
+            nicks << f.word() + QString::number(i);
+            model.updateEntry(nicks.last(), XMPP::Status(XMPP::Status::Online));
+        }
+        QBENCHMARK {
+            for (int i = 0; i < 500; ++i) {
+                const int n = f.next(nicks.size());
+                model.updateEntry(nicks.at(n), XMPP::Status(i % 2 ? XMPP::Status::Away : XMPP::Status::Online));
+            }
+        }
+    }
+
+    // history
+
+    void edbFlatFileIndex()
+    {
+        const XMPP::Jid jid("flatfile@example.org");
+        EDBFlatFile     edb(psi);
+        fillHistory(&edb, jid, 20000);
+        const QString index = EDBFlatFile::File::indexFileName(EDBFlatFile::File::jidToFileName(jid));
+        QBENCHMARK {
+            QFile::remove(index);
+            EDBFlatFile::File file(jid);
+            QCOMPARE(file.total(), 20000);
+        }
+    }
+
+    void edbSqLiteGet()
+    {
+        const XMPP::Jid jid("sqlite@example.org");
+        EDBSqLite       edb(psi);
+        QVERIFY(edb.init());
+        fillHistory(&edb, jid, 20000);
+        EDBHandle  h(&edb);
+        QSignalSpy spy(&h, SIGNAL(finished()));
+        Fixture    f;
+        QBENCHMARK {
+            h.get(account->id(), jid, QDateTime(), EDB::Forward, f.next(19900), 50);
+            QVERIFY(spy.wait(10000));
+        }
+    }
+
+    // searches the history written by edbSqLiteGet
+    void edbSqLiteFind()
+    {
+        const XMPP::Jid jid("sqlite@example.org");
+        EDBSqLite       edb(psi);
+        QVERIFY(edb.init());
+        EDBHandle  h(&edb);
+        QSignalSpy spy(&h, SIGNAL(finished()));
+        QBENCHMARK {
+            h.find(account->id(), "tomorrow lunch", jid, QDateTime(), EDB::Backward);
+            QVERIFY(spy.wait(10000));
+        }
+    }
+
+    // inserts as a chat does, each message on its own and committed by the worker
+    void edbSqLiteAppend()
+    {
+        const XMPP::Jid jid("sqlite-append@example.org");
+        EDBSqLite       edb(psi);
+        QVERIFY(edb.init());
+        qDebug("storage profile: %s", qPrintable(edb.getStorageParam("storage_profile")));
+        const QList<PsiEvent::Ptr> events = historyEvents(200);
+        EDBHandle  h(&edb);
+        QSignalSpy spy(&h, SIGNAL(finished()));
+        QBENCHMARK {
+            for (const PsiEvent::Ptr &e : events) {
+                h.append(account->id(), jid, e, EDB::Contact);
+                QVERIFY(spy.wait(10000));
+            }
+        }
+    }
+
+    // pages through the history of edbSqLiteGet while another contact keeps writing
+    void edbSqLiteGetWhileAppending()
+    {
+        const XMPP::Jid jid("sqlite@example.org");
+        const XMPP::Jid writer("sqlite-append@example.org");
+        EDBSqLite       edb(psi);
+        QVERIFY(edb.init());
+        const QList<PsiEvent::Ptr> events = historyEvents(50);
+        EDBHandle  r(&edb);
+        EDBHandle  w(&edb);
+        QSignalSpy readSpy(&r, SIGNAL(finished()));
+        QSignalSpy writeSpy(&w, SIGNAL(finished()));
+        Fixture    f;
+        QBENCHMARK {
+            // a handle follows its latest request, the writes are done with the last one
+            for (const PsiEvent::Ptr &e : events) {
+                w.append(account->id(), writer, e, EDB::Contact);
+                r.get(account->id(), jid, QDateTime(), EDB::Forward, f.next(19900), 50);
+                QVERIFY(readSpy.wait(10000));
+            }
+            if (w.busy())
+                QVERIFY(writeSpy.wait(10000));
+        }
+    }
+};
+
+QTEST_MAIN(TestBenchmark)
+#include "testbenchmark.moc"
@@ -0,0 +1,9 @@
+TARGET = testbenchmark
+SOURCES += testbenchmark.cpp
+
+include(../half_of_psi.pri)
+
+# results of every benchmark as csv, to compare builds of different commits
+QMAKE_EXTRA_TARGETS += bench
+bench.depends = $$EXEC_TARGET
+bench.commands = PSIDATADIR=~/.psi-bench ./$$EXEC_TARGET -o benchmark.csv,csv
@@ -31,10 +31,13 @@
 #include <QBuffer>
 #include <QList>
 #include <QPixmap>
+#include <QSet>
 #include <QTextDocument> // for TextUtil::escape()
 #include <QUrl>
 #include <QtCrypto>
 
+#include <algorithm>
+
 using namespace XMPP;
 
 static QString dot_truncate(const QString &in, int clip)
@@ -47,6 +50,41 @@ static QString dot_truncate(const QString &in, int clip)
     return s;
 }
 
+/**
+ * Client names, versions, OSes and group names repeat across thousands of
+ * roster entries. Returns a shared copy of \a s, so each distinct string
+ * is stored only once.
+ */
+static QString intern(const QString &s)
+{
+    if (s.isEmpty())
+        return QString();
+
+    static QSet<QString> pool;
+    auto it = pool.constFind(s);
+    if (it == pool.constEnd()) {
+        QString copy = s;
+        copy.squeeze();
+        it = pool.insert(copy);
+    }
+    return *it;
+}
+
+static QStringList intern(const QStringList &list)
+{
+    QStringList res;
+    res.reserve(list.size());
+    foreach (const QString &s, list)
+        res += intern(s);
+    return res;
+}
+
+template <typename T> static const T &empty()
+{
+    static const T v;
+    return v;
+}
+
 //----------------------------------------------------------------------------
 // UserResource
 //----------------------------------------------------------------------------
@@ -88,13 +126,14 @@ const QString & UserResource::clientOS() const
 
 void UserResource::setClient(const QString &name, const QString& version, const QString& os)
 {
-    v_clientName = name;
-    v_clientVersion = version;
-    v_clientOS = os;
+    v_clientName = intern(name);
+    v_clientVersion = intern(version);
+    v_clientOS = intern(os);
     if (!v_clientName.isEmpty()) {
-        v_ver = v_clientName + " " + v_clientVersion;
+        QString ver = v_clientName + " " + v_clientVersion;
         if ( !v_clientOS.isEmpty() )
-            v_ver += " / " + v_clientOS;
+            ver += " / " + v_clientOS;
+        v_ver = intern(ver);
     }
     else {
         v_ver = "";
@@ -132,7 +171,7 @@ void UserResource::setTimezone(Maybe<int> off)
         u += QString::number(t.hour());
         if (t.minute())
             u += QString(":%1").arg(t.minute());
-        v_tzoString = u;
+        v_tzoString = intern(u);
     }
     else
         v_tzoString = "";
@@ -170,22 +209,32 @@ void UserResource::setSigTimestamp(const QDateTime &ts)
 
 void UserResource::setTune(const QString& t)
 {
-    v_tune = t;
+    if (!v_pep) {
+        if (t.isEmpty())
+            return;
+        v_pep = new UserPEPData;
+    }
+    v_pep->tune = t;
 }
 
 const QString& UserResource::tune() const
 {
-    return v_tune;
+    return v_pep ? v_pep->tune : empty<QString>();
 }
 
 void UserResource::setGeoLocation(const GeoLocation& geoLocation)
 {
-    v_geoLocation = geoLocation;
+    if (!v_pep) {
+        if (geoLocation.isNull())
+            return;
+        v_pep = new UserPEPData;
+    }
+    v_pep->geoLocation = geoLocation;
 }
 
 const GeoLocation& UserResource::geoLocation() const
 {
-    return v_geoLocation;
+    return v_pep ? v_pep->geoLocation : empty<GeoLocation>();
 }
 
 /*void UserResource::setPhysicalLocation(const PhysicalLocation& physicalLocation)
@@ -298,6 +347,7 @@ UserListItem::UserListItem(bool self)
     lastmsgtype = -1;
     v_pending = 0;
     v_hPending = 0;
+    v_revision = 0;
 }
 
 UserListItem::~UserListItem()
@@ -311,12 +361,18 @@ bool UserListItem::inList() const
 
 void UserListItem::setMood(const Mood& mood)
 {
-    v_mood = mood;
+    ++v_revision;
+    if (!v_pep) {
+        if (mood.isNull())
+            return;
+        v_pep = new UserPEPData;
+    }
+    v_pep->mood = mood;
 }
 
 const Mood& UserListItem::mood() const
 {
-    return v_mood;
+    return v_pep ? v_pep->mood : empty<Mood>();
 }
 
 QStringList UserListItem::clients() const
@@ -357,32 +413,50 @@ QString UserListItem::findClient(const UserResource &ur) const
 
 void UserListItem::setActivity(const Activity& activity)
 {
-    v_activity = activity;
+    ++v_revision;
+    if (!v_pep) {
+        if (activity.isNull())
+            return;
+        v_pep = new UserPEPData;
+    }
+    v_pep->activity = activity;
 }
 
 const Activity& UserListItem::activity() const
 {
-    return v_activity;
+    return v_pep ? v_pep->activity : empty<Activity>();
 }
 
 void UserListItem::setTune(const QString& t)
 {
-    v_tune = t;
+    ++v_revision;
+    if (!v_pep) {
+        if (t.isEmpty())
+            return;
+        v_pep = new UserPEPData;
+    }
+    v_pep->tune = t;
 }
 
 const QString& UserListItem::tune() const
 {
-    return v_tune;
+    return v_pep ? v_pep->tune : empty<QString>();
 }
 
 void UserListItem::setGeoLocation(const GeoLocation& geoLocation)
 {
-    v_geoLocation = geoLocation;
+    ++v_revision;
+    if (!v_pep) {
+        if (geoLocation.isNull())
+            return;
+        v_pep = new UserPEPData;
+    }
+    v_pep->geoLocation = geoLocation;
 }
 
 const GeoLocation& UserListItem::geoLocation() const
 {
-    return v_geoLocation;
+    return v_pep ? v_pep->geoLocation : empty<GeoLocation>();
 }
 
 /*void UserListItem::setPhysicalLocation(const PhysicalLocation& physicalLocation)
@@ -397,11 +471,13 @@ const PhysicalLocation& UserListItem::physicalLocation() const
 
 void UserListItem::setAvatarFactory(AvatarFactory* av)
 {
+    ++v_revision;
     v_avatarFactory = av;
 }
 
 void UserListItem::setJid(const Jid &j)
 {
+    ++v_revision;
     LiveRosterItem::setJid(j);
 
     int n = jid().full().indexOf('@');
@@ -411,6 +487,19 @@ void UserListItem::setJid(const Jid &j)
         v_isTransport = false;
 }
 
+void UserListItem::setRosterItem(const RosterItem &i)
+{
+    ++v_revision;
+    LiveRosterItem::setRosterItem(i);
+    LiveRosterItem::setGroups(intern(groups()));
+}
+
+void UserListItem::setGroups(const QStringList &g)
+{
+    ++v_revision;
+    LiveRosterItem::setGroups(intern(g));
+}
+
 bool UserListItem::isTransport() const
 {
     return v_isTransport;
@@ -423,6 +512,7 @@ bool UserListItem::isConference() const
 
 void UserListItem::setConference(bool b)
 {
+    ++v_revision;
     v_isConference = b;
 }
 
@@ -494,26 +584,31 @@ bool UserListItem::isSelf() const
 
 void UserListItem::setInList(bool b)
 {
+    ++v_revision;
     v_inList = b;
 }
 
 void UserListItem::setLastAvailable(const QDateTime &t)
 {
+    ++v_revision;
     v_t = t;
 }
 
 void UserListItem::setPresenceError(const QString &e)
 {
+    ++v_revision;
     v_perr = e;
 }
 
 UserResourceList & UserListItem::userResourceList()
 {
+    ++v_revision;
     return v_url;
 }
 
 UserResourceList::Iterator UserListItem::priority()
 {
+    ++v_revision;
     return v_url.priority();
 }
 
@@ -532,7 +627,69 @@ QString UserListItem::makeTip(bool trim, bool doLinkify) const
     return "<qt>" + makeBareTip(trim,doLinkify) + "</qt>";
 }
 
+/**
+ * Incremented whenever something affecting every tooltip changes,
+ * i.e. options or iconsets.
+ */
+static int tipsRevision()
+{
+    static int revision = 0;
+    static bool connected = false;
+    if (!connected) {
+        connected = true;
+        QObject::connect(PsiOptions::instance(), &PsiOptions::optionChanged, PsiOptions::instance(), []() { ++revision; });
+        QObject::connect(PsiIconset::instance(), &PsiIconset::emoticonsChanged, PsiOptions::instance(), []() { ++revision; });
+        QObject::connect(PsiIconset::instance(), &PsiIconset::systemIconsSizeChanged, PsiOptions::instance(), []() { ++revision; });
+        QObject::connect(PsiIconset::instance(), &PsiIconset::rosterIconsSizeChanged, PsiOptions::instance(), []() { ++revision; });
+    }
+    return revision;
+}
+
+/**
+ * Tooltips are expensive to build (status icons are embedded as png) and
+ * get requested on every hover, so they are cached until the item, the
+ * options or the iconsets change. Each trim/linkify variant is built only
+ * when it's asked for.
+ */
 QString UserListItem::makeBareTip(bool trim, bool doLinkify) const
+{
+    bool useAvatar = false;
+    if (v_avatarFactory && PsiOptions::instance()->getOption("options.ui.contactlist.tooltip.avatar").toBool()) {
+        bool mucItem = !userResourceList().isEmpty() && userResourceList()[0].status().hasMUCItem();
+        if (mucItem) {
+            useAvatar = !v_avatarFactory->getMucAvatar(jid()).isNull();
+        } else {
+            useAvatar = !v_avatarFactory->getAvatar(jid().bare()).isNull();
+        }
+    }
+
+    // name, subscription and last status are set through LiveRosterItem,
+    // which doesn't bump our revision
+    TipCache &c = v_tipCache;
+    qint64 minute = QDateTime::currentMSecsSinceEpoch() / 60000;
+    if (c.revision != v_revision || c.globalRevision != tipsRevision() || c.useAvatar != useAvatar
+        || (c.minute != -1 && c.minute != minute) || c.name != name()
+        || c.subscription != subscription().type() || c.lastStatus != lastUnavailableStatus().status()) {
+        c = TipCache();
+        c.revision = v_revision;
+        c.globalRevision = tipsRevision();
+        c.useAvatar = useAvatar;
+        c.name = name();
+        c.subscription = subscription().type();
+        c.lastStatus = lastUnavailableStatus().status();
+    }
+
+    QString &tip = c.tips[(trim ? 1 : 0) | (doLinkify ? 2 : 0)];
+    if (tip.isNull()) {
+        bool showsTime = false;
+        tip = buildTip(trim, doLinkify, useAvatar, &showsTime);
+        if (showsTime)
+            c.minute = minute;
+    }
+    return tip;
+}
+
+QString UserListItem::buildTip(bool trim, bool doLinkify, bool useAvatar, bool *showsTime) const
 {
     // NOTE: If you add something to the tooltip,
     // you most probably want to wrap it with TextUtil::escape()
@@ -545,21 +702,12 @@ QString UserListItem::makeBareTip(bool trim, bool doLinkify) const
     </style>").arg(s+2);
 
     QString imgTag = "icon name"; // or 'img src' if appropriate QMimeSourceFactory is installed. but mblsha noticed that QMimeSourceFactory unloads sometimes
-    bool useAvatar = false;
     bool mucItem = false;
 
     if(!userResourceList().isEmpty()) {
         mucItem = userResourceList()[0].status().hasMUCItem();
     }
 
-    if (v_avatarFactory && PsiOptions::instance()->getOption("options.ui.contactlist.tooltip.avatar").toBool()) {
-        if (mucItem) {
-            useAvatar = !v_avatarFactory->getMucAvatar(jid()).isNull();
-        } else {
-            useAvatar = !v_avatarFactory->getAvatar(jid().bare()).isNull();
-        }
-    }
-
     str += "<table cellspacing=\"3\"><tr>";
     str += "<td>";
 
@@ -689,6 +837,7 @@ QString UserListItem::makeBareTip(bool trim, bool doLinkify) const
 
             // Entity Time
             if (r.timezoneOffset().hasValue()) {
+                *showsTime = true;
                 QDateTime dt = QDateTime::currentDateTime().toUTC().addSecs(r.timezoneOffset().value()*60);
                 str += QString("<div class='layer1'><%1=\"%2\"> ").arg(imgTag).arg("psi/time") + QObject::tr("Time") + QString(": %1 (%2)").arg(dt.toString(Qt::DefaultLocaleShortDate)).arg(r.timezoneOffsetString()) + "</div>";
             }
@@ -791,6 +940,7 @@ bool UserListItem::isPrivate() const
 
 void UserListItem::setPrivate(bool b)
 {
+    ++v_revision;
     v_private = b;
 }
 
@@ -810,6 +960,7 @@ bool UserListItem::isSecure(const QString &rname) const
 
 void UserListItem::setSecure(const QString &rname, bool b)
 {
+    ++v_revision;
     foreach(const QString s, secList) {
         if(s == rname) {
             if(!b)
@@ -828,6 +979,7 @@ const QString & UserListItem::publicKeyID() const
 
 void UserListItem::setPublicKeyID(const QString &k)
 {
+    ++v_revision;
     v_keyID = k;
 }
 
@@ -844,10 +996,48 @@ UserList::~UserList()
 
 UserListItem *UserList::find(const XMPP::Jid &j)
 {
-    foreach(UserListItem* i, *this) {
-        if(i->jid().compare(j))
-            return i;
+    UserListItem *res = nullptr;
+    const JidKey  key(j);
+    for (auto it = index_.constFind(key); it != index_.constEnd() && it.key() == key; ++it) {
+        UserListItem *i = it.value();
+        // several items with the same jid are unusual, prefer the earliest one like a list scan does
+        if (i->jid().compare(j) && (!res || indexOf(i) < indexOf(res)))
+            res = i;
+    }
+    return res;
+}
+
+QList<UserListItem*> UserList::findAll(const QString &bare) const
+{
+    // QMultiHash returns the most recently inserted first, items are only appended
+    QList<UserListItem*> res = index_.values(JidKey(bare));
+    std::reverse(res.begin(), res.end());
+    return res;
+}
+
+void UserList::append(UserListItem *i)
+{
+    QList<UserListItem*>::append(i);
+    index_.insert(JidKey(i->jid()), i);
+}
+
+int UserList::removeAll(UserListItem *i)
+{
+    if (index_.remove(JidKey(i->jid()), i) == 0) {
+        // the jid was changed behind our back
+        for (auto it = index_.begin(); it != index_.end(); ) {
+            if (it.value() == i)
+                it = index_.erase(it);
+            else
+                ++it;
+        }
     }
-    return nullptr;
+    return QList<UserListItem*>::removeAll(i);
+}
+
+void UserList::clear()
+{
+    QList<UserListItem*>::clear();
+    index_.clear();
 }
 
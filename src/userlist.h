@@ -22,6 +22,7 @@
 
 #include "activity.h"
 #include "geolocation.h"
+#include "jidkey.h"
 #include "maybe.h"
 #include "mood.h"
 #include "xmpp_liverosteritem.h"
@@ -29,7 +30,9 @@
 
 #include <QDateTime>
 #include <QList>
+#include <QMultiHash>
 #include <QPixmap>
+#include <QSharedData>
 #include <QString>
 
 class AvatarFactory;
@@ -38,6 +41,16 @@ namespace XMPP {
     class Jid;
 }
 
+// Rarely published PEP data. Allocated only for contacts which publish it.
+class UserPEPData : public QSharedData
+{
+public:
+    Mood mood;
+    Activity activity;
+    QString tune;
+    GeoLocation geoLocation;
+};
+
 class UserResource : public XMPP::Resource
 {
 public:
@@ -75,8 +88,7 @@ private:
     QString v_ver, v_clientName, v_clientVersion, v_clientOS, v_keyID;
     Maybe<int> v_tzo;
     QString v_tzoString;
-    QString v_tune;
-    GeoLocation v_geoLocation;
+    QSharedDataPointer<UserPEPData> v_pep;
     //PhysicalLocation v_physicalLocation;
     int v_pgpVerifyStatus;
     QDateTime sigts;
@@ -131,6 +143,9 @@ public:
     QString pending() const;
 
     void setJid(const XMPP::Jid &);
+    // These hide the RosterItem versions to share group name strings
+    void setRosterItem(const XMPP::RosterItem &);
+    void setGroups(const QStringList &);
     void setInList(bool);
     void setLastAvailable(const QDateTime &);
     void setPresenceError(const QString &);
@@ -170,12 +185,24 @@ private:
     QStringList secList;
     QString v_keyID;
     QPixmap v_avatar;
-    Mood v_mood;
-    Activity v_activity;
-    QString v_tune;
-    GeoLocation v_geoLocation;
+    QSharedDataPointer<UserPEPData> v_pep;
     //PhysicalLocation v_physicalLocation;
     AvatarFactory* v_avatarFactory;
+
+    struct TipCache {
+        int revision = -1;
+        int globalRevision = -1;
+        qint64 minute = -1; // set only if a tip shows the contact's time
+        bool useAvatar = false;
+        QString name;
+        int subscription = -1;
+        QString lastStatus;
+        QString tips[4];
+    };
+    int v_revision;
+    mutable TipCache v_tipCache;
+
+    QString buildTip(bool trim, bool doLinkify, bool useAvatar, bool *showsTime) const;
 };
 
 typedef QListIterator<UserListItem*> UserListIt;
@@ -187,6 +214,16 @@ public:
     ~UserList();
 
     UserListItem *find(const XMPP::Jid &);
+    QList<UserListItem*> findAll(const QString &bare) const;
+
+    // These hide the QList versions to keep the bare JID index up to date.
+    // The jid of an item must not change while it is in the list.
+    void append(UserListItem *);
+    int removeAll(UserListItem *);
+    void clear();
+
+private:
+    QMultiHash<JidKey, UserListItem*> index_;
 };
 
 #endif // USERLIST_H
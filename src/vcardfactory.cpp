@@ -20,27 +20,55 @@
 #include "vcardfactory.h"
 
 #include "applicationinfo.h"
-#include "jidutil.h"
-#include "profiles.h"
+#include "memoryaccounting.h"
 #include "psiaccount.h"
 #include "xmpp_tasks.h"
 #include "xmpp_vcard.h"
 #include <functional>
 
 #include <QApplication>
-#include <QDir>
 #include <QDomDocument>
-#include <QFile>
 #include <QMap>
 #include <QObject>
-#include <QTextStream>
+#include <QThread>
+
+static const int vcardCacheSize = 8 * 1024 * 1024; // bytes of xml
 
 /**
  * \brief Factory for retrieving and changing VCards.
  */
 VCardFactory::VCardFactory() :
-    QObject(qApp), dictSize_(5)
+    QObject(qApp),
+    storeThread_(new QThread(this)),
+    store_(new VCardStore()),
+    vcardCache_(vcardCacheSize)
 {
+    qRegisterMetaType<VCardStoreEntries>("VCardStoreEntries");
+    store_->moveToThread(storeThread_);
+    connect(store_, &VCardStore::loaded, this, &VCardFactory::storeLoaded);
+    connect(store_, &VCardStore::notFound, this, &VCardFactory::storeNotFound);
+    connect(store_, &VCardStore::warmedUp, this, &VCardFactory::storeWarmedUp);
+    storeThread_->setObjectName("VCardStore");
+    storeThread_->start();
+    QMetaObject::invokeMethod(store_, "open", Qt::QueuedConnection, Q_ARG(QString, ApplicationInfo::vCardDir()),
+                              Q_ARG(int, vcardCacheSize));
+
+    // the store has them all, so the cache can go
+    MemoryAccounting::add(
+        this, "vcards",
+        [this]() {
+            MemoryAccounting::Usage u;
+            u.bytes   = vcardCache_.totalCost();
+            u.entries = vcardCache_.count();
+            return u;
+        },
+        [this]() { vcardCache_.clear(); });
+    MemoryAccounting::add(this, "muc vcards", [this]() {
+        MemoryAccounting::Usage u;
+        for (const auto &room : mucVcardDict_)
+            u.entries += room.size();
+        return u;
+    });
 }
 
 /**
@@ -48,6 +76,10 @@ VCardFactory::VCardFactory() :
  */
 VCardFactory::~VCardFactory()
 {
+    QMetaObject::invokeMethod(store_, "close", Qt::BlockingQueuedConnection);
+    storeThread_->quit();
+    storeThread_->wait();
+    delete store_;
 }
 
 /**
@@ -61,21 +93,54 @@ VCardFactory *VCardFactory::instance()
     return instance_;
 }
 
-/**
- * Adds a vcard to the cache (and removes other items if necessary)
- */
-void VCardFactory::checkLimit(const QString &jid, const VCard &vcard)
-{
-    if (vcardList_.contains(jid)) {
-        vcardList_.removeAll(jid);
-        vcardDict_.remove(jid);
-    } else if (vcardList_.size() > dictSize_) {
-        QString j = vcardList_.takeLast();
-        vcardDict_.remove(j);
+// the store has always had lower case keys
+JidKey VCardFactory::key(const Jid &j)
+{
+    return JidKey(j.bare().toLower());
+}
+
+void VCardFactory::storeLoaded(const VCardStoreEntries &entries)
+{
+    for (const VCardStoreEntry &e : entries) {
+        const JidKey k(e.jid);
+        // a vcard saved in the meantime is newer than the stored one
+        if (!pending_.remove(k)) {
+            if (!vcardCache_.contains(k))
+                vcardCache_.insert(k, new VCard(e.vcard), e.size);
+            continue;
+        }
+        vcardCache_.insert(k, new VCard(e.vcard), e.size);
+
+        // somebody asked for it and got nothing
+        Jid j(e.jid);
+        emit vcardChanged(j);
+        if (!e.vcard.photo().isEmpty()) {
+            emit vcardPhotoAvailable(j, false);
+        }
+    }
+}
+
+void VCardFactory::storeNotFound(const QStringList &jids)
+{
+    for (const QString &jid : jids) {
+        const JidKey k(jid);
+        pending_.remove(k);
+        missing_.insert(k);
     }
+}
 
-    vcardDict_.insert(jid, vcard);
-    vcardList_.push_front(jid);
+void VCardFactory::storeWarmedUp()
+{
+    storeReady_ = true;
+    // whatever was asked for and didn't come with the warm-up
+    QStringList jids;
+    for (const JidKey &k : pending_) {
+        if (vcardCache_.contains(k))
+            continue;
+        jids.append(k.toString());
+    }
+    if (!jids.isEmpty())
+        QMetaObject::invokeMethod(store_, "load", Qt::QueuedConnection, Q_ARG(QStringList, jids));
 }
 
 void VCardFactory::taskFinished()
@@ -95,11 +160,11 @@ void VCardFactory::mucTaskFinished()
     bool      notifyPhoto = task->property("phntf").toBool();
     if (task->success()) {
         Jid   j          = task->jid();
-        auto &nick2vcard = mucVcardDict_[j.bare()];
+        auto &nick2vcard = mucVcardDict_[JidKey(j)];
         auto  nickIt     = nick2vcard.find(j.resource());
         if (nickIt == nick2vcard.end()) {
             nick2vcard.insert(j.resource(), task->vcard());
-            auto &resQueue = lastMucVcards_[j.bare()];
+            auto &resQueue = lastMucVcards_[JidKey(j)];
             resQueue.enqueue(j.resource());
             while (resQueue.size() > 3) { // keep max 3 vcards per muc
                 nick2vcard.remove(resQueue.dequeue());
@@ -117,23 +182,15 @@ void VCardFactory::mucTaskFinished()
 
 void VCardFactory::saveVCard(const Jid &j, const VCard &vcard, bool notifyPhoto)
 {
-    checkLimit(j.bare(), vcard);
-
-    // save vCard to disk
-
-    // ensure that there's a vcard directory to save into
-    QDir p(pathToProfile(activeProfile, ApplicationInfo::CacheLocation));
-    QDir v(pathToProfile(activeProfile, ApplicationInfo::CacheLocation) + "/vcard");
-    if (!v.exists())
-        p.mkdir("vcard");
-
-    QFile file(ApplicationInfo::vCardDir() + '/' + JIDUtil::encode(j.bare()).toLower() + ".xml");
-    file.open(QIODevice::WriteOnly);
-    QTextStream out(&file);
-    out.setCodec("UTF-8");
+    const JidKey k = key(j);
     QDomDocument doc;
     doc.appendChild(vcard.toXml(&doc));
-    out << doc.toString(4);
+    QString xml = doc.toString(-1);
+
+    vcardCache_.insert(k, new VCard(vcard), xml.size() * int(sizeof(QChar)));
+    pending_.remove(k);
+    missing_.remove(k);
+    QMetaObject::invokeMethod(store_, "save", Qt::QueuedConnection, Q_ARG(QString, k.toString()), Q_ARG(QString, xml));
 
     Jid  jid = j;
     emit vcardChanged(jid);
@@ -148,7 +205,7 @@ void VCardFactory::saveVCard(const Jid &j, const VCard &vcard, bool notifyPhoto)
  */
 const VCard VCardFactory::mucVcard(const Jid &j) const
 {
-    QHash<QString, VCard>                d  = mucVcardDict_.value(j.bare());
+    QHash<QString, VCard>                d  = mucVcardDict_.value(JidKey(j));
     QHash<QString, VCard>::ConstIterator it = d.constFind(j.resource());
     if (it != d.constEnd()) {
         return *it;
@@ -158,27 +215,25 @@ const VCard VCardFactory::mucVcard(const Jid &j) const
 
 /**
  * \brief Call this, when you need a cached vCard.
+ *
+ * Returns a null vCard if it isn't in memory yet, vcardChanged() is emitted
+ * once it has been loaded from the store.
  */
 VCard VCardFactory::vcard(const Jid &j)
 {
-    // first, try to get vCard from runtime cache
-    if (vcardDict_.contains(j.bare())) {
-        return vcardDict_[j.bare()];
+    const JidKey k     = key(j);
+    VCard *      vcard = vcardCache_.object(k);
+    if (vcard) {
+        return *vcard;
     }
 
-    // then try to load from cache on disk
-    QFile file(ApplicationInfo::vCardDir() + '/' + JIDUtil::encode(j.bare()).toLower() + ".xml");
-    file.open(QIODevice::ReadOnly);
-    QDomDocument doc;
-
-    if (doc.setContent(&file, false)) {
-        VCard vcard = VCard::fromXml(doc.documentElement());
-        if (!vcard.isNull()) {
-            checkLimit(j.bare(), vcard);
-            return vcard;
-        }
+    // not in memory. ask the store, vcardChanged() follows when it has one
+    if (!missing_.contains(k) && !pending_.contains(k)) {
+        pending_.insert(k);
+        if (storeReady_)
+            QMetaObject::invokeMethod(store_, "load", Qt::QueuedConnection,
+                                      Q_ARG(QStringList, QStringList() << k.toString()));
     }
-
     return VCard();
 }
 
@@ -20,13 +20,19 @@
 #ifndef VCARDFACTORY_H
 #define VCARDFACTORY_H
 
+#include "jidkey.h"
+#include "vcardstore.h"
+
+#include <QCache>
 #include <QHash>
 #include <QMap>
 #include <QObject>
+#include <QSet>
 #include <QStringList>
 #include <functional>
 
 class PsiAccount;
+class QThread;
 
 namespace XMPP {
 class JT_VCard;
@@ -53,26 +59,30 @@ signals:
     void vcardChanged(const Jid &);
     void vcardPhotoAvailable(const Jid &, bool isMuc); // dedicated for AvatarFactory. it will almost always work except requests from AvatarFactory
 
-protected:
-    void checkLimit(const QString &jid, const VCard &vcard);
-
 private slots:
     void updateVCardFinished();
     void taskFinished();
     void mucTaskFinished();
+    void storeLoaded(const VCardStoreEntries &entries);
+    void storeNotFound(const QStringList &jids);
+    void storeWarmedUp();
 
 private:
     VCardFactory();
     ~VCardFactory();
 
     static VCardFactory *                instance_;
-    const int                            dictSize_;
-    QStringList                          vcardList_;
-    QMap<QString, VCard>                 vcardDict_;
-    QMap<QString, QHash<QString, VCard>> mucVcardDict_;  // QHash in case of big mucs mucBareJid => {resoure => vcard}
-    QMap<QString, QQueue<QString>>       lastMucVcards_; // to limit the hash above. this one keeps ordered resource. mucBareJid => resource_list
+    QThread *                            storeThread_;
+    VCardStore *                         store_;
+    bool                                 storeReady_ = false;
+    QCache<JidKey, VCard>                vcardCache_; // bare jid => vcard, cost in bytes
+    QSet<JidKey>                         pending_;    // requested from the store
+    QSet<JidKey>                         missing_;    // known to be absent in the store
+    QHash<JidKey, QHash<QString, VCard>> mucVcardDict_;  // QHash in case of big mucs mucBareJid => {resoure => vcard}
+    QHash<JidKey, QQueue<QString>>       lastMucVcards_; // to limit the hash above. this one keeps ordered resource. mucBareJid => resource_list
 
-    void saveVCard(const Jid &, const VCard &, bool notifyPhoto);
+    static JidKey key(const Jid &);
+    void          saveVCard(const Jid &, const VCard &, bool notifyPhoto);
 };
 
 #endif // VCARDFACTORY_H
@@ -0,0 +1,172 @@
+/*
+ * vcardstore.cpp - on-disk storage of cached vCards
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "vcardstore.h"
+
+#include "jidutil.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+
+static const char *connectionName = "vcards";
+static const int   loadBatchSize  = 200;
+
+VCardStore::VCardStore() : QObject()
+{
+}
+
+/**
+ * Opens the database in \a dir, imports the old one-file-per-contact
+ * cache found there and sends out the most recent vCards, up to \a warmUpBytes
+ * of xml.
+ */
+bool VCardStore::open(const QString &dir, int warmUpBytes)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(dir + "/vcards.db");
+    if (!db.open()) {
+        qWarning("VCardStore::open(): Can't open base.\n%s", qUtf8Printable(db.lastError().text()));
+        emit warmedUp();
+        return false;
+    }
+    QSqlQuery query(db);
+    query.exec("CREATE TABLE IF NOT EXISTS `vcards` ("
+               "`jid` TEXT NOT NULL PRIMARY KEY, "
+               "`ts` INTEGER, "
+               "`xml` TEXT"
+               ");");
+    migrate(dir);
+    warmUp(warmUpBytes);
+    emit warmedUp();
+    return true;
+}
+
+void VCardStore::close()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+        if (db.isOpen())
+            db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+void VCardStore::migrate(const QString &dir)
+{
+    QDir        d(dir);
+    QStringList files = d.entryList(QStringList() << "*.xml", QDir::Files);
+    if (files.isEmpty())
+        return;
+
+    QSqlDatabase db = QSqlDatabase::database(connectionName);
+    QSqlQuery    query(db);
+    if (!db.transaction())
+        return;
+    query.prepare("INSERT OR IGNORE INTO `vcards` (`jid`, `ts`, `xml`) VALUES (?, ?, ?);");
+    for (const QString &name : files) {
+        QFile file(d.filePath(name));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        query.addBindValue(JIDUtil::decode(name.left(name.length() - 4)));
+        query.addBindValue(QFileInfo(file).lastModified().toMSecsSinceEpoch());
+        query.addBindValue(QString::fromUtf8(file.readAll()));
+        query.exec();
+    }
+    if (!db.commit()) {
+        qWarning("VCardStore: failed to import %s", qPrintable(dir));
+        return;
+    }
+    for (const QString &name : files)
+        d.remove(name);
+    qDebug("VCardStore: imported %d vCards", files.size());
+}
+
+void VCardStore::warmUp(int bytes)
+{
+    QSqlQuery query(QSqlDatabase::database(connectionName));
+    if (!query.exec("SELECT `jid`, `xml` FROM `vcards` ORDER BY `ts` DESC;"))
+        return;
+
+    VCardStoreEntries entries;
+    while (bytes > 0 && query.next()) {
+        VCardStoreEntry e;
+        if (!parse(query.value(0).toString(), query.value(1).toString(), &e))
+            continue;
+        bytes -= e.size;
+        entries.append(e);
+        if (entries.size() == loadBatchSize) {
+            emit loaded(entries);
+            entries.clear();
+        }
+    }
+    if (!entries.isEmpty())
+        emit loaded(entries);
+}
+
+void VCardStore::load(const QStringList &jids)
+{
+    QSqlQuery query(QSqlDatabase::database(connectionName));
+    query.prepare("SELECT `xml` FROM `vcards` WHERE `jid` = ?;");
+
+    VCardStoreEntries entries;
+    QStringList       missing;
+    for (const QString &jid : jids) {
+        query.addBindValue(jid);
+        VCardStoreEntry e;
+        if (query.exec() && query.next() && parse(jid, query.value(0).toString(), &e))
+            entries.append(e);
+        else
+            missing.append(jid);
+    }
+    if (!entries.isEmpty())
+        emit loaded(entries);
+    if (!missing.isEmpty())
+        emit notFound(missing);
+}
+
+void VCardStore::save(const QString &jid, const QString &xml)
+{
+    QSqlQuery query(QSqlDatabase::database(connectionName));
+    query.prepare("INSERT OR REPLACE INTO `vcards` (`jid`, `ts`, `xml`) VALUES (?, ?, ?);");
+    query.addBindValue(jid);
+    query.addBindValue(QDateTime::currentMSecsSinceEpoch());
+    query.addBindValue(xml);
+    if (!query.exec())
+        qWarning("VCardStore: failed to save vCard of %s: %s", qPrintable(jid), qUtf8Printable(query.lastError().text()));
+}
+
+bool VCardStore::parse(const QString &jid, const QString &xml, VCardStoreEntry *entry)
+{
+    QDomDocument doc;
+    if (!doc.setContent(xml, false))
+        return false;
+    entry->vcard = XMPP::VCard::fromXml(doc.documentElement());
+    if (entry->vcard.isNull())
+        return false;
+    entry->jid  = jid;
+    entry->size = xml.size() * int(sizeof(QChar));
+    return true;
+}
@@ -0,0 +1,64 @@
+/*
+ * vcardstore.h - on-disk storage of cached vCards
+ * Copyright (C) 2001-2019  Psi Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VCARDSTORE_H
+#define VCARDSTORE_H
+
+#include "xmpp_vcard.h"
+
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QStringList>
+
+struct VCardStoreEntry
+{
+    QString jid;
+    XMPP::VCard vcard;
+    int size = 0; // of the stored xml, in bytes
+};
+typedef QList<VCardStoreEntry> VCardStoreEntries;
+Q_DECLARE_METATYPE(VCardStoreEntries)
+
+// Lives in its own thread. All vCards are kept in one SQLite database,
+// xml is parsed here so the GUI thread never has to.
+class VCardStore : public QObject
+{
+    Q_OBJECT
+public:
+    VCardStore();
+
+public slots:
+    bool open(const QString &dir, int warmUpBytes);
+    void close();
+    void load(const QStringList &jids);
+    void save(const QString &jid, const QString &xml);
+
+signals:
+    void loaded(const VCardStoreEntries &entries);
+    void notFound(const QStringList &jids);
+    void warmedUp();
+
+private:
+    void migrate(const QString &dir);
+    void warmUp(int bytes);
+    static bool parse(const QString &jid, const QString &xml, VCardStoreEntry *entry);
+};
+
+#endif // VCARDSTORE_H
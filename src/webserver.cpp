@@ -1,8 +1,18 @@
 #include "webserver.h"
 
+#include <QCryptographicHash>
 #include <QFile>
 #include <QTcpServer>
 
+#include <algorithm>
+
+WebServer::StaticResponse::StaticResponse(const QByteArray &contentType, const QByteArray &data) :
+    contentType(contentType),
+    data(data),
+    etag('"' + QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex() + '"')
+{
+}
+
 WebServer::WebServer(QObject *parent) :
     qhttp::server::QHttpServer(parent)
 {
@@ -11,23 +21,46 @@ WebServer::WebServer(QObject *parent) :
             QHostAddress::LocalHost, 0,
             [this](QHttpRequest* req, QHttpResponse* res)
     {
-        // very global stuff first
-        QString path = req->url().path();
-        //qDebug() << "LOADING: " << path << serverPort();
-
-        foreach (auto &h, pathHandlers) {
-            if (path.startsWith(h.first)) {
-                if (h.second(req, res)) {
-                    return;
-                }
-            }
-        }
+        dispatch(req, res);
+    });
+}
+
+// The most specific prefix is tried first. Only as many hash lookups as there
+// are distinct prefix lengths are needed, regardless of the number of routes.
+void WebServer::dispatch(qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res)
+{
+    QString path = req->url().path();
+    //qDebug() << "LOADING: " << path << serverPort();
+
+    for (int len : prefixLengths) {
+        if (len > path.size())
+            continue;
+        auto it = routes.constFind(path.left(len));
+        if (it == routes.constEnd())
+            continue;
 
-        if (!defaultHandler || !defaultHandler(req, res)) {
-            res->setStatusCode(qhttp::ESTATUS_NOT_FOUND);
-            res->end();
+        const auto candidates = it.value(); // handlers may change routing
+        for (const auto &r : candidates) {
+            if (!r.methods.isEmpty() && !r.methods.contains(req->method()))
+                continue;
+            if (r.handler(req, res))
+                return;
         }
-    });
+    }
+
+    if (!defaultHandler || !defaultHandler(req, res)) {
+        res->setStatusCode(qhttp::ESTATUS_NOT_FOUND);
+        res->end();
+    }
+}
+
+void WebServer::updatePrefixLengths()
+{
+    prefixLengths.clear();
+    for (auto it = routes.constBegin(); it != routes.constEnd(); ++it)
+        prefixLengths.append(it.key().size());
+    std::sort(prefixLengths.begin(), prefixLengths.end(), std::greater<int>());
+    prefixLengths.erase(std::unique(prefixLengths.begin(), prefixLengths.end()), prefixLengths.end());
 }
 
 quint16 WebServer::serverPort() const
@@ -49,13 +82,55 @@ QUrl WebServer::serverUrl()
     return u;
 }
 
-void WebServer::route(const char *path, const WebServer::Handler &handler)
+void WebServer::route(const char *path, const WebServer::Handler &handler, const Methods &methods)
 {
-    pathHandlers.append(QPair<QString, Handler>(QLatin1String(path), handler));
+    Route r;
+    r.handler = handler;
+    r.methods = methods;
+    routes[QLatin1String(path)].append(r);
+    updatePrefixLengths();
 }
 
-void WebServer::unroute(const char *path)
+void WebServer::routeStatic(const char *path, const StaticResponse &response)
 {
     QString pstr = QLatin1String(path);
-    std::remove_if(pathHandlers.begin(), pathHandlers.end(), [pstr](const auto &v){return v.first == pstr;});
+    route(path, [pstr, response](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
+        if (req->url().path() != pstr)
+            return false;
+        sendStatic(req, res, response);
+        return true;
+    }, Methods() << qhttp::EHTTP_GET << qhttp::EHTTP_HEAD);
+}
+
+void WebServer::unroute(const char *path)
+{
+    routes.remove(QLatin1String(path));
+    updatePrefixLengths();
+}
+
+void WebServer::sendStatic(qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res,
+                           const StaticResponse &response)
+{
+    auto inm = req->headers().value("if-none-match");
+    if (response.etag.size() && inm.size()) {
+        for (const auto &tag : inm.split(',')) {
+            if (tag.trimmed() == response.etag || tag.trimmed() == "*") {
+                res->setStatusCode(qhttp::ESTATUS_NOT_MODIFIED);
+                res->addHeader("ETag", response.etag);
+                if (response.cacheControl.size())
+                    res->addHeader("Cache-Control", response.cacheControl);
+                res->end();
+                return;
+            }
+        }
+    }
+
+    res->setStatusCode(qhttp::ESTATUS_OK);
+    if (response.contentType.size())
+        res->addHeader("Content-Type", response.contentType);
+    if (response.etag.size())
+        res->addHeader("ETag", response.etag);
+    if (response.cacheControl.size())
+        res->addHeader("Cache-Control", response.cacheControl);
+    res->end(req->method() == qhttp::EHTTP_HEAD ? QByteArray() : response.data);
 }
@@ -5,6 +5,8 @@
 #include "qhttpserverrequest.hpp"
 #include "qhttpserverresponse.hpp"
 
+#include <QHash>
+#include <QList>
 #include <QObject>
 #include <functional>
 
@@ -13,6 +15,18 @@ class WebServer : public qhttp::server::QHttpServer
     Q_OBJECT
 public:
     typedef std::function<bool(qhttp::server::QHttpRequest* req, qhttp::server::QHttpResponse* res)> Handler;
+    typedef QList<qhttp::THttpMethod> Methods; // empty - any method
+
+    // a response computed once and served as is
+    struct StaticResponse {
+        QByteArray contentType;
+        QByteArray data;
+        QByteArray etag;
+        QByteArray cacheControl; // Cache-Control header, none if empty
+
+        StaticResponse() = default;
+        StaticResponse(const QByteArray &contentType, const QByteArray &data);
+    };
 
     WebServer(QObject *parent = nullptr);
 
@@ -20,12 +34,26 @@ public:
     QHostAddress serverAddress() const;
     QUrl serverUrl();
 
-    void route(const char *path, const Handler &handler);
+    void route(const char *path, const Handler &handler, const Methods &methods = Methods());
+    void routeStatic(const char *path, const StaticResponse &response);
     void unroute(const char *path);
 
     inline void setDefaultHandler(const Handler &h) { defaultHandler = h; }
+
+    static void sendStatic(qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res,
+                           const StaticResponse &response);
+
 private:
-    QList<QPair<QString,Handler>> pathHandlers;
+    struct Route {
+        Handler handler;
+        Methods methods;
+    };
+
+    void dispatch(qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res);
+    void updatePrefixLengths();
+
+    QHash<QString, QList<Route>> routes; // path prefix => routes in registration order
+    QList<int> prefixLengths; // distinct lengths of registered prefixes, longest first
     Handler defaultHandler;
 };
 
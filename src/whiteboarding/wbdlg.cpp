@@ -66,7 +66,7 @@ WbDlg::WbDlg(SxeSession* session, PsiAccount* pa) {
     vb1->addLayout(hb1);
 
     // mid area
-    wbWidget_ = new WbWidget(session, this);
+    wbWidget_ = new WbWidget(session, pa, this);
     wbWidget_->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding));
     vb1->addWidget(wbWidget_);
 
@@ -23,6 +23,7 @@
 #include "wbwidget.h"
 
 #include <QDebug>
+#include <QPainter>
 #include <QRegExp>
 #include <QSvgRenderer>
 #include <math.h>
@@ -80,11 +81,14 @@ WbItem::WbItem(SxeSession* session, QSvgRenderer* renderer, QDomElement node, Wb
     // Enable drag-n-drop
     setAcceptDrops(true);
 
-    // Don't cache the SVG
-    setCachingEnabled(false);
+    // Cache the rendered SVG. The renderer is reloaded with the whole document on
+    // every change, so WbWidget updates the items whose elements actually changed
+    // instead of having the renderer repaint every item.
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
 
     // Set the renderer for the item
     setSharedRenderer(renderer);
+    QObject::disconnect(renderer, SIGNAL(repaintNeeded()), this, nullptr);
 
     // add the new item to the scene
     addToScene();
@@ -279,19 +283,32 @@ void WbItem::removeFromScene() {
     setElementId(QString());
 }
 
-void WbItem::resetPos() {
+void WbItem::resetPos(int zValue) {
     // set the x & y approriately;
     setPos(renderer()->boundsOnElement(id()).topLeft());
 
     // set the drawing order
-    // TODO: optimize
-    int i = 0;
-    QDomNodeList children = node_.parentNode().childNodes();
-    while(children.at(i) != node_) {
-        i++;
+    if(zValue < 0) {
+        int i = 0;
+        QDomNodeList children = node_.parentNode().childNodes();
+        while(children.at(i) != node_) {
+            i++;
+        }
+        zValue = i;
+    }
+
+    setZValue(zValue);
+}
+
+void WbItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    // when zoomed far out, the details of the SVG wouldn't be visible anyway
+    const QRectF deviceRect = painter->worldTransform().mapRect(boundingRect());
+    if(deviceRect.width() < 3 && deviceRect.height() < 3) {
+        painter->fillRect(boundingRect(), QColor(128, 128, 128, 128));
+        return;
     }
 
-    setZValue(i);
+    QGraphicsSvgItem::paint(painter, option, widget);
 }
 
 WbItemMenu* WbItem::constructContextMenu() {
@@ -84,8 +84,13 @@ public:
     /*! \brief Removes the item from the scene. */
     void removeFromScene();
 
-    /*! \brief Resets the position of the item according to the SVG and clears any QGraphicsItem transformations.*/
-    void resetPos();
+    /*! \brief Resets the position of the item according to the SVG and clears any QGraphicsItem transformations.
+     *  \a zValue is the index of the node among its siblings, if already known.
+     */
+    void resetPos(int zValue = -1);
+
+    /*! \brief Paints the item, or only a placeholder if it would be a few pixels in size.*/
+    virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr);
 
     /*! \brief Returns a QTransform based on \a string provided in the SVG 'transform' attribute format.*/
     static QMatrix parseSvgTransform(QString string);
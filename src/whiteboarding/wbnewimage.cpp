@@ -22,12 +22,53 @@
 
 #include "../sxe/sxesession.h"
 
-#include <QFile>
+#include <QBuffer>
 #include <QGraphicsScene>
 
-WbNewImage::WbNewImage(QGraphicsScene* s, QPointF startPos, const QString &filename) : WbNewItem(s),
-                       graphicsitem_(QPixmap(filename)) {
-    filename_ = filename;
+static const int maxSide      = 1600;       // px, larger images are scaled down
+static const int maxFullBytes = 180 * 1024; // fits into a stanza once base64 encoded
+static const int inlineBytes  = 16 * 1024;  // smaller images go right into the document
+static const int previewSide  = 128;
+
+static QByteArray encodeImage(const QImage &image, bool alpha, int quality)
+{
+    QByteArray data;
+    QBuffer    buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, alpha ? "PNG" : "JPEG", quality);
+    return data;
+}
+
+WbNewImage::Data WbNewImage::prepare(const QString &filename) {
+    Data d;
+    QImage image(filename);
+    if(image.isNull())
+        return d;
+    if(image.width() > maxSide || image.height() > maxSide)
+        image = image.scaled(maxSide, maxSide, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    d.image = image;
+
+    // less resolution at the same size until it fits
+    const bool alpha = image.hasAlphaChannel();
+    d.fullType = alpha ? "image/png" : "image/jpeg";
+    d.full = encodeImage(image, alpha, 85);
+    while(d.full.size() > maxFullBytes && qMin(image.width(), image.height()) > previewSide) {
+        image = image.scaled(image.size() * 3 / 4, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        d.full = encodeImage(image, alpha, 85);
+    }
+
+    if(d.full.size() > inlineBytes) {
+        d.preview = encodeImage(d.image.scaled(previewSide, previewSide, Qt::KeepAspectRatio, Qt::SmoothTransformation), alpha, 60);
+        d.previewType = d.fullType;
+    }
+    return d;
+}
+
+WbNewImage::WbNewImage(QGraphicsScene* s, QPointF startPos, const Data &data, const QString &cid, const QString &owner) : WbNewItem(s),
+                       graphicsitem_(QPixmap::fromImage(data.image)) {
+    data_ = data;
+    cid_ = cid;
+    owner_ = owner;
     graphicsitem_.setZValue(std::numeric_limits<double>::max());
     graphicsitem_.setPos(startPos);
 
@@ -35,31 +76,36 @@ WbNewImage::WbNewImage(QGraphicsScene* s, QPointF startPos, const QString &filen
 }
 
 QDomNode WbNewImage::serializeToSvg(QDomDocument *doc) {
-    // TODO: Should we perhaps scale large images?
-
-    if(graphicsitem_.pixmap().isNull()) {
+    if(data_.full.isEmpty()) {
         return QDomNode();
     }
 
-    QFile file(filename_);
-    if (file.open(QIODevice::ReadOnly)) {
-        QDomElement image = doc->createElement("image");
-        image.setAttribute("id", "e" + SxeSession::generateUUID());
-        image.setAttribute("x", graphicsitem_.x());
-        image.setAttribute("y", graphicsitem_.y());
-        image.setAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
-        image.setAttribute("xlink:href", QString("data:image/%1;base64,%2")
-                                            .arg(filename_.mid(filename_.lastIndexOf(".") + 1).toLower())
-                                            .arg(file.readAll().toBase64().constData()));
-
-        // QDomElement g = QDomDocument().createElement("g");
-        // g.setAttribute("id", "e" + SxeSession::generateUUID());
-        // g.appendChild(image);
-
-        return image;
+    QDomElement image = doc->createElement("image");
+    image.setAttribute("id", "e" + SxeSession::generateUUID());
+    image.setAttribute("x", graphicsitem_.x());
+    image.setAttribute("y", graphicsitem_.y());
+    image.setAttribute("width", data_.image.width());
+    image.setAttribute("height", data_.image.height());
+    image.setAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+    if(data_.preview.isEmpty() || cid_.isEmpty()) {
+        image.setAttribute("xlink:href", dataUri(data_.fullType, data_.full));
+    } else {
+        // every peer gets the preview with the document, the full image only from us
+        image.setAttribute("xlink:href", dataUri(data_.previewType, data_.preview));
+        image.setAttribute("xmlns:psi", "http://psi-im.org/whiteboard");
+        image.setAttribute("psi:src", "cid:" + cid_);
+        image.setAttribute("psi:owner", owner_);
     }
 
-    return QDomNode();
+    // QDomElement g = QDomDocument().createElement("g");
+    // g.setAttribute("id", "e" + SxeSession::generateUUID());
+    // g.appendChild(image);
+
+    return image;
+}
+
+QString WbNewImage::dataUri(const QString &type, const QByteArray &data) {
+    return QString("data:%1;base64,%2").arg(type, QString::fromLatin1(data.toBase64()));
 }
 
 void WbNewImage::parseCursorMove(QPointF newPos) {
@@ -23,18 +23,44 @@
 
 #include "wbnewitem.h"
 
+#include <QImage>
+
+/*! \brief An image being added to the whiteboard.
+ *  A large image isn't inlined into the document: it gets a small preview
+ *  there, scaled up to its size, and the full image is offered as Bits of
+ *  Binary (XEP-0231) the peers fetch in the background.
+ */
 class WbNewImage : public WbNewItem {
 public:
-    WbNewImage(QGraphicsScene* s, QPointF startPos, const QString &filename);
+    /*! \brief The image file decoded and scaled down for sending.*/
+    struct Data {
+        QImage     image; // scaled to its size on the whiteboard
+        QByteArray preview;
+        QString    previewType;
+        QByteArray full;
+        QString    fullType;
+    };
+
+    /*! \brief Reads the file and encodes the image, slow enough for a worker thread.*/
+    static Data prepare(const QString &filename);
+
+    /*! \brief Constructor
+     *  \a cid is where the peers find the full image, its data is inlined if empty.
+     */
+    WbNewImage(QGraphicsScene* s, QPointF startPos, const Data &data, const QString &cid, const QString &owner);
     void parseCursorMove(QPointF newPos);
     QDomNode serializeToSvg(QDomDocument *doc);
 
+    static QString dataUri(const QString &type, const QByteArray &data);
+
 protected:
     QGraphicsItem* graphicsItem();
 
 private:
     QGraphicsPixmapItem graphicsitem_;
-    QString filename_;
+    Data data_;
+    QString cid_;
+    QString owner_;
 };
 
 #endif // WBNEWIMAGE_H
@@ -20,13 +20,20 @@
 
 #include "wbwidget.h"
 
+#include "psiaccount.h"
 #include "wbnewimage.h"
 #include "wbnewpath.h"
+#include "xmpp_client.h"
 
 #include <QApplication>
+#include <QFutureWatcher>
 #include <QMouseEvent>
+#include <QtConcurrentRun>
 
-WbWidget::WbWidget(SxeSession* session, QWidget *parent) : QGraphicsView(parent) {
+static const int imageMaxAge = 7 * 24 * 3600; // secs the peers may keep a full image
+
+WbWidget::WbWidget(SxeSession* session, PsiAccount* account, QWidget *parent) : QGraphicsView(parent) {
+    account_ = account;
     newWbItem_ = nullptr;
     adding_ = nullptr;
     addVertex_ = false;
@@ -34,6 +41,7 @@ WbWidget::WbWidget(SxeSession* session, QWidget *parent) : QGraphicsView(parent)
     fillColor_ = Qt::transparent;
     strokeWidth_ = 1;
     session_ = session;
+    allDirty_ = true;
 
 //    setCacheMode(CacheBackground);
     setRenderHint(QPainter::Antialiasing);
@@ -47,7 +55,8 @@ WbWidget::WbWidget(SxeSession* session, QWidget *parent) : QGraphicsView(parent)
 
     // create the scene
     scene_ = new WbScene(session_, this);
-    scene_->setItemIndexMethod(QGraphicsScene::NoIndex);
+    // items only move when dragged, so an index makes painting large drawings cheap
+    scene_->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
     setRenderHint(QPainter::Antialiasing);
     setTransformationAnchor(AnchorUnderMouse);
     setResizeAnchor(AnchorViewCenter);
@@ -79,6 +88,11 @@ WbWidget::WbWidget(SxeSession* session, QWidget *parent) : QGraphicsView(parent)
     connect(session_, SIGNAL(nodeAdded(QDomNode, bool)), SLOT(checkForViewBoxChange(QDomNode)));
     connect(session_, SIGNAL(nodeMoved(QDomNode, bool)), SLOT(checkForViewBoxChange(QDomNode)));
     connect(session_, SIGNAL(chdataChanged(QDomNode, bool)), SLOT(checkForViewBoxChange(QDomNode)));
+    // repaint only the items that change
+    connect(session_, SIGNAL(nodeAdded(QDomNode, bool)), SLOT(markDirty(QDomNode)));
+    connect(session_, SIGNAL(nodeMoved(QDomNode, bool)), SLOT(markDirty(QDomNode)));
+    connect(session_, SIGNAL(chdataChanged(QDomNode, bool)), SLOT(markDirty(QDomNode)));
+    connect(session_, SIGNAL(nodeToBeRemoved(QDomNode, bool)), SLOT(markDirty(QDomNode)));
 
     // set the default mode to select
     setMode(Mode::Select);
@@ -255,14 +269,8 @@ void WbWidget::mousePressEvent(QMouseEvent * event) {
 
     } else if(mode_ == Mode::DrawImage) {
         QString filename = QFileDialog::getOpenFileName(this, "Choose an image", QString(), "Images (*.png *.jpg)");
-        if(!filename.isEmpty()) {
-            newWbItem_ = new WbNewImage(scene_, startPoint, filename);
-            QDomDocument tempDoc;
-            session_->insertNodeAfter(newWbItem_->serializeToSvg(&tempDoc), session_->document().documentElement());
-            session_->flush();
-            delete newWbItem_;
-            newWbItem_ = nullptr;
-        }
+        if(!filename.isEmpty())
+            insertImage(filename, startPoint);
     }
 
     QGraphicsView::mousePressEvent(event);
@@ -414,22 +422,115 @@ void WbWidget::checkForRemovalOfId(QDomNode node) {
     }
 }
 
+void WbWidget::insertImage(const QString &filename, const QPointF &pos) {
+    // decoding and scaling a photo takes a while
+    QFutureWatcher<WbNewImage::Data>* watcher = new QFutureWatcher<WbNewImage::Data>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, pos]() {
+        watcher->deleteLater();
+        const WbNewImage::Data data = watcher->result();
+        if(data.full.isEmpty())
+            return;
+
+        QString cid;
+        if(!data.preview.isEmpty() && account_ && account_->isAvailable()) {
+            cid = account_->client()->bobManager()->append(data.full, data.fullType, imageMaxAge).cid();
+            fullImages_.insert("cid:" + cid, WbNewImage::dataUri(data.fullType, data.full));
+        }
+        WbNewImage image(scene_, pos, data, cid, session_->ownJid().full());
+        QDomDocument tempDoc;
+        session_->insertNodeAfter(image.serializeToSvg(&tempDoc), session_->document().documentElement());
+        session_->flush();
+    });
+    watcher->setFuture(QtConcurrent::run(WbNewImage::prepare, filename));
+}
+
+void WbWidget::fetchImage(const QString &src, const QString &owner) {
+    if(!account_ || owner.isEmpty() || !src.startsWith("cid:") || requestedImages_.contains(src))
+        return;
+    requestedImages_ += src;
+
+    account_->loadBob(XMPP::Jid(owner), src.mid(4), this, [this, src](bool success, const QByteArray &data, const QByteArray &type) {
+        // a failed one stays at its preview
+        if(!success)
+            return;
+        fullImages_.insert(src, WbNewImage::dataUri(QString::fromLatin1(type), data));
+
+        const QDomNodeList images = session_->document().elementsByTagName("image");
+        for(int i = 0; i < int(images.length()); i++) {
+            if(images.at(i).toElement().attribute("psi:src") == src)
+                markDirty(images.at(i));
+        }
+        rerender();
+    });
+}
+
 void WbWidget::rerender() {
     QString xmldump;
     QTextStream stream(&xmldump);
     session_->document().save(stream, 1);
 
+    // images sent by reference show their preview until the full one is here
+    const QDomNodeList images = session_->document().elementsByTagName("image");
+    for(int i = 0; i < int(images.length()); i++) {
+        const QDomElement image = images.at(i).toElement();
+        const QString src = image.attribute("psi:src");
+        if(src.isEmpty())
+            continue;
+        const QString full = fullImages_.value(src);
+        if(!full.isEmpty())
+            xmldump.replace(image.attribute("xlink:href"), full);
+        else
+            fetchImage(src, image.attribute("psi:owner"));
+    }
+
     // qDebug("Document in WbWidget:");
     // qDebug() << xmldump.toLatin1();
 
     renderer_.load(xmldump.toLatin1());
 
+    // the drawing order is the position among the children of <svg/>
+    QHash<QString, int> zValues;
+    const QDomNodeList children = session_->document().documentElement().childNodes();
+    for(int i = 0; i < int(children.length()); i++) {
+        const QString id = children.at(i).toElement().attribute("id");
+        if(!id.isEmpty() && !zValues.contains(id))
+            zValues.insert(id, i);
+    }
+
     // Update all positions if changed
     foreach(WbItem* wbitem, items_) {
         // resetting elementId is necessary for rendering some updates to the element (e.g. adding child elements to <g/>)
-        wbitem->setElementId(wbitem->id());
+        // it also repaints the cached item
+        if(allDirty_ || dirtyIds_.contains(wbitem->id()))
+            wbitem->setElementId(wbitem->id());
 
         // qDebug() << QString("Rerendering %1").arg((unsigned int) wbitem).toLatin1();
-        wbitem->resetPos();
+        wbitem->resetPos(zValues.value(wbitem->id(), -1));
     }
+
+    dirtyIds_.clear();
+    allDirty_ = false;
+}
+
+void WbWidget::markDirty(const QDomNode &node) {
+    QDomNode n = node;
+    if(n.isAttr()) {
+        // the item is looked up by its 'id'
+        if(n.nodeName() == "id") {
+            allDirty_ = true;
+            return;
+        }
+        n = n.toAttr().ownerElement();
+    }
+
+    // find the child of <svg/> that contains the node
+    const QDomElement root = session_->document().documentElement();
+    while(!n.isNull() && n.parentNode() != root)
+        n = n.parentNode();
+
+    const QString id = n.toElement().attribute("id");
+    if(id.isEmpty() || n.nodeName() == "defs")
+        allDirty_ = true;
+    else
+        dirtyIds_ += id;
 }
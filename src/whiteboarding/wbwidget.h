@@ -28,11 +28,15 @@
 
 #include <QFileDialog>
 #include <QGraphicsView>
+#include <QHash>
+#include <QSet>
 #include <QSvgRenderer>
 #include <QTime>
 #include <QTimer>
 #include <QWidget>
 
+class PsiAccount;
+
 /*! \brief The whiteboard widget.
  *  Visualizes the whiteboard scene and provides different modes for editing and adding new elements.
  *  Local edits to existing elements are handled by the elements themselves
@@ -54,8 +58,9 @@ public:
 
     /*! \brief Constructor
      *  Constructs a new widget with \a session and parent \a parent.
+     *  Images are exchanged through \a account.
      */
-    WbWidget(SxeSession* session, QWidget* parent = nullptr);
+    WbWidget(SxeSession* session, PsiAccount* account, QWidget* parent = nullptr);
     /*! \brief Returns the session this widget is visualizing.*/
     SxeSession* session();
     /*! \brief Returns the mode this widget is in.*/
@@ -91,9 +96,15 @@ protected:
 private:
     /*! \brief Returns the item representing the node (if any).*/
     WbItem* wbItem(const QDomNode &node);
+    /*! \brief Adds the image in \a filename at \a pos once it's prepared for sending.*/
+    void insertImage(const QString &filename, const QPointF &pos);
+    /*! \brief Fetches the full image \a src from \a owner in the background, once.*/
+    void fetchImage(const QString &src, const QString &owner);
 
     /*! \brief The SxeSession synchronizing the document.*/
     SxeSession* session_;
+    /*! \brief The account images are exchanged through.*/
+    PsiAccount* account_;
     /*! \brief The WbScene used for visualizing the document.*/
     WbScene* scene_;
     /*! \brief The user interaction mode the widget is in.*/
@@ -121,6 +132,14 @@ private:
     QTimer* adding_;
     /*! \brief The primary renderer used for rendering the document.*/
     QSvgRenderer renderer_;
+    /*! \brief The 'id's of the items whose elements changed since the last rerender().*/
+    QSet<QString> dirtyIds_;
+    /*! \brief True if a change can't be attributed to a single item (e.g. to <defs/>).*/
+    bool allDirty_;
+    /*! \brief The full images fetched so far as data URIs, by their 'cid:' URI.*/
+    QHash<QString, QString> fullImages_;
+    /*! \brief The 'cid:' URIs of the full images fetched or being fetched.*/
+    QSet<QString> requestedImages_;
 
 private slots:
     /*! \brief Tries to add 'id' attributes to nodes in deletionQueue_ if they still don't have them.*/
@@ -153,6 +172,8 @@ private slots:
 
     /*! \brief Rerenders the contents of the document.*/
     void rerender();
+    /*! \brief Marks the item containing \a node to be repainted at the next rerender().*/
+    void markDirty(const QDomNode &node);
 };
 
 #endif // WBWIDGET_H
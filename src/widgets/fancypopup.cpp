@@ -96,9 +96,14 @@ public:
 
 public slots:
     void popupDestroyed(QObject *);
+    void popupReleased();
 
 public:
     void initContents(QString title, const PsiIcon *icon, bool copyIcon);
+    void setTitle(QString title, const PsiIcon *icon, bool copyIcon);
+    void applyColors();
+    void linkTo(FancyPopup *prev);
+    void unlink();
 
     // parameters
     static int hideTimeout;
@@ -114,6 +119,7 @@ public:
     //QBoxLayout *layout;
     FancyPopup *popup;
     QTimer *hideTimer;
+    bool recyclable;
     Ui::Frame ui_;
 };
 
@@ -122,7 +128,8 @@ QColor FancyPopup::Private::backgroundColor = QColor (0x52, 0x97, 0xF9);
 
 FancyPopup::Private::Private(FancyPopup *p) :
     QObject(p),
-    popupLayout(TopToBottom)
+    popupLayout(TopToBottom),
+    recyclable(false)
 {
     popup = p;
 
@@ -142,6 +149,45 @@ void FancyPopup::Private::popupDestroyed(QObject *obj)
     }
 }
 
+void FancyPopup::Private::popupReleased()
+{
+    popupDestroyed(sender());
+}
+
+void FancyPopup::Private::linkTo(FancyPopup *prev)
+{
+    if ( !prev )
+        return;
+
+    QList<FancyPopup *> prevPopups = prev->d->prevPopups;
+    prevPopups.append(prev);
+
+    foreach (FancyPopup *popup, prevPopups) {
+        this->prevPopups.append( popup );
+        connect(popup, SIGNAL(destroyed(QObject *)), SLOT(popupDestroyed(QObject *)));
+        connect(popup, SIGNAL(released()), SLOT(popupReleased()));
+    }
+}
+
+void FancyPopup::Private::unlink()
+{
+    foreach (FancyPopup *popup, prevPopups)
+        popup->disconnect(this);
+    prevPopups.clear();
+}
+
+// removes everything added by addLayout(), keeping the spacer from the .ui file
+static void clearLayout(QLayout *layout, int from)
+{
+    while ( layout->count() > from ) {
+        QLayoutItem *item = layout->takeAt(from);
+        if ( item->layout() )
+            clearLayout(item->layout(), 0);
+        delete item->widget();
+        delete item;
+    }
+}
+
 QPoint FancyPopup::Private::position()
 {
     QRect geom = qApp->desktop()->availableGeometry(popup);
@@ -176,14 +222,31 @@ QPoint FancyPopup::Private::position()
 }
 
 void FancyPopup::Private::initContents(QString title, const PsiIcon *icon, bool copyIcon)
+{
+    ui_.setupUi(popup);
+    applyColors();
+    setTitle(title, icon, copyIcon);
+
+    ui_.closeButton->setObjectName("closeButton");
+    ui_.closeButton->setToolTip(tr("Close"));
+    ui_.closeButton->setFocusPolicy( Qt::NoFocus );
+    ui_.closeButton->setIcon( popup->style()->standardPixmap(QStyle::SP_TitleBarCloseButton) );
+    ui_.closeButton->setFixedSize(BUTTON_WIDTH, BUTTON_HEIGHT);
+    connect(ui_.closeButton, SIGNAL(clicked()), popup, SLOT(hide()));
+}
+
+void FancyPopup::Private::setTitle(QString title, const PsiIcon *icon, bool copyIcon)
+{
+    ui_.lb_title->setText( title );
+    ui_.lb_icon->setPsiIcon(icon, copyIcon);
+}
+
+void FancyPopup::Private::applyColors()
 {
     // TODO: use darker color on popup borders
     QPalette backgroundPalette;
     backgroundPalette.setBrush(QPalette::Background, QBrush(backgroundColor));
-    QPixmap back(1, 1);
-    back.fill(backgroundColor);
 
-    ui_.setupUi(popup);
     ui_.lb_bottom1->setPalette(backgroundPalette);
     ui_.lb_icon->setPalette(backgroundPalette);
     ui_.lb_mid1->setPalette(backgroundPalette);
@@ -202,16 +265,6 @@ void FancyPopup::Private::initContents(QString title, const PsiIcon *icon, bool
     QFont titleFont = ui_.lb_title->font();
     titleFont.setBold(true);
     ui_.lb_title->setFont(titleFont);
-    ui_.lb_title->setText( title );
-
-    ui_.lb_icon->setPsiIcon(icon, copyIcon);
-
-    ui_.closeButton->setObjectName("closeButton");
-    ui_.closeButton->setToolTip(tr("Close"));
-    ui_.closeButton->setFocusPolicy( Qt::NoFocus );
-    ui_.closeButton->setIcon( popup->style()->standardPixmap(QStyle::SP_TitleBarCloseButton) );
-    ui_.closeButton->setFixedSize(BUTTON_WIDTH, BUTTON_HEIGHT);
-    connect(ui_.closeButton, SIGNAL(clicked()), popup, SLOT(hide()));
 
     const QString css = PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.css").toString();
     if (!css.isEmpty()) {
@@ -239,17 +292,7 @@ FancyPopup::FancyPopup(QString title, const PsiIcon *icon, FancyPopup *prev, boo
     QWidget::setAttribute(Qt::WA_DeleteOnClose);
     setWindowModality(Qt::NonModal);
     d = new Private(this);
-
-    if ( prev ) {
-        QList<FancyPopup *> prevPopups = prev->d->prevPopups;
-        prevPopups.append(prev);
-
-        foreach (FancyPopup *popup, prevPopups) {
-            d->prevPopups.append( popup );
-            connect(popup, SIGNAL(destroyed(QObject *)), d, SLOT(popupDestroyed(QObject *)));
-        }
-    }
-
+    d->linkTo(prev);
     d->initContents(title, icon, copyIcon);
 }
 
@@ -263,6 +306,26 @@ void FancyPopup::addLayout(QLayout *layout, int stretch)
     d->ui_.layout->addSpacing(5);
 }
 
+/**
+ * Prepares a hidden popup to be shown again with new contents, which is
+ * cheaper than creating a new top-level window.
+ */
+void FancyPopup::reset(QString title, const PsiIcon *icon, FancyPopup *prev, bool copyIcon)
+{
+    d->hideTimer->stop();
+    d->unlink();
+    d->linkTo(prev);
+    clearLayout(d->ui_.layout, 1);
+    d->applyColors();
+    d->setTitle(title, icon, copyIcon);
+}
+
+void FancyPopup::setRecyclable(bool recyclable)
+{
+    d->recyclable = recyclable;
+    setAttribute(Qt::WA_DeleteOnClose, !recyclable);
+}
+
 void FancyPopup::show()
 {
     if ( size() != sizeHint() )
@@ -284,7 +347,10 @@ void FancyPopup::show()
 void FancyPopup::hideEvent(QHideEvent *e)
 {
     d->hideTimer->stop();
-    deleteLater();
+    if ( d->recyclable )
+        emit released();
+    else
+        deleteLater();
 
     QFrame::hideEvent(e);
 }
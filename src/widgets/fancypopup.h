@@ -33,6 +33,10 @@ public:
     ~FancyPopup();
 
     void addLayout(QLayout *layout, int stretch = 0);
+    void reset(QString title, const PsiIcon *icon = nullptr, FancyPopup *prev = nullptr, bool copyIcon = true);
+
+    // recyclable popups are kept when hidden and emit released() instead of deleting themselves
+    void setRecyclable(bool);
 
     static void setHideTimeout(int);
     static void setBorderColor(QColor);
@@ -42,6 +46,7 @@ public:
 
 signals:
     void clicked(int);
+    void released();
 
 protected:
     void hideEvent(QHideEvent *);
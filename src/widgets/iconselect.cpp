@@ -20,163 +20,293 @@
 #include "iconselect.h"
 
 #include "iconset.h"
-#include "psitooltip.h"
 
-#include <QAbstractButton>
+#include <QAbstractScrollArea>
 #include <QApplication>
 #include <QDesktopWidget>
 #include <QEvent>
+#include <QHash>
+#include <QKeyEvent>
 #include <QLabel>
 #include <QLayout>
+#include <QLineEdit>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QScrollBar>
 #include <QStyle>
 #include <QStyleOption>
-#include <QTextCodec>
+#include <QToolTip>
+#include <QVector>
 #include <QWidgetAction>
 #include <math.h>
 
+static const int maxRecent = 32;
+
 //----------------------------------------------------------------------------
-// IconSelectButton
+// IconSelectGrid
 //----------------------------------------------------------------------------
 
 //! \if _hide_doc_
 /**
-    \class IconSelectButton
-    \brief This button is used by IconSelect and displays one PsiIcon
+    \class IconSelectGrid
+    \brief Paints the icons of IconSelect as a grid, only the visible rows
+
+    There are no widgets per icon. The icon under the mouse is the only one
+    animated, through a copy of it that lives as long as the hover does.
 */
-class IconSelectButton : public QAbstractButton
+class IconSelectGrid : public QAbstractScrollArea
 {
     Q_OBJECT
 
-private:
-    PsiIcon *ic;
-    QSize s;
-    bool animated;
-
 public:
-    IconSelectButton(QWidget *parent)
-    : QAbstractButton(parent)
+    IconSelectGrid(QWidget *parent)
+        : QAbstractScrollArea(parent)
     {
-        ic = nullptr;
-        animated = false;
-        connect (this, SIGNAL(clicked()), SLOT(iconSelected()));
+        setFrameStyle(QFrame::NoFrame);
+        setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+        setFocusPolicy(Qt::StrongFocus);
+        viewport()->setMouseTracking(true);
+        viewport()->setAttribute(Qt::WA_Hover);
     }
 
-    ~IconSelectButton()
+    ~IconSelectGrid()
     {
-        iconStop();
-
-        if ( ic ) {
-            delete ic;
-            ic = nullptr;
-        }
+        stopAnimation();
     }
 
-    void setIcon(const PsiIcon *i)
+    // the recent ones make the first row, the rest follows on a new one
+    void setIcons(const QList<const PsiIcon *> &recent, const QList<const PsiIcon *> &icons)
     {
-        iconStop();
-
-        if ( ic ) {
-            delete ic;
-            ic = nullptr;
+        stopAnimation();
+        cells_.clear();
+        if (!recent.isEmpty()) {
+            cells_ = recent.mid(0, columns_);
+            while (cells_.size() % columns_)
+                cells_ += nullptr;
         }
+        cells_ += icons;
+        current_ = -1;
+        updateScrollBar();
+        verticalScrollBar()->setValue(0);
+        viewport()->update();
+    }
 
-        if ( i )
-            ic = new PsiIcon(*(const_cast<PsiIcon *>(i)));
-        else
-            ic = nullptr;
+    void setTiles(QSize tile, int columns, int visibleRows)
+    {
+        tile_        = tile;
+        columns_     = qMax(columns, 1);
+        visibleRows_ = qMax(visibleRows, 1);
+        verticalScrollBar()->setSingleStep(tile_.height());
+        updateGeometry();
     }
 
-    const PsiIcon *icon() const
+    int columns() const { return columns_; }
+
+    QSize sizeHint() const
     {
-        return ic;
+        return QSize(columns_ * tile_.width() + verticalScrollBar()->sizeHint().width(),
+                     visibleRows_ * tile_.height());
     }
 
-    QSize sizeHint() const { return s; }
-    void setSizeHint(QSize sh) { s = sh; }
+    QSize minimumSizeHint() const { return sizeHint(); }
 
 signals:
-    void iconSelected(const PsiIcon *);
-    void textSelected(QString);
+    void activated(const PsiIcon *);
 
-private:
-    void iconStart()
+protected:
+    void paintEvent(QPaintEvent *e)
     {
-        if ( ic ) {
-            connect(ic, SIGNAL(pixmapChanged()), SLOT(iconUpdated()));
-            if ( !animated ) {
-                ic->activated(false);
-                animated = true;
-            }
+        QPainter p(viewport());
+
+        QStyleOptionMenuItem empty;
+        empty.palette = palette();
+        empty.rect    = viewport()->rect();
+        style()->drawControl(QStyle::CE_MenuEmptyArea, &empty, &p, this);
+
+        const int offset = verticalScrollBar()->value();
+        const int first  = (e->rect().top() + offset) / tile_.height() * columns_;
+        const int last   = qMin(cells_.size() - 1, (e->rect().bottom() + offset) / tile_.height() * columns_ + columns_ - 1);
+        for (int i = first; i <= last; ++i) {
+            const PsiIcon *icon = cells_.at(i);
+            if (!icon)
+                continue;
+
+            const QRect r = cellRect(i);
+            QStyleOptionMenuItem opt;
+            opt.palette = palette();
+            opt.state   = QStyle::State_Active | QStyle::State_Enabled;
+            if (i == current_)
+                opt.state |= QStyle::State_Selected;
+            opt.font = font();
+            opt.rect = r;
+            style()->drawControl(QStyle::CE_MenuItem, &opt, &p, this);
+
+            const QPixmap &pix = (i == current_ && animated_) ? animated_->pixmap() : icon->pixmap();
+            p.drawPixmap(r.x() + (r.width() - pix.width()) / 2, r.y() + (r.height() - pix.height()) / 2, pix);
+        }
+    }
+
+    void mouseMoveEvent(QMouseEvent *e)
+    {
+        setCurrent(cellAt(e->pos()));
+    }
 
-            if ( !ic->text().isEmpty() ) {
-                // and list of possible variants in the ToolTip
-                QStringList toolTip;
-                foreach(PsiIcon::IconText t, ic->text()) {
-                    toolTip += t.text;
-                }
+    void mouseReleaseEvent(QMouseEvent *e)
+    {
+        const int i = cellAt(e->pos());
+        if (i != -1 && e->button() == Qt::LeftButton)
+            emit activated(cells_.at(i));
+    }
 
-                QString toolTipText = toolTip.join(", ");
-                if ( toolTipText.length() > 30 )
-                    toolTipText = toolTipText.left(30) + "...";
+    void leaveEvent(QEvent *)
+    {
+        setCurrent(-1);
+    }
 
-                setToolTip(toolTipText);
-            }
+    void resizeEvent(QResizeEvent *)
+    {
+        updateScrollBar();
+    }
+
+    void keyPressEvent(QKeyEvent *e)
+    {
+        int i = current_;
+        switch (e->key()) {
+        case Qt::Key_Left:
+            i = i <= 0 ? 0 : i - 1;
+            break;
+        case Qt::Key_Right:
+            i = i + 1;
+            break;
+        case Qt::Key_Up:
+            i = i - columns_;
+            break;
+        case Qt::Key_Down:
+            i = i < 0 ? 0 : i + columns_;
+            break;
+        case Qt::Key_PageUp:
+            i = i - columns_ * visibleRows_;
+            break;
+        case Qt::Key_PageDown:
+            i = i < 0 ? 0 : i + columns_ * visibleRows_;
+            break;
+        case Qt::Key_Home:
+            i = 0;
+            break;
+        case Qt::Key_End:
+            i = cells_.size() - 1;
+            break;
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+            if (current_ == -1 && !cells_.isEmpty())
+                current_ = 0;
+            if (current_ != -1)
+                emit activated(cells_.at(current_));
+            return;
+        default:
+            QAbstractScrollArea::keyPressEvent(e);
+            return;
         }
+        i = qBound(0, i, cells_.size() - 1);
+        // the padding of the recent row
+        while (i > 0 && !cells_.at(i))
+            --i;
+        setCurrent(i);
+        ensureVisible(i);
     }
 
-    void iconStop()
+    bool viewportEvent(QEvent *e)
     {
-        if ( ic ) {
-            disconnect(ic, nullptr, this, nullptr );
-            if ( animated ) {
-                ic->stop();
-                animated = false;
+        if (e->type() == QEvent::ToolTip) {
+            QHelpEvent *he = static_cast<QHelpEvent *>(e);
+            const int   i  = cellAt(he->pos());
+            if (i == -1) {
+                QToolTip::hideText();
+                return true;
             }
+            // the list of possible variants
+            QStringList texts;
+            for (const PsiIcon::IconText &t : cells_.at(i)->text())
+                texts += t.text;
+            QString tip = texts.join(", ");
+            if (tip.length() > 30)
+                tip = tip.left(30) + "...";
+            QToolTip::showText(he->globalPos(), tip, viewport(), cellRect(i));
+            return true;
         }
+        return QAbstractScrollArea::viewportEvent(e);
     }
 
-    void enterEvent(QEvent *) { iconStart(); setFocus();  update(); } // focus follows mouse mode
-    void leaveEvent(QEvent *) { iconStop(); clearFocus(); update(); }
-
 private slots:
-    void iconUpdated()
+    void animationUpdated()
     {
-        update();
+        if (current_ != -1)
+            viewport()->update(cellRect(current_));
     }
 
-    void iconSelected()
+private:
+    QRect cellRect(int i) const
     {
-        clearFocus();
-        if ( ic ) {
-            emit iconSelected(ic);
-            emit textSelected(ic->defaultText());
-        }
+        return QRect(QPoint(i % columns_ * tile_.width(), i / columns_ * tile_.height() - verticalScrollBar()->value()),
+                     tile_);
     }
 
-private:
-    // reimplemented
-    void paintEvent(QPaintEvent *)
+    int cellAt(const QPoint &pos) const
     {
-        QPainter p(this);
-        QFlags<QStyle::StateFlag> flags = QStyle::State_Active | QStyle::State_Enabled;
+        if (pos.x() < 0 || pos.x() >= columns_ * tile_.width())
+            return -1;
+        const int row = (pos.y() + verticalScrollBar()->value()) / tile_.height();
+        const int i   = row * columns_ + pos.x() / tile_.width();
+        return (pos.y() >= 0 && i < cells_.size() && cells_.at(i)) ? i : -1;
+    }
 
-        if ( hasFocus() )
-            flags |= QStyle::State_Selected;
+    void ensureVisible(int i)
+    {
+        const QRect r = cellRect(i);
+        if (r.top() < 0)
+            verticalScrollBar()->setValue(verticalScrollBar()->value() + r.top());
+        else if (r.bottom() > viewport()->height())
+            verticalScrollBar()->setValue(verticalScrollBar()->value() + r.bottom() - viewport()->height());
+    }
 
-        QStyleOptionMenuItem opt;
-        opt.palette = palette();
-        opt.state = flags;
-        opt.font = font();
-        opt.rect = rect();
-        style()->drawControl(QStyle::CE_MenuItem, &opt, &p, this);
-
-        if ( ic ) {
-            QPixmap pix = ic->pixmap();
-            p.drawPixmap((width() - pix.width())/2, (height() - pix.height())/2, pix);
+    void setCurrent(int i)
+    {
+        if (i == current_)
+            return;
+        if (current_ != -1)
+            viewport()->update(cellRect(current_));
+        stopAnimation();
+        current_ = i;
+        if (current_ != -1) {
+            animated_ = new PsiIcon(*cells_.at(current_));
+            connect(animated_, SIGNAL(pixmapChanged()), SLOT(animationUpdated()));
+            animated_->activated(false);
+            viewport()->update(cellRect(current_));
         }
     }
+
+    void stopAnimation()
+    {
+        if (animated_) {
+            animated_->stop();
+            delete animated_;
+            animated_ = nullptr;
+        }
+    }
+
+    void updateScrollBar()
+    {
+        const int rows = (cells_.size() + columns_ - 1) / columns_;
+        verticalScrollBar()->setPageStep(viewport()->height());
+        verticalScrollBar()->setRange(0, qMax(0, rows * tile_.height() - viewport()->height()));
+    }
+
+    QList<const PsiIcon *> cells_; // nullptr pads the recent row
+    QSize                  tile_ = QSize(20, 20);
+    int                    columns_     = 1;
+    int                    visibleRows_ = 1;
+    int                    current_     = -1;
+    PsiIcon *              animated_    = nullptr;
 };
 //! \endif
 
@@ -189,10 +319,13 @@ class IconSelect : public QWidget
     Q_OBJECT
 
 private:
-    IconSelectPopup *menu;
-    Iconset is;
-    QGridLayout *grid;
-    bool shown;
+    IconSelectPopup *      menu;
+    Iconset                is;
+    QList<const PsiIcon *> icons;
+    QStringList            recent;
+    QLineEdit *            search;
+    IconSelectGrid *       grid;
+    QLabel *               noIcons;
 
 signals:
     void updatedGeometry();
@@ -201,12 +334,14 @@ public:
     IconSelect(IconSelectPopup *parentMenu);
     ~IconSelect();
 
-    void setIconset(const Iconset &);
+    void           setIconset(const Iconset &);
     const Iconset &iconset() const;
 
+    const QStringList &recentTexts() const { return recent; }
+    void               setRecentTexts(const QStringList &texts);
+
 protected:
-    void noIcons();
-    void createLayout();
+    bool eventFilter(QObject *o, QEvent *e);
 
     void paintEvent(QPaintEvent *)
     {
@@ -214,12 +349,15 @@ protected:
 
         QStyleOptionMenuItem opt;
         opt.palette = palette();
-        opt.rect = rect();
+        opt.rect    = rect();
         style()->drawControl(QStyle::CE_MenuEmptyArea, &opt, &p, this);
     }
 
 protected slots:
     void closeMenu();
+    void aboutToShow();
+    void filter();
+    void iconActivated(const PsiIcon *);
 };
 
 IconSelect::IconSelect(IconSelectPopup *parentMenu)
@@ -227,11 +365,27 @@ IconSelect::IconSelect(IconSelectPopup *parentMenu)
 {
     menu = parentMenu;
     connect(menu, SIGNAL(textSelected(QString)), SLOT(closeMenu()));
+    connect(menu, SIGNAL(aboutToShow()), SLOT(aboutToShow()));
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setMargin(style()->pixelMetric(QStyle::PM_MenuPanelWidth, nullptr, this));
+    layout->setSpacing(2);
+
+    search = new QLineEdit(this);
+    search->setPlaceholderText(tr("Search"));
+    search->setClearButtonEnabled(true);
+    search->installEventFilter(this);
+    connect(search, SIGNAL(textChanged(QString)), SLOT(filter()));
+    layout->addWidget(search);
 
-    grid = nullptr;
-    noIcons();
+    grid = new IconSelectGrid(this);
+    connect(grid, SIGNAL(activated(const PsiIcon *)), SLOT(iconActivated(const PsiIcon *)));
+    layout->addWidget(grid);
 
-    Q_UNUSED(shown)
+    noIcons = new QLabel(tr("No icons available"), this);
+    layout->addWidget(noIcons);
+
+    setIconset(Iconset());
 }
 
 IconSelect::~IconSelect()
@@ -248,102 +402,136 @@ void IconSelect::closeMenu()
     menu->close();
 }
 
-void IconSelect::createLayout()
+void IconSelect::aboutToShow()
 {
-    Q_ASSERT(!grid);
-    grid = new QGridLayout(this);
-    grid->setMargin(style()->pixelMetric(QStyle::PM_MenuPanelWidth, nullptr, this));
-    grid->setSpacing(1);
+    search->clear();
+    search->setFocus();
 }
 
-void IconSelect::noIcons()
+bool IconSelect::eventFilter(QObject *o, QEvent *e)
 {
-    createLayout();
-    QLabel *lbl = new QLabel(this);
-    grid->addWidget(lbl, 0, 0);
-    lbl->setText( tr("No icons available") );
-    emit updatedGeometry();
+    // the search box has the focus, the grid still gets moved around
+    if (o == search && e->type() == QEvent::KeyPress) {
+        switch (static_cast<QKeyEvent *>(e)->key()) {
+        case Qt::Key_Up:
+        case Qt::Key_Down:
+        case Qt::Key_PageUp:
+        case Qt::Key_PageDown:
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+            QApplication::sendEvent(grid, e);
+            return true;
+        default:
+            break;
+        }
+    }
+    return QWidget::eventFilter(o, e);
 }
 
 void IconSelect::setIconset(const Iconset &iconset)
 {
     is = iconset;
-
-    // delete all children
-    if (grid) {
-        delete grid;
-        grid = nullptr;
-
-        QObjectList list = children();
-        qDeleteAll(list);
-    }
-
-    if ( !is.count() ) {
-        noIcons();
+    icons.clear();
+    icons.reserve(is.count());
+    QListIterator<PsiIcon *> it = is.iterator();
+    while (it.hasNext())
+        icons += it.next();
+
+    search->setVisible(!icons.isEmpty());
+    grid->setVisible(!icons.isEmpty());
+    noIcons->setVisible(icons.isEmpty());
+    if (icons.isEmpty()) {
+        emit updatedGeometry();
         return;
     }
 
-    // first we need to find optimal size for elements and don't forget about
-    // taking too much screen space
-    float w = 0, h = 0;
-
-    double count; // the 'double' type is somewhat important for MSVC.NET here
-    QListIterator<PsiIcon *> it = is.iterator();
-    for (count = 0; it.hasNext(); count++) {
-        PsiIcon *icon = it.next();
-        w += icon->pixmap().width();
-        h += icon->pixmap().height();
+    // the tile fits an average icon. a sample of them is enough, every
+    // pixmap asked for here has to be loaded
+    const int sample = qMin(icons.size(), 64);
+    float     w = 0, h = 0;
+    for (int i = 0; i < sample; ++i) {
+        const QPixmap &pix = icons.at(i * icons.size() / sample)->pixmap();
+        w += pix.width();
+        h += pix.height();
     }
-    w /= float(count);
-    h /= float(count);
+    w /= float(sample);
+    h /= float(sample);
 
-    const int margin = 2;
-    int tileSize = int(qMax(w, h)) + 2*margin;
+    const int margin   = 2;
+    const int tileSize = int(qMax(w, h)) + 2 * margin;
 
-    QRect r = QApplication::desktop()->availableGeometry( menu );
-    int maxSize = qMin(r.width(), r.height())*3/4;
-
-    int size = int(ceil( sqrt( count ) ));
-
-    if ( size*tileSize > maxSize ) { // too many icons. find reasonable size.
-        int c = 0;
-        for (w = 0; w <= maxSize; w += tileSize)
-            c++;
-        size = c - 1;
-    }
+    // don't take too much screen space, the rest can be scrolled to
+    QRect r       = QApplication::desktop()->availableGeometry(menu);
+    int   maxSize = qMin(r.width(), r.height()) * 3 / 4;
+    int   maxRows = qMax(1, maxSize / tileSize);
 
-    // now, fill grid with elements
-    createLayout();
-    count = 0;
+    int columns = qMin(int(ceil(sqrt(double(icons.size())))), maxRows);
+    int rows    = (icons.size() + columns - 1) / columns + 1; // and the recent row
+    grid->setTiles(QSize(tileSize, tileSize), columns, qMin(rows, maxRows));
 
-    int row = 0;
-    int column = 0;
-    it = is.iterator();
-    while ( it.hasNext() ) {
-        if ( ++count > size*size )
-            break;
+    filter();
+    emit updatedGeometry();
+}
 
-        IconSelectButton *b = new IconSelectButton(this);
-        grid->addWidget(b, row, column);
-        b->setIcon( it.next() );
-        b->setSizeHint( QSize(tileSize, tileSize) );
-        connect (b, SIGNAL(iconSelected(const PsiIcon *)), menu, SIGNAL(iconSelected(const PsiIcon *)));
-        connect (b, SIGNAL(textSelected(QString)), menu, SIGNAL(textSelected(QString)));
+const Iconset &IconSelect::iconset() const
+{
+    return is;
+}
 
-        //connect (menu, SIGNAL(aboutToShow()), b, SLOT(aboutToShow()));
-        //connect (menu, SIGNAL(aboutToHide()), b, SLOT(aboutToHide()));
+void IconSelect::setRecentTexts(const QStringList &texts)
+{
+    recent = texts.mid(0, maxRecent);
+    filter();
+}
 
-        if (++column >= size) {
-            ++row;
-            column = 0;
+void IconSelect::filter()
+{
+    const QString text = search->text().trimmed();
+    if (text.isEmpty()) {
+        // the icons of the recently used texts, as far as they're still there
+        QHash<QString, int> wanted;
+        for (int i = 0; i < recent.size() && i < grid->columns(); ++i)
+            wanted.insert(recent.at(i), i);
+        QVector<const PsiIcon *> matches(wanted.size(), nullptr);
+        for (const PsiIcon *icon : icons) {
+            for (const PsiIcon::IconText &t : icon->text()) {
+                const int i = wanted.value(t.text, -1);
+                if (i != -1 && !matches.at(i))
+                    matches[i] = icon;
+            }
+        }
+        QList<const PsiIcon *> recentIcons;
+        for (const PsiIcon *icon : matches) {
+            if (icon)
+                recentIcons += icon;
         }
+        grid->setIcons(recentIcons, icons);
+        return;
     }
-    emit updatedGeometry();
+
+    QList<const PsiIcon *> found;
+    for (const PsiIcon *icon : icons) {
+        bool match = icon->name().contains(text, Qt::CaseInsensitive);
+        for (int i = 0; !match && i < icon->text().size(); ++i)
+            match = icon->text().at(i).text.contains(text, Qt::CaseInsensitive);
+        if (match)
+            found += icon;
+    }
+    grid->setIcons(QList<const PsiIcon *>(), found);
 }
 
-const Iconset &IconSelect::iconset() const
+void IconSelect::iconActivated(const PsiIcon *icon)
 {
-    return is;
+    const QString text = icon->defaultText();
+    recent.removeAll(text);
+    recent.prepend(text);
+    while (recent.size() > maxRecent)
+        recent.removeLast();
+
+    // closes the menu, and we start over next time it shows up
+    emit menu->iconSelected(icon);
+    emit menu->textSelected(text);
+    filter();
 }
 
 //----------------------------------------------------------------------------
@@ -398,6 +586,16 @@ const Iconset &IconSelectPopup::iconset() const
     return d->icsel_->iconset();
 }
 
+QStringList IconSelectPopup::recentTexts() const
+{
+    return d->icsel_->recentTexts();
+}
+
+void IconSelectPopup::setRecentTexts(const QStringList &texts)
+{
+    d->icsel_->setRecentTexts(texts);
+}
+
 /**
     It's used by child widget to close the menu by simulating a
     click slightly outside of menu. This seems to be the best way
@@ -36,6 +36,10 @@ public:
     void setIconset(const Iconset &);
     const Iconset &iconset() const;
 
+    // default texts of the icons picked lately, latest first
+    QStringList recentTexts() const;
+    void setRecentTexts(const QStringList &);
+
     // reimplemented
     void mousePressEvent(QMouseEvent *e);
 
@@ -31,6 +31,7 @@
 #include <QRegularExpression>
 #include <QTextCharFormat>
 #include <QTextCursor>
+#include <QTextBlock>
 #include <QTextDocumentFragment>
 #include <QTextEdit>
 #include <QTextFrame>
@@ -546,6 +547,35 @@ QTextCursor PsiRichText::findMarker(const QTextCursor &cursor, const QString &un
     return nc;
 }
 
+// same as above, but without scanning the whole document
+QTextCursor PsiRichText::findMarker(const QTextBlock &block, const QString &uniqueId)
+{
+    if (!block.isValid())
+        return QTextCursor();
+
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        QTextFragment f = it.fragment();
+        if (f.charFormat().objectType() == MarkerFormatType && f.charFormat().stringProperty(TextMarkerFormat::MarkerId) == uniqueId) {
+            QTextCursor nc(block.document());
+            nc.setPosition(f.position());
+            nc.setPosition(f.position() + 1, QTextCursor::KeepAnchor);
+            return nc;
+        }
+    }
+    return QTextCursor();
+}
+
+QStringList PsiRichText::markers(const QTextBlock &block)
+{
+    QStringList ids;
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        QTextCharFormat format = it.fragment().charFormat();
+        if (format.objectType() == MarkerFormatType)
+            ids << format.stringProperty(TextMarkerFormat::MarkerId);
+    }
+    return ids;
+}
+
 /**
  * Saves current Selection in a structure, so it could be restored at later time.
  */
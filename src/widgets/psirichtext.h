@@ -22,6 +22,7 @@
 
 #include <functional>
 
+class QTextBlock;
 class QTextEdit;
 class ITEMediaOpener;
 
@@ -41,6 +42,8 @@ public:
 
     static void insertMarker(QTextCursor &cursor, const QString &uniqueId);
     static QTextCursor findMarker(const QTextCursor &cursor, const QString &uniqueId); // will modify cursor to stay right after marker.
+    static QTextCursor findMarker(const QTextBlock &block, const QString &uniqueId); // looks only inside the block
+    static QStringList markers(const QTextBlock &block);
 
     struct Selection {
         int start, end;
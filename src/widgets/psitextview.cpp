@@ -27,6 +27,7 @@
 #include <QScrollBar>
 #include <QTextDocumentFragment>
 #include <QTextFragment>
+#include <memory>
 
 #include "filesharingmanager.h"
 #include "psirichtext.h"
@@ -108,22 +109,33 @@ PsiTextView::PsiTextView(QWidget *parent) :
                  return QTextCharFormat();
 
              if (item->mimeType().startsWith(QLatin1String("audio/"))) {
+                 // the player reads the waveform from the item's metadata, have it there
+                 item->manager()->amplitudes(item, this, [](const QByteArray &) {});
                  return d->voiceMsgCtrl->makeFormat(QUrl(QLatin1String("share:") + id), d->mediaOpener);
              }
 
              if (item->mimeType().startsWith("image/")) {
                  QUrl url(QLatin1String("share:") + id);
-                 if (item->isCached()) {
-                     QImage img = item->preview(QSize(640, 480));
+                 // a cached preview comes right away, before the format below is laid out.
+                 // a later one needs a relayout
+                 auto laidOut    = std::make_shared<bool>(false);
+                 auto addPreview = [this, url, laidOut](const QImage &img) {
                      document()->addResource(QTextDocument::ImageResource, url, img);
+                     if (*laidOut)
+                         document()->markContentsDirty(0, document()->characterCount());
+                 };
+                 auto manager = item->manager();
+                 if (item->isCached() || item->fileType() != FileSharingItem::FileType::RemoteFile) {
+                     manager->preview(item, FileSharingManager::PreviewSize::Inline, this, addPreview);
                  } else {
-                     connect(item, &FileSharingItem::downloadFinished, this, [this, url, item]() {
+                     connect(item, &FileSharingItem::downloadFinished, this, [this, item, manager, addPreview]() {
                          item->disconnect(this);
                          // TODO handle errors
-                         document()->addResource(QTextDocument::ImageResource, url, item->preview(QSize(640, 480)));
+                         manager->preview(item, FileSharingManager::PreviewSize::Inline, this, addPreview);
                      });
                      item->download(false, 0, 0);
                  }
+                 *laidOut = true;
                  QTextImageFormat fmt;
                  fmt.setName(url.toString());
                  return fmt;
@@ -25,6 +25,7 @@
 #include <QApplication>
 //#include <QDebug>
 #include <QDrag>
+#include <QHash>
 #include <QLine>
 #include <QMimeData>
 #include <QMouseEvent>
@@ -69,10 +70,16 @@ public:
     Private(TabBar *base);
 
     void layoutTabs();
+    bool refreshTab(int index);
+    QStyleOptionTab tabOption(int index, QTabBar::ButtonPosition closeSide) const;
     int pinnedTabWidthHint() const;
     QSize tabSizeHint(QStyleOptionTab tab) const;
+    QSize cachedTabSizeHint(const QStyleOptionTab &tab);
     void balanseCloseButtons();
     bool indexAtBottom(int index) const;
+    void invalidateRow(int index);
+    void paintRow(QStylePainter &pp, const QList<QStyleOptionTab> &tabs,
+                  int first, int last, int selected, int rowHeight) const;
 
     TabBar *q;
     QList<QStyleOptionTab> hackedTabs;
@@ -97,6 +104,26 @@ public:
         double baseSf;
         LayoutSf layout;
     } cachedLayout;
+
+    // Measuring the text of every tab on each layout is slow with many tabs.
+    // Hints are kept by the tab content and dropped when the font or
+    // the style changes.
+    struct {
+        QHash<QString, QSize> hints;
+        QFont font;
+        QStyle *style;
+        QTabBar::Shape shape;
+        QSize iconSize;
+    } hintCache;
+    QList<QSize> tabHints; // hints of hackedTabs before the layout
+
+    // Painted rows by their top. A row is painted again only when one of
+    // its tabs changes.
+    QHash<int, QPixmap> rowPixmaps;
+    int paintedSelected;
+    int paintedHover;
+    qint64 paintedPalette;
+    QFont paintedFont;
 };
 
 TabBar::Private::Private(TabBar *base)
@@ -116,6 +143,10 @@ TabBar::Private::Private(TabBar *base)
     , stopRecursive(false)
     , indexAlwaysAtBottom(false)
     , cachedLayout({ QList<int>(), 0, 0, 0., LayoutSf() })
+    , hintCache({ QHash<QString, QSize>(), QFont(), nullptr, QTabBar::RoundedNorth, QSize() })
+    , paintedSelected(-1)
+    , paintedHover(-1)
+    , paintedPalette(0)
 {
     balanseCloseButtons();
 }
@@ -262,6 +293,8 @@ void TabBar::Private::layoutTabs()
 
     pinnedTabs = qMin(pinnedTabs, q->count());
     hackedTabs.clear();
+    tabHints.clear();
+    rowPixmaps.clear();
 
     QTabBar::ButtonPosition closeSide = static_cast<QTabBar::ButtonPosition>(q->style()->styleHint(QStyle::SH_TabBar_CloseButtonPosition, nullptr, q));
     // Tabs maybe 0 width in all-in-one mode
@@ -280,26 +313,9 @@ void TabBar::Private::layoutTabs()
 
     // Prepare hacked tabs
     for (int i = 0; i < q->count(); i++) {
-        QStyleOptionTab tab;
-        q->initStyleOption(&tab, i);
-        if (i == 0) {
-            tab.rect.setLeft(0);
-        }
-
-        tab.state &= ~QStyle::State_MouseOver;
-        tab.position = QStyleOptionTab::Beginning;
-
-        if (tabsClosable && i >= pinnedTabs) {
-            tab.rect.setWidth(tab.rect.width() + closeButtons.at(i)->size().width());
-            if (closeSide == QTabBar::LeftSide) {
-                tab.leftButtonSize = closeButtons.at(i)->size();
-            }
-            else {
-                tab.rightButtonSize = closeButtons.at(i)->size();
-            }
-        }
-
-        tab.rect.setSize(tabSizeHint(tab));
+        QStyleOptionTab tab = tabOption(i, closeSide);
+        tabHints << cachedTabSizeHint(tab);
+        tab.rect.setSize(tabHints.last());
         // Make pinned tab if need
         if (i < pinnedTabs){
             tab.text = PINNED_TEXT(tab.text);
@@ -452,6 +468,58 @@ void TabBar::Private::layoutTabs()
     q->resize(q->sizeHint());
 }
 
+/*
+ * Takes the text, icon and color of the tab at index without a new layout
+ * when the tab keeps its size. Returns false if a layout is needed.
+ */
+bool TabBar::Private::refreshTab(int index)
+{
+    if (!multiRow || !update || index < 0 || index >= tabHints.size() || tabHints.size() != q->count())
+        return false;
+
+    QTabBar::ButtonPosition closeSide = static_cast<QTabBar::ButtonPosition>(q->style()->styleHint(QStyle::SH_TabBar_CloseButtonPosition, nullptr, q));
+    QStyleOptionTab tab = tabOption(index, closeSide);
+    if (cachedTabSizeHint(tab) != tabHints.at(index))
+        return false;
+
+    QStyleOptionTab &hacked = hackedTabs[index];
+    hacked.text = index < pinnedTabs ? PINNED_TEXT(tab.text) : tab.text;
+    hacked.icon = tab.icon;
+    hacked.palette = tab.palette;
+    invalidateRow(index);
+    q->update(QRect(0, hacked.rect.top(), q->width(), hacked.rect.height()));
+    return true;
+}
+
+QStyleOptionTab TabBar::Private::tabOption(int index, QTabBar::ButtonPosition closeSide) const
+{
+    QStyleOptionTab tab;
+    q->initStyleOption(&tab, index);
+    if (index == 0) {
+        tab.rect.setLeft(0);
+    }
+
+    tab.state &= ~QStyle::State_MouseOver;
+    tab.position = QStyleOptionTab::Beginning;
+
+    if (tabsClosable && index >= pinnedTabs) {
+        tab.rect.setWidth(tab.rect.width() + closeButtons.at(index)->size().width());
+        if (closeSide == QTabBar::LeftSide) {
+            tab.leftButtonSize = closeButtons.at(index)->size();
+        }
+        else {
+            tab.rightButtonSize = closeButtons.at(index)->size();
+        }
+    }
+    return tab;
+}
+
+void TabBar::Private::invalidateRow(int index)
+{
+    if (index >= 0 && index < hackedTabs.size())
+        rowPixmaps.remove(hackedTabs.at(index).rect.top());
+}
+
 inline static bool verticalTabs(QTabBar::Shape shape)
 {
     return shape == QTabBar::RoundedWest
@@ -541,6 +609,32 @@ QSize TabBar::Private::tabSizeHint(QStyleOptionTab opt) const
 
 }
 
+QSize TabBar::Private::cachedTabSizeHint(const QStyleOptionTab &tab)
+{
+    if (hintCache.font != q->font() || hintCache.style != q->style()
+        || hintCache.shape != q->shape() || hintCache.iconSize != tab.iconSize
+        || hintCache.hints.size() > 2 * q->count() + 16) {
+
+        hintCache.hints.clear();
+        hintCache.font = q->font();
+        hintCache.style = q->style();
+        hintCache.shape = q->shape();
+        hintCache.iconSize = tab.iconSize;
+    }
+
+    QString key = QString("%1x%2x%3x%4|%5")
+                      .arg(tab.leftButtonSize.width()).arg(tab.leftButtonSize.height())
+                      .arg(tab.rightButtonSize.width()).arg(tab.rightButtonSize.height())
+                      .arg(tab.icon.isNull() ? 0 : 1) + tab.text;
+    auto it = hintCache.hints.constFind(key);
+    if (it != hintCache.hints.constEnd())
+        return it.value();
+
+    QSize hint = tabSizeHint(tab);
+    hintCache.hints.insert(key, hint);
+    return hint;
+}
+
 void TabBar::Private::balanseCloseButtons()
 {
     pinnedTabs = qMin(pinnedTabs, q->count());
@@ -642,6 +736,8 @@ void TabBar::setMultiRow(bool b)
     }
     else {
         d->hackedTabs.clear();
+        d->tabHints.clear();
+        d->rowPixmaps.clear();
         update();
     }
 }
@@ -706,19 +802,22 @@ void TabBar::setCurrentIndex(int index)
 void TabBar::setTabText(int index, const QString & text)
 {
     QTabBar::setTabText(index, text);
-    layoutTabs();
+    if (!d->refreshTab(index))
+        layoutTabs();
 }
 
 void TabBar::setTabTextColor(int index, const QColor & color)
 {
     QTabBar::setTabTextColor(index, color);
-    layoutTabs();
+    if (!d->refreshTab(index))
+        layoutTabs();
 }
 
 void TabBar::setTabIcon(int index, const QIcon &icon)
 {
     QTabBar::setTabIcon(index, icon);
-    layoutTabs();
+    if (!d->refreshTab(index))
+        layoutTabs();
 }
 
 QRect TabBar::tabRect(int index) const
@@ -779,6 +878,8 @@ void TabBar::setUpdateEnabled(bool b)
     }
     else {
         d->hackedTabs.clear();
+        d->tabHints.clear();
+        d->rowPixmaps.clear();
     }
 }
 
@@ -965,72 +1066,41 @@ void TabBar::paintEvent(QPaintEvent *event)
         rowHeight = tabs[0].rect.height();
     }
 
+    if (palette().cacheKey() != d->paintedPalette || font() != d->paintedFont) {
+        d->rowPixmaps.clear();
+        d->paintedPalette = palette().cacheKey();
+        d->paintedFont = font();
+    }
+    if (selected != d->paintedSelected) {
+        d->invalidateRow(d->paintedSelected);
+        d->invalidateRow(selected);
+        d->paintedSelected = selected;
+    }
+    if (d->hoverTab != d->paintedHover) {
+        d->invalidateRow(d->paintedHover);
+        d->invalidateRow(d->hoverTab);
+        d->paintedHover = d->hoverTab;
+    }
+
     // There is some problems when tabs are painted not in first row.
     // Draw on a pixmap like a painting in the first row. Then move image
     // to real TabBar widget.
-    QPixmap pixmap(width(), rowHeight);
-    pixmap.fill(Qt::transparent);
-    QStylePainter pp(&pixmap, this);
-    bool drawSelected = false;
-    QPixmap pinPixmap = IconsetFactory::iconPixmap("psi/pin");
+    int first = 0;
     for (int i = 0; i < tabs.size(); i++) {
-        QStyleOptionTab tab = tabs[i];
-        if (i != selected) {
-            if (i == d->hoverTab)
-                tab.state |= QStyle::State_MouseOver;
-
-            if (shape() == QTabBar::RoundedNorth)
-                tab.rect.moveBottom(rowHeight - 1);
-            else
-                tab.rect.moveTop(0);
-
-            // Just dd.drawControl works incorrect with KDE5 breeze style
-            pp.style()->drawControl(QStyle::CE_TabBarTab, &tab, &pp);
-            if (i < d->pinnedTabs) {
-                pp.drawPixmap(tab.rect.topRight() - QPoint(pinPixmap.width(), -3), pinPixmap);
-            }
-        }
-        else {
-            drawSelected = true;
-        }
-
-        if (tab.position == QStyleOptionTab::End || tab.position == QStyleOptionTab::OnlyOneTab) {
-            if (drawSelected) {
-                // Draw current tab in the last order
-                tab = tabs.at(selected);
-                if (shape() == QTabBar::RoundedNorth)
-                    tab.rect.moveBottom(rowHeight - 1);
-                else
-                    tab.rect.moveTop(0);
-
-                // Draw tab shape
-                // Use red color as tab frame
-                QPalette oldPalette = tab.palette;
-                tab.palette.setColor(QPalette::Foreground, Qt::red);
-                tab.palette.setColor(QPalette::Light, Qt::red);
-                tab.palette.setColor(QPalette::Dark, Qt::red);
-                pp.drawControl(QStyle::CE_TabBarTabShape, tab);
-                tab.palette = oldPalette;
-
-                // Use bold font for current tab
-                QFont f = pp.font();
-                f.setBold(true);
-                pp.save();
-                pp.setFont(f);
-                pp.drawControl(QStyle::CE_TabBarTabLabel, tab);
-                pp.restore();
-
-                if (selected < d->pinnedTabs) {
-                    pp.drawPixmap(tab.rect.topRight() - QPoint(pinPixmap.width(), -3), pinPixmap);
-                }
-
-                drawSelected = false;
-            }
+        if (tabs.at(i).position != QStyleOptionTab::End && tabs.at(i).position != QStyleOptionTab::OnlyOneTab)
+            continue;
 
-            QRect rect(0, tabs.at(i).rect.top(), width(), rowHeight);
-            p.drawItemPixmap(rect, Qt::AlignCenter, pixmap);
+        QPixmap &pixmap = d->rowPixmaps[tabs.at(i).rect.top()];
+        if (pixmap.size() != QSize(width(), rowHeight)) {
+            pixmap = QPixmap(width(), rowHeight);
             pixmap.fill(Qt::transparent);
+            QStylePainter pp(&pixmap, this);
+            d->paintRow(pp, tabs, first, i, selected, rowHeight);
         }
+
+        QRect rect(0, tabs.at(i).rect.top(), width(), rowHeight);
+        p.drawItemPixmap(rect, Qt::AlignCenter, pixmap);
+        first = i + 1;
     }
 
     ButtonPosition closeSide = static_cast<QTabBar::ButtonPosition>(style()->styleHint(QStyle::SH_TabBar_CloseButtonPosition, nullptr, this));
@@ -1065,6 +1135,62 @@ void TabBar::paintEvent(QPaintEvent *event)
     }
 }
 
+void TabBar::Private::paintRow(QStylePainter &pp, const QList<QStyleOptionTab> &tabs,
+                                int first, int last, int selected, int rowHeight) const
+{
+    static const IconsetFactory::Handle pinIcon("psi/pin");
+    QPixmap pinPixmap = pinIcon.pixmap();
+    for (int i = first; i <= last; i++) {
+        if (i == selected)
+            continue;
+
+        QStyleOptionTab tab = tabs[i];
+        if (i == hoverTab)
+            tab.state |= QStyle::State_MouseOver;
+
+        if (q->shape() == QTabBar::RoundedNorth)
+            tab.rect.moveBottom(rowHeight - 1);
+        else
+            tab.rect.moveTop(0);
+
+        // Just dd.drawControl works incorrect with KDE5 breeze style
+        pp.style()->drawControl(QStyle::CE_TabBarTab, &tab, &pp);
+        if (i < pinnedTabs) {
+            pp.drawPixmap(tab.rect.topRight() - QPoint(pinPixmap.width(), -3), pinPixmap);
+        }
+    }
+
+    if (selected >= first && selected <= last) {
+        // Draw current tab in the last order
+        QStyleOptionTab tab = tabs.at(selected);
+        if (q->shape() == QTabBar::RoundedNorth)
+            tab.rect.moveBottom(rowHeight - 1);
+        else
+            tab.rect.moveTop(0);
+
+        // Draw tab shape
+        // Use red color as tab frame
+        QPalette oldPalette = tab.palette;
+        tab.palette.setColor(QPalette::Foreground, Qt::red);
+        tab.palette.setColor(QPalette::Light, Qt::red);
+        tab.palette.setColor(QPalette::Dark, Qt::red);
+        pp.drawControl(QStyle::CE_TabBarTabShape, tab);
+        tab.palette = oldPalette;
+
+        // Use bold font for current tab
+        QFont f = pp.font();
+        f.setBold(true);
+        pp.save();
+        pp.setFont(f);
+        pp.drawControl(QStyle::CE_TabBarTabLabel, tab);
+        pp.restore();
+
+        if (selected < pinnedTabs) {
+            pp.drawPixmap(tab.rect.topRight() - QPoint(pinPixmap.width(), -3), pinPixmap);
+        }
+    }
+}
+
 void TabBar::mousePressEvent(QMouseEvent *event)
 {
     if (!d->multiRow) {
@@ -26,16 +26,20 @@
 #include "xmpp_tasks.h"
 #include "xmpp_xdata.h"
 
+#include <QAbstractListModel>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QCompleter>
 #include <QGridLayout>
 #include <QLabel>
 #include <QLayout>
 #include <QLineEdit>
-#include <QListWidget>
+#include <QListView>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QObject>
+#include <QSet>
+#include <QSortFilterProxyModel>
 #include <QSpacerItem>
 #include <QTextEdit>
 #include <QUrl>
@@ -360,6 +364,99 @@ public:
 
 ////////////////////////////////////////
 
+// lists with more options than that get type-ahead filtering
+static const int filteredListSize = 30;
+
+/**
+ * Options of a list field for the views, so no item is made per option
+ * and the views only ask for the rows they show. For list-multi the
+ * chosen options are check states, which are kept while filtering.
+ */
+class XDataOptionsModel : public QAbstractListModel
+{
+public:
+    XDataOptionsModel(const XData::Field &f, bool checkable, QObject *parent)
+    : QAbstractListModel(parent)
+    , opts_(f.options())
+    , checkable_(checkable)
+    {
+        if ( checkable_ ) {
+            const QSet<QString> val = f.value().toSet();
+            checked_.resize(opts_.count());
+            for (int i = 0; i < opts_.count(); i++)
+                checked_[i] = val.contains(opts_[i].label) || val.contains(opts_[i].value);
+        }
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : opts_.count();
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override
+    {
+        if ( !index.isValid() || index.row() >= opts_.count() )
+            return QVariant();
+        if ( role == Qt::DisplayRole || role == Qt::EditRole )
+            return label(index.row());
+        if ( role == Qt::CheckStateRole && checkable_ )
+            return checked_[index.row()] ? Qt::Checked : Qt::Unchecked;
+        return QVariant();
+    }
+
+    bool setData(const QModelIndex &index, const QVariant &value, int role) override
+    {
+        if ( !checkable_ || role != Qt::CheckStateRole || !index.isValid() )
+            return false;
+        checked_[index.row()] = value.toInt() == Qt::Checked;
+        emit dataChanged(index, index, QVector<int>() << role);
+        return true;
+    }
+
+    Qt::ItemFlags flags(const QModelIndex &index) const override
+    {
+        Qt::ItemFlags f = QAbstractListModel::flags(index);
+        if ( checkable_ )
+            f |= Qt::ItemIsUserCheckable;
+        return f;
+    }
+
+    QString label(int row) const
+    {
+        const XData::Field::Option &o = opts_.at(row);
+        return o.label.isEmpty() ? o.value : o.label;
+    }
+
+    QString value(int row) const
+    {
+        return opts_.at(row).value;
+    }
+
+    int find(const QString &text) const
+    {
+        for (int i = 0; i < opts_.count(); i++)
+            if ( opts_[i].label == text || opts_[i].value == text )
+                return i;
+        return -1;
+    }
+
+    QStringList checkedValues() const
+    {
+        QStringList val;
+        for (int i = 0; i < checked_.count(); i++)
+            if ( checked_[i] )
+                val << opts_[i].value;
+        return val;
+    }
+
+private:
+    XData::Field::OptionList opts_;
+    QVector<bool>            checked_;
+    bool                     checkable_;
+};
+
+////////////////////////////////////////
+
 class XDataField_ListSingle : public XDataField
 {
 public:
@@ -374,25 +471,28 @@ public:
         layout->addWidget(label);
 
         combo = new QComboBox(xdw);
+        model = new XDataOptionsModel(f, false, combo);
         layout->addWidget(combo);
+        combo->setModel(model);
+        if ( QListView *view = qobject_cast<QListView *>(combo->view()) )
+            view->setUniformItemSizes(true);
+        if ( model->rowCount() > filteredListSize ) {
+            // type a part of the option to find it
+            combo->setEditable(true);
+            combo->completer()->setCompletionMode(QCompleter::PopupCompletion);
+            combo->completer()->setFilterMode(Qt::MatchContains);
+        }
         combo->setInsertPolicy(QComboBox::NoInsert);
 
         grid->addLayout(layout, row, 0);
 
-        QString sel;
-        if ( !f.value().isEmpty() )
-            sel = f.value().first();
-
-        XData::Field::OptionList opts = f.options();
-        XData::Field::OptionList::Iterator it = opts.begin();
-        for ( ; it != opts.end(); ++it) {
-            QString lbl = (*it).label;
-            if ( lbl.isEmpty() )
-                lbl = (*it).value;
-
-            combo->addItem(lbl);
-            if ( (*it).value == sel )
-                combo->setCurrentIndex(combo->count()-1);
+        if ( !f.value().isEmpty() ) {
+            for (int i = 0; i < model->rowCount(); i++) {
+                if ( model->value(i) == f.value().first() ) {
+                    combo->setCurrentIndex(i);
+                    break;
+                }
+            }
         }
 
         QLabel *req = new QLabel(reqText(), xdw);
@@ -407,25 +507,21 @@ public:
 
     XData::Field field() const
     {
-        QString lbl = combo->currentText();
-
         XData::Field f = XDataField::field();
         QStringList val;
 
-        XData::Field::OptionList opts = f.options();
-        XData::Field::OptionList::Iterator it = opts.begin();
-        for ( ; it != opts.end(); ++it) {
-            if ( (*it).label == lbl || (*it).value == lbl ) {
-                val << (*it).value;
-                break;
-            }
-        }
+        int row = combo->currentIndex();
+        if ( row == -1 || model->label(row) != combo->currentText() )
+            row = model->find(combo->currentText()); // typed in
+        if ( row != -1 )
+            val << model->value(row);
 
         f.setValue(val);
         return f;
     }
 
 private:
+    XDataOptionsModel *model;
     QComboBox *combo;
 };
 
@@ -442,25 +538,25 @@ public:
         label->setWordWrap(true);
         grid->addWidget(label, row, 0);
 
-        list = new QListWidget(xdw);
-        grid->addWidget(list, row, 1);
-        list->setSelectionMode(QAbstractItemView::MultiSelection);
-
-        XData::Field::OptionList opts = f.options();
-        XData::Field::OptionList::Iterator it = opts.begin();
-        for ( ; it != opts.end(); ++it) {
-            QString lbl = (*it).label;
-            if ( lbl.isEmpty() )
-                lbl = (*it).value;
-
-            QListWidgetItem* item = new QListWidgetItem(lbl,list);
-
-            QStringList val = f.value();
-            QStringList::Iterator sit = val.begin();
-            for ( ; sit != val.end(); ++sit)
-                if ( (*it).label == *sit || (*it).value == *sit )
-                    item->setSelected(true);
+        QVBoxLayout *layout = new QVBoxLayout;
+        list = new QListView(xdw);
+        model = new XDataOptionsModel(f, true, list);
+        list->setUniformItemSizes(true);
+        if ( model->rowCount() > filteredListSize ) {
+            QSortFilterProxyModel *proxy = new QSortFilterProxyModel(list);
+            proxy->setSourceModel(model);
+            proxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+            QLineEdit *filter = new QLineEdit(xdw);
+            filter->setPlaceholderText(XDataWidget::tr("Filter"));
+            filter->setClearButtonEnabled(true);
+            QObject::connect(filter, &QLineEdit::textChanged, proxy, &QSortFilterProxyModel::setFilterFixedString);
+            layout->addWidget(filter);
+            list->setModel(proxy);
+        } else {
+            list->setModel(model);
         }
+        layout->addWidget(list);
+        grid->addLayout(layout, row, 1);
 
         QLabel *req = new QLabel(reqText(), xdw);
         grid->addWidget(req, row, 2);
@@ -475,29 +571,13 @@ public:
     XData::Field field() const
     {
         XData::Field f = XDataField::field();
-        QStringList val;
-
-        for (int i = 0; i < list->count(); i++) {
-            QListWidgetItem* item = list->item(i);
-            if ( item->isSelected() ) {
-                QString lbl = item->text();
-                XData::Field::OptionList opts = f.options();
-                XData::Field::OptionList::Iterator it = opts.begin();
-                for ( ; it != opts.end(); ++it) {
-                    if ( (*it).label == lbl || (*it).value == lbl ) {
-                        val << (*it).value;
-                        break;
-                    }
-                }
-            }
-        }
-
-        f.setValue(val);
+        f.setValue(model->checkedValues());
         return f;
     }
 
 private:
-    QListWidget *list;
+    XDataOptionsModel *model;
+    QListView *list;
 };
 
 ////////////////////////////////////////
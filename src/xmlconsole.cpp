@@ -19,22 +19,225 @@
 
 #include "xmlconsole.h"
 
+#include "fileutil.h"
 #include "iconset.h"
 #include "psiaccount.h"
 #include "psicon.h"
 #include "psicontactlist.h"
+#include "psioptions.h"
+#include "stanzapacer.h"
 #include "textutil.h"
 #include "xmpp_client.h"
 
+#include <QAbstractListModel>
 #include <QCheckBox>
+#include <QColor>
+#include <QDomDocument>
+#include <QFile>
+#include <QFutureWatcher>
 #include <QHBoxLayout>
 #include <QLayout>
 #include <QMessageBox>
 #include <QPushButton>
 #include <QScrollBar>
 #include <QTextEdit>
-#include <QTextFrame>
+#include <QTextStream>
 #include <QVBoxLayout>
+#include <QXmlStreamReader>
+#include <QtConcurrentRun>
+
+//----------------------------------------------------------------------------
+// XmlConsoleModel
+//----------------------------------------------------------------------------
+struct XmlRecord
+{
+    quint64   seq;
+    bool      incoming;
+    QDateTime time;
+    QString   xml;
+    QString   tag, to, from; // of the top element
+    bool      valid;         // starts with a well-formed element
+};
+
+struct XmlFilter
+{
+    bool iq = true, message = true, presence = true, sm = true;
+    Jid  jid;
+
+    bool isActive() const { return !jid.isEmpty() || !iq || !message || !presence || !sm; }
+
+    bool accepts(const XmlRecord &r) const
+    {
+        if (!isActive())
+            return true;
+        if (!r.valid)
+            return false;
+
+        const QString &tn = r.tag;
+        if ((tn == "iq" && !iq) || (tn == "message" && !message) || (tn == "presence" && !presence) || ((tn == "a" || tn == "r") && !sm))
+            return false;
+
+        if (!jid.isEmpty()) {
+            bool hasResource = !jid.resource().isEmpty();
+            if (!jid.compare(Jid(r.to), hasResource) && !jid.compare(Jid(r.from), hasResource))
+                return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * Keeps the recorded stanzas in a ring buffer limited by memory usage and
+ * exposes the ones passing the filter as one-line rows, so the view only
+ * ever touches the visible part. Changing the filter is done on a worker
+ * thread.
+ */
+class XmlConsoleModel : public QAbstractListModel
+{
+public:
+    XmlConsoleModel(qint64 limit, QObject *parent) : QAbstractListModel(parent), limit_(limit) { }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : visible_.size();
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override
+    {
+        const XmlRecord *r = record(index);
+        if (!r)
+            return QVariant();
+
+        if (role == Qt::DisplayRole) {
+            QString line = r->xml.left(300).simplified();
+            return QString("%1 %2 %3").arg(r->time.toString("hh:mm:ss"), r->incoming ? "<<" : ">>", line);
+        }
+        if (role == Qt::ForegroundRole) {
+            return QColor(r->incoming ? Qt::yellow : Qt::red);
+        }
+        return QVariant();
+    }
+
+    const XmlRecord *record(const QModelIndex &index) const
+    {
+        if (!index.isValid() || index.row() >= visible_.size() || records_.isEmpty())
+            return nullptr;
+        return &records_.at(int(visible_.at(index.row()) - records_.first().seq));
+    }
+
+    void append(bool incoming, const QDateTime &time, const QString &xml)
+    {
+        XmlRecord r;
+        r.seq      = nextSeq_++;
+        r.incoming = incoming;
+        r.time     = time;
+        r.xml      = xml;
+        r.valid    = false;
+
+        // only the top element is needed for filtering
+        QXmlStreamReader reader(xml);
+        while (!reader.atEnd()) {
+            if (reader.readNext() == QXmlStreamReader::StartElement) {
+                r.tag   = reader.qualifiedName().toString();
+                r.to    = reader.attributes().value(QLatin1String("to")).toString();
+                r.from  = reader.attributes().value(QLatin1String("from")).toString();
+                r.valid = true;
+                break;
+            }
+        }
+
+        records_.append(r);
+        bytes_ += cost(r);
+        if (filter_.accepts(r)) {
+            beginInsertRows(QModelIndex(), visible_.size(), visible_.size());
+            visible_.append(r.seq);
+            endInsertRows();
+        }
+
+        while (bytes_ > limit_ && records_.size() > 1) {
+            XmlRecord old = records_.takeFirst();
+            bytes_ -= cost(old);
+            if (!visible_.isEmpty() && visible_.first() == old.seq) {
+                beginRemoveRows(QModelIndex(), 0, 0);
+                visible_.removeFirst();
+                endRemoveRows();
+            }
+        }
+    }
+
+    void clear()
+    {
+        beginResetModel();
+        records_.clear();
+        visible_.clear();
+        bytes_ = 0;
+        ++filterGeneration_; // drop results of running filtering
+        endResetModel();
+    }
+
+    void setFilter(const XmlFilter &filter)
+    {
+        filter_                   = filter;
+        int              gen      = ++filterGeneration_;
+        quint64          upTo     = nextSeq_;
+        QList<XmlRecord> snapshot = records_; // implicitly shared
+
+        auto watcher = new QFutureWatcher<QList<quint64>>(this);
+        connect(watcher, &QFutureWatcher<QList<quint64>>::finished, this, [this, watcher, gen, upTo]() {
+            watcher->deleteLater();
+            if (gen == filterGeneration_)
+                applyFilter(watcher->result(), upTo);
+        });
+        watcher->setFuture(QtConcurrent::run([snapshot, filter]() {
+            QList<quint64> ret;
+            for (const XmlRecord &r : snapshot) {
+                if (filter.accepts(r))
+                    ret.append(r.seq);
+            }
+            return ret;
+        }));
+    }
+
+    // raw buffer contents with timestamps, the same format as the ring buffer dump
+    void write(QTextStream &ts) const
+    {
+        for (const XmlRecord &r : records_) {
+            ts << "<!-- " << (r.incoming ? "IN" : "OUT") << " TS:" << r.time.toString(Qt::ISODate) << " -->\n"
+               << r.xml << "\n";
+        }
+    }
+
+private:
+    static qint64 cost(const XmlRecord &r)
+    {
+        return qint64(r.xml.size() + r.tag.size() + r.to.size() + r.from.size()) * 2 + 64;
+    }
+
+    void applyFilter(const QList<quint64> &filtered, quint64 upTo)
+    {
+        beginResetModel();
+        visible_.clear();
+        quint64 first = records_.isEmpty() ? nextSeq_ : records_.first().seq;
+        for (quint64 seq : filtered) {
+            if (seq >= first) // not evicted meanwhile
+                visible_.append(seq);
+        }
+        // appended while filtering
+        for (const XmlRecord &r : records_) {
+            if (r.seq >= upTo && filter_.accepts(r))
+                visible_.append(r.seq);
+        }
+        endResetModel();
+    }
+
+    QList<XmlRecord> records_; // oldest first, consecutive seqs
+    QList<quint64>   visible_;
+    quint64          nextSeq_ = 0;
+    qint64           bytes_   = 0;
+    qint64           limit_;
+    XmlFilter        filter_;
+    int              filterGeneration_ = 0;
+};
 
 //----------------------------------------------------------------------------
 // XmlConsole
@@ -54,18 +257,33 @@ XmlConsole::XmlConsole(PsiAccount *_pa)
 
     prompt = nullptr;
 
+    qint64 limit = qMax(64, PsiOptions::instance()->getOption("options.xml-console.memory-limit").toInt()) * qint64(1024);
+    model = new XmlConsoleModel(limit, this);
+    ui_.lv_log->setModel(model);
+    ui_.lv_log->setUniformItemSizes(true);
+    connect(ui_.lv_log->selectionModel(), SIGNAL(currentChanged(QModelIndex, QModelIndex)), SLOT(showRecord(QModelIndex)));
+
     ui_.te->setUndoRedoEnabled(false);
     ui_.te->setReadOnly(true);
     ui_.te->setAcceptRichText(false);
 
-    QTextFrameFormat f = ui_.te->document()->rootFrame()->frameFormat();
-    f.setBackground(QBrush(Qt::black));
-    ui_.te->document()->rootFrame()->setFrameFormat(f);
+    QPalette pal = ui_.lv_log->palette();
+    pal.setColor(QPalette::Base, Qt::black);
+    ui_.lv_log->setPalette(pal);
+    ui_.te->setPalette(pal);
 
     connect(ui_.pb_clear, SIGNAL(clicked()), SLOT(clear()));
     connect(ui_.pb_input, SIGNAL(clicked()), SLOT(insertXml()));
     connect(ui_.pb_close, SIGNAL(clicked()), SLOT(close()));
     connect(ui_.pb_dumpRingbuf, SIGNAL(clicked()), SLOT(dumpRingbuf()));
+    connect(ui_.pb_save, SIGNAL(clicked()), SLOT(save()));
+    foreach (QCheckBox *ck, QList<QCheckBox *>() << ui_.ck_iq << ui_.ck_message << ui_.ck_presence << ui_.ck_sm) {
+        connect(ck, SIGNAL(toggled(bool)), SLOT(updateFilter()));
+    }
+    connect(ui_.le_jid, SIGNAL(textChanged(QString)), SLOT(updateFilter()));
+
+    connect(pa->stanzaPacer(), SIGNAL(countersChanged()), SLOT(updatePacer()));
+    updatePacer();
 
     resize(560,400);
 }
@@ -75,12 +293,15 @@ XmlConsole::~XmlConsole()
     pa->dialogUnregister(this);
 }
 
+void XmlConsole::updatePacer()
+{
+    ui_.lb_pacer->setText(pa->stanzaPacer()->summary());
+}
+
 void XmlConsole::clear()
 {
+    model->clear();
     ui_.te->clear();
-    QTextFrameFormat f = ui_.te->document()->rootFrame()->frameFormat();
-    f.setBackground(QBrush(Qt::black));
-    ui_.te->document()->rootFrame()->setFrameFormat(f);
 }
 
 void XmlConsole::updateCaption()
@@ -96,66 +317,72 @@ void XmlConsole::enable()
     ui_.ck_enable->setChecked(true);
 }
 
-bool XmlConsole::filtered(const QString& str) const
+void XmlConsole::updateFilter()
 {
-    if(ui_.ck_enable->isChecked()) {
-        // Only do parsing if needed
-        if (!ui_.le_jid->text().isEmpty() || !ui_.ck_iq->isChecked() || !ui_.ck_message->isChecked() || !ui_.ck_presence->isChecked() || !ui_.ck_sm->isChecked()) {
-            QDomDocument doc;
-            if (!doc.setContent(str))
-                return true;
-
-            QDomElement e = doc.documentElement();
-            QString tn = e.tagName();
-            if ((tn == "iq" && !ui_.ck_iq->isChecked()) || (tn == "message" && !ui_.ck_message->isChecked()) || (tn == "presence" && !ui_.ck_presence->isChecked()) || ((tn == "a" || tn == "r") && !ui_.ck_sm->isChecked()))
-                return true;
+    XmlFilter f;
+    f.iq       = ui_.ck_iq->isChecked();
+    f.message  = ui_.ck_message->isChecked();
+    f.presence = ui_.ck_presence->isChecked();
+    f.sm       = ui_.ck_sm->isChecked();
+    f.jid      = Jid(ui_.le_jid->text());
+    model->setFilter(f);
+}
 
-            if (!ui_.le_jid->text().isEmpty()) {
-                Jid jid(ui_.le_jid->text());
-                bool hasResource = !jid.resource().isEmpty();
-                if (!jid.compare(e.attribute("to"),hasResource) && !jid.compare(e.attribute("from"),hasResource))
-                    return true;
-            }
-        }
-        return false;
+void XmlConsole::showRecord(const QModelIndex &index)
+{
+    const XmlRecord *r = model->record(index);
+    if (!r) {
+        ui_.te->clear();
+        return;
     }
-    return true;
+
+    // pretty printed only when looked at
+    QDomDocument doc;
+    QString      text = doc.setContent(r->xml) ? doc.toString(2) : r->xml;
+
+    QPalette pal = ui_.te->palette();
+    pal.setColor(QPalette::Text, r->incoming ? Qt::yellow : Qt::red);
+    ui_.te->setPalette(pal);
+    ui_.te->setPlainText("<!-- TS:" + r->time.toString(Qt::ISODate) + " -->\n" + text);
 }
 
 void XmlConsole::dumpRingbuf()
 {
     QList<PsiAccount::xmlRingElem> buf = pa->dumpRingbuf();
-    bool enablesave = ui_.ck_enable->isChecked();
-    ui_.ck_enable->setChecked(true);
-    QString stamp;
+    bool atBottom = ui_.lv_log->verticalScrollBar()->value() == ui_.lv_log->verticalScrollBar()->maximum();
     foreach (PsiAccount::xmlRingElem el, buf) {
-        stamp = "<!-- TS:" + el.time.toString(Qt::ISODate) + "-->";
-        if (el.type == PsiAccount::RingXmlOut) {
-            client_xmlOutgoing(stamp + el.xml);
-        } else {
-            client_xmlIncoming(stamp + el.xml);
-        }
+        model->append(el.type != PsiAccount::RingXmlOut, el.time, el.xml);
     }
-    ui_.ck_enable->setChecked(enablesave);
+    if (atBottom)
+        ui_.lv_log->scrollToBottom();
 }
 
-void XmlConsole::addRecord(bool incoming, const QString &str) {
-    if (!filtered(str)) {
-        int prevSPos = ui_.te->verticalScrollBar()->value();
-        bool atBottom = (prevSPos == ui_.te->verticalScrollBar()->maximum());
-        QTextCursor prevCur = ui_.te->textCursor();
+void XmlConsole::save()
+{
+    QString fileName = FileUtil::getSaveFileName(this, tr("Save XML Log"), "xmlconsole.log",
+                                                 tr("Log files (*.log);;All files (*)"));
+    if (fileName.isEmpty())
+        return;
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QMessageBox::warning(this, tr("Error"), tr("Unable to write to %1").arg(fileName));
+        return;
+    }
+    QTextStream ts(&f);
+    ts.setCodec("UTF-8");
+    model->write(ts);
+}
 
-        ui_.te->moveCursor(QTextCursor::End);
-        ui_.te->setTextColor(incoming? Qt::yellow : Qt::red);
-        ui_.te->insertPlainText(str + '\n');
+void XmlConsole::addRecord(bool incoming, const QString &str)
+{
+    if (!ui_.ck_enable->isChecked())
+        return;
 
-        if (!atBottom) {
-            ui_.te->setTextCursor(prevCur);
-            ui_.te->verticalScrollBar()->setValue(prevSPos);
-        } else {
-            ui_.te->verticalScrollBar()->setValue(ui_.te->verticalScrollBar()->maximum());
-        }
-    }
+    bool atBottom = ui_.lv_log->verticalScrollBar()->value() == ui_.lv_log->verticalScrollBar()->maximum();
+    model->append(incoming, QDateTime::currentDateTime(), str);
+    if (atBottom)
+        ui_.lv_log->scrollToBottom();
 }
 
 void XmlConsole::client_xmlIncoming(const QString &str)
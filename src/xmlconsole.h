@@ -28,7 +28,9 @@
 
 class PsiAccount;
 class QCheckBox;
+class QModelIndex;
 class QTextEdit;
+class XmlConsoleModel;
 class XmlPrompt;
 
 class XmlConsole : public QWidget
@@ -44,18 +46,22 @@ private slots:
     void updateCaption();
     void insertXml();
     void dumpRingbuf();
+    void save();
     void client_xmlIncoming(const QString &);
     void client_xmlOutgoing(const QString &);
     void xml_textReady(const QString &);
+    void updateFilter();
+    void showRecord(const QModelIndex &);
+    void updatePacer();
 
 protected:
-    bool filtered(const QString&) const;
     void addRecord(bool incoming, const QString &str);
 
 private:
     Ui::XMLConsole ui_;
     PsiAccount *pa;
     QPointer<XmlPrompt> prompt;
+    XmlConsoleModel *model;
 };
 
 class XmlPrompt : public QDialog
@@ -399,6 +399,7 @@ chat.util.updateObject(adapter, function(chat){
                 var ip = cache["Info.plist"];
                 var prevGrouppingData = null;
                 var groupping = !(ip.DisableCombineConsecutive == true);
+                var prepend = null; // set while a page of older messages is rendered
 
                 chat.adapter.receiveObject = function(data) {
                     cdata = data;
@@ -435,7 +436,7 @@ chat.util.updateObject(adapter, function(chat){
                             switch (data.mtype) {
                                 case "message":
                                     data.messageClasses += " message";
-                                    data.nextOfGroup = groupping && !!(prevGrouppingData &&
+                                    data.nextOfGroup = groupping && !prepend && !!(prevGrouppingData &&
                                         (prevGrouppingData.type == cdata.type) &&
                                         (prevGrouppingData.mtype == cdata.mtype) &&
                                         (prevGrouppingData.userid == cdata.userid) &&
@@ -489,12 +490,18 @@ chat.util.updateObject(adapter, function(chat){
                                     break;
                             }
                             if (template) {
-                                if (data.nextOfGroup) {
+                                if (prepend) {
+                                    if (prepend.anchor) {
+                                        chat.util.siblingHtml(prepend.anchor, template.toString(data));
+                                    } else {
+                                        chat.util.appendHtml(document.getElementById("Chat"), template.toString(data));
+                                    }
+                                } else if (data.nextOfGroup) {
                                     appendNextMessage(template.toString(data));
                                 } else {
                                     appendMessage(template.toString(data));
                                 }
-                                if (data.mtype == "message" && data.local) {
+                                if (!prepend && data.mtype == "message" && data.local) {
                                     scrollToBottom();
                                 }
                             } else {
@@ -509,6 +516,17 @@ chat.util.updateObject(adapter, function(chat){
                     }
                 };
 
+                chat.adapter.chatContainer = function() { return document.getElementById("Chat"); };
+                chat.adapter.atBottom = function() { return nearBottom(); };
+                chat.adapter.beginPrepend = function(anchor) {
+                    prepend = {anchor: anchor, groupping: prevGrouppingData};
+                    prevGrouppingData = null;
+                };
+                chat.adapter.endPrepend = function() {
+                    prevGrouppingData = prepend.groupping;
+                    prepend = null;
+                };
+
                 var t = {};
                 var templates = {}
                 var tcList = ["Status.html", "Content.html",
@@ -547,6 +565,7 @@ chat.util.updateObject(adapter, function(chat){
                 session.localUserAvatarChanged.connect(printAvatar);
 
                 session.newMessage.connect(chat.receiveObject);
+                session.newMessages.connect(chat.receiveObjects);
                 chat.util.rereadOptions();
                 session.signalInited();
             }
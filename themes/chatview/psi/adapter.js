@@ -75,6 +75,7 @@ function psiThemeAdapter(chat) {
             groupping : false,
             chatElement : null,
             chat : chat,
+            prepend : null, // set while a page of older messages is rendered
 
             TemplateVar : function(name, param) {
                 this.name = name;
@@ -103,6 +104,15 @@ function psiThemeAdapter(chat) {
             },
 
             appendHtml : function(html, scroll, nextEl) { //scroll[true|false|auto/other]
+                if (shared.prepend) { // older messages go above the current ones
+                    var dest = nextEl || shared.prepend.anchor;
+                    if (dest) {
+                        chat.util.siblingHtml(dest, html);
+                    } else {
+                        chat.util.appendHtml(shared.chatElement, html);
+                    }
+                    return;
+                }
                 if (typeof(scroll) == 'boolean') {
                     shared.scroller.atBottom = scroll;
                 }
@@ -132,6 +142,15 @@ function psiThemeAdapter(chat) {
                 shared.scroller = config.scroller || new chat.WindowScroller(false);
                 shared.groupping = config.groupping || shared.groupping;
                 proxy = config.proxy;
+                if (config.receipts) {
+                    chat.adapter.markReceived = function(receipts) {
+                        try {
+                            config.receipts(receipts);
+                        } catch(e) {
+                            chat.util.showCriticalError("RECEIPTS ERROR: " + e + "\n" + (e.stack?e.stack:"<no stack>"))
+                        }
+                    };
+                }
                 shared.varHandlers = config.varHandlers || {};
                 for (var tname in config.templates) {
                     if (config.templates[tname]) {
@@ -318,8 +337,8 @@ function psiThemeAdapter(chat) {
                     if (!trackbar) {
                         trackbar = document.createElement("div");
                         trackbar.innerHTML = shared.templates.trackbar.toString();
-                    } else {
-                        shared.chatElement.removeChild(trackbar);
+                    } else if (trackbar.parentNode) { // could be dropped with old messages
+                        trackbar.parentNode.removeChild(trackbar);
                     }
                     shared.chatElement.appendChild(trackbar);
                     shared.scroller.invalidate();
@@ -334,7 +353,20 @@ function psiThemeAdapter(chat) {
             }
         };
 
+        chat.adapter.chatContainer = function() { return shared.chatElement; };
+        chat.adapter.atBottom = function() { return shared.scroller.atBottom; };
+        chat.adapter.beginPrepend = function(anchor) {
+            shared.prepend = {anchor: anchor, groupping: shared.prevGrouppingData};
+            shared.prevGrouppingData = null;
+        };
+        chat.adapter.endPrepend = function() {
+            shared.stopGroupping();
+            shared.prevGrouppingData = shared.prepend.groupping;
+            shared.prepend = null;
+        };
+
         shared.session.newMessage.connect(chat.receiveObject);
+        shared.session.newMessages.connect(chat.receiveObjects);
 
         chat.adapter.initSession = null;
         chat.adapter.loadTheme = null;
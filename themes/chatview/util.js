@@ -11,6 +11,8 @@ function initPsiTheme() {
     var uniqReplId = Number(0);
     var previewsEnabled = true;
     var optionChangeHandlers = {}
+    var deferredScrollers = null; // scrollers to invalidate when a batch of messages is rendered
+    var chatLog = {limit: 0, trimmed: false, requested: false}; // windowed chat log state
 
     function BackForthScollerPausedAnimation(start, stop, callback)
     {
@@ -350,7 +352,7 @@ function initPsiTheme() {
                         var hg = share.getAttribute("amplitudes");
                         if (hg && hg.length)
                             hg.split(",").forEach(v => { info += `<b style="height:${v}%"></b>` });
-                        var playerFragment = chat.util.createHtmlNode(`<div class="psi-audio-msg">
+                        var playerFragment = chat.util.createHtmlNode(`<div class="psi-audio-msg" data-share="${source}">
   <div class="psi-am-play-btn"><div class="psi-am-play-sign psi-am-sign-play"></div></div>
   <div class="psi-am-info">
   <div>
@@ -632,6 +634,12 @@ function initPsiTheme() {
             //EXTERNAL API
             // checks current state of scroll and wish and activates necessary actions
             o.invalidate = function() {
+                if (deferredScrollers) { // layout is checked once after the whole batch
+                    if (deferredScrollers.indexOf(o) == -1) {
+                        deferredScrollers.push(o);
+                    }
+                    return;
+                }
                 if (o.atBottom) {
                     startAnimation();
                 }
@@ -725,6 +733,9 @@ function initPsiTheme() {
         AudioMessage : AudioMessage,
 
         receiveObject : function(data) {
+            if (typeof data === "string") {
+                data = parseMessage(data);
+            }
             for(var i=0; i < chat.hooks.length; i++) {
                 try {
                     chat.hooks[i](chat, data);
@@ -753,6 +764,25 @@ function initPsiTheme() {
                     delete serverTransctions[data.id];
                 }
                 return;
+            } else if (data.type == "receipts") {
+                // delivery receipts by message id, all the ones of a frame at once
+                if (chat.adapter.markReceived) {
+                    chat.adapter.markReceived(data.receipts);
+                } else {
+                    for (var id in data.receipts) {
+                        chat.adapter.receiveObject({type: "receipt", id: id, encrypted: data.receipts[id]});
+                    }
+                }
+                return;
+            } else if (data.type == "amplitudes") {
+                // the waveform of a voice message, computed after the message was shown
+                var bars = "";
+                data.amplitudes.forEach(v => { bars += `<b style="height:${v}%"></b>` });
+                var infos = document.querySelectorAll(`.psi-audio-msg[data-share="${data.id}"] .psi-am-info > div`);
+                for (var i = 0; i < infos.length; i++) {
+                    infos[i].innerHTML = bars;
+                }
+                return;
             } else if (data.type == "receivehooks") {
                 var hooks = [];
                 for (var i = 0; i < data.hooks.length; i++) {
@@ -776,7 +806,119 @@ function initPsiTheme() {
                 }
             }
 
+            if (data.type == "prepend") {
+                prependObjects(data.items);
+                return;
+            }
+
             chat.adapter.receiveObject(data)
+            if (data.type == "message") {
+                updateChatLog(data);
+            } else if (data.type == "clear") {
+                chatLog.trimmed = false;
+                chatLog.requested = false;
+            }
+        },
+
+        // a batch of messages delivered in one bridge call (preloaded history, MUC backlog)
+        receiveObjects : function(list) {
+            deferredScrollers = [];
+            try {
+                for (var i = 0; i < list.length; i++) {
+                    chat.receiveObject(list[i]);
+                }
+            } finally {
+                var scrollers = deferredScrollers;
+                deferredScrollers = null;
+                for (var i = 0; i < scrollers.length; i++) {
+                    scrollers[i].invalidate();
+                }
+            }
+        }
+    }
+
+    // messages come as JSON text with the time in msecs since epoch
+    function parseMessage(json)
+    {
+        var data = JSON.parse(json);
+        if (typeof data.time === "number") {
+            data.time = new Date(data.time);
+        }
+        return data;
+    }
+
+    function chatContainer()
+    {
+        return chat.adapter.chatContainer? chat.adapter.chatContainer() : null;
+    }
+
+    // marks just rendered top-level elements with the message time
+    function tagMessages(el, data)
+    {
+        if (!data.time) {
+            return;
+        }
+        var ts = new Date(data.time).getTime();
+        for (; el && el.psiTime === undefined; el = el.previousElementSibling) {
+            el.psiTime = ts;
+        }
+    }
+
+    // keeps at most chatLog.limit top-level elements in the chat. it's trimmed only
+    // while the user is at the bottom. dropped messages are loaded back on scroll up
+    function updateChatLog(data)
+    {
+        var container = chatContainer();
+        if (!container) {
+            return;
+        }
+        tagMessages(container.lastElementChild, data);
+        if (!chatLog.limit || container.childElementCount <= chatLog.limit ||
+                (chat.adapter.atBottom && !chat.adapter.atBottom())) {
+            return;
+        }
+        while (container.childElementCount > chatLog.limit) {
+            container.removeChild(container.firstElementChild);
+        }
+        chatLog.trimmed = true;
+    }
+
+    // renders a page of older messages above the current ones keeping the scroll position
+    function prependObjects(items)
+    {
+        chatLog.requested = false;
+        var container = chatContainer();
+        if (!items.length || !container || !chat.adapter.beginPrepend) {
+            chatLog.trimmed = false;
+            return;
+        }
+        var height = document.body.scrollHeight;
+        var anchor = container.firstElementChild;
+        chat.adapter.beginPrepend(container.firstChild);
+        try {
+            for (var i = 0; i < items.length; i++) {
+                var item = typeof items[i] === "string"? parseMessage(items[i]) : items[i];
+                chat.adapter.receiveObject(item);
+                tagMessages(anchor? anchor.previousElementSibling : container.lastElementChild, item);
+            }
+        } finally {
+            chat.adapter.endPrepend();
+        }
+        window.scrollBy(0, document.body.scrollHeight - height);
+    }
+
+    function checkOlderMessages()
+    {
+        if (!chatLog.trimmed || chatLog.requested || window.pageYOffset > 0) {
+            return;
+        }
+        var container = chatContainer();
+        for (var el = container && container.firstElementChild; el; el = el.nextElementSibling) {
+            if (el.psiTime !== undefined) {
+                chatLog.requested = true;
+                session.requestOlderMessages(el.psiTime);
+                return;
+            }
         }
     }
 
@@ -809,6 +951,10 @@ function initPsiTheme() {
         var updateShowPreviews = function(value) { previewsEnabled = value;  }
         chat.util.psiOption("options.ui.chat.show-previews", updateShowPreviews);
         chat.util.connectOptionChange("options.ui.chat.show-previews", updateShowPreviews)
+        var updateLogLimit = function(value) { chatLog.limit = value; }
+        chat.util.psiOption("options.ui.chat.history.max-shown-messages", updateLogLimit);
+        chat.util.connectOptionChange("options.ui.chat.history.max-shown-messages", updateLogLimit)
+        window.addEventListener("scroll", checkOlderMessages, false);
     } catch(e) {
         server.console("Failed to initialize adapter:" + e + "(Line:" + e.line + ")");
         chat.adapter = {